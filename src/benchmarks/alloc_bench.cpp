@@ -0,0 +1,61 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <vector>
+
+#include "memory/alloc.h"
+#include "memory/area.h"
+
+// 小对象分配：SimpleFreeListAlloc(可以归还) / SimpleVectorAlloc(只分配不归还) / malloc，
+// Range给出每次分配的字节数，每一轮分配kBatch个对象
+namespace corekv {
+namespace {
+constexpr int32_t kBatch = 1024;
+
+void BM_FreeListAlloc(benchmark::State& state) {
+  const int32_t bytes = state.range(0);
+  SimpleFreeListAlloc alloc;
+  std::vector<void*> ptrs(kBatch);
+  for (auto _ : state) {
+    for (auto& p : ptrs) {
+      p = alloc.Allocate(bytes);
+    }
+    benchmark::ClobberMemory();
+    for (auto p : ptrs) {
+      alloc.Deallocate(p, bytes);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kBatch);
+}
+BENCHMARK(BM_FreeListAlloc)->RangeMultiplier(4)->Range(16, 4096);
+
+void BM_VectorAlloc(benchmark::State& state) {
+  const uint32_t bytes = state.range(0);
+  for (auto _ : state) {
+    // arena只能整体释放，所以每一轮重新构造
+    SimpleVectorAlloc alloc;
+    for (int32_t i = 0; i < kBatch; ++i) {
+      benchmark::DoNotOptimize(alloc.Allocate(bytes));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kBatch);
+}
+BENCHMARK(BM_VectorAlloc)->RangeMultiplier(4)->Range(16, 4096);
+
+void BM_Malloc(benchmark::State& state) {
+  const size_t bytes = state.range(0);
+  std::vector<void*> ptrs(kBatch);
+  for (auto _ : state) {
+    for (auto& p : ptrs) {
+      p = malloc(bytes);
+    }
+    benchmark::ClobberMemory();
+    for (auto p : ptrs) {
+      free(p);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kBatch);
+}
+BENCHMARK(BM_Malloc)->RangeMultiplier(4)->Range(16, 4096);
+}  // namespace
+}  // namespace corekv
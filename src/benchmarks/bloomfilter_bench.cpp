@@ -0,0 +1,55 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include "filter/bloomfilter.h"
+
+// 布隆过滤器的构建和查询，Range给出key的个数，每个key 10 bits
+namespace corekv {
+namespace {
+constexpr int32_t kBitsPerKey = 10;
+
+std::vector<std::string> MakeKeys(int64_t n, const char* prefix) {
+  std::vector<std::string> keys;
+  keys.reserve(n);
+  for (int64_t i = 0; i < n; ++i) {
+    keys.push_back(prefix + std::to_string(i));
+  }
+  return keys;
+}
+
+void BM_BloomFilterCreate(benchmark::State& state) {
+  const std::vector<std::string> keys = MakeKeys(state.range(0), "key");
+  for (auto _ : state) {
+    BloomFilter filter(kBitsPerKey);
+    filter.CreateFilter(keys.data(), keys.size());
+    benchmark::DoNotOptimize(filter.Data().data());
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_BloomFilterCreate)->Range(1 << 8, 1 << 16);
+
+// hit为1时查询存在的key，为0时查询不存在的key(主要是误判和提前返回的代价)
+void BM_BloomFilterMayMatch(benchmark::State& state) {
+  const std::vector<std::string> keys = MakeKeys(state.range(0), "key");
+  const std::vector<std::string> probes =
+      state.range(1) ? keys : MakeKeys(state.range(0), "miss");
+  BloomFilter filter(kBitsPerKey);
+  filter.CreateFilter(keys.data(), keys.size());
+  size_t index = 0;
+  int64_t matched = 0;
+  for (auto _ : state) {
+    matched += filter.MayMatch(probes[index], 0, 0);
+    if (++index == probes.size()) {
+      index = 0;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["match_rate"] =
+      static_cast<double>(matched) / state.iterations();
+}
+BENCHMARK(BM_BloomFilterMayMatch)
+    ->ArgsProduct({{1 << 10, 1 << 16}, {0, 1}});
+}  // namespace
+}  // namespace corekv
@@ -0,0 +1,48 @@
+#include <benchmark/benchmark.h>
+
+#include <memory>
+
+#include "cache/cache.h"
+
+// ShardCache的并发Get，Threads给出线程数，所有线程共享同一个cache；
+// key的个数是容量的两倍，一半左右的Get会miss并插入
+namespace corekv {
+namespace {
+constexpr uint64_t kCapacity = 64 * 1024;
+constexpr uint64_t kKeyNum = kCapacity * 2;
+
+std::unique_ptr<ShardCache<uint64_t, uint64_t>> cache;
+
+void BM_ShardCacheGet(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    cache = std::make_unique<ShardCache<uint64_t, uint64_t>>(kCapacity);
+    cache->RegistCleanHandle(
+        [](const uint64_t&, uint64_t* value) { delete value; });
+    for (uint64_t key = 0; key < kCapacity; ++key) {
+      cache->Insert(key, new uint64_t(key));
+    }
+  }
+  // 每个线程从不同的位置开始，用乘法打散访问顺序
+  uint64_t i = state.thread_index() * 7919;
+  int64_t hits = 0;
+  for (auto _ : state) {
+    const uint64_t key = (i++ * 2654435761u) % kKeyNum;
+    auto* node = cache->Get(key);
+    if (node != nullptr) {
+      ++hits;
+      cache->Release(node);
+    } else {
+      cache->Insert(key, new uint64_t(key));
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["hit_rate"] = benchmark::Counter(
+      static_cast<double>(hits) / state.iterations(),
+      benchmark::Counter::kAvgThreads);
+  if (state.thread_index() == 0) {
+    cache.reset();
+  }
+}
+BENCHMARK(BM_ShardCacheGet)->ThreadRange(1, 16)->UseRealTime();
+}  // namespace
+}  // namespace corekv
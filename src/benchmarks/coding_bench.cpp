@@ -0,0 +1,88 @@
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "utils/codec.h"
+#include "utils/crc32.h"
+
+// crc32c和varint编解码，这两个在每次读写entry和block的时候都会调用
+namespace corekv {
+namespace {
+void BM_Crc32Value(benchmark::State& state) {
+  const std::string data(state.range(0), 'x');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(crc32::Value(data.data(), data.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_Crc32Value)->RangeMultiplier(8)->Range(64, 1 << 20);
+
+// Arg为每个值的最大位数，决定varint的平均编码长度
+std::vector<uint32_t> RandomValues32(int bits) {
+  std::mt19937 rnd(301);
+  std::vector<uint32_t> values(4096);
+  for (auto& v : values) {
+    v = bits >= 32 ? rnd() : rnd() & ((1u << bits) - 1);
+  }
+  return values;
+}
+
+void BM_PutVarint32(benchmark::State& state) {
+  const std::vector<uint32_t> values = RandomValues32(state.range(0));
+  std::string dst;
+  dst.reserve(values.size() * 5);
+  for (auto _ : state) {
+    dst.clear();
+    for (uint32_t v : values) {
+      util::PutVarint32(&dst, v);
+    }
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK(BM_PutVarint32)->Arg(7)->Arg(14)->Arg(32);
+
+void BM_GetVarint32Ptr(benchmark::State& state) {
+  const std::vector<uint32_t> values = RandomValues32(state.range(0));
+  std::string src;
+  for (uint32_t v : values) {
+    util::PutVarint32(&src, v);
+  }
+  const char* limit = src.data() + src.size();
+  for (auto _ : state) {
+    const char* p = src.data();
+    uint32_t v = 0;
+    while (p < limit) {
+      p = util::GetVarint32Ptr(p, limit, &v);
+    }
+    benchmark::DoNotOptimize(v);
+  }
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK(BM_GetVarint32Ptr)->Arg(7)->Arg(14)->Arg(32);
+
+void BM_Varint64RoundTrip(benchmark::State& state) {
+  std::mt19937_64 rnd(301);
+  std::vector<uint64_t> values(4096);
+  for (auto& v : values) {
+    v = rnd() >> (rnd() % 64);
+  }
+  std::string buf;
+  for (auto _ : state) {
+    buf.clear();
+    for (uint64_t v : values) {
+      util::PutVarint64(&buf, v);
+    }
+    std::string_view input(buf);
+    uint64_t v = 0;
+    while (util::GetVarint64(&input, &v)) {
+    }
+    benchmark::DoNotOptimize(v);
+  }
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK(BM_Varint64RoundTrip);
+}  // namespace
+}  // namespace corekv
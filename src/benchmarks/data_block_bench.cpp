@@ -0,0 +1,78 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "db/comparator.h"
+#include "db/iterator.h"
+#include "db/options.h"
+#include "table/block_builder.h"
+#include "table/data_block.h"
+
+// data block的构建和block内的Seek，Range给出block中entry的个数
+namespace corekv {
+namespace {
+std::vector<std::string> SortedKeys(int64_t n) {
+  std::vector<std::string> keys;
+  keys.reserve(n);
+  char buf[32];
+  for (int64_t i = 0; i < n; ++i) {
+    snprintf(buf, sizeof(buf), "user_key_%08lld", static_cast<long long>(i));
+    keys.emplace_back(buf);
+  }
+  return keys;
+}
+
+void BM_DataBlockBuilderAdd(benchmark::State& state) {
+  const std::vector<std::string> keys = SortedKeys(state.range(0));
+  const std::string value(100, 'v');
+  Options options;
+  options.comparator = std::make_shared<ByteComparator>();
+  DataBlockBuilder builder(&options);
+  for (auto _ : state) {
+    builder.Reset();
+    for (const auto& key : keys) {
+      builder.Add(key, value);
+    }
+    builder.Finish();
+    benchmark::DoNotOptimize(builder.Data().data());
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_DataBlockBuilderAdd)->Range(16, 1024);
+
+void BM_DataBlockSeek(benchmark::State& state) {
+  const std::vector<std::string> keys = SortedKeys(state.range(0));
+  const std::string value(100, 'v');
+  Options options;
+  auto comparator = std::make_shared<ByteComparator>();
+  options.comparator = comparator;
+  DataBlockBuilder builder(&options);
+  for (const auto& key : keys) {
+    builder.Add(key, value);
+  }
+  builder.Finish();
+  DataBlock block(std::string(builder.Data()));
+  std::unique_ptr<Iterator> iter(block.NewIterator(comparator));
+  std::vector<size_t> order(keys.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::shuffle(order.begin(), order.end(), std::mt19937(301));
+  size_t index = 0;
+  for (auto _ : state) {
+    iter->Seek(keys[order[index]]);
+    benchmark::DoNotOptimize(iter->Valid());
+    if (++index == order.size()) {
+      index = 0;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DataBlockSeek)->Range(16, 1024);
+}  // namespace
+}  // namespace corekv
@@ -0,0 +1,92 @@
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "db/comparator.h"
+#include "db/skiplist.h"
+#include "memory/area.h"
+
+// SkipList的插入和点查，key数量由Range给出
+namespace corekv {
+namespace {
+struct U64Comparator {
+  int32_t Compare(uint64_t a, uint64_t b) const {
+    return a < b ? -1 : (a > b ? 1 : 0);
+  }
+};
+using U64List = SkipList<uint64_t, U64Comparator, SimpleVectorAlloc>;
+
+std::vector<uint64_t> RandomKeys(int64_t n) {
+  std::mt19937_64 rnd(301);
+  std::vector<uint64_t> keys(n);
+  for (auto& key : keys) {
+    key = rnd();
+  }
+  return keys;
+}
+
+void BM_SkipListInsert(benchmark::State& state) {
+  const std::vector<uint64_t> keys = RandomKeys(state.range(0));
+  for (auto _ : state) {
+    // 每一轮使用新的skiplist，构造的时间不计入
+    state.PauseTiming();
+    auto list = std::make_unique<U64List>(U64Comparator());
+    state.ResumeTiming();
+    for (uint64_t key : keys) {
+      list->Insert(key);
+    }
+    state.PauseTiming();
+    list.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_SkipListInsert)->Range(1 << 10, 1 << 18);
+
+void BM_SkipListContains(benchmark::State& state) {
+  const std::vector<uint64_t> keys = RandomKeys(state.range(0));
+  U64List list((U64Comparator()));
+  for (uint64_t key : keys) {
+    list.Insert(key);
+  }
+  size_t index = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(list.Contains(keys[index]));
+    if (++index == keys.size()) {
+      index = 0;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SkipListContains)->Range(1 << 10, 1 << 20);
+
+// 字符串key走ByteComparator，和memtable中的比较方式接近
+void BM_SkipListInsertString(benchmark::State& state) {
+  const int64_t n = state.range(0);
+  std::vector<std::string> keys;
+  keys.reserve(n);
+  std::mt19937_64 rnd(301);
+  for (int64_t i = 0; i < n; ++i) {
+    keys.push_back("key" + std::to_string(rnd()));
+  }
+  ByteComparator comparator;
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto list = std::make_unique<
+        SkipList<const char*, ByteComparator, SimpleVectorAlloc>>(comparator);
+    state.ResumeTiming();
+    for (const auto& key : keys) {
+      list->Insert(key.c_str());
+    }
+    state.PauseTiming();
+    list.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_SkipListInsertString)->Range(1 << 10, 1 << 16);
+}  // namespace
+}  // namespace corekv
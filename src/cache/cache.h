@@ -1,12 +1,19 @@
 #pragma once
 #include <stdint.h>
 
+#include <algorithm>
+#include <atomic>
 #include <functional>
-#include <string>
 #include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include "../memory/area.h"
+#include "../utils/hash_util.h"
+#include "clock.h"
 #include "lru.h"
+#include "wtinylfu.h"
 
 namespace corekv {
 template <typename KeyType, typename ValueType>
@@ -15,12 +22,29 @@ class Cache {
   Cache() = default;
   virtual ~Cache() = default;
   virtual const char* Name() const = 0;
-  virtual void Insert(const KeyType& key, ValueType* value,
+  virtual void Insert(const KeyType& key, ValueType* value, size_t charge = 1,
                       uint32_t ttl = 0) = 0;
+  // 插入之后返回持有引用的节点，使用完之后需要调用Release
+  virtual CacheNode<KeyType, ValueType>* InsertAndRef(const KeyType& key,
+                                                      ValueType* value,
+                                                      size_t charge = 1,
+                                                      uint32_t ttl = 0) = 0;
   virtual CacheNode<KeyType, ValueType>* Get(const KeyType& key) = 0;
   virtual void Release(CacheNode<KeyType, ValueType>* node) = 0;
   virtual void Prune() = 0;
   virtual void Erase(const KeyType& key) = 0;
+  virtual size_t GetUsage() const = 0;
+  virtual size_t GetPinnedUsage() const = 0;
+  // 对缓存中的每个key调用fn，见CachePolicy::ApplyToAllKeys
+  virtual void ApplyToAllKeys(
+      const std::function<void(const KeyType& key)>& fn) const = 0;
+  // 分配一个新的id，多个使用者共享同一个缓存的时候用作key的前缀，避免冲突
+  virtual uint64_t NewId() = 0;
+  // key所在分片的内存分配器，value的数据从这里申请可以和分片放在同一个NUMA节点的大页上，
+  // 释放的时候还给同一个分配器；没有配置的时候返回nullptr
+  virtual PageSlabAlloc* ShardAllocator(const KeyType& /*key*/) {
+    return nullptr;
+  }
   virtual void RegistCleanHandle(
       std::function<void(const KeyType& key, ValueType* value)> destructor) = 0;
 };
@@ -29,15 +53,43 @@ class Cache {
 Cache* base = new Cache();
 delete base;
 */
-// 在这里使用分片方式来处理缓存
-template <typename KeyType, typename ValueType>
+// 在这里使用分片方式来处理缓存，每个分片有自己的锁，不同分片之间的访问互不影响
+// PolicyType决定每个分片的淘汰策略，例如
+//   options.block_cache =
+//       new ShardCache<uint64_t, DataBlock, WTinyLfuCachePolicy>(capacity);
+template <typename KeyType, typename ValueType,
+          template <typename, typename, typename> class PolicyType =
+              LruCachePolicy>
 class ShardCache final : public Cache<KeyType, ValueType> {
  public:
-  ShardCache() = default;
-  ShardCache(uint32_t capacity) {
-    for (int32_t index = 0; index < kShardNum; ++index) {
-      cache_impl_[index] =
-          std::make_shared<LruCachePolicy<KeyType, ValueType, MutexLock>>(capacity);
+  // capacity为所有分片的总容量(charge之和)，shard_num为0时根据cpu核数决定分片个数
+  // huge_page_size或者numa_nodes大于0的时候每个分片有自己的PageSlabAlloc，
+  // 第i个分片绑定到i % numa_nodes号节点上，numa_nodes为0时不绑定，例如
+  //   new ShardCache<uint64_t, DataBlock>(capacity, 0, 2 << 20, NumaNodeCount());
+  explicit ShardCache(size_t capacity, uint32_t shard_num = 0,
+                      size_t huge_page_size = 0, int32_t numa_nodes = 0) {
+    if (shard_num == 0) {
+      shard_num = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // 分片个数取2的幂，计算分片的时候只需要取hash的高位
+    while ((1u << shard_bits_) < shard_num && shard_bits_ < kMaxShardBits) {
+      ++shard_bits_;
+    }
+    const uint32_t num = 1u << shard_bits_;
+    const size_t per_shard = (capacity + num - 1) / num;
+    cache_impl_.reserve(num);
+    for (uint32_t index = 0; index < num; ++index) {
+      cache_impl_.emplace_back(
+          std::make_unique<PolicyType<KeyType, ValueType, MutexLock>>(
+              per_shard));
+    }
+    if (huge_page_size > 0 || numa_nodes > 0) {
+      allocators_.reserve(num);
+      for (uint32_t index = 0; index < num; ++index) {
+        allocators_.emplace_back(std::make_unique<PageSlabAlloc>(
+            huge_page_size,
+            numa_nodes > 0 ? static_cast<int32_t>(index % numa_nodes) : -1));
+      }
     }
   }
   /*
@@ -45,42 +97,80 @@ class ShardCache final : public Cache<KeyType, ValueType> {
   data block:具体数据指针
   */
   ~ShardCache() = default;
-  const char* Name() const {
-      return "shard.cache";
+  const char* Name() const { return "shard.cache"; }
+  uint32_t ShardNum() const { return cache_impl_.size(); }
+  void Insert(const KeyType& key, ValueType* value, size_t charge = 1,
+              uint32_t ttl = 0) {
+    Shard(key)->Insert(key, value, charge, ttl);
   }
-  void Insert(const KeyType& key, ValueType* value, uint32_t ttl = 0) {
-    uint64_t shard_num = std::hash<KeyType>{}(key) % kShardNum;
-    cache_impl_[shard_num]->Insert(key, value, ttl);
+  CacheNode<KeyType, ValueType>* InsertAndRef(const KeyType& key,
+                                              ValueType* value,
+                                              size_t charge = 1,
+                                              uint32_t ttl = 0) {
+    return Shard(key)->InsertAndRef(key, value, charge, ttl);
   }
   CacheNode<KeyType, ValueType>* Get(const KeyType& key) {
-    uint64_t shard_num = std::hash<KeyType>{}(key) % kShardNum;
-    return cache_impl_[shard_num]->Get(key);
+    return Shard(key)->Get(key);
   }
   void Release(CacheNode<KeyType, ValueType>* node) {
-    uint64_t shard_num = std::hash<KeyType>{}(node->key) % kShardNum;
-    return cache_impl_[shard_num]->Release(node);
+    return Shard(node->key)->Release(node);
   }
   void Prune() {
-    for (int32_t index = 0; index < kShardNum; ++index) {
-      cache_impl_[index]->Prune();
+    for (auto& impl : cache_impl_) {
+      impl->Prune();
     }
   }
-  void Erase(const KeyType& key) {
-    uint64_t shard_num = std::hash<KeyType>{}(key) % kShardNum;
-    return cache_impl_[shard_num]->Erase(key);
+  void Erase(const KeyType& key) { return Shard(key)->Erase(key); }
+  size_t GetUsage() const {
+    size_t usage = 0;
+    for (const auto& impl : cache_impl_) {
+      usage += impl->GetUsage();
+    }
+    return usage;
+  }
+  size_t GetPinnedUsage() const {
+    size_t usage = 0;
+    for (const auto& impl : cache_impl_) {
+      usage += impl->GetPinnedUsage();
+    }
+    return usage;
+  }
+  void ApplyToAllKeys(const std::function<void(const KeyType& key)>& fn) const {
+    for (const auto& impl : cache_impl_) {
+      impl->ApplyToAllKeys(fn);
+    }
+  }
+  uint64_t NewId() { return ++last_id_; }
+  PageSlabAlloc* ShardAllocator(const KeyType& key) {
+    return allocators_.empty() ? nullptr : allocators_[ShardIndex(key)].get();
   }
   void RegistCleanHandle(
       std::function<void(const KeyType& key, ValueType* value)> destructor) {
-    for (int32_t index = 0; index < kShardNum; ++index) {
-      cache_impl_[index]->RegistCleanHandle(destructor);
+    for (auto& impl : cache_impl_) {
+      impl->RegistCleanHandle(destructor);
     }
   }
 
  private:
-  // 默认分为5个shard
-  static constexpr uint8_t kShardNum = 4;
+  uint32_t ShardIndex(const KeyType& key) const {
+    if (shard_bits_ == 0) {
+      return 0;
+    }
+    // 和分片内的哈希表使用同一个hash，分片取高位
+    const uint64_t hash = hash_util::HashKey(key);
+    return hash >> (64 - shard_bits_);
+  }
+  CachePolicy<KeyType, ValueType>* Shard(const KeyType& key) const {
+    return cache_impl_[ShardIndex(key)].get();
+  }
+
+  static constexpr uint32_t kMaxShardBits = 8;
+  uint32_t shard_bits_ = 0;
+  std::atomic<uint64_t> last_id_{0};
+  // 每个分片的value数据分配器，需要比cache_impl_后析构，淘汰剩下的value时还会释放数据
+  std::vector<std::unique_ptr<PageSlabAlloc>> allocators_;
   // 采用impl的机制来进行实现
-  std::vector<std::shared_ptr<CachePolicy<KeyType, ValueType>>> cache_impl_;
+  std::vector<std::unique_ptr<CachePolicy<KeyType, ValueType>>> cache_impl_;
 };
 
 }  // namespace corekv
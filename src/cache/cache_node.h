@@ -1,4 +1,8 @@
 #pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
 #include <functional>
 namespace corekv {
 template <typename KeyType, typename ValueType>
@@ -6,15 +10,24 @@ struct CacheNode {
   // key的话我们保证他是深度复制的
   KeyType key;
   ValueType* value;
-  // 引用计数，
-  uint32_t refs = 0;
+  // 引用计数，CLOCK策略中会在读锁下并发修改
+  std::atomic<uint32_t> refs{0};
+  // 占用的容量，一般是value的字节数
+  size_t charge = 1;
   uint32_t hash = 0;
   // 默认不再缓存中
   bool in_cache = false;
+  // 节点当前所在的队列，由缓存策略自己定义含义
+  uint8_t queue = 0;
+  // CLOCK策略中的访问标记，命中的时候不加写锁直接设置
+  std::atomic<bool> referenced{false};
   // 最近一次更新的时间
   uint64_t last_access_time = 0;
   // 有效周期
   uint64_t ttl = 0;
+  // 由缓存策略使用的侵入式双向链表指针，避免额外分配链表节点
+  CacheNode* prev = nullptr;
+  CacheNode* next = nullptr;
 };
 
 }  // namespace corekv
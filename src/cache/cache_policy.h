@@ -1,4 +1,7 @@
 #pragma once
+#include <stddef.h>
+#include <stdint.h>
+
 #include <functional>
 
 #include "cache_node.h"
@@ -7,12 +10,26 @@ template <typename KeyType, typename ValueType>
 class CachePolicy {
  public:
   virtual ~CachePolicy() = default;
-  virtual void Insert(const KeyType& key, ValueType* value,
+  // charge为节点占用的容量，缓存中所有节点的charge之和不超过capacity
+  virtual void Insert(const KeyType& key, ValueType* value, size_t charge = 1,
                       uint32_t ttl = 0) = 0;
+  // 插入之后返回持有引用的节点，使用完之后需要调用Release
+  // 节点因为容量不足没有被缓存的时候也会返回，Release之后释放
+  virtual CacheNode<KeyType, ValueType>* InsertAndRef(const KeyType& key,
+                                                      ValueType* value,
+                                                      size_t charge = 1,
+                                                      uint32_t ttl = 0) = 0;
   virtual CacheNode<KeyType, ValueType>* Get(const KeyType& key) = 0;
   virtual void Release(CacheNode<KeyType, ValueType>* node) = 0;
   virtual void Prune() = 0;
   virtual void Erase(const KeyType& key) = 0;
+  // 缓存中所有节点的charge之和
+  virtual size_t GetUsage() const = 0;
+  // 被外部引用的节点的charge之和，包括已经被淘汰但是还没有Release的节点
+  virtual size_t GetPinnedUsage() const = 0;
+  // 对缓存中的每个key调用fn，越近被访问的越先调用；fn在锁内执行，不能再访问这个缓存
+  virtual void ApplyToAllKeys(
+      const std::function<void(const KeyType& key)>& fn) const = 0;
   virtual void RegistCleanHandle(
       std::function<void(const KeyType& key, ValueType* value)> destructor) = 0;
 };
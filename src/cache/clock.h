@@ -0,0 +1,210 @@
+#pragma once
+#include <assert.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+
+#include "../utils/mutex.h"
+#include "../utils/util.h"
+#include "cache_node.h"
+#include "cache_policy.h"
+#include "node_table.h"
+namespace corekv {
+/*
+ * CLOCK: 所有节点串成一个环，命中的时候只设置节点的referenced标记，不移动节点
+ * 淘汰的时候从hand_开始扫描，referenced的节点清除标记之后跳过，否则淘汰，
+ * 新节点插入到hand_之前，也就是下一轮扫描的最后一个位置
+ *
+ * Get和Release只持有读锁，多个线程可以同时命中同一个分片；
+ * 引用计数、pinned_usage_和referenced都是原子变量，
+ * Insert/Erase/Prune以及节点的释放需要修改哈希表和环，持有写锁
+ * LockType只是为了和ShardCache的模板参数保持一致，内部固定使用读写锁
+ */
+template <typename KeyType, typename ValueType, typename LockType = NullLock>
+class ClockCachePolicy final : public CachePolicy<KeyType, ValueType> {
+  using Node = CacheNode<KeyType, ValueType>;
+  using Table = NodeTable<KeyType, ValueType>;
+
+ public:
+  explicit ClockCachePolicy(size_t capacity) : capacity_(capacity) {
+    hand_ = nodes_.End();
+  }
+  // 走到这里的时候，所有的节点都应该已经被Release了
+  ~ClockCachePolicy() {
+    while (!nodes_.Empty()) {
+      FinishErase(nodes_.Front());
+    }
+  }
+  void Insert(const KeyType& key, ValueType* value, size_t charge = 1,
+              uint32_t ttl = 0) {
+    ScopedLockImpl<RWLock> lock_guard(lock_);
+    InsertNode(key, value, charge, ttl, false);
+  }
+  Node* InsertAndRef(const KeyType& key, ValueType* value, size_t charge = 1,
+                     uint32_t ttl = 0) {
+    ScopedLockImpl<RWLock> lock_guard(lock_);
+    return InsertNode(key, value, charge, ttl, true);
+  }
+  Node* Get(const KeyType& key) {
+    ScopedReadLockImpl<RWLock> lock_guard(lock_);
+    Node* node = table_.Find(key, Table::HashOf(key));
+    if (node == nullptr) {
+      return nullptr;
+    }
+    // 已经设置过的时候不再写，避免热点节点的cache line在核之间来回失效
+    if (!node->referenced.load(std::memory_order_relaxed)) {
+      node->referenced.store(true, std::memory_order_relaxed);
+    }
+    if (node->refs.fetch_add(1) == 1) {
+      pinned_usage_.fetch_add(node->charge, std::memory_order_relaxed);
+    }
+    return node;
+  }
+  // 默认的析构函数
+  void RegistCleanHandle(
+      std::function<void(const KeyType& key, ValueType* value)> destructor) {
+    ScopedLockImpl<RWLock> lock_guard(lock_);
+    destructor_ = destructor;
+  }
+  void Release(Node* node) {
+    {
+      // in_cache只会在写锁下修改，读锁下可以直接判断
+      ScopedReadLockImpl<RWLock> lock_guard(lock_);
+      assert(node->refs > 0);
+      const uint32_t refs = node->refs.fetch_sub(1);
+      if (refs == (node->in_cache ? 2u : 1u)) {
+        pinned_usage_.fetch_sub(node->charge, std::memory_order_relaxed);
+      }
+      if (refs != 1) {
+        return;
+      }
+    }
+    // 最后一个引用，节点已经不在缓存中了，其他线程不会再访问它
+    ScopedLockImpl<RWLock> lock_guard(lock_);
+    FreeNode(node);
+  }
+  // 回收所有没有被外部引用的节点
+  void Prune() {
+    ScopedLockImpl<RWLock> lock_guard(lock_);
+    for (Node* node = nodes_.Front(); node != nullptr && node != nodes_.End();) {
+      Node* next = node->next;
+      if (node->refs == 1) {
+        FinishErase(node);
+      }
+      node = next;
+    }
+  }
+  // 删除某个key对应的节点
+  void Erase(const KeyType& key) {
+    ScopedLockImpl<RWLock> lock_guard(lock_);
+    Node* node = table_.Find(key, Table::HashOf(key));
+    if (node != nullptr) {
+      FinishErase(node);
+    }
+  }
+  size_t GetUsage() const {
+    ScopedReadLockImpl<RWLock> lock_guard(lock_);
+    return nodes_.Charge();
+  }
+  size_t GetPinnedUsage() const {
+    return pinned_usage_.load(std::memory_order_relaxed);
+  }
+  // 环上没有访问顺序，按照环上的位置依次调用
+  void ApplyToAllKeys(const std::function<void(const KeyType& key)>& fn) const {
+    ScopedReadLockImpl<RWLock> lock_guard(lock_);
+    for (const Node* node = nodes_.Front();
+         node != nullptr && node != nodes_.End(); node = node->next) {
+      fn(node->key);
+    }
+  }
+
+ private:
+  // 插入新节点，需要持有锁，ref为true时返回的节点额外持有一个引用
+  Node* InsertNode(const KeyType& key, ValueType* value, size_t charge,
+                   uint32_t ttl, bool ref) {
+    const uint32_t hash = Table::HashOf(key);
+    Node* old = table_.Find(key, hash);
+    if (old != nullptr) {
+      // 已经有相同的key，旧的节点直接从缓存中移除
+      FinishErase(old);
+    }
+    Node* node = pool_.New();
+    node->hash = hash;
+    node->key = key;
+    node->value = value;
+    node->charge = charge;
+    node->refs = 1;
+    node->referenced.store(false, std::memory_order_relaxed);
+    node->ttl = ttl;
+    node->last_access_time = ttl > 0 ? util::GetCurrentTime() : 0;
+    if (charge > capacity_) {
+      // 单个节点就超过了容量，不缓存，需要返回引用的时候由调用方Release之后释放
+      node->in_cache = false;
+      if (!ref) {
+        FreeNode(node);
+        return nullptr;
+      }
+      pinned_usage_ += charge;
+      return node;
+    }
+    while (nodes_.Charge() + charge > capacity_) {
+      Evict();
+    }
+    node->in_cache = true;
+    table_.Insert(node);
+    nodes_.InsertBefore(hand_, node);
+    if (ref) {
+      node->refs++;
+      pinned_usage_ += charge;
+    }
+    return node;
+  }
+
+  // 转动一次时钟指针，需要持有写锁，调用者保证环不为空
+  // 每个节点最多被跳过一次，所以最多转两圈就能淘汰一个节点
+  void Evict() {
+    assert(!nodes_.Empty());
+    if (hand_ == nodes_.End()) {
+      hand_ = hand_->next;
+    }
+    Node* node = hand_;
+    hand_ = node->next;
+    if (node->referenced.load(std::memory_order_relaxed)) {
+      node->referenced.store(false, std::memory_order_relaxed);
+      return;
+    }
+    FinishErase(node);
+  }
+  void FreeNode(Node* node) {
+    assert(!node->in_cache);
+    if (destructor_) {
+      destructor_(node->key, node->value);
+    }
+    pool_.Free(node);
+  }
+  // 从哈希表和环中摘除节点并释放缓存持有的引用，需要持有写锁
+  void FinishErase(Node* node) {
+    if (hand_ == node) {
+      hand_ = node->next;
+    }
+    table_.Remove(node);
+    nodes_.Remove(node);
+    node->in_cache = false;
+    if (--node->refs == 0) {
+      FreeNode(node);
+    }
+  }
+
+ private:
+  const size_t capacity_;
+  mutable RWLock lock_;
+  std::atomic<size_t> pinned_usage_{0};
+  Table table_;
+  // 环上的节点按照插入顺序排列，哨兵节点只是一个占位，扫描时跳过
+  NodeList<KeyType, ValueType> nodes_;
+  Node* hand_;
+  NodePool<KeyType, ValueType> pool_;
+  std::function<void(const KeyType& key, ValueType* value)> destructor_;
+};
+}  // namespace corekv
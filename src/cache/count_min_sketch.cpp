@@ -1,84 +1,64 @@
 #include "count_min_sketch.h"
 
 #include <algorithm>
+#include <limits>
 
-#include "../utils/random_util.h"
 namespace corekv {
-
-void CountMinSketch::SingleGroup::Init(uint32_t counter_num) {
-  if (counter_num == 0) {
-    counter_num = 1;
-  }
-  base_.resize(counter_num);
-}
-void CountMinSketch::SingleGroup::Increment(uint32_t counter_index) {
-  if (base_.empty()) {
-    return;
-  }
-  auto value = base_[counter_index].to_ulong();
-  // 这里15表示的是4bit，最大值为15，
-  if (!base_[counter_index].all()) {
-    CounterType tmp(value + 1);
-    base_[counter_index] = tmp;
-  }
-}
-void CountMinSketch::SingleGroup::Reset() {
-  for (auto& item : base_) {
-    auto value = item.to_ulong();
-    value = value >> 1 & 0x0111;
-    CounterType tmp(value);
-    item = tmp;
-  }
-}
-void CountMinSketch::SingleGroup::Clear() {
-  for (auto& item : base_) {
-    item.reset();
+CountMinSketch::CountMinSketch(uint32_t counter_num) {
+  // block的个数取2的幂，每个block中每一行有kCountersPerDepth个counter
+  while ((1u << block_bits_) * kCountersPerDepth < counter_num &&
+         block_bits_ < 31) {
+    ++block_bits_;
   }
+  blocks_.resize(1u << block_bits_);
 }
-int32_t CountMinSketch::SingleGroup::Get(uint32_t counter_index) {
-  static constexpr int32_t kEmpty = 0;
-  if (base_.empty()) {
-    return kEmpty;
-  }
-  const auto& value = base_[counter_index].to_ulong();
-  return value;
+
+const CountMinSketch::Block& CountMinSketch::BlockOf(uint32_t hash_val,
+                                                     uint64_t* spread) const {
+  const uint64_t h = static_cast<uint64_t>(hash_val) * 0x9E3779B97F4A7C15ull;
+  // 高位用来选择block，低位再打散一次用来选择每一行的counter
+  const uint64_t block = block_bits_ == 0 ? 0 : h >> (64 - block_bits_);
+  *spread = (h ^ (h >> 29)) * 0xBF58476D1CE4E5B9ull;
+  return blocks_[block];
 }
 
-// CountMinSketch
-CountMinSketch::CountMinSketch(uint32_t counter_num) {
-  if (counter_num > 0) {
-    mask_ = counter_num - 1;
-    RandomUtil rand_util;
-    std::for_each(groups_.begin(), groups_.end(),
-                  [counter_num](SingleGroup& base) { base.Init(counter_num); });
-    std::for_each(seeds_.begin(), seeds_.end(), [&rand_util](uint64_t& seed) {
-      seed = static_cast<uint64_t>(rand_util.GetSimpleRandomNum());
-    });
+void CountMinSketch::Increment(uint32_t hash_val) {
+  uint64_t spread;
+  Block& block = const_cast<Block&>(BlockOf(hash_val, &spread));
+  for (uint32_t depth = 0; depth < kCmsDepth; ++depth) {
+    const uint32_t index = (spread >> (depth * 8)) % kCountersPerDepth;
+    uint64_t& word = block.words[depth * kWordsPerDepth + index / 16];
+    const uint32_t shift = (index % 16) * 4;
+    // 4bit的counter最大值为15，达到之后不再增加
+    if (((word >> shift) & 0xF) != 0xF) {
+      word += 1ull << shift;
+    }
   }
 }
 
-int32_t CountMinSketch::Estimate(uint32_t hash_val) {
-  int32_t min_val = 0;
-  for (int32_t index = 0; index < kCmsDepth; ++index) {
-    min_val = std::min(groups_[index].Get((hash_val ^ seeds_[index]) & mask_),
+int32_t CountMinSketch::Estimate(uint32_t hash_val) const {
+  uint64_t spread;
+  const Block& block = BlockOf(hash_val, &spread);
+  int32_t min_val = std::numeric_limits<int32_t>::max();
+  for (uint32_t depth = 0; depth < kCmsDepth; ++depth) {
+    const uint32_t index = (spread >> (depth * 8)) % kCountersPerDepth;
+    const uint64_t word = block.words[depth * kWordsPerDepth + index / 16];
+    min_val = std::min(static_cast<int32_t>((word >> ((index % 16) * 4)) & 0xF),
                        min_val);
   }
   return min_val;
 }
-void CountMinSketch::Increment(uint32_t hash_val) {
-  for (int32_t index = 0; index < kCmsDepth; ++index) {
-    groups_[index].Increment((hash_val ^ seeds_[index]) & mask_);
-  }
-}
+
 // 大于某个阈值之后，会进行降级操作
 void CountMinSketch::Reset() {
-  for (int32_t index = 0; index < kCmsDepth; ++index) {
-    groups_[index].Reset();
+  for (auto& block : blocks_) {
+    for (auto& word : block.words) {
+      // 每个counter右移一位，去掉从高位counter移过来的bit
+      word = (word >> 1) & 0x7777777777777777ull;
+    }
   }
 }
 void CountMinSketch::Clear() {
-  for (int32_t index = 0; index < kCmsDepth; ++index) {
-    groups_[index].Clear();
-  }
+  std::fill(blocks_.begin(), blocks_.end(), Block());
 }
 }  // namespace corekv
@@ -1,49 +1,41 @@
 #pragma once
 #include <stdint.h>
 
-#include <array>
-#include <bitset>
 #include <vector>
 namespace corekv {
-// CountMinSketch简称cms算法
+/*
+ * CountMinSketch简称cms算法，这里使用分块的实现:
+ * 1. 每个counter占4bit，一个uint64_t中打包16个counter
+ * 2. 8个uint64_t组成一个按照cache line对齐的64字节block，每一行(depth)占用其中2个word
+ * 3. 一个key的所有行都落在同一个block中，Increment/Estimate只访问一个cache line
+ */
 class CountMinSketch final {
   static constexpr uint8_t kCmsDepth = 4;
 
  public:
+  // counter_num为每一行大约需要的counter个数
   explicit CountMinSketch(uint32_t counter_num);
   ~CountMinSketch() = default;
   void Increment(uint32_t hash_val);
+  // 所有的counter减半
   void Reset();
   void Clear();
   // 每次取出最小的那个值
-  int32_t Estimate(uint32_t hash_val);
+  int32_t Estimate(uint32_t hash_val) const;
 
  private:
-  class SingleGroup final {
-    // 4bit作为一个counter，char是1个字节，等于8位，相当于是2个counter
-    static constexpr uint8_t kCounterBitLen = 4;
-    using CounterType = std::bitset<kCounterBitLen>;
-    // 每一行一组
-   public:
-    SingleGroup(uint32_t counter_num) {
-        Init(counter_num);
-    }
-    SingleGroup() = default;
-    ~SingleGroup() = default;
-    void Init(uint32_t counter_num);
-    void Increment(uint32_t counter_index);
-    void Reset();
-    void Clear();
-    int32_t Get(uint32_t counter_index);
-
-   private:
-    std::vector<CounterType> base_;
+  static constexpr uint32_t kWordsPerBlock = 8;
+  static constexpr uint32_t kWordsPerDepth = kWordsPerBlock / kCmsDepth;
+  // 一行在一个block中的counter个数
+  static constexpr uint32_t kCountersPerDepth = kWordsPerDepth * 16;
+  struct alignas(64) Block {
+    uint64_t words[kWordsPerBlock] = {0};
   };
+  // 计算hash_val所在的block，以及每一行的counter在block中的位置
+  const Block& BlockOf(uint32_t hash_val, uint64_t* spread) const;
 
- private:
-  uint32_t mask_;
-  std::array<uint64_t, kCmsDepth> seeds_;
-  std::array<SingleGroup, kCmsDepth> groups_;
+  uint32_t block_bits_ = 0;
+  std::vector<Block> blocks_;
 };
 
 }  // namespace corekv
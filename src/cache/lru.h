@@ -1,166 +1,184 @@
 #pragma once
+#include <assert.h>
+#include <stdint.h>
+
 #include <functional>
-#include <list>
-#include <string>
-#include <type_traits>
-#include <unordered_map>
-#include <iostream>
 
-#include "../utils/hash_util.h"
 #include "../utils/mutex.h"
 #include "../utils/util.h"
 #include "cache_node.h"
 #include "cache_policy.h"
+#include "node_table.h"
 namespace corekv {
+/*
+ * 侵入式的LRU: 节点通过自身的prev/next串成链表，索引是开放寻址的哈希表，
+ * 引用计数归零的节点放回NodePool复用，Get只需要一次探测和一次链表摘挂
+ *
+ * 每个节点被缓存本身持有一个引用，每次Get再增加一个引用，Release的时候减少
+ * 节点被淘汰或者删除之后不再能被Get到，但是要等到所有的引用都释放之后才真正析构
+ * 容量按照charge计算，插入之后从链表尾部开始淘汰，直到所有节点的charge之和不超过容量
+ * lock_是类的成员，所有的public接口都在lock_的保护下执行
+ */
 template <typename KeyType, typename ValueType, typename LockType = NullLock>
 class LruCachePolicy final : public CachePolicy<KeyType, ValueType> {
-  using ListIter = typename std::list<CacheNode<KeyType, ValueType>*>::iterator;
+  using Node = CacheNode<KeyType, ValueType>;
+  using Table = NodeTable<KeyType, ValueType>;
 
  public:
-  LruCachePolicy(uint32_t capacity) : capacity_(capacity) {}
-  // 其实走到这里，说明整个程序都结束了
+  explicit LruCachePolicy(size_t capacity) : capacity_(capacity) {}
+  // 走到这里的时候，所有的节点都应该已经被Release了
   ~LruCachePolicy() {
-    for (auto it = nodes_.begin(); it != nodes_.end(); it++) {
-      // Unref(it);
+    while (!nodes_.Empty()) {
+      FinishErase(nodes_.Front());
     }
   }
-  void Insert(const KeyType& key, ValueType* value, uint32_t ttl = 0) {
-    LockType lock_type;
-    ScopedLockImpl<LockType> lock_guard(lock_type);
-    CacheNode<KeyType, ValueType>* new_node =
-        new CacheNode<KeyType, ValueType>();
-    new_node->hash = std::hash<KeyType>{}(key);
-    new_node->key = key;
-    new_node->value = value;
-    new_node->in_cache = true;
-    new_node->refs = 1;
-    new_node->ttl = ttl;
-    if (ttl > 0) {
-      new_node->last_access_time = util::GetCurrentTime();
-    }
-    typename std::unordered_map<
-        KeyType,
-        typename std::list<CacheNode<KeyType, ValueType>*>::iterator>::iterator
-        iter = index_.find(key);
-    //首先判断是否有相同的key在缓存中
-    if (iter == index_.end()) {
-      //淘汰最后一个，然后将其加到第一个位置
-      if (nodes_.size() == capacity_) {
-        CacheNode<KeyType, ValueType>* node = nodes_.back();
-        index_.erase(node->key);
-        nodes_.pop_back();
-        FinishErase(node);
-      }
-      nodes_.push_front(new_node);
-      index_[key] = nodes_.begin();
-    } else {
-      //说明已经存在有新的值
-      //更新节点的值，并将其加到第一个位置
-      FinishErase(*(iter->second));
-      nodes_.splice(nodes_.begin(), nodes_, index_[key]);
-      index_[key] = nodes_.begin();
-    }
+  void Insert(const KeyType& key, ValueType* value, size_t charge = 1,
+              uint32_t ttl = 0) {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    InsertNode(key, value, charge, ttl, false);
+  }
+  Node* InsertAndRef(const KeyType& key, ValueType* value, size_t charge = 1,
+                     uint32_t ttl = 0) {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    return InsertNode(key, value, charge, ttl, true);
   }
-  CacheNode<KeyType, ValueType>* Get(const KeyType& key) {
-    LockType lock_type;
-    ScopedLockImpl<LockType> lock_guard(lock_type);
-    typename std::unordered_map<
-        KeyType,
-        typename std::list<CacheNode<KeyType, ValueType>*>::iterator>::iterator
-        iter = index_.find(key);
-    if (iter == index_.end()) {
+  Node* Get(const KeyType& key) {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    Node* node = table_.Find(key, Table::HashOf(key));
+    if (node == nullptr) {
       return nullptr;
     }
-    CacheNode<KeyType, ValueType>* node = *(iter->second);
-    nodes_.erase(iter->second);
     //需要移动到头部
-    nodes_.push_front(node);
-    index_[node->key] = nodes_.begin();
+    nodes_.MoveToFront(node);
     Ref(node);
     return node;
   }
   // 默认的析构函数
   void RegistCleanHandle(
       std::function<void(const KeyType& key, ValueType* value)> destructor) {
+    ScopedLockImpl<LockType> lock_guard(lock_);
     destructor_ = destructor;
   }
-  void Release(CacheNode<KeyType, ValueType>* node) {
-    LockType lock_type;
-    ScopedLockImpl<LockType> lock_guard(lock_type);
+  void Release(Node* node) {
+    ScopedLockImpl<LockType> lock_guard(lock_);
     Unref(node);
   }
-  // 定期的来进行回收
+  // 回收所有没有被外部引用的节点
   void Prune() {
-    LockType lock_type;
-    ScopedLockImpl<LockType> lock_guard(lock_type);
-    for (auto it = wait_erase_.begin(); it != wait_erase_.end(); ++it) {
-      Unref((it->second));
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    for (Node* node = nodes_.Front(); node != nullptr && node != nodes_.End();) {
+      Node* next = node->next;
+      if (node->refs == 1) {
+        FinishErase(node);
+      }
+      node = next;
     }
   }
   // 删除某个key对应的节点
   void Erase(const KeyType& key) {
-    LockType lock_type;
-    ScopedLockImpl<LockType> lock_guard(lock_type);
-    typename std::unordered_map<
-        KeyType,
-        typename std::list<CacheNode<KeyType, ValueType>*>::iterator>::iterator
-        iter = index_.find(key);
-    if (iter == index_.end()) {
-      return;
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    Node* node = table_.Find(key, Table::HashOf(key));
+    if (node != nullptr) {
+      FinishErase(node);
     }
-    CacheNode<KeyType, ValueType>* node = *(iter->second);
-    FinishErase(node);
-    //从user列表中删除该对象
-    nodes_.erase(iter->second);
-    index_.erase(node->key);
-    if (!index_.empty()) {
-      //更新头节点
-      ListIter begin_iter = nodes_.begin();
-      index_[(*begin_iter)->key] = nodes_.begin();
+  }
+  size_t GetUsage() const {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    return nodes_.Charge();
+  }
+  size_t GetPinnedUsage() const {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    return pinned_usage_;
+  }
+  void ApplyToAllKeys(const std::function<void(const KeyType& key)>& fn) const {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    for (const Node* node = nodes_.Front();
+         node != nullptr && node != nodes_.End(); node = node->next) {
+      fn(node->key);
     }
   }
 
  private:
-  void Ref(CacheNode<KeyType, ValueType>* node) {
-    if (node) {
-      ++node->refs;
+  // 插入新节点，需要持有锁，ref为true时返回的节点额外持有一个引用
+  Node* InsertNode(const KeyType& key, ValueType* value, size_t charge,
+                   uint32_t ttl, bool ref) {
+    const uint32_t hash = Table::HashOf(key);
+    Node* old = table_.Find(key, hash);
+    if (old != nullptr) {
+      // 已经有相同的key，旧的节点直接从缓存中移除
+      FinishErase(old);
     }
-  }
-  void Unref(CacheNode<KeyType, ValueType>* node) {
-    if (!node) {
-      --node->refs;
-      if (node->refs == 0) {
-        destructor_(node->key, node->value);
-        if (wait_erase_.count(node->key) > 0) {
-          wait_erase_.erase(node->key);
-        }
-        delete node;
-        node = nullptr;
+    Node* node = pool_.New();
+    node->hash = hash;
+    node->key = key;
+    node->value = value;
+    node->charge = charge;
+    node->refs = 1;
+    node->ttl = ttl;
+    node->last_access_time = ttl > 0 ? util::GetCurrentTime() : 0;
+    if (charge > capacity_) {
+      // 单个节点就超过了容量，不缓存，需要返回引用的时候由调用方Release之后释放
+      node->in_cache = false;
+      if (!ref) {
+        FreeNode(node);
+        return nullptr;
       }
+      pinned_usage_ += charge;
+      return node;
+    }
+    //从尾部开始淘汰，直到可以放下新的节点
+    while (nodes_.Charge() + charge > capacity_) {
+      FinishErase(nodes_.Back());
+    }
+    node->in_cache = true;
+    table_.Insert(node);
+    nodes_.PushFront(node);
+    if (ref) {
+      Ref(node);
     }
+    return node;
   }
-  void MoveToEraseContainer(CacheNode<KeyType, ValueType>* node) {
-    if (wait_erase_.count(node->key) == 0) {
-      wait_erase_[node->key] = node;
+
+  // 缓存之外有引用的节点计入pinned_usage_
+  void Ref(Node* node) {
+    if (node->refs++ == 1) {
+      pinned_usage_ += node->charge;
     }
   }
-  // 这个是不带锁的版本
-  void FinishErase(CacheNode<KeyType, ValueType>* node) {
-    if (node) {
-      node->in_cache = false;
-      MoveToEraseContainer(node);
-      Unref(node);
+  void Unref(Node* node) {
+    assert(node->refs > 0);
+    if (node->refs == (node->in_cache ? 2u : 1u)) {
+      pinned_usage_ -= node->charge;
+    }
+    if (--node->refs == 0) {
+      FreeNode(node);
+    }
+  }
+  void FreeNode(Node* node) {
+    assert(!node->in_cache);
+    if (destructor_) {
+      destructor_(node->key, node->value);
+    }
+    pool_.Free(node);
+  }
+  // 从哈希表和链表中摘除节点并释放缓存持有的引用，需要持有锁
+  // 还有外部引用的节点在摘除前后都是pinned，不需要修改pinned_usage_
+  void FinishErase(Node* node) {
+    table_.Remove(node);
+    nodes_.Remove(node);
+    node->in_cache = false;
+    if (--node->refs == 0) {
+      FreeNode(node);
     }
   }
 
  private:
-  const uint32_t capacity_;
-  uint32_t cur_size_ = 0;
-  std::list<CacheNode<KeyType, ValueType>*> nodes_;
-  typename std::unordered_map<
-      KeyType, typename std::list<CacheNode<KeyType, ValueType>*>::iterator>
-      index_;
-  std::unordered_map<KeyType, CacheNode<KeyType, ValueType>*> wait_erase_;
+  const size_t capacity_;
+  mutable LockType lock_;
+  size_t pinned_usage_ = 0;
+  Table table_;
+  NodeList<KeyType, ValueType> nodes_;
+  NodePool<KeyType, ValueType> pool_;
   std::function<void(const KeyType& key, ValueType* value)> destructor_;
 };
 }  // namespace corekv
@@ -0,0 +1,190 @@
+#pragma once
+#include <assert.h>
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#include "../utils/hash_util.h"
+#include "cache_node.h"
+namespace corekv {
+// 以下几个工具类由各个缓存策略共用，都不加锁，由缓存策略负责加锁
+
+// 通过CacheNode自身的prev/next串起来的带哨兵的双向链表，Front是最近插入的节点
+template <typename KeyType, typename ValueType>
+class NodeList final {
+  using Node = CacheNode<KeyType, ValueType>;
+
+ public:
+  NodeList() { head_.prev = head_.next = &head_; }
+  NodeList(const NodeList&) = delete;
+  NodeList& operator=(const NodeList&) = delete;
+
+  bool Empty() const { return head_.next == &head_; }
+  size_t Size() const { return size_; }
+  // 链表中所有节点的charge之和
+  size_t Charge() const { return charge_; }
+  Node* Front() const { return Empty() ? nullptr : head_.next; }
+  Node* Back() const { return Empty() ? nullptr : head_.prev; }
+  // 遍历时的结束位置
+  const Node* End() const { return &head_; }
+  Node* End() { return &head_; }
+
+  void PushFront(Node* node) {
+    node->next = head_.next;
+    node->prev = &head_;
+    head_.next->prev = node;
+    head_.next = node;
+    ++size_;
+    charge_ += node->charge;
+  }
+  void Remove(Node* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
+    --size_;
+    charge_ -= node->charge;
+  }
+  void MoveToFront(Node* node) {
+    Remove(node);
+    PushFront(node);
+  }
+  // 插入到pos之前，pos为End()时插入到链表尾部
+  void InsertBefore(Node* pos, Node* node) {
+    node->next = pos;
+    node->prev = pos->prev;
+    pos->prev->next = node;
+    pos->prev = node;
+    ++size_;
+    charge_ += node->charge;
+  }
+
+ private:
+  Node head_;
+  size_t size_ = 0;
+  size_t charge_ = 0;
+};
+
+/*
+ * 线性探测的开放寻址哈希表，槽位中直接保存节点指针
+ * 删除时把后续探测序列上的节点往前搬，不需要墓碑；
+ * 节点个数超过槽位的一半时扩容一倍，Find通常只需要一次探测
+ */
+template <typename KeyType, typename ValueType>
+class NodeTable final {
+  using Node = CacheNode<KeyType, ValueType>;
+
+ public:
+  NodeTable() {
+    table_.assign(kInitSize, nullptr);
+    mask_ = kInitSize - 1;
+  }
+  NodeTable(const NodeTable&) = delete;
+  NodeTable& operator=(const NodeTable&) = delete;
+
+  // 取64位hash的低32位，分片用的是高位，两者互不影响
+  static uint32_t HashOf(const KeyType& key) {
+    return static_cast<uint32_t>(hash_util::HashKey(key));
+  }
+  Node* Find(const KeyType& key, uint32_t hash) const {
+    return table_[FindSlot(key, hash)];
+  }
+  // 调用方保证key不在表中
+  void Insert(Node* node) {
+    if (2 * (count_ + 1) > table_.size()) {
+      Resize(2 * table_.size());
+    }
+    const size_t slot = FindSlot(node->key, node->hash);
+    assert(table_[slot] == nullptr);
+    table_[slot] = node;
+    ++count_;
+  }
+  void Remove(Node* node) {
+    size_t slot = FindSlot(node->key, node->hash);
+    assert(table_[slot] == node);
+    table_[slot] = nullptr;
+    --count_;
+    // 清空槽位之后，把后面探测序列上的节点往前搬，保证查找不会提前遇到空槽位
+    size_t next = slot;
+    while (true) {
+      next = (next + 1) & mask_;
+      Node* moved = table_[next];
+      if (moved == nullptr) {
+        break;
+      }
+      const size_t home = moved->hash & mask_;
+      // home在(slot, next]之间的节点不能移动到slot
+      const bool stay = (slot <= next) ? (slot < home && home <= next)
+                                       : (slot < home || home <= next);
+      if (!stay) {
+        table_[slot] = moved;
+        table_[next] = nullptr;
+        slot = next;
+      }
+    }
+  }
+
+ private:
+  static constexpr size_t kInitSize = 16;
+  void Resize(size_t new_size) {
+    std::vector<Node*> old(new_size, nullptr);
+    old.swap(table_);
+    mask_ = new_size - 1;
+    for (Node* node : old) {
+      if (node != nullptr) {
+        table_[FindSlot(node->key, node->hash)] = node;
+      }
+    }
+  }
+  // 返回key所在的槽位，不存在的话返回探测序列上第一个空槽位
+  size_t FindSlot(const KeyType& key, uint32_t hash) const {
+    size_t slot = hash & mask_;
+    while (table_[slot] != nullptr &&
+           (table_[slot]->hash != hash || !(table_[slot]->key == key))) {
+      slot = (slot + 1) & mask_;
+    }
+    return slot;
+  }
+
+  std::vector<Node*> table_;
+  size_t mask_ = 0;
+  size_t count_ = 0;
+};
+
+// 引用计数归零的节点放回池子中复用，稳定运行之后插入不再分配内存
+template <typename KeyType, typename ValueType>
+class NodePool final {
+  using Node = CacheNode<KeyType, ValueType>;
+
+ public:
+  NodePool() = default;
+  NodePool(const NodePool&) = delete;
+  NodePool& operator=(const NodePool&) = delete;
+  ~NodePool() {
+    while (free_list_ != nullptr) {
+      Node* node = free_list_;
+      free_list_ = node->next;
+      delete node;
+    }
+  }
+  Node* New() {
+    if (free_list_ == nullptr) {
+      return new Node();
+    }
+    Node* node = free_list_;
+    free_list_ = node->next;
+    node->next = nullptr;
+    return node;
+  }
+  void Free(Node* node) {
+    node->value = nullptr;
+    node->prev = nullptr;
+    node->next = free_list_;
+    free_list_ = node;
+  }
+
+ private:
+  // 可以复用的节点，通过next串起来
+  Node* free_list_ = nullptr;
+};
+}  // namespace corekv
@@ -0,0 +1,285 @@
+#pragma once
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+
+#include "../utils/mutex.h"
+#include "../utils/util.h"
+#include "cache_node.h"
+#include "cache_policy.h"
+#include "count_min_sketch.h"
+#include "node_table.h"
+namespace corekv {
+/*
+ * W-TinyLFU:
+ * 1. 新插入的节点先进入容量为1%的window LRU，用来吸收突发的新数据
+ * 2. 剩下的容量是分段的main LRU，由probation(20%)和protected(80%)两段组成，
+ *    probation中的节点再次被访问之后晋升到protected，protected满了之后把最久没有访问的降级回probation
+ * 3. window淘汰出来的候选节点和probation的末尾节点比较CountMinSketch中的访问频率，
+ *    频率高的留下，这样一次性的扫描很难把热点数据挤出去
+ * 4. sketch记录的访问次数达到一定次数之后整体减半，让过去的热点逐渐老化
+ *
+ * 各段的容量都按照charge计算
+ * 引用计数和LruCachePolicy一致: 缓存本身持有一个引用，Get增加一个引用，Release减少
+ */
+template <typename KeyType, typename ValueType, typename LockType = NullLock>
+class WTinyLfuCachePolicy final : public CachePolicy<KeyType, ValueType> {
+  using Node = CacheNode<KeyType, ValueType>;
+  using Table = NodeTable<KeyType, ValueType>;
+  using List = NodeList<KeyType, ValueType>;
+  enum Queue : uint8_t { kWindow, kProbation, kProtected };
+
+ public:
+  // expected_entries用来估计sketch的大小，按照容量和平均charge计算
+  explicit WTinyLfuCachePolicy(size_t capacity, uint32_t expected_entries = 0)
+      : capacity_(capacity),
+        window_capacity_(capacity == 0 ? 0
+                                       : std::max<size_t>(1, capacity / 100)),
+        main_capacity_(capacity - window_capacity_),
+        protected_capacity_(main_capacity_ * 4 / 5),
+        sample_size_(10 * SketchWidth(capacity, expected_entries)),
+        sketch_(SketchWidth(capacity, expected_entries)) {}
+  // 走到这里的时候，所有的节点都应该已经被Release了
+  ~WTinyLfuCachePolicy() {
+    for (List* list : {&window_, &probation_, &protected_}) {
+      while (!list->Empty()) {
+        FinishErase(list->Front());
+      }
+    }
+  }
+  void Insert(const KeyType& key, ValueType* value, size_t charge = 1,
+              uint32_t ttl = 0) {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    InsertNode(key, value, charge, ttl, false);
+  }
+  Node* InsertAndRef(const KeyType& key, ValueType* value, size_t charge = 1,
+                     uint32_t ttl = 0) {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    return InsertNode(key, value, charge, ttl, true);
+  }
+  Node* Get(const KeyType& key) {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    const uint32_t hash = Table::HashOf(key);
+    // 没有命中的访问也需要记录，下一次插入的时候才能和已有的节点比较频率
+    RecordAccess(hash);
+    Node* node = table_.Find(key, hash);
+    if (node == nullptr) {
+      return nullptr;
+    }
+    switch (node->queue) {
+      case kWindow:
+        window_.MoveToFront(node);
+        break;
+      case kProbation:
+        // 再次被访问，晋升到protected
+        probation_.Remove(node);
+        node->queue = kProtected;
+        protected_.PushFront(node);
+        while (protected_.Charge() > protected_capacity_) {
+          Node* demoted = protected_.Back();
+          protected_.Remove(demoted);
+          demoted->queue = kProbation;
+          probation_.PushFront(demoted);
+        }
+        break;
+      default:
+        protected_.MoveToFront(node);
+        break;
+    }
+    Ref(node);
+    return node;
+  }
+  // 默认的析构函数
+  void RegistCleanHandle(
+      std::function<void(const KeyType& key, ValueType* value)> destructor) {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    destructor_ = destructor;
+  }
+  void Release(Node* node) {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    Unref(node);
+  }
+  // 回收所有没有被外部引用的节点
+  void Prune() {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    for (List* list : {&window_, &probation_, &protected_}) {
+      for (Node* node = list->Front(); node != nullptr && node != list->End();) {
+        Node* next = node->next;
+        if (node->refs == 1) {
+          FinishErase(node);
+        }
+        node = next;
+      }
+    }
+  }
+  // 删除某个key对应的节点
+  void Erase(const KeyType& key) {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    Node* node = table_.Find(key, Table::HashOf(key));
+    if (node != nullptr) {
+      FinishErase(node);
+    }
+  }
+  size_t GetUsage() const {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    return window_.Charge() + probation_.Charge() + protected_.Charge();
+  }
+  size_t GetPinnedUsage() const {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    return pinned_usage_;
+  }
+  // 依次是protected、probation和window，每一段内越近被访问的越靠前
+  void ApplyToAllKeys(const std::function<void(const KeyType& key)>& fn) const {
+    ScopedLockImpl<LockType> lock_guard(lock_);
+    for (const List* list : {&protected_, &probation_, &window_}) {
+      for (const Node* node = list->Front();
+           node != nullptr && node != list->End(); node = node->next) {
+        fn(node->key);
+      }
+    }
+  }
+
+ private:
+  // 插入新节点，需要持有锁，ref为true时返回的节点额外持有一个引用
+  Node* InsertNode(const KeyType& key, ValueType* value, size_t charge,
+                   uint32_t ttl, bool ref) {
+    const uint32_t hash = Table::HashOf(key);
+    RecordAccess(hash);
+    Node* old = table_.Find(key, hash);
+    if (old != nullptr) {
+      // 已经有相同的key，旧的节点直接从缓存中移除
+      FinishErase(old);
+    }
+    Node* node = pool_.New();
+    node->hash = hash;
+    node->key = key;
+    node->value = value;
+    node->charge = charge;
+    node->refs = 1;
+    node->ttl = ttl;
+    node->last_access_time = ttl > 0 ? util::GetCurrentTime() : 0;
+    if (charge > capacity_) {
+      // 单个节点就超过了容量，不缓存，需要返回引用的时候由调用方Release之后释放
+      node->in_cache = false;
+      if (!ref) {
+        FreeNode(node);
+        return nullptr;
+      }
+      pinned_usage_ += charge;
+      return node;
+    }
+    node->in_cache = true;
+    node->queue = kWindow;
+    table_.Insert(node);
+    window_.PushFront(node);
+    // 先增加引用再淘汰，新节点没有被准入的时候也能交给调用方使用
+    if (ref) {
+      Ref(node);
+    }
+    EvictFromWindow();
+    return node;
+  }
+
+  static uint32_t SketchWidth(size_t capacity, uint32_t expected_entries) {
+    // 没有指定的时候认为每个节点的charge为1
+    const size_t entries = expected_entries > 0 ? expected_entries : capacity;
+    return static_cast<uint32_t>(
+        std::min<size_t>(std::max<size_t>(16, entries), 1u << 24));
+  }
+  void RecordAccess(uint32_t hash) {
+    sketch_.Increment(hash);
+    if (++samples_ >= sample_size_) {
+      // 所有的counter减半
+      sketch_.Reset();
+      samples_ /= 2;
+    }
+  }
+  // window超过容量之后，把末尾的节点作为候选，尝试放入main中
+  // main放不下的时候，候选节点依次和main的末尾节点比较访问频率，频率更高才能替换掉它
+  void EvictFromWindow() {
+    while (window_.Charge() > window_capacity_) {
+      Node* candidate = window_.Back();
+      const int32_t freq = sketch_.Estimate(candidate->hash);
+      bool admit = true;
+      while (probation_.Charge() + protected_.Charge() + candidate->charge >
+             main_capacity_) {
+        Node* victim =
+            probation_.Empty() ? protected_.Back() : probation_.Back();
+        if (victim == nullptr || freq <= sketch_.Estimate(victim->hash)) {
+          admit = false;
+          break;
+        }
+        FinishErase(victim);
+      }
+      if (!admit) {
+        FinishErase(candidate);
+        continue;
+      }
+      window_.Remove(candidate);
+      candidate->queue = kProbation;
+      probation_.PushFront(candidate);
+    }
+  }
+  List* QueueOf(Node* node) {
+    switch (node->queue) {
+      case kWindow:
+        return &window_;
+      case kProbation:
+        return &probation_;
+      default:
+        return &protected_;
+    }
+  }
+  // 缓存之外有引用的节点计入pinned_usage_
+  void Ref(Node* node) {
+    if (node->refs++ == 1) {
+      pinned_usage_ += node->charge;
+    }
+  }
+  void Unref(Node* node) {
+    assert(node->refs > 0);
+    if (node->refs == (node->in_cache ? 2u : 1u)) {
+      pinned_usage_ -= node->charge;
+    }
+    if (--node->refs == 0) {
+      FreeNode(node);
+    }
+  }
+  void FreeNode(Node* node) {
+    assert(!node->in_cache);
+    if (destructor_) {
+      destructor_(node->key, node->value);
+    }
+    pool_.Free(node);
+  }
+  // 从哈希表和所在队列中摘除节点并释放缓存持有的引用，需要持有锁
+  // 还有外部引用的节点在摘除前后都是pinned，不需要修改pinned_usage_
+  void FinishErase(Node* node) {
+    table_.Remove(node);
+    QueueOf(node)->Remove(node);
+    node->in_cache = false;
+    if (--node->refs == 0) {
+      FreeNode(node);
+    }
+  }
+
+ private:
+  const size_t capacity_;
+  const size_t window_capacity_;
+  const size_t main_capacity_;
+  const size_t protected_capacity_;
+  const uint32_t sample_size_;
+  uint32_t samples_ = 0;
+  mutable LockType lock_;
+  size_t pinned_usage_ = 0;
+  Table table_;
+  List window_;
+  List probation_;
+  List protected_;
+  CountMinSketch sketch_;
+  NodePool<KeyType, ValueType> pool_;
+  std::function<void(const KeyType& key, ValueType* value)> destructor_;
+};
+}  // namespace corekv
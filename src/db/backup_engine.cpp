@@ -0,0 +1,456 @@
+#include "backup_engine.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <set>
+
+#include "../file/file.h"
+#include "../file/file_name.h"
+#include "../utils/codec.h"
+#include "../utils/crc32.h"
+#include "db.h"
+
+namespace corekv {
+static constexpr char kMetaDir[] = "meta";
+static constexpr char kSharedDir[] = "shared";
+static constexpr char kPrivateDir[] = "private";
+// 每次拷贝的大小
+static constexpr size_t kCopyBufferSize = 1 << 20;
+
+// 全部由数字组成的名字才是backup_id
+static bool ParseBackupId(const std::string& name, uint32_t* backup_id) {
+  if (name.empty() || name.size() > 9 ||
+      !std::all_of(name.begin(), name.end(), ::isdigit)) {
+    return false;
+  }
+  *backup_id = static_cast<uint32_t>(std::stoul(name));
+  return true;
+}
+
+BackupEngine::BackupEngine(const BackupEngineOptions& options)
+    : options_(options) {}
+
+DBStatus BackupEngine::Open(const BackupEngineOptions& options,
+                            BackupEngine** backup_engine) {
+  *backup_engine = nullptr;
+  auto* engine = new BackupEngine(options);
+  DBStatus s = engine->Initialize();
+  if (s == Status::kSuccess) {
+    *backup_engine = engine;
+  } else {
+    delete engine;
+  }
+  return s;
+}
+
+DBStatus BackupEngine::Initialize() {
+  const std::string& dir = options_.backup_dir;
+  for (const std::string& sub :
+       {dir, dir + "/" + kMetaDir, dir + "/" + kSharedDir,
+        dir + "/" + kPrivateDir}) {
+    DBStatus s = FileTool::CreateDir(sub);
+    if (s != Status::kSuccess) {
+      return s;
+    }
+  }
+  std::vector<std::string> filenames;
+  DBStatus s = FileTool::GetChildren(dir + "/" + kMetaDir, &filenames);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  for (const auto& filename : filenames) {
+    uint32_t backup_id = 0;
+    if (!ParseBackupId(filename, &backup_id)) {
+      continue;
+    }
+    Backup backup;
+    s = ReadMetaFile(backup_id, &backup);
+    if (s != Status::kSuccess) {
+      return s;
+    }
+    for (const auto& file : backup.files) {
+      if (file.path.rfind(kSharedDir, 0) == 0) {
+        shared_files_[file.path] = file;
+      }
+    }
+    backups_[backup_id] = std::move(backup);
+  }
+  GarbageCollect();
+  return Status::kSuccess;
+}
+
+std::string BackupEngine::MetaFileName(uint32_t backup_id) const {
+  return options_.backup_dir + "/" + kMetaDir + "/" +
+         std::to_string(backup_id);
+}
+
+std::string BackupEngine::PrivateDirName(uint32_t backup_id) const {
+  return options_.backup_dir + "/" + kPrivateDir + "/" +
+         std::to_string(backup_id);
+}
+
+DBStatus BackupEngine::CopyFile(const std::string& from, const std::string& to,
+                                uint64_t size, FileInfo* info) const {
+  FileReader reader(from);
+  if (!reader.IsOpen()) {
+    return Status::kReadFileFailed;
+  }
+  FileWriter writer(to);
+  if (options_.rate_limiter) {
+    writer.SetRateLimiter(options_.rate_limiter.get(), IOPriority::kLow);
+  }
+  info->size = 0;
+  info->crc = 0;
+  DBStatus s = Status::kSuccess;
+  std::string buffer;
+  while (info->size < size) {
+    const size_t n =
+        static_cast<size_t>(std::min<uint64_t>(kCopyBufferSize,
+                                               size - info->size));
+    s = reader.Read(info->size, n, &buffer);
+    if (s != Status::kSuccess || buffer.empty()) {
+      break;
+    }
+    info->crc = crc32::Extend(info->crc, buffer.data(), buffer.size());
+    s = writer.Append(buffer.data(), buffer.size());
+    if (s != Status::kSuccess) {
+      break;
+    }
+    info->size += buffer.size();
+  }
+  if (s == Status::kSuccess) {
+    s = writer.Sync();
+  }
+  writer.Close();
+  if (s != Status::kSuccess) {
+    FileTool::RemoveFile(to);
+  }
+  return s;
+}
+
+// meta文件的格式:
+//   [时间戳 varint64][文件个数 varint32]
+//   每个文件依次是[路径 length prefixed][大小 varint64][crc fixed32]
+//   最后是前面所有内容的crc(fixed32，mask过)
+DBStatus BackupEngine::WriteMetaFile(uint32_t backup_id,
+                                     const Backup& backup) const {
+  std::string contents;
+  util::PutVarint64(&contents, backup.timestamp);
+  util::PutVarint32(&contents, backup.files.size());
+  for (const auto& file : backup.files) {
+    util::PutLengthPrefixedSlice(&contents, file.path);
+    util::PutVarint64(&contents, file.size);
+    util::PutFixed32(&contents, file.crc);
+  }
+  util::PutFixed32(&contents,
+                   crc32::Mask(crc32::Value(contents.data(), contents.size())));
+  // meta文件rename之后备份才算完成
+  const std::string& fname = MetaFileName(backup_id);
+  const std::string& tmp = fname + ".tmp";
+  FileWriter writer(tmp);
+  DBStatus s = writer.Append(contents.data(), contents.size());
+  if (s == Status::kSuccess) {
+    s = writer.Sync();
+  }
+  writer.Close();
+  if (s == Status::kSuccess) {
+    s = FileTool::RenameFile(tmp, fname);
+  }
+  if (s != Status::kSuccess) {
+    FileTool::RemoveFile(tmp);
+  }
+  return s;
+}
+
+DBStatus BackupEngine::ReadMetaFile(uint32_t backup_id, Backup* backup) const {
+  const std::string& fname = MetaFileName(backup_id);
+  std::string contents;
+  {
+    FileReader reader(fname);
+    if (!reader.IsOpen() ||
+        reader.Read(0, FileTool::GetFileSize(fname), &contents) !=
+            Status::kSuccess) {
+      return Status::kReadFileFailed;
+    }
+  }
+  std::string_view input = contents;
+  if (input.size() < sizeof(uint32_t)) {
+    return Status::kCorruption;
+  }
+  const size_t n = input.size() - sizeof(uint32_t);
+  if (crc32::Unmask(util::DecodeFixed32(input.data() + n)) !=
+      crc32::Value(input.data(), n)) {
+    return Status::kCorruption;
+  }
+  input.remove_suffix(sizeof(uint32_t));
+  uint64_t timestamp = 0;
+  uint32_t count = 0;
+  if (!util::GetVarint64(&input, &timestamp) ||
+      !util::GetVarint32(&input, &count)) {
+    return Status::kCorruption;
+  }
+  backup->timestamp = static_cast<int64_t>(timestamp);
+  backup->files.clear();
+  for (uint32_t i = 0; i < count; ++i) {
+    FileInfo file;
+    std::string_view path;
+    if (!util::GetLengthPrefixedSlice(&input, &path) ||
+        !util::GetVarint64(&input, &file.size) ||
+        input.size() < sizeof(uint32_t)) {
+      return Status::kCorruption;
+    }
+    file.path.assign(path.data(), path.size());
+    file.crc = util::DecodeFixed32(input.data());
+    input.remove_prefix(sizeof(uint32_t));
+    backup->files.push_back(std::move(file));
+  }
+  return input.empty() ? Status::kSuccess : Status::kCorruption;
+}
+
+void BackupEngine::GarbageCollect() {
+  const std::string& dir = options_.backup_dir;
+  std::vector<std::string> filenames;
+  FileTool::GetChildren(dir + "/" + kMetaDir, &filenames);
+  for (const auto& filename : filenames) {
+    uint32_t backup_id = 0;
+    if (!ParseBackupId(filename, &backup_id)) {
+      FileTool::RemoveFile(dir + "/" + kMetaDir + "/" + filename);
+    }
+  }
+  FileTool::GetChildren(dir + "/" + kPrivateDir, &filenames);
+  for (const auto& filename : filenames) {
+    uint32_t backup_id = 0;
+    if (!ParseBackupId(filename, &backup_id) || backups_.count(backup_id) == 0) {
+      FileTool::RemoveDirAndFiles(dir + "/" + kPrivateDir + "/" + filename);
+    }
+  }
+  FileTool::GetChildren(dir + "/" + kSharedDir, &filenames);
+  for (const auto& filename : filenames) {
+    const std::string& path = std::string(kSharedDir) + "/" + filename;
+    if (shared_files_.count(path) == 0) {
+      FileTool::RemoveFile(dir + "/" + path);
+    }
+  }
+}
+
+DBStatus BackupEngine::CreateNewBackup(DB* db, uint32_t* backup_id) {
+  const uint32_t new_id = backups_.empty() ? 1 : backups_.rbegin()->first + 1;
+  const std::string& private_dir = PrivateDirName(new_id);
+  DBStatus s = FileTool::CreateDir(private_dir);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  s = db->DisableFileDeletions();
+  if (s != Status::kSuccess) {
+    FileTool::RemoveDir(private_dir);
+    return s;
+  }
+  std::vector<std::string> files;
+  uint64_t manifest_file_size = 0;
+  s = db->GetLiveFiles(&files, &manifest_file_size);
+  Backup backup;
+  backup.timestamp = std::chrono::duration_cast<std::chrono::seconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+  // 这次新拷贝的shared文件，失败的时候删除
+  std::vector<FileInfo> new_shared_files;
+  uint64_t number;
+  FileType type;
+  for (const auto& filename : files) {
+    if (s != Status::kSuccess) {
+      break;
+    }
+    if (!FileName::ParseFileName(filename, &number, &type) ||
+        type == FileType::kCurrentFile) {
+      // 恢复的时候根据MANIFEST的文件名重新生成CURRENT
+      continue;
+    }
+    const std::string& from = db->GetName() + "/" + filename;
+    FileInfo info;
+    if (type == FileType::kTableFile || type == FileType::kBlobFile) {
+      info.path = std::string(kSharedDir) + "/" + filename;
+      auto iter = shared_files_.find(info.path);
+      if (iter != shared_files_.end()) {
+        // 之前的备份已经有这个文件了，只需要引用它
+        if (iter->second.size != FileTool::GetFileSize(from)) {
+          s = Status::kInvalidArgument;
+        }
+        backup.files.push_back(iter->second);
+        continue;
+      }
+      const std::string& to = options_.backup_dir + "/" + info.path;
+      s = CopyFile(from, to + ".tmp", UINT64_MAX, &info);
+      if (s == Status::kSuccess) {
+        s = FileTool::RenameFile(to + ".tmp", to);
+      }
+      if (s == Status::kSuccess) {
+        new_shared_files.push_back(info);
+      }
+    } else {
+      info.path = std::string(kPrivateDir) + "/" + std::to_string(new_id) +
+                  "/" + filename;
+      // WAL末尾写到一半的记录在回放的时候会被忽略
+      s = CopyFile(from, options_.backup_dir + "/" + info.path,
+                   type == FileType::kDescriptorFile ? manifest_file_size
+                                                     : UINT64_MAX,
+                   &info);
+    }
+    if (s == Status::kSuccess) {
+      backup.files.push_back(info);
+    }
+  }
+  db->EnableFileDeletions();
+  if (s == Status::kSuccess) {
+    s = WriteMetaFile(new_id, backup);
+  }
+  if (s != Status::kSuccess) {
+    FileTool::RemoveDirAndFiles(private_dir);
+    for (const auto& file : new_shared_files) {
+      FileTool::RemoveFile(options_.backup_dir + "/" + file.path);
+    }
+    return s;
+  }
+  for (const auto& file : new_shared_files) {
+    shared_files_[file.path] = file;
+  }
+  backups_[new_id] = std::move(backup);
+  if (backup_id != nullptr) {
+    *backup_id = new_id;
+  }
+  return Status::kSuccess;
+}
+
+void BackupEngine::GetBackupInfo(std::vector<BackupInfo>* infos) const {
+  infos->clear();
+  for (const auto& [backup_id, backup] : backups_) {
+    BackupInfo info;
+    info.backup_id = backup_id;
+    info.timestamp = backup.timestamp;
+    info.number_files = backup.files.size();
+    for (const auto& file : backup.files) {
+      info.size += file.size;
+    }
+    infos->push_back(info);
+  }
+}
+
+DBStatus BackupEngine::DeleteBackup(uint32_t backup_id) {
+  auto iter = backups_.find(backup_id);
+  if (iter == backups_.end()) {
+    return Status::kNotFound;
+  }
+  // 先删除meta，中途失败的时候剩下的文件在下次打开时被清理
+  DBStatus s = FileTool::RemoveFile(MetaFileName(backup_id));
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  backups_.erase(iter);
+  std::set<std::string> referenced;
+  for (const auto& item : backups_) {
+    for (const auto& file : item.second.files) {
+      referenced.insert(file.path);
+    }
+  }
+  for (auto it = shared_files_.begin(); it != shared_files_.end();) {
+    if (referenced.count(it->first) == 0) {
+      FileTool::RemoveFile(options_.backup_dir + "/" + it->first);
+      it = shared_files_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  FileTool::RemoveDirAndFiles(PrivateDirName(backup_id));
+  return Status::kSuccess;
+}
+
+DBStatus BackupEngine::PurgeOldBackups(uint32_t num_backups_to_keep) {
+  while (backups_.size() > num_backups_to_keep) {
+    DBStatus s = DeleteBackup(backups_.begin()->first);
+    if (s != Status::kSuccess) {
+      return s;
+    }
+  }
+  return Status::kSuccess;
+}
+
+DBStatus BackupEngine::VerifyBackup(uint32_t backup_id) const {
+  auto iter = backups_.find(backup_id);
+  if (iter == backups_.end()) {
+    return Status::kNotFound;
+  }
+  std::string buffer;
+  for (const auto& file : iter->second.files) {
+    const std::string& path = options_.backup_dir + "/" + file.path;
+    FileReader reader(path);
+    if (!reader.IsOpen() || FileTool::GetFileSize(path) != file.size) {
+      return Status::kCorruption;
+    }
+    uint32_t crc = 0;
+    for (uint64_t offset = 0; offset < file.size; offset += buffer.size()) {
+      if (reader.Read(offset, kCopyBufferSize, &buffer) != Status::kSuccess ||
+          buffer.empty()) {
+        return Status::kCorruption;
+      }
+      crc = crc32::Extend(crc, buffer.data(), buffer.size());
+    }
+    if (crc != file.crc) {
+      return Status::kCorruption;
+    }
+  }
+  return Status::kSuccess;
+}
+
+DBStatus BackupEngine::RestoreDBFromBackup(uint32_t backup_id,
+                                           const std::string& db_dir) {
+  auto iter = backups_.find(backup_id);
+  if (iter == backups_.end()) {
+    return Status::kNotFound;
+  }
+  DBStatus s = FileTool::CreateDir(db_dir);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  // 只删除db自己的文件，和DestroyDB一致
+  std::vector<std::string> filenames;
+  FileTool::GetChildren(db_dir, &filenames);
+  uint64_t number;
+  FileType type;
+  for (const auto& filename : filenames) {
+    if (FileName::ParseFileName(filename, &number, &type)) {
+      FileTool::RemoveFile(db_dir + "/" + filename);
+    }
+  }
+  uint64_t manifest_number = 0;
+  for (const auto& file : iter->second.files) {
+    const std::string& filename = file.path.substr(file.path.rfind('/') + 1);
+    if (!FileName::ParseFileName(filename, &number, &type)) {
+      return Status::kCorruption;
+    }
+    if (type == FileType::kDescriptorFile) {
+      manifest_number = number;
+    }
+    FileInfo copied;
+    s = CopyFile(options_.backup_dir + "/" + file.path,
+                 db_dir + "/" + filename, UINT64_MAX, &copied);
+    if (s != Status::kSuccess) {
+      return s;
+    }
+    if (copied.size != file.size || copied.crc != file.crc) {
+      return Status::kCorruption;
+    }
+  }
+  if (manifest_number == 0) {
+    return Status::kCorruption;
+  }
+  // CURRENT最后生成，中途失败的目录不会被当成完整的db打开
+  return FileName::SetCurrentFile(db_dir, manifest_number);
+}
+
+DBStatus BackupEngine::RestoreDBFromLatestBackup(const std::string& db_dir) {
+  if (backups_.empty()) {
+    return Status::kNotFound;
+  }
+  return RestoreDBFromBackup(backups_.rbegin()->first, db_dir);
+}
+}  // namespace corekv
@@ -0,0 +1,100 @@
+#ifndef DB_BACKUP_ENGINE_H_
+#define DB_BACKUP_ENGINE_H_
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../utils/rate_limiter.h"
+#include "status.h"
+
+namespace corekv {
+class DB;
+
+struct BackupEngineOptions {
+  // 备份保存的目录，可以是挂载的远端存储，不存在的时候创建
+  std::string backup_dir;
+  // 拷贝文件时的写入限速，为nullptr时不限速
+  std::shared_ptr<RateLimiter> rate_limiter = nullptr;
+};
+
+struct BackupInfo {
+  uint32_t backup_id = 0;
+  // 创建备份的时间(秒)
+  int64_t timestamp = 0;
+  // 恢复这个备份需要的所有文件的总大小，和其他备份共享的sst也计算在内
+  uint64_t size = 0;
+  uint32_t number_files = 0;
+};
+
+/*
+ * 增量备份: sst和blob文件创建之后不再修改，所有备份共用一份，
+ * 新的备份只拷贝备份目录中还没有的文件；MANIFEST和WAL每个备份单独拷贝一份
+ *
+ * 备份目录的结构:
+ *   backup_dir/shared/[0-9]+.(sst|blob)   所有备份共用的sst和blob文件
+ *   backup_dir/private/<id>/             MANIFEST和WAL
+ *   backup_dir/meta/<id>                 备份包含的文件以及每个文件的大小和crc
+ * meta文件最后写入，没有meta的private目录和没有被任何meta引用的shared文件
+ * 都是没有完成的备份留下的，打开的时候删除
+ *
+ * 同一个备份目录只能用来备份同一个db，文件名相同的sst被认为内容相同；
+ * 不是线程安全的，同一时刻只能有一个BackupEngine打开同一个备份目录
+ */
+class BackupEngine final {
+ public:
+  // 成功之后*backup_engine由调用方负责delete；
+  // meta文件损坏的时候返回kCorruption，不会删除任何文件
+  static DBStatus Open(const BackupEngineOptions& options,
+                       BackupEngine** backup_engine);
+  BackupEngine(const BackupEngine&) = delete;
+  BackupEngine& operator=(const BackupEngine&) = delete;
+
+  // 备份db的当前状态，包含调用之前完成的所有写入；备份的过程中db可以正常读写
+  DBStatus CreateNewBackup(DB* db, uint32_t* backup_id = nullptr);
+  // 按照backup_id从小到大排列
+  void GetBackupInfo(std::vector<BackupInfo>* infos) const;
+  // 删除备份，不再被任何备份引用的shared文件一起删除
+  DBStatus DeleteBackup(uint32_t backup_id);
+  // 只保留最新的num_backups_to_keep个备份
+  DBStatus PurgeOldBackups(uint32_t num_backups_to_keep);
+  // 逐个文件检查大小和crc，不一致的时候返回kCorruption
+  DBStatus VerifyBackup(uint32_t backup_id) const;
+  // 把备份恢复到db_dir，db_dir中已有的db文件会被删除；
+  // 拷贝的同时校验crc，不一致的时候返回kCorruption
+  DBStatus RestoreDBFromBackup(uint32_t backup_id, const std::string& db_dir);
+  DBStatus RestoreDBFromLatestBackup(const std::string& db_dir);
+
+ private:
+  struct FileInfo {
+    // 相对backup_dir的路径
+    std::string path;
+    uint64_t size = 0;
+    uint32_t crc = 0;
+  };
+  struct Backup {
+    int64_t timestamp = 0;
+    std::vector<FileInfo> files;
+  };
+
+  explicit BackupEngine(const BackupEngineOptions& options);
+  DBStatus Initialize();
+  std::string MetaFileName(uint32_t backup_id) const;
+  std::string PrivateDirName(uint32_t backup_id) const;
+  // 拷贝from的前size个字节到to，同时计算crc，to所在的目录需要已经存在
+  DBStatus CopyFile(const std::string& from, const std::string& to,
+                    uint64_t size, FileInfo* info) const;
+  DBStatus WriteMetaFile(uint32_t backup_id, const Backup& backup) const;
+  DBStatus ReadMetaFile(uint32_t backup_id, Backup* backup) const;
+  // 删除没有完成的备份留下的文件，以及不再被引用的shared文件
+  void GarbageCollect();
+
+  const BackupEngineOptions options_;
+  std::map<uint32_t, Backup> backups_;
+  // 所有备份引用的shared文件
+  std::map<std::string, FileInfo> shared_files_;
+};
+}  // namespace corekv
+#endif
@@ -0,0 +1,140 @@
+#include "blob_file.h"
+
+#include "../file/file.h"
+#include "../file/file_name.h"
+#include "../utils/codec.h"
+#include "../utils/crc32.h"
+
+namespace corekv {
+using namespace util;
+
+void BlobIndex::EncodeTo(std::string* dst) const {
+  PutVarint64(dst, file_number);
+  PutVarint64(dst, offset);
+  PutVarint64(dst, size);
+  PutFixed32(dst, crc);
+}
+
+bool BlobIndex::DecodeFrom(std::string_view input) {
+  if (!GetVarint64(&input, &file_number) || !GetVarint64(&input, &offset) ||
+      !GetVarint64(&input, &size) || input.size() != sizeof(uint32_t)) {
+    return false;
+  }
+  crc = DecodeFixed32(input.data());
+  return true;
+}
+
+BlobFileBuilder::BlobFileBuilder(const std::string& dbname,
+                                 const Options* options,
+                                 std::function<uint64_t()> new_file_number,
+                                 IOPriority io_priority)
+    : dbname_(dbname),
+      options_(options),
+      new_file_number_(std::move(new_file_number)),
+      io_priority_(io_priority) {}
+
+BlobFileBuilder::~BlobFileBuilder() {
+  // 没有Finish的文件由DeleteObsoleteFiles删除
+  if (file_) {
+    file_->Close();
+  }
+}
+
+DBStatus BlobFileBuilder::Add(const std::string_view& value,
+                              std::string* blob_index) {
+  if (file_ && current_.bytes >= options_->blob_file_size) {
+    DBStatus s = CloseCurrentFile();
+    if (s != Status::kSuccess) {
+      return s;
+    }
+  }
+  if (!file_) {
+    current_ = BlobFileAddition();
+    current_.number = new_file_number_();
+    file_ = std::make_unique<FileWriter>(
+        FileName::BlobFileName(dbname_, current_.number), false,
+        options_->use_direct_io_for_flush_and_compaction);
+    file_->SetRateLimiter(options_->rate_limiter.get(), io_priority_);
+    file_->SetBytesPerSync(options_->bytes_per_sync);
+  }
+  BlobIndex index;
+  index.file_number = current_.number;
+  index.offset = current_.bytes;
+  index.size = value.size();
+  index.crc = crc32::Mask(crc32::Value(value.data(), value.size()));
+  DBStatus s = file_->Append(value.data(), value.size());
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  ++current_.count;
+  current_.bytes += value.size();
+  blob_index->clear();
+  index.EncodeTo(blob_index);
+  return Status::kSuccess;
+}
+
+DBStatus BlobFileBuilder::CloseCurrentFile() {
+  DBStatus s = file_->Sync();
+  file_->Close();
+  file_.reset();
+  if (s == Status::kSuccess) {
+    files_.push_back(current_);
+  }
+  return s;
+}
+
+DBStatus BlobFileBuilder::Finish() {
+  return file_ ? CloseCurrentFile() : Status::kSuccess;
+}
+
+BlobSource::BlobSource(const std::string& dbname, const Options* options)
+    : dbname_(dbname), options_(options) {}
+
+BlobSource::~BlobSource() = default;
+
+std::shared_ptr<FileReader> BlobSource::GetFile(uint64_t file_number) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto iter = files_.find(file_number);
+  if (iter != files_.end()) {
+    return iter->second;
+  }
+  auto file = std::make_shared<FileReader>(
+      FileName::BlobFileName(dbname_, file_number), options_->use_mmap_reads);
+  if (!file->IsOpen()) {
+    return nullptr;
+  }
+  files_.emplace(file_number, file);
+  return file;
+}
+
+DBStatus BlobSource::Get(const std::string_view& blob_index,
+                         std::string* value) {
+  BlobIndex index;
+  if (!index.DecodeFrom(blob_index)) {
+    return Status::kCorruption;
+  }
+  return Get(index, value);
+}
+
+DBStatus BlobSource::Get(const BlobIndex& index, std::string* value) {
+  // 读取的过程中不持有锁，Evict之后文件在最后一个读取结束时关闭
+  std::shared_ptr<FileReader> file = GetFile(index.file_number);
+  if (!file) {
+    return Status::kReadFileFailed;
+  }
+  DBStatus s = file->Read(index.offset, index.size, value);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  if (value->size() != index.size ||
+      crc32::Unmask(index.crc) != crc32::Value(value->data(), value->size())) {
+    return Status::kCorruption;
+  }
+  return Status::kSuccess;
+}
+
+void BlobSource::Evict(uint64_t file_number) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  files_.erase(file_number);
+}
+}  // namespace corekv
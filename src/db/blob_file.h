@@ -0,0 +1,100 @@
+#ifndef DB_BLOB_FILE_H_
+#define DB_BLOB_FILE_H_
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../utils/rate_limiter.h"
+#include "options.h"
+#include "status.h"
+
+namespace corekv {
+class FileReader;
+class FileWriter;
+
+/*
+ * 大value和key分离存放(WiscKey)：flush和compaction的时候把长度不小于
+ * Options::min_blob_size的value追加到blob文件中，sst中只保存kTypeBlobIndex类型的
+ * 索引，之后的compaction只需要搬运很短的索引
+ *
+ * blob文件只是value依次拼接在一起，没有额外的格式，索引中带上value的crc
+ * blob index := varint64(file_number) varint64(offset) varint64(size) fixed32(crc)
+ */
+struct BlobIndex {
+  uint64_t file_number = 0;
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  // value的masked crc32
+  uint32_t crc = 0;
+
+  void EncodeTo(std::string* dst) const;
+  bool DecodeFrom(std::string_view input);
+};
+
+// 一个blob文件写完之后的统计信息，用来生成VersionEdit
+struct BlobFileAddition {
+  uint64_t number = 0;
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+};
+
+// 按顺序追加value，当前文件超过Options::blob_file_size之后换一个新文件，
+// 不是线程安全的，每个flush或者compaction子任务各自使用一个
+class BlobFileBuilder final {
+ public:
+  // 需要新文件的时候调用new_file_number分配编号，
+  // 调用方负责保证编号对应的文件在写入版本之前不会被删除
+  BlobFileBuilder(const std::string& dbname, const Options* options,
+                  std::function<uint64_t()> new_file_number,
+                  IOPriority io_priority);
+  BlobFileBuilder(const BlobFileBuilder&) = delete;
+  BlobFileBuilder& operator=(const BlobFileBuilder&) = delete;
+  ~BlobFileBuilder();
+
+  // 把value写入blob文件，blob_index中返回编码之后的索引
+  DBStatus Add(const std::string_view& value, std::string* blob_index);
+  // sync并关闭当前的文件，之后files()中包含所有写完的文件
+  DBStatus Finish();
+  const std::vector<BlobFileAddition>& files() const { return files_; }
+
+ private:
+  DBStatus CloseCurrentFile();
+
+  const std::string dbname_;
+  const Options* const options_;
+  const std::function<uint64_t()> new_file_number_;
+  const IOPriority io_priority_;
+  std::unique_ptr<FileWriter> file_;
+  BlobFileAddition current_;
+  std::vector<BlobFileAddition> files_;
+};
+
+// 读取blob中的value，打开的文件按照编号缓存，线程安全
+class BlobSource final {
+ public:
+  BlobSource(const std::string& dbname, const Options* options);
+  BlobSource(const BlobSource&) = delete;
+  BlobSource& operator=(const BlobSource&) = delete;
+  ~BlobSource();
+
+  DBStatus Get(const std::string_view& blob_index, std::string* value);
+  DBStatus Get(const BlobIndex& index, std::string* value);
+  // blob文件被删除之前调用，关闭缓存的fd
+  void Evict(uint64_t file_number);
+
+ private:
+  std::shared_ptr<FileReader> GetFile(uint64_t file_number);
+
+  const std::string dbname_;
+  const Options* const options_;
+  std::mutex mutex_;
+  std::unordered_map<uint64_t, std::shared_ptr<FileReader>> files_;
+};
+}  // namespace corekv
+#endif
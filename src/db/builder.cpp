@@ -0,0 +1,95 @@
+#include "builder.h"
+
+#include <algorithm>
+
+#include "../file/file.h"
+#include "../file/file_name.h"
+#include "../table/table_builder.h"
+#include "../utils/util.h"
+#include "blob_file.h"
+#include "table_cache.h"
+#include "version_edit.h"
+namespace corekv {
+DBStatus BuildTable(const std::string& dbname, const Options& options,
+                    TableCache* table_cache, Iterator* iter,
+                    FileMetaData* meta, BlobFileBuilder* blob_builder,
+                    const std::vector<RangeTombstone>* range_tombstones) {
+  DBStatus s = Status::kSuccess;
+  meta->file_size = 0;
+  meta->largest_seqno = 0;
+  meta->num_range_deletions = 0;
+  iter->SeekToFirst();
+  const std::string& fname = FileName::TableFileName(dbname, meta->number);
+  const bool has_range_del =
+      range_tombstones != nullptr && !range_tombstones->empty();
+  if (iter->Valid() || has_range_del) {
+    FileWriter file(fname, false,
+                    options.use_direct_io_for_flush_and_compaction);
+    file.SetRateLimiter(options.rate_limiter.get(), IOPriority::kHigh);
+    file.SetBytesPerSync(options.bytes_per_sync);
+    TableBuilder builder(options, &file);
+    meta->file_creation_time = util::GetCurrentTime();
+    builder.SetCreationTime(meta->file_creation_time);
+    std::string blob_key, blob_index;
+    for (; iter->Valid(); iter->Next()) {
+      std::string_view key = iter->key();
+      std::string_view value = iter->value();
+      ParsedInternalKey ikey;
+      const bool parsed = ParseInternalKey(key, &ikey);
+      if (parsed) {
+        meta->largest_seqno = std::max(meta->largest_seqno, ikey.sequence);
+      }
+      if (blob_builder != nullptr && value.size() >= options.min_blob_size &&
+          parsed && ikey.type == kTypeValue) {
+        s = blob_builder->Add(value, &blob_index);
+        if (s != Status::kSuccess) {
+          break;
+        }
+        blob_key.assign(key.data(), key.size());
+        SetInternalKeyType(&blob_key, kTypeBlobIndex);
+        key = blob_key;
+        value = blob_index;
+      }
+      if (builder.GetEntryNum() == 0) {
+        meta->smallest.assign(key.data(), key.size());
+      }
+      meta->largest.assign(key.data(), key.size());
+      builder.Add(key, value);
+    }
+    if (has_range_del) {
+      for (const auto& tombstone : *range_tombstones) {
+        builder.AddRangeTombstone(tombstone);
+        ExtendFileBounds(tombstone, options.comparator.get(), &meta->smallest,
+                         &meta->largest);
+        meta->largest_seqno = std::max(meta->largest_seqno, tombstone.seq);
+      }
+      meta->num_range_deletions = range_tombstones->size();
+    }
+    if (s == Status::kSuccess && blob_builder != nullptr) {
+      s = blob_builder->Finish();
+    }
+    builder.Finish();
+    if (s == Status::kSuccess && !builder.Success()) {
+      s = Status::kWriteFileFailed;
+    }
+    if (s == Status::kSuccess) {
+      meta->file_size = builder.GetFileSize();
+    }
+    // 确认生成的sst是可以正常打开的
+    if (s == Status::kSuccess) {
+      Iterator* it =
+          table_cache->NewIterator(ReadOptions(), meta->number, meta->file_size);
+      s = it->status();
+      delete it;
+    }
+  }
+  if (s == Status::kSuccess) {
+    s = iter->status();
+  }
+  if (s != Status::kSuccess || meta->file_size == 0) {
+    FileTool::RemoveFile(fname);
+    meta->file_size = 0;
+  }
+  return s;
+}
+}  // namespace corekv
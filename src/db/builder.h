@@ -0,0 +1,26 @@
+#ifndef DB_BUILDER_H_
+#define DB_BUILDER_H_
+#include <string>
+#include <vector>
+
+#include "iterator.h"
+#include "options.h"
+#include "range_del.h"
+#include "status.h"
+
+namespace corekv {
+class BlobFileBuilder;
+struct FileMetaData;
+class TableCache;
+// 把iter中的数据写成编号为meta->number的sst，成功之后填充meta中的其他字段
+// iter中没有数据并且没有range tombstone的时候不会生成文件，meta->file_size为0
+// blob_builder不为空的时候，长度不小于options.min_blob_size的value写到blob文件中，
+// 返回之前会调用blob_builder->Finish()
+// range_tombstones不为空的时候写到sst的range tombstone block中，边界同时覆盖
+// tombstone的范围，只有tombstone没有数据的时候也会生成文件
+DBStatus BuildTable(
+    const std::string& dbname, const Options& options, TableCache* table_cache,
+    Iterator* iter, FileMetaData* meta, BlobFileBuilder* blob_builder = nullptr,
+    const std::vector<RangeTombstone>* range_tombstones = nullptr);
+}  // namespace corekv
+#endif
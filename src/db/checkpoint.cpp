@@ -0,0 +1,82 @@
+#include "checkpoint.h"
+
+#include <vector>
+
+#include "../file/file.h"
+#include "../file/file_name.h"
+#include "db.h"
+
+namespace corekv {
+static DBStatus CopyLiveFiles(const std::string& dbname, const std::string& dir,
+                              const std::vector<std::string>& files,
+                              uint64_t manifest_file_size) {
+  DBStatus s = Status::kSuccess;
+  uint64_t number;
+  FileType type;
+  for (const auto& filename : files) {
+    if (!FileName::ParseFileName(filename, &number, &type)) {
+      continue;
+    }
+    const std::string from = dbname + "/" + filename;
+    const std::string to = dir + "/" + filename;
+    switch (type) {
+      case FileType::kTableFile:
+      case FileType::kBlobFile:
+        s = FileTool::LinkFile(from, to);
+        break;
+      case FileType::kDescriptorFile:
+        s = FileTool::CopyFile(from, to, manifest_file_size);
+        if (s == Status::kSuccess) {
+          // db中的CURRENT可能已经指向了更新的MANIFEST，这里重新生成
+          s = FileName::SetCurrentFile(dir, number);
+        }
+        break;
+      case FileType::kLogFile:
+        // 末尾写到一半的记录在回放的时候会被忽略
+        s = FileTool::CopyFile(from, to);
+        break;
+      default:
+        break;
+    }
+    if (s != Status::kSuccess) {
+      break;
+    }
+  }
+  return s;
+}
+
+DBStatus Checkpoint::Create(const std::string& checkpoint_dir) {
+  if (FileTool::FileExists(checkpoint_dir)) {
+    return Status::kInvalidArgument;
+  }
+  const std::string tmp_dir = checkpoint_dir + ".tmp";
+  // 上一次失败留下的临时目录
+  if (FileTool::FileExists(tmp_dir)) {
+    FileTool::RemoveDirAndFiles(tmp_dir);
+  }
+  DBStatus s = FileTool::CreateDir(tmp_dir);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  s = db_->DisableFileDeletions();
+  if (s != Status::kSuccess) {
+    FileTool::RemoveDir(tmp_dir);
+    return s;
+  }
+  std::vector<std::string> files;
+  uint64_t manifest_file_size = 0;
+  s = db_->GetLiveFiles(&files, &manifest_file_size);
+  if (s == Status::kSuccess) {
+    s = CopyLiveFiles(db_->GetName(), tmp_dir, files, manifest_file_size);
+  }
+  // 拷贝完成之后db可以继续删除废弃文件，硬链接不受影响
+  db_->EnableFileDeletions();
+  if (s == Status::kSuccess) {
+    s = FileTool::RenameFile(tmp_dir, checkpoint_dir);
+  }
+  if (s != Status::kSuccess) {
+    FileTool::RemoveDirAndFiles(tmp_dir);
+  }
+  return s;
+}
+}  // namespace corekv
@@ -0,0 +1,31 @@
+#ifndef DB_CHECKPOINT_H_
+#define DB_CHECKPOINT_H_
+#include <string>
+
+#include "status.h"
+
+namespace corekv {
+class DB;
+
+/*
+ * 在另一个目录下生成db当前状态的一致快照，生成之后可以直接用DB::Open打开
+ *
+ * sst和blob文件创建之后不再修改，直接创建硬链接，不在同一个文件系统的时候
+ * 退化成拷贝；MANIFEST只拷贝生成时已经写完的部分，还需要回放的WAL整个拷贝，
+ * CURRENT重新生成。生成的过程中db可以正常读写，快照包含调用之前完成的所有写入
+ */
+class Checkpoint final {
+ public:
+  explicit Checkpoint(DB* db) : db_(db) {}
+  Checkpoint(const Checkpoint&) = delete;
+  Checkpoint& operator=(const Checkpoint&) = delete;
+
+  // checkpoint_dir已经存在的时候返回kInvalidArgument；
+  // 先写到checkpoint_dir.tmp，全部完成之后再rename，失败时不留下任何文件
+  DBStatus Create(const std::string& checkpoint_dir);
+
+ private:
+  DB* const db_;
+};
+}  // namespace corekv
+#endif
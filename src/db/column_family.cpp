@@ -0,0 +1,5 @@
+#include "column_family.h"
+
+namespace corekv {
+const std::string kDefaultColumnFamilyName = "default";
+}  // namespace corekv
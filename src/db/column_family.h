@@ -0,0 +1,40 @@
+#ifndef DB_COLUMN_FAMILY_H_
+#define DB_COLUMN_FAMILY_H_
+#include <stdint.h>
+
+#include <string>
+
+#include "options.h"
+
+namespace corekv {
+// 默认column family的名字，id固定为0，每个db都有
+extern const std::string kDefaultColumnFamilyName;
+
+// 一个db可以包含多个column family，每个column family有独立的memtable、各层sst、
+// comparator和Options，所有column family共用WAL、MANIFEST、后台线程池和block_cache，
+// 同一个WriteBatch中对多个column family的写入整体原子生效
+class ColumnFamilyHandle {
+ public:
+  virtual ~ColumnFamilyHandle() = default;
+  virtual const std::string& GetName() const = 0;
+  virtual uint32_t GetID() const = 0;
+};
+
+// 打开或者创建column family时使用的配置
+// options中以下db级别的配置被忽略，统一使用DB::Open传入的options:
+//   create_if_missing、error_if_exists、max_background_jobs、async_read_threads、
+//   max_subcompactions、max_manifest_file_size、max_file_opening_threads、
+//   mmap/direct io/bytes_per_sync/预读等io相关的配置、
+//   rate_limiter、statistics、delayed_write_rate和block_cache_warmup
+// block_cache和row_cache为nullptr的时候使用DB::Open传入的options中的配置，
+// block_cache为nullptr的时候secondary_cache同样跟着使用DB::Open中的配置
+struct ColumnFamilyDescriptor {
+  std::string name;
+  Options options;
+
+  ColumnFamilyDescriptor() : name(kDefaultColumnFamilyName) {}
+  ColumnFamilyDescriptor(const std::string& n, const Options& o)
+      : name(n), options(o) {}
+};
+}  // namespace corekv
+#endif
@@ -0,0 +1,27 @@
+#ifndef DB_COMPACTION_FILTER_H_
+#define DB_COMPACTION_FILTER_H_
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+/*
+ * compaction的时候对每个key最新的value调用一次，可以删除或者改写value，
+ * 例如按照业务规则清理过期数据，不需要client逐个Delete
+ *
+ * 只处理对所有读请求都可见的kTypeValue，删除标记、带过期时间的value、
+ * 分离到blob文件中的value和merge操作数都不会经过filter
+ */
+namespace corekv {
+class CompactionFilter {
+ public:
+  virtual ~CompactionFilter() = default;
+  virtual const char* Name() const = 0;
+  // level是compaction输入的层数；返回true表示删除这个key，
+  // 需要改写的时候把新的value写入new_value并把value_changed置为true
+  // 会被多个compaction线程同时调用
+  virtual bool Filter(int32_t level, const std::string_view& key,
+                      const std::string_view& existing_value,
+                      std::string* new_value, bool* value_changed) const = 0;
+};
+}  // namespace corekv
+#endif
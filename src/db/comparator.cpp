@@ -11,10 +11,6 @@ const char* ByteComparator::Name() {
   return kByteComparator.data();
 }
 
-int32_t ByteComparator::Compare(const char* a, const char* b) {
-  return strcmp(a, b);
-}
-
 void ByteComparator::FindShortest(std::string& start,
                                   const std::string_view& limit) {
   //
@@ -29,12 +25,40 @@ void ByteComparator::FindShortest(std::string& start,
          start[first_diff_pos] == limit[first_diff_pos]) {
     ++first_diff_pos;
   }
-  if (first_diff_pos < min_len) {
-    char diff_ch = start[first_diff_pos];
-    if (diff_ch < 0xff && (diff_ch + 1) < limit[first_diff_pos]) {
-      start[first_diff_pos]++;
-      // diff_pos+1是因为diff_pos从0开始计算
-      start.resize(first_diff_pos + 1);
+  if (first_diff_pos >= min_len) {
+    // 一个是另一个的前缀，无法缩短
+    return;
+  }
+  // 字节需要按照无符号比较，否则大于等于0x80的字节会被当成负数
+  const uint8_t diff_byte = static_cast<uint8_t>(start[first_diff_pos]);
+  const uint8_t limit_byte = static_cast<uint8_t>(limit[first_diff_pos]);
+  if (diff_byte >= limit_byte) {
+    return;
+  }
+  if (diff_byte + 1 < limit_byte) {
+    start[first_diff_pos]++;
+    // diff_pos+1是因为diff_pos从0开始计算
+    start.resize(first_diff_pos + 1);
+    return;
+  }
+  // 不同的字节只差1，例如"abc1xyz"和"abd"：保留这个字节，之后第一个不是0xff的
+  // 字节加1，得到"abc2"，依然小于limit
+  for (size_t i = first_diff_pos + 1; i < start_size; ++i) {
+    if (static_cast<uint8_t>(start[i]) < 0xff) {
+      start[i]++;
+      start.resize(i + 1);
+      return;
+    }
+  }
+}
+
+void ByteComparator::FindShortSuccessor(std::string& key) {
+  // 第一个不是0xff的字节加1，后面的部分都可以去掉；全是0xff的时候保持不变
+  for (size_t i = 0; i < key.size(); ++i) {
+    if (static_cast<uint8_t>(key[i]) != 0xff) {
+      key[i]++;
+      key.resize(i + 1);
+      return;
     }
   }
 }
@@ -10,17 +10,32 @@ class Comparator {
   virtual ~Comparator() = default;
   virtual const char* Name() = 0;
 
-  virtual int32_t Compare(const char* a, const char* b) = 0;
+  // key中可能包含'\0'(例如internal key的序号部分)，所以需要带上长度比较
+  virtual int32_t Compare(const std::string_view& a,
+                          const std::string_view& b) = 0;
 
+  // start < limit的时候，把start改成[start, limit)中尽可能短的key，用作index的key
   virtual void FindShortest(std::string& start, const std::string_view& limit) = 0;
+  // 把key改成大于等于它的尽可能短的key，用作sst中最后一个block的index key；
+  // 默认不做修改
+  virtual void FindShortSuccessor(std::string& /*key*/) {}
+  // 点查时判断是不是同一个key只看这一部分，例如internal key去掉序号之后的user_key
+  // block内的hash索引按照它计算hash
+  virtual std::string_view UserKey(const std::string_view& key) { return key; }
 
 };
 // 按照字典序列
+// 类是final的并且Compare定义在头文件中，通过ByteComparator*调用时不经过虚函数表，
+// 可以直接内联成一次memcmp，InternalKeyComparator和DataBlock的迭代器都利用了这一点
 class ByteComparator final : public Comparator {
  public:
   const char* Name() override;
-  int32_t Compare(const char* a, const char* b) override;
+  int32_t Compare(const std::string_view& a,
+                  const std::string_view& b) override {
+    return a.compare(b);
+  }
   void FindShortest(std::string& start, const std::string_view& limit) override;
+  void FindShortSuccessor(std::string& key) override;
 };
 }  // namespace corekv
 
@@ -1,4 +1,306 @@
 #ifndef DB_DB_H_
 #define DB_DB_H_
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
 
-#endif
\ No newline at end of file
+#include "../table/table_properties.h"
+#include "column_family.h"
+#include "iterator.h"
+#include "options.h"
+#include "status.h"
+
+namespace corekv {
+class WriteBatch;
+
+// db在某一时刻的只读视图，通过ReadOptions::snapshot使用，
+// 由DB::GetSnapshot创建，不再使用之后调用DB::ReleaseSnapshot释放
+class Snapshot {
+ public:
+  // 快照能看到序号不大于它的所有写入
+  virtual uint64_t sequence_number() const = 0;
+
+ protected:
+  virtual ~Snapshot() = default;
+};
+
+// user key的区间[start, limit)
+struct Range {
+  std::string_view start;
+  std::string_view limit;
+
+  Range() = default;
+  Range(const std::string_view& s, const std::string_view& l)
+      : start(s), limit(l) {}
+};
+
+// DB::AsyncGet的回调，value只在status为kSuccess时有效
+using GetCallback = std::function<void(DBStatus status, std::string&& value)>;
+// DB::AsyncMultiGet的回调，statuses[i]和values[i]对应keys[i]
+using MultiGetCallback = std::function<void(
+    std::vector<DBStatus>&& statuses, std::vector<std::string>&& values)>;
+// DB::ParallelScan的回调，多个线程会并发调用，同一个分区内按照key从小到大调用；
+// 返回false的时候整个扫描提前结束
+using ScanCallback = std::function<bool(const std::string_view& key,
+                                        const std::string_view& value)>;
+
+// 对外暴露的kv接口，线程安全
+// 不带ColumnFamilyHandle的接口都作用在默认column family上
+class DB {
+ public:
+  // 打开name目录下的db，成功之后*dbptr由调用方负责delete
+  static DBStatus Open(const Options& options, const std::string& name,
+                       DB** dbptr);
+  // 同时打开column_families中的所有column family，成功之后(*handles)[i]对应
+  // column_families[i]，需要在delete db之前通过DestroyColumnFamilyHandle释放
+  // db中已有的column family都需要出现在column_families中，否则返回kInvalidArgument；
+  // db中还没有的column family在options.create_if_missing为true时创建
+  // column_families中没有默认column family的时候按照options打开它
+  static DBStatus Open(
+      const Options& options, const std::string& name,
+      const std::vector<ColumnFamilyDescriptor>& column_families,
+      std::vector<ColumnFamilyHandle*>* handles, DB** dbptr);
+
+  // 以只读方式打开name目录下的db，不创建、不修改任何文件，也不会flush和compaction，
+  // 还没有刷成sst的WAL回放到memtable中；写入接口都返回kNotSupported
+  // 可以和正常打开这个db的进程同时使用，但是看不到打开之后的写入；
+  // column_families中可以只给出需要读取的column family，不能包含db中没有的
+  static DBStatus OpenForReadOnly(const Options& options,
+                                  const std::string& name, DB** dbptr);
+  static DBStatus OpenForReadOnly(
+      const Options& options, const std::string& name,
+      const std::vector<ColumnFamilyDescriptor>& column_families,
+      std::vector<ColumnFamilyHandle*>* handles, DB** dbptr);
+  // 作为name目录下正在运行的db(primary)的secondary打开，和只读实例一样不写任何文件，
+  // 通过TryCatchUpWithPrimary跟上primary在MANIFEST和WAL中追加的内容，
+  // 多个进程或者共享存储的多台机器可以各自打开secondary分担读请求
+  static DBStatus OpenAsSecondary(const Options& options,
+                                  const std::string& name, DB** dbptr);
+  static DBStatus OpenAsSecondary(
+      const Options& options, const std::string& name,
+      const std::vector<ColumnFamilyDescriptor>& column_families,
+      std::vector<ColumnFamilyHandle*>* handles, DB** dbptr);
+
+  DB() = default;
+  DB(const DB&) = delete;
+  DB& operator=(const DB&) = delete;
+  virtual ~DB() = default;
+
+  // 创建一个新的column family，options中db级别的配置被忽略，见ColumnFamilyDescriptor
+  // 名字已经存在的时候返回kInvalidArgument
+  virtual DBStatus CreateColumnFamily(const Options& options,
+                                      const std::string& name,
+                                      ColumnFamilyHandle** handle) = 0;
+  // 删除之后不能再读写这个column family，它的sst在handle释放之后被删除；
+  // 默认column family不能删除
+  virtual DBStatus DropColumnFamily(ColumnFamilyHandle* column_family) = 0;
+  // 释放Open或者CreateColumnFamily返回的handle，默认column family的handle
+  // 由db持有，不需要释放
+  virtual DBStatus DestroyColumnFamilyHandle(
+      ColumnFamilyHandle* column_family) = 0;
+  virtual ColumnFamilyHandle* DefaultColumnFamily() const = 0;
+
+  DBStatus Put(const WriteOptions& options, const std::string_view& key,
+               const std::string_view& value) {
+    return Put(options, DefaultColumnFamily(), key, value);
+  }
+  virtual DBStatus Put(const WriteOptions& options,
+                       ColumnFamilyHandle* column_family,
+                       const std::string_view& key,
+                       const std::string_view& value) = 0;
+  // 写入ttl_ms毫秒之后过期的value，过期之后的读取和key不存在一样，
+  // 过期的value在compaction的时候被回收
+  DBStatus PutWithTTL(const WriteOptions& options, const std::string_view& key,
+                      const std::string_view& value, uint64_t ttl_ms) {
+    return PutWithTTL(options, DefaultColumnFamily(), key, value, ttl_ms);
+  }
+  virtual DBStatus PutWithTTL(const WriteOptions& options,
+                              ColumnFamilyHandle* column_family,
+                              const std::string_view& key,
+                              const std::string_view& value,
+                              uint64_t ttl_ms) = 0;
+  // 写入一个merge操作数，读取时由Options::merge_operator和之前的value合并，
+  // 没有设置merge_operator时返回kNotSupported
+  DBStatus Merge(const WriteOptions& options, const std::string_view& key,
+                 const std::string_view& operand) {
+    return Merge(options, DefaultColumnFamily(), key, operand);
+  }
+  virtual DBStatus Merge(const WriteOptions& options,
+                         ColumnFamilyHandle* column_family,
+                         const std::string_view& key,
+                         const std::string_view& operand) = 0;
+  // key不存在的时候也返回成功
+  DBStatus Delete(const WriteOptions& options, const std::string_view& key) {
+    return Delete(options, DefaultColumnFamily(), key);
+  }
+  virtual DBStatus Delete(const WriteOptions& options,
+                          ColumnFamilyHandle* column_family,
+                          const std::string_view& key) = 0;
+  // 删除[begin_key, end_key)中的所有key，写入的是一个range tombstone，
+  // 不需要遍历范围内的数据；begin_key大于end_key时返回kInvalidArgument
+  DBStatus DeleteRange(const WriteOptions& options,
+                       const std::string_view& begin_key,
+                       const std::string_view& end_key) {
+    return DeleteRange(options, DefaultColumnFamily(), begin_key, end_key);
+  }
+  virtual DBStatus DeleteRange(const WriteOptions& options,
+                               ColumnFamilyHandle* column_family,
+                               const std::string_view& begin_key,
+                               const std::string_view& end_key) = 0;
+  // batch中的操作要么全部生效，要么全部不生效，可以同时写入多个column family；
+  // 写入已经删除的column family的操作被忽略
+  virtual DBStatus Write(const WriteOptions& options, WriteBatch* updates) = 0;
+  // key不存在的时候返回Status::kNotFound
+  DBStatus Get(const ReadOptions& options, const std::string_view& key,
+               std::string* value) {
+    return Get(options, DefaultColumnFamily(), key, value);
+  }
+  virtual DBStatus Get(const ReadOptions& options,
+                       ColumnFamilyHandle* column_family,
+                       const std::string_view& key, std::string* value) = 0;
+  // 批量查找，返回值和(*values)[i]对应keys[i]，每个key的返回值和Get相同
+  // 所有key使用同一个快照，同一个sst中的key一起查找，共享filter、index和block的读取
+  std::vector<DBStatus> MultiGet(const ReadOptions& options,
+                                 const std::vector<std::string_view>& keys,
+                                 std::vector<std::string>* values) {
+    return MultiGet(options, DefaultColumnFamily(), keys, values);
+  }
+  virtual std::vector<DBStatus> MultiGet(
+      const ReadOptions& options, ColumnFamilyHandle* column_family,
+      const std::vector<std::string_view>& keys,
+      std::vector<std::string>* values) = 0;
+  // 不会在调用线程上等待磁盘io的Get: 先按照ReadOptions::cache_only只用内存中的数据
+  // 查找，能得到结果的时候直接在调用线程上执行callback；否则交给读线程池
+  // (Options::async_read_threads)读文件，callback在读线程上执行
+  // 返回之后key就可以释放；options.snapshot需要保持到callback执行之后，没有设置的时候
+  // 读线程上读取的是执行时刻的最新数据；delete db会等待已经提交的请求执行完callback
+  void AsyncGet(const ReadOptions& options, const std::string_view& key,
+                GetCallback callback) {
+    AsyncGet(options, DefaultColumnFamily(), key, std::move(callback));
+  }
+  virtual void AsyncGet(const ReadOptions& options,
+                        ColumnFamilyHandle* column_family,
+                        const std::string_view& key, GetCallback callback) = 0;
+  // AsyncGet的批量版本，内存中得不到结果的key在读线程上通过一次MultiGet读取；
+  // 所有key使用同一个快照
+  void AsyncMultiGet(const ReadOptions& options,
+                     const std::vector<std::string_view>& keys,
+                     MultiGetCallback callback) {
+    AsyncMultiGet(options, DefaultColumnFamily(), keys, std::move(callback));
+  }
+  virtual void AsyncMultiGet(const ReadOptions& options,
+                             ColumnFamilyHandle* column_family,
+                             const std::vector<std::string_view>& keys,
+                             MultiGetCallback callback) = 0;
+  // 返回的迭代器需要在db关闭之前delete，迭代器可以在handle释放之后继续使用
+  Iterator* NewIterator(const ReadOptions& options) {
+    return NewIterator(options, DefaultColumnFamily());
+  }
+  virtual Iterator* NewIterator(const ReadOptions& options,
+                                ColumnFamilyHandle* column_family) = 0;
+  // 并行遍历[*begin, *end)中的数据，begin为nullptr表示从头开始，end为nullptr表示
+  // 一直到最后，空字符串是普通的key；按照GetApproximateKeyBoundaries把范围切成
+  // 大小相近的n_threads个分区，每个分区在独立的线程上用各自的迭代器遍历，
+  // 所有分区使用同一个快照；遍历结束之后才返回，返回第一个出错的分区的错误
+  DBStatus ParallelScan(const ReadOptions& options,
+                        const std::string_view* begin,
+                        const std::string_view* end, int32_t n_threads,
+                        const ScanCallback& callback) {
+    return ParallelScan(options, DefaultColumnFamily(), begin, end, n_threads,
+                        callback);
+  }
+  virtual DBStatus ParallelScan(const ReadOptions& options,
+                                ColumnFamilyHandle* column_family,
+                                const std::string_view* begin,
+                                const std::string_view* end, int32_t n_threads,
+                                const ScanCallback& callback) = 0;
+  // 返回当前状态的快照，之后的写入对使用这个快照的读取不可见，
+  // 快照释放之前compaction会保留它能看到的所有版本；创建快照不会阻塞写入
+  // 序号在所有column family之间共享，同一个快照可以读取任意一个column family
+  virtual const Snapshot* GetSnapshot() = 0;
+  // 释放之后snapshot不能再使用
+  virtual void ReleaseSnapshot(const Snapshot* snapshot) = 0;
+  // 把SstFileWriter生成的sst直接链接到db中，不经过WAL和memtable，
+  // 文件中的数据比导入之前的所有写入都新；key范围和memtable重叠的时候先等待memtable刷盘
+  // 导入成功之后db不再依赖path，调用方可以删除
+  DBStatus IngestExternalFile(const std::string& path) {
+    return IngestExternalFile(DefaultColumnFamily(), path);
+  }
+  virtual DBStatus IngestExternalFile(ColumnFamilyHandle* column_family,
+                                      const std::string& path) = 0;
+
+  // 当前版本中每个sst的属性(条目数、删除标记数、原始大小、压缩率等)，
+  // 只读取Table::Open时已经解析好的properties block，不扫描data block
+  DBStatus GetPropertiesOfAllTables(TablePropertiesCollection* props) {
+    return GetPropertiesOfAllTables(DefaultColumnFamily(), props);
+  }
+  virtual DBStatus GetPropertiesOfAllTables(ColumnFamilyHandle* column_family,
+                                            TablePropertiesCollection* props) = 0;
+
+  // sizes[i]是ranges[i]中的数据在sst中大致占用的字节数，只根据index block中
+  // data block的位置估算，不读取data block，也不包括memtable中的数据
+  void GetApproximateSizes(const Range* ranges, int32_t n, uint64_t* sizes) {
+    GetApproximateSizes(DefaultColumnFamily(), ranges, n, sizes);
+  }
+  virtual void GetApproximateSizes(ColumnFamilyHandle* column_family,
+                                   const Range* ranges, int32_t n,
+                                   uint64_t* sizes) = 0;
+  // 把sst中的数据按照大小大致均分成n份，*boundaries是n-1个递增的user key，
+  // 第i份是[boundaries[i-1], boundaries[i])；同样只读取index block，
+  // 可以用来把一次全量扫描切分给多个线程，数据少的时候边界可能不足n-1个
+  void GetApproximateKeyBoundaries(int32_t n,
+                                   std::vector<std::string>* boundaries) {
+    GetApproximateKeyBoundaries(DefaultColumnFamily(), n, boundaries);
+  }
+  virtual void GetApproximateKeyBoundaries(
+      ColumnFamilyHandle* column_family, int32_t n,
+      std::vector<std::string>* boundaries) = 0;
+
+  // secondary实例读取primary新写入的MANIFEST记录和WAL，之后的读取能看到
+  // primary在调用之前完成的写入；primary在两次调用之间删除的sst如果还没有被打开过，
+  // 读取的时候返回kReadFileFailed，再调用一次之后恢复正常
+  // 不是secondary的实例返回kNotSupported
+  virtual DBStatus TryCatchUpWithPrimary() = 0;
+
+  // 把block_cache中属于这个db的data block位置写到BLOCK_CACHE_KEYS文件，
+  // 下次打开的时候按照它预热block_cache，见Options::block_cache_warmup；
+  // 需要遍历整个block_cache，但是不阻塞读写
+  virtual DBStatus PersistBlockCacheKeys() = 0;
+
+  // 暂停删除不再需要的文件，flush和compaction照常进行，只是被替换掉的sst、
+  // blob文件和WAL先保留下来；可以嵌套调用，每次调用都需要对应一次EnableFileDeletions
+  virtual DBStatus DisableFileDeletions() = 0;
+  // 嵌套计数减到0之后立即删除暂停期间积累的废弃文件，
+  // 没有对应的DisableFileDeletions时返回kInvalidArgument
+  virtual DBStatus EnableFileDeletions() = 0;
+  // 打开当前状态的db需要的所有文件(db目录下的文件名): CURRENT、MANIFEST、
+  // 每个column family当前版本中的sst和blob文件以及还需要回放的WAL；
+  // MANIFEST只有前*manifest_file_size个字节属于当前状态，后面可能有写到一半的记录
+  // 需要在DisableFileDeletions之后调用，否则返回的文件随时可能被删除
+  virtual DBStatus GetLiveFiles(std::vector<std::string>* files,
+                                uint64_t* manifest_file_size) = 0;
+  // 打开时传入的db目录
+  virtual const std::string& GetName() const = 0;
+
+  // 查询db内部的状态，不支持的property返回false
+  //  "corekv.num-files-at-level<N>": 第N层的sst个数
+  //  "corekv.total-sst-files-size": 当前版本中所有sst的总大小
+  //  "corekv.num-blob-files": 当前版本中还有有效value的blob文件个数
+  //  "corekv.estimate-pending-compaction-bytes": 估计的待compaction字节数
+  //  "corekv.actual-delayed-write-rate": 当前限制的写入速率(字节/秒)，没有限速时为0
+  //  "corekv.is-write-stopped": 写入是否因为compaction积压而停止，1或者0
+  //  "corekv.stats": Options::statistics中的计数器和延迟分布，没有设置时返回false
+  bool GetProperty(const std::string_view& property, std::string* value) {
+    return GetProperty(DefaultColumnFamily(), property, value);
+  }
+  // 前四个property只统计column_family，其余的是整个db的
+  virtual bool GetProperty(ColumnFamilyHandle* column_family,
+                           const std::string_view& property,
+                           std::string* value) = 0;
+};
+
+// 删除db目录下的所有文件
+DBStatus DestroyDB(const std::string& name, const Options& options);
+}  // namespace corekv
+#endif
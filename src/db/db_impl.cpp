@@ -0,0 +1,2694 @@
+#include "db_impl.h"
+
+#include <ctype.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "../file/file.h"
+#include "../file/file_name.h"
+#include "../table/merging_iterator.h"
+#include "../table/table.h"
+#include "../table/table_builder.h"
+#include "../utils/codec.h"
+#include "../utils/crc32.h"
+#include "../utils/perf_context.h"
+#include "../utils/rate_limiter.h"
+#include "../utils/statistics.h"
+#include "../utils/thread_pool.h"
+#include "../utils/util.h"
+#include "blob_file.h"
+#include "builder.h"
+#include "compaction_filter.h"
+#include "db_iter.h"
+#include "log_reader.h"
+#include "log_writer.h"
+#include "memtable.h"
+#include "merge_operator.h"
+#include "table_cache.h"
+#include "version_set.h"
+#include "write_batch.h"
+#include "write_batch_internal.h"
+namespace corekv {
+// 按照compression_per_level选择输出到level这一层的sst使用的压缩算法
+static Options OptionsForLevel(const Options& options, int level) {
+  Options result = options;
+  const auto& per_level = options.compression_per_level;
+  if (!per_level.empty()) {
+    result.block_compress_type =
+        per_level[std::min<size_t>(level, per_level.size() - 1)];
+  }
+  return result;
+}
+
+// memtable中没有任何entry和range tombstone
+static bool MemTableEmpty(MemTable* mem) {
+  std::unique_ptr<Iterator> iter(mem->NewIterator());
+  iter->SeekToFirst();
+  return !iter->Valid() && mem->GetRangeTombstones() == nullptr;
+}
+
+ColumnFamilyHandleImpl::ColumnFamilyHandleImpl(ColumnFamilyData* cfd,
+                                               std::mutex* mu)
+    : cfd_(cfd), mu_(mu) {
+  cfd_->Ref();
+}
+
+ColumnFamilyHandleImpl::~ColumnFamilyHandleImpl() {
+  std::lock_guard<std::mutex> lock(*mu_);
+  cfd_->Unref();
+}
+
+const std::string& ColumnFamilyHandleImpl::GetName() const {
+  return cfd_->name();
+}
+
+uint32_t ColumnFamilyHandleImpl::GetID() const { return cfd_->id(); }
+
+DBImpl::DBImpl(const Options& options, const std::string& dbname)
+    : dbname_(dbname),
+      options_(options),
+      write_controller_(options.delayed_write_rate) {
+  blob_source_ = std::make_unique<BlobSource>(dbname_, &options_);
+  versions_ = std::make_unique<VersionSet>(dbname_, &options_,
+                                           blob_source_.get());
+  read_pool_ =
+      std::make_unique<ThreadPool>(std::max(1, options_.async_read_threads));
+}
+
+DBImpl::~DBImpl() {
+  // 已经提交的异步读先执行完callback
+  read_pool_.reset();
+  std::unique_lock<std::mutex> lock(mutex_);
+  writers_cv_.wait(lock, [this]() { return pending_writes_.empty(); });
+  // 等待正在进行的后台任务结束，还没有刷盘的imm在下次打开的时候从WAL中恢复
+  shutting_down_.store(true, std::memory_order_release);
+  bg_done_cv_.wait(lock, [this]() {
+    return !bg_flush_scheduled_ && bg_compaction_scheduled_ == 0 &&
+           !bg_warmup_scheduled_;
+  });
+  lock.unlock();
+  bg_pool_.reset();
+  if (options_.block_cache_warmup && !read_only_) {
+    // 失败的时候下次打开只是不预热
+    PersistBlockCacheKeys();
+  }
+  // handle析构的时候需要加锁
+  default_cf_handle_.reset();
+  lock.lock();
+  log_.reset();
+  if (logfile_) {
+    logfile_->Close();
+    logfile_.reset();
+  }
+  versions_.reset();
+  blob_source_.reset();
+}
+
+DBStatus DBImpl::NewDB(const Options& options) {
+  VersionEdit new_db;
+  new_db.SetComparatorName(options.comparator ? options.comparator->Name()
+                                              : ByteComparator().Name());
+  new_db.SetLogNumber(0);
+  new_db.SetNextFile(2);
+  new_db.SetLastSequence(0);
+
+  const std::string& manifest = FileName::DescriptorFileName(dbname_, 1);
+  FileWriter file(manifest);
+  log::Writer writer(&file);
+  std::string record;
+  new_db.EncodeTo(&record);
+  DBStatus s = writer.AddRecord(record);
+  if (s == Status::kSuccess) {
+    s = file.Sync();
+  }
+  file.Close();
+  if (s == Status::kSuccess) {
+    s = FileName::SetCurrentFile(dbname_, 1);
+  } else {
+    FileTool::RemoveFile(manifest);
+  }
+  return s;
+}
+
+DBStatus DBImpl::Recover(
+    const std::vector<ColumnFamilyDescriptor>& column_families,
+    std::map<uint32_t, VersionEdit>* edits,
+    std::vector<std::string>* missing) {
+  FileTool::CreateDir(dbname_);
+  if (!FileTool::FileExists(FileName::CurrentFileName(dbname_))) {
+    if (!options_.create_if_missing) {
+      return Status::kInvalidArgument;
+    }
+    auto iter = std::find_if(column_families.begin(), column_families.end(),
+                             [](const ColumnFamilyDescriptor& d) {
+                               return d.name == kDefaultColumnFamilyName;
+                             });
+    assert(iter != column_families.end());
+    DBStatus s = NewDB(iter->options);
+    if (s != Status::kSuccess) {
+      return s;
+    }
+  } else if (options_.error_if_exists) {
+    return Status::kInvalidArgument;
+  }
+  DBStatus s = versions_->Recover(column_families, missing);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  // 编号大于等于所有column family的LogNumber中最小值的WAL可能还有没有刷成sst的数据，
+  // 需要按照编号顺序回放
+  std::vector<std::string> filenames;
+  s = FileTool::GetChildren(dbname_, &filenames);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  const uint64_t min_log_number = versions_->MinLogNumber();
+  std::vector<uint64_t> logs;
+  uint64_t number;
+  FileType type;
+  for (const auto& filename : filenames) {
+    if (FileName::ParseFileName(filename, &number, &type) &&
+        type == FileType::kLogFile && number >= min_log_number) {
+      logs.push_back(number);
+    }
+  }
+  std::sort(logs.begin(), logs.end());
+  SequenceNumber max_sequence = 0;
+  for (const auto& log_number : logs) {
+    s = RecoverLogFile(log_number, edits, &max_sequence);
+    if (s != Status::kSuccess) {
+      return s;
+    }
+    versions_->MarkFileNumberUsed(log_number);
+  }
+  if (versions_->LastSequence() < max_sequence) {
+    versions_->SetLastSequence(max_sequence);
+  }
+  visible_sequence_ = versions_->LastSequence();
+  return Status::kSuccess;
+}
+
+DBStatus DBImpl::RecoverLogFile(uint64_t log_number,
+                                std::map<uint32_t, VersionEdit>* edits,
+                                SequenceNumber* max_sequence) {
+  FileReader file(FileName::LogFileName(dbname_, log_number));
+  if (!file.IsOpen()) {
+    return Status::kReadFileFailed;
+  }
+  // 尾部不完整的记录是写到一半时宕机导致的，直接丢弃
+  log::Reader reader(&file, true);
+  std::string_view record;
+  std::string scratch;
+  WriteBatch batch;
+  // 每个column family回放到各自的memtable中；已经删除的column family，
+  // 以及这个WAL中的数据已经刷成sst的column family对应nullptr
+  std::map<uint32_t, MemTable*> mems;
+  auto lookup = [this, log_number, &mems](uint32_t id) -> MemTable* {
+    auto iter = mems.find(id);
+    if (iter != mems.end()) {
+      return iter->second;
+    }
+    MemTable* mem = nullptr;
+    auto cf = versions_->column_families().find(id);
+    if (cf != versions_->column_families().end() &&
+        log_number >= cf->second->LogNumber()) {
+      mem = cf->second->NewMemTable();
+      mem->Ref();
+    }
+    mems[id] = mem;
+    return mem;
+  };
+  // 把id对应的memtable刷成sst
+  auto flush = [this, edits, &mems](uint32_t id) {
+    MemTable* mem = mems[id];
+    mems.erase(id);
+    DBStatus s = WriteLevel0Table(versions_->column_families().at(id), mem,
+                                  &(*edits)[id]);
+    mem->Unref();
+    return s;
+  };
+  DBStatus s = Status::kSuccess;
+  while (reader.ReadRecord(&record, &scratch) && s == Status::kSuccess) {
+    if (record.size() < 12) {
+      continue;
+    }
+    WriteBatchInternal::SetContents(&batch, record);
+    s = WriteBatchInternal::InsertInto(&batch, lookup, false);
+    if (s != Status::kSuccess) {
+      break;
+    }
+    const SequenceNumber last_seq = WriteBatchInternal::Sequence(&batch) +
+                                    WriteBatchInternal::Count(&batch) - 1;
+    if (last_seq > *max_sequence) {
+      *max_sequence = last_seq;
+    }
+    std::vector<uint32_t> full;
+    for (const auto& [id, mem] : mems) {
+      if (mem != nullptr &&
+          mem->ApproximateMemoryUsage() >
+              versions_->column_families().at(id)->options().write_buffer_size) {
+        full.push_back(id);
+      }
+    }
+    for (const uint32_t id : full) {
+      if (s == Status::kSuccess) {
+        s = flush(id);
+      }
+    }
+  }
+  for (const auto& [id, mem] : mems) {
+    if (mem == nullptr) {
+      continue;
+    }
+    if (s == Status::kSuccess) {
+      s = WriteLevel0Table(versions_->column_families().at(id), mem,
+                           &(*edits)[id]);
+    }
+    mem->Unref();
+  }
+  return s;
+}
+
+DBStatus DBImpl::NewLogFile() {
+  const uint64_t new_log_number = versions_->NewFileNumber();
+  auto logfile = std::make_unique<FileWriter>(
+      FileName::LogFileName(dbname_, new_log_number));
+  log_.reset();
+  if (logfile_) {
+    logfile_->Close();
+  }
+  logfile_ = std::move(logfile);
+  logfile_number_ = new_log_number;
+  log_ = std::make_unique<GroupCommitWriter>(logfile_.get(), 0,
+                                             options_.statistics.get());
+  return Status::kSuccess;
+}
+
+uint64_t DBImpl::NewBlobFileNumber(std::vector<uint64_t>* numbers) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const uint64_t number = versions_->NewFileNumber();
+  pending_outputs_.insert(number);
+  numbers->push_back(number);
+  return number;
+}
+
+DBStatus DBImpl::WriteLevel0Table(ColumnFamilyData* cfd, MemTable* mem,
+                                  VersionEdit* edit) {
+  StopWatch watch(options_.statistics.get(), kFlushTime);
+  const Options& options = cfd->options();
+  FileMetaData meta;
+  meta.number = versions_->NewFileNumber();
+  pending_outputs_.insert(meta.number);
+  Iterator* iter = mem->NewIterator();
+  std::vector<uint64_t> blob_numbers;
+  std::unique_ptr<BlobFileBuilder> blob_builder;
+  if (options.min_blob_size > 0) {
+    blob_builder = std::make_unique<BlobFileBuilder>(
+        dbname_, &options,
+        [this, &blob_numbers]() { return NewBlobFileNumber(&blob_numbers); },
+        IOPriority::kHigh);
+  }
+  DBStatus s;
+  {
+    // mem已经不会再被写入了，生成sst的时候不需要持有锁
+    mutex_.unlock();
+    auto range_del = mem->GetRangeTombstones();
+    s = BuildTable(dbname_, OptionsForLevel(options, 0), cfd->table_cache(),
+                   iter, &meta, blob_builder.get(),
+                   range_del ? &range_del->tombstones() : nullptr);
+    mutex_.lock();
+  }
+  delete iter;
+  pending_outputs_.erase(meta.number);
+  for (const uint64_t number : blob_numbers) {
+    pending_outputs_.erase(number);
+  }
+  if (s == Status::kSuccess && meta.file_size > 0) {
+    RecordTick(options_.statistics.get(), kFlushWriteBytes, meta.file_size);
+    edit->AddFile(0, meta);
+    if (blob_builder) {
+      for (const auto& f : blob_builder->files()) {
+        edit->AddBlobFile(f.number, f.count, f.bytes);
+      }
+    }
+  }
+  return s;
+}
+
+void DBImpl::CompactMemTable(ColumnFamilyData* cfd) {
+  assert(cfd->imm() != nullptr);
+  VersionEdit edit;
+  DBStatus s = WriteLevel0Table(cfd, cfd->imm(), &edit);
+  if (cfd->IsDropped()) {
+    // 刷盘的过程中column family被删除了，生成的sst等待DeleteObsoleteFiles删除
+    cfd->ClearImmutableMemTable();
+    DeleteObsoleteFiles();
+    return;
+  }
+  if (s == Status::kSuccess) {
+    // imm之前的WAL中已经没有这个column family需要的数据了
+    edit.SetLogNumber(cfd->MemLogNumber());
+    s = versions_->LogAndApply(cfd, &edit);
+  }
+  if (s == Status::kSuccess) {
+    cfd->ClearImmutableMemTable();
+    DeleteObsoleteFiles();
+  } else {
+    bg_error_ = s;
+  }
+}
+
+void DBImpl::RecalculateWriteStallCondition() {
+  WriteStallCondition condition = WriteStallCondition::kNormal;
+  uint64_t pending_bytes = 0;
+  // level0的文件数离停写只差两个的时候，不管积压有没有增加都降低速率
+  bool near_stop = false;
+  for (const auto& cf : versions_->column_families()) {
+    const Options& options = cf.second->options();
+    const Version* current = cf.second->current();
+    // FIFO方式下level0的文件个数不会因为compaction减少，只受总大小限制
+    const int32_t l0_files = options.compaction_style == kCompactionStyleFIFO
+                                 ? 0
+                                 : current->NumFiles(0);
+    const uint64_t bytes = current->EstimatedPendingCompactionBytes();
+    if (l0_files >= options.level0_stop_writes_trigger ||
+        (options.hard_pending_compaction_bytes_limit > 0 &&
+         bytes >= options.hard_pending_compaction_bytes_limit)) {
+      condition = WriteStallCondition::kStopped;
+    } else if (l0_files >= options.level0_slowdown_writes_trigger ||
+               (options.soft_pending_compaction_bytes_limit > 0 &&
+                bytes >= options.soft_pending_compaction_bytes_limit)) {
+      if (condition == WriteStallCondition::kNormal) {
+        condition = WriteStallCondition::kDelayed;
+      }
+      pending_bytes = std::max(pending_bytes, bytes);
+      near_stop |= (l0_files >= options.level0_stop_writes_trigger - 2);
+    }
+  }
+  if (condition == WriteStallCondition::kNormal) {
+    write_controller_.Reset();
+  } else if (condition == WriteStallCondition::kDelayed &&
+             write_stall_condition_ == WriteStallCondition::kDelayed) {
+    if (near_stop || pending_bytes > last_pending_compaction_bytes_) {
+      write_controller_.Slowdown();
+    } else if (pending_bytes < last_pending_compaction_bytes_) {
+      write_controller_.Speedup();
+    }
+  }
+  last_pending_compaction_bytes_ = pending_bytes;
+  write_stall_condition_ = condition;
+}
+
+void DBImpl::MaybeScheduleCompaction() {
+  // 每次版本变化之后都会走到这里
+  RecalculateWriteStallCondition();
+  if (shutting_down_.load(std::memory_order_acquire) ||
+      bg_error_ != Status::kSuccess || !bg_pool_) {
+    return;
+  }
+  const auto& column_families = versions_->column_families();
+  const bool has_imm =
+      std::any_of(column_families.begin(), column_families.end(),
+                  [](const auto& cf) { return cf.second->imm() != nullptr; });
+  if (has_imm && !bg_flush_scheduled_) {
+    bg_flush_scheduled_ = true;
+    bg_pool_->Schedule([this]() { BackgroundFlush(); });
+  }
+  // 至少给刷盘留一个线程，避免compaction占满线程池导致写入阻塞
+  const int32_t max_compactions = std::max(1, bg_pool_->ThreadNum() - 1);
+  for (const auto& cf : column_families) {
+    while (bg_compaction_scheduled_ < max_compactions) {
+      Compaction* c = versions_->PickCompaction(cf.second);
+      if (c == nullptr) {
+        break;
+      }
+      ++bg_compaction_scheduled_;
+      bg_pool_->Schedule([this, c]() { BackgroundCompaction(c); });
+    }
+  }
+}
+
+void DBImpl::BackgroundFlush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // 刷盘的过程中会释放锁，每一轮重新查找有imm的column family
+  while (!shutting_down_.load(std::memory_order_acquire) &&
+         bg_error_ == Status::kSuccess) {
+    ColumnFamilyData* cfd = nullptr;
+    for (const auto& cf : versions_->column_families()) {
+      if (cf.second->imm() != nullptr) {
+        cfd = cf.second;
+        break;
+      }
+    }
+    if (cfd == nullptr) {
+      break;
+    }
+    // 刷盘的过程中column family可能被删除
+    cfd->Ref();
+    CompactMemTable(cfd);
+    cfd->Unref();
+  }
+  bg_flush_scheduled_ = false;
+  // 刷盘之后level0可能需要compaction
+  MaybeScheduleCompaction();
+  bg_done_cv_.notify_all();
+}
+
+struct DBImpl::SubcompactionState {
+  struct Output {
+    uint64_t number;
+    uint64_t file_size;
+    std::string smallest, largest;
+    SequenceNumber largest_seqno = 0;
+    uint64_t num_range_deletions = 0;
+  };
+  // 负责的user key范围[start, end)，nullptr表示不限制
+  const std::string* start = nullptr;
+  const std::string* end = nullptr;
+  // 当前输出文件负责的range tombstone范围的起点，也就是上一个输出文件的终点
+  std::string output_lower;
+  bool has_output_lower = false;
+  std::vector<Output> outputs;
+  std::unique_ptr<FileWriter> outfile;
+  std::unique_ptr<TableBuilder> builder;
+  // 分离出来的value和GC搬迁的value写到这里，第一次需要的时候才创建
+  std::unique_ptr<BlobFileBuilder> blob_builder;
+  std::vector<uint64_t> blob_numbers;
+  // 被丢弃或者搬迁的value所在的blob文件 -> (个数, 字节数)
+  std::map<uint64_t, std::pair<uint64_t, uint64_t>> blob_garbage;
+  uint64_t total_bytes = 0;
+  // IsBaseLevelForKey中每一层当前检查到的位置
+  size_t level_ptrs[config::kNumLevels] = {0};
+  DBStatus status = Status::kSuccess;
+
+  Output* current_output() { return &outputs[outputs.size() - 1]; }
+};
+
+struct DBImpl::CompactionState {
+  explicit CompactionState(Compaction* c) : compaction(c) {}
+
+  Compaction* const compaction;
+  // 最旧的快照，没有快照的时候是compaction开始时最新的序号；
+  // 小于等于它的版本之间只有最新的一个可能被读取
+  SequenceNumber smallest_snapshot = 0;
+  // compaction开始时所有快照的序号，从小到大
+  std::vector<SequenceNumber> snapshots;
+
+  // 能看到sequence的最旧的快照，没有的时候返回kMaxSequenceNumber，
+  // 表示只有不使用快照的读取能看到；同一个key落在同一个区间里的多个版本，
+  // 任何读取都只能看到其中最新的一个
+  SequenceNumber EarliestVisibleSnapshot(SequenceNumber sequence) const {
+    auto iter = std::lower_bound(snapshots.begin(), snapshots.end(), sequence);
+    return iter == snapshots.end() ? kMaxSequenceNumber : *iter;
+  }
+  // 所有输入sst中的range tombstone，没有的时候为nullptr
+  std::shared_ptr<const FragmentedRangeTombstoneList> range_del;
+  // ikey被输入中的range tombstone删除，并且能看到ikey的读请求都能看到这个tombstone
+  bool CoveredByRangeTombstone(const ParsedInternalKey& ikey) const {
+    return range_del != nullptr &&
+           ikey.sequence <
+               range_del->MaxCoveringSequence(
+                   ikey.user_key, EarliestVisibleSnapshot(ikey.sequence));
+  }
+  // 当前输出文件需要写入的range tombstone，范围是[sub->output_lower, upper)；
+  // 对所有读请求可见并且更高的层中没有数据可以删除的tombstone直接丢弃
+  void OutputRangeTombstones(const SubcompactionState* sub,
+                             const std::string_view* upper,
+                             std::vector<RangeTombstone>* result) const {
+    result->clear();
+    if (range_del == nullptr) {
+      return;
+    }
+    const std::string_view lower_view = sub->output_lower;
+    std::vector<RangeTombstone> clipped;
+    range_del->GetClipped(sub->has_output_lower ? &lower_view : nullptr, upper,
+                          &clipped);
+    for (auto& t : clipped) {
+      if (t.seq > smallest_snapshot ||
+          !compaction->IsBaseLevelForRange(t.start, t.end)) {
+        result->push_back(std::move(t));
+      }
+    }
+  }
+  // 指向编号小于它的blob文件的value需要搬迁到新的blob文件
+  uint64_t blob_gc_cutoff = 0;
+  // compaction开始的时间(ms)，过期时间不晚于它的value按照删除处理
+  uint64_t now = 0;
+  // 子任务之间的分界点，sub_compact_states比boundaries多一个
+  std::vector<std::string> boundaries;
+  std::vector<SubcompactionState> sub_compact_states;
+};
+
+void DBImpl::BackgroundCompaction(Compaction* c) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  DBStatus s = Status::kSuccess;
+  if (shutting_down_.load(std::memory_order_acquire) ||
+      c->column_family()->IsDropped()) {
+    // 直接放弃
+  } else if (c->IsTrivialMove()) {
+    // 只需要修改元数据，把文件移动到下一层
+    FileMetaData* f = c->input(0, 0);
+    c->edit()->RemoveFile(c->level(), f->number);
+    c->edit()->AddFile(c->output_level(), *f);
+    s = versions_->LogAndApply(c->column_family(), c->edit());
+  } else if (c->IsDeletionCompaction()) {
+    c->AddInputDeletions(c->edit());
+    s = versions_->LogAndApply(c->column_family(), c->edit());
+  } else {
+    CompactionState compact(c);
+    s = DoCompactionWork(&compact);
+    CleanupCompaction(&compact);
+  }
+  versions_->ReleaseCompaction(c);
+  delete c;
+  if (s != Status::kSuccess &&
+      !shutting_down_.load(std::memory_order_acquire)) {
+    bg_error_ = s;
+  }
+  DeleteObsoleteFiles();
+  --bg_compaction_scheduled_;
+  // 当前compaction的输出可能导致下一层也需要compaction
+  MaybeScheduleCompaction();
+  bg_done_cv_.notify_all();
+}
+
+void DBImpl::CleanupCompaction(CompactionState* compact) {
+  for (auto& sub : compact->sub_compact_states) {
+    if (sub.builder) {
+      // 异常退出时，已经创建的文件等待DeleteObsoleteFiles删除
+      sub.builder.reset();
+      sub.outfile->Close();
+    }
+    sub.outfile.reset();
+    sub.blob_builder.reset();
+    for (const auto& out : sub.outputs) {
+      pending_outputs_.erase(out.number);
+    }
+    for (const uint64_t number : sub.blob_numbers) {
+      pending_outputs_.erase(number);
+    }
+  }
+}
+
+DBStatus DBImpl::OpenCompactionOutputFile(CompactionState* compact,
+                                          SubcompactionState* sub, int level) {
+  assert(!sub->builder);
+  uint64_t file_number;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_number = versions_->NewFileNumber();
+    pending_outputs_.insert(file_number);
+    SubcompactionState::Output out;
+    out.number = file_number;
+    out.file_size = 0;
+    sub->outputs.push_back(out);
+  }
+  sub->outfile = std::make_unique<FileWriter>(
+      FileName::TableFileName(dbname_, file_number), false,
+      options_.use_direct_io_for_flush_and_compaction);
+  sub->outfile->SetRateLimiter(options_.rate_limiter.get(), IOPriority::kLow);
+  sub->outfile->SetBytesPerSync(options_.bytes_per_sync);
+  sub->builder = std::make_unique<TableBuilder>(
+      OptionsForLevel(compact->compaction->column_family()->options(), level),
+      sub->outfile.get());
+  sub->builder->SetCreationTime(compact->now);
+  return Status::kSuccess;
+}
+
+DBStatus DBImpl::FinishCompactionOutputFile(CompactionState* compact,
+                                            SubcompactionState* sub,
+                                            const std::string_view* upper) {
+  assert(sub->builder);
+  auto* out = sub->current_output();
+  const uint64_t output_number = out->number;
+  ColumnFamilyData* cfd = compact->compaction->column_family();
+  std::vector<RangeTombstone> tombstones;
+  compact->OutputRangeTombstones(sub, upper, &tombstones);
+  for (const auto& t : tombstones) {
+    sub->builder->AddRangeTombstone(t);
+    ExtendFileBounds(t, cfd->options().comparator.get(), &out->smallest,
+                     &out->largest);
+    out->largest_seqno = std::max(out->largest_seqno, t.seq);
+  }
+  out->num_range_deletions = tombstones.size();
+  // 下一个输出文件从这里开始
+  sub->has_output_lower = (upper != nullptr);
+  if (upper != nullptr) {
+    sub->output_lower.assign(upper->data(), upper->size());
+  }
+  sub->builder->Finish();
+  DBStatus s =
+      sub->builder->Success() ? Status::kSuccess : Status::kWriteFileFailed;
+  const uint64_t file_size = sub->builder->GetFileSize();
+  sub->current_output()->file_size = file_size;
+  sub->total_bytes += file_size;
+  sub->builder.reset();
+  sub->outfile.reset();
+  if (s == Status::kSuccess) {
+    // 确认生成的sst是可以正常打开的
+    Iterator* iter = cfd->table_cache()->NewIterator(ReadOptions(),
+                                                     output_number, file_size);
+    s = iter->status();
+    delete iter;
+  }
+  return s;
+}
+
+DBStatus DBImpl::InstallCompactionResults(CompactionState* compact) {
+  Compaction* c = compact->compaction;
+  c->AddInputDeletions(c->edit());
+  for (const auto& sub : compact->sub_compact_states) {
+    for (const auto& out : sub.outputs) {
+      FileMetaData meta;
+      meta.number = out.number;
+      meta.file_size = out.file_size;
+      meta.smallest = out.smallest;
+      meta.largest = out.largest;
+      meta.largest_seqno = out.largest_seqno;
+      meta.num_range_deletions = out.num_range_deletions;
+      meta.file_creation_time = compact->now;
+      c->edit()->AddFile(c->output_level(), meta);
+    }
+    if (sub.blob_builder) {
+      for (const auto& f : sub.blob_builder->files()) {
+        c->edit()->AddBlobFile(f.number, f.count, f.bytes);
+      }
+    }
+    for (const auto& garbage : sub.blob_garbage) {
+      c->edit()->AddBlobGarbage(garbage.first, garbage.second.first,
+                                garbage.second.second);
+    }
+  }
+  return versions_->LogAndApply(c->column_family(), c->edit());
+}
+
+DBStatus DBImpl::SeparateBlobValue(CompactionState* compact,
+                                   SubcompactionState* sub, bool drop,
+                                   ValueType type, std::string_view* key,
+                                   std::string_view* value,
+                                   std::string* key_buf,
+                                   std::string* value_buf) {
+  if (type == kTypeBlobIndex) {
+    BlobIndex index;
+    if (!index.DecodeFrom(*value)) {
+      return Status::kCorruption;
+    }
+    if (!drop && index.file_number >= compact->blob_gc_cutoff) {
+      // 索引原样保留
+      return Status::kSuccess;
+    }
+    auto& garbage = sub->blob_garbage[index.file_number];
+    ++garbage.first;
+    garbage.second += index.size;
+    if (drop) {
+      return Status::kSuccess;
+    }
+    // 需要搬迁的value读出来之后和普通的value一样处理
+    DBStatus s = blob_source_->Get(index, value_buf);
+    if (s != Status::kSuccess) {
+      return s;
+    }
+    key_buf->assign(key->data(), key->size());
+    SetInternalKeyType(key_buf, kTypeValue);
+    *key = *key_buf;
+    *value = *value_buf;
+  }
+  const Options& options = compact->compaction->column_family()->options();
+  if (drop || options.min_blob_size == 0 ||
+      value->size() < options.min_blob_size) {
+    return Status::kSuccess;
+  }
+  if (!sub->blob_builder) {
+    sub->blob_builder = std::make_unique<BlobFileBuilder>(
+        dbname_, &options,
+        [this, sub]() { return NewBlobFileNumber(&sub->blob_numbers); },
+        IOPriority::kLow);
+  }
+  std::string blob_index;
+  DBStatus s = sub->blob_builder->Add(*value, &blob_index);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  // 搬迁的时候key已经在key_buf中了
+  if (key->data() != key_buf->data()) {
+    key_buf->assign(key->data(), key->size());
+  }
+  SetInternalKeyType(key_buf, kTypeBlobIndex);
+  value_buf->swap(blob_index);
+  *key = *key_buf;
+  *value = *value_buf;
+  return Status::kSuccess;
+}
+
+DBStatus DBImpl::AddCompactionOutput(CompactionState* compact,
+                                     SubcompactionState* sub, int32_t level,
+                                     const std::string_view& key,
+                                     const std::string_view& value) {
+  if (!sub->builder) {
+    DBStatus s = OpenCompactionOutputFile(compact, sub, level);
+    if (s != Status::kSuccess) {
+      return s;
+    }
+  }
+  auto* out = sub->current_output();
+  if (sub->builder->GetEntryNum() == 0) {
+    out->smallest.assign(key.data(), key.size());
+  }
+  out->largest.assign(key.data(), key.size());
+  if (key.size() >= kInternalKeyTailSize) {
+    out->largest_seqno = std::max(
+        out->largest_seqno,
+        util::DecodeFixed64(key.data() + key.size() - kInternalKeyTailSize) >> 8);
+  }
+  sub->builder->Add(key, value);
+  return Status::kSuccess;
+}
+
+DBStatus DBImpl::MergeCompactionOperands(CompactionState* compact,
+                                         SubcompactionState* sub,
+                                         Iterator* input,
+                                         const ParsedInternalKey& newest,
+                                         bool* merged) {
+  Compaction* c = compact->compaction;
+  const Options& options = c->column_family()->options();
+  Comparator* ucmp = c->column_family()->user_comparator();
+  const std::string user_key(newest.user_key);
+  // 从新到旧的操作数和它们的internal key
+  std::vector<std::string> keys, operands;
+  std::string base;
+  bool has_base = false;
+  bool found_base = false;
+  for (; input->Valid(); input->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(input->key(), &ikey) ||
+        ucmp->Compare(ikey.user_key, user_key) != 0) {
+      break;
+    }
+    if (compact->CoveredByRangeTombstone(ikey)) {
+      // 和删除标记一样作为合并的基础，它本身由调用方丢弃
+      found_base = true;
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      keys.emplace_back(input->key());
+      operands.emplace_back(input->value());
+      continue;
+    }
+    // 遇到value或者删除标记就可以合并，它本身留给调用方作为被遮住的旧版本丢弃
+    found_base = true;
+    if (ikey.type == kTypeValue) {
+      base.assign(input->value());
+      has_base = true;
+    } else if (ikey.type == kTypeValueWithExpiry) {
+      std::string_view value;
+      uint64_t expire_at;
+      if (SplitExpiry(input->value(), &value, &expire_at) &&
+          expire_at > compact->now) {
+        base.assign(value.data(), value.size());
+        has_base = true;
+      }
+    } else if (ikey.type == kTypeBlobIndex) {
+      DBStatus s = blob_source_->Get(input->value(), &base);
+      if (s != Status::kSuccess) {
+        return s;
+      }
+      has_base = true;
+    }
+    break;
+  }
+
+  const int32_t output_level = c->output_level();
+  std::string value;
+  *merged = false;
+  if (found_base || c->IsBaseLevelForKey(user_key, sub->level_ptrs)) {
+    std::vector<std::string_view> views(operands.rbegin(), operands.rend());
+    const std::string_view base_view(base);
+    // 合并失败的时候原样保留操作数，由读取的时候报告错误
+    *merged = options.merge_operator->FullMerge(
+        user_key, has_base ? &base_view : nullptr, views, &value);
+  }
+  if (!*merged) {
+    for (size_t i = 0; i < keys.size(); ++i) {
+      DBStatus s = AddCompactionOutput(compact, sub, output_level, keys[i],
+                                       operands[i]);
+      if (s != Status::kSuccess) {
+        return s;
+      }
+    }
+    return Status::kSuccess;
+  }
+  // 合并的结果使用最新的操作数的序号
+  std::string key_buf = keys.front();
+  SetInternalKeyType(&key_buf, kTypeValue);
+  std::string_view output_key = key_buf;
+  std::string_view output_value = value;
+  std::string blob_key, blob_value;
+  DBStatus s = SeparateBlobValue(compact, sub, false, kTypeValue, &output_key,
+                                 &output_value, &blob_key, &blob_value);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  return AddCompactionOutput(compact, sub, output_level, output_key,
+                             output_value);
+}
+
+void DBImpl::ProcessKeyValueCompaction(CompactionState* compact,
+                                       SubcompactionState* sub) {
+  Compaction* c = compact->compaction;
+  Iterator* input = versions_->MakeInputIterator(c);
+  if (sub->start != nullptr) {
+    std::string seek_key;
+    AppendInternalKey(&seek_key, ParsedInternalKey(*sub->start,
+                                                   kMaxSequenceNumber,
+                                                   kValueTypeForSeek));
+    input->Seek(seek_key);
+  } else {
+    input->SeekToFirst();
+  }
+  if (sub->start != nullptr) {
+    sub->output_lower = *sub->start;
+    sub->has_output_lower = true;
+  }
+  DBStatus s = Status::kSuccess;
+  const Options& options = c->column_family()->options();
+  Comparator* ucmp = c->column_family()->user_comparator();
+  std::string current_user_key;
+  bool has_current_user_key = false;
+  SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  ParsedInternalKey ikey;
+  // 分离value或者搬迁blob之后输出的key和value
+  std::string blob_key, blob_value;
+  // compaction_filter改写之后的value
+  std::string filtered_value;
+  while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
+    const std::string_view key = input->key();
+    bool drop = false;
+    // 过期或者被compaction_filter删除的value，按照删除标记处理
+    bool as_deletion = false;
+    bool value_changed = false;
+    if (!ParseInternalKey(key, &ikey)) {
+      // 解析失败的key不能丢弃，原样保留
+      current_user_key.clear();
+      has_current_user_key = false;
+      last_sequence_for_key = kMaxSequenceNumber;
+    } else {
+      if (sub->end != nullptr && ucmp->Compare(ikey.user_key, *sub->end) >= 0) {
+        // 剩下的key属于下一个子任务
+        break;
+      }
+      const bool new_user_key =
+          !has_current_user_key ||
+          ucmp->Compare(ikey.user_key, current_user_key) != 0;
+      if (new_user_key) {
+        // 同一个user_key的多个版本必须在同一个sst中，否则下一次compaction的时候
+        // 只有一部分版本被合并到下一层，旧版本反而会遮住新版本
+        if (sub->builder &&
+            sub->builder->GetFileSize() >= c->MaxOutputFileSize()) {
+          s = FinishCompactionOutputFile(compact, sub, &ikey.user_key);
+          if (s != Status::kSuccess) {
+            break;
+          }
+        }
+        current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
+        has_current_user_key = true;
+        last_sequence_for_key = kMaxSequenceNumber;
+      }
+      if (last_sequence_for_key != kMaxSequenceNumber &&
+          compact->EarliestVisibleSnapshot(last_sequence_for_key) ==
+              compact->EarliestVisibleSnapshot(ikey.sequence)) {
+        // 能看到这个版本的读请求都能看到更新的版本，这个版本不会再被读取
+        drop = true;
+      } else if (compact->CoveredByRangeTombstone(ikey)) {
+        drop = true;
+      } else if (ikey.type == kTypeValueWithExpiry) {
+        std::string_view unused;
+        uint64_t expire_at;
+        as_deletion = SplitExpiry(input->value(), &unused, &expire_at) &&
+                      expire_at <= compact->now;
+      } else if (ikey.type == kTypeValue && new_user_key &&
+                 ikey.sequence <= compact->smallest_snapshot &&
+                 options.compaction_filter != nullptr) {
+        // 只过滤对所有读请求可见的最新版本，更旧的版本会因为被它遮住而丢弃
+        filtered_value.clear();
+        as_deletion = options.compaction_filter->Filter(
+            c->level(), ikey.user_key, input->value(), &filtered_value,
+            &value_changed);
+      }
+      if (!drop && (ikey.type == kTypeDeletion || as_deletion) &&
+          ikey.sequence <= compact->smallest_snapshot &&
+          c->IsBaseLevelForKey(ikey.user_key, sub->level_ptrs)) {
+        // 更高的层中没有这个key，删除标记和过期的value也不再需要了
+        drop = true;
+      }
+      last_sequence_for_key = ikey.sequence;
+      if (!drop && ikey.type == kTypeMerge) {
+        // 没有合并的操作数不能遮住更旧的版本
+        last_sequence_for_key = kMaxSequenceNumber;
+        if (options.merge_operator != nullptr &&
+            ikey.sequence <= compact->smallest_snapshot) {
+          bool merged = false;
+          s = MergeCompactionOperands(compact, sub, input, ikey, &merged);
+          if (s != Status::kSuccess) {
+            break;
+          }
+          if (merged) {
+            // 合并的结果遮住了剩下的旧版本
+            last_sequence_for_key = ikey.sequence;
+          }
+          // input已经指向下一个没有处理的entry
+          continue;
+        }
+      }
+    }
+
+    std::string_view output_key = key;
+    std::string_view output_value = input->value();
+    if (value_changed && !as_deletion) {
+      output_value = filtered_value;
+    }
+    // has_current_user_key为false表示key解析失败，原样输出
+    if (has_current_user_key && !as_deletion &&
+        (ikey.type == kTypeBlobIndex || ikey.type == kTypeValue)) {
+      s = SeparateBlobValue(compact, sub, drop, ikey.type, &output_key,
+                            &output_value, &blob_key, &blob_value);
+      if (s != Status::kSuccess) {
+        break;
+      }
+    }
+    if (as_deletion && !drop) {
+      // 时间只会往前走，过期的value对之后所有的读请求都等价于删除标记，
+      // 换成删除标记之后仍然能遮住更旧的版本
+      blob_key.assign(output_key.data(), output_key.size());
+      SetInternalKeyType(&blob_key, kTypeDeletion);
+      output_key = blob_key;
+      output_value = std::string_view();
+    }
+    if (!drop) {
+      s = AddCompactionOutput(compact, sub, c->output_level(), output_key,
+                              output_value);
+      if (s != Status::kSuccess) {
+        break;
+      }
+    }
+    input->Next();
+  }
+
+  if (s == Status::kSuccess && shutting_down_.load(std::memory_order_acquire)) {
+    s = Status::kInterupt;
+  }
+  const std::string_view end_view =
+      sub->end != nullptr ? std::string_view(*sub->end) : std::string_view();
+  const std::string_view* upper = sub->end != nullptr ? &end_view : nullptr;
+  if (s == Status::kSuccess && !sub->builder && compact->range_del) {
+    // 最后一段范围中没有数据，只有tombstone的时候也要生成文件
+    std::vector<RangeTombstone> tombstones;
+    compact->OutputRangeTombstones(sub, upper, &tombstones);
+    if (!tombstones.empty()) {
+      s = OpenCompactionOutputFile(compact, sub, c->output_level());
+    }
+  }
+  if (s == Status::kSuccess && sub->builder) {
+    s = FinishCompactionOutputFile(compact, sub, upper);
+  }
+  if (s == Status::kSuccess && sub->blob_builder) {
+    s = sub->blob_builder->Finish();
+  }
+  if (s == Status::kSuccess) {
+    s = input->status();
+  }
+  delete input;
+  sub->status = s;
+}
+
+DBStatus DBImpl::CollectCompactionRangeTombstones(CompactionState* compact,
+                                                  bool can_skip_inputs) {
+  Compaction* c = compact->compaction;
+  std::vector<RangeTombstone> tombstones;
+  for (int32_t which = 0; which < 2; ++which) {
+    for (int32_t i = 0; i < c->num_input_files(which); ++i) {
+      FileMetaData* f = c->input(which, i);
+      if (f->num_range_deletions == 0) {
+        continue;
+      }
+      std::shared_ptr<const FragmentedRangeTombstoneList> range_del;
+      DBStatus s = c->column_family()->table_cache()->GetRangeTombstones(
+          f->number, f->file_size, &range_del);
+      if (s != Status::kSuccess) {
+        return s;
+      }
+      if (range_del) {
+        tombstones.insert(tombstones.end(), range_del->tombstones().begin(),
+                          range_del->tombstones().end());
+      }
+    }
+  }
+  if (tombstones.empty()) {
+    return Status::kSuccess;
+  }
+  compact->range_del = std::make_shared<const FragmentedRangeTombstoneList>(
+      std::move(tombstones), c->column_family()->user_comparator());
+  if (!can_skip_inputs) {
+    return Status::kSuccess;
+  }
+  // 整个文件被同一个快照区间内更新的tombstone覆盖时，其中的每个entry都会被丢弃，
+  // 不需要再读取；带有tombstone的文件需要读出tombstone，不在这里处理
+  const SequenceNumber oldest_snapshot = compact->snapshots.empty()
+                                             ? kMaxSequenceNumber
+                                             : compact->snapshots.front();
+  for (int32_t which = 0; which < 2; ++which) {
+    for (int32_t i = 0; i < c->num_input_files(which); ++i) {
+      FileMetaData* f = c->input(which, i);
+      if (f->largest_seqno == 0 || f->num_range_deletions != 0) {
+        continue;
+      }
+      const SequenceNumber covering = compact->range_del->MinCoveringSequence(
+          ExtractUserKey(f->smallest), ExtractUserKey(f->largest),
+          compact->EarliestVisibleSnapshot(f->largest_seqno));
+      // 比tombstone旧的快照能看到文件中的数据，但是看不到tombstone
+      if (covering > f->largest_seqno && covering <= oldest_snapshot) {
+        c->SkipInput(f->number);
+      }
+    }
+  }
+  return Status::kSuccess;
+}
+
+DBStatus DBImpl::DoCompactionWork(CompactionState* compact) {
+  StopWatch watch(options_.statistics.get(), kCompactionTime);
+  Compaction* c = compact->compaction;
+  snapshots_.GetAll(&compact->snapshots);
+  compact->smallest_snapshot = compact->snapshots.empty()
+                                   ? versions_->LastSequence()
+                                   : compact->snapshots.front();
+  ColumnFamilyData* cfd = c->column_family();
+  compact->blob_gc_cutoff = versions_->BlobGarbageCollectionCutoff(cfd);
+  compact->now = util::GetCurrentTime();
+  // 直接丢弃文件的时候不会统计其中的blob value，有blob文件的时候不这样做
+  const bool can_skip_inputs = (cfd->current()->NumBlobFiles() == 0);
+  mutex_.unlock();
+
+  DBStatus s = CollectCompactionRangeTombstones(compact, can_skip_inputs);
+  if (s != Status::kSuccess) {
+    mutex_.lock();
+    return s;
+  }
+
+  // 输入足够大的时候按照key范围拆分成多个子任务，每个子任务生成各自的sst
+  if (options_.max_subcompactions > 1) {
+    const uint64_t max_output = std::max<uint64_t>(1, c->MaxOutputFileSize());
+    const int32_t n = static_cast<int32_t>(std::min<uint64_t>(
+        options_.max_subcompactions, c->TotalInputBytes() / max_output));
+    versions_->GetSubcompactionBoundaries(c, n, &compact->boundaries);
+  }
+  const size_t num_subs = compact->boundaries.size() + 1;
+  compact->sub_compact_states.resize(num_subs);
+  for (size_t i = 0; i < num_subs; ++i) {
+    auto& sub = compact->sub_compact_states[i];
+    sub.start = (i == 0) ? nullptr : &compact->boundaries[i - 1];
+    sub.end = (i + 1 == num_subs) ? nullptr : &compact->boundaries[i];
+  }
+  // 第一个子任务在当前线程执行，其余的各自启动一个线程
+  std::vector<std::thread> threads;
+  threads.reserve(num_subs - 1);
+  for (size_t i = 1; i < num_subs; ++i) {
+    threads.emplace_back(&DBImpl::ProcessKeyValueCompaction, this, compact,
+                         &compact->sub_compact_states[i]);
+  }
+  ProcessKeyValueCompaction(compact, &compact->sub_compact_states[0]);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  uint64_t output_bytes = 0;
+  for (const auto& sub : compact->sub_compact_states) {
+    if (sub.status != Status::kSuccess) {
+      s = sub.status;
+      break;
+    }
+    output_bytes += sub.total_bytes;
+  }
+  Statistics* statistics = options_.statistics.get();
+  RecordTick(statistics, kCompactReadBytes, c->TotalInputBytes());
+  RecordTick(statistics, kCompactWriteBytes, output_bytes);
+
+  mutex_.lock();
+  if (cfd->IsDropped()) {
+    // 输出的sst等待DeleteObsoleteFiles删除
+    return Status::kSuccess;
+  }
+  if (s == Status::kSuccess) {
+    s = InstallCompactionResults(compact);
+  }
+  return s;
+}
+
+uint64_t DBImpl::MinLogNumberToKeep() const {
+  // memtable为空并且没有imm的column family不再需要任何旧的WAL
+  uint64_t min_log_number = logfile_number_;
+  for (const auto& cf : versions_->column_families()) {
+    ColumnFamilyData* cfd = cf.second;
+    if (cfd->imm() != nullptr || !MemTableEmpty(cfd->mem())) {
+      min_log_number = std::min(min_log_number, cfd->LogNumber());
+    }
+  }
+  return min_log_number;
+}
+
+void DBImpl::DeleteObsoleteFiles() {
+  if (disable_file_deletions_ > 0) {
+    return;
+  }
+  std::set<uint64_t> live;
+  versions_->AddLiveFiles(&live);
+  const uint64_t min_log_number = MinLogNumberToKeep();
+  std::vector<std::string> filenames;
+  FileTool::GetChildren(dbname_, &filenames);
+  uint64_t number;
+  FileType type;
+  for (const auto& filename : filenames) {
+    if (!FileName::ParseFileName(filename, &number, &type)) {
+      continue;
+    }
+    bool keep = true;
+    switch (type) {
+      case FileType::kLogFile:
+        keep = (number >= min_log_number);
+        break;
+      case FileType::kDescriptorFile:
+        keep = (number >= versions_->ManifestFileNumber());
+        break;
+      case FileType::kTableFile:
+      case FileType::kBlobFile:
+        keep = (live.count(number) != 0 || pending_outputs_.count(number) != 0);
+        break;
+      case FileType::kTempFile:
+      case FileType::kCurrentFile:
+      case FileType::kBlockCacheKeysFile:
+        break;
+    }
+    if (!keep) {
+      if (type == FileType::kTableFile) {
+        // 已经删除的column family的TableCache随着它一起释放了
+        for (const auto& cf : versions_->column_families()) {
+          cf.second->table_cache()->Evict(number);
+        }
+      } else if (type == FileType::kBlobFile) {
+        blob_source_->Evict(number);
+      }
+      FileTool::RemoveFile(dbname_ + "/" + filename);
+    }
+  }
+}
+
+// 单调时钟的当前时间(微秒)
+static uint64_t NowMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+DBStatus DBImpl::DelayWrite(std::unique_lock<std::mutex>& lock,
+                            uint64_t num_bytes) {
+  uint64_t start = 0;
+  bool delayed = false;
+  DBStatus s = Status::kSuccess;
+  while (true) {
+    if (bg_error_ != Status::kSuccess) {
+      s = bg_error_;
+      break;
+    }
+    if (write_stall_condition_ == WriteStallCondition::kStopped) {
+      // 等待flush或者compaction完成之后重新判断
+      if (start == 0) {
+        start = NowMicros();
+      }
+      bg_done_cv_.wait(lock);
+      continue;
+    }
+    // 每次写入只按照速率等待一次
+    if (write_stall_condition_ == WriteStallCondition::kDelayed && !delayed) {
+      delayed = true;
+      const uint64_t now = NowMicros();
+      const uint64_t delay = write_controller_.GetDelay(now, num_bytes);
+      if (delay > 0) {
+        if (start == 0) {
+          start = now;
+        }
+        lock.unlock();
+        std::this_thread::sleep_for(std::chrono::microseconds(delay));
+        lock.lock();
+        continue;
+      }
+    }
+    break;
+  }
+  if (start != 0) {
+    RecordTick(options_.statistics.get(), kStallMicros, NowMicros() - start);
+  }
+  return s;
+}
+
+DBStatus DBImpl::MakeRoomForWrite(std::unique_lock<std::mutex>& lock,
+                                  ColumnFamilyData* force) {
+  while (true) {
+    if (bg_error_ != Status::kSuccess) {
+      return bg_error_;
+    }
+    ColumnFamilyData* cfd = force;
+    if (cfd == nullptr) {
+      for (const auto& cf : versions_->column_families()) {
+        if (cf.second->mem()->ApproximateMemoryUsage() >=
+            cf.second->options().write_buffer_size) {
+          cfd = cf.second;
+          break;
+        }
+      }
+    }
+    if (cfd == nullptr) {
+      break;
+    }
+    if (cfd->imm() != nullptr) {
+      // 上一个memtable还没有刷完，只能等待
+      bg_done_cv_.wait(lock);
+      continue;
+    }
+    // 切换memtable和WAL之前，需要等待正在写入当前memtable的请求结束
+    if (!pending_writes_.empty()) {
+      writers_cv_.wait(lock);
+      continue;
+    }
+    DBStatus s = NewLogFile();
+    if (s != Status::kSuccess) {
+      return s;
+    }
+    cfd->SwitchMemTable(logfile_number_);
+    // 只强制切换一次
+    force = nullptr;
+    MaybeScheduleCompaction();
+  }
+  return Status::kSuccess;
+}
+
+void DBImpl::UpdateVisibleSequence() {
+  if (pending_writes_.empty()) {
+    visible_sequence_ = versions_->LastSequence();
+  } else {
+    visible_sequence_ = *pending_writes_.begin() - 1;
+  }
+}
+
+DBStatus DBImpl::Put(const WriteOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const std::string_view& key,
+                     const std::string_view& value) {
+  WriteBatch batch;
+  batch.Put(column_family, key, value);
+  return Write(options, &batch);
+}
+
+DBStatus DBImpl::PutWithTTL(const WriteOptions& options,
+                            ColumnFamilyHandle* column_family,
+                            const std::string_view& key,
+                            const std::string_view& value, uint64_t ttl_ms) {
+  WriteBatch batch;
+  batch.PutWithTTL(column_family, key, value, ttl_ms);
+  return Write(options, &batch);
+}
+
+DBStatus DBImpl::Merge(const WriteOptions& options,
+                       ColumnFamilyHandle* column_family,
+                       const std::string_view& key,
+                       const std::string_view& operand) {
+  auto* cfh = static_cast<ColumnFamilyHandleImpl*>(column_family);
+  if (cfh->cfd()->options().merge_operator == nullptr) {
+    return Status::kNotSupported;
+  }
+  WriteBatch batch;
+  batch.Merge(column_family, key, operand);
+  return Write(options, &batch);
+}
+
+DBStatus DBImpl::Delete(const WriteOptions& options,
+                        ColumnFamilyHandle* column_family,
+                        const std::string_view& key) {
+  WriteBatch batch;
+  batch.Delete(column_family, key);
+  return Write(options, &batch);
+}
+
+DBStatus DBImpl::DeleteRange(const WriteOptions& options,
+                             ColumnFamilyHandle* column_family,
+                             const std::string_view& begin_key,
+                             const std::string_view& end_key) {
+  auto* cfh = static_cast<ColumnFamilyHandleImpl*>(column_family);
+  const int32_t r =
+      cfh->cfd()->user_comparator()->Compare(begin_key, end_key);
+  if (r > 0) {
+    return Status::kInvalidArgument;
+  }
+  if (r == 0) {
+    // 空的范围
+    return Status::kSuccess;
+  }
+  WriteBatch batch;
+  batch.DeleteRange(column_family, begin_key, end_key);
+  return Write(options, &batch);
+}
+
+DBStatus DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  if (read_only_) {
+    return Status::kNotSupported;
+  }
+  if (updates == nullptr) {
+    return Status::kInvalidArgument;
+  }
+  const uint32_t count = WriteBatchInternal::Count(updates);
+  if (count == 0) {
+    return Status::kSuccess;
+  }
+  Statistics* statistics = options_.statistics.get();
+  StopWatch watch(statistics, kDbWrite);
+  RecordTick(statistics, kNumberKeysWritten, count);
+  RecordTick(statistics, kBytesWritten,
+             WriteBatchInternal::Contents(updates).size());
+  std::unique_lock<std::mutex> lock(mutex_);
+  DBStatus s = DelayWrite(lock, WriteBatchInternal::Contents(updates).size());
+  if (s == Status::kSuccess) {
+    s = MakeRoomForWrite(lock);
+  }
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  // 持锁的时间只包括分配序号，写WAL(group commit)和写memtable(并发插入)都不持锁
+  const SequenceNumber sequence = versions_->LastSequence() + 1;
+  WriteBatchInternal::SetSequence(updates, sequence);
+  versions_->SetLastSequence(sequence + count - 1);
+  pending_writes_.insert(sequence);
+  // pending_writes_不为空的时候memtable不会被切换，column family也不会被删除；
+  // 已经删除的column family的写入被忽略
+  std::vector<std::pair<uint32_t, MemTable*>> mems;
+  mems.reserve(versions_->column_families().size());
+  for (const auto& cf : versions_->column_families()) {
+    mems.emplace_back(cf.first, cf.second->mem());
+  }
+  GroupCommitWriter* log = log_.get();
+  lock.unlock();
+
+  {
+    PerfTimer timer(&PerfContext::write_wal_time);
+    s = log->AddRecord(WriteBatchInternal::Contents(updates), options.sync);
+  }
+  if (s == Status::kSuccess) {
+    PerfTimer timer(&PerfContext::write_memtable_time);
+    s = WriteBatchInternal::InsertInto(
+        updates,
+        [&mems](uint32_t column_family_id) -> MemTable* {
+          for (const auto& item : mems) {
+            if (item.first == column_family_id) {
+              return item.second;
+            }
+          }
+          return nullptr;
+        },
+        true);
+  }
+
+  lock.lock();
+  if (s != Status::kSuccess && bg_error_ == Status::kSuccess) {
+    // WAL或者memtable可能只写入了一部分，序号已经分配出去，之后的写入全部拒绝
+    bg_error_ = s;
+  }
+  pending_writes_.erase(sequence);
+  const SequenceNumber visible = visible_sequence_;
+  UpdateVisibleSequence();
+  if (visible_sequence_ != visible || pending_writes_.empty()) {
+    writers_cv_.notify_all();
+  }
+  // 序号按照顺序对读请求可见，等前面的写入都完成之后再返回，
+  // 保证返回之后的Get/MultiGet/GetSnapshot一定能看到这次写入
+  const SequenceNumber last = sequence + count - 1;
+  writers_cv_.wait(lock, [this, last]() { return visible_sequence_ >= last; });
+  return s;
+}
+
+DBStatus DBImpl::Get(const ReadOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const std::string_view& key, std::string* value) {
+  Statistics* statistics = options_.statistics.get();
+  StopWatch watch(statistics, kDbGet);
+  ColumnFamilyData* cfd =
+      static_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  // 先拿到SuperVersion再取序号，之后切换出去的memtable中的写入不会丢失
+  SuperVersion* sv = cfd->GetThreadLocalSuperVersion(&mutex_);
+  const SequenceNumber snapshot = ReadSequence(options);
+  MemTable* mem = sv->mem;
+  MemTable* imm = sv->imm;
+  Version* current = sv->current;
+
+  // 按照memtable -> immutable memtable -> sst的顺序查找
+  DBStatus s = Status::kSuccess;
+  LookupKey lkey(key, snapshot);
+  PerfTimer memtable_timer(&PerfContext::get_from_memtable_time);
+  PerfCounterAdd(&PerfContext::get_from_memtable_count);
+  // 已经查找过的数据中覆盖key的range tombstone的最大序号，更旧的数据中序号
+  // 比它小的版本都已经被删除了
+  SequenceNumber max_covering_tombstone_seq = 0;
+  bool found = mem->Get(lkey, value, &s, &max_covering_tombstone_seq);
+  if (!found && imm != nullptr) {
+    PerfCounterAdd(&PerfContext::get_from_memtable_count);
+    found = imm->Get(lkey, value, &s, &max_covering_tombstone_seq);
+  }
+  memtable_timer.Stop();
+  if (!found) {
+    ForegroundReadTimer timer(options_.rate_limiter.get());
+    PerfTimer perf_timer(&PerfContext::get_from_output_files_time);
+    s = current->Get(options, lkey, value, max_covering_tombstone_seq);
+  }
+  if (s == Status::kMergeInProgress) {
+    s = GetMergedValue(options, cfd, key, snapshot, mem, imm, current, value);
+  }
+  // cache_only没有得到结果的请求之后还会再读一次，不重复计数
+  if (s != Status::kIncomplete) {
+    RecordTick(statistics, kNumberKeysRead);
+  }
+  if (s == Status::kSuccess) {
+    RecordTick(statistics, kNumberKeysFound);
+    RecordTick(statistics, kBytesRead, key.size() + value->size());
+  }
+
+  cfd->ReturnThreadLocalSuperVersion(sv, &mutex_);
+  return s;
+}
+
+std::vector<DBStatus> DBImpl::MultiGet(
+    const ReadOptions& options, ColumnFamilyHandle* column_family,
+    const std::vector<std::string_view>& keys,
+    std::vector<std::string>* values) {
+  Statistics* statistics = options_.statistics.get();
+  StopWatch watch(statistics, kDbMultiGet);
+  ColumnFamilyData* cfd =
+      static_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  // 先拿到SuperVersion再取序号，之后切换出去的memtable中的写入不会丢失
+  SuperVersion* sv = cfd->GetThreadLocalSuperVersion(&mutex_);
+  const SequenceNumber snapshot = ReadSequence(options);
+  MemTable* mem = sv->mem;
+  MemTable* imm = sv->imm;
+  Version* current = sv->current;
+
+  const size_t n = keys.size();
+  std::vector<DBStatus> statuses(n, Status::kSuccess);
+  values->assign(n, std::string());
+  std::vector<std::unique_ptr<LookupKey>> lkeys(n);
+  // memtable中没有找到的key再一起到sst中查找
+  std::vector<size_t> pending;
+  std::vector<const LookupKey*> pending_keys;
+  std::vector<std::string*> pending_values;
+  std::vector<SequenceNumber> pending_max_covering;
+  for (size_t i = 0; i < n; ++i) {
+    lkeys[i] = std::make_unique<LookupKey>(keys[i], snapshot);
+    SequenceNumber max_covering_tombstone_seq = 0;
+    if (mem->Get(*lkeys[i], &(*values)[i], &statuses[i],
+                 &max_covering_tombstone_seq)) {
+      continue;
+    }
+    if (imm != nullptr && imm->Get(*lkeys[i], &(*values)[i], &statuses[i],
+                                   &max_covering_tombstone_seq)) {
+      continue;
+    }
+    pending.push_back(i);
+    pending_keys.push_back(lkeys[i].get());
+    pending_values.push_back(&(*values)[i]);
+    pending_max_covering.push_back(max_covering_tombstone_seq);
+  }
+  if (!pending.empty()) {
+    std::vector<DBStatus> pending_statuses;
+    {
+      ForegroundReadTimer timer(options_.rate_limiter.get());
+      PerfTimer perf_timer(&PerfContext::get_from_output_files_time);
+      current->MultiGet(options, pending_keys, pending_values,
+                        &pending_statuses, &pending_max_covering);
+    }
+    for (size_t i = 0; i < pending.size(); ++i) {
+      statuses[pending[i]] = pending_statuses[i];
+    }
+  }
+  size_t keys_read = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (statuses[i] == Status::kMergeInProgress) {
+      statuses[i] = GetMergedValue(options, cfd, keys[i], snapshot, mem, imm,
+                                   current, &(*values)[i]);
+    }
+    // 和Get一样，cache_only没有得到结果的key不计数
+    if (statuses[i] != Status::kIncomplete) {
+      ++keys_read;
+    }
+    if (statuses[i] == Status::kSuccess) {
+      RecordTick(statistics, kNumberKeysFound);
+      RecordTick(statistics, kBytesRead, keys[i].size() + (*values)[i].size());
+    }
+  }
+  RecordTick(statistics, kNumberKeysRead, keys_read);
+
+  cfd->ReturnThreadLocalSuperVersion(sv, &mutex_);
+  return statuses;
+}
+
+void DBImpl::AsyncGet(const ReadOptions& options,
+                      ColumnFamilyHandle* column_family,
+                      const std::string_view& key, GetCallback callback) {
+  ReadOptions cache_options = options;
+  cache_options.cache_only = true;
+  std::string value;
+  DBStatus s = Get(cache_options, column_family, key, &value);
+  if (s != Status::kIncomplete || options.cache_only) {
+    callback(s, std::move(value));
+    return;
+  }
+  RecordTick(options_.statistics.get(), kAsyncReadOffloaded);
+  read_pool_->Schedule([this, options, column_family, key = std::string(key),
+                        callback = std::move(callback)]() {
+    std::string value;
+    DBStatus s = Get(options, column_family, key, &value);
+    callback(s, std::move(value));
+  });
+}
+
+void DBImpl::AsyncMultiGet(const ReadOptions& options,
+                           ColumnFamilyHandle* column_family,
+                           const std::vector<std::string_view>& keys,
+                           MultiGetCallback callback) {
+  // 内存中查找和读线程上的查找需要使用同一个快照
+  ReadOptions cache_options = options;
+  cache_options.cache_only = true;
+  const Snapshot* snapshot = nullptr;
+  if (options.snapshot == nullptr) {
+    snapshot = GetSnapshot();
+    cache_options.snapshot = snapshot;
+  }
+  std::vector<std::string> values;
+  std::vector<DBStatus> statuses =
+      MultiGet(cache_options, column_family, keys, &values);
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (statuses[i] == Status::kIncomplete) {
+      pending.push_back(i);
+    }
+  }
+  if (pending.empty() || options.cache_only) {
+    if (snapshot != nullptr) {
+      ReleaseSnapshot(snapshot);
+    }
+    callback(std::move(statuses), std::move(values));
+    return;
+  }
+  RecordTick(options_.statistics.get(), kAsyncReadOffloaded);
+  std::vector<std::string> pending_keys;
+  pending_keys.reserve(pending.size());
+  for (const size_t i : pending) {
+    pending_keys.emplace_back(keys[i]);
+  }
+  ReadOptions read_options = cache_options;
+  read_options.cache_only = false;
+  read_pool_->Schedule([this, read_options, column_family, snapshot,
+                        pending = std::move(pending),
+                        pending_keys = std::move(pending_keys),
+                        statuses = std::move(statuses),
+                        values = std::move(values),
+                        callback = std::move(callback)]() mutable {
+    std::vector<std::string_view> key_views(pending_keys.begin(),
+                                            pending_keys.end());
+    std::vector<std::string> pending_values;
+    const std::vector<DBStatus>& pending_statuses =
+        MultiGet(read_options, column_family, key_views, &pending_values);
+    if (snapshot != nullptr) {
+      ReleaseSnapshot(snapshot);
+    }
+    for (size_t i = 0; i < pending.size(); ++i) {
+      statuses[pending[i]] = pending_statuses[i];
+      values[pending[i]] = std::move(pending_values[i]);
+    }
+    callback(std::move(statuses), std::move(values));
+  });
+}
+
+namespace {
+// 迭代器持有的column family、memtable和version的引用，迭代器释放的时候一起释放
+struct IterState {
+  std::mutex* mu;
+  ColumnFamilyData* cfd;
+  MemTable* mem;
+  MemTable* imm;
+  Version* version;
+};
+}  // namespace
+
+static void CleanupIteratorState(void* arg1, void*) {
+  auto* state = reinterpret_cast<IterState*>(arg1);
+  {
+    std::lock_guard<std::mutex> lock(*state->mu);
+    state->mem->Unref();
+    if (state->imm != nullptr) {
+      state->imm->Unref();
+    }
+    state->version->Unref();
+    state->cfd->Unref();
+  }
+  delete state;
+}
+
+Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
+                                      ColumnFamilyData* cfd, MemTable* mem,
+                                      MemTable* imm, Version* current) {
+  std::vector<Iterator*> list;
+  list.push_back(mem->NewIterator());
+  if (imm != nullptr) {
+    list.push_back(imm->NewIterator());
+  }
+  current->AddIterators(options, &list);
+  return NewMergingIterator(cfd->options().comparator.get(), list.data(),
+                            list.size());
+}
+
+DBStatus DBImpl::GetMergedValue(const ReadOptions& options,
+                                ColumnFamilyData* cfd,
+                                const std::string_view& key,
+                                SequenceNumber snapshot, MemTable* mem,
+                                MemTable* imm, Version* current,
+                                std::string* value) {
+  // 操作数和更旧的版本可能分散在memtable和多个sst中，交给DBIter按照顺序合并；
+  // 只有最新的版本是操作数的时候才会走到这里
+  std::shared_ptr<const FragmentedRangeTombstoneList> range_del;
+  DBStatus s = CollectRangeTombstones(cfd, mem, imm, current, &range_del);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  Comparator* ucmp = cfd->user_comparator();
+  std::unique_ptr<Iterator> iter(NewDBIterator(
+      ucmp, NewInternalIterator(options, cfd, mem, imm, current), snapshot,
+      nullptr, blob_source_.get(), cfd->options().merge_operator.get(),
+      nullptr, std::move(range_del)));
+  iter->Seek(key);
+  if (!iter->Valid() || ucmp->Compare(iter->key(), key) != 0) {
+    // 合并失败的时候DBIter会变成无效并设置status
+    s = iter->status();
+    return s == Status::kSuccess ? Status::kNotFound : s;
+  }
+  value->assign(iter->value());
+  return iter->status();
+}
+
+SequenceNumber DBImpl::ReadSequence(const ReadOptions& options) const {
+  if (options.snapshot != nullptr) {
+    return static_cast<const SnapshotImpl*>(options.snapshot)
+        ->sequence_number();
+  }
+  return visible_sequence_.load(std::memory_order_acquire);
+}
+
+const Snapshot* DBImpl::GetSnapshot() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // 还在写memtable的batch对快照不可见，和没有快照的读取看到的一样
+  return snapshots_.New(visible_sequence_);
+}
+
+void DBImpl::ReleaseSnapshot(const Snapshot* snapshot) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  snapshots_.Delete(static_cast<const SnapshotImpl*>(snapshot));
+}
+
+DBStatus DBImpl::CollectRangeTombstones(
+    ColumnFamilyData* cfd, MemTable* mem, MemTable* imm, Version* current,
+    std::shared_ptr<const FragmentedRangeTombstoneList>* result) {
+  std::vector<RangeTombstone> tombstones;
+  for (MemTable* m : {mem, imm}) {
+    if (m == nullptr) {
+      continue;
+    }
+    auto range_del = m->GetRangeTombstones();
+    if (range_del) {
+      tombstones.insert(tombstones.end(), range_del->tombstones().begin(),
+                        range_del->tombstones().end());
+    }
+  }
+  DBStatus s = current->AddRangeTombstones(&tombstones);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  result->reset();
+  if (!tombstones.empty()) {
+    *result = std::make_shared<const FragmentedRangeTombstoneList>(
+        std::move(tombstones), cfd->user_comparator());
+  }
+  return Status::kSuccess;
+}
+
+Iterator* DBImpl::NewIterator(const ReadOptions& options,
+                              ColumnFamilyHandle* column_family) {
+  ColumnFamilyData* cfd =
+      static_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  std::lock_guard<std::mutex> lock(mutex_);
+  const SequenceNumber snapshot = ReadSequence(options);
+  MemTable* mem = cfd->mem();
+  MemTable* imm = cfd->imm();
+  Version* current = cfd->current();
+  // 所有range tombstone在创建迭代器的时候一次性收集，遍历过程中直接查找
+  std::shared_ptr<const FragmentedRangeTombstoneList> range_del;
+  DBStatus s = CollectRangeTombstones(cfd, mem, imm, current, &range_del);
+  if (s != Status::kSuccess) {
+    return NewErrorIterator(s);
+  }
+  Iterator* internal_iter =
+      NewInternalIterator(options, cfd, mem, imm, current);
+  cfd->Ref();
+  mem->Ref();
+  if (imm != nullptr) {
+    imm->Ref();
+  }
+  current->Ref();
+  auto* state = new IterState{&mutex_, cfd, mem, imm, current};
+  internal_iter->RegisterCleanup(&CleanupIteratorState, state, nullptr);
+  const Options& cf_options = cfd->options();
+  return NewDBIterator(cfd->user_comparator(), internal_iter, snapshot,
+                       options.prefix_same_as_start
+                           ? cf_options.prefix_extractor.get()
+                           : nullptr,
+                       blob_source_.get(), cf_options.merge_operator.get(),
+                       options_.statistics.get(), std::move(range_del));
+}
+
+DBStatus DBImpl::ParallelScan(const ReadOptions& options,
+                              ColumnFamilyHandle* column_family,
+                              const std::string_view* begin,
+                              const std::string_view* end, int32_t n_threads,
+                              const ScanCallback& callback) {
+  // 每个线程平均分到的细分区个数，细分区越多，只覆盖一部分key空间的范围切得越均匀
+  static constexpr int32_t kSplitsPerThread = 8;
+  n_threads = std::max(1, n_threads);
+  ColumnFamilyData* cfd =
+      static_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  Comparator* ucmp = cfd->user_comparator();
+  // 先在整个column family上切成更细的分区，再从落在范围内的边界中均匀地挑出分区的边界
+  std::vector<std::string> boundaries, inside;
+  GetApproximateKeyBoundaries(column_family, n_threads * kSplitsPerThread,
+                              &boundaries);
+  for (auto& boundary : boundaries) {
+    // 空字符串之前没有任何key，用作边界只会切出空的分区
+    if (!boundary.empty() &&
+        (begin == nullptr || ucmp->Compare(boundary, *begin) > 0) &&
+        (end == nullptr || ucmp->Compare(boundary, *end) < 0)) {
+      inside.push_back(std::move(boundary));
+    }
+  }
+  const size_t parts = std::min<size_t>(n_threads, inside.size() + 1);
+  std::vector<std::string_view> split_keys;
+  for (size_t i = 1; i < parts; ++i) {
+    split_keys.emplace_back(inside[i * (inside.size() + 1) / parts - 1]);
+  }
+  // 第i个分区是[*bounds[i], *bounds[i+1])，首尾为nullptr表示不限制
+  std::vector<const std::string_view*> bounds;
+  bounds.push_back(begin);
+  for (const auto& key : split_keys) {
+    bounds.push_back(&key);
+  }
+  bounds.push_back(end);
+
+  ReadOptions scan_options = options;
+  const Snapshot* snapshot = nullptr;
+  if (scan_options.snapshot == nullptr) {
+    snapshot = GetSnapshot();
+    scan_options.snapshot = snapshot;
+  }
+  std::atomic<bool> stop(false);
+  std::mutex result_mutex;
+  DBStatus result = Status::kSuccess;
+  {
+    // 析构的时候等待所有分区遍历结束
+    ThreadPool pool(parts);
+    for (size_t i = 0; i < parts; ++i) {
+      pool.Schedule([&, i]() {
+        std::unique_ptr<Iterator> iter(
+            NewIterator(scan_options, column_family));
+        const std::string_view* lower = bounds[i];
+        const std::string_view* upper = bounds[i + 1];
+        if (lower == nullptr) {
+          iter->SeekToFirst();
+        } else {
+          iter->Seek(*lower);
+        }
+        for (; iter->Valid() && !stop.load(std::memory_order_relaxed);
+             iter->Next()) {
+          if (upper != nullptr && ucmp->Compare(iter->key(), *upper) >= 0) {
+            break;
+          }
+          if (!callback(iter->key(), iter->value())) {
+            stop.store(true, std::memory_order_relaxed);
+            break;
+          }
+        }
+        if (iter->status() != Status::kSuccess) {
+          std::lock_guard<std::mutex> lock(result_mutex);
+          if (result == Status::kSuccess) {
+            result = iter->status();
+          }
+          stop.store(true, std::memory_order_relaxed);
+        }
+      });
+    }
+  }
+  if (snapshot != nullptr) {
+    ReleaseSnapshot(snapshot);
+  }
+  return result;
+}
+
+// mem中是否有user_key落在[smallest_user_key, largest_user_key]中的entry
+static bool MemTableOverlaps(MemTable* mem, Comparator* user_comparator,
+                             const std::string_view& smallest_user_key,
+                             const std::string_view& largest_user_key) {
+  std::unique_ptr<Iterator> iter(mem->NewIterator());
+  LookupKey lkey(smallest_user_key, kMaxSequenceNumber);
+  iter->Seek(lkey.internal_key());
+  return iter->Valid() &&
+         user_comparator->Compare(ExtractUserKey(iter->key()),
+                                  largest_user_key) <= 0;
+}
+
+DBStatus DBImpl::IngestExternalFile(ColumnFamilyHandle* column_family,
+                                    const std::string& path) {
+  if (read_only_) {
+    return Status::kNotSupported;
+  }
+  ColumnFamilyData* cfd =
+      static_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  // 读取文件的key范围，SstFileWriter写入的序号都是0，
+  // 真正的序号在导入的时候统一分配，读取时由TableCache替换
+  const uint64_t file_size = FileTool::GetFileSize(path);
+  std::string smallest_user_key, largest_user_key;
+  {
+    FileReader file(path);
+    if (!file.IsOpen()) {
+      return Status::kReadFileFailed;
+    }
+    // 临时打开的table不使用block_cache，避免留下不会再被访问的block
+    Options table_options = cfd->options();
+    table_options.block_cache = nullptr;
+    Table table(&table_options, &file);
+    DBStatus s = table.Open(file_size);
+    if (s != Status::kSuccess) {
+      return s;
+    }
+    std::unique_ptr<Iterator> iter(table.NewIterator(ReadOptions()));
+    ParsedInternalKey first, last;
+    iter->SeekToFirst();
+    if (!iter->Valid() || !ParseInternalKey(iter->key(), &first)) {
+      return iter->status() != Status::kSuccess ? iter->status()
+                                                : Status::kInvalidArgument;
+    }
+    smallest_user_key.assign(first.user_key.data(), first.user_key.size());
+    iter->SeekToLast();
+    if (!iter->Valid() || !ParseInternalKey(iter->key(), &last)) {
+      return iter->status() != Status::kSuccess ? iter->status()
+                                                : Status::kInvalidArgument;
+    }
+    largest_user_key.assign(last.user_key.data(), last.user_key.size());
+    if (first.sequence != 0 || last.sequence != 0) {
+      return Status::kInvalidArgument;
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  uint64_t number = versions_->NewFileNumber();
+  pending_outputs_.insert(number);
+  lock.unlock();
+  std::string fname = FileName::TableFileName(dbname_, number);
+  DBStatus s = FileTool::LinkFile(path, fname);
+  lock.lock();
+
+  // 导入的数据必须比memtable中的数据新，有重叠的时候先把memtable刷成sst，
+  // 持有锁之后不会再有新的写入分配序号
+  while (s == Status::kSuccess) {
+    if (cfd->IsDropped()) {
+      s = Status::kInvalidArgument;
+    } else if (bg_error_ != Status::kSuccess) {
+      s = bg_error_;
+    } else if (!pending_writes_.empty()) {
+      writers_cv_.wait(lock);
+    } else if (cfd->imm() != nullptr &&
+               MemTableOverlaps(cfd->imm(), cfd->user_comparator(),
+                                smallest_user_key, largest_user_key)) {
+      bg_done_cv_.wait(lock);
+    } else if (MemTableOverlaps(cfd->mem(), cfd->user_comparator(),
+                                smallest_user_key, largest_user_key)) {
+      s = MakeRoomForWrite(lock, cfd);
+    } else {
+      break;
+    }
+  }
+
+  // 第0层的sst按照编号从新到旧查找，刷盘生成的sst编号比一开始分配的大，
+  // 这里重新分配一个编号，保证导入的文件比之前刷盘的文件新；rename只修改目录项
+  if (s == Status::kSuccess) {
+    const uint64_t new_number = versions_->NewFileNumber();
+    const std::string new_fname = FileName::TableFileName(dbname_, new_number);
+    pending_outputs_.insert(new_number);
+    s = FileTool::RenameFile(fname, new_fname);
+    if (s == Status::kSuccess) {
+      pending_outputs_.erase(number);
+      number = new_number;
+      fname = new_fname;
+    } else {
+      pending_outputs_.erase(new_number);
+    }
+  }
+
+  if (s == Status::kSuccess) {
+    const SequenceNumber sequence = versions_->LastSequence() + 1;
+    versions_->SetLastSequence(sequence);
+    // 边界的type取最宽的范围，保证覆盖文件中的所有key
+    std::string smallest, largest;
+    AppendInternalKey(&smallest, ParsedInternalKey(smallest_user_key, sequence,
+                                                   kValueTypeForSeek));
+    AppendInternalKey(&largest, ParsedInternalKey(largest_user_key, sequence,
+                                                  kTypeDeletion));
+    VersionEdit edit;
+    FileMetaData meta;
+    meta.number = number;
+    meta.file_size = file_size;
+    meta.smallest = std::move(smallest);
+    meta.largest = std::move(largest);
+    meta.global_seqno = sequence;
+    meta.largest_seqno = sequence;
+    meta.file_creation_time = util::GetCurrentTime();
+    edit.AddFile(versions_->PickLevelForIngestedFile(cfd, meta.smallest,
+                                                     meta.largest),
+                 meta);
+    s = versions_->LogAndApply(cfd, &edit);
+    if (s == Status::kSuccess) {
+      UpdateVisibleSequence();
+      MaybeScheduleCompaction();
+    }
+  }
+  pending_outputs_.erase(number);
+  if (s != Status::kSuccess) {
+    FileTool::RemoveFile(fname);
+  }
+  return s;
+}
+
+DBStatus DBImpl::GetPropertiesOfAllTables(ColumnFamilyHandle* column_family,
+                                          TablePropertiesCollection* props) {
+  ColumnFamilyData* cfd =
+      static_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  props->clear();
+  std::unique_lock<std::mutex> lock(mutex_);
+  Version* current = cfd->current();
+  current->Ref();
+  lock.unlock();
+  // 没有缓存的sst需要打开，不持有锁
+  DBStatus s = current->GetTableProperties(props);
+  lock.lock();
+  current->Unref();
+  return s;
+}
+
+void DBImpl::GetApproximateSizes(ColumnFamilyHandle* column_family,
+                                 const Range* ranges, int32_t n,
+                                 uint64_t* sizes) {
+  ColumnFamilyData* cfd =
+      static_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  std::unique_lock<std::mutex> lock(mutex_);
+  Version* current = cfd->current();
+  current->Ref();
+  lock.unlock();
+  for (int32_t i = 0; i < n; ++i) {
+    // 比user key的所有版本都靠前的internal key
+    std::string start, limit;
+    AppendInternalKey(&start, ParsedInternalKey(ranges[i].start,
+                                                kMaxSequenceNumber,
+                                                kValueTypeForSeek));
+    AppendInternalKey(&limit, ParsedInternalKey(ranges[i].limit,
+                                                kMaxSequenceNumber,
+                                                kValueTypeForSeek));
+    sizes[i] = current->ApproximateSize(start, limit);
+  }
+  lock.lock();
+  current->Unref();
+}
+
+void DBImpl::GetApproximateKeyBoundaries(ColumnFamilyHandle* column_family,
+                                         int32_t n,
+                                         std::vector<std::string>* boundaries) {
+  ColumnFamilyData* cfd =
+      static_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  std::unique_lock<std::mutex> lock(mutex_);
+  Version* current = cfd->current();
+  current->Ref();
+  lock.unlock();
+  current->GetApproximateKeyBoundaries(n, boundaries);
+  lock.lock();
+  current->Unref();
+}
+
+bool DBImpl::GetProperty(ColumnFamilyHandle* column_family,
+                         const std::string_view& property,
+                         std::string* value) {
+  ColumnFamilyData* cfd =
+      static_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  value->clear();
+  static constexpr std::string_view kPrefix = "corekv.";
+  if (property.substr(0, kPrefix.size()) != kPrefix) {
+    return false;
+  }
+  std::string_view in = property.substr(kPrefix.size());
+  std::lock_guard<std::mutex> lock(mutex_);
+  static constexpr std::string_view kNumFilesAtLevel = "num-files-at-level";
+  if (in.substr(0, kNumFilesAtLevel.size()) == kNumFilesAtLevel) {
+    in.remove_prefix(kNumFilesAtLevel.size());
+    if (in.empty() || in.size() > 2 ||
+        !std::all_of(in.begin(), in.end(), ::isdigit)) {
+      return false;
+    }
+    const int32_t level = std::stoi(std::string(in));
+    if (level >= config::kNumLevels) {
+      return false;
+    }
+    *value = std::to_string(cfd->current()->NumFiles(level));
+    return true;
+  }
+  if (in == "total-sst-files-size") {
+    uint64_t total = 0;
+    for (int32_t level = 0; level < config::kNumLevels; ++level) {
+      total += cfd->current()->NumLevelBytes(level);
+    }
+    *value = std::to_string(total);
+    return true;
+  }
+  if (in == "num-blob-files") {
+    *value = std::to_string(cfd->current()->NumBlobFiles());
+    return true;
+  }
+  if (in == "estimate-pending-compaction-bytes") {
+    *value =
+        std::to_string(cfd->current()->EstimatedPendingCompactionBytes());
+    return true;
+  }
+  if (in == "actual-delayed-write-rate") {
+    *value = std::to_string(
+        write_stall_condition_ == WriteStallCondition::kDelayed
+            ? write_controller_.delayed_write_rate()
+            : 0);
+    return true;
+  }
+  if (in == "is-write-stopped") {
+    *value =
+        (write_stall_condition_ == WriteStallCondition::kStopped) ? "1" : "0";
+    return true;
+  }
+  if (in == "stats") {
+    if (options_.statistics == nullptr) {
+      return false;
+    }
+    *value = options_.statistics->ToString();
+    return true;
+  }
+  return false;
+}
+
+// BLOCK_CACHE_KEYS的格式: 每个sst依次是
+//   [文件编号 varint64][block个数 varint64][和前一个偏移的差值 varint64]...
+// 最后是前面所有内容的crc(fixed32，mask过)
+static void EncodeBlockCacheKeys(
+    std::map<uint64_t, std::vector<uint64_t>>* blocks, std::string* dst) {
+  for (auto& [number, offsets] : *blocks) {
+    std::sort(offsets.begin(), offsets.end());
+    util::PutVarint64(dst, number);
+    util::PutVarint64(dst, offsets.size());
+    uint64_t last = 0;
+    for (uint64_t offset : offsets) {
+      util::PutVarint64(dst, offset - last);
+      last = offset;
+    }
+  }
+  util::PutFixed32(dst, crc32::Mask(crc32::Value(dst->data(), dst->size())));
+}
+
+// 文件损坏的时候返回false
+static bool DecodeBlockCacheKeys(
+    std::string_view input,
+    std::map<uint64_t, std::vector<uint64_t>>* blocks) {
+  if (input.size() < sizeof(uint32_t)) {
+    return false;
+  }
+  const size_t n = input.size() - sizeof(uint32_t);
+  if (crc32::Unmask(util::DecodeFixed32(input.data() + n)) !=
+      crc32::Value(input.data(), n)) {
+    return false;
+  }
+  input.remove_suffix(sizeof(uint32_t));
+  while (!input.empty()) {
+    uint64_t number = 0;
+    uint64_t count = 0;
+    if (!util::GetVarint64(&input, &number) ||
+        !util::GetVarint64(&input, &count) || count > input.size()) {
+      return false;
+    }
+    std::vector<uint64_t>& offsets = (*blocks)[number];
+    offsets.reserve(count);
+    uint64_t offset = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+      uint64_t delta = 0;
+      if (!util::GetVarint64(&input, &delta)) {
+        return false;
+      }
+      offset += delta;
+      offsets.push_back(offset);
+    }
+  }
+  return true;
+}
+
+DBStatus DBImpl::PersistBlockCacheKeys() {
+  if (read_only_) {
+    return Status::kNotSupported;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::vector<ColumnFamilyData*> cfds;
+  for (const auto& cf : versions_->column_families()) {
+    cf.second->Ref();
+    cfds.push_back(cf.second);
+  }
+  const std::string& tmp =
+      FileName::TempFileName(dbname_, versions_->NewFileNumber());
+  lock.unlock();
+  // 遍历block_cache的时间和缓存中block的个数成正比，不持有锁
+  std::map<uint64_t, std::vector<uint64_t>> blocks;
+  for (ColumnFamilyData* cfd : cfds) {
+    cfd->table_cache()->GetCachedBlocks(&blocks);
+  }
+  lock.lock();
+  for (ColumnFamilyData* cfd : cfds) {
+    cfd->Unref();
+  }
+  lock.unlock();
+
+  std::string contents;
+  EncodeBlockCacheKeys(&blocks, &contents);
+  // 先写临时文件再rename，进程在中途退出的时候不会留下半个文件
+  FileWriter writer(tmp);
+  DBStatus s = writer.Append(contents.data(), contents.size());
+  if (s == Status::kSuccess) {
+    s = writer.Sync();
+  }
+  writer.Close();
+  if (s == Status::kSuccess) {
+    s = FileTool::RenameFile(tmp, FileName::BlockCacheKeysFileName(dbname_));
+  }
+  if (s != Status::kSuccess) {
+    FileTool::RemoveFile(tmp);
+  }
+  return s;
+}
+
+void DBImpl::BackgroundWarmUp() {
+  const std::string& fname = FileName::BlockCacheKeysFileName(dbname_);
+  std::string contents;
+  std::map<uint64_t, std::vector<uint64_t>> blocks;
+  {
+    FileReader reader(fname);
+    if (!reader.IsOpen() ||
+        reader.Read(0, FileTool::GetFileSize(fname), &contents) !=
+            Status::kSuccess ||
+        !DecodeBlockCacheKeys(contents, &blocks)) {
+      blocks.clear();
+    }
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!blocks.empty()) {
+    std::vector<std::pair<ColumnFamilyData*, Version*>> versions;
+    for (const auto& cf : versions_->column_families()) {
+      cf.second->Ref();
+      cf.second->current()->Ref();
+      versions.emplace_back(cf.second, cf.second->current());
+    }
+    lock.unlock();
+    // 持有版本的引用，预热过程中被compaction替换掉的sst也不会被删除
+    for (const auto& [cfd, current] : versions) {
+      current->LoadBlocks(blocks, &shutting_down_);
+    }
+    lock.lock();
+    for (const auto& [cfd, current] : versions) {
+      current->Unref();
+      cfd->Unref();
+    }
+  }
+  bg_warmup_scheduled_ = false;
+  bg_done_cv_.notify_all();
+}
+
+void DBImpl::OpenTableFiles() {
+  if (options_.max_file_opening_threads <= 0) {
+    return;
+  }
+  // 后台线程还没有启动，版本不会变化，不需要额外持有引用；
+  // pool析构的时候等待所有sst打开完成
+  ThreadPool pool(options_.max_file_opening_threads);
+  for (const auto& cf : versions_->column_families()) {
+    cf.second->current()->OpenTables(&pool,
+                                     cf.second->options().max_open_files);
+  }
+}
+
+DBStatus DBImpl::ReplayLogFilesReadOnly(std::unique_lock<std::mutex>& lock) {
+  // 回放的过程中column family可能被删除(只读实例不会，但是handle可能被释放)
+  std::map<uint32_t, std::pair<ColumnFamilyData*, uint64_t>> cfs;
+  uint64_t min_log_number = UINT64_MAX;
+  for (const auto& [id, cfd] : versions_->column_families()) {
+    cfd->Ref();
+    cfs[id] = std::make_pair(cfd, cfd->LogNumber());
+    min_log_number = std::min(min_log_number, cfd->LogNumber());
+  }
+  lock.unlock();
+  std::vector<std::string> filenames;
+  DBStatus s = FileTool::GetChildren(dbname_, &filenames);
+  std::vector<uint64_t> logs;
+  uint64_t number;
+  FileType type;
+  for (const auto& filename : filenames) {
+    if (FileName::ParseFileName(filename, &number, &type) &&
+        type == FileType::kLogFile && number >= min_log_number) {
+      logs.push_back(number);
+    }
+  }
+  std::sort(logs.begin(), logs.end());
+  // 和RecoverLogFile相同，只是memtable写满之后也不刷盘
+  std::map<uint32_t, MemTable*> mems;
+  uint64_t log_number = 0;
+  auto lookup = [&cfs, &mems, &log_number](uint32_t id) -> MemTable* {
+    auto cf = cfs.find(id);
+    if (cf == cfs.end() || log_number < cf->second.second) {
+      return nullptr;
+    }
+    MemTable*& mem = mems[id];
+    if (mem == nullptr) {
+      mem = cf->second.first->NewMemTable();
+      mem->Ref();
+    }
+    return mem;
+  };
+  SequenceNumber max_sequence = 0;
+  for (size_t i = 0; i < logs.size() && s == Status::kSuccess; ++i) {
+    log_number = logs[i];
+    FileReader file(FileName::LogFileName(dbname_, log_number));
+    if (!file.IsOpen()) {
+      // primary刷盘之后删除了这个WAL，数据在之后的MANIFEST记录指向的sst中
+      continue;
+    }
+    // primary可能正在写最后一条记录，没有写完整的部分直接忽略
+    log::Reader reader(&file, true);
+    std::string_view record;
+    std::string scratch;
+    WriteBatch batch;
+    while (reader.ReadRecord(&record, &scratch)) {
+      if (record.size() < 12) {
+        continue;
+      }
+      WriteBatchInternal::SetContents(&batch, record);
+      s = WriteBatchInternal::InsertInto(&batch, lookup, false);
+      if (s != Status::kSuccess) {
+        break;
+      }
+      max_sequence =
+          std::max(max_sequence, WriteBatchInternal::Sequence(&batch) +
+                                     WriteBatchInternal::Count(&batch) - 1);
+    }
+  }
+  lock.lock();
+  for (const auto& [id, cf] : cfs) {
+    ColumnFamilyData* cfd = cf.first;
+    auto iter = mems.find(id);
+    MemTable* mem = nullptr;
+    if (iter != mems.end()) {
+      mem = iter->second;
+    } else {
+      mem = cfd->NewMemTable();
+      mem->Ref();
+    }
+    if (s == Status::kSuccess) {
+      cfd->ReplaceMemTable(mem);
+    } else {
+      mem->Unref();
+    }
+    cfd->Unref();
+  }
+  if (s == Status::kSuccess) {
+    if (versions_->LastSequence() < max_sequence) {
+      versions_->SetLastSequence(max_sequence);
+    }
+    visible_sequence_ = versions_->LastSequence();
+  }
+  return s;
+}
+
+DBStatus DBImpl::DisableFileDeletions() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++disable_file_deletions_;
+  return Status::kSuccess;
+}
+
+DBStatus DBImpl::EnableFileDeletions() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (disable_file_deletions_ == 0) {
+    return Status::kInvalidArgument;
+  }
+  if (--disable_file_deletions_ == 0 && !read_only_) {
+    DeleteObsoleteFiles();
+  }
+  return Status::kSuccess;
+}
+
+DBStatus DBImpl::GetLiveFiles(std::vector<std::string>* files,
+                              uint64_t* manifest_file_size) {
+  files->clear();
+  std::lock_guard<std::mutex> lock(mutex_);
+  // 持锁的时候MANIFEST中没有写到一半的记录
+  const uint64_t manifest_number = versions_->ManifestFileNumber();
+  *manifest_file_size = FileTool::GetFileSize(
+      FileName::DescriptorFileName(dbname_, manifest_number));
+  std::set<uint64_t> live;
+  versions_->AddCurrentFiles(&live);
+  const uint64_t min_log_number = MinLogNumberToKeep();
+  std::vector<std::string> filenames;
+  DBStatus s = FileTool::GetChildren(dbname_, &filenames);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  uint64_t number;
+  FileType type;
+  for (const auto& filename : filenames) {
+    if (!FileName::ParseFileName(filename, &number, &type)) {
+      continue;
+    }
+    bool need = false;
+    switch (type) {
+      case FileType::kLogFile:
+        need = (number >= min_log_number);
+        break;
+      case FileType::kDescriptorFile:
+        need = (number == manifest_number);
+        break;
+      case FileType::kTableFile:
+      case FileType::kBlobFile:
+        need = (live.count(number) != 0);
+        live.erase(number);
+        break;
+      case FileType::kCurrentFile:
+        need = true;
+        break;
+      case FileType::kTempFile:
+      case FileType::kBlockCacheKeysFile:
+        break;
+    }
+    if (need) {
+      files->push_back(filename);
+    }
+  }
+  // 当前版本中的文件都应该在目录中
+  return live.empty() ? Status::kSuccess : Status::kCorruption;
+}
+
+DBStatus DBImpl::TryCatchUpWithPrimary() {
+  if (!secondary_) {
+    return Status::kNotSupported;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  // 先读MANIFEST再读WAL: 读完MANIFEST之后刷盘的数据还可以在WAL中找到
+  DBStatus s = versions_->CatchUpWithPrimary();
+  if (s == Status::kSuccess) {
+    s = ReplayLogFilesReadOnly(lock);
+  }
+  return s;
+}
+
+DBStatus DBImpl::CreateColumnFamily(const Options& options,
+                                    const std::string& name,
+                                    ColumnFamilyHandle** handle) {
+  *handle = nullptr;
+  if (read_only_) {
+    return Status::kNotSupported;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ColumnFamilyData* cfd = nullptr;
+  // 新的column family只会写入当前的WAL
+  DBStatus s = versions_->CreateColumnFamily(
+      ColumnFamilyDescriptor(name, options), logfile_number_, &cfd);
+  if (s == Status::kSuccess) {
+    *handle = new ColumnFamilyHandleImpl(cfd, &mutex_);
+  }
+  return s;
+}
+
+DBStatus DBImpl::DropColumnFamily(ColumnFamilyHandle* column_family) {
+  ColumnFamilyData* cfd =
+      static_cast<ColumnFamilyHandleImpl*>(column_family)->cfd();
+  if (read_only_) {
+    return Status::kNotSupported;
+  }
+  if (cfd->id() == 0) {
+    return Status::kInvalidArgument;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  // 等待正在写memtable的请求结束，之后的写入不会再看到这个column family
+  writers_cv_.wait(lock, [this]() { return pending_writes_.empty(); });
+  if (cfd->IsDropped()) {
+    return Status::kInvalidArgument;
+  }
+  DBStatus s = versions_->DropColumnFamily(cfd);
+  if (s == Status::kSuccess) {
+    // 删除的column family不再限制写入
+    RecalculateWriteStallCondition();
+    bg_done_cv_.notify_all();
+  }
+  return s;
+}
+
+DBStatus DBImpl::DestroyColumnFamilyHandle(ColumnFamilyHandle* column_family) {
+  if (column_family == default_cf_handle_.get()) {
+    return Status::kSuccess;
+  }
+  // 已经删除的column family在最后一个引用释放之后，它的sst变成了可以删除的文件
+  delete column_family;
+  if (!read_only_) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    DeleteObsoleteFiles();
+  }
+  return Status::kSuccess;
+}
+
+ColumnFamilyHandle* DBImpl::DefaultColumnFamily() const {
+  return default_cf_handle_.get();
+}
+
+DBStatus DB::Open(const Options& options, const std::string& dbname,
+                  DB** dbptr) {
+  std::vector<ColumnFamilyDescriptor> column_families;
+  column_families.emplace_back(kDefaultColumnFamilyName, options);
+  std::vector<ColumnFamilyHandle*> handles;
+  // 返回的是默认column family的handle，由db持有
+  return Open(options, dbname, column_families, &handles, dbptr);
+}
+
+DBStatus DB::Open(const Options& options, const std::string& dbname,
+                  const std::vector<ColumnFamilyDescriptor>& column_families,
+                  std::vector<ColumnFamilyHandle*>* handles, DB** dbptr) {
+  *dbptr = nullptr;
+  handles->clear();
+  std::vector<ColumnFamilyDescriptor> descriptors = column_families;
+  if (std::none_of(descriptors.begin(), descriptors.end(),
+                   [](const ColumnFamilyDescriptor& d) {
+                     return d.name == kDefaultColumnFamilyName;
+                   })) {
+    descriptors.emplace(descriptors.begin(), kDefaultColumnFamilyName,
+                        options);
+  }
+  DBImpl* impl = new DBImpl(options, dbname);
+  std::unique_lock<std::mutex> lock(impl->mutex_);
+  std::map<uint32_t, VersionEdit> edits;
+  std::vector<std::string> missing;
+  DBStatus s = impl->Recover(descriptors, &edits, &missing);
+  if (s == Status::kSuccess && !missing.empty() && !options.create_if_missing) {
+    s = Status::kInvalidArgument;
+  }
+  if (s == Status::kSuccess) {
+    s = impl->NewLogFile();
+  }
+  if (s == Status::kSuccess) {
+    // 回放过的WAL都已经刷成了sst
+    for (const auto& cf : impl->versions_->column_families()) {
+      VersionEdit& edit = edits[cf.first];
+      edit.SetLogNumber(impl->logfile_number_);
+      s = impl->versions_->LogAndApply(cf.second, &edit);
+      if (s != Status::kSuccess) {
+        break;
+      }
+    }
+  }
+  for (const auto& name : missing) {
+    if (s != Status::kSuccess) {
+      break;
+    }
+    auto iter = std::find_if(descriptors.begin(), descriptors.end(),
+                             [&name](const ColumnFamilyDescriptor& d) {
+                               return d.name == name;
+                             });
+    ColumnFamilyData* cfd = nullptr;
+    s = impl->versions_->CreateColumnFamily(*iter, impl->logfile_number_,
+                                            &cfd);
+  }
+  if (s == Status::kSuccess) {
+    impl->default_cf_handle_ = std::make_unique<ColumnFamilyHandleImpl>(
+        impl->versions_->DefaultColumnFamily(), &impl->mutex_);
+    for (const auto& d : column_families) {
+      if (d.name == kDefaultColumnFamilyName) {
+        handles->push_back(impl->default_cf_handle_.get());
+      } else {
+        handles->push_back(new ColumnFamilyHandleImpl(
+            impl->versions_->GetColumnFamily(d.name), &impl->mutex_));
+      }
+    }
+    impl->DeleteObsoleteFiles();
+    impl->OpenTableFiles();
+    impl->bg_pool_ =
+        std::make_unique<ThreadPool>(impl->options_.max_background_jobs);
+    impl->MaybeScheduleCompaction();
+    if (impl->options_.block_cache_warmup &&
+        FileTool::FileExists(FileName::BlockCacheKeysFileName(dbname))) {
+      impl->bg_warmup_scheduled_ = true;
+      impl->bg_pool_->Schedule([impl]() { impl->BackgroundWarmUp(); });
+    }
+  }
+  lock.unlock();
+  if (s == Status::kSuccess) {
+    *dbptr = impl;
+  } else {
+    delete impl;
+  }
+  return s;
+}
+
+DBStatus DB::OpenForReadOnly(const Options& options, const std::string& dbname,
+                             DB** dbptr) {
+  std::vector<ColumnFamilyDescriptor> column_families;
+  column_families.emplace_back(kDefaultColumnFamilyName, options);
+  std::vector<ColumnFamilyHandle*> handles;
+  return DBImpl::OpenReadOnly(options, dbname, column_families, false,
+                              &handles, dbptr);
+}
+
+DBStatus DB::OpenForReadOnly(
+    const Options& options, const std::string& dbname,
+    const std::vector<ColumnFamilyDescriptor>& column_families,
+    std::vector<ColumnFamilyHandle*>* handles, DB** dbptr) {
+  return DBImpl::OpenReadOnly(options, dbname, column_families, false,
+                              handles, dbptr);
+}
+
+DBStatus DB::OpenAsSecondary(const Options& options, const std::string& dbname,
+                             DB** dbptr) {
+  std::vector<ColumnFamilyDescriptor> column_families;
+  column_families.emplace_back(kDefaultColumnFamilyName, options);
+  std::vector<ColumnFamilyHandle*> handles;
+  return DBImpl::OpenReadOnly(options, dbname, column_families, true,
+                              &handles, dbptr);
+}
+
+DBStatus DB::OpenAsSecondary(
+    const Options& options, const std::string& dbname,
+    const std::vector<ColumnFamilyDescriptor>& column_families,
+    std::vector<ColumnFamilyHandle*>* handles, DB** dbptr) {
+  return DBImpl::OpenReadOnly(options, dbname, column_families, true, handles,
+                              dbptr);
+}
+
+DBStatus DBImpl::OpenReadOnly(
+    const Options& options, const std::string& dbname,
+    const std::vector<ColumnFamilyDescriptor>& column_families,
+    bool secondary, std::vector<ColumnFamilyHandle*>* handles, DB** dbptr) {
+  *dbptr = nullptr;
+  handles->clear();
+  if (!FileTool::FileExists(FileName::CurrentFileName(dbname))) {
+    return Status::kInvalidArgument;
+  }
+  std::vector<ColumnFamilyDescriptor> descriptors = column_families;
+  if (std::none_of(descriptors.begin(), descriptors.end(),
+                   [](const ColumnFamilyDescriptor& d) {
+                     return d.name == kDefaultColumnFamilyName;
+                   })) {
+    descriptors.emplace(descriptors.begin(), kDefaultColumnFamilyName,
+                        options);
+  }
+  DBImpl* impl = new DBImpl(options, dbname);
+  impl->read_only_ = true;
+  impl->secondary_ = secondary;
+  std::unique_lock<std::mutex> lock(impl->mutex_);
+  std::vector<std::string> missing;
+  DBStatus s = impl->versions_->Recover(descriptors, &missing, true);
+  if (s == Status::kSuccess && !missing.empty()) {
+    s = Status::kInvalidArgument;
+  }
+  if (s == Status::kSuccess) {
+    s = impl->ReplayLogFilesReadOnly(lock);
+  }
+  if (s == Status::kSuccess) {
+    impl->default_cf_handle_ = std::make_unique<ColumnFamilyHandleImpl>(
+        impl->versions_->DefaultColumnFamily(), &impl->mutex_);
+    for (const auto& d : column_families) {
+      if (d.name == kDefaultColumnFamilyName) {
+        handles->push_back(impl->default_cf_handle_.get());
+      } else {
+        handles->push_back(new ColumnFamilyHandleImpl(
+            impl->versions_->GetColumnFamily(d.name), &impl->mutex_));
+      }
+    }
+    impl->OpenTableFiles();
+    // 只用来预热block_cache
+    impl->bg_pool_ =
+        std::make_unique<ThreadPool>(impl->options_.max_background_jobs);
+    if (impl->options_.block_cache_warmup &&
+        FileTool::FileExists(FileName::BlockCacheKeysFileName(dbname))) {
+      impl->bg_warmup_scheduled_ = true;
+      impl->bg_pool_->Schedule([impl]() { impl->BackgroundWarmUp(); });
+    }
+  }
+  lock.unlock();
+  if (s == Status::kSuccess) {
+    *dbptr = impl;
+  } else {
+    delete impl;
+  }
+  return s;
+}
+
+DBStatus DestroyDB(const std::string& dbname, const Options& /*options*/) {
+  std::vector<std::string> filenames;
+  if (FileTool::GetChildren(dbname, &filenames) != Status::kSuccess) {
+    // 目录不存在
+    return Status::kSuccess;
+  }
+  DBStatus result = Status::kSuccess;
+  uint64_t number;
+  FileType type;
+  for (const auto& filename : filenames) {
+    if (FileName::ParseFileName(filename, &number, &type)) {
+      DBStatus s = FileTool::RemoveFile(dbname + "/" + filename);
+      if (result == Status::kSuccess && s != Status::kSuccess) {
+        result = s;
+      }
+    }
+  }
+  FileTool::RemoveDir(dbname);
+  return result;
+}
+}  // namespace corekv
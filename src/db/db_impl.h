@@ -0,0 +1,297 @@
+#ifndef DB_DB_IMPL_H_
+#define DB_DB_IMPL_H_
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "db.h"
+#include "dbformat.h"
+#include "range_del.h"
+#include "snapshot.h"
+#include "write_controller.h"
+
+namespace corekv {
+class BlobSource;
+class ColumnFamilyData;
+class Compaction;
+class FileWriter;
+class GroupCommitWriter;
+class MemTable;
+class TableBuilder;
+class ThreadPool;
+class Version;
+class VersionEdit;
+class VersionSet;
+
+// 返回给用户的column family，持有ColumnFamilyData的一个引用
+class ColumnFamilyHandleImpl final : public ColumnFamilyHandle {
+ public:
+  // mu是db的锁，释放引用的时候需要持有
+  ColumnFamilyHandleImpl(ColumnFamilyData* cfd, std::mutex* mu);
+  ColumnFamilyHandleImpl(const ColumnFamilyHandleImpl&) = delete;
+  ColumnFamilyHandleImpl& operator=(const ColumnFamilyHandleImpl&) = delete;
+  ~ColumnFamilyHandleImpl() override;
+
+  const std::string& GetName() const override;
+  uint32_t GetID() const override;
+  ColumnFamilyData* cfd() const { return cfd_; }
+
+ private:
+  ColumnFamilyData* const cfd_;
+  std::mutex* const mu_;
+};
+
+class DBImpl final : public DB {
+ public:
+  DBImpl(const Options& options, const std::string& dbname);
+  DBImpl(const DBImpl&) = delete;
+  DBImpl& operator=(const DBImpl&) = delete;
+  ~DBImpl() override;
+
+  using DB::AsyncGet;
+  using DB::AsyncMultiGet;
+  using DB::Delete;
+  using DB::DeleteRange;
+  using DB::Get;
+  using DB::GetApproximateKeyBoundaries;
+  using DB::GetApproximateSizes;
+  using DB::GetPropertiesOfAllTables;
+  using DB::GetProperty;
+  using DB::IngestExternalFile;
+  using DB::Merge;
+  using DB::MultiGet;
+  using DB::NewIterator;
+  using DB::ParallelScan;
+  using DB::Put;
+  using DB::PutWithTTL;
+
+  DBStatus CreateColumnFamily(const Options& options, const std::string& name,
+                              ColumnFamilyHandle** handle) override;
+  DBStatus DropColumnFamily(ColumnFamilyHandle* column_family) override;
+  DBStatus DestroyColumnFamilyHandle(
+      ColumnFamilyHandle* column_family) override;
+  ColumnFamilyHandle* DefaultColumnFamily() const override;
+
+  DBStatus Put(const WriteOptions& options, ColumnFamilyHandle* column_family,
+               const std::string_view& key,
+               const std::string_view& value) override;
+  DBStatus PutWithTTL(const WriteOptions& options,
+                      ColumnFamilyHandle* column_family,
+                      const std::string_view& key,
+                      const std::string_view& value, uint64_t ttl_ms) override;
+  DBStatus Merge(const WriteOptions& options,
+                 ColumnFamilyHandle* column_family,
+                 const std::string_view& key,
+                 const std::string_view& operand) override;
+  DBStatus Delete(const WriteOptions& options,
+                  ColumnFamilyHandle* column_family,
+                  const std::string_view& key) override;
+  DBStatus DeleteRange(const WriteOptions& options,
+                       ColumnFamilyHandle* column_family,
+                       const std::string_view& begin_key,
+                       const std::string_view& end_key) override;
+  DBStatus Write(const WriteOptions& options, WriteBatch* updates) override;
+  std::vector<DBStatus> MultiGet(const ReadOptions& options,
+                                 ColumnFamilyHandle* column_family,
+                                 const std::vector<std::string_view>& keys,
+                                 std::vector<std::string>* values) override;
+  DBStatus Get(const ReadOptions& options, ColumnFamilyHandle* column_family,
+               const std::string_view& key, std::string* value) override;
+  void AsyncGet(const ReadOptions& options, ColumnFamilyHandle* column_family,
+                const std::string_view& key, GetCallback callback) override;
+  void AsyncMultiGet(const ReadOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const std::vector<std::string_view>& keys,
+                     MultiGetCallback callback) override;
+  Iterator* NewIterator(const ReadOptions& options,
+                        ColumnFamilyHandle* column_family) override;
+  DBStatus ParallelScan(const ReadOptions& options,
+                        ColumnFamilyHandle* column_family,
+                        const std::string_view* begin,
+                        const std::string_view* end, int32_t n_threads,
+                        const ScanCallback& callback) override;
+  const Snapshot* GetSnapshot() override;
+  void ReleaseSnapshot(const Snapshot* snapshot) override;
+  DBStatus IngestExternalFile(ColumnFamilyHandle* column_family,
+                              const std::string& path) override;
+  DBStatus GetPropertiesOfAllTables(ColumnFamilyHandle* column_family,
+                                    TablePropertiesCollection* props) override;
+  void GetApproximateSizes(ColumnFamilyHandle* column_family,
+                           const Range* ranges, int32_t n,
+                           uint64_t* sizes) override;
+  void GetApproximateKeyBoundaries(
+      ColumnFamilyHandle* column_family, int32_t n,
+      std::vector<std::string>* boundaries) override;
+  bool GetProperty(ColumnFamilyHandle* column_family,
+                   const std::string_view& property,
+                   std::string* value) override;
+  DBStatus PersistBlockCacheKeys() override;
+  DBStatus TryCatchUpWithPrimary() override;
+  DBStatus DisableFileDeletions() override;
+  DBStatus EnableFileDeletions() override;
+  DBStatus GetLiveFiles(std::vector<std::string>* files,
+                        uint64_t* manifest_file_size) override;
+  const std::string& GetName() const override { return dbname_; }
+
+ private:
+  friend class DB;
+  struct CompactionState;
+  struct SubcompactionState;
+
+  // OpenForReadOnly和OpenAsSecondary的实现
+  static DBStatus OpenReadOnly(
+      const Options& options, const std::string& dbname,
+      const std::vector<ColumnFamilyDescriptor>& column_families,
+      bool secondary, std::vector<ColumnFamilyHandle*>* handles, DB** dbptr);
+  // 只读实例把还没有刷成sst的WAL回放到新的memtable中，替换掉每个column family
+  // 当前的memtable；回放的过程中释放mutex_
+  DBStatus ReplayLogFilesReadOnly(std::unique_lock<std::mutex>& lock);
+  // 创建一个新的db，只包含一个空的MANIFEST，options是默认column family的配置
+  DBStatus NewDB(const Options& options);
+  // 恢复出MANIFEST中的版本，并回放还没有刷成sst的WAL，
+  // 回放生成的sst按照column family的id记录到edits中
+  // column_families中MANIFEST里没有的column family追加到missing中
+  DBStatus Recover(const std::vector<ColumnFamilyDescriptor>& column_families,
+                   std::map<uint32_t, VersionEdit>* edits,
+                   std::vector<std::string>* missing);
+  DBStatus RecoverLogFile(uint64_t log_number,
+                          std::map<uint32_t, VersionEdit>* edits,
+                          SequenceNumber* max_sequence);
+  // mem、imm和current中所有entry的internal key迭代器，调用方负责保证它们的引用
+  Iterator* NewInternalIterator(const ReadOptions& options,
+                                ColumnFamilyData* cfd, MemTable* mem,
+                                MemTable* imm, Version* current);
+  // mem、imm和current中所有range tombstone合并切分之后的结果，没有的时候为nullptr
+  DBStatus CollectRangeTombstones(
+      ColumnFamilyData* cfd, MemTable* mem, MemTable* imm, Version* current,
+      std::shared_ptr<const FragmentedRangeTombstoneList>* result);
+  // 点查遇到merge操作数之后，通过迭代器收集操作数和更旧的版本并合并
+  DBStatus GetMergedValue(const ReadOptions& options, ColumnFamilyData* cfd,
+                          const std::string_view& key, SequenceNumber snapshot,
+                          MemTable* mem, MemTable* imm, Version* current,
+                          std::string* value);
+  // 给blob文件分配编号，加入pending_outputs_并记录到numbers中，
+  // 在不持有mutex_的flush和compaction过程中调用
+  uint64_t NewBlobFileNumber(std::vector<uint64_t>* numbers);
+  // 以下函数都需要持有mutex_
+  DBStatus NewLogFile();
+  // memtable写满的column family切换成新的memtable和WAL，
+  // force不为nullptr时不管它的memtable大小都切换一次
+  DBStatus MakeRoomForWrite(std::unique_lock<std::mutex>& lock,
+                            ColumnFamilyData* force = nullptr);
+  // compaction积压的时候限制写入速度或者停止写入，num_bytes是这次写入的大小
+  DBStatus DelayWrite(std::unique_lock<std::mutex>& lock, uint64_t num_bytes);
+  // 根据每个column family的level0文件数和待compaction字节数重新计算写入限制，
+  // 限速期间积压增加的时候降低速率，减少的时候提高速率
+  void RecalculateWriteStallCondition();
+  // 有immutable memtable或者某一层需要compaction的时候，提交任务到后台线程池
+  void MaybeScheduleCompaction();
+  // 依次把所有column family的immutable memtable刷成sst
+  void BackgroundFlush();
+  void BackgroundCompaction(Compaction* c);
+  // 按照上次关闭时保存的BLOCK_CACHE_KEYS把block读进block_cache，db关闭的时候提前结束
+  void BackgroundWarmUp();
+  // max_file_opening_threads大于0时并行打开所有column family当前版本中的sst，
+  // 全部打开之后才返回，在Open中后台线程启动之前调用
+  void OpenTableFiles();
+  void CompactMemTable(ColumnFamilyData* cfd);
+  // 合并的过程中会释放mutex_
+  DBStatus DoCompactionWork(CompactionState* compact);
+  // 读出所有输入sst中的range tombstone，can_skip_inputs为true的时候把整个被覆盖的
+  // 输入文件标记为不需要读取
+  DBStatus CollectCompactionRangeTombstones(CompactionState* compact,
+                                            bool can_skip_inputs);
+  // 合并一个子任务负责的key范围，不持有mutex_，可以多个子任务并行执行
+  void ProcessKeyValueCompaction(CompactionState* compact,
+                                 SubcompactionState* sub);
+  // level是输出文件所在的层，用来选择压缩算法
+  DBStatus OpenCompactionOutputFile(CompactionState* compact,
+                                    SubcompactionState* sub, int level);
+  // 把落在[上一个输出文件的终点, upper)中的range tombstone也写进去，
+  // upper为nullptr表示到子任务的终点为止
+  DBStatus FinishCompactionOutputFile(CompactionState* compact,
+                                      SubcompactionState* sub,
+                                      const std::string_view* upper);
+  // 处理compaction输出的一个value: 长度不小于min_blob_size的value写到blob文件，
+  // 旧blob文件中的value搬迁到新文件，被丢弃或者搬迁的value计入garbage
+  // 需要改写的时候key和value指向key_buf和value_buf
+  DBStatus SeparateBlobValue(CompactionState* compact, SubcompactionState* sub,
+                             bool drop, ValueType type, std::string_view* key,
+                             std::string_view* value, std::string* key_buf,
+                             std::string* value_buf);
+  // input指向当前key最新的merge操作数，收集更旧的操作数，遇到value、删除标记
+  // 或者到了最底层的时候合并成一个value写入输出，否则把操作数原样输出；
+  // merged返回是否合并成了一个value，返回之后input指向第一个没有处理的entry
+  DBStatus MergeCompactionOperands(CompactionState* compact,
+                                   SubcompactionState* sub, Iterator* input,
+                                   const ParsedInternalKey& newest,
+                                   bool* merged);
+  // 把一个entry写入当前的输出文件，需要的时候打开新的文件
+  DBStatus AddCompactionOutput(CompactionState* compact,
+                               SubcompactionState* sub, int32_t level,
+                               const std::string_view& key,
+                               const std::string_view& value);
+  DBStatus InstallCompactionResults(CompactionState* compact);
+  void CleanupCompaction(CompactionState* compact);
+  // 生成sst的过程中会释放mutex_
+  DBStatus WriteLevel0Table(ColumnFamilyData* cfd, MemTable* mem,
+                            VersionEdit* edit);
+  void DeleteObsoleteFiles();
+  // 编号小于返回值的WAL中已经没有任何column family需要回放的数据了
+  uint64_t MinLogNumberToKeep() const;
+  // 所有序号小于等于visible_sequence_的写入都已经完整写入了memtable
+  void UpdateVisibleSequence();
+  // 读取使用的序号，不需要持有mutex_
+  SequenceNumber ReadSequence(const ReadOptions& options) const;
+
+  const std::string dbname_;
+  // 用户传入的options，db级别的配置以这里为准，每个column family的配置
+  // 在ColumnFamilyData::options()中
+  const Options options_;
+  std::unique_ptr<BlobSource> blob_source_;
+
+  std::mutex mutex_;
+  // 等待正在写memtable的写请求结束
+  std::condition_variable writers_cv_;
+  // 后台任务结束之后通知等待的写请求
+  std::condition_variable bg_done_cv_;
+  std::unique_ptr<ThreadPool> bg_pool_;
+  // AsyncGet/AsyncMultiGet中需要读文件的请求
+  std::unique_ptr<ThreadPool> read_pool_;
+  // OpenForReadOnly或者OpenAsSecondary打开的实例，不写任何文件
+  bool read_only_ = false;
+  bool secondary_ = false;
+  // compaction过程中不持有锁，需要通过原子变量判断是否需要提前退出
+  std::atomic<bool> shutting_down_{false};
+  bool bg_flush_scheduled_ = false;
+  // 正在执行或者等待执行的compaction个数
+  int32_t bg_compaction_scheduled_ = 0;
+  bool bg_warmup_scheduled_ = false;
+  // 后台刷盘失败之后，后续的写入都直接返回这个错误
+  DBStatus bg_error_ = Status::kSuccess;
+  // 正在生成的sst，不能被DeleteObsoleteFiles删除
+  std::set<uint64_t> pending_outputs_;
+  // 大于0的时候DeleteObsoleteFiles什么都不做
+  int32_t disable_file_deletions_ = 0;
+  std::unique_ptr<FileWriter> logfile_;
+  uint64_t logfile_number_ = 0;
+  std::unique_ptr<GroupCommitWriter> log_;
+  std::unique_ptr<VersionSet> versions_;
+  std::unique_ptr<ColumnFamilyHandleImpl> default_cf_handle_;
+  // 已经分配了序号，但还没有写完memtable的batch的起始序号
+  std::set<SequenceNumber> pending_writes_;
+  // 持有mutex_修改，读请求不加锁读取
+  std::atomic<SequenceNumber> visible_sequence_{0};
+  SnapshotList snapshots_;
+  WriteController write_controller_;
+  WriteStallCondition write_stall_condition_ = WriteStallCondition::kNormal;
+  // 上一次计算时受到限制的column family中最大的待compaction字节数
+  uint64_t last_pending_compaction_bytes_ = 0;
+};
+}  // namespace corekv
+#endif
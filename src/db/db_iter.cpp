@@ -0,0 +1,467 @@
+#include "db_iter.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../utils/statistics.h"
+#include "../utils/util.h"
+#include "blob_file.h"
+#include "merge_operator.h"
+namespace corekv {
+namespace {
+class DBIter final : public Iterator {
+ public:
+  // 正向遍历时，iter_指向当前返回的entry；当前key的value是合并的结果时，
+  // iter_已经越过了参与合并的entry，key和value保存在saved_中
+  // 反向遍历时，iter_指向当前返回的user_key之前的entry，key和value保存在saved_中
+  enum Direction { kForward, kReverse };
+
+  DBIter(Comparator* cmp, Iterator* iter, SequenceNumber s,
+         const PrefixExtractor* prefix_extractor, BlobSource* blob_source,
+         const MergeOperator* merge_operator, Statistics* statistics,
+         std::shared_ptr<const FragmentedRangeTombstoneList> range_del)
+      : user_comparator_(cmp),
+        iter_(iter),
+        sequence_(s),
+        prefix_extractor_(prefix_extractor),
+        blob_source_(blob_source),
+        merge_operator_(merge_operator),
+        statistics_(statistics),
+        range_del_(range_del && !range_del->empty() ? std::move(range_del)
+                                                    : nullptr),
+        now_(util::GetCurrentTime()) {}
+  ~DBIter() override = default;
+
+  bool Valid() const override { return valid_; }
+  std::string_view key() const override {
+    assert(valid_);
+    return (direction_ == kForward && !merged_) ? ExtractUserKey(iter_->key())
+                                                : std::string_view(saved_key_);
+  }
+  std::string_view value() const override {
+    assert(valid_);
+    std::string_view v = (direction_ == kForward && !merged_)
+                             ? iter_->value()
+                             : std::string_view(saved_value_);
+    if (has_expiry_ && direction_ == kForward) {
+      // 反向遍历时saved_value_中已经去掉了过期时间
+      v.remove_suffix(kExpiryTailSize);
+    }
+    if (!is_blob_index_) {
+      return v;
+    }
+    if (!blob_value_loaded_) {
+      DBStatus s = blob_source_->Get(v, &blob_value_);
+      if (s != Status::kSuccess) {
+        status_ = s;
+        blob_value_.clear();
+      }
+      blob_value_loaded_ = true;
+    }
+    return blob_value_;
+  }
+  DBStatus status() const override {
+    if (status_ == Status::kSuccess) {
+      return iter_->status();
+    }
+    return status_;
+  }
+
+  void Next() override;
+  void Prev() override;
+  void Seek(const std::string_view& target) override;
+  void SeekToFirst() override;
+  void SeekToLast() override;
+
+ private:
+  void FindNextUserEntry(bool skipping, std::string* skip);
+  void FindPrevUserEntry();
+  bool ParseKey(ParsedInternalKey* key);
+  // iter_指向当前key最新的merge操作数，从新到旧收集操作数直到遇到value或者删除标记，
+  // 合并的结果保存在saved_value_中
+  void MergeValuesNewToOld();
+  // operands按照从旧到新排列，失败的时候设置status_并变成无效
+  void FinishMerge(const std::string* base,
+                   const std::vector<std::string>& operands);
+  // iter_指向的kTypeValueWithExpiry在迭代器创建的时候已经过期，过期的value当作删除标记
+  bool Expired() const;
+  // ikey被可见的range tombstone删除了，和删除标记等价
+  bool Covered(const ParsedInternalKey& ikey) const {
+    return range_del_ != nullptr &&
+           ikey.sequence <
+               range_del_->MaxCoveringSequence(ikey.user_key, sequence_);
+  }
+  // 移动之后如果已经离开了Seek目标的前缀，就变成无效
+  void CheckPrefix();
+
+  void SaveKey(const std::string_view& k, std::string* dst) {
+    dst->assign(k.data(), k.size());
+  }
+  void ClearSavedValue() {
+    // 避免一直持有很大的内存
+    if (saved_value_.capacity() > 1048576) {
+      std::string empty;
+      saved_value_.swap(empty);
+    } else {
+      saved_value_.clear();
+    }
+  }
+
+  Comparator* const user_comparator_;
+  std::unique_ptr<Iterator> iter_;
+  const SequenceNumber sequence_;
+  const PrefixExtractor* const prefix_extractor_;
+  BlobSource* const blob_source_;
+  const MergeOperator* const merge_operator_;
+  Statistics* const statistics_;
+  const std::shared_ptr<const FragmentedRangeTombstoneList> range_del_;
+  // 判断是否过期使用迭代器创建时的时间，保证同一个迭代器看到的结果一致
+  const uint64_t now_;
+  // 正向遍历时当前entry的value后面带有过期时间
+  bool has_expiry_ = false;
+  // 当前entry的value是BlobIndex，blob_value_中缓存读取出来的value
+  bool is_blob_index_ = false;
+  mutable bool blob_value_loaded_ = false;
+  mutable std::string blob_value_;
+  // 最近一次Seek的目标前缀，SeekToFirst/SeekToLast之后不限制
+  std::string prefix_;
+  bool prefix_bound_ = false;
+  // 读取blob失败的时候在value()中设置
+  mutable DBStatus status_ = Status::kSuccess;
+  std::string saved_key_;
+  std::string saved_value_;
+  // 正向遍历时当前key的value是合并的结果
+  bool merged_ = false;
+  // 反向遍历时当前key已经遇到的操作数(从旧到新)，以及更旧的版本
+  std::vector<std::string> merge_operands_;
+  std::string merge_base_;
+  bool has_merge_base_ = false;
+  Direction direction_ = kForward;
+  bool valid_ = false;
+};
+
+bool DBIter::ParseKey(ParsedInternalKey* ikey) {
+  if (!ParseInternalKey(iter_->key(), ikey)) {
+    status_ = Status::kCorruption;
+    return false;
+  }
+  return true;
+}
+
+bool DBIter::Expired() const {
+  std::string_view value;
+  uint64_t expire_at;
+  // 格式错误的value按照未过期处理，由value()原样返回
+  return SplitExpiry(iter_->value(), &value, &expire_at) && expire_at <= now_;
+}
+
+void DBIter::MergeValuesNewToOld() {
+  merged_ = true;
+  is_blob_index_ = false;
+  has_expiry_ = false;
+  std::vector<std::string> operands;
+  operands.emplace_back(iter_->value());
+  std::string base;
+  bool has_base = false;
+  // 后面的entry序号更小，都是可见的
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey) ||
+        user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+      break;
+    }
+    if (Covered(ikey)) {
+      // 更旧的版本同样被删除了，和遇到删除标记一样
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      operands.emplace_back(iter_->value());
+      continue;
+    }
+    // 遇到value或者删除标记之后，更旧的版本都不需要了，iter_停在这里交给Next跳过
+    if (ikey.type == kTypeValue) {
+      base.assign(iter_->value());
+      has_base = true;
+    } else if (ikey.type == kTypeValueWithExpiry && !Expired()) {
+      base.assign(iter_->value());
+      base.resize(base.size() - kExpiryTailSize);
+      has_base = true;
+    } else if (ikey.type == kTypeBlobIndex) {
+      DBStatus s = blob_source_->Get(iter_->value(), &base);
+      if (s != Status::kSuccess) {
+        status_ = s;
+        valid_ = false;
+        return;
+      }
+      has_base = true;
+    }
+    break;
+  }
+  std::reverse(operands.begin(), operands.end());
+  FinishMerge(has_base ? &base : nullptr, operands);
+}
+
+void DBIter::FinishMerge(const std::string* base,
+                         const std::vector<std::string>& operands) {
+  if (merge_operator_ == nullptr) {
+    // 没有设置Options::merge_operator时写入了操作数
+    status_ = Status::kInvalidArgument;
+    valid_ = false;
+    return;
+  }
+  const std::vector<std::string_view> views(operands.begin(), operands.end());
+  std::string_view base_view;
+  if (base != nullptr) {
+    base_view = *base;
+  }
+  if (!merge_operator_->FullMerge(saved_key_,
+                                  base != nullptr ? &base_view : nullptr,
+                                  views, &saved_value_)) {
+    status_ = Status::kCorruption;
+    valid_ = false;
+  }
+}
+
+void DBIter::CheckPrefix() {
+  if (valid_ && prefix_bound_) {
+    const std::string_view& k = key();
+    if (!prefix_extractor_->InDomain(k) ||
+        prefix_extractor_->Transform(k) != prefix_) {
+      valid_ = false;
+    }
+  }
+}
+
+void DBIter::Next() {
+  assert(valid_);
+  if (direction_ == kReverse) {
+    direction_ = kForward;
+    // iter_指向的是当前key之前的entry，需要先移动到当前key的范围内
+    if (!iter_->Valid()) {
+      iter_->SeekToFirst();
+    } else {
+      iter_->Next();
+    }
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
+    // saved_key_中已经保存了需要跳过的key
+  } else if (merged_) {
+    // iter_已经越过了参与合并的entry，saved_key_中保存了需要跳过的key
+    merged_ = false;
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
+  } else {
+    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    iter_->Next();
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
+  }
+  FindNextUserEntry(true, &saved_key_);
+  CheckPrefix();
+}
+
+void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
+  assert(iter_->Valid());
+  assert(direction_ == kForward);
+  do {
+    ParsedInternalKey ikey;
+    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      // 过期的value和删除标记等价
+      if (ikey.type == kTypeDeletion ||
+          (ikey.type == kTypeValueWithExpiry && Expired()) || Covered(ikey)) {
+        // 这个key之后更旧的版本都需要跳过
+        SaveKey(ikey.user_key, skip);
+        skipping = true;
+      } else if (skipping &&
+                 user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+        // 被删除或者已经返回过的key
+      } else {
+        valid_ = true;
+        is_blob_index_ = (ikey.type == kTypeBlobIndex);
+        has_expiry_ = (ikey.type == kTypeValueWithExpiry);
+        blob_value_loaded_ = false;
+        if (ikey.type == kTypeMerge) {
+          SaveKey(ikey.user_key, &saved_key_);
+          MergeValuesNewToOld();
+        } else {
+          saved_key_.clear();
+        }
+        return;
+      }
+    }
+    iter_->Next();
+  } while (iter_->Valid());
+  saved_key_.clear();
+  valid_ = false;
+}
+
+void DBIter::Prev() {
+  assert(valid_);
+  if (direction_ == kForward) {
+    // iter_指向的是当前key，需要往前移动到上一个user_key
+    if (merged_) {
+      // iter_在当前key之后，saved_key_中保存了当前key
+      merged_ = false;
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      assert(iter_->Valid());
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
+    while (iter_->Valid() && user_comparator_->Compare(
+                                 ExtractUserKey(iter_->key()), saved_key_) >= 0) {
+      iter_->Prev();
+    }
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      ClearSavedValue();
+      return;
+    }
+    direction_ = kReverse;
+  }
+  FindPrevUserEntry();
+  CheckPrefix();
+}
+
+void DBIter::FindPrevUserEntry() {
+  assert(direction_ == kReverse);
+  ValueType value_type = kTypeDeletion;
+  if (iter_->Valid()) {
+    do {
+      ParsedInternalKey ikey;
+      if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+        if ((value_type != kTypeDeletion) &&
+            user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
+          // 已经越过了一个完整的user_key
+          break;
+        }
+        // 同一个user_key更旧的版本，切换到新的key时一定是kTypeDeletion
+        const ValueType older_type = value_type;
+        value_type = ikey.type;
+        if ((value_type == kTypeValueWithExpiry && Expired()) ||
+            Covered(ikey)) {
+          value_type = kTypeDeletion;
+        }
+        if (value_type == kTypeDeletion) {
+          saved_key_.clear();
+          ClearSavedValue();
+        } else if (value_type == kTypeMerge) {
+          if (older_type != kTypeMerge) {
+            // 第一个操作数，saved_value_中更旧的版本作为合并的基础
+            merge_operands_.clear();
+            has_merge_base_ = (older_type != kTypeDeletion);
+            if (older_type == kTypeBlobIndex) {
+              DBStatus s = blob_source_->Get(saved_value_, &merge_base_);
+              if (s != Status::kSuccess) {
+                status_ = s;
+                has_merge_base_ = false;
+              }
+            } else {
+              merge_base_.swap(saved_value_);
+            }
+          }
+          SaveKey(ikey.user_key, &saved_key_);
+          merge_operands_.emplace_back(iter_->value());
+        } else {
+          // 往前遍历时，后遇到的是更新的版本
+          SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+          saved_value_.assign(iter_->value());
+          if (value_type == kTypeValueWithExpiry) {
+            saved_value_.resize(saved_value_.size() - kExpiryTailSize);
+          }
+        }
+      }
+      iter_->Prev();
+    } while (iter_->Valid());
+  }
+
+  if (value_type == kTypeDeletion) {
+    // 已经到头了
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+    direction_ = kForward;
+  } else {
+    valid_ = true;
+    is_blob_index_ = (value_type == kTypeBlobIndex);
+    has_expiry_ = false;
+    blob_value_loaded_ = false;
+    if (value_type == kTypeMerge) {
+      FinishMerge(has_merge_base_ ? &merge_base_ : nullptr, merge_operands_);
+      merge_operands_.clear();
+    }
+  }
+}
+
+void DBIter::Seek(const std::string_view& target) {
+  StopWatch watch(statistics_, kDbSeek);
+  RecordTick(statistics_, kNumberDbSeek);
+  direction_ = kForward;
+  prefix_bound_ =
+      prefix_extractor_ != nullptr && prefix_extractor_->InDomain(target);
+  if (prefix_bound_) {
+    prefix_.assign(prefix_extractor_->Transform(target));
+  }
+  merged_ = false;
+  ClearSavedValue();
+  saved_key_.clear();
+  AppendInternalKey(&saved_key_,
+                    ParsedInternalKey(target, sequence_, kValueTypeForSeek));
+  iter_->Seek(saved_key_);
+  if (iter_->Valid()) {
+    FindNextUserEntry(false, &saved_key_);
+    CheckPrefix();
+  } else {
+    valid_ = false;
+  }
+}
+
+void DBIter::SeekToFirst() {
+  direction_ = kForward;
+  prefix_bound_ = false;
+  merged_ = false;
+  ClearSavedValue();
+  iter_->SeekToFirst();
+  if (iter_->Valid()) {
+    FindNextUserEntry(false, &saved_key_);
+  } else {
+    valid_ = false;
+  }
+}
+
+void DBIter::SeekToLast() {
+  direction_ = kReverse;
+  prefix_bound_ = false;
+  merged_ = false;
+  ClearSavedValue();
+  iter_->SeekToLast();
+  FindPrevUserEntry();
+}
+}  // namespace
+
+Iterator* NewDBIterator(Comparator* user_comparator, Iterator* internal_iter,
+                        SequenceNumber sequence,
+                        const PrefixExtractor* prefix_extractor,
+                        BlobSource* blob_source,
+                        const MergeOperator* merge_operator,
+                        Statistics* statistics,
+                        std::shared_ptr<const FragmentedRangeTombstoneList>
+                            range_del) {
+  return new DBIter(user_comparator, internal_iter, sequence,
+                    prefix_extractor, blob_source, merge_operator, statistics,
+                    std::move(range_del));
+}
+}  // namespace corekv
@@ -0,0 +1,29 @@
+#ifndef DB_DB_ITER_H_
+#define DB_DB_ITER_H_
+#include <memory>
+
+#include "dbformat.h"
+#include "iterator.h"
+#include "prefix_extractor.h"
+#include "range_del.h"
+
+namespace corekv {
+class BlobSource;
+class MergeOperator;
+class Statistics;
+// 把internal key的迭代器转换成user key的迭代器:
+// 同一个user_key只返回sequence之前最新的版本，并且跳过被删除的key
+// prefix_extractor不为空的时候，Seek之后只返回和目标前缀相同的key
+// kTypeBlobIndex的value在第一次调用value()的时候才通过blob_source读取
+// merge操作数在移动到这个key的时候通过merge_operator和更旧的版本合并
+// statistics不为nullptr时统计Seek的次数和延迟
+// range_del中覆盖某个版本并且在sequence之前可见的tombstone把这个版本当作删除标记
+Iterator* NewDBIterator(
+    Comparator* user_comparator, Iterator* internal_iter,
+    SequenceNumber sequence, const PrefixExtractor* prefix_extractor = nullptr,
+    BlobSource* blob_source = nullptr,
+    const MergeOperator* merge_operator = nullptr,
+    Statistics* statistics = nullptr,
+    std::shared_ptr<const FragmentedRangeTombstoneList> range_del = nullptr);
+}  // namespace corekv
+#endif
@@ -0,0 +1,134 @@
+#include "dbformat.h"
+
+#include <vector>
+
+#include "../utils/codec.h"
+namespace corekv {
+using namespace util;
+
+void AppendInternalKey(std::string* result, const ParsedInternalKey& key) {
+  result->append(key.user_key.data(), key.user_key.size());
+  PutFixed64(result, PackSequenceAndType(key.sequence, key.type));
+}
+
+bool ParseInternalKey(const std::string_view& internal_key,
+                      ParsedInternalKey* result) {
+  const size_t n = internal_key.size();
+  if (n < kInternalKeyTailSize) {
+    return false;
+  }
+  uint64_t num = DecodeFixed64(internal_key.data() + n - kInternalKeyTailSize);
+  uint8_t c = num & 0xff;
+  result->sequence = num >> 8;
+  result->type = static_cast<ValueType>(c);
+  result->user_key = std::string_view(internal_key.data(), n - kInternalKeyTailSize);
+  return (c <= static_cast<uint8_t>(kTypeRangeDeletion));
+}
+
+const char* InternalKeyComparator::Name() {
+  return "corekv.InternalKeyComparator";
+}
+
+void InternalKeyComparator::FindShortest(std::string& start,
+                                         const std::string_view& limit) {
+  // 只对user_key部分做缩短，然后补上最大的序号，保证依然大于等于原来的key
+  std::string_view user_start = ExtractUserKey(start);
+  std::string_view user_limit = ExtractUserKey(limit);
+  std::string tmp(user_start.data(), user_start.size());
+  user_comparator_->FindShortest(tmp, user_limit);
+  if (tmp.size() < user_start.size() &&
+      user_comparator_->Compare(user_start, tmp) < 0) {
+    PutFixed64(&tmp,
+               PackSequenceAndType(kMaxSequenceNumber, kValueTypeForSeek));
+    start.swap(tmp);
+  }
+}
+
+void InternalKeyComparator::FindShortSuccessor(std::string& key) {
+  std::string_view user_key = ExtractUserKey(key);
+  std::string tmp(user_key.data(), user_key.size());
+  user_comparator_->FindShortSuccessor(tmp);
+  if (tmp.size() < user_key.size() &&
+      user_comparator_->Compare(user_key, tmp) < 0) {
+    PutFixed64(&tmp,
+               PackSequenceAndType(kMaxSequenceNumber, kValueTypeForSeek));
+    key.swap(tmp);
+  }
+}
+
+InternalFilterPolicy::InternalFilterPolicy(
+    std::shared_ptr<FilterPolicy> user_policy,
+    std::shared_ptr<PrefixExtractor> prefix_extractor)
+    : user_policy_(std::move(user_policy)),
+      prefix_extractor_(std::move(prefix_extractor)),
+      name_(user_policy_->Name()) {
+  if (prefix_extractor_) {
+    name_.append(":").append(prefix_extractor_->Name());
+  }
+}
+
+// 去掉每个key后面的序号部分，有前缀的key紧跟着加入它的前缀，相邻重复的前缀只加一次
+std::vector<std::string> InternalFilterPolicy::ExtractFilterKeys(
+    const std::string* keys, int n) const {
+  std::vector<std::string> user_keys;
+  user_keys.reserve(n);
+  std::string_view last_prefix;
+  bool has_prefix = false;
+  for (int i = 0; i < n; ++i) {
+    const std::string_view& user_key = ExtractUserKey(keys[i]);
+    user_keys.emplace_back(user_key);
+    if (prefix_extractor_ && prefix_extractor_->InDomain(user_key)) {
+      const std::string_view& prefix = prefix_extractor_->Transform(user_key);
+      if (!has_prefix || prefix != last_prefix) {
+        user_keys.emplace_back(prefix);
+        last_prefix = prefix;
+        has_prefix = true;
+      }
+    }
+  }
+  return user_keys;
+}
+
+void InternalFilterPolicy::CreateFilter(const std::string* keys, int n) {
+  if (n <= 0) {
+    return;
+  }
+  const auto& user_keys = ExtractFilterKeys(keys, n);
+  user_policy_->CreateFilter(user_keys.data(), user_keys.size());
+}
+
+void InternalFilterPolicy::CreateFilter(const std::string* keys, int n,
+                                        std::string* dst) {
+  if (n <= 0) {
+    return;
+  }
+  const auto& user_keys = ExtractFilterKeys(keys, n);
+  user_policy_->CreateFilter(user_keys.data(), user_keys.size(), dst);
+}
+
+LookupKey::LookupKey(const std::string_view& user_key, SequenceNumber s) {
+  size_t usize = user_key.size();
+  // 5个字节保存varint32
+  size_t needed = usize + 13;
+  char* dst;
+  if (needed <= sizeof(space_)) {
+    dst = space_;
+  } else {
+    dst = new char[needed];
+  }
+  start_ = dst;
+  dst = EncodeVarint32(dst, usize + kInternalKeyTailSize);
+  kstart_ = dst;
+  std::memcpy(dst, user_key.data(), usize);
+  dst += usize;
+  EncodeFixed64(dst, PackSequenceAndType(s, kValueTypeForSeek));
+  dst += kInternalKeyTailSize;
+  end_ = dst;
+}
+
+LookupKey::~LookupKey() {
+  if (start_ != space_) {
+    delete[] start_;
+  }
+}
+}  // namespace corekv
@@ -0,0 +1,202 @@
+#ifndef DB_DBFORMAT_H_
+#define DB_DBFORMAT_H_
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+
+#include <memory>
+#include <vector>
+
+#include "../filter/filter_policy.h"
+#include "../utils/codec.h"
+#include "comparator.h"
+#include "prefix_extractor.h"
+/*
+ * internal key = user_key | sequence number(56bit) + value type(8bit)
+ * 其中后8个字节按照fixed64编码，保证同一个user_key下序号越大的排在越前面
+ */
+namespace corekv {
+
+namespace config {
+// lsm的层数
+static constexpr int32_t kNumLevels = 7;
+}  // namespace config
+
+// kTypeBlobIndex只出现在sst中，value是指向blob文件的BlobIndex，
+// memtable和WAL中的value都是原始的数据
+// kTypeValueWithExpiry的value后面带有过期时间，过期之后和删除标记等价
+// kTypeMerge的value是MergeOperator的操作数，读取和compaction的时候和更旧的版本合并
+// kTypeRangeDeletion只出现在WAL和sst的range tombstone block中，见range_del.h
+enum ValueType : uint8_t {
+  kTypeDeletion = 0x0,
+  kTypeValue = 0x1,
+  kTypeBlobIndex = 0x2,
+  kTypeValueWithExpiry = 0x3,
+  kTypeMerge = 0x4,
+  kTypeRangeDeletion = 0x5,
+};
+// seek的时候按照序号从大到小排序，所以使用点数据中最大的type
+static constexpr ValueType kValueTypeForSeek = kTypeMerge;
+
+using SequenceNumber = uint64_t;
+// 低8位留给value type
+static constexpr SequenceNumber kMaxSequenceNumber = ((0x1ull << 56) - 1);
+// internal key后缀的长度
+static constexpr uint32_t kInternalKeyTailSize = 8;
+
+struct ParsedInternalKey {
+  std::string_view user_key;
+  SequenceNumber sequence = 0;
+  ValueType type = kTypeValue;
+  ParsedInternalKey() = default;
+  ParsedInternalKey(const std::string_view& u, const SequenceNumber& seq,
+                    ValueType t)
+      : user_key(u), sequence(seq), type(t) {}
+};
+
+inline uint64_t PackSequenceAndType(uint64_t seq, ValueType t) {
+  return (seq << 8) | t;
+}
+void AppendInternalKey(std::string* result, const ParsedInternalKey& key);
+bool ParseInternalKey(const std::string_view& internal_key,
+                      ParsedInternalKey* result);
+
+inline std::string_view ExtractUserKey(const std::string_view& internal_key) {
+  return std::string_view(internal_key.data(),
+                          internal_key.size() - kInternalKeyTailSize);
+}
+
+// kTypeValueWithExpiry的value := user_value | fixed64(expire_at)
+// expire_at是util::GetCurrentTime()的时间点(ms)，到达之后value失效
+static constexpr size_t kExpiryTailSize = 8;
+inline void AppendExpiry(std::string* value, uint64_t expire_at) {
+  char buf[kExpiryTailSize];
+  util::EncodeFixed64(buf, expire_at);
+  value->append(buf, kExpiryTailSize);
+}
+// 把带过期时间的value拆开，长度不够的时候返回false
+inline bool SplitExpiry(const std::string_view& value_with_expiry,
+                        std::string_view* value, uint64_t* expire_at) {
+  if (value_with_expiry.size() < kExpiryTailSize) {
+    return false;
+  }
+  const size_t n = value_with_expiry.size() - kExpiryTailSize;
+  *value = value_with_expiry.substr(0, n);
+  *expire_at = util::DecodeFixed64(value_with_expiry.data() + n);
+  return true;
+}
+
+// 序号不变，只修改internal key的type，分离value的时候用来标记kTypeBlobIndex
+inline void SetInternalKeyType(std::string* internal_key, ValueType type) {
+  char* tail = internal_key->data() + internal_key->size() - kInternalKeyTailSize;
+  const uint64_t tag = util::DecodeFixed64(tail);
+  util::EncodeFixed64(tail, (tag & ~0xffull) | type);
+}
+
+// 先按照user_key升序，再按照sequence降序
+// user_comparator是ByteComparator的时候直接调用内联的字典序比较，不经过虚函数
+class InternalKeyComparator final : public Comparator {
+ public:
+  explicit InternalKeyComparator(Comparator* user_comparator)
+      : user_comparator_(user_comparator),
+        bytewise_comparator_(dynamic_cast<ByteComparator*>(user_comparator)) {}
+  const char* Name() override;
+  int32_t Compare(const std::string_view& a,
+                  const std::string_view& b) override {
+    const std::string_view ua = ExtractUserKey(a);
+    const std::string_view ub = ExtractUserKey(b);
+    int32_t r = bytewise_comparator_ != nullptr
+                    ? bytewise_comparator_->Compare(ua, ub)
+                    : user_comparator_->Compare(ua, ub);
+    if (r == 0) {
+      // user_key相同的话，序号大的排在前面
+      const uint64_t anum =
+          util::DecodeFixed64(a.data() + a.size() - kInternalKeyTailSize);
+      const uint64_t bnum =
+          util::DecodeFixed64(b.data() + b.size() - kInternalKeyTailSize);
+      if (anum > bnum) {
+        r = -1;
+      } else if (anum < bnum) {
+        r = +1;
+      }
+    }
+    return r;
+  }
+  void FindShortest(std::string& start,
+                    const std::string_view& limit) override;
+  void FindShortSuccessor(std::string& key) override;
+  std::string_view UserKey(const std::string_view& key) override {
+    return ExtractUserKey(key);
+  }
+  Comparator* user_comparator() const { return user_comparator_; }
+
+ private:
+  Comparator* user_comparator_;
+  ByteComparator* bytewise_comparator_;
+};
+
+// sst中保存的是internal key，而布隆过滤器只需要对user_key生效，
+// 这样读取时使用任意的snapshot序号都能命中
+// 有prefix_extractor的时候每个key的前缀也加入filter，前缀查询使用前缀本身作为user_key
+class InternalFilterPolicy final : public FilterPolicy {
+ public:
+  explicit InternalFilterPolicy(
+      std::shared_ptr<FilterPolicy> user_policy,
+      std::shared_ptr<PrefixExtractor> prefix_extractor = nullptr);
+  const char* Name() override { return name_.c_str(); }
+  void CreateFilter(const std::string* keys, int n) override;
+  void CreateFilter(const std::string* keys, int n, std::string* dst) override;
+  bool MayMatch(const std::string_view& key, int32_t start_pos,
+                int32_t len) override {
+    return user_policy_->MayMatch(ExtractUserKey(key), start_pos, len);
+  }
+  bool MayMatch(const std::string_view& key,
+                const std::string_view& datas) override {
+    return user_policy_->MayMatch(ExtractUserKey(key), datas);
+  }
+  const std::string& Data() override { return user_policy_->Data(); }
+  const FilterPolicyMeta& GetMeta() override {
+    return user_policy_->GetMeta();
+  }
+  uint32_t Size() override { return user_policy_->Size(); }
+
+ private:
+  std::vector<std::string> ExtractFilterKeys(const std::string* keys,
+                                             int n) const;
+
+ private:
+  std::shared_ptr<FilterPolicy> user_policy_;
+  std::shared_ptr<PrefixExtractor> prefix_extractor_;
+  // 带上前缀规则的名字，前缀规则变化之后旧sst中的filter不会被误用
+  std::string name_;
+};
+
+// 用于MemTable::Get，把user_key和snapshot序号打包成查找用的key
+// memtable_key : varint32(internal_key_size) | user_key | tag
+class LookupKey final {
+ public:
+  LookupKey(const std::string_view& user_key, SequenceNumber sequence);
+  LookupKey(const LookupKey&) = delete;
+  LookupKey& operator=(const LookupKey&) = delete;
+  ~LookupKey();
+
+  std::string_view memtable_key() const {
+    return std::string_view(start_, end_ - start_);
+  }
+  std::string_view internal_key() const {
+    return std::string_view(kstart_, end_ - kstart_);
+  }
+  std::string_view user_key() const {
+    return std::string_view(kstart_, end_ - kstart_ - kInternalKeyTailSize);
+  }
+
+ private:
+  const char* start_;
+  const char* kstart_;
+  const char* end_;
+  // 短key直接放在栈上，避免一次内存分配
+  char space_[200];
+};
+}  // namespace corekv
+#endif
@@ -55,9 +55,9 @@ class EmptyIterator : public Iterator {
     assert(false);
     return std::string_view();
   }
-  std::string value() override {
-    static const std::string kEmpty;
-    return kEmpty;
+  std::string_view value() const override {
+    assert(false);
+    return std::string_view();
   }
   DBStatus status() const override { return status_; }
 
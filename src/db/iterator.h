@@ -22,12 +22,17 @@ class Iterator {
   virtual void SeekToLast() = 0;
 
   virtual void Seek(const std::string_view& target) = 0;
+  // 点查专用: 和target是同一个key(见Comparator::UserKey)的entry一定能定位到，
+  // 和Seek的结果相同；key不存在的时候可能直接变成无效
+  virtual void SeekForGet(const std::string_view& target) { Seek(target); }
 
   virtual void Next() = 0;
 
   virtual void Prev() = 0;
+  // key和value指向迭代器内部或者当前block的内存，只在下一次移动迭代器之前有效，
+  // 需要保留的时候由调用方自己复制
   virtual std::string_view key() const = 0;
-  virtual std::string value() = 0;
+  virtual std::string_view value() const = 0;
 
   virtual DBStatus status() const = 0;
   using CleanupFunction = void (*)(void* arg1, void* arg2);
@@ -0,0 +1,35 @@
+#ifndef DB_LOG_FORMAT_H_
+#define DB_LOG_FORMAT_H_
+#include <stdint.h>
+/*
+ * WAL按照32KB的物理block来组织，每个record的格式如下:
+ *
+ * ┌───────────────┬──────────────┬────────────┬──────────────┐
+ * │ crc32(fixed32)│length(fixed16)│ type(1byte)│  payload     │
+ * └───────────────┴──────────────┴────────────┴──────────────┘
+ *
+ * 一条逻辑记录如果跨越了多个block，会被切分成First/Middle/Last几个物理记录
+ */
+namespace corekv {
+namespace log {
+
+enum RecordType {
+  // 预分配的文件中全0的部分
+  kZeroType = 0,
+  kFullType = 1,
+  // 被切分的记录
+  kFirstType = 2,
+  kMiddleType = 3,
+  kLastType = 4
+};
+static constexpr int32_t kMaxRecordType = kLastType;
+
+static constexpr int32_t kBlockSize = 32768;
+
+// checksum (4 bytes), length (2 bytes), type (1 byte).
+static constexpr int32_t kHeaderSize = 4 + 2 + 1;
+
+}  // namespace log
+}  // namespace corekv
+
+#endif
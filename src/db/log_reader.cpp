@@ -0,0 +1,159 @@
+#include "log_reader.h"
+
+#include "../file/file.h"
+#include "../logger/log.h"
+#include "../utils/codec.h"
+#include "../utils/crc32.h"
+namespace corekv {
+using namespace util;
+namespace log {
+
+Reader::Reader(const FileReader* file, bool checksum, uint64_t initial_offset)
+    : file_(file),
+      checksum_(checksum),
+      file_offset_(initial_offset),
+      last_record_end_offset_(initial_offset) {}
+
+void Reader::ReportCorruption(uint64_t bytes, const char* reason) {
+  dropped_bytes_ += bytes;
+  LOG(WARN, "log record corruption, drop %lu bytes: %s", bytes, reason);
+}
+
+bool Reader::ReadRecord(std::string_view* record, std::string* scratch) {
+  scratch->clear();
+  *record = std::string_view();
+  bool in_fragmented_record = false;
+  std::string_view fragment;
+  while (true) {
+    const uint32_t record_type = ReadPhysicalRecord(&fragment);
+    switch (record_type) {
+      case kFullType:
+        if (in_fragmented_record) {
+          ReportCorruption(scratch->size(), "partial record without end");
+        }
+        scratch->clear();
+        *record = fragment;
+        last_record_end_offset_ = file_offset_ - buffer_.size();
+        return true;
+
+      case kFirstType:
+        if (in_fragmented_record) {
+          ReportCorruption(scratch->size(), "partial record without end");
+        }
+        scratch->assign(fragment.data(), fragment.size());
+        in_fragmented_record = true;
+        break;
+
+      case kMiddleType:
+        if (!in_fragmented_record) {
+          ReportCorruption(fragment.size(),
+                           "missing start of fragmented record");
+        } else {
+          scratch->append(fragment.data(), fragment.size());
+        }
+        break;
+
+      case kLastType:
+        if (!in_fragmented_record) {
+          ReportCorruption(fragment.size(),
+                           "missing start of fragmented record");
+        } else {
+          scratch->append(fragment.data(), fragment.size());
+          *record = std::string_view(*scratch);
+          last_record_end_offset_ = file_offset_ - buffer_.size();
+          return true;
+        }
+        break;
+
+      case kEof:
+        // 最后一条记录没有写完整(比如写的过程中宕机了)，直接丢弃
+        scratch->clear();
+        return false;
+
+      case kBadRecord:
+        if (in_fragmented_record) {
+          ReportCorruption(scratch->size(), "error in middle of record");
+          in_fragmented_record = false;
+          scratch->clear();
+        }
+        break;
+
+      default:
+        ReportCorruption(fragment.size() + (in_fragmented_record ? scratch->size() : 0),
+                         "unknown record type");
+        in_fragmented_record = false;
+        scratch->clear();
+        break;
+    }
+  }
+  return false;
+}
+
+uint32_t Reader::ReadPhysicalRecord(std::string_view* result) {
+  while (true) {
+    if (buffer_.size() < static_cast<size_t>(kHeaderSize)) {
+      if (!eof_) {
+        // 剩余的部分是block末尾的填充数据，直接跳过，读取下一个block；
+        // 从block中间开始读的时候只读到这个block的末尾
+        buffer_ = std::string_view();
+        const size_t n = kBlockSize - file_offset_ % kBlockSize;
+        DBStatus s = file_->Read(file_offset_, n, &backing_store_);
+        if (s != Status::kSuccess) {
+          ReportCorruption(n, "read log file failed");
+          eof_ = true;
+          return kEof;
+        }
+        file_offset_ += backing_store_.size();
+        buffer_ = backing_store_;
+        if (backing_store_.size() < n) {
+          eof_ = true;
+        }
+        continue;
+      } else {
+        // header写到一半的时候宕机了
+        buffer_ = std::string_view();
+        return kEof;
+      }
+    }
+
+    const char* header = buffer_.data();
+    const uint32_t a = static_cast<uint32_t>(header[4]) & 0xff;
+    const uint32_t b = static_cast<uint32_t>(header[5]) & 0xff;
+    const uint32_t type = header[6];
+    const uint32_t length = a | (b << 8);
+    if (kHeaderSize + length > buffer_.size()) {
+      size_t drop_size = buffer_.size();
+      buffer_ = std::string_view();
+      if (!eof_) {
+        ReportCorruption(drop_size, "bad record length");
+        return kBadRecord;
+      }
+      // 文件末尾的记录没有写完整，不当做错误处理
+      return kEof;
+    }
+
+    if (type == kZeroType && length == 0) {
+      // 预分配的空间，跳过当前block剩余部分
+      buffer_ = std::string_view();
+      return kBadRecord;
+    }
+
+    if (checksum_) {
+      uint32_t expected_crc = crc32::Unmask(DecodeFixed32(header));
+      uint32_t actual_crc = crc32::Value(header + 6, 1 + length);
+      if (actual_crc != expected_crc) {
+        // 长度也可能是错的，所以直接丢弃整个block剩余部分
+        size_t drop_size = buffer_.size();
+        buffer_ = std::string_view();
+        ReportCorruption(drop_size, "checksum mismatch");
+        return kBadRecord;
+      }
+    }
+
+    buffer_.remove_prefix(kHeaderSize + length);
+    *result = std::string_view(header + kHeaderSize, length);
+    return type;
+  }
+}
+}  // namespace log
+}  // namespace corekv
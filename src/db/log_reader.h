@@ -0,0 +1,58 @@
+#ifndef DB_LOG_READER_H_
+#define DB_LOG_READER_H_
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+
+#include "log_format.h"
+#include "status.h"
+
+namespace corekv {
+class FileReader;
+namespace log {
+
+class Reader final {
+ public:
+  // checksum为true的时候会校验每一个物理记录的crc
+  // initial_offset需要是一条记录的起始位置，例如上一次读取的LastRecordEndOffset，
+  // 用来继续读取另一个进程正在追加的文件
+  Reader(const FileReader* file, bool checksum, uint64_t initial_offset = 0);
+
+  Reader(const Reader&) = delete;
+  Reader& operator=(const Reader&) = delete;
+
+  // 读取下一条完整的逻辑记录，record可能指向scratch，也可能指向内部的block缓冲区，
+  // 在下一次调用ReadRecord之前有效；读到文件末尾返回false
+  bool ReadRecord(std::string_view* record, std::string* scratch);
+
+  // 由于数据损坏而被跳过的字节数
+  uint64_t DroppedBytes() const { return dropped_bytes_; }
+  // 最后一条读到的完整记录在文件中的结束位置，之后的内容还没有写完整或者还没有读取
+  uint64_t LastRecordEndOffset() const { return last_record_end_offset_; }
+
+ private:
+  // 除了log_format.h中的类型之外，额外的两种内部返回值
+  enum {
+    kEof = kMaxRecordType + 1,
+    // crc错误、长度错误等
+    kBadRecord = kMaxRecordType + 2
+  };
+  uint32_t ReadPhysicalRecord(std::string_view* result);
+  void ReportCorruption(uint64_t bytes, const char* reason);
+
+  const FileReader* file_;
+  const bool checksum_;
+  std::string backing_store_;
+  // 当前block中还未解析的部分
+  std::string_view buffer_;
+  // 下一次从文件中读取的位置
+  uint64_t file_offset_;
+  uint64_t last_record_end_offset_;
+  bool eof_ = false;
+  uint64_t dropped_bytes_ = 0;
+};
+}  // namespace log
+}  // namespace corekv
+
+#endif
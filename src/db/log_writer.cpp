@@ -0,0 +1,176 @@
+#include "log_writer.h"
+
+#include <assert.h>
+
+#include <vector>
+
+#include "../file/file.h"
+#include "../utils/codec.h"
+#include "../utils/crc32.h"
+#include "../utils/statistics.h"
+namespace corekv {
+using namespace util;
+namespace log {
+
+static void InitTypeCrc(uint32_t* type_crc) {
+  for (int32_t i = 0; i <= kMaxRecordType; i++) {
+    char t = static_cast<char>(i);
+    type_crc[i] = crc32::Value(&t, 1);
+  }
+}
+
+Writer::Writer(FileWriter* dest, uint64_t dest_length)
+    : dest_(dest), block_offset_(dest_length % kBlockSize) {
+  InitTypeCrc(type_crc_);
+}
+
+DBStatus Writer::AddRecord(const std::string_view& record) {
+  const char* ptr = record.data();
+  size_t left = record.size();
+  // 空的record也需要写一个header
+  DBStatus s;
+  bool begin = true;
+  do {
+    const int32_t leftover = kBlockSize - block_offset_;
+    assert(leftover >= 0);
+    if (leftover < kHeaderSize) {
+      // 剩余空间连header都放不下，直接用0填充，切换到下一个block
+      if (leftover > 0) {
+        static const char kZeros[kHeaderSize] = {0};
+        s = dest_->Append(kZeros, leftover);
+      }
+      block_offset_ = 0;
+    }
+
+    const size_t avail = kBlockSize - block_offset_ - kHeaderSize;
+    const size_t fragment_length = (left < avail) ? left : avail;
+
+    RecordType type;
+    const bool end = (left == fragment_length);
+    if (begin && end) {
+      type = kFullType;
+    } else if (begin) {
+      type = kFirstType;
+    } else if (end) {
+      type = kLastType;
+    } else {
+      type = kMiddleType;
+    }
+
+    s = EmitPhysicalRecord(type, ptr, fragment_length);
+    ptr += fragment_length;
+    left -= fragment_length;
+    begin = false;
+  } while (s == Status::kSuccess && left > 0);
+  return s;
+}
+
+DBStatus Writer::EmitPhysicalRecord(RecordType t, const char* ptr,
+                                    size_t length) {
+  assert(length <= 0xffff);
+  assert(block_offset_ + kHeaderSize + length <= kBlockSize);
+
+  char buf[kHeaderSize];
+  buf[4] = static_cast<char>(length & 0xff);
+  buf[5] = static_cast<char>(length >> 8);
+  buf[6] = static_cast<char>(t);
+
+  // crc覆盖type和payload
+  uint32_t crc = crc32::Extend(type_crc_[t], ptr, length);
+  crc = crc32::Mask(crc);
+  EncodeFixed32(buf, crc);
+
+  DBStatus s = dest_->Append(buf, kHeaderSize);
+  if (s == Status::kSuccess) {
+    s = dest_->Append(ptr, length);
+  }
+  block_offset_ += kHeaderSize + length;
+  return s;
+}
+}  // namespace log
+
+struct GroupCommitWriter::Request {
+  explicit Request(const std::string_view& r, bool s) : record(r), sync(s) {}
+  std::string_view record;
+  bool sync;
+  bool done = false;
+  DBStatus status;
+  std::condition_variable cv;
+};
+
+GroupCommitWriter::GroupCommitWriter(FileWriter* dest, uint64_t dest_length,
+                                     Statistics* statistics)
+    : dest_(dest), writer_(dest, dest_length), statistics_(statistics) {}
+
+DBStatus GroupCommitWriter::AddRecord(const std::string_view& record,
+                                      bool sync) {
+  Request request(record, sync);
+  std::unique_lock<std::mutex> lock(mutex_);
+  requests_.push_back(&request);
+  while (!request.done && &request != requests_.front()) {
+    request.cv.wait(lock);
+  }
+  // 已经被其他leader顺带提交了
+  if (request.done) {
+    return request.status;
+  }
+
+  // 当前线程是leader，收集当前排队的所有请求;
+  // 只有sync相同的请求才合并成一组: 不需要sync的请求搭上需要sync的组会被迫等待fsync，
+  // 需要sync的请求搭上不需要sync的组同样会让组内其他请求等待fsync
+  size_t group_bytes = 0;
+  bool need_sync = false;
+  // 释放锁之后队列还会继续增长，所以需要先把这一组拷贝出来
+  std::vector<Request*> group;
+  for (Request* req : requests_) {
+    if (!group.empty() &&
+        (group_bytes + req->record.size() > kMaxGroupBytes ||
+         req->sync != request.sync)) {
+      break;
+    }
+    group_bytes += req->record.size();
+    need_sync = need_sync || req->sync;
+    group.push_back(req);
+  }
+  Request* last_request = group.back();
+
+  // 写文件的时候不需要持锁，其他线程可以继续排队形成下一个组
+  lock.unlock();
+  DBStatus s;
+  for (Request* req : group) {
+    s = writer_.AddRecord(req->record);
+    if (s != Status::kSuccess) {
+      break;
+    }
+  }
+  if (s == Status::kSuccess) {
+    s = dest_->FlushBuffer();
+    RecordTick(statistics_, kWalFileBytes, group_bytes);
+  }
+  if (s == Status::kSuccess && need_sync) {
+    s = dest_->Sync();
+    sync_count_.fetch_add(1, std::memory_order_relaxed);
+    RecordTick(statistics_, kWalFileSynced);
+  }
+  group_count_.fetch_add(1, std::memory_order_relaxed);
+  lock.lock();
+
+  while (true) {
+    Request* ready = requests_.front();
+    requests_.pop_front();
+    if (ready != &request) {
+      ready->status = s;
+      ready->done = true;
+      ready->cv.notify_one();
+    }
+    if (ready == last_request) {
+      break;
+    }
+  }
+  // 唤醒下一个组的leader
+  if (!requests_.empty()) {
+    requests_.front()->cv.notify_one();
+  }
+  return s;
+}
+}  // namespace corekv
@@ -0,0 +1,81 @@
+#ifndef DB_LOG_WRITER_H_
+#define DB_LOG_WRITER_H_
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string_view>
+
+#include "log_format.h"
+#include "status.h"
+
+namespace corekv {
+class FileWriter;
+class Statistics;
+namespace log {
+
+// 只负责record的编码，数据先进入FileWriter的缓冲区，由调用方决定何时刷盘
+class Writer final {
+ public:
+  // dest_length表示文件已有的长度，用于追加写
+  explicit Writer(FileWriter* dest, uint64_t dest_length = 0);
+
+  Writer(const Writer&) = delete;
+  Writer& operator=(const Writer&) = delete;
+
+  DBStatus AddRecord(const std::string_view& record);
+
+ private:
+  DBStatus EmitPhysicalRecord(RecordType type, const char* ptr,
+                              size_t length);
+
+  FileWriter* dest_;
+  // 当前block中已经写入的位置
+  int32_t block_offset_;
+  // 预先计算好每个type的crc，减少计算量
+  uint32_t type_crc_[kMaxRecordType + 1];
+};
+}  // namespace log
+
+// 组提交: 并发的写请求在队列中排队，队首的线程作为leader，把当前所有排队的
+// 请求一次性写入，并只调用一次flush + fsync，其余线程直接等待leader的结果
+class GroupCommitWriter final {
+ public:
+  // statistics不为nullptr时统计写入的字节数和fsync次数
+  explicit GroupCommitWriter(FileWriter* dest, uint64_t dest_length = 0,
+                             Statistics* statistics = nullptr);
+
+  GroupCommitWriter(const GroupCommitWriter&) = delete;
+  GroupCommitWriter& operator=(const GroupCommitWriter&) = delete;
+
+  // 可以被多个线程同时调用，返回时record已经写入(sync为true时已经落盘)
+  DBStatus AddRecord(const std::string_view& record, bool sync);
+
+  // 实际执行的fsync次数
+  uint64_t SyncCount() const {
+    return sync_count_.load(std::memory_order_relaxed);
+  }
+  // 实际执行的组提交次数
+  uint64_t GroupCount() const {
+    return group_count_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Request;
+  // 单次组提交的最大数据量，避免小请求被一个大组拖住太久
+  static constexpr size_t kMaxGroupBytes = 1 << 20;
+
+  std::mutex mutex_;
+  std::deque<Request*> requests_;
+  FileWriter* dest_;
+  log::Writer writer_;
+  Statistics* const statistics_;
+  // leader线程更新，其他线程不加锁读取
+  std::atomic<uint64_t> sync_count_{0};
+  std::atomic<uint64_t> group_count_{0};
+};
+}  // namespace corekv
+
+#endif
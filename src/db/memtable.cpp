@@ -0,0 +1,200 @@
+#include "memtable.h"
+
+#include <algorithm>
+
+#include "../utils/codec.h"
+#include "../utils/util.h"
+namespace corekv {
+using namespace util;
+
+MemTable::MemTable(const InternalKeyComparator& comparator,
+                   size_t arena_block_size, size_t huge_page_size,
+                   int32_t numa_node, const MemTableRepFactory* rep_factory)
+    : comparator_(comparator),
+      refs_(0),
+      arena_(arena_block_size, huge_page_size, numa_node) {
+  if (rep_factory != nullptr) {
+    table_.reset(rep_factory->CreateMemTableRep(comparator_, &arena_));
+  } else {
+    table_.reset(SkipListRepFactory().CreateMemTableRep(comparator_, &arena_));
+  }
+}
+
+uint64_t MemTable::ApproximateMemoryUsage() {
+  return arena_.MemoryUsage() +
+         range_tombstone_bytes_.load(std::memory_order_relaxed);
+}
+
+const char* MemTable::EncodeEntry(SequenceNumber seq, ValueType type,
+                                  const std::string_view& key,
+                                  const std::string_view& value) {
+  // 格式如下:
+  //  key_size     : varint32 of internal_key.size()
+  //  key bytes    : char[internal_key.size()]
+  //  tag          : uint64((sequence << 8) | type)
+  //  value_size   : varint32 of value.size()
+  //  value bytes  : char[value.size()]
+  const uint32_t key_size = key.size();
+  const uint32_t val_size = value.size();
+  const uint32_t internal_key_size = key_size + kInternalKeyTailSize;
+  const uint32_t encoded_len = VarintLength(internal_key_size) +
+                               internal_key_size + VarintLength(val_size) +
+                               val_size;
+  char* buf = reinterpret_cast<char*>(arena_.Allocate(encoded_len));
+  char* p = EncodeVarint32(buf, internal_key_size);
+  std::memcpy(p, key.data(), key_size);
+  p += key_size;
+  EncodeFixed64(p, PackSequenceAndType(seq, type));
+  p += kInternalKeyTailSize;
+  p = EncodeVarint32(p, val_size);
+  std::memcpy(p, value.data(), val_size);
+  assert(p + val_size == buf + encoded_len);
+  return buf;
+}
+
+void MemTable::Add(SequenceNumber seq, ValueType type,
+                   const std::string_view& key,
+                   const std::string_view& value) {
+  table_->Insert(EncodeEntry(seq, type, key, value));
+}
+
+void MemTable::AddConcurrently(SequenceNumber seq, ValueType type,
+                               const std::string_view& key,
+                               const std::string_view& value) {
+  table_->InsertConcurrently(EncodeEntry(seq, type, key, value));
+}
+
+void MemTable::AddRangeTombstone(SequenceNumber seq,
+                                 const std::string_view& begin_key,
+                                 const std::string_view& end_key) {
+  std::lock_guard<std::mutex> lock(range_del_mutex_);
+  range_tombstones_.emplace_back(begin_key, end_key, seq);
+  fragmented_range_tombstones_.reset();
+  range_tombstone_bytes_.fetch_add(
+      sizeof(RangeTombstone) + begin_key.size() + end_key.size(),
+      std::memory_order_relaxed);
+  num_range_tombstones_.fetch_add(1, std::memory_order_release);
+}
+
+std::shared_ptr<const FragmentedRangeTombstoneList>
+MemTable::GetRangeTombstones() {
+  if (num_range_tombstones_.load(std::memory_order_acquire) == 0) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(range_del_mutex_);
+  if (!fragmented_range_tombstones_) {
+    fragmented_range_tombstones_ =
+        std::make_shared<const FragmentedRangeTombstoneList>(
+            range_tombstones_, comparator_.comparator.user_comparator());
+  }
+  return fragmented_range_tombstones_;
+}
+
+bool MemTable::Get(const LookupKey& key, std::string* value, DBStatus* s,
+                   SequenceNumber* max_covering_tombstone_seq) {
+  std::string_view memkey = key.memtable_key();
+  const std::string_view& ikey = key.internal_key();
+  const SequenceNumber snapshot =
+      DecodeFixed64(ikey.data() + ikey.size() - kInternalKeyTailSize) >> 8;
+  if (max_covering_tombstone_seq != nullptr) {
+    auto range_del = GetRangeTombstones();
+    if (range_del) {
+      *max_covering_tombstone_seq =
+          std::max(*max_covering_tombstone_seq,
+                   range_del->MaxCoveringSequence(key.user_key(), snapshot));
+    }
+  }
+  const char* entry = table_->Seek(memkey.data());
+  if (entry == nullptr) {
+    return false;
+  }
+  // 找到的是第一个大于等于lookup key的entry，只需要判断user_key是否相等，
+  // 序号比lookup key大的entry已经在seek的时候被跳过了
+  uint32_t key_length;
+  const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
+  std::string_view found_user_key(key_ptr, key_length - kInternalKeyTailSize);
+  if (comparator_.comparator.user_comparator()->Compare(found_user_key,
+                                                        key.user_key()) != 0) {
+    return false;
+  }
+  const uint64_t tag = DecodeFixed64(key_ptr + key_length - kInternalKeyTailSize);
+  if (max_covering_tombstone_seq != nullptr &&
+      (tag >> 8) < *max_covering_tombstone_seq) {
+    // 被更新的range tombstone删除了，更旧的版本同样被删除
+    *s = Status::kNotFound;
+    return true;
+  }
+  switch (static_cast<ValueType>(tag & 0xff)) {
+    case kTypeValue: {
+      std::string_view v = GetLengthPrefixedSlice(key_ptr + key_length);
+      value->assign(v.data(), v.size());
+      *s = Status::kSuccess;
+      return true;
+    }
+    case kTypeDeletion:
+      *s = Status::kNotFound;
+      return true;
+    case kTypeValueWithExpiry: {
+      std::string_view v;
+      uint64_t expire_at;
+      if (!SplitExpiry(GetLengthPrefixedSlice(key_ptr + key_length), &v,
+                       &expire_at)) {
+        *s = Status::kCorruption;
+      } else if (expire_at <= GetCurrentTime()) {
+        // 过期之后和删除等价，更旧的版本也不可见
+        *s = Status::kNotFound;
+      } else {
+        value->assign(v.data(), v.size());
+        *s = Status::kSuccess;
+      }
+      return true;
+    }
+    case kTypeMerge:
+      // 需要和更旧的版本一起合并，由调用方处理
+      *s = Status::kMergeInProgress;
+      return true;
+    case kTypeBlobIndex:
+    case kTypeRangeDeletion:
+      // 不会出现在rep中
+      break;
+  }
+  return false;
+}
+
+class MemTable::MemTableIterator final : public Iterator {
+ public:
+  explicit MemTableIterator(MemTableRep* table) : iter_(table->NewIterator()) {}
+  MemTableIterator(const MemTableIterator&) = delete;
+  MemTableIterator& operator=(const MemTableIterator&) = delete;
+  ~MemTableIterator() override = default;
+
+  bool Valid() const override { return iter_->Valid(); }
+  void Seek(const std::string_view& k) override {
+    // rep中保存的是带长度前缀的key
+    tmp_.clear();
+    PutVarint32(&tmp_, k.size());
+    tmp_.append(k.data(), k.size());
+    iter_->Seek(tmp_.data());
+  }
+  void SeekToFirst() override { iter_->SeekToFirst(); }
+  void SeekToLast() override { iter_->SeekToLast(); }
+  void Next() override { iter_->Next(); }
+  void Prev() override { iter_->Prev(); }
+  std::string_view key() const override {
+    return GetLengthPrefixedSlice(iter_->key());
+  }
+  std::string_view value() const override {
+    std::string_view key_slice = GetLengthPrefixedSlice(iter_->key());
+    return GetLengthPrefixedSlice(key_slice.data() + key_slice.size());
+  }
+  DBStatus status() const override { return Status::kSuccess; }
+
+ private:
+  std::unique_ptr<MemTableRep::Iterator> iter_;
+  std::string tmp_;
+};
+
+Iterator* MemTable::NewIterator() {
+  return new MemTableIterator(table_.get());
+}
+}  // namespace corekv
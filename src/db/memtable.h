@@ -0,0 +1,92 @@
+#ifndef DB_MEMTABLE_H_
+#define DB_MEMTABLE_H_
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../memory/area.h"
+#include "dbformat.h"
+#include "iterator.h"
+#include "memtable_rep.h"
+#include "range_del.h"
+#include "status.h"
+
+namespace corekv {
+class MemTable final {
+ public:
+  // 通过引用计数管理生命周期，初始引用计数为0，使用方需要先调用Ref
+  // arena_block_size、huge_page_size、numa_node和rep_factory见Options中对应的选项，
+  // rep_factory为nullptr时使用skiplist
+  explicit MemTable(
+      const InternalKeyComparator& comparator,
+      size_t arena_block_size = ConcurrentArena::kDefaultBlockSize,
+      size_t huge_page_size = 0, int32_t numa_node = -1,
+      const MemTableRepFactory* rep_factory = nullptr);
+
+  MemTable(const MemTable&) = delete;
+  MemTable& operator=(const MemTable&) = delete;
+
+  void Ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+  void Unref() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+  // 当前使用的内存大小(包括skiplist节点和entry)
+  uint64_t ApproximateMemoryUsage();
+
+  // 返回的迭代器的key是internal key，调用方负责释放
+  Iterator* NewIterator();
+
+  // 单写线程的插入，调用方需要保证写入的串行化
+  void Add(SequenceNumber seq, ValueType type, const std::string_view& key,
+           const std::string_view& value);
+  // 多个写线程可以同时调用
+  void AddConcurrently(SequenceNumber seq, ValueType type,
+                       const std::string_view& key,
+                       const std::string_view& value);
+
+  // range tombstone单独保存，不进入rep，多个写线程可以同时调用
+  void AddRangeTombstone(SequenceNumber seq, const std::string_view& begin_key,
+                         const std::string_view& end_key);
+  // 当前所有range tombstone切分之后的结果，没有的时候返回nullptr
+  std::shared_ptr<const FragmentedRangeTombstoneList> GetRangeTombstones();
+
+  // 找到value返回true,如果key已经被删除，也返回true同时设置status为kNotFound
+  // 最新的版本是merge操作数的时候返回true并设置status为kMergeInProgress
+  // max_covering_tombstone_seq不为nullptr时先合并上这个memtable中覆盖key的
+  // range tombstone的序号，找到的版本序号比它小的时候按照已经删除处理；
+  // 调用方按照从新到旧的顺序查找，把同一个变量依次传给更旧的数据
+  bool Get(const LookupKey& key, std::string* value, DBStatus* s,
+           SequenceNumber* max_covering_tombstone_seq = nullptr);
+
+ private:
+  ~MemTable() = default;
+  class MemTableIterator;
+
+  const char* EncodeEntry(SequenceNumber seq, ValueType type,
+                          const std::string_view& key,
+                          const std::string_view& value);
+
+  MemTableKeyComparator comparator_;
+  std::atomic<int32_t> refs_;
+  // entry和rep的节点都从arena_中分配，需要比table_后析构
+  ConcurrentArena arena_;
+  std::unique_ptr<MemTableRep> table_;
+
+  // 写入range tombstone很少见，只用一把锁保护；
+  // num_range_tombstones_为0的时候读取不需要加锁
+  std::atomic<uint32_t> num_range_tombstones_{0};
+  std::atomic<size_t> range_tombstone_bytes_{0};
+  std::mutex range_del_mutex_;
+  std::vector<RangeTombstone> range_tombstones_;
+  // 最近一次切分的结果，新的tombstone写入之后清空，下次读取的时候重新生成
+  std::shared_ptr<const FragmentedRangeTombstoneList> fragmented_range_tombstones_;
+};
+}  // namespace corekv
+#endif
@@ -0,0 +1,291 @@
+#include "memtable_rep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../utils/hash_util.h"
+#include "prefix_extractor.h"
+#include "skiplist.h"
+
+namespace corekv {
+namespace {
+// SkipList按值持有allocator，这里只转发给MemTable的arena，
+// 节点和entry的内存统一由MemTable统计
+class ArenaRef final {
+ public:
+  explicit ArenaRef(ConcurrentArena* arena) : arena_(arena) {}
+  void* Allocate(uint32_t bytes) { return arena_->Allocate(bytes); }
+
+ private:
+  ConcurrentArena* arena_;
+};
+
+using EntryList = SkipList<const char*, MemTableKeyComparator, ArenaRef>;
+
+class SkipListIterator final : public MemTableRep::Iterator {
+ public:
+  explicit SkipListIterator(EntryList* list) : iter_(list) {}
+  bool Valid() const override { return iter_.Valid(); }
+  const char* key() const override { return iter_.key(); }
+  void Next() override { iter_.Next(); }
+  void Prev() override { iter_.Prev(); }
+  void Seek(const char* memtable_key) override { iter_.Seek(memtable_key); }
+  void SeekToFirst() override { iter_.SeekToFirst(); }
+  void SeekToLast() override { iter_.SeekToLast(); }
+
+ private:
+  EntryList::Iterator iter_;
+};
+
+// 遍历已经排好序的entry数组，entry本身仍然在arena中
+class SortedVectorIterator final : public MemTableRep::Iterator {
+ public:
+  SortedVectorIterator(const MemTableKeyComparator& comparator,
+                       std::vector<const char*>&& entries)
+      : comparator_(comparator),
+        entries_(std::move(entries)),
+        pos_(entries_.size()) {}
+  bool Valid() const override { return pos_ < entries_.size(); }
+  const char* key() const override { return entries_[pos_]; }
+  void Next() override { ++pos_; }
+  void Prev() override {
+    // 越过开头之后变成无效
+    pos_ = pos_ == 0 ? entries_.size() : pos_ - 1;
+  }
+  void Seek(const char* memtable_key) override {
+    pos_ = std::lower_bound(entries_.begin(), entries_.end(), memtable_key,
+                            [this](const char* a, const char* b) {
+                              return comparator_.Compare(a, b) < 0;
+                            }) -
+           entries_.begin();
+  }
+  void SeekToFirst() override { pos_ = 0; }
+  void SeekToLast() override {
+    pos_ = entries_.empty() ? 0 : entries_.size() - 1;
+  }
+
+ private:
+  MemTableKeyComparator comparator_;
+  std::vector<const char*> entries_;
+  size_t pos_;
+};
+
+class SkipListRep final : public MemTableRep {
+ public:
+  SkipListRep(const MemTableKeyComparator& comparator, ConcurrentArena* arena)
+      : list_(comparator, arena) {}
+  void Insert(const char* entry) override { list_.Insert(entry); }
+  void InsertConcurrently(const char* entry) override {
+    list_.InsertConcurrently(entry);
+  }
+  const char* Seek(const char* memtable_key) override {
+    EntryList::Iterator iter(&list_);
+    iter.Seek(memtable_key);
+    return iter.Valid() ? iter.key() : nullptr;
+  }
+  Iterator* NewIterator() override { return new SkipListIterator(&list_); }
+
+ private:
+  EntryList list_;
+};
+
+class HashSkipListRep final : public MemTableRep {
+ public:
+  HashSkipListRep(const MemTableKeyComparator& comparator,
+                  ConcurrentArena* arena,
+                  std::shared_ptr<PrefixExtractor> extractor,
+                  size_t bucket_count)
+      : comparator_(comparator),
+        arena_(arena),
+        extractor_(std::move(extractor)),
+        bucket_count_(bucket_count),
+        buckets_(new std::atomic<EntryList*>[bucket_count]) {
+    for (size_t i = 0; i < bucket_count_; ++i) {
+      buckets_[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+  ~HashSkipListRep() override {
+    for (size_t i = 0; i < bucket_count_; ++i) {
+      delete buckets_[i].load(std::memory_order_relaxed);
+    }
+  }
+  void Insert(const char* entry) override {
+    GetOrCreateBucket(entry)->Insert(entry);
+  }
+  void InsertConcurrently(const char* entry) override {
+    GetOrCreateBucket(entry)->InsertConcurrently(entry);
+  }
+  const char* Seek(const char* memtable_key) override {
+    EntryList* bucket =
+        buckets_[BucketIndex(memtable_key)].load(std::memory_order_acquire);
+    if (bucket == nullptr) {
+      return nullptr;
+    }
+    EntryList::Iterator iter(bucket);
+    iter.Seek(memtable_key);
+    return iter.Valid() ? iter.key() : nullptr;
+  }
+  // 把所有桶的entry收集起来排序，之后插入的entry不可见
+  Iterator* NewIterator() override {
+    std::vector<const char*> entries;
+    for (size_t i = 0; i < bucket_count_; ++i) {
+      EntryList* bucket = buckets_[i].load(std::memory_order_acquire);
+      if (bucket == nullptr) {
+        continue;
+      }
+      EntryList::Iterator iter(bucket);
+      for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        entries.push_back(iter.key());
+      }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [this](const char* a, const char* b) {
+                return comparator_.Compare(a, b) < 0;
+              });
+    return new SortedVectorIterator(comparator_, std::move(entries));
+  }
+
+ private:
+  size_t BucketIndex(const char* entry) const {
+    const std::string_view internal_key = GetLengthPrefixedSlice(entry);
+    const std::string_view user_key = ExtractUserKey(internal_key);
+    std::string_view prefix;
+    if (extractor_->InDomain(user_key)) {
+      prefix = extractor_->Transform(user_key);
+    }
+    return hash_util::Hash64(prefix.data(), prefix.size()) % bucket_count_;
+  }
+  EntryList* GetOrCreateBucket(const char* entry) {
+    std::atomic<EntryList*>& slot = buckets_[BucketIndex(entry)];
+    EntryList* bucket = slot.load(std::memory_order_acquire);
+    if (bucket != nullptr) {
+      return bucket;
+    }
+    // 并发插入时可能有多个线程同时创建同一个桶，失败的一方直接丢弃，
+    // 丢弃的桶的头节点留在arena中
+    EntryList* created = new EntryList(comparator_, arena_);
+    if (slot.compare_exchange_strong(bucket, created,
+                                     std::memory_order_acq_rel,
+                                     std::memory_order_acquire)) {
+      return created;
+    }
+    delete created;
+    return bucket;
+  }
+
+  MemTableKeyComparator comparator_;
+  ConcurrentArena* const arena_;
+  const std::shared_ptr<PrefixExtractor> extractor_;
+  const size_t bucket_count_;
+  std::unique_ptr<std::atomic<EntryList*>[]> buckets_;
+};
+
+class VectorRep final : public MemTableRep {
+ public:
+  VectorRep(const MemTableKeyComparator& comparator, uint32_t sort_threads)
+      : comparator_(comparator), sort_threads_(sort_threads) {}
+  void Insert(const char* entry) override { InsertConcurrently(entry); }
+  void InsertConcurrently(const char* entry) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.push_back(entry);
+  }
+  const char* Seek(const char* memtable_key) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    SortLocked();
+    auto iter = std::lower_bound(entries_.begin(), entries_.end(),
+                                 memtable_key, EntryLess{&comparator_});
+    return iter == entries_.end() ? nullptr : *iter;
+  }
+  // 返回排序之后的拷贝，之后插入的entry不可见
+  Iterator* NewIterator() override {
+    std::vector<const char*> entries;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      SortLocked();
+      entries = entries_;
+    }
+    return new SortedVectorIterator(comparator_, std::move(entries));
+  }
+
+ private:
+  struct EntryLess {
+    MemTableKeyComparator* comparator;
+    bool operator()(const char* a, const char* b) const {
+      return comparator->Compare(a, b) < 0;
+    }
+  };
+
+  // 上次排序之后追加的部分分成若干段分别排序，再两两归并，最后和之前有序的部分归并
+  void SortLocked() {
+    static constexpr size_t kMinEntriesPerThread = 16 * 1024;
+    const size_t n = entries_.size() - sorted_count_;
+    if (n == 0) {
+      return;
+    }
+    const EntryLess less{&comparator_};
+    const auto begin = entries_.begin() + sorted_count_;
+    const size_t parts = std::max<size_t>(
+        std::min<size_t>(sort_threads_, n / kMinEntriesPerThread), 1);
+    std::vector<size_t> bounds;
+    for (size_t i = 0; i <= parts; ++i) {
+      bounds.push_back(n * i / parts);
+    }
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < parts; ++i) {
+      threads.emplace_back([&, i]() {
+        std::sort(begin + bounds[i], begin + bounds[i + 1], less);
+      });
+    }
+    std::sort(begin, begin + bounds[1], less);
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    for (size_t step = 1; step < parts; step *= 2) {
+      for (size_t i = 0; i + step < parts; i += step * 2) {
+        const size_t last = std::min(i + step * 2, parts);
+        std::inplace_merge(begin + bounds[i], begin + bounds[i + step],
+                           begin + bounds[last], less);
+      }
+    }
+    std::inplace_merge(entries_.begin(), begin, entries_.end(), less);
+    sorted_count_ = entries_.size();
+  }
+
+  MemTableKeyComparator comparator_;
+  const uint32_t sort_threads_;
+  std::mutex mutex_;
+  std::vector<const char*> entries_;
+  // entries_中前sorted_count_个已经有序
+  size_t sorted_count_ = 0;
+};
+}  // namespace
+
+MemTableRep* SkipListRepFactory::CreateMemTableRep(
+    const MemTableKeyComparator& comparator, ConcurrentArena* arena) const {
+  return new SkipListRep(comparator, arena);
+}
+
+HashSkipListRepFactory::HashSkipListRepFactory(
+    std::shared_ptr<PrefixExtractor> prefix_extractor, size_t bucket_count)
+    : prefix_extractor_(std::move(prefix_extractor)),
+      bucket_count_(std::max<size_t>(bucket_count, 1)) {}
+
+MemTableRep* HashSkipListRepFactory::CreateMemTableRep(
+    const MemTableKeyComparator& comparator, ConcurrentArena* arena) const {
+  return new HashSkipListRep(comparator, arena, prefix_extractor_,
+                             bucket_count_);
+}
+
+VectorRepFactory::VectorRepFactory(uint32_t sort_threads)
+    : sort_threads_(sort_threads > 0
+                        ? sort_threads
+                        : std::max(1u, std::thread::hardware_concurrency())) {}
+
+MemTableRep* VectorRepFactory::CreateMemTableRep(
+    const MemTableKeyComparator& comparator, ConcurrentArena* /*arena*/) const {
+  return new VectorRep(comparator, sort_threads_);
+}
+}  // namespace corekv
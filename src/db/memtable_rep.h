@@ -0,0 +1,118 @@
+#ifndef DB_MEMTABLE_REP_H_
+#define DB_MEMTABLE_REP_H_
+#include <stdint.h>
+
+#include <memory>
+#include <string_view>
+
+#include "../memory/area.h"
+#include "../utils/codec.h"
+#include "dbformat.h"
+
+namespace corekv {
+class PrefixExtractor;
+
+// entry的开头是varint32编码的长度，返回紧跟在后面的内容
+inline std::string_view GetLengthPrefixedSlice(const char* data) {
+  uint32_t len;
+  // 最多5个字节
+  const char* p = util::GetVarint32Ptr(data, data + 5, &len);
+  return std::string_view(p, len);
+}
+
+// memtable中保存的是entry的起始地址，entry的格式见MemTable::EncodeEntry，
+// 按照entry中的internal key排序
+struct MemTableKeyComparator {
+  InternalKeyComparator comparator;
+  explicit MemTableKeyComparator(const InternalKeyComparator& c)
+      : comparator(c) {}
+  // 在头文件中定义，SkipList实例化的时候可以一直内联到字典序比较
+  int32_t Compare(const char* a, const char* b) {
+    return comparator.Compare(GetLengthPrefixedSlice(a),
+                              GetLengthPrefixedSlice(b));
+  }
+};
+
+/*
+ * memtable中entry的组织方式，MemTable负责编码entry并从arena中分配，
+ * rep只负责保存entry的地址并提供查找和遍历
+ *
+ * 默认的SkipListRep是一个全局有序的skiplist；HashSkipListRep按照user_key的前缀分桶，
+ * 每个桶是一个独立的skiplist，点查只需要在一个桶里比较，全局有序的遍历在需要的时候
+ * (例如flush)把所有桶的entry排序之后再返回；VectorRep插入时只追加，读取时才排序
+ */
+class MemTableRep {
+ public:
+  // 遍历entry的迭代器，key()返回entry的起始地址
+  class Iterator {
+   public:
+    virtual ~Iterator() = default;
+    virtual bool Valid() const = 0;
+    virtual const char* key() const = 0;
+    virtual void Next() = 0;
+    virtual void Prev() = 0;
+    // memtable_key的格式和entry相同，只需要带上internal key
+    virtual void Seek(const char* memtable_key) = 0;
+    virtual void SeekToFirst() = 0;
+    virtual void SeekToLast() = 0;
+  };
+
+  virtual ~MemTableRep() = default;
+  // 单写线程的插入，调用方需要保证写入的串行化
+  virtual void Insert(const char* entry) = 0;
+  // 多个写线程可以同时调用
+  virtual void InsertConcurrently(const char* entry) = 0;
+  // 点查使用，返回第一个大于等于memtable_key的entry，没有的时候返回nullptr；
+  // 分桶的实现只在同一个桶里查找，结果只有在user_key相同的时候才有意义
+  virtual const char* Seek(const char* memtable_key) = 0;
+  // 按照comparator的顺序遍历所有entry，调用方负责释放
+  virtual Iterator* NewIterator() = 0;
+};
+
+class MemTableRepFactory {
+ public:
+  virtual ~MemTableRepFactory() = default;
+  virtual const char* Name() const = 0;
+  // 返回的rep从arena中分配节点，arena的生命周期比rep长
+  virtual MemTableRep* CreateMemTableRep(const MemTableKeyComparator& comparator,
+                                         ConcurrentArena* arena) const = 0;
+};
+
+class SkipListRepFactory final : public MemTableRepFactory {
+ public:
+  const char* Name() const override { return "SkipListRepFactory"; }
+  MemTableRep* CreateMemTableRep(const MemTableKeyComparator& comparator,
+                                 ConcurrentArena* arena) const override;
+};
+
+// 不在prefix_extractor的domain里的key都放在同一个桶里；
+// 适合先写入再按照key点查的场景，按照全局顺序遍历的代价是一次排序
+class HashSkipListRepFactory final : public MemTableRepFactory {
+ public:
+  explicit HashSkipListRepFactory(
+      std::shared_ptr<PrefixExtractor> prefix_extractor,
+      size_t bucket_count = 50000);
+  const char* Name() const override { return "HashSkipListRepFactory"; }
+  MemTableRep* CreateMemTableRep(const MemTableKeyComparator& comparator,
+                                 ConcurrentArena* arena) const override;
+
+ private:
+  const std::shared_ptr<PrefixExtractor> prefix_extractor_;
+  const size_t bucket_count_;
+};
+
+// 插入只是加锁追加到数组末尾，第一次读取或者flush的时候才多线程排序，
+// 适合导入数据这种写入之后不会马上读取的场景；排序之后再插入的部分会单独排序后归并进来
+class VectorRepFactory final : public MemTableRepFactory {
+ public:
+  // sort_threads为0时根据cpu核数决定
+  explicit VectorRepFactory(uint32_t sort_threads = 0);
+  const char* Name() const override { return "VectorRepFactory"; }
+  MemTableRep* CreateMemTableRep(const MemTableKeyComparator& comparator,
+                                 ConcurrentArena* arena) const override;
+
+ private:
+  const uint32_t sort_threads_;
+};
+}  // namespace corekv
+#endif
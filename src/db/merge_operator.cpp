@@ -0,0 +1,56 @@
+#include "merge_operator.h"
+
+#include <stdint.h>
+
+#include "../utils/codec.h"
+
+namespace corekv {
+using namespace util;
+
+bool UInt64AddOperator::FullMerge(const std::string_view& /*key*/,
+                                  const std::string_view* existing_value,
+                                  const std::vector<std::string_view>& operands,
+                                  std::string* new_value) const {
+  uint64_t sum = 0;
+  if (existing_value != nullptr) {
+    if (existing_value->size() != sizeof(uint64_t)) {
+      return false;
+    }
+    sum = DecodeFixed64(existing_value->data());
+  }
+  for (const auto& operand : operands) {
+    if (operand.size() != sizeof(uint64_t)) {
+      return false;
+    }
+    sum += DecodeFixed64(operand.data());
+  }
+  new_value->clear();
+  PutFixed64(new_value, sum);
+  return true;
+}
+
+StringAppendOperator::StringAppendOperator(char delimiter)
+    : delimiter_(delimiter),
+      name_("corekv.StringAppend." +
+            std::to_string(static_cast<unsigned char>(delimiter))) {}
+
+bool StringAppendOperator::FullMerge(
+    const std::string_view& /*key*/, const std::string_view* existing_value,
+    const std::vector<std::string_view>& operands,
+    std::string* new_value) const {
+  new_value->clear();
+  bool first = true;
+  if (existing_value != nullptr) {
+    new_value->assign(existing_value->data(), existing_value->size());
+    first = false;
+  }
+  for (const auto& operand : operands) {
+    if (!first) {
+      new_value->push_back(delimiter_);
+    }
+    new_value->append(operand.data(), operand.size());
+    first = false;
+  }
+  return true;
+}
+}  // namespace corekv
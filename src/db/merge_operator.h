@@ -0,0 +1,50 @@
+#ifndef DB_MERGE_OPERATOR_H_
+#define DB_MERGE_OPERATOR_H_
+#include <string>
+#include <string_view>
+#include <vector>
+/*
+ * 读-改-写的操作(计数器加一、往列表追加元素)通过DB::Merge只写入一个操作数，
+ * 不需要先Get再Put；读取的时候把操作数和更旧的value合并，
+ * compaction遇到完整的value或者到了最底层的时候把合并的结果写回去
+ */
+namespace corekv {
+class MergeOperator {
+ public:
+  virtual ~MergeOperator() = default;
+  // 换了合并规则之后已经写入的操作数的含义也变了，需要使用不同的名字
+  virtual const char* Name() const = 0;
+  // existing_value为nullptr表示key之前不存在或者已经被删除，
+  // operands按照写入的顺序从旧到新排列；返回false表示操作数无法合并，读取时报告kCorruption
+  virtual bool FullMerge(const std::string_view& key,
+                         const std::string_view* existing_value,
+                         const std::vector<std::string_view>& operands,
+                         std::string* new_value) const = 0;
+};
+
+// value和操作数都是fixed64编码的无符号整数，合并的结果是它们的和
+class UInt64AddOperator final : public MergeOperator {
+ public:
+  const char* Name() const override { return "corekv.UInt64Add"; }
+  bool FullMerge(const std::string_view& key,
+                 const std::string_view* existing_value,
+                 const std::vector<std::string_view>& operands,
+                 std::string* new_value) const override;
+};
+
+// 把操作数依次追加到value的末尾，相邻两项之间插入分隔符
+class StringAppendOperator final : public MergeOperator {
+ public:
+  explicit StringAppendOperator(char delimiter);
+  const char* Name() const override { return name_.c_str(); }
+  bool FullMerge(const std::string_view& key,
+                 const std::string_view* existing_value,
+                 const std::vector<std::string_view>& operands,
+                 std::string* new_value) const override;
+
+ private:
+  const char delimiter_;
+  const std::string name_;
+};
+}  // namespace corekv
+#endif
@@ -3,18 +3,74 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "../cache/cache.h"
 #include "table/data_block.h"
 namespace corekv {
+class CompactionFilter;
+class CompressedSecondaryCache;
 class FilterPolicy;
+class MemTableRepFactory;
+class MergeOperator;
 class Comparator;
+class PrefixExtractor;
+class RateLimiter;
+class Snapshot;
+class Statistics;
 }
 namespace corekv {
   
 enum  BlockCompressType  {
   kNonCompress = 0x0,
-  kSnappyCompression = 0x1
+  kSnappyCompression = 0x1,
+  kLZ4Compression = 0x4,
+  kZSTDCompression = 0x7
+};
+
+struct CompressionOptions {
+  // zstd的压缩级别，其他算法忽略
+  int32_t level = 3;
+  // 大于0的时候每个sst用开头的若干data block训练一个zstd字典，之后的data block都用它压缩，
+  // 字典保存在sst的meta block中
+  uint32_t max_dict_bytes = 0;
+  // 攒够这么多字节的样本之后调用zstd训练字典，一般取max_dict_bytes的几十到100倍；
+  // 为0的时候不训练，攒够max_dict_bytes之后直接把样本作为原始内容字典
+  uint32_t zstd_max_train_bytes = 0;
+  // 大于1的时候TableBuilder用这么多个线程并行压缩data block并计算crc，
+  // 另外一个线程按照顺序写入文件，调用Add的线程只负责构建block
+  // 不压缩、分区index或者per_block_filter的时候不生效
+  uint32_t parallel_threads = 1;
+};
+
+enum CompactionStyle {
+  // 每一层的sst之间没有重叠，超过上限之后合并到下一层，读放大和空间放大小
+  kCompactionStyleLevel = 0x0,
+  // 所有数据以sorted run的形式放在level0，大小相近的相邻run合并成一个，
+  // 每个数据只会被重写很少的几次，写放大小，读放大和空间放大比leveled大
+  kCompactionStyleUniversal = 0x1,
+  // 所有sst都留在level0，数据从不重写，总大小或者存在时间超过上限之后整个删除
+  // 最旧的sst，适合只读取最近一段时间数据的场景；覆盖写和删除不会回收空间
+  kCompactionStyleFIFO = 0x2
+};
+
+struct CompactionOptionsUniversal {
+  // 累计大小的(100 + size_ratio)%不小于下一个更旧的run时，把它也合并进来
+  uint32_t size_ratio = 1;
+  // 一次合并的run的个数范围
+  uint32_t min_merge_width = 2;
+  uint32_t max_merge_width = UINT32_MAX;
+  // 除最旧的run之外的总大小超过最旧的run的这个百分比时，合并所有的run，
+  // 限制空间放大
+  uint32_t max_size_amplification_percent = 200;
+};
+
+struct CompactionOptionsFIFO {
+  // 所有sst的总大小超过这个值之后，从最旧的开始删除
+  uint64_t max_table_files_size = 1024 * 1024 * 1024;
+  // 大于0时，sst生成超过ttl_ms毫秒之后被删除；sst生成之后不会再写入新的数据，
+  // 其中的数据都至少存在了这么长时间。只在版本变化(刷盘、compaction)时检查
+  uint64_t ttl_ms = 0;
 };
 
 struct Options {
@@ -22,15 +78,167 @@ struct Options {
   uint32_t block_size = 4 * 1024;
   // 16个entry来构建一个restart
   uint32_t block_restart_interval = 16;
-  // 默认不会进行压缩
+  // data block末尾追加user_key hash -> restart下标的索引，点查时直接定位到对应的restart区间，
+  // 不用在restart数组上二分；hash表的装载率由data_block_hash_table_util_ratio决定
+  bool data_block_hash_index = false;
+  double data_block_hash_table_util_ratio = 0.75;
+  // index block的restart数组之后额外保存每个restart key前8个字节组成的定长整数，
+  // Seek先在这个连续的数组上查找(支持AVX2的时候一次比较4个)，只有前缀和目标相同的
+  // 少数restart才需要解码完整的key比较，减少大sst上一次index查找的cache miss；
+  // 只对bytewise的comparator生效，旧版本读取的时候会把block当作损坏
+  bool index_block_key_prefix = false;
+  // 默认不会进行压缩，压缩之后节省不到1/8的block按照不压缩保存
   BlockCompressType block_compress_type = BlockCompressType::kNonCompress;
+  // 不为空的时候第i层的sst使用compression_per_level[i]，层数更多的时候使用最后一个，
+  // 例如level0和level1不压缩来降低写入延迟，更深的层用zstd
+  std::vector<BlockCompressType> compression_per_level;
+  CompressionOptions compression_opts;
 
   std::shared_ptr<FilterPolicy> filter_policy = nullptr;
 
   std::shared_ptr<Comparator> comparator = nullptr;
+  // 设置之后filter中同时保存每个key的前缀，用于ReadOptions::prefix_same_as_start
+  std::shared_ptr<PrefixExtractor> prefix_extractor = nullptr;
+  // 容量按照block的字节数计算
   Cache<uint64_t, DataBlock>* block_cache = nullptr;
+  // block_cache的第二层，见CompressedSecondaryCache，只有设置了block_cache才生效；
+  // 共用同一个block_cache的db和column family需要设置同一个secondary_cache，
+  // 并且secondary_cache需要比block_cache后析构
+  CompressedSecondaryCache* secondary_cache = nullptr;
+  // 点查时在block_cache之前查找，缓存每个sst中user_key最新的版本(或者不存在)，
+  // 命中的时候不需要查index、读block和解析entry；容量按照key和value的字节数计算，
+  // 多个db可以共用同一个row_cache，key和value的内存由row_cache负责释放
+  Cache<std::string, std::string>* row_cache = nullptr;
+  // index按照index_partition_size切分成多个分区，顶层index只记录每个分区的位置，
+  // 分区在用到的时候才通过block_cache读取
+  bool partition_index = false;
+  // filter和index的分区一一对应，需要同时打开partition_index
+  bool partition_filters = false;
+  // 没有使用分区filter时，按照data block的偏移量每2KB生成一个filter，
+  // 构建的时候只需要保存当前block的key，查询时只用到候选block对应的filter
+  bool per_block_filter = false;
+  uint32_t index_partition_size = 4 * 1024;
+  // 顶层的index和filter常驻在Table中；为false时同样通过block_cache读取，
+  // 内存占用完全由block_cache的容量决定
+  bool pin_top_level_index_and_filter = true;
+  // 常驻的顶层index和filter在第一次访问的时候才读取，打开sst只读取footer和meta block，
+  // 适合sst很多、打开db之后只访问其中一部分的场景
+  bool lazy_load_index_and_filter = false;
+
+  // 以下是db级别的配置
+  // db目录不存在的时候是否创建
+  bool create_if_missing = false;
+  // db已经存在的时候是否报错
+  bool error_if_exists = false;
+  // memtable超过这个大小之后会切换成immutable memtable并刷成sst
+  uint64_t write_buffer_size = 4 * 1024 * 1024;
+  // memtable的arena每次申请的block大小，为0时取write_buffer_size / 8，
+  // 限制在[4KB, 8MB]之间；block越大分配越少加锁，但最后一个block的浪费也越多
+  uint64_t arena_block_size = 0;
+  // 大于0时memtable的block通过这个大小的大页申请(例如2MB)，优先使用系统预留的大页，
+  // 没有预留的时候通过madvise交给THP，mmap失败的时候退化成普通的malloc
+  uint64_t memtable_huge_page_size = 0;
+  // 不小于0时memtable的block绑定到这个NUMA节点，一般设置成写入线程所在的节点，
+  // 避免遍历skiplist时跨socket访问内存
+  int32_t memtable_numa_node = -1;
+  // memtable中entry的组织方式，为nullptr时使用全局有序的skiplist；
+  // 只有点查的场景可以使用HashSkipListRepFactory按照前缀分桶
+  std::shared_ptr<MemTableRepFactory> memtable_factory = nullptr;
+  // 后台线程池的大小，刷盘和compaction共用
+  int32_t max_background_jobs = 2;
+  // DB::AsyncGet/AsyncMultiGet中需要读文件的请求在这个大小的线程池中执行
+  int32_t async_read_threads = 2;
+  // 一个compaction最多按照key范围拆分成多少个子任务并行执行，为1时不拆分
+  int32_t max_subcompactions = 1;
+  // MANIFEST超过这个大小之后切换到一个新的MANIFEST，新文件以全量快照开头
+  // 保证恢复的时候只需要回放有限长度的增量记录
+  uint64_t max_manifest_file_size = 64 * 1024 * 1024;
+  // TableCache中最多同时打开的sst个数，超过之后淘汰最久没有使用的sst并关闭fd
+  int32_t max_open_files = 1000;
+  // 大于0时DB::Open用这么多线程并行打开当前版本中的sst放进TableCache，每个column family
+  // 从level0开始最多打开max_open_files个，避免打开之后的读请求逐个串行地打开sst；
+  // 为0时sst在第一次访问的时候才打开
+  int32_t max_file_opening_threads = 0;
+  // 为true时关闭db的时候把block_cache中属于这个db的data block位置(sst文件编号和偏移)
+  // 写到BLOCK_CACHE_KEYS文件，下次打开之后由后台线程把这些block重新读进block_cache，
+  // 避免重启之后很长时间内大部分读请求都要访问磁盘；运行中也可以通过
+  // DB::PersistBlockCacheKeys定期保存，防止进程异常退出之后没有可用的列表
+  bool block_cache_warmup = false;
+  // sst通过mmap读取，没有压缩的block直接指向映射的内存，省掉pread的系统调用和拷贝，
+  // 适合数据能放进page cache的场景；mmap失败的时候退化成pread
+  bool use_mmap_reads = false;
+  // flush和compaction生成sst的时候使用O_DIRECT写，不占用page cache，
+  // 避免后台写入的数据把前台读的热数据挤出去
+  bool use_direct_io_for_flush_and_compaction = false;
+  // compaction读取输入sst的时候使用O_DIRECT，读到的block也不放进block_cache
+  bool use_direct_reads_for_compaction = false;
+  // 大于0的时候flush和compaction每写入这么多字节就让内核开始异步回写，
+  // 避免sst写完之后的fsync一次性回写所有的脏页，比较合适的值是1MB
+  uint64_t bytes_per_sync = 0;
+  // sst迭代器顺序读的时候自动预读，第一次预读initial_auto_readahead_size，
+  // 之后每次翻倍直到max_auto_readahead_size；compaction的输入一开始就按照最大值预读
+  // max_auto_readahead_size为0的时候不预读，每个block单独读取
+  size_t initial_auto_readahead_size = 8 * 1024;
+  size_t max_auto_readahead_size = 2 * 1024 * 1024;
+  // flush和compaction写sst时共用的限速器，flush的优先级更高，为nullptr时不限速
+  // 自动调整的限速器还会统计Get和MultiGet的延迟，前台变慢的时候降低后台写入速率
+  std::shared_ptr<RateLimiter> rate_limiter = nullptr;
+  // compaction生成的单个sst的目标大小
+  uint64_t max_file_size = 2 * 1024 * 1024;
+  // 大于0时flush和compaction把长度不小于min_blob_size的value写到单独的blob文件中，
+  // sst中只保存指向value的索引，compaction不再反复重写大value，减少写放大
+  // 带过期时间的value(PutWithTTL)不会被分离
+  uint64_t min_blob_size = 0;
+  // 单个blob文件的目标大小
+  uint64_t blob_file_size = 256 * 1024 * 1024;
+  // compaction遇到指向最旧的这一比例blob文件的索引时，把value重新写到新的blob文件中，
+  // 旧文件中的value全部失效之后文件被删除；为0时不主动搬迁，只回收全部失效的文件
+  double blob_garbage_collection_age_cutoff = 0.25;
+  // DB::Merge写入的操作数的合并规则，为nullptr时不能使用Merge
+  std::shared_ptr<MergeOperator> merge_operator = nullptr;
+  // compaction的时候对每个key最新的value调用，为nullptr时不过滤
+  std::shared_ptr<CompactionFilter> compaction_filter = nullptr;
+  // 不为nullptr时收集block cache命中率、读写字节数以及Get/Write/flush/compaction的
+  // 延迟分布，可以通过GetProperty("corekv.stats")查看
+  std::shared_ptr<Statistics> statistics = nullptr;
+  CompactionStyle compaction_style = kCompactionStyleLevel;
+  CompactionOptionsUniversal compaction_options_universal;
+  CompactionOptionsFIFO compaction_options_fifo;
+  // level0的文件个数达到这个值之后触发compaction，universal方式下是sorted run的个数
+  int32_t level0_file_num_compaction_trigger = 4;
+  // level0的文件个数达到slowdown之后按照delayed_write_rate限制写入速度，
+  // 达到stop之后停止写入，直到compaction把文件数降下来；
+  // 小于触发compaction的阈值时按照触发阈值处理
+  int32_t level0_slowdown_writes_trigger = 20;
+  int32_t level0_stop_writes_trigger = 36;
+  // 估计的待compaction字节数超过soft之后限制写入速度，超过hard之后停止写入，为0时不检查
+  uint64_t soft_pending_compaction_bytes_limit = 64ull * 1024 * 1024 * 1024;
+  uint64_t hard_pending_compaction_bytes_limit = 256ull * 1024 * 1024 * 1024;
+  // db级别的配置，开始限速时的写入速率(字节/秒)，积压继续增加的时候逐步降低
+  uint64_t delayed_write_rate = 16 * 1024 * 1024;
+  // level1的总大小上限，之后每一层是上一层的max_bytes_for_level_multiplier倍
+  uint64_t max_bytes_for_level_base = 10 * 1024 * 1024;
+  int32_t max_bytes_for_level_multiplier = 10;
 };
 struct ReadOptions {
-
+  // 不为nullptr时读取这个快照时刻的数据，需要是同一个db的GetSnapshot返回的
+  // 还没有释放的快照；为nullptr时读取当前最新的数据
+  const Snapshot* snapshot = nullptr;
+  // 只遍历和Seek的目标前缀相同的key，filter中没有这个前缀的sst在Seek的时候直接跳过，
+  // 需要设置Options::prefix_extractor
+  bool prefix_same_as_start = false;
+  // MultiGet时一个sst中没有命中缓存的block通过io_uring一次提交，
+  // 由内核并发读取；内核不支持的时候退化成逐个pread
+  bool async_io = false;
+  // 为true时Get和MultiGet不读文件，只使用memtable、已经打开的sst和
+  // block_cache/secondary_cache中的数据，需要读文件才能得到结果的时候返回kIncomplete，
+  // filter不在缓存中时当作可能存在；迭代器遇到不在缓存中的block时以kIncomplete结束
+  bool cache_only = false;
+  // 内部使用，compaction读取输入sst的时候设置
+  bool for_compaction = false;
+};
+struct WriteOptions {
+  // 为true时，写WAL之后需要fsync才返回
+  bool sync = false;
 };
 }  // namespace corekv
\ No newline at end of file
@@ -0,0 +1,12 @@
+#include "prefix_extractor.h"
+
+namespace corekv {
+FixedPrefixExtractor::FixedPrefixExtractor(size_t prefix_len)
+    : prefix_len_(prefix_len),
+      name_("corekv.FixedPrefix." + std::to_string(prefix_len)) {}
+
+DelimitedPrefixExtractor::DelimitedPrefixExtractor(char delimiter)
+    : delimiter_(delimiter),
+      name_("corekv.DelimitedPrefix." +
+            std::to_string(static_cast<unsigned char>(delimiter))) {}
+}  // namespace corekv
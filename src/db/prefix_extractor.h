@@ -0,0 +1,60 @@
+#ifndef DB_PREFIX_EXTRACTOR_H_
+#define DB_PREFIX_EXTRACTOR_H_
+#include <stddef.h>
+
+#include <string>
+#include <string_view>
+/*
+ * 从user_key中取出前缀，打开之后filter中同时保存完整的key和前缀，
+ * 带前缀的范围查询可以直接跳过filter中没有这个前缀的sst
+ *
+ * 要求: 前缀相同的key在comparator下是连续的，并且前缀不大于任何以它开头的key，
+ * ByteComparator下所有按字节取前缀的实现都满足
+ */
+namespace corekv {
+class PrefixExtractor {
+ public:
+  virtual ~PrefixExtractor() = default;
+  // 写入sst的时候会记录在filter的名字里，换了前缀规则之后旧sst的filter不再使用
+  virtual const char* Name() const = 0;
+  // 不在domain里的key没有前缀，也不会被过滤
+  virtual bool InDomain(const std::string_view& key) const = 0;
+  virtual std::string_view Transform(const std::string_view& key) const = 0;
+};
+
+// 固定长度的前缀，长度不够的key不在domain里
+class FixedPrefixExtractor final : public PrefixExtractor {
+ public:
+  explicit FixedPrefixExtractor(size_t prefix_len);
+  const char* Name() const override { return name_.c_str(); }
+  bool InDomain(const std::string_view& key) const override {
+    return key.size() >= prefix_len_;
+  }
+  std::string_view Transform(const std::string_view& key) const override {
+    return key.substr(0, prefix_len_);
+  }
+
+ private:
+  const size_t prefix_len_;
+  const std::string name_;
+};
+
+// 到第一个分隔符为止(包含分隔符)的部分作为前缀，例如 "tenant_id|"
+// 没有分隔符的key不在domain里
+class DelimitedPrefixExtractor final : public PrefixExtractor {
+ public:
+  explicit DelimitedPrefixExtractor(char delimiter);
+  const char* Name() const override { return name_.c_str(); }
+  bool InDomain(const std::string_view& key) const override {
+    return key.find(delimiter_) != std::string_view::npos;
+  }
+  std::string_view Transform(const std::string_view& key) const override {
+    return key.substr(0, key.find(delimiter_) + 1);
+  }
+
+ private:
+  const char delimiter_;
+  const std::string name_;
+};
+}  // namespace corekv
+#endif
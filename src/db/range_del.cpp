@@ -0,0 +1,197 @@
+#include "range_del.h"
+
+#include <algorithm>
+
+namespace corekv {
+std::string RangeTombstone::InternalStartKey() const {
+  std::string key;
+  AppendInternalKey(&key, ParsedInternalKey(start, seq, kTypeRangeDeletion));
+  return key;
+}
+
+std::string RangeTombstone::InternalEndKey() const {
+  std::string key;
+  AppendInternalKey(&key,
+                    ParsedInternalKey(end, kMaxSequenceNumber, kTypeRangeDeletion));
+  return key;
+}
+
+void ExtendFileBounds(const RangeTombstone& tombstone, Comparator* icmp,
+                      std::string* smallest, std::string* largest) {
+  std::string start = tombstone.InternalStartKey();
+  if (smallest->empty() || icmp->Compare(start, *smallest) < 0) {
+    smallest->swap(start);
+  }
+  std::string end = tombstone.InternalEndKey();
+  if (largest->empty() || icmp->Compare(end, *largest) > 0) {
+    largest->swap(end);
+  }
+}
+
+bool RangeTombstone::Decode(const std::string_view& internal_start_key,
+                            const std::string_view& end,
+                            RangeTombstone* tombstone) {
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(internal_start_key, &ikey) ||
+      ikey.type != kTypeRangeDeletion) {
+    return false;
+  }
+  tombstone->start.assign(ikey.user_key.data(), ikey.user_key.size());
+  tombstone->end.assign(end.data(), end.size());
+  tombstone->seq = ikey.sequence;
+  return true;
+}
+
+FragmentedRangeTombstoneList::FragmentedRangeTombstoneList(
+    std::vector<RangeTombstone> tombstones, Comparator* user_comparator)
+    : user_comparator_(user_comparator), tombstones_(std::move(tombstones)) {
+  auto less = [this](const std::string& a, const std::string& b) {
+    return user_comparator_->Compare(a, b) < 0;
+  };
+  // 所有的端点排序去重之后，相邻两个端点之间就是一个候选的片段
+  std::vector<std::string> points;
+  std::vector<const RangeTombstone*> sorted;
+  for (const auto& t : tombstones_) {
+    if (user_comparator_->Compare(t.start, t.end) >= 0) {
+      continue;
+    }
+    points.push_back(t.start);
+    points.push_back(t.end);
+    sorted.push_back(&t);
+  }
+  std::sort(points.begin(), points.end(), less);
+  points.erase(std::unique(points.begin(), points.end(),
+                           [this](const std::string& a, const std::string& b) {
+                             return user_comparator_->Compare(a, b) == 0;
+                           }),
+               points.end());
+  std::sort(sorted.begin(), sorted.end(),
+            [&](const RangeTombstone* a, const RangeTombstone* b) {
+              return less(a->start, b->start);
+            });
+  // 扫描到当前片段时所有start不大于片段起点的tombstone
+  std::vector<const RangeTombstone*> active;
+  size_t next = 0;
+  for (size_t i = 0; i + 1 < points.size(); ++i) {
+    const std::string& lo = points[i];
+    while (next < sorted.size() &&
+           user_comparator_->Compare(sorted[next]->start, lo) <= 0) {
+      active.push_back(sorted[next++]);
+    }
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [&](const RangeTombstone* t) {
+                                  return user_comparator_->Compare(t->end,
+                                                                   lo) <= 0;
+                                }),
+                 active.end());
+    if (active.empty()) {
+      continue;
+    }
+    const size_t seq_begin = seqs_.size();
+    for (const auto* t : active) {
+      seqs_.push_back(t->seq);
+    }
+    std::sort(seqs_.begin() + seq_begin, seqs_.end(),
+              std::greater<SequenceNumber>());
+    seqs_.erase(std::unique(seqs_.begin() + seq_begin, seqs_.end()),
+                seqs_.end());
+    fragments_.push_back({lo, points[i + 1], seq_begin, seqs_.size()});
+  }
+}
+
+const FragmentedRangeTombstoneList::Fragment*
+FragmentedRangeTombstoneList::FindFragment(
+    const std::string_view& user_key) const {
+  // 第一个start大于user_key的片段的前一个
+  auto iter = std::upper_bound(
+      fragments_.begin(), fragments_.end(), user_key,
+      [this](const std::string_view& k, const Fragment& f) {
+        return user_comparator_->Compare(k, f.start) < 0;
+      });
+  if (iter == fragments_.begin()) {
+    return nullptr;
+  }
+  --iter;
+  if (user_comparator_->Compare(user_key, iter->end) >= 0) {
+    return nullptr;
+  }
+  return &*iter;
+}
+
+SequenceNumber FragmentedRangeTombstoneList::VisibleSequence(
+    const Fragment& fragment, SequenceNumber snapshot) const {
+  // 序号从大到小，找到第一个对snapshot可见的
+  auto seq = std::lower_bound(seqs_.begin() + fragment.seq_begin,
+                              seqs_.begin() + fragment.seq_end, snapshot,
+                              std::greater<SequenceNumber>());
+  return seq == seqs_.begin() + fragment.seq_end ? 0 : *seq;
+}
+
+SequenceNumber FragmentedRangeTombstoneList::MaxCoveringSequence(
+    const std::string_view& user_key, SequenceNumber snapshot) const {
+  const Fragment* fragment = FindFragment(user_key);
+  return fragment == nullptr ? 0 : VisibleSequence(*fragment, snapshot);
+}
+
+SequenceNumber FragmentedRangeTombstoneList::MinCoveringSequence(
+    const std::string_view& first, const std::string_view& last,
+    SequenceNumber snapshot) const {
+  const Fragment* fragment = FindFragment(first);
+  if (fragment == nullptr) {
+    return 0;
+  }
+  SequenceNumber result = kMaxSequenceNumber;
+  for (const Fragment* f = fragment; f != fragments_.data() + fragments_.size();
+       ++f) {
+    if (f != fragment &&
+        user_comparator_->Compare((f - 1)->end, f->start) != 0) {
+      // 两个片段之间有空隙
+      return 0;
+    }
+    const SequenceNumber seq = VisibleSequence(*f, snapshot);
+    if (seq == 0) {
+      return 0;
+    }
+    result = std::min(result, seq);
+    if (user_comparator_->Compare(last, f->end) < 0) {
+      return result;
+    }
+  }
+  return 0;
+}
+
+void FragmentedRangeTombstoneList::GetClipped(
+    const std::string_view* begin, const std::string_view* end,
+    std::vector<RangeTombstone>* result) const {
+  std::vector<RangeTombstone> clipped;
+  for (const auto& f : fragments_) {
+    std::string_view lo = f.start;
+    std::string_view hi = f.end;
+    if (begin != nullptr && user_comparator_->Compare(lo, *begin) < 0) {
+      lo = *begin;
+    }
+    if (end != nullptr && user_comparator_->Compare(hi, *end) > 0) {
+      hi = *end;
+    }
+    if (user_comparator_->Compare(lo, hi) >= 0) {
+      continue;
+    }
+    for (size_t i = f.seq_begin; i < f.seq_end; ++i) {
+      clipped.emplace_back(lo, hi, seqs_[i]);
+    }
+  }
+  // 片段是按照start有序的，稳定排序之后同一个序号首尾相连的片段相邻
+  std::stable_sort(clipped.begin(), clipped.end(),
+                   [](const RangeTombstone& a, const RangeTombstone& b) {
+                     return a.seq > b.seq;
+                   });
+  for (auto& t : clipped) {
+    if (!result->empty() && result->back().seq == t.seq &&
+        user_comparator_->Compare(result->back().end, t.start) == 0) {
+      result->back().end.swap(t.end);
+    } else {
+      result->push_back(std::move(t));
+    }
+  }
+}
+}  // namespace corekv
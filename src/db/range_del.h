@@ -0,0 +1,93 @@
+#ifndef DB_RANGE_DEL_H_
+#define DB_RANGE_DEL_H_
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "comparator.h"
+#include "dbformat.h"
+
+namespace corekv {
+/*
+ * DeleteRange写入的range tombstone，删除[start, end)中序号小于seq的所有版本
+ *
+ * memtable中的tombstone单独保存，不进入rep；sst中保存在meta block中key为
+ * kRangeDelMetaKey的block里，格式为 internal key(start, seq, kTypeRangeDeletion) -> end
+ */
+struct RangeTombstone {
+  std::string start;
+  std::string end;
+  SequenceNumber seq = 0;
+
+  RangeTombstone() = default;
+  RangeTombstone(const std::string_view& s, const std::string_view& e,
+                 SequenceNumber sequence)
+      : start(s), end(e), seq(sequence) {}
+
+  // 写入sst时使用的key
+  std::string InternalStartKey() const;
+  // 作为sst的largest，排在end的所有版本之前，end本身不被覆盖
+  std::string InternalEndKey() const;
+  // 从sst的range tombstone block中解析，格式错误的时候返回false
+  static bool Decode(const std::string_view& internal_start_key,
+                     const std::string_view& end, RangeTombstone* tombstone);
+};
+
+// 扩大sst的边界[*smallest, *largest]使它包含tombstone覆盖的范围，
+// 边界为空表示sst中还没有数据，icmp是internal key的比较器
+void ExtendFileBounds(const RangeTombstone& tombstone, Comparator* icmp,
+                      std::string* smallest, std::string* largest);
+
+// 把可能互相重叠的tombstone切分成互不重叠的片段，每个片段记录覆盖它的所有序号，
+// 查询某个key被哪些tombstone覆盖只需要二分找到一个片段；构造之后只读，可以多线程共享
+class FragmentedRangeTombstoneList final {
+ public:
+  FragmentedRangeTombstoneList(std::vector<RangeTombstone> tombstones,
+                               Comparator* user_comparator);
+  FragmentedRangeTombstoneList(const FragmentedRangeTombstoneList&) = delete;
+  FragmentedRangeTombstoneList& operator=(const FragmentedRangeTombstoneList&) =
+      delete;
+
+  bool empty() const { return fragments_.empty(); }
+  // 覆盖user_key并且序号不大于snapshot的tombstone中最大的序号，没有的时候返回0；
+  // 序号比它小的版本都已经被删除了
+  SequenceNumber MaxCoveringSequence(const std::string_view& user_key,
+                                     SequenceNumber snapshot) const;
+  // [first, last]中的每一个key都被序号不大于snapshot的tombstone覆盖时，返回所有key
+  // 的MaxCoveringSequence中最小的一个，也就是序号比它小的版本全部被删除了；
+  // 有没被覆盖的key时返回0
+  SequenceNumber MinCoveringSequence(const std::string_view& first,
+                                     const std::string_view& last,
+                                     SequenceNumber snapshot) const;
+  // 落在[begin, end)中的部分裁剪之后追加到result中，begin/end为nullptr表示不限制；
+  // 同一个序号首尾相连的片段会重新合并成一个tombstone
+  void GetClipped(const std::string_view* begin, const std::string_view* end,
+                  std::vector<RangeTombstone>* result) const;
+  // 构造时传入的原始tombstone
+  const std::vector<RangeTombstone>& tombstones() const { return tombstones_; }
+
+ private:
+  struct Fragment {
+    std::string start;
+    std::string end;
+    // 覆盖这个片段的序号在seqs_中的范围[seq_begin, seq_end)，从大到小排列
+    size_t seq_begin;
+    size_t seq_end;
+  };
+
+  // 包含user_key的片段，没有的时候返回nullptr
+  const Fragment* FindFragment(const std::string_view& user_key) const;
+  // 覆盖fragment并且序号不大于snapshot的最大序号，没有的时候返回0
+  SequenceNumber VisibleSequence(const Fragment& fragment,
+                                 SequenceNumber snapshot) const;
+
+  Comparator* const user_comparator_;
+  const std::vector<RangeTombstone> tombstones_;
+  // 按照start排序，相邻片段之间没有重叠
+  std::vector<Fragment> fragments_;
+  std::vector<SequenceNumber> seqs_;
+};
+}  // namespace corekv
+#endif
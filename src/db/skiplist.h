@@ -5,7 +5,10 @@
 #include <stdint.h>
 
 #include <atomic>
+#include <functional>
 #include <new>
+#include <thread>
+#include <utility>
 #include <iostream>
 #include <cstdio>
 
@@ -13,6 +16,13 @@
 #include "logger/log.h"
 #include "logger/log_level.h"
 #include "utils/random_util.h"
+
+// 提前把下一个要访问的节点读进cache，遍历skiplist的时候每一跳都是一次cache miss
+#if defined(__GNUC__) || defined(__clang__)
+#define SKIPLIST_PREFETCH(addr) __builtin_prefetch(addr, 0, 1)
+#else
+#define SKIPLIST_PREFETCH(addr)
+#endif
 /*
  * SkipList 属于 leveldb 中的核心数据结构，也是 memory table 的具体实现
  *
@@ -38,15 +48,21 @@ class SkipList final {
   struct Node;
 
  public:
-  SkipList(_KeyComparator comparator  );
+  class Iterator;
+  // 额外的参数原样转发给_Allocator的构造函数，例如arena的block大小
+  template <typename... _AllocatorArgs>
+  SkipList(_KeyComparator comparator, _AllocatorArgs&&... allocator_args);
 
   SkipList(const SkipList&) = delete;
   SkipList& operator=(const SkipList&) = delete;
+  // 设置Insert生成节点高度用的随机种子，相同的种子和插入顺序得到相同的结构，
+  // 需要在插入之前调用
+  void Seed(uint64_t seed) { rnd_ = RandomUtil(seed); }
   void Insert(const _KeyType& key) {
     // 该对象记录的是要节点要插入位置的前一个对象，本质是链表的插入
     Node* prev[SkipListOption::kMaxHeight] = {nullptr};
     //在key的构造过程中，有一个持续递增的序号，因此理论上不会有重复的key
-    Node* node = FindGreaterOrEqual(key, prev);
+    Node* node = FindGreaterOrEqualWithHint(key, prev);
     if (nullptr != node) {
       if (Equal(key, node->key)) {
         LOG(WARN, "key:%s has existed", key);
@@ -54,7 +70,7 @@ class SkipList final {
       }
     }
 
-    int32_t new_level = RandomHeight();
+    int32_t new_level = RandomHeight(&rnd_);
     int32_t cur_max_level = GetMaxHeight();
     if (new_level > cur_max_level) {
       //因为skiplist存在多层，而刚开始的时候只是分配kMaxHeight个空间，每一层的next并没有真正使用
@@ -71,6 +87,57 @@ class SkipList final {
       //那么 Thread-1 在store()之前对内存的所有写入操作，此时对 Thread-2 来说，都是可见的。
       prev[index]->SetNext(index, new_node);
     }
+    // 新节点是后面更大的key在低层的前驱，高层的前驱不变
+    for (int32_t index = 0; index < new_level; ++index) {
+      hint_[index] = new_node;
+    }
+    for (int32_t index = new_level; index < GetMaxHeight(); ++index) {
+      hint_[index] = prev[index];
+    }
+  }
+  // 插入一段已经按照comparator排好序的key，每个key都紧跟在上一个后面，
+  // 查找位置的时候都能用上hint_，要求和Insert相同
+  void InsertBatch(const _KeyType* keys, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      Insert(keys[i]);
+    }
+  }
+  // 支持多个写线程同时插入，每一层都通过CAS来挂载节点，读线程依然是无锁的
+  // 要求: _Allocator::Allocate是线程安全的
+  void InsertConcurrently(const _KeyType& key) {
+    Node* prev[SkipListOption::kMaxHeight];
+    Node* next[SkipListOption::kMaxHeight];
+    // rnd_只给单线程的Insert使用，并发插入时每个线程使用自己的生成器
+    thread_local RandomUtil thread_rnd(
+        std::hash<std::thread::id>()(std::this_thread::get_id()));
+    int32_t new_level = RandomHeight(&thread_rnd);
+    // 通过CAS来更新当前的最大高度，失败的话说明其他线程已经更新过了
+    int32_t cur_max_level = GetMaxHeight();
+    while (new_level > cur_max_level) {
+      if (cur_height_.compare_exchange_weak(cur_max_level, new_level,
+                                            std::memory_order_relaxed)) {
+        cur_max_level = new_level;
+        break;
+      }
+    }
+    // 从最高层往下，依次找到每一层的前驱和后继
+    Node* before = head_;
+    for (int32_t level = cur_max_level - 1; level >= 0; --level) {
+      FindSpliceForLevel(key, before, level, &prev[level], &next[level]);
+      before = prev[level];
+    }
+    Node* new_node = NewNode(key, new_level);
+    for (int32_t index = 0; index < new_level; ++index) {
+      while (true) {
+        new_node->NoBarrier_SetNext(index, next[index]);
+        if (prev[index]->CASNext(index, next[index], new_node)) {
+          break;
+        }
+        // CAS失败说明有其他线程在prev和next之间插入了节点，从prev开始重新查找该层
+        FindSpliceForLevel(key, prev[index], index, &prev[index],
+                           &next[index]);
+      }
+    }
   }
   bool Contains(const _KeyType& key) {
     Node* node = FindGreaterOrEqual(key, nullptr);
@@ -80,14 +147,18 @@ class SkipList final {
     return comparator_.Compare(a, b) == 0;
   }
 
+  // 节点和key都从同一个allocator中分配，方便统一统计内存
+  _Allocator& GetAllocator() { return arena_; }
+
  private:
   Node* NewNode(const _KeyType& key, int32_t height);
-  int32_t RandomHeight();
+  int32_t RandomHeight(RandomUtil* rnd);
   int32_t GetMaxHeight() {
     return cur_height_.load(std::memory_order_relaxed);
   }
+  // key比n大，说明还需要继续往后查找
   bool KeyIsAfterNode(const _KeyType& key, Node* n) {
-    return (nullptr != n && comparator_.Compare(key, n->key) < 0);
+    return (nullptr != n && comparator_.Compare(n->key, key) < 0);
   }
   //找到一个大于等于key的node
   Node* FindGreaterOrEqual(const _KeyType& key, Node** prev) {
@@ -98,6 +169,9 @@ class SkipList final {
     while (true) {
       // 根据跳表原理，他是从最上层开始，向左或者向下遍历
       Node* next = cur->Next(level);
+      if (nullptr != next) {
+        SKIPLIST_PREFETCH(next->Next(level));
+      }
       // 说明key比next要大，直接往后next即可
       if (KeyIsAfterNode(key, next)) {
         cur = next;
@@ -113,6 +187,44 @@ class SkipList final {
       }
     }
   }
+  // 和FindGreaterOrEqual相同，但是先检查上一次Insert的前驱hint_[level]在这一层是否
+  // 仍然满足 hint < key <= next，满足的话直接使用，不满足再从上一层的前驱开始查找；
+  // key单调递增的时候每一层只需要一次比较
+  Node* FindGreaterOrEqualWithHint(const _KeyType& key, Node** prev) {
+    // hint_[0]是上一次插入的节点，其他层的hint都不大于它，key更小的时候hint都不能用
+    const bool use_hint = hint_[0] == head_ || KeyIsAfterNode(key, hint_[0]);
+    if (!use_hint) {
+      return FindGreaterOrEqual(key, prev);
+    }
+    Node* before = head_;
+    Node* next = nullptr;
+    for (int32_t level = GetMaxHeight() - 1; level >= 0; --level) {
+      next = hint_[level]->Next(level);
+      if (!KeyIsAfterNode(key, next)) {
+        prev[level] = hint_[level];
+      } else {
+        FindSpliceForLevel(key, before, level, &prev[level], &next);
+      }
+      before = prev[level];
+    }
+    return next;
+  }
+  // 从before开始，在level层找到满足 prev < key <= next 的位置
+  void FindSpliceForLevel(const _KeyType& key, Node* before, int32_t level,
+                          Node** out_prev, Node** out_next) {
+    while (true) {
+      Node* next = before->Next(level);
+      if (nullptr != next) {
+        SKIPLIST_PREFETCH(next->Next(level));
+      }
+      if (!KeyIsAfterNode(key, next)) {
+        *out_prev = before;
+        *out_next = next;
+        return;
+      }
+      before = next;
+    }
+  }
   // 找到小于key中最大的key
   Node* FindLessThan(const _KeyType& key) {
     Node* cur = head_;
@@ -152,6 +264,8 @@ class SkipList final {
   std::atomic<int32_t> cur_height_;  //当前有效的层数
   _Allocator arena_;  //内存管理对象
   RandomUtil rnd_;
+  // 上一次Insert时每一层的前驱，只有单线程的Insert读写
+  Node* hint_[SkipListOption::kMaxHeight];
 };
 
 /*
@@ -203,6 +317,13 @@ struct SkipList<_KeyType, _KeyComparator, _Allocator>::Node {
   void NoBarrier_SetNext(int n, Node* x) {
     next_[n].store(x, std::memory_order_relaxed);
   }
+  // 成功的时候带release语义，保证节点内容对读线程可见
+  bool CASNext(int n, Node* expected, Node* x) {
+    assert(n >= 0);
+    return next_[n].compare_exchange_strong(expected, x,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed);
+  }
 
  private:
   // 这里提前声明并申请了一个内存，用于存储第 0 层的数据，因为第 0 层必然存在数据。
@@ -210,15 +331,61 @@ struct SkipList<_KeyType, _KeyComparator, _Allocator>::Node {
 };
 
 template <typename _KeyType, class _Comparator, typename _Allocator>
-SkipList<_KeyType, _Comparator, _Allocator>::SkipList(_Comparator cmp) {
+template <typename... _AllocatorArgs>
+SkipList<_KeyType, _Comparator, _Allocator>::SkipList(
+    _Comparator cmp, _AllocatorArgs&&... allocator_args)
+    : comparator_(cmp),
+      arena_(std::forward<_AllocatorArgs>(allocator_args)...) {
   cur_height_ = 1;
-  comparator_ =cmp;
   head_ = NewNode(0, SkipListOption::kMaxHeight);
-  for (int i = 0; i < cur_height_; i++) {
+  // 头节点的每一层都需要初始化，后续层数增长时会直接读取
+  for (int i = 0; i < SkipListOption::kMaxHeight; i++) {
     head_->SetNext(i, nullptr);
+    hint_[i] = head_;
   }
 }
 
+// 迭代器只依赖acquire语义的Next，不需要加锁，可以和写线程并发执行
+template <typename _KeyType, class _Comparator, typename _Allocator>
+class SkipList<_KeyType, _Comparator, _Allocator>::Iterator {
+ public:
+  explicit Iterator(SkipList* list) : list_(list), node_(nullptr) {}
+
+  bool Valid() const { return node_ != nullptr; }
+
+  const _KeyType& key() const {
+    assert(Valid());
+    return node_->key;
+  }
+
+  void Next() {
+    assert(Valid());
+    node_ = node_->Next(0);
+  }
+  // 没有前向指针，只能重新从头开始查找
+  void Prev() {
+    assert(Valid());
+    node_ = list_->FindLessThan(node_->key);
+    if (node_ == list_->head_) {
+      node_ = nullptr;
+    }
+  }
+  void Seek(const _KeyType& target) {
+    node_ = list_->FindGreaterOrEqual(target, nullptr);
+  }
+  void SeekToFirst() { node_ = list_->head_->Next(0); }
+  void SeekToLast() {
+    node_ = list_->FindLast();
+    if (node_ == list_->head_) {
+      node_ = nullptr;
+    }
+  }
+
+ private:
+  SkipList* list_;
+  Node* node_;
+};
+
 
 
 template <typename _KeyType, typename _Comparator, typename _Allocator>
@@ -232,10 +399,11 @@ SkipList<_KeyType, _Comparator, _Allocator>::NewNode(const _KeyType& key,
 }
 
 template <typename _KeyType, typename _Comparator, typename _Allocator>
-int32_t SkipList<_KeyType, _Comparator, _Allocator>::RandomHeight() {
+int32_t SkipList<_KeyType, _Comparator, _Allocator>::RandomHeight(
+    RandomUtil* rnd) {
   int32_t height = 1;
   while (height < SkipListOption::kMaxHeight &&
-         ((rnd_.GetSimpleRandomNum() % SkipListOption::kBranching) == 0)) {
+         ((rnd->GetSimpleRandomNum() % SkipListOption::kBranching) == 0)) {
     height++;
   }
   return height;
@@ -0,0 +1,73 @@
+#ifndef DB_SNAPSHOT_H_
+#define DB_SNAPSHOT_H_
+#include <vector>
+
+#include "db.h"
+#include "dbformat.h"
+
+namespace corekv {
+class SnapshotList;
+
+// 快照只是一个序号，读取的时候忽略序号比它大的entry
+class SnapshotImpl final : public Snapshot {
+ public:
+  explicit SnapshotImpl(SequenceNumber sequence_number)
+      : sequence_number_(sequence_number) {}
+
+  uint64_t sequence_number() const override { return sequence_number_; }
+
+ private:
+  friend class SnapshotList;
+
+  const SequenceNumber sequence_number_;
+  // 按照创建顺序组成的双向循环链表，序号单调不减
+  SnapshotImpl* prev_ = nullptr;
+  SnapshotImpl* next_ = nullptr;
+};
+
+// 所有还没有释放的快照，由DBImpl::mutex_保护
+class SnapshotList final {
+ public:
+  SnapshotList() : head_(0) {
+    head_.prev_ = &head_;
+    head_.next_ = &head_;
+  }
+  SnapshotList(const SnapshotList&) = delete;
+  SnapshotList& operator=(const SnapshotList&) = delete;
+
+  bool empty() const { return head_.next_ == &head_; }
+  SnapshotImpl* oldest() const { return head_.next_; }
+  SnapshotImpl* newest() const { return head_.prev_; }
+
+  // 序号不能比newest()小
+  SnapshotImpl* New(SequenceNumber sequence_number) {
+    auto* snapshot = new SnapshotImpl(sequence_number);
+    snapshot->next_ = &head_;
+    snapshot->prev_ = head_.prev_;
+    snapshot->prev_->next_ = snapshot;
+    snapshot->next_->prev_ = snapshot;
+    return snapshot;
+  }
+
+  void Delete(const SnapshotImpl* snapshot) {
+    snapshot->prev_->next_ = snapshot->next_;
+    snapshot->next_->prev_ = snapshot->prev_;
+    delete snapshot;
+  }
+
+  // 按照从旧到新的顺序返回所有快照的序号，相同的序号只返回一次
+  void GetAll(std::vector<SequenceNumber>* sequences) const {
+    sequences->clear();
+    for (const SnapshotImpl* s = head_.next_; s != &head_; s = s->next_) {
+      if (sequences->empty() || sequences->back() != s->sequence_number_) {
+        sequences->push_back(s->sequence_number_);
+      }
+    }
+  }
+
+ private:
+  // 链表的哨兵节点
+  SnapshotImpl head_;
+};
+}  // namespace corekv
+#endif
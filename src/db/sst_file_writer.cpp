@@ -0,0 +1,93 @@
+#include "sst_file_writer.h"
+
+#include "../file/file.h"
+#include "../table/table_builder.h"
+#include "../utils/util.h"
+#include "comparator.h"
+#include "dbformat.h"
+
+namespace corekv {
+SstFileWriter::SstFileWriter(const Options& options)
+    : user_comparator_(options.comparator ? options.comparator
+                                          : std::make_shared<ByteComparator>()),
+      internal_comparator_(
+          std::make_shared<InternalKeyComparator>(user_comparator_.get())),
+      options_(options) {
+  options_.comparator = internal_comparator_;
+  if (options.filter_policy) {
+    options_.filter_policy = std::make_shared<InternalFilterPolicy>(
+        options.filter_policy, options.prefix_extractor);
+  }
+  // 离线生成的sst不需要限速，也不经过block_cache
+  options_.rate_limiter = nullptr;
+  options_.block_cache = nullptr;
+}
+
+SstFileWriter::~SstFileWriter() = default;
+
+DBStatus SstFileWriter::Open(const std::string& path) {
+  if (file_) {
+    return Status::kInvalidArgument;
+  }
+  path_ = path;
+  file_ = std::make_unique<FileWriter>(path);
+  builder_ = std::make_unique<TableBuilder>(options_, file_.get());
+  builder_->SetCreationTime(util::GetCurrentTime());
+  last_key_.clear();
+  num_entries_ = 0;
+  return Status::kSuccess;
+}
+
+DBStatus SstFileWriter::Put(const std::string_view& key,
+                            const std::string_view& value) {
+  return Add(key, value, false);
+}
+
+DBStatus SstFileWriter::Delete(const std::string_view& key) {
+  return Add(key, std::string_view(), true);
+}
+
+DBStatus SstFileWriter::Add(const std::string_view& key,
+                            const std::string_view& value, bool deletion) {
+  if (!builder_) {
+    return Status::kInvalidArgument;
+  }
+  if (num_entries_ > 0 && user_comparator_->Compare(key, last_key_) <= 0) {
+    return Status::kInvalidArgument;
+  }
+  last_key_.assign(key.data(), key.size());
+  std::string ikey;
+  AppendInternalKey(&ikey, ParsedInternalKey(
+                               key, 0, deletion ? kTypeDeletion : kTypeValue));
+  builder_->Add(ikey, value);
+  ++num_entries_;
+  return builder_->Success() ? Status::kSuccess : Status::kWriteFileFailed;
+}
+
+DBStatus SstFileWriter::Finish(uint64_t* file_size) {
+  if (!builder_) {
+    return Status::kInvalidArgument;
+  }
+  DBStatus s = Status::kSuccess;
+  if (num_entries_ == 0) {
+    s = Status::kInvalidArgument;
+  } else {
+    builder_->Finish();
+    if (!builder_->Success()) {
+      s = Status::kWriteFileFailed;
+    } else {
+      if (file_size != nullptr) {
+        *file_size = builder_->GetFileSize();
+      }
+      s = file_->Sync();
+    }
+  }
+  builder_.reset();
+  file_->Close();
+  file_.reset();
+  if (s != Status::kSuccess) {
+    FileTool::RemoveFile(path_);
+  }
+  return s;
+}
+}  // namespace corekv
@@ -0,0 +1,54 @@
+#ifndef DB_SST_FILE_WRITER_H_
+#define DB_SST_FILE_WRITER_H_
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "options.h"
+#include "status.h"
+
+namespace corekv {
+class Comparator;
+class FileWriter;
+class InternalKeyComparator;
+class TableBuilder;
+/*
+ * 离线生成sst，之后通过DB::IngestExternalFile直接链接到db中，不经过WAL和memtable
+ *
+ * key需要按照options.comparator严格递增，文件中所有key的序号都是0，
+ * 导入的时候由db分配一个统一的序号；options需要和打开db时的comparator、
+ * filter_policy以及prefix_extractor一致，否则导入之后filter不会生效
+ */
+class SstFileWriter final {
+ public:
+  explicit SstFileWriter(const Options& options);
+  SstFileWriter(const SstFileWriter&) = delete;
+  SstFileWriter& operator=(const SstFileWriter&) = delete;
+  ~SstFileWriter();
+
+  DBStatus Open(const std::string& path);
+  // key不比上一个key大的时候返回Status::kInvalidArgument
+  DBStatus Put(const std::string_view& key, const std::string_view& value);
+  // 导入之后会覆盖db中已有的同名key
+  DBStatus Delete(const std::string_view& key);
+  // 没有写入任何key的时候返回Status::kInvalidArgument，并删除文件
+  DBStatus Finish(uint64_t* file_size = nullptr);
+
+ private:
+  DBStatus Add(const std::string_view& key, const std::string_view& value,
+               bool deletion);
+
+  std::shared_ptr<Comparator> user_comparator_;
+  std::shared_ptr<InternalKeyComparator> internal_comparator_;
+  // comparator和filter_policy都是处理internal key的
+  Options options_;
+  std::string path_;
+  std::unique_ptr<FileWriter> file_;
+  std::unique_ptr<TableBuilder> builder_;
+  std::string last_key_;
+  uint64_t num_entries_ = 0;
+};
+}  // namespace corekv
+#endif
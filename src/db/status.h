@@ -20,6 +20,13 @@ struct Status {
   static constexpr DBStatus kWriteFileFailed = {1004, "WriteFile Failed"};
   static constexpr DBStatus kReadFileFailed = {1005, "ReadFile Failed"};
   static constexpr DBStatus kInvalidObject = {1006, "Invalid Object"};
+  static constexpr DBStatus kCorruption = {1007, "Corruption"};
+  static constexpr DBStatus kInvalidArgument = {1008, "Invalid Argument"};
+  static constexpr DBStatus kNotSupported = {1009, "Not Supported"};
+  // 只在读取的内部流程中使用，表示遇到了merge操作数，需要和更旧的版本一起合并
+  static constexpr DBStatus kMergeInProgress = {1010, "Merge In Progress"};
+  // ReadOptions::cache_only为true并且需要读文件才能得到结果
+  static constexpr DBStatus kIncomplete = {1011, "Incomplete"};
 };
 
 }  // namespace corekv
@@ -0,0 +1,506 @@
+#include "table_cache.h"
+
+#include <algorithm>
+
+#include "../file/file.h"
+#include "../file/file_name.h"
+#include "../table/table.h"
+#include "../utils/codec.h"
+#include "../utils/statistics.h"
+#include "dbformat.h"
+#include "prefix_extractor.h"
+namespace corekv {
+struct TableCache::TableAndFile {
+  std::unique_ptr<FileReader> file;
+  std::unique_ptr<Table> table;
+  // 打开的时候就切分好，table中没有range tombstone的时候为空
+  std::shared_ptr<const FragmentedRangeTombstoneList> range_del;
+};
+
+TableCache::TableCache(const std::string& dbname, const Options* options)
+    : dbname_(dbname),
+      options_(options),
+      compaction_options_(*options),
+      cache_(std::make_unique<ShardCache<uint64_t, TableHandle>>(
+          std::max(options->max_open_files, 1))) {
+  cache_->RegistCleanHandle(
+      [](const uint64_t&, TableHandle* handle) { delete handle; });
+  // compaction只读一遍输入，读到的block不放进block_cache
+  compaction_options_.block_cache = nullptr;
+  if (options_->row_cache != nullptr) {
+    row_cache_id_ = options_->row_cache->NewId();
+    options_->row_cache->RegistCleanHandle(
+        [](const std::string&, std::string* row) { delete row; });
+  }
+}
+
+TableCache::~TableCache() = default;
+
+DBStatus TableCache::FindTable(uint64_t file_number, uint64_t file_size,
+                               TableHandle* handle, bool cache_only) {
+  auto* node = cache_->Get(file_number);
+  if (node != nullptr) {
+    *handle = *node->value;
+    cache_->Release(node);
+    return Status::kSuccess;
+  }
+  if (cache_only) {
+    return Status::kIncomplete;
+  }
+  // 打开文件的时候不持有锁，两个线程同时打开同一个sst时以后插入的为准
+  DBStatus s = OpenTable(file_number, file_size, false, handle);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  // 打开失败的sst不会被缓存，下次访问的时候重新打开
+  cache_->Insert(file_number, new TableHandle(*handle));
+  return Status::kSuccess;
+}
+
+DBStatus TableCache::OpenTable(uint64_t file_number, uint64_t file_size,
+                               bool for_compaction, TableHandle* handle) {
+  auto table_and_file = std::make_shared<TableAndFile>();
+  const std::string& fname = FileName::TableFileName(dbname_, file_number);
+  table_and_file->file =
+      for_compaction ? std::make_unique<FileReader>(fname, false, true)
+                     : std::make_unique<FileReader>(fname,
+                                                    options_->use_mmap_reads);
+  if (!table_and_file->file->IsOpen()) {
+    return Status::kReadFileFailed;
+  }
+  table_and_file->table = std::make_unique<Table>(
+      for_compaction ? &compaction_options_ : options_,
+      table_and_file->file.get());
+  DBStatus s = table_and_file->table->Open(file_size);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  if (!table_and_file->table->range_tombstones().empty()) {
+    auto* icmp = static_cast<InternalKeyComparator*>(options_->comparator.get());
+    table_and_file->range_del = std::make_shared<FragmentedRangeTombstoneList>(
+        table_and_file->table->range_tombstones(), icmp->user_comparator());
+  }
+  *handle = std::move(table_and_file);
+  return Status::kSuccess;
+}
+
+static void ReleaseTable(void* arg1, void*) {
+  delete reinterpret_cast<std::shared_ptr<void>*>(arg1);
+}
+
+namespace {
+// prefix_same_as_start时包装sst的迭代器: Seek之前先用filter检查目标的前缀，
+// 不存在的时候直接变成无效，不读取任何data block
+class PrefixSeekIterator final : public Iterator {
+ public:
+  PrefixSeekIterator(const ReadOptions& options,
+                     const PrefixExtractor* prefix_extractor,
+                     const Table* table, Iterator* iter)
+      : options_(options),
+        prefix_extractor_(prefix_extractor),
+        table_(table),
+        iter_(iter) {}
+  bool Valid() const override { return !filtered_ && iter_->Valid(); }
+  void SeekToFirst() override {
+    filtered_ = false;
+    iter_->SeekToFirst();
+  }
+  void SeekToLast() override {
+    filtered_ = false;
+    iter_->SeekToLast();
+  }
+  void Seek(const std::string_view& target) override {
+    const std::string_view& user_key = ExtractUserKey(target);
+    if (prefix_extractor_->InDomain(user_key)) {
+      LookupKey prefix_key(prefix_extractor_->Transform(user_key),
+                           kMaxSequenceNumber);
+      filtered_ = !table_->FilterMayMatch(options_, prefix_key.internal_key());
+      if (filtered_) {
+        return;
+      }
+    }
+    filtered_ = false;
+    iter_->Seek(target);
+  }
+  void Next() override {
+    assert(Valid());
+    iter_->Next();
+  }
+  void Prev() override {
+    assert(Valid());
+    iter_->Prev();
+  }
+  std::string_view key() const override { return iter_->key(); }
+  std::string_view value() const override { return iter_->value(); }
+  DBStatus status() const override { return iter_->status(); }
+
+ private:
+  const ReadOptions options_;
+  const PrefixExtractor* const prefix_extractor_;
+  const Table* const table_;
+  std::unique_ptr<Iterator> iter_;
+  bool filtered_ = false;
+};
+
+// 把key的序号替换成global_seqno，类型保持不变
+void ReplaceSequence(const std::string_view& ikey, SequenceNumber global_seqno,
+                     std::string* result) {
+  result->assign(ikey.data(), ikey.size() - kInternalKeyTailSize);
+  const uint64_t tag = util::DecodeFixed64(ikey.data() + result->size());
+  util::PutFixed64(result, PackSequenceAndType(global_seqno,
+                                         static_cast<ValueType>(tag & 0xff)));
+}
+
+// 外部导入的sst中每个user_key只有一个序号为0的版本，替换序号之后相对顺序不变
+class GlobalSeqnoIterator final : public Iterator {
+ public:
+  GlobalSeqnoIterator(Comparator* icmp, SequenceNumber global_seqno,
+                      Iterator* iter)
+      : icmp_(icmp), global_seqno_(global_seqno), iter_(iter) {}
+  bool Valid() const override { return iter_->Valid(); }
+  void SeekToFirst() override {
+    iter_->SeekToFirst();
+    UpdateKey();
+  }
+  void SeekToLast() override {
+    iter_->SeekToLast();
+    UpdateKey();
+  }
+  void Seek(const std::string_view& target) override {
+    // 先定位到第一个user_key不小于目标的entry，替换序号之后比目标小的话再往后一个
+    LookupKey lookup(ExtractUserKey(target), kMaxSequenceNumber);
+    iter_->Seek(lookup.internal_key());
+    UpdateKey();
+    if (Valid() && icmp_->Compare(key_, target) < 0) {
+      Next();
+    }
+  }
+  void Next() override {
+    assert(Valid());
+    iter_->Next();
+    UpdateKey();
+  }
+  void Prev() override {
+    assert(Valid());
+    iter_->Prev();
+    UpdateKey();
+  }
+  std::string_view key() const override { return key_; }
+  std::string_view value() const override { return iter_->value(); }
+  DBStatus status() const override { return iter_->status(); }
+
+ private:
+  void UpdateKey() {
+    if (iter_->Valid()) {
+      ReplaceSequence(iter_->key(), global_seqno_, &key_);
+    }
+  }
+
+  Comparator* const icmp_;
+  const SequenceNumber global_seqno_;
+  std::unique_ptr<Iterator> iter_;
+  std::string key_;
+};
+
+// 点查的时候包装调用方的回调，替换序号之后再交给调用方
+struct GlobalSeqnoSaver {
+  SequenceNumber global_seqno;
+  // 查找的key的序号，也就是读取的快照
+  SequenceNumber snapshot;
+  void* arg;
+  void (*handle_result)(void*, const std::string_view&,
+                        const std::string_view&);
+};
+
+void SaveWithGlobalSeqno(void* arg, const std::string_view& k,
+                         const std::string_view& v) {
+  auto* saver = reinterpret_cast<GlobalSeqnoSaver*>(arg);
+  // 快照早于导入的时候这个sst中的数据不可见
+  if (k.size() < kInternalKeyTailSize || saver->global_seqno > saver->snapshot) {
+    return;
+  }
+  std::string key;
+  ReplaceSequence(k, saver->global_seqno, &key);
+  saver->handle_result(saver->arg, key, v);
+}
+
+GlobalSeqnoSaver MakeSaver(SequenceNumber global_seqno,
+                           const std::string_view& k, void* arg,
+                           void (*handle_result)(void*, const std::string_view&,
+                                                 const std::string_view&)) {
+  const uint64_t tag =
+      util::DecodeFixed64(k.data() + k.size() - kInternalKeyTailSize);
+  return {global_seqno, tag >> 8, arg, handle_result};
+}
+
+/*
+ * row_cache的key为 row_cache_id(fixed64) + 文件编号(fixed64) + user_key，
+ * value为 [kRowFound][internal key长度(varint32)][internal key][value]，
+ * 是sst中这个user_key最新的版本；sst中没有这个user_key的时候只有一个kRowNotFound。
+ * sst被删除之后文件编号不会再被使用，残留的entry由row_cache自己淘汰
+ */
+constexpr char kRowNotFound = 0;
+constexpr char kRowFound = 1;
+
+// 查找user_key最新的版本时使用，只记录user_key相同的entry
+struct RowSaver {
+  Comparator* ucmp;
+  std::string_view user_key;
+  std::string* row;
+};
+
+void SaveRow(void* arg, const std::string_view& k, const std::string_view& v) {
+  auto* saver = reinterpret_cast<RowSaver*>(arg);
+  // 格式错误的key也原样保存，交给调用方的回调报告
+  if (k.size() >= kInternalKeyTailSize &&
+      saver->ucmp->Compare(ExtractUserKey(k), saver->user_key) != 0) {
+    return;
+  }
+  saver->row->assign(1, kRowFound);
+  util::PutVarint32(saver->row, k.size());
+  saver->row->append(k.data(), k.size());
+  saver->row->append(v.data(), v.size());
+}
+
+// 用缓存的最新版本回答快照为snapshot的查找，这个版本对快照不可见的时候返回false；
+// 可见的时候它就是sst中第一个大于等于查找key的entry，和直接查找的结果相同
+bool ReplayRow(const std::string& row, SequenceNumber snapshot,
+               void (*handle_result)(void*, const std::string_view&,
+                                     const std::string_view&),
+               void* arg) {
+  if (row.empty() || row[0] == kRowNotFound) {
+    return true;
+  }
+  const char* limit = row.data() + row.size();
+  uint32_t key_size;
+  const char* p = util::GetVarint32Ptr(row.data() + 1, limit, &key_size);
+  if (p == nullptr || static_cast<size_t>(limit - p) < key_size) {
+    return false;
+  }
+  const std::string_view ikey(p, key_size);
+  if (ikey.size() >= kInternalKeyTailSize &&
+      (util::DecodeFixed64(ikey.data() + ikey.size() - kInternalKeyTailSize) >>
+       8) > snapshot) {
+    return false;
+  }
+  (*handle_result)(arg, ikey,
+                   std::string_view(p + key_size, limit - p - key_size));
+  return true;
+}
+}  // namespace
+
+Iterator* TableCache::NewIterator(const ReadOptions& options,
+                                  uint64_t file_number, uint64_t file_size,
+                                  SequenceNumber global_seqno) {
+  TableHandle handle;
+  // compaction的输入单独用O_DIRECT打开，不经过page cache，也不放进TableCache
+  DBStatus s =
+      options.for_compaction && options_->use_direct_reads_for_compaction
+          ? OpenTable(file_number, file_size, true, &handle)
+          : FindTable(file_number, file_size, &handle, options.cache_only);
+  if (s != Status::kSuccess) {
+    return NewErrorIterator(s);
+  }
+  Iterator* result = handle->table->NewIterator(options);
+  if (options.prefix_same_as_start && options_->prefix_extractor) {
+    result = new PrefixSeekIterator(options, options_->prefix_extractor.get(),
+                                    handle->table.get(), result);
+  }
+  if (global_seqno != 0) {
+    result = new GlobalSeqnoIterator(options_->comparator.get(), global_seqno,
+                                     result);
+  }
+  // 迭代器释放的时候才释放对table的引用
+  result->RegisterCleanup(&ReleaseTable, new std::shared_ptr<void>(handle),
+                          nullptr);
+  return result;
+}
+
+DBStatus TableCache::Get(const ReadOptions& options, uint64_t file_number,
+                         uint64_t file_size, SequenceNumber global_seqno,
+                         const std::string_view& k, void* arg,
+                         void (*handle_result)(void*, const std::string_view&,
+                                               const std::string_view&)) {
+  TableHandle handle;
+  DBStatus s = FindTable(file_number, file_size, &handle, options.cache_only);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  if (options_->row_cache != nullptr && k.size() >= kInternalKeyTailSize) {
+    bool served = false;
+    s = GetFromRowCache(options, handle->table.get(), file_number, global_seqno,
+                        k, arg, handle_result, &served);
+    if (s != Status::kSuccess || served) {
+      return s;
+    }
+  }
+  if (global_seqno == 0) {
+    return handle->table->InternalGet(options, k, arg, handle_result);
+  }
+  // 文件中key的序号是0，总是不小于任何快照的查找key，直接查找就能定位到user_key
+  GlobalSeqnoSaver saver = MakeSaver(global_seqno, k, arg, handle_result);
+  return handle->table->InternalGet(options, k, &saver, SaveWithGlobalSeqno);
+}
+
+DBStatus TableCache::GetFromRowCache(
+    const ReadOptions& options, Table* table, uint64_t file_number,
+    SequenceNumber global_seqno, const std::string_view& k, void* arg,
+    void (*handle_result)(void*, const std::string_view&,
+                          const std::string_view&),
+    bool* served) {
+  auto* row_cache = options_->row_cache;
+  const std::string_view user_key = ExtractUserKey(k);
+  std::string row_key;
+  row_key.reserve(2 * sizeof(uint64_t) + user_key.size());
+  util::PutFixed64(&row_key, row_cache_id_);
+  util::PutFixed64(&row_key, file_number);
+  row_key.append(user_key.data(), user_key.size());
+  // 导入的sst中key的序号都是0，回调需要先替换序号
+  GlobalSeqnoSaver saver = MakeSaver(global_seqno, k, arg, handle_result);
+  if (global_seqno != 0) {
+    arg = &saver;
+    handle_result = SaveWithGlobalSeqno;
+  }
+  const SequenceNumber snapshot = saver.snapshot;
+
+  auto* node = row_cache->Get(row_key);
+  if (node != nullptr) {
+    RecordTick(options_->statistics.get(), kRowCacheHit);
+    *served = ReplayRow(*node->value, snapshot, handle_result, arg);
+    row_cache->Release(node);
+    return Status::kSuccess;
+  }
+  RecordTick(options_->statistics.get(), kRowCacheMiss);
+  // 用最大的序号查找，得到的是user_key最新的版本，和查找的快照无关
+  auto* icmp = static_cast<InternalKeyComparator*>(options_->comparator.get());
+  auto row = std::make_unique<std::string>(1, kRowNotFound);
+  RowSaver row_saver{icmp->user_comparator(), user_key, row.get()};
+  LookupKey latest(user_key, kMaxSequenceNumber);
+  DBStatus s = table->InternalGet(options, latest.internal_key(), &row_saver,
+                                  SaveRow);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  *served = ReplayRow(*row, snapshot, handle_result, arg);
+  const size_t charge = row_key.size() + row->size();
+  row_cache->Insert(row_key, row.release(), charge);
+  return Status::kSuccess;
+}
+
+DBStatus TableCache::MultiGet(
+    const ReadOptions& options, uint64_t file_number, uint64_t file_size,
+    SequenceNumber global_seqno, const std::vector<std::string_view>& keys,
+    const std::vector<void*>& args,
+    void (*handle_result)(void*, const std::string_view&,
+                          const std::string_view&)) {
+  TableHandle handle;
+  DBStatus s = FindTable(file_number, file_size, &handle, options.cache_only);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  if (global_seqno == 0) {
+    return handle->table->MultiGet(options, keys, args, handle_result);
+  }
+  std::vector<GlobalSeqnoSaver> savers;
+  std::vector<void*> saver_args;
+  savers.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    savers.push_back(MakeSaver(global_seqno, keys[i], args[i], handle_result));
+    saver_args.push_back(&savers.back());
+  }
+  return handle->table->MultiGet(options, keys, saver_args,
+                                 SaveWithGlobalSeqno);
+}
+
+DBStatus TableCache::GetIndexKeys(uint64_t file_number, uint64_t file_size,
+                                  std::vector<std::string>* keys,
+                                  std::vector<uint64_t>* block_sizes) {
+  TableHandle handle;
+  DBStatus s = FindTable(file_number, file_size, &handle);
+  if (s == Status::kSuccess) {
+    handle->table->GetIndexKeys(keys, block_sizes);
+  }
+  return s;
+}
+
+DBStatus TableCache::ApproximateOffsetOf(uint64_t file_number,
+                                         uint64_t file_size,
+                                         const std::string_view& k,
+                                         uint64_t* offset) {
+  TableHandle handle;
+  DBStatus s = FindTable(file_number, file_size, &handle);
+  if (s == Status::kSuccess) {
+    *offset = handle->table->ApproximateOffsetOf(k);
+  }
+  return s;
+}
+
+DBStatus TableCache::GetRangeTombstones(
+    uint64_t file_number, uint64_t file_size,
+    std::shared_ptr<const FragmentedRangeTombstoneList>* result,
+    bool cache_only) {
+  TableHandle handle;
+  DBStatus s = FindTable(file_number, file_size, &handle, cache_only);
+  if (s == Status::kSuccess) {
+    *result = handle->range_del;
+  }
+  return s;
+}
+
+DBStatus TableCache::GetTableProperties(
+    uint64_t file_number, uint64_t file_size,
+    std::shared_ptr<const TableProperties>* result) {
+  TableHandle handle;
+  DBStatus s = FindTable(file_number, file_size, &handle);
+  if (s == Status::kSuccess) {
+    *result = handle->table->properties();
+  }
+  return s;
+}
+
+void TableCache::GetCachedBlocks(
+    std::map<uint64_t, std::vector<uint64_t>>* blocks) const {
+  Cache<uint64_t, DataBlock>* block_cache = options_->block_cache;
+  if (block_cache == nullptr) {
+    return;
+  }
+  // 回调在缓存的锁内执行，先把key收集出来再查找
+  std::vector<uint64_t> file_numbers;
+  cache_->ApplyToAllKeys(
+      [&file_numbers](const uint64_t& key) { file_numbers.push_back(key); });
+  std::map<uint64_t, uint64_t> table_ids;
+  for (uint64_t file_number : file_numbers) {
+    auto* node = cache_->Get(file_number);
+    if (node != nullptr) {
+      table_ids[(*node->value)->table->table_id()] = file_number;
+      cache_->Release(node);
+    }
+  }
+  if (table_ids.empty()) {
+    return;
+  }
+  block_cache->ApplyToAllKeys([&](const uint64_t& key) {
+    auto iter = table_ids.find(key >> 32);
+    if (iter != table_ids.end()) {
+      (*blocks)[iter->second].push_back(key & 0xffffffffu);
+    }
+  });
+}
+
+DBStatus TableCache::LoadTable(uint64_t file_number, uint64_t file_size) {
+  TableHandle handle;
+  return FindTable(file_number, file_size, &handle);
+}
+
+DBStatus TableCache::LoadBlocks(uint64_t file_number, uint64_t file_size,
+                                const std::vector<uint64_t>& offsets) {
+  TableHandle handle;
+  DBStatus s = FindTable(file_number, file_size, &handle);
+  if (s == Status::kSuccess) {
+    s = handle->table->LoadBlocks(offsets);
+  }
+  return s;
+}
+
+void TableCache::Evict(uint64_t file_number) { cache_->Erase(file_number); }
+}  // namespace corekv
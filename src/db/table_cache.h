@@ -0,0 +1,122 @@
+#ifndef DB_TABLE_CACHE_H_
+#define DB_TABLE_CACHE_H_
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../cache/cache.h"
+#include "../table/table_properties.h"
+#include "dbformat.h"
+#include "iterator.h"
+#include "options.h"
+#include "range_del.h"
+#include "status.h"
+
+namespace corekv {
+class FileReader;
+class Table;
+// 缓存已经打开的sst，key为文件编号，最多保留options.max_open_files个sst
+// 命中的时候直接复用解析好的footer、index和filter，淘汰的时候关闭fd
+class TableCache final {
+ public:
+  TableCache(const std::string& dbname, const Options* options);
+  TableCache(const TableCache&) = delete;
+  TableCache& operator=(const TableCache&) = delete;
+  ~TableCache();
+
+  // 以下函数的global_seqno见FileMetaData::global_seqno，不为0的时候返回的key中的序号
+  // 都替换成global_seqno，点查时global_seqno比查找的key更新的entry当作不存在
+
+  // 返回的迭代器会持有table的引用，即使table被Evict也可以继续使用
+  // options.for_compaction并且设置了use_direct_reads_for_compaction时，
+  // sst单独用direct io打开，迭代器释放的时候关闭
+  Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
+                        uint64_t file_size, SequenceNumber global_seqno = 0);
+
+  // 在sst中找到第一个大于等于k的entry，然后调用handle_result；
+  // 使用row_cache的时候sst中没有k的user_key就不会调用handle_result
+  DBStatus Get(const ReadOptions& options, uint64_t file_number,
+               uint64_t file_size, SequenceNumber global_seqno,
+               const std::string_view& k, void* arg,
+               void (*handle_result)(void*, const std::string_view&,
+                                     const std::string_view&));
+
+  // 批量点查，keys[i]的结果通过handle_result(args[i], ...)返回
+  DBStatus MultiGet(const ReadOptions& options, uint64_t file_number,
+                    uint64_t file_size, SequenceNumber global_seqno,
+                    const std::vector<std::string_view>& keys,
+                    const std::vector<void*>& args,
+                    void (*handle_result)(void*, const std::string_view&,
+                                          const std::string_view&));
+
+  // 把sst的index block中的分隔key追加到keys中，block_sizes见Table::GetIndexKeys
+  DBStatus GetIndexKeys(uint64_t file_number, uint64_t file_size,
+                        std::vector<std::string>* keys,
+                        std::vector<uint64_t>* block_sizes = nullptr);
+
+  // internal key k在sst中的大致偏移，见Table::ApproximateOffsetOf
+  DBStatus ApproximateOffsetOf(uint64_t file_number, uint64_t file_size,
+                               const std::string_view& k, uint64_t* offset);
+
+  // sst中的range tombstone，没有的时候*result为nullptr；
+  // 切分好的结果和table一起缓存，多次调用不会重复构造
+  // cache_only为true时sst还没有打开就返回kIncomplete
+  DBStatus GetRangeTombstones(
+      uint64_t file_number, uint64_t file_size,
+      std::shared_ptr<const FragmentedRangeTombstoneList>* result,
+      bool cache_only = false);
+
+  // sst的properties block，没有的时候*result为nullptr；和table一起缓存
+  DBStatus GetTableProperties(uint64_t file_number, uint64_t file_size,
+                              std::shared_ptr<const TableProperties>* result);
+
+  // 当前打开着的sst中已经在block_cache里的block，按照文件编号把偏移
+  // (见Table::BlockCacheKey，只有低32位)追加到blocks中，没有排序；
+  // 已经被淘汰出TableCache的sst留在block_cache中的block再也不会被访问，不统计
+  void GetCachedBlocks(std::map<uint64_t, std::vector<uint64_t>>* blocks) const;
+
+  // 把sst中偏移在offsets中的data block读进block_cache，offsets需要排好序
+  DBStatus LoadBlocks(uint64_t file_number, uint64_t file_size,
+                      const std::vector<uint64_t>& offsets);
+
+  // 打开sst放进缓存，已经在缓存中的时候什么都不做；DB::Open预先打开sst时使用
+  DBStatus LoadTable(uint64_t file_number, uint64_t file_size);
+
+  // sst被删除之后调用
+  void Evict(uint64_t file_number);
+
+ private:
+  struct TableAndFile;
+  // 缓存中保存的是shared_ptr，淘汰只会释放缓存持有的那一份引用，
+  // 正在使用的迭代器或者Get结束之后table和fd才真正被关闭
+  using TableHandle = std::shared_ptr<TableAndFile>;
+  // cache_only为true时不在缓存中就返回kIncomplete，不打开文件
+  DBStatus FindTable(uint64_t file_number, uint64_t file_size,
+                     TableHandle* handle, bool cache_only = false);
+  // 打开sst并解析footer、index和filter，不放进缓存
+  // for_compaction为true时使用direct io读取，并且不使用block_cache
+  DBStatus OpenTable(uint64_t file_number, uint64_t file_size,
+                     bool for_compaction, TableHandle* handle);
+  // 通过row_cache回答点查，*served为false表示缓存的版本对k的快照不可见，
+  // 需要再直接查找sst
+  DBStatus GetFromRowCache(const ReadOptions& options, Table* table,
+                           uint64_t file_number, SequenceNumber global_seqno,
+                           const std::string_view& k, void* arg,
+                           void (*handle_result)(void*, const std::string_view&,
+                                                 const std::string_view&),
+                           bool* served);
+
+  const std::string dbname_;
+  const Options* options_;
+  // 和options_相同，只是没有block_cache，给compaction输入的table使用
+  Options compaction_options_;
+  std::unique_ptr<Cache<uint64_t, TableHandle>> cache_;
+  // 在row_cache中区分不同的db和column family
+  uint64_t row_cache_id_ = 0;
+};
+}  // namespace corekv
+#endif
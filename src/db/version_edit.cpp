@@ -0,0 +1,257 @@
+#include "version_edit.h"
+
+#include "../utils/codec.h"
+namespace corekv {
+using namespace util;
+// 每个字段前面都带上tag，后续新增字段的时候可以保持向前兼容
+enum Tag : uint32_t {
+  kComparator = 1,
+  kLogNumber = 2,
+  kNextFileNumber = 3,
+  kLastSequence = 4,
+  kDeletedFile = 5,
+  kNewFile = 6,
+  // 和kNewFile相同，最后多一个global_seqno，只有外部导入的sst使用
+  kNewFileWithSeqno = 7,
+  kNewBlobFile = 8,
+  kBlobGarbage = 9,
+  // 和kNewFileWithSeqno相同，最后再多largest_seqno和num_range_deletions
+  kNewFile2 = 10,
+  // 以下字段只有非默认的column family使用
+  kColumnFamily = 11,
+  kColumnFamilyAdd = 12,
+  kColumnFamilyDrop = 13,
+  kMaxColumnFamily = 14,
+  // 和kNewFile2相同，最后再多file_creation_time
+  kNewFile3 = 15,
+};
+
+void VersionEdit::Clear() {
+  comparator_.clear();
+  column_family_ = 0;
+  column_family_name_.clear();
+  is_column_family_add_ = false;
+  is_column_family_drop_ = false;
+  has_max_column_family_ = false;
+  max_column_family_ = 0;
+  log_number_ = 0;
+  next_file_number_ = 0;
+  last_sequence_ = 0;
+  has_comparator_ = false;
+  has_log_number_ = false;
+  has_next_file_number_ = false;
+  has_last_sequence_ = false;
+  deleted_files_.clear();
+  new_files_.clear();
+  new_blob_files_.clear();
+  blob_garbage_.clear();
+}
+
+void VersionEdit::EncodeTo(std::string* dst) const {
+  if (column_family_ != 0) {
+    PutVarint32(dst, kColumnFamily);
+    PutVarint32(dst, column_family_);
+  }
+  if (is_column_family_add_) {
+    PutVarint32(dst, kColumnFamilyAdd);
+    PutLengthPrefixedSlice(dst, column_family_name_);
+  }
+  if (is_column_family_drop_) {
+    PutVarint32(dst, kColumnFamilyDrop);
+  }
+  if (has_max_column_family_) {
+    PutVarint32(dst, kMaxColumnFamily);
+    PutVarint32(dst, max_column_family_);
+  }
+  if (has_comparator_) {
+    PutVarint32(dst, kComparator);
+    PutLengthPrefixedSlice(dst, comparator_);
+  }
+  if (has_log_number_) {
+    PutVarint32(dst, kLogNumber);
+    PutVarint64(dst, log_number_);
+  }
+  if (has_next_file_number_) {
+    PutVarint32(dst, kNextFileNumber);
+    PutVarint64(dst, next_file_number_);
+  }
+  if (has_last_sequence_) {
+    PutVarint32(dst, kLastSequence);
+    PutVarint64(dst, last_sequence_);
+  }
+  for (const auto& deleted_file : deleted_files_) {
+    PutVarint32(dst, kDeletedFile);
+    PutVarint32(dst, deleted_file.first);
+    PutVarint64(dst, deleted_file.second);
+  }
+  for (const auto& new_file : new_files_) {
+    const FileMetaData& f = new_file.second;
+    // 新增的字段都为0的时候仍然使用旧的tag，旧版本也能读取
+    Tag tag = kNewFile;
+    if (f.file_creation_time != 0) {
+      tag = kNewFile3;
+    } else if (f.largest_seqno != 0 || f.num_range_deletions != 0) {
+      tag = kNewFile2;
+    } else if (f.global_seqno != 0) {
+      tag = kNewFileWithSeqno;
+    }
+    PutVarint32(dst, tag);
+    PutVarint32(dst, new_file.first);
+    PutVarint64(dst, f.number);
+    PutVarint64(dst, f.file_size);
+    PutLengthPrefixedSlice(dst, f.smallest);
+    PutLengthPrefixedSlice(dst, f.largest);
+    if (tag != kNewFile) {
+      PutVarint64(dst, f.global_seqno);
+    }
+    if (tag == kNewFile2 || tag == kNewFile3) {
+      PutVarint64(dst, f.largest_seqno);
+      PutVarint64(dst, f.num_range_deletions);
+    }
+    if (tag == kNewFile3) {
+      PutVarint64(dst, f.file_creation_time);
+    }
+  }
+  for (const auto& f : new_blob_files_) {
+    PutVarint32(dst, kNewBlobFile);
+    PutVarint64(dst, f.number);
+    PutVarint64(dst, f.total_count);
+    PutVarint64(dst, f.total_bytes);
+  }
+  for (const auto& garbage : blob_garbage_) {
+    PutVarint32(dst, kBlobGarbage);
+    PutVarint64(dst, garbage.first);
+    PutVarint64(dst, garbage.second.first);
+    PutVarint64(dst, garbage.second.second);
+  }
+}
+
+static bool GetLevel(std::string_view* input, int32_t* level) {
+  uint32_t v;
+  if (GetVarint32(input, &v) && v < config::kNumLevels) {
+    *level = v;
+    return true;
+  }
+  return false;
+}
+
+static bool GetInternalKey(std::string_view* input, std::string* dst) {
+  std::string_view str;
+  if (GetLengthPrefixedSlice(input, &str) &&
+      str.size() >= kInternalKeyTailSize) {
+    dst->assign(str.data(), str.size());
+    return true;
+  }
+  return false;
+}
+
+DBStatus VersionEdit::DecodeFrom(const std::string_view& src) {
+  Clear();
+  std::string_view input = src;
+  uint32_t tag;
+  int32_t level;
+  uint64_t number;
+  FileMetaData f;
+  BlobFileMetaData blob;
+  uint64_t count, bytes;
+  std::string_view str;
+  while (GetVarint32(&input, &tag)) {
+    switch (tag) {
+      case kComparator:
+        if (!GetLengthPrefixedSlice(&input, &str)) {
+          return Status::kCorruption;
+        }
+        comparator_.assign(str.data(), str.size());
+        has_comparator_ = true;
+        break;
+      case kColumnFamily:
+        if (!GetVarint32(&input, &column_family_)) {
+          return Status::kCorruption;
+        }
+        break;
+      case kColumnFamilyAdd:
+        if (!GetLengthPrefixedSlice(&input, &str)) {
+          return Status::kCorruption;
+        }
+        column_family_name_.assign(str.data(), str.size());
+        is_column_family_add_ = true;
+        break;
+      case kColumnFamilyDrop:
+        is_column_family_drop_ = true;
+        break;
+      case kMaxColumnFamily:
+        if (!GetVarint32(&input, &max_column_family_)) {
+          return Status::kCorruption;
+        }
+        has_max_column_family_ = true;
+        break;
+      case kLogNumber:
+        if (!GetVarint64(&input, &log_number_)) {
+          return Status::kCorruption;
+        }
+        has_log_number_ = true;
+        break;
+      case kNextFileNumber:
+        if (!GetVarint64(&input, &next_file_number_)) {
+          return Status::kCorruption;
+        }
+        has_next_file_number_ = true;
+        break;
+      case kLastSequence:
+        if (!GetVarint64(&input, &last_sequence_)) {
+          return Status::kCorruption;
+        }
+        has_last_sequence_ = true;
+        break;
+      case kDeletedFile:
+        if (!GetLevel(&input, &level) || !GetVarint64(&input, &number)) {
+          return Status::kCorruption;
+        }
+        deleted_files_.emplace(level, number);
+        break;
+      case kNewFile:
+      case kNewFileWithSeqno:
+      case kNewFile2:
+      case kNewFile3:
+        f.global_seqno = 0;
+        f.largest_seqno = 0;
+        f.num_range_deletions = 0;
+        f.file_creation_time = 0;
+        if (!GetLevel(&input, &level) || !GetVarint64(&input, &f.number) ||
+            !GetVarint64(&input, &f.file_size) ||
+            !GetInternalKey(&input, &f.smallest) ||
+            !GetInternalKey(&input, &f.largest) ||
+            (tag != kNewFile && !GetVarint64(&input, &f.global_seqno)) ||
+            ((tag == kNewFile2 || tag == kNewFile3) &&
+             (!GetVarint64(&input, &f.largest_seqno) ||
+              !GetVarint64(&input, &f.num_range_deletions))) ||
+            (tag == kNewFile3 && !GetVarint64(&input, &f.file_creation_time))) {
+          return Status::kCorruption;
+        }
+        new_files_.emplace_back(level, f);
+        break;
+      case kNewBlobFile:
+        if (!GetVarint64(&input, &blob.number) ||
+            !GetVarint64(&input, &blob.total_count) ||
+            !GetVarint64(&input, &blob.total_bytes)) {
+          return Status::kCorruption;
+        }
+        new_blob_files_.push_back(blob);
+        break;
+      case kBlobGarbage:
+        if (!GetVarint64(&input, &number) || !GetVarint64(&input, &count) ||
+            !GetVarint64(&input, &bytes)) {
+          return Status::kCorruption;
+        }
+        AddBlobGarbage(number, count, bytes);
+        break;
+      default:
+        return Status::kCorruption;
+    }
+  }
+  if (!input.empty()) {
+    return Status::kCorruption;
+  }
+  return Status::kSuccess;
+}
+}  // namespace corekv
@@ -0,0 +1,147 @@
+#ifndef DB_VERSION_EDIT_H_
+#define DB_VERSION_EDIT_H_
+#include <stdint.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dbformat.h"
+#include "status.h"
+
+namespace corekv {
+// 一个sst文件的元数据
+struct FileMetaData {
+  int32_t refs = 0;
+  uint64_t number = 0;
+  uint64_t file_size = 0;
+  // sst中最小和最大的internal key
+  std::string smallest;
+  std::string largest;
+  // 外部导入的sst中key的序号都是0，读取的时候替换成导入时分配的这个序号，
+  // 为0表示使用文件中的序号
+  SequenceNumber global_seqno = 0;
+  // 文件中所有entry和range tombstone的最大序号，为0表示未知（旧版本写入的文件）
+  SequenceNumber largest_seqno = 0;
+  // 文件中range tombstone的个数，为0的时候读取不需要打开meta block
+  uint64_t num_range_deletions = 0;
+  // 文件生成的时间(ms)，为0表示未知；FIFO方式下据此判断文件是否过期
+  uint64_t file_creation_time = 0;
+};
+
+// 一个blob文件的元数据，garbage是已经不再被任何sst引用的value，
+// 全部value都变成garbage之后文件从版本中移除
+struct BlobFileMetaData {
+  uint64_t number = 0;
+  uint64_t total_count = 0;
+  uint64_t total_bytes = 0;
+  uint64_t garbage_count = 0;
+  uint64_t garbage_bytes = 0;
+};
+
+// 对lsm结构的一次修改，序列化之后保存在MANIFEST中
+class VersionEdit final {
+ public:
+  VersionEdit() { Clear(); }
+  ~VersionEdit() = default;
+
+  void Clear();
+
+  void SetLogNumber(uint64_t num) {
+    has_log_number_ = true;
+    log_number_ = num;
+  }
+  void SetNextFile(uint64_t num) {
+    has_next_file_number_ = true;
+    next_file_number_ = num;
+  }
+  void SetLastSequence(SequenceNumber seq) {
+    has_last_sequence_ = true;
+    last_sequence_ = seq;
+  }
+  void SetComparatorName(const std::string_view& name) {
+    has_comparator_ = true;
+    comparator_.assign(name.data(), name.size());
+  }
+  // edit中的文件和log_number属于这个column family，默认是0
+  void SetColumnFamily(uint32_t column_family) {
+    column_family_ = column_family;
+  }
+  // 新建一个名字为name的column family，edit中同时带上它的comparator和log_number
+  void AddColumnFamily(const std::string_view& name) {
+    is_column_family_add_ = true;
+    column_family_name_.assign(name.data(), name.size());
+  }
+  void DropColumnFamily() { is_column_family_drop_ = true; }
+  // 已经分配过的最大的column family id，保证删除之后id不会被复用
+  void SetMaxColumnFamily(uint32_t max_column_family) {
+    has_max_column_family_ = true;
+    max_column_family_ = max_column_family;
+  }
+
+  void AddFile(int32_t level, uint64_t file, uint64_t file_size,
+               const std::string_view& smallest,
+               const std::string_view& largest,
+               SequenceNumber global_seqno = 0) {
+    FileMetaData f;
+    f.number = file;
+    f.file_size = file_size;
+    f.global_seqno = global_seqno;
+    f.smallest.assign(smallest.data(), smallest.size());
+    f.largest.assign(largest.data(), largest.size());
+    new_files_.emplace_back(level, f);
+  }
+  // 使用f中除了refs之外的所有字段
+  void AddFile(int32_t level, const FileMetaData& f) {
+    new_files_.emplace_back(level, f);
+    new_files_.back().second.refs = 0;
+  }
+  void RemoveFile(int32_t level, uint64_t file) {
+    deleted_files_.emplace(level, file);
+  }
+  void AddBlobFile(uint64_t file, uint64_t total_count, uint64_t total_bytes) {
+    BlobFileMetaData f;
+    f.number = file;
+    f.total_count = total_count;
+    f.total_bytes = total_bytes;
+    new_blob_files_.push_back(f);
+  }
+  // compaction丢弃或者搬迁了file中的value，同一个文件的多次调用累加
+  void AddBlobGarbage(uint64_t file, uint64_t count, uint64_t bytes) {
+    auto& garbage = blob_garbage_[file];
+    garbage.first += count;
+    garbage.second += bytes;
+  }
+
+  void EncodeTo(std::string* dst) const;
+  DBStatus DecodeFrom(const std::string_view& src);
+
+ private:
+  friend class VersionSet;
+  using DeletedFileSet = std::set<std::pair<int32_t, uint64_t>>;
+
+  std::string comparator_;
+  uint32_t column_family_;
+  std::string column_family_name_;
+  bool is_column_family_add_;
+  bool is_column_family_drop_;
+  bool has_max_column_family_;
+  uint32_t max_column_family_;
+  uint64_t log_number_;
+  uint64_t next_file_number_;
+  SequenceNumber last_sequence_;
+  bool has_comparator_;
+  bool has_log_number_;
+  bool has_next_file_number_;
+  bool has_last_sequence_;
+
+  DeletedFileSet deleted_files_;
+  std::vector<std::pair<int32_t, FileMetaData>> new_files_;
+  std::vector<BlobFileMetaData> new_blob_files_;
+  // 文件编号 -> (garbage_count, garbage_bytes)
+  std::map<uint64_t, std::pair<uint64_t, uint64_t>> blob_garbage_;
+};
+}  // namespace corekv
+#endif
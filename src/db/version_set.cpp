@@ -0,0 +1,1730 @@
+#include "version_set.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+
+#include "../file/file.h"
+#include "../file/file_name.h"
+#include "../table/merging_iterator.h"
+#include "../utils/thread_pool.h"
+#include "../utils/util.h"
+#include "blob_file.h"
+#include "comparator.h"
+#include "log_reader.h"
+#include "log_writer.h"
+#include "memtable.h"
+#include "table_cache.h"
+namespace corekv {
+Version::~Version() {
+  assert(refs_ == 0);
+  // 从链表中摘掉
+  prev_->next_ = next_;
+  next_->prev_ = prev_;
+  for (int32_t level = 0; level < config::kNumLevels; ++level) {
+    for (auto* f : files_[level]) {
+      assert(f->refs > 0);
+      if (--f->refs <= 0) {
+        delete f;
+      }
+    }
+  }
+}
+
+void Version::Ref() { ++refs_; }
+
+void Version::Unref() {
+  assert(this != &cfd_->dummy_versions_);
+  assert(refs_ >= 1);
+  if (--refs_ == 0) {
+    delete this;
+  }
+}
+
+namespace {
+enum SaverState {
+  kNotFound,
+  kFound,
+  kDeleted,
+  kCorrupt,
+  // 最新的版本是merge操作数，由调用方和更旧的版本一起合并
+  kMerge,
+};
+struct Saver {
+  SaverState state;
+  Comparator* ucmp;
+  std::string_view user_key;
+  std::string* value;
+  // 找到的value是BlobIndex，需要再从blob文件中读取
+  bool is_blob_index = false;
+  // 已经查找过的数据中覆盖user_key的range tombstone的最大序号
+  SequenceNumber max_covering_tombstone_seq = 0;
+};
+
+SequenceNumber LookupSequence(const std::string_view& ikey) {
+  return util::DecodeFixed64(ikey.data() + ikey.size() - kInternalKeyTailSize) >>
+         8;
+}
+}  // namespace
+
+static void SaveValue(void* arg, const std::string_view& ikey,
+                      const std::string_view& v) {
+  Saver* s = reinterpret_cast<Saver*>(arg);
+  ParsedInternalKey parsed_key;
+  if (!ParseInternalKey(ikey, &parsed_key)) {
+    s->state = kCorrupt;
+    return;
+  }
+  if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
+    if (parsed_key.sequence < s->max_covering_tombstone_seq) {
+      s->state = kDeleted;
+      return;
+    }
+    s->state = (parsed_key.type == kTypeDeletion) ? kDeleted : kFound;
+    if (parsed_key.type == kTypeMerge) {
+      s->state = kMerge;
+      return;
+    }
+    s->is_blob_index = (parsed_key.type == kTypeBlobIndex);
+    std::string_view value = v;
+    if (parsed_key.type == kTypeValueWithExpiry) {
+      uint64_t expire_at;
+      if (!SplitExpiry(v, &value, &expire_at)) {
+        s->state = kCorrupt;
+      } else if (expire_at <= util::GetCurrentTime()) {
+        s->state = kDeleted;
+      }
+    }
+    if (s->state == kFound) {
+      s->value->assign(value.data(), value.size());
+    }
+  }
+}
+
+// level0按照largest_seqno判断新旧: universal合并出来的run编号比更新的run大，
+// 但其中的数据更旧；largest_seqno相同的时候(没有记录序号的旧文件)再按照编号
+static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
+  if (a->largest_seqno != b->largest_seqno) {
+    return a->largest_seqno > b->largest_seqno;
+  }
+  return a->number > b->number;
+}
+
+DBStatus Version::Get(const ReadOptions& options, const LookupKey& k,
+                      std::string* value,
+                      SequenceNumber max_covering_tombstone_seq) {
+  const std::string_view& ikey = k.internal_key();
+  const std::string_view& user_key = k.user_key();
+  Comparator* ucmp = cfd_->icmp_.user_comparator();
+
+  Saver saver;
+  saver.ucmp = ucmp;
+  saver.user_key = user_key;
+  saver.value = value;
+  saver.max_covering_tombstone_seq = max_covering_tombstone_seq;
+  const SequenceNumber snapshot = LookupSequence(ikey);
+  // 查找某一个sst，返回true表示已经有结果了
+  auto search_file = [&](FileMetaData* f, DBStatus* s) {
+    saver.state = kNotFound;
+    if (f->num_range_deletions > 0) {
+      std::shared_ptr<const FragmentedRangeTombstoneList> range_del;
+      *s = cfd_->table_cache_->GetRangeTombstones(
+          f->number, f->file_size, &range_del, options.cache_only);
+      if (*s != Status::kSuccess) {
+        return true;
+      }
+      if (range_del) {
+        saver.max_covering_tombstone_seq =
+            std::max(saver.max_covering_tombstone_seq,
+                     range_del->MaxCoveringSequence(user_key, snapshot));
+      }
+    }
+    *s = cfd_->table_cache_->Get(options, f->number, f->file_size,
+                                 f->global_seqno, ikey, &saver, SaveValue);
+    if (*s != Status::kSuccess) {
+      return true;
+    }
+    switch (saver.state) {
+      case kNotFound:
+        return false;
+      case kFound:
+        if (!saver.is_blob_index) {
+          *s = Status::kSuccess;
+        } else if (options.cache_only) {
+          // blob文件没有缓存，总是需要读文件
+          *s = Status::kIncomplete;
+        } else {
+          *s = cfd_->vset_->blob_source_->Get(*value, value);
+        }
+        return true;
+      case kDeleted:
+        *s = Status::kNotFound;
+        return true;
+      case kCorrupt:
+        *s = Status::kCorruption;
+        return true;
+      case kMerge:
+        *s = Status::kMergeInProgress;
+        return true;
+    }
+    return false;
+  };
+
+  DBStatus s = Status::kNotFound;
+  // level0中的sst之间可能有重叠，需要从新到旧依次查找
+  std::vector<FileMetaData*> tmp;
+  tmp.reserve(files_[0].size());
+  for (auto* f : files_[0]) {
+    if (ucmp->Compare(user_key, ExtractUserKey(f->smallest)) >= 0 &&
+        ucmp->Compare(user_key, ExtractUserKey(f->largest)) <= 0) {
+      tmp.push_back(f);
+    }
+  }
+  std::sort(tmp.begin(), tmp.end(), NewestFirst);
+  for (auto* f : tmp) {
+    if (search_file(f, &s)) {
+      return s;
+    }
+  }
+  // 其他层的sst之间没有重叠，二分找到第一个largest大于等于ikey的sst
+  for (int32_t level = 1; level < config::kNumLevels; ++level) {
+    const auto& files = files_[level];
+    if (files.empty()) {
+      continue;
+    }
+    auto iter = std::lower_bound(
+        files.begin(), files.end(), ikey,
+        [this](FileMetaData* f, const std::string_view& key) {
+          return cfd_->icmp_.Compare(f->largest, key) < 0;
+        });
+    if (iter == files.end() ||
+        ucmp->Compare(user_key, ExtractUserKey((*iter)->smallest)) < 0) {
+      continue;
+    }
+    if (search_file(*iter, &s)) {
+      return s;
+    }
+  }
+  return Status::kNotFound;
+}
+
+void Version::MultiGet(const ReadOptions& options,
+                       const std::vector<const LookupKey*>& keys,
+                       const std::vector<std::string*>& values,
+                       std::vector<DBStatus>* statuses,
+                       const std::vector<SequenceNumber>*
+                           max_covering_tombstone_seqs) {
+  Comparator* ucmp = cfd_->icmp_.user_comparator();
+  const size_t n = keys.size();
+  statuses->assign(n, Status::kNotFound);
+  // 还没有结果的key，按照key有序，落在同一个sst中的key是相邻的
+  std::vector<size_t> pending(n);
+  for (size_t i = 0; i < n; ++i) {
+    pending[i] = i;
+  }
+  std::sort(pending.begin(), pending.end(), [&](size_t a, size_t b) {
+    return cfd_->icmp_.Compare(keys[a]->internal_key(),
+                                keys[b]->internal_key()) < 0;
+  });
+  std::vector<bool> done(n, false);
+  std::vector<Saver> savers(n);
+  for (size_t i = 0; i < n; ++i) {
+    savers[i].ucmp = ucmp;
+    savers[i].user_key = keys[i]->user_key();
+    savers[i].value = values[i];
+    if (max_covering_tombstone_seqs != nullptr) {
+      savers[i].max_covering_tombstone_seq = (*max_covering_tombstone_seqs)[i];
+    }
+  }
+  // 在一个sst中查找batch中的key，有结果的key标记为done
+  std::vector<std::string_view> ikeys;
+  std::vector<void*> args;
+  auto search_file = [&](FileMetaData* f, const std::vector<size_t>& batch) {
+    ikeys.clear();
+    args.clear();
+    std::shared_ptr<const FragmentedRangeTombstoneList> range_del;
+    if (f->num_range_deletions > 0) {
+      DBStatus s = cfd_->table_cache_->GetRangeTombstones(
+          f->number, f->file_size, &range_del, options.cache_only);
+      if (s != Status::kSuccess) {
+        for (const size_t idx : batch) {
+          (*statuses)[idx] = s;
+          done[idx] = true;
+        }
+        return;
+      }
+    }
+    for (const size_t idx : batch) {
+      if (range_del) {
+        const std::string_view& ikey = keys[idx]->internal_key();
+        savers[idx].max_covering_tombstone_seq = std::max(
+            savers[idx].max_covering_tombstone_seq,
+            range_del->MaxCoveringSequence(savers[idx].user_key,
+                                           LookupSequence(ikey)));
+      }
+    }
+    for (const size_t idx : batch) {
+      savers[idx].state = kNotFound;
+      ikeys.push_back(keys[idx]->internal_key());
+      args.push_back(&savers[idx]);
+    }
+    DBStatus s = cfd_->table_cache_->MultiGet(options, f->number,
+                                              f->file_size, f->global_seqno,
+                                              ikeys, args, SaveValue);
+    for (const size_t idx : batch) {
+      if (s != Status::kSuccess) {
+        (*statuses)[idx] = s;
+        done[idx] = true;
+        continue;
+      }
+      switch (savers[idx].state) {
+        case kNotFound:
+          break;
+        case kFound:
+          if (!savers[idx].is_blob_index) {
+            (*statuses)[idx] = Status::kSuccess;
+          } else if (options.cache_only) {
+            (*statuses)[idx] = Status::kIncomplete;
+          } else {
+            (*statuses)[idx] = cfd_->vset_->blob_source_->Get(*values[idx],
+                                                              values[idx]);
+          }
+          done[idx] = true;
+          break;
+        case kDeleted:
+          done[idx] = true;
+          break;
+        case kCorrupt:
+          (*statuses)[idx] = Status::kCorruption;
+          done[idx] = true;
+          break;
+        case kMerge:
+          (*statuses)[idx] = Status::kMergeInProgress;
+          done[idx] = true;
+          break;
+      }
+    }
+  };
+  auto remove_done = [&]() {
+    pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                 [&](size_t idx) { return done[idx]; }),
+                  pending.end());
+  };
+
+  // level0中的sst之间可能有重叠，从新到旧依次查找
+  std::vector<FileMetaData*> tmp(files_[0].begin(), files_[0].end());
+  std::sort(tmp.begin(), tmp.end(), NewestFirst);
+  std::vector<size_t> batch;
+  for (auto* f : tmp) {
+    batch.clear();
+    for (const size_t idx : pending) {
+      if (ucmp->Compare(savers[idx].user_key, ExtractUserKey(f->smallest)) >=
+              0 &&
+          ucmp->Compare(savers[idx].user_key, ExtractUserKey(f->largest)) <=
+              0) {
+        batch.push_back(idx);
+      }
+    }
+    if (!batch.empty()) {
+      search_file(f, batch);
+      remove_done();
+    }
+  }
+  // 其他层的sst之间没有重叠，pending有序，所以同一个sst中的key是连续的一段
+  for (int32_t level = 1; level < config::kNumLevels && !pending.empty();
+       ++level) {
+    const auto& files = files_[level];
+    if (files.empty()) {
+      continue;
+    }
+    FileMetaData* batch_file = nullptr;
+    batch.clear();
+    for (const size_t idx : pending) {
+      const std::string_view& ikey = keys[idx]->internal_key();
+      auto iter = std::lower_bound(
+          files.begin(), files.end(), ikey,
+          [this](FileMetaData* f, const std::string_view& key) {
+            return cfd_->icmp_.Compare(f->largest, key) < 0;
+          });
+      FileMetaData* f = nullptr;
+      if (iter != files.end() &&
+          ucmp->Compare(savers[idx].user_key,
+                        ExtractUserKey((*iter)->smallest)) >= 0) {
+        f = *iter;
+      }
+      if (f != batch_file && !batch.empty()) {
+        search_file(batch_file, batch);
+        batch.clear();
+      }
+      batch_file = f;
+      if (f != nullptr) {
+        batch.push_back(idx);
+      }
+    }
+    if (!batch.empty()) {
+      search_file(batch_file, batch);
+    }
+    remove_done();
+  }
+}
+
+void Version::GetOverlappingInputs(int32_t level, const std::string* begin,
+                                   const std::string* end,
+                                   std::vector<FileMetaData*>* inputs) {
+  assert(level >= 0 && level < config::kNumLevels);
+  inputs->clear();
+  std::string_view user_begin, user_end;
+  if (begin != nullptr) {
+    user_begin = ExtractUserKey(*begin);
+  }
+  if (end != nullptr) {
+    user_end = ExtractUserKey(*end);
+  }
+  Comparator* ucmp = cfd_->icmp_.user_comparator();
+  for (size_t i = 0; i < files_[level].size();) {
+    FileMetaData* f = files_[level][i++];
+    const std::string_view& file_start = ExtractUserKey(f->smallest);
+    const std::string_view& file_limit = ExtractUserKey(f->largest);
+    if (begin != nullptr && ucmp->Compare(file_limit, user_begin) < 0) {
+      // 完全在范围的左边
+    } else if (end != nullptr && ucmp->Compare(file_start, user_end) > 0) {
+      // 完全在范围的右边
+    } else {
+      inputs->push_back(f);
+      if (level == 0) {
+        // level0的sst范围超出了当前的范围，扩大范围之后重新开始查找
+        if (begin != nullptr && ucmp->Compare(file_start, user_begin) < 0) {
+          user_begin = file_start;
+          inputs->clear();
+          i = 0;
+        } else if (end != nullptr && ucmp->Compare(file_limit, user_end) > 0) {
+          user_end = file_limit;
+          inputs->clear();
+          i = 0;
+        }
+      }
+    }
+  }
+}
+
+void Version::AddIterators(const ReadOptions& options,
+                           std::vector<Iterator*>* iters) {
+  for (int32_t level = 0; level < config::kNumLevels; ++level) {
+    for (auto* f : files_[level]) {
+      iters->push_back(cfd_->table_cache_->NewIterator(
+          options, f->number, f->file_size, f->global_seqno));
+    }
+  }
+}
+
+DBStatus Version::GetTableProperties(TablePropertiesCollection* props) {
+  for (int32_t level = 0; level < config::kNumLevels; ++level) {
+    for (auto* f : files_[level]) {
+      std::shared_ptr<const TableProperties> table_props;
+      DBStatus s = cfd_->table_cache_->GetTableProperties(
+          f->number, f->file_size, &table_props);
+      if (s != Status::kSuccess) {
+        return s;
+      }
+      if (table_props) {
+        (*props)[f->number] = std::move(table_props);
+      }
+    }
+  }
+  return Status::kSuccess;
+}
+
+void Version::LoadBlocks(
+    const std::map<uint64_t, std::vector<uint64_t>>& blocks,
+    const std::atomic<bool>* stop) {
+  for (int32_t level = 0; level < config::kNumLevels; ++level) {
+    for (auto* f : files_[level]) {
+      if (stop->load(std::memory_order_acquire)) {
+        return;
+      }
+      auto iter = blocks.find(f->number);
+      if (iter != blocks.end()) {
+        cfd_->table_cache_->LoadBlocks(f->number, f->file_size, iter->second);
+      }
+    }
+  }
+}
+
+void Version::OpenTables(ThreadPool* pool, int32_t limit) {
+  TableCache* table_cache = cfd_->table_cache_.get();
+  for (int32_t level = 0; level < config::kNumLevels; ++level) {
+    for (auto* f : files_[level]) {
+      if (limit-- <= 0) {
+        return;
+      }
+      const uint64_t number = f->number;
+      const uint64_t file_size = f->file_size;
+      pool->Schedule([table_cache, number, file_size]() {
+        table_cache->LoadTable(number, file_size);
+      });
+    }
+  }
+}
+
+uint64_t Version::ApproximateOffsetOf(const std::string& ikey) {
+  InternalKeyComparator& icmp = cfd_->icmp_;
+  uint64_t result = 0;
+  for (int32_t level = 0; level < config::kNumLevels; ++level) {
+    for (auto* f : files_[level]) {
+      if (icmp.Compare(f->largest, ikey) <= 0) {
+        // 整个文件都在ikey之前
+        result += f->file_size;
+      } else if (icmp.Compare(f->smallest, ikey) > 0) {
+        // level0之外的文件之间没有重叠，后面的文件都在ikey之后
+        if (level > 0) {
+          break;
+        }
+      } else {
+        uint64_t offset = 0;
+        if (cfd_->table_cache_->ApproximateOffsetOf(f->number, f->file_size,
+                                                    ikey, &offset) ==
+            Status::kSuccess) {
+          result += offset;
+        }
+      }
+    }
+  }
+  return result;
+}
+
+uint64_t Version::ApproximateSize(const std::string& start,
+                                  const std::string& limit) {
+  const uint64_t start_offset = ApproximateOffsetOf(start);
+  const uint64_t limit_offset = ApproximateOffsetOf(limit);
+  return limit_offset > start_offset ? limit_offset - start_offset : 0;
+}
+
+void Version::GetApproximateKeyBoundaries(
+    int32_t n, std::vector<std::string>* boundaries) {
+  boundaries->clear();
+  if (n <= 1) {
+    return;
+  }
+  // 每个data block用它的index key和大小表示
+  std::vector<std::pair<std::string, uint64_t>> blocks;
+  uint64_t total_bytes = 0;
+  for (int32_t level = 0; level < config::kNumLevels; ++level) {
+    for (auto* f : files_[level]) {
+      std::vector<std::string> keys;
+      std::vector<uint64_t> sizes;
+      if (cfd_->table_cache_->GetIndexKeys(f->number, f->file_size, &keys,
+                                           &sizes) != Status::kSuccess) {
+        continue;
+      }
+      for (size_t i = 0; i < keys.size(); ++i) {
+        blocks.emplace_back(std::string(ExtractUserKey(keys[i])), sizes[i]);
+        total_bytes += sizes[i];
+      }
+    }
+  }
+  Comparator* ucmp = cfd_->user_comparator();
+  std::sort(blocks.begin(), blocks.end(),
+            [ucmp](const auto& a, const auto& b) {
+              return ucmp->Compare(a.first, b.first) < 0;
+            });
+  // 累计大小第一次超过i/n的block的key作为第i个边界
+  uint64_t accumulated = 0;
+  int32_t next = 1;
+  for (const auto& [key, bytes] : blocks) {
+    if (next >= n) {
+      break;
+    }
+    accumulated += bytes;
+    if (accumulated * n < total_bytes * next) {
+      continue;
+    }
+    if (boundaries->empty() || ucmp->Compare(boundaries->back(), key) < 0) {
+      boundaries->push_back(key);
+    }
+    while (next < n && accumulated * n >= total_bytes * next) {
+      ++next;
+    }
+  }
+}
+
+DBStatus Version::AddRangeTombstones(std::vector<RangeTombstone>* tombstones) {
+  for (int32_t level = 0; level < config::kNumLevels; ++level) {
+    for (auto* f : files_[level]) {
+      if (f->num_range_deletions == 0) {
+        continue;
+      }
+      std::shared_ptr<const FragmentedRangeTombstoneList> range_del;
+      DBStatus s = cfd_->table_cache_->GetRangeTombstones(
+          f->number, f->file_size, &range_del);
+      if (s != Status::kSuccess) {
+        return s;
+      }
+      if (range_del) {
+        tombstones->insert(tombstones->end(), range_del->tombstones().begin(),
+                           range_del->tombstones().end());
+      }
+    }
+  }
+  return Status::kSuccess;
+}
+
+// 用户传入的column family配置，db级别的配置统一使用db_options中的值
+static Options SanitizeColumnFamilyOptions(const Options& db_options,
+                                           const Options& options) {
+  Options result = options;
+  result.create_if_missing = db_options.create_if_missing;
+  result.error_if_exists = db_options.error_if_exists;
+  result.max_background_jobs = db_options.max_background_jobs;
+  result.max_subcompactions = db_options.max_subcompactions;
+  result.max_manifest_file_size = db_options.max_manifest_file_size;
+  result.use_mmap_reads = db_options.use_mmap_reads;
+  result.use_direct_io_for_flush_and_compaction =
+      db_options.use_direct_io_for_flush_and_compaction;
+  result.use_direct_reads_for_compaction =
+      db_options.use_direct_reads_for_compaction;
+  result.bytes_per_sync = db_options.bytes_per_sync;
+  result.initial_auto_readahead_size = db_options.initial_auto_readahead_size;
+  result.max_auto_readahead_size = db_options.max_auto_readahead_size;
+  result.rate_limiter = db_options.rate_limiter;
+  result.statistics = db_options.statistics;
+  if (result.block_cache == nullptr) {
+    result.block_cache = db_options.block_cache;
+    if (result.secondary_cache == nullptr) {
+      result.secondary_cache = db_options.secondary_cache;
+    }
+  }
+  if (result.row_cache == nullptr) {
+    result.row_cache = db_options.row_cache;
+  }
+  // 限速和停写的阈值比触发compaction的阈值低的时候，写入会一直等待
+  result.level0_slowdown_writes_trigger =
+      std::max(result.level0_slowdown_writes_trigger,
+               result.level0_file_num_compaction_trigger);
+  result.level0_stop_writes_trigger = std::max(
+      result.level0_stop_writes_trigger, result.level0_slowdown_writes_trigger);
+  // FIFO方式下整个删除sst不会记录其中引用的blob变成了垃圾，blob文件永远不会被回收
+  if (result.compaction_style == kCompactionStyleFIFO) {
+    result.min_blob_size = 0;
+  }
+  return result;
+}
+
+namespace {
+int sv_in_use_dummy = 0;
+
+// 线程退出或者ColumnFamilyData析构的时候释放线程缓存的SuperVersion；
+// ColumnFamilyData自己还持有引用，这里不会是最后一个，不需要db的锁
+void SuperVersionUnrefHandle(void* ptr) {
+  SuperVersion* sv = static_cast<SuperVersion*>(ptr);
+  const bool last = sv->Unref();
+  (void)last;
+  assert(!last);
+}
+}  // namespace
+
+void* const SuperVersion::kSVInUse = &sv_in_use_dummy;
+void* const SuperVersion::kSVObsolete = nullptr;
+
+void SuperVersion::Cleanup() {
+  mem->Unref();
+  if (imm != nullptr) {
+    imm->Unref();
+  }
+  current->Unref();
+}
+
+ColumnFamilyData::ColumnFamilyData(uint32_t id, const std::string& name,
+                                   VersionSet* vset, const Options& options)
+    : id_(id),
+      name_(name),
+      vset_(vset),
+      user_comparator_(options.comparator
+                           ? options.comparator
+                           : std::make_shared<ByteComparator>()),
+      icmp_(user_comparator_.get()),
+      options_(options),
+      dummy_versions_(this) {
+  options_.comparator =
+      std::make_shared<InternalKeyComparator>(user_comparator_.get());
+  if (options.filter_policy) {
+    options_.filter_policy = std::make_shared<InternalFilterPolicy>(
+        options.filter_policy, options.prefix_extractor);
+  }
+  table_cache_ = std::make_unique<TableCache>(vset_->dbname_, &options_);
+  local_sv_ = std::make_unique<ThreadLocalPtr>(&SuperVersionUnrefHandle);
+  mem_ = NewMemTable();
+  mem_->Ref();
+  AppendVersion(new Version(this));
+  vset_->all_column_families_.insert(this);
+}
+
+ColumnFamilyData::~ColumnFamilyData() {
+  assert(refs_ == 0);
+  vset_->all_column_families_.erase(this);
+  // 先释放线程缓存中的引用，最后一个引用由这里释放
+  local_sv_.reset();
+  if (super_version_->Unref()) {
+    super_version_->Cleanup();
+    delete super_version_;
+  }
+  if (mem_ != nullptr) {
+    mem_->Unref();
+  }
+  if (imm_ != nullptr) {
+    imm_->Unref();
+  }
+  current_->Unref();
+  // 所有的迭代器都应该在db关闭之前释放
+  assert(dummy_versions_.next_ == &dummy_versions_);
+}
+
+void ColumnFamilyData::Unref() {
+  assert(refs_ >= 1);
+  if (--refs_ == 0) {
+    delete this;
+  }
+}
+
+MemTable* ColumnFamilyData::NewMemTable() const {
+  uint64_t block_size = options_.arena_block_size;
+  if (block_size == 0) {
+    block_size = options_.write_buffer_size / 8;
+  }
+  block_size = std::clamp<uint64_t>(block_size, 4 * 1024, 8 * 1024 * 1024);
+  return new MemTable(icmp_, block_size, options_.memtable_huge_page_size,
+                      options_.memtable_numa_node,
+                      options_.memtable_factory.get());
+}
+
+void ColumnFamilyData::SwitchMemTable(uint64_t log_number) {
+  assert(imm_ == nullptr);
+  mem_log_number_ = log_number;
+  imm_ = mem_;
+  mem_ = NewMemTable();
+  mem_->Ref();
+  InstallSuperVersion();
+}
+
+void ColumnFamilyData::ReplaceMemTable(MemTable* mem) {
+  mem_->Unref();
+  mem_ = mem;
+  InstallSuperVersion();
+}
+
+void ColumnFamilyData::ClearImmutableMemTable() {
+  assert(imm_ != nullptr);
+  imm_->Unref();
+  imm_ = nullptr;
+  InstallSuperVersion();
+}
+
+void ColumnFamilyData::InstallSuperVersion() {
+  SuperVersion* sv = new SuperVersion;
+  sv->mem = mem_;
+  sv->mem->Ref();
+  sv->imm = imm_;
+  if (sv->imm != nullptr) {
+    sv->imm->Ref();
+  }
+  sv->current = current_;
+  sv->current->Ref();
+  sv->version_number = super_version_number_.load(std::memory_order_relaxed) + 1;
+  sv->Ref();
+  SuperVersion* old = super_version_;
+  super_version_ = sv;
+  super_version_number_.store(sv->version_number, std::memory_order_release);
+  // 线程缓存的旧SuperVersion全部作废，正在使用的由读请求结束的时候自己释放；
+  // old的引用还没有释放，这里不会是最后一个
+  std::vector<void*> cached;
+  local_sv_->Scrape(&cached, SuperVersion::kSVObsolete);
+  for (void* ptr : cached) {
+    if (ptr != SuperVersion::kSVInUse) {
+      static_cast<SuperVersion*>(ptr)->Unref();
+    }
+  }
+  if (old != nullptr && old->Unref()) {
+    old->Cleanup();
+    delete old;
+  }
+}
+
+SuperVersion* ColumnFamilyData::GetThreadLocalSuperVersion(
+    std::mutex* db_mutex) {
+  void* ptr = local_sv_->Swap(SuperVersion::kSVInUse);
+  assert(ptr != SuperVersion::kSVInUse);
+  SuperVersion* sv = static_cast<SuperVersion*>(ptr);
+  if (sv != nullptr &&
+      sv->version_number ==
+          super_version_number_.load(std::memory_order_acquire)) {
+    return sv;
+  }
+  // 缓存为空或者已经过期
+  std::lock_guard<std::mutex> lock(*db_mutex);
+  if (sv != nullptr && sv->Unref()) {
+    sv->Cleanup();
+    delete sv;
+  }
+  sv = super_version_;
+  sv->Ref();
+  return sv;
+}
+
+void ColumnFamilyData::ReturnThreadLocalSuperVersion(SuperVersion* sv,
+                                                      std::mutex* db_mutex) {
+  void* expected = SuperVersion::kSVInUse;
+  if (local_sv_->CompareAndSwap(sv, expected)) {
+    return;
+  }
+  // 使用期间InstallSuperVersion作废了缓存
+  assert(expected == SuperVersion::kSVObsolete);
+  if (sv->Unref()) {
+    std::lock_guard<std::mutex> lock(*db_mutex);
+    sv->Cleanup();
+    delete sv;
+  }
+}
+
+void ColumnFamilyData::AppendVersion(Version* v) {
+  assert(v->refs_ == 0);
+  assert(v != current_);
+  if (current_ != nullptr) {
+    current_->Unref();
+  }
+  current_ = v;
+  v->Ref();
+  // 插入到链表的尾部
+  v->prev_ = dummy_versions_.prev_;
+  v->next_ = &dummy_versions_;
+  v->prev_->next_ = v;
+  v->next_->prev_ = v;
+  InstallSuperVersion();
+}
+
+void ColumnFamilyData::SortFiles(Version* v) {
+  std::sort(v->files_[0].begin(), v->files_[0].end(),
+            [](FileMetaData* a, FileMetaData* b) { return NewestFirst(b, a); });
+  for (int32_t level = 1; level < config::kNumLevels; ++level) {
+    std::sort(v->files_[level].begin(), v->files_[level].end(),
+              [this](FileMetaData* a, FileMetaData* b) {
+                return icmp_.Compare(a->smallest, b->smallest) < 0;
+              });
+  }
+}
+
+static uint64_t TotalFileSize(const std::vector<FileMetaData*>& files) {
+  uint64_t sum = 0;
+  for (const auto* f : files) {
+    sum += f->file_size;
+  }
+  return sum;
+}
+
+uint64_t Version::NumLevelBytes(int32_t level) const {
+  return TotalFileSize(files_[level]);
+}
+
+double ColumnFamilyData::MaxBytesForLevel(int32_t level) const {
+  double result = options_.max_bytes_for_level_base;
+  while (level > 1) {
+    result *= options_.max_bytes_for_level_multiplier;
+    --level;
+  }
+  return result;
+}
+
+void ColumnFamilyData::Finalize(Version* v) {
+  // FIFO方式下只会整个删除sst，没有需要重写的数据
+  if (options_.compaction_style == kCompactionStyleFIFO) {
+    v->estimated_pending_compaction_bytes_ = 0;
+    return;
+  }
+  // 最后一层不需要再往下compaction
+  for (int32_t level = 0; level < config::kNumLevels - 1; ++level) {
+    if (level == 0) {
+      // level0按照文件个数计算，每次读都需要查找所有有重叠的level0文件
+      v->compaction_score_[level] =
+          v->files_[level].size() /
+          static_cast<double>(options_.level0_file_num_compaction_trigger);
+    } else {
+      v->compaction_score_[level] =
+          TotalFileSize(v->files_[level]) / MaxBytesForLevel(level);
+    }
+  }
+  // level0触发compaction的时候和level1一起重写；其他层超出上限的部分合并到下一层，
+  // 下一层按照层之间的倍数估计被重写的字节数，同时下一层也会因此超出上限
+  uint64_t pending = 0;
+  uint64_t incoming = 0;
+  if (v->files_[0].size() >=
+      static_cast<size_t>(options_.level0_file_num_compaction_trigger)) {
+    incoming = TotalFileSize(v->files_[0]);
+    pending += incoming + TotalFileSize(v->files_[1]);
+  }
+  for (int32_t level = 1; level < config::kNumLevels - 1; ++level) {
+    const uint64_t level_bytes = TotalFileSize(v->files_[level]) + incoming;
+    const auto max_bytes = static_cast<uint64_t>(MaxBytesForLevel(level));
+    incoming = 0;
+    if (level_bytes > max_bytes) {
+      incoming = level_bytes - max_bytes;
+      pending += incoming * (options_.max_bytes_for_level_multiplier + 1);
+    }
+  }
+  v->estimated_pending_compaction_bytes_ = pending;
+}
+
+void ColumnFamilyData::GetRange(const std::vector<FileMetaData*>& inputs,
+                                std::string* smallest, std::string* largest) {
+  assert(!inputs.empty());
+  smallest->clear();
+  largest->clear();
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    FileMetaData* f = inputs[i];
+    if (i == 0) {
+      *smallest = f->smallest;
+      *largest = f->largest;
+    } else {
+      if (icmp_.Compare(f->smallest, *smallest) < 0) {
+        *smallest = f->smallest;
+      }
+      if (icmp_.Compare(f->largest, *largest) > 0) {
+        *largest = f->largest;
+      }
+    }
+  }
+}
+
+VersionSet::VersionSet(const std::string& dbname, const Options* options,
+                       BlobSource* blob_source)
+    : dbname_(dbname), options_(options), blob_source_(blob_source) {}
+
+VersionSet::~VersionSet() {
+  if (descriptor_file_) {
+    descriptor_file_->Close();
+  }
+  for (const auto& item : column_families_) {
+    item.second->Unref();
+  }
+  column_families_.clear();
+  // 所有的handle都应该在db关闭之前释放
+  assert(all_column_families_.empty());
+}
+
+ColumnFamilyData* VersionSet::GetColumnFamily(const std::string& name) const {
+  for (const auto& item : column_families_) {
+    if (item.second->name() == name) {
+      return item.second;
+    }
+  }
+  return nullptr;
+}
+
+uint64_t VersionSet::MinLogNumber() const {
+  uint64_t result = std::numeric_limits<uint64_t>::max();
+  for (const auto& item : column_families_) {
+    result = std::min(result, item.second->LogNumber());
+  }
+  return result;
+}
+
+void VersionSet::Apply(Version* base, const VersionEdit* edit, Version* v) {
+  for (int32_t level = 0; level < config::kNumLevels; ++level) {
+    for (auto* f : base->files_[level]) {
+      if (edit->deleted_files_.count(std::make_pair(level, f->number)) == 0) {
+        ++f->refs;
+        v->files_[level].push_back(f);
+      }
+    }
+  }
+  for (const auto& new_file : edit->new_files_) {
+    const int32_t level = new_file.first;
+    if (edit->deleted_files_.count(
+            std::make_pair(level, new_file.second.number)) != 0) {
+      continue;
+    }
+    FileMetaData* f = new FileMetaData(new_file.second);
+    f->refs = 1;
+    v->files_[level].push_back(f);
+  }
+  v->blob_files_ = base->blob_files_;
+  ApplyBlobFiles(edit, &v->blob_files_);
+  v->cfd_->SortFiles(v);
+  v->cfd_->Finalize(v);
+}
+
+void VersionSet::ApplyBlobFiles(
+    const VersionEdit* edit, std::map<uint64_t, BlobFileMetaData>* blob_files) {
+  for (const auto& f : edit->new_blob_files_) {
+    (*blob_files)[f.number] = f;
+  }
+  for (const auto& garbage : edit->blob_garbage_) {
+    auto iter = blob_files->find(garbage.first);
+    if (iter == blob_files->end()) {
+      continue;
+    }
+    BlobFileMetaData& f = iter->second;
+    f.garbage_count += garbage.second.first;
+    f.garbage_bytes += garbage.second.second;
+    if (f.garbage_count >= f.total_count) {
+      blob_files->erase(iter);
+    }
+  }
+}
+
+// 恢复的时候把MANIFEST中的所有edit累积起来，最后只生成一个版本，
+// 避免每条记录都复制一遍所有的FileMetaData
+class VersionSet::Builder final {
+ public:
+  void Apply(const VersionEdit* edit) {
+    for (const auto& deleted : edit->deleted_files_) {
+      files_[deleted.first].erase(deleted.second);
+    }
+    for (const auto& new_file : edit->new_files_) {
+      const int32_t level = new_file.first;
+      if (edit->deleted_files_.count(
+              std::make_pair(level, new_file.second.number)) == 0) {
+        files_[level][new_file.second.number] = new_file.second;
+      }
+    }
+    VersionSet::ApplyBlobFiles(edit, &blob_files_);
+  }
+
+  void SaveTo(Version* v) {
+    for (int32_t level = 0; level < config::kNumLevels; ++level) {
+      v->files_[level].reserve(files_[level].size());
+      for (const auto& item : files_[level]) {
+        FileMetaData* f = new FileMetaData(item.second);
+        f->refs = 1;
+        v->files_[level].push_back(f);
+      }
+    }
+    v->blob_files_ = blob_files_;
+    v->cfd_->SortFiles(v);
+    v->cfd_->Finalize(v);
+  }
+
+ private:
+  std::map<uint64_t, FileMetaData> files_[config::kNumLevels];
+  std::map<uint64_t, BlobFileMetaData> blob_files_;
+};
+
+uint64_t VersionSet::NumLevelBytes(ColumnFamilyData* cfd, int32_t level) const {
+  return TotalFileSize(cfd->current_->files_[level]);
+}
+
+Compaction* VersionSet::PickCompaction(ColumnFamilyData* cfd) {
+  if (cfd->options().compaction_style == kCompactionStyleUniversal) {
+    return PickUniversalCompaction(cfd);
+  }
+  if (cfd->options().compaction_style == kCompactionStyleFIFO) {
+    return PickFIFOCompaction(cfd);
+  }
+  Version* v = cfd->current_;
+  int32_t level = -1;
+  double best_score = 1;
+  for (int32_t i = 0; i < config::kNumLevels - 1; ++i) {
+    if (cfd->level_compacting_[i] || cfd->level_compacting_[i + 1]) {
+      continue;
+    }
+    if (v->compaction_score_[i] >= best_score) {
+      best_score = v->compaction_score_[i];
+      level = i;
+    }
+  }
+  if (level < 0 || v->files_[level].empty()) {
+    return nullptr;
+  }
+  Compaction* c = new Compaction(cfd, level);
+  // 从上一次compaction结束的位置开始选，到了最后之后再从头开始
+  std::string& compact_pointer = cfd->compact_pointer_[level];
+  for (auto* f : v->files_[level]) {
+    if (compact_pointer.empty() ||
+        cfd->icmp_.Compare(f->largest, compact_pointer) > 0) {
+      c->inputs_[0].push_back(f);
+      break;
+    }
+  }
+  if (c->inputs_[0].empty()) {
+    c->inputs_[0].push_back(v->files_[level][0]);
+  }
+  std::string smallest, largest;
+  if (level == 0) {
+    cfd->GetRange(c->inputs_[0], &smallest, &largest);
+    v->GetOverlappingInputs(0, &smallest, &largest, &c->inputs_[0]);
+  }
+  cfd->GetRange(c->inputs_[0], &smallest, &largest);
+  v->GetOverlappingInputs(level + 1, &smallest, &largest, &c->inputs_[1]);
+  compact_pointer = largest;
+
+  c->input_version_ = v;
+  v->Ref();
+  cfd->level_compacting_[level] = true;
+  cfd->level_compacting_[level + 1] = true;
+  return c;
+}
+
+Compaction* VersionSet::PickUniversalCompaction(ColumnFamilyData* cfd) {
+  Version* v = cfd->current_;
+  const Options& options = cfd->options();
+  const auto& uopts = options.compaction_options_universal;
+  // 同一时刻只有一个universal compaction，保证选出来的run和输出在时间上都是连续的
+  if (cfd->level_compacting_[0] ||
+      v->files_[0].size() <
+          static_cast<size_t>(options.level0_file_num_compaction_trigger) ||
+      v->files_[0].size() < 2) {
+    return nullptr;
+  }
+  // 从新到旧
+  const std::vector<FileMetaData*> runs(v->files_[0].rbegin(),
+                                        v->files_[0].rend());
+  size_t start = 0;
+  size_t count = 0;
+  uint64_t newer_bytes = 0;
+  for (size_t i = 0; i + 1 < runs.size(); ++i) {
+    newer_bytes += runs[i]->file_size;
+  }
+  if (newer_bytes * 100 >=
+      static_cast<uint64_t>(uopts.max_size_amplification_percent) *
+          runs.back()->file_size) {
+    count = runs.size();
+  }
+  const size_t min_width = std::max<size_t>(2, uopts.min_merge_width);
+  const size_t max_width =
+      std::max<size_t>(min_width, uopts.max_merge_width);
+  for (size_t i = 0; count == 0 && i + 1 < runs.size(); ++i) {
+    uint64_t candidate_bytes = runs[i]->file_size;
+    size_t j = i + 1;
+    for (; j < runs.size() && j - i < max_width; ++j) {
+      if (candidate_bytes * (100 + uopts.size_ratio) / 100 <
+          runs[j]->file_size) {
+        break;
+      }
+      candidate_bytes += runs[j]->file_size;
+    }
+    if (j - i >= min_width) {
+      start = i;
+      count = j - i;
+    }
+  }
+  if (count == 0) {
+    count = std::clamp<size_t>(
+        runs.size() - options.level0_file_num_compaction_trigger + 1, 2,
+        runs.size());
+  }
+
+  Compaction* c = new Compaction(cfd, 0);
+  c->output_level_ = 0;
+  // 输出只能是一个run，不按照大小切分文件，也就不会拆分成子任务
+  c->max_output_file_size_ = std::numeric_limits<uint64_t>::max();
+  c->has_older_runs_ = (start + count < runs.size());
+  // 和level0的顺序一致，从旧到新
+  for (size_t i = start + count; i > start; --i) {
+    c->inputs_[0].push_back(runs[i - 1]);
+  }
+  c->input_version_ = v;
+  v->Ref();
+  cfd->level_compacting_[0] = true;
+  return c;
+}
+
+Compaction* VersionSet::PickFIFOCompaction(ColumnFamilyData* cfd) {
+  Version* v = cfd->current_;
+  const auto& fopts = cfd->options().compaction_options_fifo;
+  if (cfd->level_compacting_[0] || v->files_[0].empty()) {
+    return nullptr;
+  }
+  uint64_t total_bytes = TotalFileSize(v->files_[0]);
+  const uint64_t now = util::GetCurrentTime();
+  Compaction* c = nullptr;
+  // level0从旧到新
+  for (FileMetaData* f : v->files_[0]) {
+    const bool expired = fopts.ttl_ms > 0 && f->file_creation_time > 0 &&
+                         f->file_creation_time + fopts.ttl_ms <= now;
+    if (!expired && total_bytes <= fopts.max_table_files_size) {
+      break;
+    }
+    if (c == nullptr) {
+      c = new Compaction(cfd, 0);
+      c->output_level_ = 0;
+      c->is_deletion_compaction_ = true;
+    }
+    c->inputs_[0].push_back(f);
+    total_bytes -= f->file_size;
+  }
+  if (c == nullptr) {
+    return nullptr;
+  }
+  c->input_version_ = v;
+  v->Ref();
+  cfd->level_compacting_[0] = true;
+  return c;
+}
+
+void VersionSet::ReleaseCompaction(Compaction* c) {
+  c->cfd_->level_compacting_[c->level()] = false;
+  c->cfd_->level_compacting_[c->output_level()] = false;
+}
+
+int32_t VersionSet::PickLevelForIngestedFile(ColumnFamilyData* cfd,
+                                             const std::string& smallest,
+                                             const std::string& largest) {
+  if (cfd->options().compaction_style != kCompactionStyleLevel) {
+    return 0;
+  }
+  Version* current = cfd->current_;
+  std::vector<FileMetaData*> overlaps;
+  current->GetOverlappingInputs(0, &smallest, &largest, &overlaps);
+  if (!overlaps.empty()) {
+    return 0;
+  }
+  int32_t level = 0;
+  while (level + 1 < config::kNumLevels) {
+    // 正在进行的compaction的输出可能会覆盖这一层中的空隙
+    if (cfd->level_compacting_[level + 1]) {
+      break;
+    }
+    current->GetOverlappingInputs(level + 1, &smallest, &largest, &overlaps);
+    if (!overlaps.empty()) {
+      break;
+    }
+    ++level;
+  }
+  return level;
+}
+
+Iterator* VersionSet::MakeInputIterator(Compaction* c) {
+  ReadOptions options;
+  options.for_compaction = true;
+  std::vector<Iterator*> list;
+  for (int32_t which = 0; which < 2; ++which) {
+    for (auto* f : c->inputs_[which]) {
+      if (c->skipped_inputs_.count(f->number) == 0) {
+        list.push_back(c->cfd_->table_cache_->NewIterator(
+            options, f->number, f->file_size, f->global_seqno));
+      }
+    }
+  }
+  return NewMergingIterator(&c->cfd_->icmp_, list.data(), list.size());
+}
+
+void VersionSet::GetSubcompactionBoundaries(
+    Compaction* c, int32_t n, std::vector<std::string>* boundaries) {
+  boundaries->clear();
+  if (n <= 1) {
+    return;
+  }
+  std::vector<std::string> keys;
+  for (int32_t which = 0; which < 2; ++which) {
+    for (auto* f : c->inputs_[which]) {
+      c->cfd_->table_cache_->GetIndexKeys(f->number, f->file_size, &keys);
+    }
+  }
+  // 边界只取user key，保证同一个user key的所有版本落在同一个子任务中
+  Comparator* ucmp = c->cfd_->user_comparator();
+  std::vector<std::string> user_keys;
+  user_keys.reserve(keys.size());
+  for (const auto& key : keys) {
+    user_keys.emplace_back(ExtractUserKey(key));
+  }
+  std::sort(user_keys.begin(), user_keys.end(),
+            [ucmp](const std::string& a, const std::string& b) {
+              return ucmp->Compare(a, b) < 0;
+            });
+  user_keys.erase(std::unique(user_keys.begin(), user_keys.end(),
+                              [ucmp](const std::string& a,
+                                     const std::string& b) {
+                                return ucmp->Compare(a, b) == 0;
+                              }),
+                  user_keys.end());
+  // 每个index key大致对应一个data block，按照个数均分即可
+  const size_t num = std::min<size_t>(n, user_keys.size());
+  for (size_t i = 1; i < num; ++i) {
+    const std::string& key = user_keys[i * user_keys.size() / num];
+    if (boundaries->empty() || ucmp->Compare(boundaries->back(), key) < 0) {
+      boundaries->push_back(key);
+    }
+  }
+}
+
+Compaction::Compaction(ColumnFamilyData* cfd, int32_t level)
+    : cfd_(cfd),
+      level_(level),
+      output_level_(level + 1),
+      max_output_file_size_(cfd->options().max_file_size) {
+  cfd_->Ref();
+}
+
+Compaction::~Compaction() {
+  if (input_version_ != nullptr) {
+    input_version_->Unref();
+  }
+  cfd_->Unref();
+}
+
+bool Compaction::IsTrivialMove() const {
+  return output_level_ != level_ && num_input_files(0) == 1 &&
+         num_input_files(1) == 0;
+}
+
+void Compaction::AddInputDeletions(VersionEdit* edit) {
+  for (int32_t which = 0; which < 2; ++which) {
+    for (auto* f : inputs_[which]) {
+      edit->RemoveFile(level_ + which, f->number);
+    }
+  }
+}
+
+uint64_t Compaction::TotalInputBytes() const {
+  uint64_t bytes = 0;
+  for (int32_t which = 0; which < 2; ++which) {
+    for (auto* f : inputs_[which]) {
+      bytes += f->file_size;
+    }
+  }
+  return bytes;
+}
+
+bool Compaction::IsBaseLevelForKey(const std::string_view& user_key,
+                                   size_t* level_ptrs) const {
+  if (has_older_runs_) {
+    return false;
+  }
+  Comparator* ucmp = cfd_->user_comparator();
+  // universal方式下更高的层中可能还有切换之前leveled方式写入的数据
+  for (int32_t lvl = output_level_ + 1; lvl < config::kNumLevels; ++lvl) {
+    const auto& files = input_version_->files_[lvl];
+    while (level_ptrs[lvl] < files.size()) {
+      FileMetaData* f = files[level_ptrs[lvl]];
+      if (ucmp->Compare(user_key, ExtractUserKey(f->largest)) <= 0) {
+        if (ucmp->Compare(user_key, ExtractUserKey(f->smallest)) >= 0) {
+          return false;
+        }
+        break;
+      }
+      // user_key是递增的，之后不需要再检查这个文件
+      ++level_ptrs[lvl];
+    }
+  }
+  return true;
+}
+
+bool Compaction::IsBaseLevelForRange(const std::string_view& begin,
+                                     const std::string_view& end) const {
+  if (has_older_runs_) {
+    return false;
+  }
+  Comparator* ucmp = cfd_->user_comparator();
+  for (int32_t lvl = output_level_ + 1; lvl < config::kNumLevels; ++lvl) {
+    for (auto* f : input_version_->files_[lvl]) {
+      if (ucmp->Compare(ExtractUserKey(f->smallest), end) < 0 &&
+          ucmp->Compare(ExtractUserKey(f->largest), begin) >= 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+DBStatus VersionSet::WriteSnapshot(uint64_t manifest_number) {
+  descriptor_file_ = std::make_unique<FileWriter>(
+      FileName::DescriptorFileName(dbname_, manifest_number));
+  descriptor_log_ = std::make_unique<log::Writer>(descriptor_file_.get());
+  manifest_file_size_ = 0;
+  // 每个column family一条记录，默认column family在最前面
+  for (const auto& item : column_families_) {
+    ColumnFamilyData* cfd = item.second;
+    VersionEdit edit;
+    if (cfd->id() == 0) {
+      edit.SetNextFile(next_file_number_);
+      edit.SetLastSequence(last_sequence_);
+      edit.SetMaxColumnFamily(max_column_family_);
+    } else {
+      edit.SetColumnFamily(cfd->id());
+      edit.AddColumnFamily(cfd->name());
+    }
+    edit.SetComparatorName(cfd->user_comparator()->Name());
+    edit.SetLogNumber(cfd->log_number_);
+    for (int32_t level = 0; level < config::kNumLevels; ++level) {
+      for (const auto* f : cfd->current_->files_[level]) {
+        edit.AddFile(level, *f);
+      }
+    }
+    for (const auto& blob : cfd->current_->blob_files_) {
+      const BlobFileMetaData& f = blob.second;
+      edit.AddBlobFile(f.number, f.total_count, f.total_bytes);
+      if (f.garbage_count > 0) {
+        edit.AddBlobGarbage(f.number, f.garbage_count, f.garbage_bytes);
+      }
+    }
+    std::string record;
+    edit.EncodeTo(&record);
+    DBStatus s = descriptor_log_->AddRecord(record);
+    if (s != Status::kSuccess) {
+      return s;
+    }
+    manifest_file_size_ += record.size();
+  }
+  return Status::kSuccess;
+}
+
+DBStatus VersionSet::LogAndApply(ColumnFamilyData* cfd, VersionEdit* edit) {
+  assert(!read_only_);
+  edit->SetColumnFamily(cfd->id());
+  if (edit->has_log_number_) {
+    assert(edit->log_number_ >= cfd->log_number_);
+    assert(edit->log_number_ < next_file_number_);
+  } else {
+    edit->SetLogNumber(cfd->log_number_);
+  }
+  Version* v = new Version(cfd);
+  Apply(cfd->current_, edit, v);
+
+  DBStatus s = Status::kSuccess;
+  uint64_t new_manifest_number = 0;
+  if (!descriptor_log_ ||
+      manifest_file_size_ >= options_->max_manifest_file_size) {
+    // 新的MANIFEST以当前版本的快照开头，后面紧跟着这次的edit
+    new_manifest_number = NewFileNumber();
+    s = WriteSnapshot(new_manifest_number);
+  }
+  edit->SetNextFile(next_file_number_);
+  edit->SetLastSequence(last_sequence_);
+  if (s == Status::kSuccess) {
+    std::string record;
+    edit->EncodeTo(&record);
+    s = descriptor_log_->AddRecord(record);
+    manifest_file_size_ += record.size();
+  }
+  if (s == Status::kSuccess) {
+    s = descriptor_file_->Sync();
+  }
+  if (s == Status::kSuccess && new_manifest_number != 0) {
+    s = FileName::SetCurrentFile(dbname_, new_manifest_number);
+  }
+
+  if (s == Status::kSuccess) {
+    cfd->AppendVersion(v);
+    cfd->log_number_ = edit->log_number_;
+    if (new_manifest_number != 0) {
+      manifest_file_number_ = new_manifest_number;
+    }
+  } else {
+    delete v;
+    // MANIFEST的尾部可能有写了一半的记录，下一次切换到新的MANIFEST
+    if (descriptor_file_) {
+      descriptor_file_->Close();
+    }
+    descriptor_log_.reset();
+    descriptor_file_.reset();
+    if (new_manifest_number != 0) {
+      FileTool::RemoveFile(
+          FileName::DescriptorFileName(dbname_, new_manifest_number));
+    }
+  }
+  return s;
+}
+
+DBStatus VersionSet::CreateColumnFamily(
+    const ColumnFamilyDescriptor& descriptor, uint64_t log_number,
+    ColumnFamilyData** result) {
+  *result = nullptr;
+  if (GetColumnFamily(descriptor.name) != nullptr) {
+    return Status::kInvalidArgument;
+  }
+  const uint32_t id = max_column_family_ + 1;
+  auto* cfd = new ColumnFamilyData(
+      id, descriptor.name, this,
+      SanitizeColumnFamilyOptions(*options_, descriptor.options));
+  cfd->Ref();
+  VersionEdit edit;
+  edit.AddColumnFamily(descriptor.name);
+  edit.SetComparatorName(cfd->user_comparator()->Name());
+  edit.SetLogNumber(log_number);
+  edit.SetMaxColumnFamily(id);
+  // 写入MANIFEST之前cfd还不在column_families_中，不会出现在快照里
+  DBStatus s = LogAndApply(cfd, &edit);
+  if (s != Status::kSuccess) {
+    cfd->Unref();
+    return s;
+  }
+  max_column_family_ = id;
+  column_families_[id] = cfd;
+  *result = cfd;
+  return Status::kSuccess;
+}
+
+DBStatus VersionSet::DropColumnFamily(ColumnFamilyData* cfd) {
+  assert(cfd->id() != 0 && !cfd->IsDropped());
+  VersionEdit edit;
+  edit.DropColumnFamily();
+  DBStatus s = LogAndApply(cfd, &edit);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  cfd->dropped_ = true;
+  column_families_.erase(cfd->id());
+  cfd->Unref();
+  return Status::kSuccess;
+}
+
+// 读取CURRENT，返回它指向的MANIFEST的路径和编号
+static DBStatus ReadCurrentFile(const std::string& dbname,
+                                std::string* manifest_name,
+                                uint64_t* manifest_number) {
+  const std::string& current_name = FileName::CurrentFileName(dbname);
+  std::string current;
+  {
+    FileReader reader(current_name);
+    DBStatus s = reader.Read(0, FileTool::GetFileSize(current_name), &current);
+    if (s != Status::kSuccess) {
+      return s;
+    }
+  }
+  if (current.empty() || current.back() != '\n') {
+    return Status::kCorruption;
+  }
+  current.resize(current.size() - 1);
+  FileType type;
+  if (!FileName::ParseFileName(current, manifest_number, &type) ||
+      type != FileType::kDescriptorFile) {
+    return Status::kCorruption;
+  }
+  *manifest_name = dbname + "/" + current;
+  return Status::kSuccess;
+}
+
+DBStatus VersionSet::Recover(
+    const std::vector<ColumnFamilyDescriptor>& column_families,
+    std::vector<std::string>* missing, bool read_only) {
+  std::string manifest_name;
+  uint64_t manifest_number;
+  DBStatus s = ReadCurrentFile(dbname_, &manifest_name, &manifest_number);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  FileReader file(manifest_name);
+  if (!file.IsOpen()) {
+    return Status::kCorruption;
+  }
+  bool have_log_number = false;
+  bool have_next_file = false;
+  bool have_last_sequence = false;
+  uint64_t next_file = 0;
+  SequenceNumber last_sequence = 0;
+  uint32_t max_column_family = 0;
+  // MANIFEST中还没有被删除的column family
+  struct ColumnFamilyState {
+    std::string name;
+    std::string comparator;
+    uint64_t log_number = 0;
+    Builder builder;
+  };
+  std::map<uint32_t, ColumnFamilyState> states;
+  states[0].name = kDefaultColumnFamilyName;
+  // 依次应用MANIFEST中的每一条记录
+  log::Reader reader(&file, true);
+  std::string_view record;
+  std::string scratch;
+  while (s == Status::kSuccess && reader.ReadRecord(&record, &scratch)) {
+    VersionEdit edit;
+    s = edit.DecodeFrom(record);
+    if (s != Status::kSuccess) {
+      break;
+    }
+    if (edit.is_column_family_add_) {
+      if (states.count(edit.column_family_) != 0) {
+        s = Status::kCorruption;
+        break;
+      }
+      states[edit.column_family_].name = edit.column_family_name_;
+    }
+    auto iter = states.find(edit.column_family_);
+    if (iter == states.end()) {
+      s = Status::kCorruption;
+      break;
+    }
+    max_column_family = std::max(max_column_family, edit.column_family_);
+    if (edit.has_max_column_family_) {
+      max_column_family = std::max(max_column_family, edit.max_column_family_);
+    }
+    if (edit.is_column_family_drop_) {
+      states.erase(iter);
+    } else {
+      ColumnFamilyState& state = iter->second;
+      if (edit.has_comparator_) {
+        state.comparator = edit.comparator_;
+      }
+      state.builder.Apply(&edit);
+      if (edit.has_log_number_) {
+        state.log_number = edit.log_number_;
+        have_log_number = true;
+      }
+    }
+    if (edit.has_next_file_number_) {
+      next_file = edit.next_file_number_;
+      have_next_file = true;
+    }
+    if (edit.has_last_sequence_) {
+      last_sequence = edit.last_sequence_;
+      have_last_sequence = true;
+    }
+  }
+  if (s == Status::kSuccess &&
+      (!have_log_number || !have_next_file || !have_last_sequence)) {
+    s = Status::kCorruption;
+  }
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  for (auto& item : states) {
+    ColumnFamilyState& state = item.second;
+    auto desc = std::find_if(
+        column_families.begin(), column_families.end(),
+        [&state](const ColumnFamilyDescriptor& d) {
+          return d.name == state.name;
+        });
+    if (desc == column_families.end()) {
+      if (read_only) {
+        continue;
+      }
+      // 打开db的时候需要给出所有column family的配置
+      return Status::kInvalidArgument;
+    }
+    auto* cfd = new ColumnFamilyData(
+        item.first, state.name, this,
+        SanitizeColumnFamilyOptions(*options_, desc->options));
+    cfd->Ref();
+    column_families_[item.first] = cfd;
+    if (!state.comparator.empty() &&
+        state.comparator != cfd->user_comparator()->Name()) {
+      return Status::kInvalidArgument;
+    }
+    // sst只在第一次被访问的时候才由TableCache打开，这里只需要元数据
+    Version* v = new Version(cfd);
+    state.builder.SaveTo(v);
+    cfd->AppendVersion(v);
+    cfd->log_number_ = state.log_number;
+    MarkFileNumberUsed(state.log_number);
+  }
+  for (const auto& desc : column_families) {
+    if (GetColumnFamily(desc.name) == nullptr) {
+      missing->push_back(desc.name);
+    }
+  }
+  // MANIFEST还不大并且完整的话，后续的edit继续追加到这个文件中，不需要重新写快照
+  const uint64_t manifest_size = FileTool::GetFileSize(manifest_name);
+  read_only_ = read_only;
+  manifest_tail_offset_ = reader.LastRecordEndOffset();
+  if (!read_only && reader.DroppedBytes() == 0 &&
+      manifest_size < options_->max_manifest_file_size) {
+    descriptor_file_ = std::make_unique<FileWriter>(manifest_name, true);
+    descriptor_log_ =
+        std::make_unique<log::Writer>(descriptor_file_.get(), manifest_size);
+    manifest_file_size_ = manifest_size;
+  }
+  manifest_file_number_ = manifest_number;
+  next_file_number_ = next_file;
+  last_sequence_ = last_sequence;
+  max_column_family_ = max_column_family;
+  MarkFileNumberUsed(manifest_number);
+  return Status::kSuccess;
+}
+
+DBStatus VersionSet::CatchUpWithPrimary() {
+  assert(read_only_);
+  std::string manifest_name;
+  uint64_t manifest_number;
+  DBStatus s = ReadCurrentFile(dbname_, &manifest_name, &manifest_number);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  const bool new_manifest = manifest_number != manifest_file_number_;
+  FileReader file(manifest_name);
+  if (!file.IsOpen()) {
+    // primary刚刚切换了MANIFEST并且删除了CURRENT读到的旧文件，下次再试
+    return Status::kReadFileFailed;
+  }
+  // 新的MANIFEST中每个column family的第一条记录是全量快照，需要从空版本开始应用
+  std::set<uint32_t> from_scratch;
+  if (new_manifest) {
+    for (const auto& item : column_families_) {
+      from_scratch.insert(item.first);
+    }
+  }
+  log::Reader reader(&file, true, new_manifest ? 0 : manifest_tail_offset_);
+  std::string_view record;
+  std::string scratch;
+  while (reader.ReadRecord(&record, &scratch)) {
+    VersionEdit edit;
+    s = edit.DecodeFrom(record);
+    if (s != Status::kSuccess) {
+      return s;
+    }
+    if (edit.has_next_file_number_) {
+      MarkFileNumberUsed(edit.next_file_number_ - 1);
+    }
+    if (edit.has_last_sequence_ && edit.last_sequence_ > last_sequence_) {
+      last_sequence_ = edit.last_sequence_;
+    }
+    auto iter = column_families_.find(edit.column_family_);
+    if (iter == column_families_.end() || edit.is_column_family_drop_) {
+      continue;
+    }
+    ColumnFamilyData* cfd = iter->second;
+    Version* v = new Version(cfd);
+    if (from_scratch.erase(cfd->id()) != 0) {
+      Version empty(cfd);
+      Apply(&empty, &edit, v);
+    } else {
+      Apply(cfd->current_, &edit, v);
+    }
+    cfd->AppendVersion(v);
+    if (edit.has_log_number_) {
+      cfd->log_number_ = edit.log_number_;
+    }
+  }
+  manifest_file_number_ = manifest_number;
+  manifest_tail_offset_ = reader.LastRecordEndOffset();
+  return Status::kSuccess;
+}
+
+void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
+  for (ColumnFamilyData* cfd : all_column_families_) {
+    for (Version* v = cfd->dummy_versions_.next_; v != &cfd->dummy_versions_;
+         v = v->next_) {
+      for (int32_t level = 0; level < config::kNumLevels; ++level) {
+        for (const auto* f : v->files_[level]) {
+          live->insert(f->number);
+        }
+      }
+      for (const auto& item : v->blob_files_) {
+        live->insert(item.first);
+      }
+    }
+  }
+}
+
+void VersionSet::AddCurrentFiles(std::set<uint64_t>* live) const {
+  for (const auto& cf : column_families_) {
+    const Version* v = cf.second->current_;
+    for (int32_t level = 0; level < config::kNumLevels; ++level) {
+      for (const auto* f : v->files_[level]) {
+        live->insert(f->number);
+      }
+    }
+    for (const auto& item : v->blob_files_) {
+      live->insert(item.first);
+    }
+  }
+}
+
+uint64_t VersionSet::BlobGarbageCollectionCutoff(ColumnFamilyData* cfd) const {
+  const auto& blob_files = cfd->current_->blob_files_;
+  const size_t n = static_cast<size_t>(
+      blob_files.size() * cfd->options_.blob_garbage_collection_age_cutoff);
+  if (n == 0) {
+    return 0;
+  }
+  auto iter = blob_files.begin();
+  std::advance(iter, std::min(n, blob_files.size()) - 1);
+  return iter->first + 1;
+}
+}  // namespace corekv
@@ -0,0 +1,437 @@
+#ifndef DB_VERSION_SET_H_
+#define DB_VERSION_SET_H_
+#include <stdint.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../table/table_properties.h"
+#include "../utils/thread_local.h"
+#include "column_family.h"
+#include "dbformat.h"
+#include "iterator.h"
+#include "options.h"
+#include "range_del.h"
+#include "version_edit.h"
+
+namespace corekv {
+namespace log {
+class Writer;
+}
+class BlobSource;
+class ColumnFamilyData;
+class Compaction;
+class FileWriter;
+class LookupKey;
+class MemTable;
+class TableCache;
+class ThreadPool;
+class VersionSet;
+
+// 某一时刻一个column family中所有sst的快照，通过引用计数管理生命周期
+// Ref/Unref需要持有db的锁
+class Version final {
+ public:
+  void Ref();
+  void Unref();
+
+  // 依次从level0(从新到旧)到最高层查找，找到value或者删除标记之后就停止，
+  // 找到merge操作数的时候返回kMergeInProgress
+  // max_covering_tombstone_seq是memtable中覆盖key的range tombstone的最大序号，
+  // 找到的版本序号比它或者sst中覆盖key的tombstone小的时候按照已经删除处理
+  DBStatus Get(const ReadOptions& options, const LookupKey& key,
+               std::string* value,
+               SequenceNumber max_covering_tombstone_seq = 0);
+  // 批量查找，(*statuses)[i]和*values[i]是keys[i]的结果，和Get的返回值含义相同
+  // 每个sst只查找一次，落在同一个sst中的key一起交给TableCache::MultiGet
+  // max_covering_tombstone_seqs不为nullptr的时候和keys一一对应，含义同Get
+  void MultiGet(const ReadOptions& options,
+                const std::vector<const LookupKey*>& keys,
+                const std::vector<std::string*>& values,
+                std::vector<DBStatus>* statuses,
+                const std::vector<SequenceNumber>* max_covering_tombstone_seqs =
+                    nullptr);
+
+  // 把当前版本中所有sst的迭代器追加到iters中
+  void AddIterators(const ReadOptions& options, std::vector<Iterator*>* iters);
+  // 把当前版本中所有sst的range tombstone追加到tombstones中
+  DBStatus AddRangeTombstones(std::vector<RangeTombstone>* tombstones);
+  // 当前版本中所有sst的属性，没有properties block的旧文件不会出现在结果中
+  DBStatus GetTableProperties(TablePropertiesCollection* props);
+  // 把blocks(文件编号 -> 排好序的block偏移，见TableCache::GetCachedBlocks)中属于
+  // 当前版本的block读进block_cache，*stop变成true的时候提前结束；
+  // 读取失败的sst直接跳过，只是预热，不影响正确性
+  void LoadBlocks(const std::map<uint64_t, std::vector<uint64_t>>& blocks,
+                  const std::atomic<bool>* stop);
+  // 从level0开始把当前版本中最多limit个sst交给pool打开并放进TableCache，
+  // 打开失败的sst在第一次访问的时候重新打开；pool中的任务执行完之前需要持有版本的引用
+  void OpenTables(ThreadPool* pool, int32_t limit);
+  // internal key在[start, limit)之间的数据在sst中大致占用的字节数
+  uint64_t ApproximateSize(const std::string& start, const std::string& limit);
+  // 按照data block的大小把当前版本的数据大致均分成n份，返回n-1个递增的user key，
+  // 数据少的时候返回的边界可能不足n-1个
+  void GetApproximateKeyBoundaries(int32_t n,
+                                   std::vector<std::string>* boundaries);
+
+  int32_t NumFiles(int32_t level) const { return files_[level].size(); }
+  int32_t NumBlobFiles() const { return blob_files_.size(); }
+  // level层所有sst的总大小
+  uint64_t NumLevelBytes(int32_t level) const;
+  // 估计还需要compaction重写多少字节才能让每一层都不超过上限
+  uint64_t EstimatedPendingCompactionBytes() const {
+    return estimated_pending_compaction_bytes_;
+  }
+
+  // 找到level中和[begin,end]有重叠的sst，begin/end为nullptr表示不限制
+  // level0中的sst之间有重叠，需要不断扩大范围直到把所有相关的sst都包含进来
+  void GetOverlappingInputs(int32_t level, const std::string* begin,
+                            const std::string* end,
+                            std::vector<FileMetaData*>* inputs);
+
+ private:
+  friend class ColumnFamilyData;
+  friend class Compaction;
+  friend class VersionSet;
+  explicit Version(ColumnFamilyData* cfd)
+      : cfd_(cfd), next_(this), prev_(this) {}
+  Version(const Version&) = delete;
+  Version& operator=(const Version&) = delete;
+  ~Version();
+  // 所有sst中排在internal key之前的数据的大致字节数
+  uint64_t ApproximateOffsetOf(const std::string& ikey);
+
+  ColumnFamilyData* cfd_;
+  // column family中所有存活版本组成的双向链表
+  Version* next_;
+  Version* prev_;
+  int32_t refs_ = 0;
+  // level0从旧到新(见NewestFirst)，其他层按照smallest升序
+  std::vector<FileMetaData*> files_[config::kNumLevels];
+  // 还有value被sst引用的blob文件，按照编号排序
+  std::map<uint64_t, BlobFileMetaData> blob_files_;
+  // 每一层需要compaction的程度，大于等于1的时候才需要compaction
+  double compaction_score_[config::kNumLevels] = {0};
+  uint64_t estimated_pending_compaction_bytes_ = 0;
+};
+
+// 一次读取需要的一致视图: memtable、immutable memtable和sst版本，整体引用计数
+// 三者中任何一个变化之后ColumnFamilyData都会生成新的SuperVersion，旧的在最后一个
+// 读请求结束之后释放；读请求通过ColumnFamilyData::GetThreadLocalSuperVersion获取
+struct SuperVersion {
+  MemTable* mem = nullptr;
+  MemTable* imm = nullptr;
+  Version* current = nullptr;
+  // 生成的时候ColumnFamilyData::super_version_number_的值，用来判断是否过期
+  uint64_t version_number = 0;
+
+  void Ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+  // 返回true表示释放的是最后一个引用，需要持有db的锁调用Cleanup之后删除
+  bool Unref() { return refs_.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+  // 释放mem、imm和current的引用，需要持有db的锁
+  void Cleanup();
+
+  // 线程缓存中的特殊值: 当前线程正在使用缓存的SuperVersion
+  static void* const kSVInUse;
+  // 线程缓存中的特殊值: 缓存已经被InstallSuperVersion作废
+  static void* const kSVObsolete;
+
+ private:
+  std::atomic<int32_t> refs_{0};
+};
+
+// 一个column family的全部状态: comparator、Options、memtable和sst的版本，
+// 所有column family共用VersionSet中的MANIFEST、文件编号和序号
+// 除了构造之后不再变化的成员，都需要持有db的锁访问
+class ColumnFamilyData final {
+ public:
+  uint32_t id() const { return id_; }
+  const std::string& name() const { return name_; }
+  // 内部使用的options，comparator和filter_policy都是处理internal key的
+  const Options& options() const { return options_; }
+  const InternalKeyComparator& internal_comparator() const { return icmp_; }
+  Comparator* user_comparator() const { return icmp_.user_comparator(); }
+  TableCache* table_cache() const { return table_cache_.get(); }
+
+  Version* current() const { return current_; }
+  // 编号小于LogNumber的WAL中这个column family的写入都已经刷成sst了
+  uint64_t LogNumber() const { return log_number_; }
+  // 已经从MANIFEST中删除，不能再写入，最后一个引用释放之后销毁
+  bool IsDropped() const { return dropped_; }
+
+  MemTable* mem() const { return mem_; }
+  // 等待后台线程刷盘的memtable
+  MemTable* imm() const { return imm_; }
+  // 当前的memtable变成imm并换上一个新的memtable，需要imm为nullptr
+  // log_number是新的memtable开始写入的WAL
+  void SwitchMemTable(uint64_t log_number);
+  // imm刷成sst之后，编号小于它的WAL中不再有这个column family没有刷盘的数据
+  uint64_t MemLogNumber() const { return mem_log_number_; }
+  // imm已经刷成sst或者不再需要了
+  void ClearImmutableMemTable();
+  // 按照options中arena相关的配置创建memtable，引用计数为0
+  MemTable* NewMemTable() const;
+  // 只读实例用回放WAL得到的memtable替换当前的memtable，mem需要已经Ref过
+  void ReplaceMemTable(MemTable* mem);
+
+  // 增加引用之后返回当前的SuperVersion，读取结束之后调用ReturnThreadLocalSuperVersion；
+  // 大部分时候直接使用当前线程缓存的那一份，不需要加锁也不修改共享的引用计数，
+  // 缓存过期的时候才持有db_mutex获取最新的一份；同一个线程不能嵌套调用
+  SuperVersion* GetThreadLocalSuperVersion(std::mutex* db_mutex);
+  // sv放回当前线程的缓存，使用期间缓存被作废的时候释放sv的引用
+  void ReturnThreadLocalSuperVersion(SuperVersion* sv, std::mutex* db_mutex);
+
+  // VersionSet、handle、迭代器和后台任务各自持有一个引用
+  void Ref() { ++refs_; }
+  void Unref();
+
+ private:
+  friend class Compaction;
+  friend class Version;
+  friend class VersionSet;
+  // options是用户传入的配置，db级别的配置已经替换成db_options中的值
+  ColumnFamilyData(uint32_t id, const std::string& name, VersionSet* vset,
+                   const Options& options);
+  ColumnFamilyData(const ColumnFamilyData&) = delete;
+  ColumnFamilyData& operator=(const ColumnFamilyData&) = delete;
+  ~ColumnFamilyData();
+
+  // level0按照文件编号排序，其他层按照smallest排序
+  void SortFiles(Version* v);
+  // 计算每一层的compaction score
+  void Finalize(Version* v);
+  double MaxBytesForLevel(int32_t level) const;
+  void GetRange(const std::vector<FileMetaData*>& inputs,
+                std::string* smallest, std::string* largest);
+  void AppendVersion(Version* v);
+  // mem_、imm_或者current_变化之后生成新的SuperVersion，并作废所有线程的缓存
+  void InstallSuperVersion();
+
+  const uint32_t id_;
+  const std::string name_;
+  VersionSet* const vset_;
+  // 用户传入的comparator
+  std::shared_ptr<Comparator> user_comparator_;
+  InternalKeyComparator icmp_;
+  Options options_;
+  std::unique_ptr<TableCache> table_cache_;
+  int32_t refs_ = 0;
+  bool dropped_ = false;
+  uint64_t log_number_ = 0;
+  uint64_t mem_log_number_ = 0;
+  MemTable* mem_ = nullptr;
+  MemTable* imm_ = nullptr;
+
+  // 双向链表的头节点
+  Version dummy_versions_;
+  Version* current_ = nullptr;
+  // ColumnFamilyData持有一个引用
+  SuperVersion* super_version_ = nullptr;
+  // 每次InstallSuperVersion加1，读请求不加锁读取
+  std::atomic<uint64_t> super_version_number_{0};
+  // 每个线程缓存的SuperVersion，持有一个引用
+  std::unique_ptr<ThreadLocalPtr> local_sv_;
+  // 每一层下一次compaction开始的位置，保证key空间被轮流compaction
+  std::string compact_pointer_[config::kNumLevels];
+  // 正在参与compaction的层，同一层同时只能有一个compaction
+  bool level_compacting_[config::kNumLevels] = {false};
+};
+
+class VersionSet final {
+ public:
+  // options是db级别的配置
+  VersionSet(const std::string& dbname, const Options* options,
+             BlobSource* blob_source);
+  VersionSet(const VersionSet&) = delete;
+  VersionSet& operator=(const VersionSet&) = delete;
+  ~VersionSet();
+
+  // 把edit应用到cfd当前的版本上生成一个新的版本，并把edit追加到MANIFEST中
+  // 第一次调用或者MANIFEST过大的时候，先在新的MANIFEST中写入所有column family的全量快照
+  // 调用方需要持有db的锁
+  DBStatus LogAndApply(ColumnFamilyData* cfd, VersionEdit* edit);
+
+  // 根据CURRENT指向的MANIFEST恢复出每个column family最后的版本，
+  // column_families中需要包含MANIFEST中所有的column family，否则返回kInvalidArgument；
+  // MANIFEST中没有的column family不会被创建，名字追加到missing中
+  // read_only为true时不会再写MANIFEST，column_families中可以缺少MANIFEST里的
+  // column family，没有给出的直接忽略
+  DBStatus Recover(const std::vector<ColumnFamilyDescriptor>& column_families,
+                   std::vector<std::string>* missing, bool read_only = false);
+  // secondary实例使用: 读取primary在上一次读到的位置之后追加到MANIFEST中的edit，
+  // 应用到已经打开的column family上；CURRENT指向了新的MANIFEST时从头读取新文件，
+  // 它开头的全量快照替换掉每个column family当前的版本
+  // 打开之后primary新建的column family被忽略，删除的column family保持最后的版本
+  // 调用方需要持有db的锁
+  DBStatus CatchUpWithPrimary();
+
+  // 新建一个column family并记录到MANIFEST中，log_number是当前正在写入的WAL，
+  // 更早的WAL中不会有它的数据；名字已经存在的时候返回kInvalidArgument
+  DBStatus CreateColumnFamily(const ColumnFamilyDescriptor& descriptor,
+                              uint64_t log_number, ColumnFamilyData** cfd);
+  // 在MANIFEST中删除cfd，之后它的sst在没有版本引用的时候变成可以删除的文件
+  DBStatus DropColumnFamily(ColumnFamilyData* cfd);
+  // 没有删除的column family，id为0的是默认column family
+  const std::map<uint32_t, ColumnFamilyData*>& column_families() const {
+    return column_families_;
+  }
+  ColumnFamilyData* DefaultColumnFamily() const {
+    return column_families_.at(0);
+  }
+  // 名字为name的column family，不存在的时候返回nullptr
+  ColumnFamilyData* GetColumnFamily(const std::string& name) const;
+
+  uint64_t ManifestFileNumber() const { return manifest_file_number_; }
+  uint64_t NewFileNumber() { return next_file_number_++; }
+  // 恢复的时候用来保证新分配的编号不会和已有文件冲突
+  void MarkFileNumberUsed(uint64_t number) {
+    if (next_file_number_ <= number) {
+      next_file_number_ = number + 1;
+    }
+  }
+
+  SequenceNumber LastSequence() const { return last_sequence_; }
+  uint64_t ManifestFileSize() const { return manifest_file_size_; }
+
+  void SetLastSequence(SequenceNumber s) {
+    assert(s >= last_sequence_);
+    last_sequence_ = s;
+  }
+  // 所有column family的LogNumber中最小的一个，更早的WAL都已经不再需要了
+  uint64_t MinLogNumber() const;
+
+  // 所有存活版本引用到的sst和blob文件，包括已经删除但是还有引用的column family
+  void AddLiveFiles(std::set<uint64_t>* live);
+  // 只添加每个column family当前版本中的sst和blob文件编号
+  void AddCurrentFiles(std::set<uint64_t>* live) const;
+  // 编号小于返回值的blob文件属于最旧的blob_garbage_collection_age_cutoff比例，
+  // compaction时需要把其中仍然有效的value搬迁到新文件；返回0表示不需要搬迁
+  uint64_t BlobGarbageCollectionCutoff(ColumnFamilyData* cfd) const;
+
+  // 选出cfd中score最高并且没有正在进行compaction的一层，没有需要compaction的返回nullptr
+  // 返回的compaction会占用level和output_level，结束之后需要调用ReleaseCompaction
+  // universal方式下改为选择level0中相邻的若干个sorted run，
+  // FIFO方式下选择level0中需要删除的最旧的若干个sst
+  Compaction* PickCompaction(ColumnFamilyData* cfd);
+  void ReleaseCompaction(Compaction* c);
+  // 根据输入sst的index block把compaction的key空间切分成最多n段，
+  // 返回的user key递增，相邻两个边界之间的数据量大致相等
+  // 不需要持有db的锁
+  void GetSubcompactionBoundaries(Compaction* c, int32_t n,
+                                  std::vector<std::string>* boundaries);
+  // 遍历compaction中所有输入sst的迭代器
+  Iterator* MakeInputIterator(Compaction* c);
+  // 外部导入的sst放在这一层: 从level0往下找，直到下一层和[smallest,largest]有重叠
+  // 或者正在参与compaction为止；导入的数据比已有的数据新，更高的层不能有重叠
+  // universal和FIFO方式下总是放在level0，作为最新的sorted run
+  int32_t PickLevelForIngestedFile(ColumnFamilyData* cfd,
+                                   const std::string& smallest,
+                                   const std::string& largest);
+
+  uint64_t NumLevelBytes(ColumnFamilyData* cfd, int32_t level) const;
+
+ private:
+  friend class ColumnFamilyData;
+  friend class Compaction;
+  friend class Version;
+  class Builder;
+  // level0中每个sst是一个sorted run，依次尝试:
+  //   1. 空间放大超过max_size_amplification_percent时合并所有的run
+  //   2. 从新到旧找到大小相近的若干个相邻run合并
+  //   3. 合并最新的几个run，让run的个数降到触发阈值以下
+  Compaction* PickUniversalCompaction(ColumnFamilyData* cfd);
+  // 从最旧的sst开始，删除过期的以及超出总大小上限的部分
+  Compaction* PickFIFOCompaction(ColumnFamilyData* cfd);
+  void Apply(Version* base, const VersionEdit* edit, Version* v);
+  // 把edit中新增的blob文件和garbage合并到blob_files中，value全部失效的文件直接移除
+  static void ApplyBlobFiles(const VersionEdit* edit,
+                             std::map<uint64_t, BlobFileMetaData>* blob_files);
+  // 把所有column family当前版本的全量快照写入新的MANIFEST，并作为后续增量记录的起点
+  DBStatus WriteSnapshot(uint64_t manifest_number);
+
+  const std::string dbname_;
+  const Options* options_;
+  BlobSource* const blob_source_;
+  uint64_t next_file_number_ = 2;
+  uint64_t manifest_file_number_ = 0;
+  SequenceNumber last_sequence_ = 0;
+  // 已经分配过的最大的column family id，删除之后id也不会被复用
+  uint32_t max_column_family_ = 0;
+
+  // 当前正在追加的MANIFEST，恢复时不能复用旧文件的话，第一次LogAndApply的时候才创建
+  std::unique_ptr<FileWriter> descriptor_file_;
+  std::unique_ptr<log::Writer> descriptor_log_;
+  uint64_t manifest_file_size_ = 0;
+  // 只读打开的时候不写MANIFEST，manifest_tail_offset_是已经读取的位置，
+  // secondary从这里继续读取primary追加的记录
+  bool read_only_ = false;
+  uint64_t manifest_tail_offset_ = 0;
+
+  // id -> 没有删除的column family，VersionSet持有它们的一个引用
+  std::map<uint32_t, ColumnFamilyData*> column_families_;
+  // 所有还没有销毁的column family，包括已经删除但还有引用的
+  std::set<ColumnFamilyData*> all_column_families_;
+};
+
+// 把一个column family中level层的若干个sst和level+1层有重叠的sst合并成level+1层新的sst
+// universal方式下把level0中相邻的若干个sorted run合并成level0中的一个新的run
+// FIFO方式下直接从版本中删除level0中最旧的若干个sst
+class Compaction final {
+ public:
+  ~Compaction();
+
+  ColumnFamilyData* column_family() const { return cfd_; }
+  int32_t level() const { return level_; }
+  // 输出文件所在的层
+  int32_t output_level() const { return output_level_; }
+  VersionEdit* edit() { return &edit_; }
+  // which为0表示level层，为1表示level+1层
+  int32_t num_input_files(int32_t which) const { return inputs_[which].size(); }
+  FileMetaData* input(int32_t which, int32_t i) const {
+    return inputs_[which][i];
+  }
+  uint64_t MaxOutputFileSize() const { return max_output_file_size_; }
+
+  // 只有一个输入文件并且level+1层没有重叠的时候，直接把文件移动到下一层即可
+  bool IsTrivialMove() const;
+  // 输入文件直接从版本中删除，不读取也没有输出
+  bool IsDeletionCompaction() const { return is_deletion_compaction_; }
+  // 把所有的输入文件都加到edit的删除列表中
+  void AddInputDeletions(VersionEdit* edit);
+  // user_key在比输出更旧的数据中都不存在，此时删除标记可以直接丢弃；
+  // leveled方式下检查level+2及更高的层
+  // 要求同一个level_ptrs上调用的时候user_key是递增的，
+  // level_ptrs记录每一层当前检查到的位置，并行的子任务各自持有一份
+  bool IsBaseLevelForKey(const std::string_view& user_key,
+                         size_t* level_ptrs) const;
+  // 比输出更旧的数据中没有和[begin, end)重叠的sst，此时range tombstone可以丢弃
+  bool IsBaseLevelForRange(const std::string_view& begin,
+                           const std::string_view& end) const;
+  uint64_t TotalInputBytes() const;
+  // 整个文件都被range tombstone删除了，MakeInputIterator不再读取它，
+  // 仍然和其他输入一起从版本中删除
+  void SkipInput(uint64_t file_number) { skipped_inputs_.insert(file_number); }
+
+ private:
+  friend class VersionSet;
+  // 持有cfd的一个引用，析构的时候释放
+  Compaction(ColumnFamilyData* cfd, int32_t level);
+
+  ColumnFamilyData* const cfd_;
+  int32_t level_;
+  int32_t output_level_;
+  uint64_t max_output_file_size_;
+  // universal方式下level0中还有比输入更旧的run，删除标记不能丢弃
+  bool has_older_runs_ = false;
+  bool is_deletion_compaction_ = false;
+  Version* input_version_ = nullptr;
+  VersionEdit edit_;
+  std::vector<FileMetaData*> inputs_[2];
+  std::set<uint64_t> skipped_inputs_;
+};
+}  // namespace corekv
+#endif
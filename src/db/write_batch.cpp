@@ -0,0 +1,276 @@
+#include "write_batch.h"
+
+#include <assert.h>
+
+#include "../utils/codec.h"
+#include "../utils/util.h"
+#include "column_family.h"
+#include "dbformat.h"
+#include "memtable.h"
+#include "write_batch_internal.h"
+namespace corekv {
+using namespace util;
+// 8-byte sequence number + 4-byte count
+static constexpr size_t kHeader = 12;
+// 非默认column family的record前缀，只出现在batch中，不和ValueType冲突
+static constexpr char kTypeColumnFamily = 0x7f;
+
+WriteBatch::WriteBatch() { Clear(); }
+
+void WriteBatch::Clear() {
+  rep_.clear();
+  rep_.resize(kHeader);
+}
+
+void WriteBatch::AppendRecordHeader(ColumnFamilyHandle* column_family,
+                                    char type) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  const uint32_t column_family_id =
+      column_family != nullptr ? column_family->GetID() : 0;
+  if (column_family_id != 0) {
+    rep_.push_back(kTypeColumnFamily);
+    PutVarint32(&rep_, column_family_id);
+  }
+  rep_.push_back(type);
+}
+
+void WriteBatch::Put(const std::string_view& key,
+                     const std::string_view& value) {
+  Put(nullptr, key, value);
+}
+
+void WriteBatch::Delete(const std::string_view& key) { Delete(nullptr, key); }
+
+void WriteBatch::PutWithTTL(const std::string_view& key,
+                            const std::string_view& value, uint64_t ttl_ms) {
+  PutWithTTL(nullptr, key, value, ttl_ms);
+}
+
+void WriteBatch::Merge(const std::string_view& key,
+                       const std::string_view& operand) {
+  Merge(nullptr, key, operand);
+}
+
+void WriteBatch::DeleteRange(const std::string_view& begin_key,
+                             const std::string_view& end_key) {
+  DeleteRange(nullptr, begin_key, end_key);
+}
+
+void WriteBatch::Put(ColumnFamilyHandle* column_family,
+                     const std::string_view& key,
+                     const std::string_view& value) {
+  AppendRecordHeader(column_family, static_cast<char>(kTypeValue));
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
+void WriteBatch::Delete(ColumnFamilyHandle* column_family,
+                        const std::string_view& key) {
+  AppendRecordHeader(column_family, static_cast<char>(kTypeDeletion));
+  PutLengthPrefixedSlice(&rep_, key);
+}
+
+void WriteBatch::PutWithTTL(ColumnFamilyHandle* column_family,
+                            const std::string_view& key,
+                            const std::string_view& value, uint64_t ttl_ms) {
+  AppendRecordHeader(column_family, static_cast<char>(kTypeValueWithExpiry));
+  PutLengthPrefixedSlice(&rep_, key);
+  PutVarint32(&rep_, value.size() + kExpiryTailSize);
+  rep_.append(value.data(), value.size());
+  AppendExpiry(&rep_, GetCurrentTime() + ttl_ms);
+}
+
+void WriteBatch::Merge(ColumnFamilyHandle* column_family,
+                       const std::string_view& key,
+                       const std::string_view& operand) {
+  AppendRecordHeader(column_family, static_cast<char>(kTypeMerge));
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, operand);
+}
+
+void WriteBatch::DeleteRange(ColumnFamilyHandle* column_family,
+                             const std::string_view& begin_key,
+                             const std::string_view& end_key) {
+  AppendRecordHeader(column_family, static_cast<char>(kTypeRangeDeletion));
+  PutLengthPrefixedSlice(&rep_, begin_key);
+  PutLengthPrefixedSlice(&rep_, end_key);
+}
+
+void WriteBatch::Append(const WriteBatch& source) {
+  WriteBatchInternal::Append(this, &source);
+}
+
+DBStatus WriteBatch::Iterate(Handler* handler) const {
+  std::string_view input(rep_);
+  if (input.size() < kHeader) {
+    return Status::kCorruption;
+  }
+  input.remove_prefix(kHeader);
+  std::string_view key, value;
+  uint64_t expire_at;
+  uint32_t found = 0;
+  while (!input.empty()) {
+    found++;
+    char tag = input[0];
+    input.remove_prefix(1);
+    uint32_t column_family_id = 0;
+    if (tag == kTypeColumnFamily) {
+      if (!GetVarint32(&input, &column_family_id) || column_family_id == 0 ||
+          input.empty()) {
+        return Status::kCorruption;
+      }
+      tag = input[0];
+      input.remove_prefix(1);
+    }
+    switch (tag) {
+      case kTypeValue:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->Put(column_family_id, key, value);
+        } else {
+          return Status::kCorruption;
+        }
+        break;
+      case kTypeDeletion:
+        if (GetLengthPrefixedSlice(&input, &key)) {
+          handler->Delete(column_family_id, key);
+        } else {
+          return Status::kCorruption;
+        }
+        break;
+      case kTypeValueWithExpiry:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value) &&
+            SplitExpiry(value, &value, &expire_at)) {
+          handler->PutWithExpiry(column_family_id, key, value, expire_at);
+        } else {
+          return Status::kCorruption;
+        }
+        break;
+      case kTypeMerge:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->Merge(column_family_id, key, value);
+        } else {
+          return Status::kCorruption;
+        }
+        break;
+      case kTypeRangeDeletion:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          handler->DeleteRange(column_family_id, key, value);
+        } else {
+          return Status::kCorruption;
+        }
+        break;
+      default:
+        return Status::kCorruption;
+    }
+  }
+  if (found != WriteBatchInternal::Count(this)) {
+    return Status::kCorruption;
+  }
+  return Status::kSuccess;
+}
+
+uint32_t WriteBatchInternal::Count(const WriteBatch* b) {
+  return DecodeFixed32(b->rep_.data() + 8);
+}
+
+void WriteBatchInternal::SetCount(WriteBatch* b, uint32_t n) {
+  EncodeFixed32(&b->rep_[8], n);
+}
+
+SequenceNumber WriteBatchInternal::Sequence(const WriteBatch* b) {
+  return SequenceNumber(DecodeFixed64(b->rep_.data()));
+}
+
+void WriteBatchInternal::SetSequence(WriteBatch* b, SequenceNumber seq) {
+  EncodeFixed64(&b->rep_[0], seq);
+}
+
+void WriteBatchInternal::SetContents(WriteBatch* b,
+                                     const std::string_view& contents) {
+  assert(contents.size() >= kHeader);
+  b->rep_.assign(contents.data(), contents.size());
+}
+
+namespace {
+class MemTableInserter final : public WriteBatch::Handler {
+ public:
+  MemTableInserter(SequenceNumber sequence,
+                   const WriteBatchInternal::MemTableLookup& lookup,
+                   bool concurrent)
+      : sequence_(sequence), lookup_(lookup), concurrent_(concurrent) {}
+  void Put(uint32_t column_family_id, const std::string_view& key,
+           const std::string_view& value) override {
+    Add(column_family_id, kTypeValue, key, value);
+  }
+  void Delete(uint32_t column_family_id,
+              const std::string_view& key) override {
+    Add(column_family_id, kTypeDeletion, key, std::string_view());
+  }
+  void PutWithExpiry(uint32_t column_family_id, const std::string_view& key,
+                     const std::string_view& value,
+                     uint64_t expire_at) override {
+    buf_.assign(value.data(), value.size());
+    AppendExpiry(&buf_, expire_at);
+    Add(column_family_id, kTypeValueWithExpiry, key, buf_);
+  }
+  void Merge(uint32_t column_family_id, const std::string_view& key,
+             const std::string_view& operand) override {
+    Add(column_family_id, kTypeMerge, key, operand);
+  }
+  void DeleteRange(uint32_t column_family_id,
+                   const std::string_view& begin_key,
+                   const std::string_view& end_key) override {
+    // range tombstone不进入rep，并发插入也是一样的
+    MemTable* mem = lookup_(column_family_id);
+    if (mem != nullptr) {
+      mem->AddRangeTombstone(sequence_, begin_key, end_key);
+    }
+    sequence_++;
+  }
+
+ private:
+  // 找不到memtable的column family跳过，但是仍然占用一个序号
+  void Add(uint32_t column_family_id, ValueType type,
+           const std::string_view& key, const std::string_view& value) {
+    MemTable* mem = lookup_(column_family_id);
+    if (mem == nullptr) {
+      // 跳过
+    } else if (concurrent_) {
+      mem->AddConcurrently(sequence_, type, key, value);
+    } else {
+      mem->Add(sequence_, type, key, value);
+    }
+    sequence_++;
+  }
+
+  SequenceNumber sequence_;
+  const WriteBatchInternal::MemTableLookup& lookup_;
+  bool concurrent_;
+  std::string buf_;
+};
+}  // namespace
+
+DBStatus WriteBatchInternal::InsertInto(const WriteBatch* b, MemTable* memtable,
+                                        bool concurrent) {
+  return InsertInto(
+      b, [memtable](uint32_t) { return memtable; }, concurrent);
+}
+
+DBStatus WriteBatchInternal::InsertInto(const WriteBatch* b,
+                                        const MemTableLookup& lookup,
+                                        bool concurrent) {
+  MemTableInserter inserter(WriteBatchInternal::Sequence(b), lookup,
+                            concurrent);
+  return b->Iterate(&inserter);
+}
+
+void WriteBatchInternal::Append(WriteBatch* dst, const WriteBatch* src) {
+  SetCount(dst, Count(dst) + Count(src));
+  assert(src->rep_.size() >= kHeader);
+  dst->rep_.append(src->rep_.data() + kHeader, src->rep_.size() - kHeader);
+}
+}  // namespace corekv
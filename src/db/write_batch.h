@@ -0,0 +1,100 @@
+#ifndef DB_WRITE_BATCH_H_
+#define DB_WRITE_BATCH_H_
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+
+#include "status.h"
+/*
+ * WriteBatch把多个Put/Delete打包到一块连续的内存中，作为一个整体写入WAL和MemTable
+ *
+ * rep_的格式:
+ * ┌────────────────────┬──────────────┬─────────────────────────────┐
+ * │ sequence(fixed64)  │count(fixed32)│ record[count]               │
+ * └────────────────────┴──────────────┴─────────────────────────────┘
+ * record := kTypeValue    varstring(key) varstring(value)
+ *         | kTypeDeletion varstring(key)
+ *         | kTypeValueWithExpiry varstring(key) varstring(value | fixed64(expire_at))
+ *         | kTypeMerge    varstring(key) varstring(operand)
+ *         | kTypeRangeDeletion varstring(begin_key) varstring(end_key)
+ *         | kTypeColumnFamily varint32(column_family_id) record
+ * varstring := varint32(len) | data
+ *
+ * 写入默认column family的record不带kTypeColumnFamily前缀，和之前的格式相同
+ * batch中第i个record使用的序号是 sequence + i
+ */
+namespace corekv {
+class ColumnFamilyHandle;
+
+class WriteBatch final {
+ public:
+  // 遍历batch中的每一个操作，column_family_id是操作所属的column family
+  class Handler {
+   public:
+    virtual ~Handler() = default;
+    virtual void Put(uint32_t column_family_id, const std::string_view& key,
+                     const std::string_view& value) = 0;
+    virtual void Delete(uint32_t column_family_id,
+                        const std::string_view& key) = 0;
+    // expire_at是过期的时间点，单位和util::GetCurrentTime()相同(ms)
+    virtual void PutWithExpiry(uint32_t column_family_id,
+                               const std::string_view& key,
+                               const std::string_view& value,
+                               uint64_t expire_at) = 0;
+    virtual void Merge(uint32_t column_family_id, const std::string_view& key,
+                       const std::string_view& operand) = 0;
+    virtual void DeleteRange(uint32_t column_family_id,
+                             const std::string_view& begin_key,
+                             const std::string_view& end_key) = 0;
+  };
+
+  WriteBatch();
+  WriteBatch(const WriteBatch&) = default;
+  WriteBatch& operator=(const WriteBatch&) = default;
+  ~WriteBatch() = default;
+
+  void Put(const std::string_view& key, const std::string_view& value);
+  void Delete(const std::string_view& key);
+  // ttl_ms毫秒之后key自动失效，读取时当作不存在，compaction时被清理
+  // 过期时间在调用的时候确定
+  void PutWithTTL(const std::string_view& key, const std::string_view& value,
+                  uint64_t ttl_ms);
+  // 写入一个操作数，读取的时候由Options::merge_operator和之前的value合并
+  void Merge(const std::string_view& key, const std::string_view& operand);
+  // 删除[begin_key, end_key)中的所有key，只占用一个序号
+  void DeleteRange(const std::string_view& begin_key,
+                   const std::string_view& end_key);
+
+  // 以下写入指定的column family，column_family为nullptr时写入默认column family
+  void Put(ColumnFamilyHandle* column_family, const std::string_view& key,
+           const std::string_view& value);
+  void Delete(ColumnFamilyHandle* column_family, const std::string_view& key);
+  void PutWithTTL(ColumnFamilyHandle* column_family,
+                  const std::string_view& key, const std::string_view& value,
+                  uint64_t ttl_ms);
+  void Merge(ColumnFamilyHandle* column_family, const std::string_view& key,
+             const std::string_view& operand);
+  void DeleteRange(ColumnFamilyHandle* column_family,
+                   const std::string_view& begin_key,
+                   const std::string_view& end_key);
+  void Clear();
+
+  // 序列化之后的大小
+  size_t ApproximateSize() const { return rep_.size(); }
+
+  // 把source中的操作追加到当前batch中
+  void Append(const WriteBatch& source);
+
+  DBStatus Iterate(Handler* handler) const;
+
+ private:
+  friend class WriteBatchInternal;
+  // 增加一个record的计数，并写入record的类型，非默认column family先写入前缀
+  void AppendRecordHeader(ColumnFamilyHandle* column_family, char type);
+
+  std::string rep_;
+};
+}  // namespace corekv
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef DB_WRITE_BATCH_INTERNAL_H_
+#define DB_WRITE_BATCH_INTERNAL_H_
+#include <stdint.h>
+
+#include <functional>
+#include <string_view>
+
+#include "dbformat.h"
+#include "write_batch.h"
+
+namespace corekv {
+class MemTable;
+// 只给引擎内部使用的接口，不对用户暴露
+class WriteBatchInternal final {
+ public:
+  // batch中操作的个数
+  static uint32_t Count(const WriteBatch* batch);
+  static void SetCount(WriteBatch* batch, uint32_t n);
+
+  // batch的起始序号
+  static SequenceNumber Sequence(const WriteBatch* batch);
+  static void SetSequence(WriteBatch* batch, SequenceNumber seq);
+
+  static std::string_view Contents(const WriteBatch* batch) {
+    return std::string_view(batch->rep_);
+  }
+  static size_t ByteSize(const WriteBatch* batch) { return batch->rep_.size(); }
+  // 用于从WAL中恢复
+  static void SetContents(WriteBatch* batch, const std::string_view& contents);
+
+  // 根据column family的id返回写入的memtable，返回nullptr的时候跳过这个record
+  using MemTableLookup = std::function<MemTable*(uint32_t column_family_id)>;
+
+  // 按照batch的起始序号依次插入到memtable中，concurrent为true时可以多个线程同时插入
+  // 所有column family的record都插入到memtable中
+  static DBStatus InsertInto(const WriteBatch* batch, MemTable* memtable,
+                             bool concurrent = false);
+  // 每个record插入到lookup返回的memtable中
+  static DBStatus InsertInto(const WriteBatch* batch,
+                             const MemTableLookup& lookup,
+                             bool concurrent = false);
+
+  static void Append(WriteBatch* dst, const WriteBatch* src);
+};
+}  // namespace corekv
+
+#endif
@@ -0,0 +1,44 @@
+#include "write_controller.h"
+
+#include <algorithm>
+
+namespace corekv {
+// 速率不会降到这个值以下，避免单次写入等待过长的时间
+static constexpr uint64_t kMinDelayedWriteRate = 16 * 1024;
+// 每次调整速率的比例
+static constexpr double kSlowdownRatio = 0.8;
+static constexpr double kSpeedupRatio = 1.25;
+
+WriteController::WriteController(uint64_t delayed_write_rate)
+    : max_delayed_write_rate_(
+          std::max(delayed_write_rate, kMinDelayedWriteRate)),
+      delayed_write_rate_(max_delayed_write_rate_) {}
+
+uint64_t WriteController::GetDelay(uint64_t now_us, uint64_t num_bytes) {
+  // 之前分配的时间片已经用完了，从现在开始重新分配
+  if (next_write_time_us_ < now_us) {
+    next_write_time_us_ = now_us;
+  }
+  const uint64_t delay = next_write_time_us_ - now_us;
+  next_write_time_us_ += static_cast<uint64_t>(
+      static_cast<double>(num_bytes) * 1000000 / delayed_write_rate_);
+  return delay;
+}
+
+void WriteController::Slowdown() {
+  delayed_write_rate_ = std::max(
+      kMinDelayedWriteRate,
+      static_cast<uint64_t>(delayed_write_rate_ * kSlowdownRatio));
+}
+
+void WriteController::Speedup() {
+  delayed_write_rate_ = std::min(
+      max_delayed_write_rate_,
+      static_cast<uint64_t>(delayed_write_rate_ * kSpeedupRatio));
+}
+
+void WriteController::Reset() {
+  delayed_write_rate_ = max_delayed_write_rate_;
+  next_write_time_us_ = 0;
+}
+}  // namespace corekv
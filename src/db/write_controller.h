@@ -0,0 +1,48 @@
+#ifndef DB_WRITE_CONTROLLER_H_
+#define DB_WRITE_CONTROLLER_H_
+#include <stdint.h>
+
+namespace corekv {
+// 写入受到后台compaction积压影响的程度
+enum class WriteStallCondition {
+  kNormal,
+  // 按照WriteController的速率限制写入
+  kDelayed,
+  // 停止写入，等待flush或者compaction完成
+  kStopped,
+};
+
+/*
+ * compaction跟不上写入的时候，给每次写入分配一段等待时间，把写入速度平滑地
+ * 降到delayed_write_rate，而不是等积压严重之后直接停写
+ *
+ * 按照速率给每次写入分配时间片，并发的写入依次排在后面，所以总的写入速度
+ * 不会超过当前的速率；积压继续增加的时候逐步降低速率，减少的时候逐步恢复，
+ * 但不会超过初始速率。需要持有db的锁访问
+ */
+class WriteController final {
+ public:
+  // delayed_write_rate是限速时的初始速率(字节/秒)
+  explicit WriteController(uint64_t delayed_write_rate);
+  WriteController(const WriteController&) = delete;
+  WriteController& operator=(const WriteController&) = delete;
+
+  // 写入num_bytes之前需要等待的微秒数，now_us是单调时钟的当前时间
+  uint64_t GetDelay(uint64_t now_us, uint64_t num_bytes);
+  // 积压增加或者level0的文件数接近停写阈值的时候降低速率
+  void Slowdown();
+  // 积压减少的时候提高速率
+  void Speedup();
+  // 解除限速之后恢复初始速率
+  void Reset();
+
+  uint64_t delayed_write_rate() const { return delayed_write_rate_; }
+
+ private:
+  const uint64_t max_delayed_write_rate_;
+  uint64_t delayed_write_rate_;
+  // 下一次写入可以开始的时间
+  uint64_t next_write_time_us_ = 0;
+};
+}  // namespace corekv
+#endif
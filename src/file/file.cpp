@@ -1,20 +1,26 @@
 #include "file.h"
 
+#include <dirent.h>
 #include <fcntl.h>
 #include <string.h>
 #include <sys/errno.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <cstring>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <memory>
 #include <stdio.h>
 
 #include "../logger/log.h"
 namespace corekv {
-FileWriter::FileWriter(const std::string& path_name) {
+FileWriter::FileWriter(const std::string& path_name, bool append,
+                       bool use_direct_io)
+    : file_name_(path_name) {
   std::string::size_type separator_pos = path_name.rfind('/');
   if (separator_pos == std::string::npos) {
     //那说明是当前路径
@@ -24,7 +30,19 @@ FileWriter::FileWriter(const std::string& path_name) {
       mkdir(dir_path.data(), 0777);
     }
   }
-  fd_ = ::open(path_name.data(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  const int flags = O_CREAT | O_WRONLY | (append ? O_APPEND : O_TRUNC);
+  // 追加写的时候文件末尾不一定是对齐的，只有新建的文件使用direct io
+  if (use_direct_io && !append) {
+    fd_ = ::open(path_name.data(), flags | O_DIRECT, 0644);
+    if (fd_ == -1) {
+      LOG(corekv::LogLevel::WARN, "open %s with O_DIRECT failed:%s",
+          path_name.data(), strerror(errno));
+    }
+    direct_io_ = fd_ != -1;
+  }
+  if (fd_ == -1) {
+    fd_ = ::open(path_name.data(), flags, 0644);
+  }
   assert(::access(path_name.c_str(), F_OK) == 0);
 }
 
@@ -32,6 +50,25 @@ DBStatus FileWriter::Append(const char* data, int32_t len) {
   if (len == 0 || !data) {
     return Status::kSuccess;
   }
+  if (direct_io_) {
+    // 所有数据都经过对齐的缓冲区，写满一次落盘一次
+    while (len > 0) {
+      const int32_t size =
+          std::min<int32_t>(len, kMaxFileBufferSize - current_pos_);
+      memcpy(buffer_ + current_pos_, data, size);
+      data += size;
+      len -= size;
+      current_pos_ += size;
+      if (current_pos_ == kMaxFileBufferSize) {
+        if (!WriteAligned(kMaxFileBufferSize)) {
+          return Status::kWriteFileFailed;
+        }
+        file_offset_ += kMaxFileBufferSize;
+        current_pos_ = 0;
+      }
+    }
+    return Status::kSuccess;
+  }
   int32_t remain_size =
       std::min<int32_t>(len, kMaxFileBufferSize - current_pos_);
   memcpy(buffer_ + current_pos_, data, remain_size);
@@ -61,6 +98,9 @@ DBStatus FileWriter::Append(const char* data, int32_t len) {
 }
 // 剩余的那些需要手动刷盘
 DBStatus FileWriter::FlushBuffer() {
+  if (direct_io_) {
+    return Status::kSuccess;
+  }
   if (current_pos_ > 0) {
     int ret = Writen(buffer_, current_pos_);
     current_pos_ = 0;
@@ -76,6 +116,9 @@ FileWriter::Writen(const char* data, int len) {
   ssize_t nwritten;  //单次调用write()写入的字节数
   const char* ptr;   // write的缓冲区
 
+  if (rate_limiter_ != nullptr) {
+    rate_limiter_->Request(len, io_priority_);
+  }
   ptr = data;  //把传参进来的write要写的缓冲区备份一份
   nleft = len;  //还剩余需要写的字节数初始化为总共需要写的字节数
   while (nleft > 0) {  //检查传参进来的需要写的字节数的有效性
@@ -87,6 +130,7 @@ FileWriter::Writen(const char* data, int len) {
       }
     }
 
+    MaybeRangeSync(nwritten);
     nleft -=
         nwritten;  //还剩余需要写的字节数=现在还剩余需要写的字节数-这次已经写的字节数
     ptr +=
@@ -95,13 +139,81 @@ FileWriter::Writen(const char* data, int len) {
   return current_pos_;  //返回已经写了的字节数
 }
 
-void FileWriter::Sync() {
-  FlushBuffer();
-  if (fd_ > -1) {
-    fsync(fd_);
+bool FileWriter::WriteAligned(size_t n) {
+  if (rate_limiter_ != nullptr) {
+    rate_limiter_->Request(n, io_priority_);
+  }
+  size_t written = 0;
+  while (written < n) {
+    const ssize_t ret = ::pwrite(fd_, buffer_ + written, n - written,
+                                 static_cast<off_t>(file_offset_ + written));
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret <= 0) {
+      return false;
+    }
+    written += ret;
+  }
+  return true;
+}
+
+void FileWriter::SetBytesPerSync(uint64_t bytes_per_sync) {
+  bytes_per_sync_ = bytes_per_sync;
+  // 回写的范围需要文件中的偏移，追加写或者已经写过数据的时候从当前末尾开始计算
+  struct ::stat file_stat;
+  if (bytes_per_sync_ > 0 && fd_ != -1 && ::fstat(fd_, &file_stat) == 0) {
+    written_offset_ = synced_offset_ = file_stat.st_size;
+  }
+}
+
+void FileWriter::MaybeRangeSync(size_t n) {
+  written_offset_ += n;
+  if (bytes_per_sync_ == 0 || written_offset_ - synced_offset_ < bytes_per_sync_) {
+    return;
+  }
+#ifdef __linux__
+  // 只是提交回写，不等待完成，写入的线程不会因此阻塞
+  ::sync_file_range(fd_, static_cast<off_t>(synced_offset_),
+                    static_cast<off_t>(written_offset_ - synced_offset_),
+                    SYNC_FILE_RANGE_WRITE);
+#endif
+  ++range_sync_count_;
+  synced_offset_ = written_offset_;
+}
+
+DBStatus FileWriter::FlushDirect() {
+  if (current_pos_ == 0) {
+    return Status::kSuccess;
   }
+  const uint32_t padded = (current_pos_ + kDirectIOAlignment - 1) /
+                          kDirectIOAlignment * kDirectIOAlignment;
+  memset(buffer_ + current_pos_, 0, padded - current_pos_);
+  if (!WriteAligned(padded) ||
+      ::ftruncate(fd_, static_cast<off_t>(file_offset_ + current_pos_)) != 0) {
+    return Status::kWriteFileFailed;
+  }
+  const uint32_t aligned = current_pos_ / kDirectIOAlignment * kDirectIOAlignment;
+  memmove(buffer_, buffer_ + aligned, current_pos_ - aligned);
+  file_offset_ += aligned;
+  current_pos_ -= aligned;
+  return Status::kSuccess;
+}
+
+DBStatus FileWriter::Sync() {
+  DBStatus s = direct_io_ ? FlushDirect() : FlushBuffer();
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  if (fd_ > -1 && fsync(fd_) != 0) {
+    return Status::kWriteFileFailed;
+  }
+  return Status::kSuccess;
 }
 void FileWriter::Close() {
+  if (direct_io_) {
+    FlushDirect();
+  }
   FlushBuffer();
   if (fd_ > -1) {
     close(fd_);
@@ -114,29 +226,182 @@ void FileWriter::DeleteFile() { ::unlink(file_name_.c_str()); }
 
 // file_reader
 FileReader::~FileReader() {
+  if (mmap_base_ != nullptr) {
+    munmap(const_cast<char*>(mmap_base_), mmap_size_);
+    mmap_base_ = nullptr;
+  }
   if (fd_ > -1) {
     close(fd_);
     fd_ = -1;
   }
 }
-FileReader::FileReader(const std::string& path_name) {
+FileReader::FileReader(const std::string& path_name, bool use_mmap,
+                       bool use_direct_io) {
   if (::access(path_name.c_str(), F_OK) != 0) {
     LOG(corekv::LogLevel::ERROR, "path_name:%s don't existed!",
         path_name.data());
-  } else {
+    return;
+  }
+  if (use_direct_io && !use_mmap) {
+    fd_ = ::open(path_name.data(), O_RDONLY | O_DIRECT);
+    if (fd_ == -1) {
+      LOG(corekv::LogLevel::WARN, "open %s with O_DIRECT failed:%s",
+          path_name.data(), strerror(errno));
+    }
+    direct_io_ = fd_ != -1;
+  }
+  if (fd_ == -1) {
     fd_ = open(path_name.data(), O_RDONLY);
   }
-  
+  struct ::stat file_stat;
+  if (!use_mmap || fd_ == -1 || ::fstat(fd_, &file_stat) != 0 ||
+      file_stat.st_size == 0) {
+    return;
+  }
+  void* base = ::mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+  if (base == MAP_FAILED) {
+    LOG(corekv::LogLevel::WARN, "mmap %s failed, fallback to pread",
+        path_name.data());
+    return;
+  }
+  // 点查的访问是随机的，关掉内核默认的预读，顺序遍历通过Prefetch提示
+  ::madvise(base, file_stat.st_size, MADV_RANDOM);
+  mmap_base_ = static_cast<const char*>(base);
+  mmap_size_ = file_stat.st_size;
 }
 DBStatus FileReader::Read(uint64_t offset, size_t n, std::string* result) const {
   if (!result) {
     return Status::kInvalidObject;
   }
+  if (mmap_base_ != nullptr) {
+    std::string_view data;
+    DBStatus s = Read(offset, n, &data, nullptr);
+    if (s == Status::kSuccess) {
+      result->assign(data.data(), data.size());
+    }
+    return s;
+  }
   if (fd_ == -1) {
     LOG(corekv::LogLevel::ERROR, "Invalid Socket");
     return Status::kInterupt;
   }
-  pread(fd_, result->data(), n, static_cast<off_t>(offset));
+  if (direct_io_) {
+    return ReadDirect(offset, n, result);
+  }
+  result->resize(n);
+  ssize_t ret = pread(fd_, result->data(), n, static_cast<off_t>(offset));
+  if (ret < 0) {
+    result->clear();
+    return Status::kReadFileFailed;
+  }
+  // 读到文件末尾的时候，实际读取的长度可能小于n
+  result->resize(ret);
+  return Status::kSuccess;
+}
+
+DBStatus FileReader::ReadDirect(uint64_t offset, size_t n,
+                                std::string* result) const {
+  const uint64_t start = offset / kDirectIOAlignment * kDirectIOAlignment;
+  const uint64_t end = (offset + n + kDirectIOAlignment - 1) /
+                       kDirectIOAlignment * kDirectIOAlignment;
+  void* buf = nullptr;
+  if (::posix_memalign(&buf, kDirectIOAlignment, end - start) != 0) {
+    return Status::kReadFileFailed;
+  }
+  std::unique_ptr<char, decltype(&::free)> aligned(static_cast<char*>(buf),
+                                                   &::free);
+  size_t read = 0;
+  while (read < end - start) {
+    const ssize_t ret = ::pread(fd_, aligned.get() + read, end - start - read,
+                                static_cast<off_t>(start + read));
+    if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ret < 0) {
+      result->clear();
+      return Status::kReadFileFailed;
+    }
+    if (ret == 0) {
+      break;
+    }
+    read += ret;
+  }
+  // 和pread一样，超过文件末尾的部分不返回
+  const size_t head = offset - start;
+  const size_t size = read > head ? std::min<size_t>(n, read - head) : 0;
+  result->assign(aligned.get() + head, size);
+  return Status::kSuccess;
+}
+
+DBStatus FileReader::Read(uint64_t offset, size_t n, std::string_view* result,
+                          std::string* scratch) const {
+  if (!result) {
+    return Status::kInvalidObject;
+  }
+  if (mmap_base_ == nullptr) {
+    DBStatus s = Read(offset, n, scratch);
+    *result = s == Status::kSuccess ? std::string_view(*scratch)
+                                    : std::string_view();
+    return s;
+  }
+  // 和pread一样，超过文件末尾的部分不返回
+  if (offset >= mmap_size_) {
+    *result = std::string_view();
+  } else {
+    *result = std::string_view(mmap_base_ + offset,
+                               std::min<uint64_t>(n, mmap_size_ - offset));
+  }
+  return Status::kSuccess;
+}
+
+DBStatus FileReader::MultiRead(ReadRequest* reqs, size_t n,
+                               bool use_io_uring) const {
+  if (fd_ == -1) {
+    return Status::kInterupt;
+  }
+  IoUring* ring = nullptr;
+  // 只有一个请求的时候直接pread，省掉提交和收割的开销
+  // direct io需要对齐的内存，也走逐个读取的路径
+  if (use_io_uring && mmap_base_ == nullptr && !direct_io_ && n > 1) {
+    ring = IoUring::ThreadLocal();
+  }
+  if (ring != nullptr) {
+    ring->Read(fd_, reqs, n);
+    return Status::kSuccess;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    reqs[i].status =
+        Read(reqs[i].offset, reqs[i].len, &reqs[i].result, &reqs[i].scratch);
+  }
+  return Status::kSuccess;
+}
+
+DBStatus FileReader::Prefetch(uint64_t offset, size_t n) const {
+  if (fd_ == -1) {
+    return Status::kInterupt;
+  }
+  if (mmap_base_ != nullptr) {
+    if (offset >= mmap_size_) {
+      return Status::kSuccess;
+    }
+    // madvise要求起始地址按页对齐
+    static const uint64_t kPageSize = ::sysconf(_SC_PAGESIZE);
+    const uint64_t start = offset / kPageSize * kPageSize;
+    const uint64_t end = std::min<uint64_t>(offset + n, mmap_size_);
+    if (::madvise(const_cast<char*>(mmap_base_) + start, end - start,
+                  MADV_WILLNEED) != 0) {
+      return Status::kReadFileFailed;
+    }
+    return Status::kSuccess;
+  }
+  if (direct_io_) {
+    // 预读会把数据带进page cache，和direct io的目的相反
+    return Status::kSuccess;
+  }
+  if (::posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(n),
+                      POSIX_FADV_WILLNEED) != 0) {
+    return Status::kReadFileFailed;
+  }
   return Status::kSuccess;
 }
 
@@ -150,4 +415,129 @@ uint64_t FileTool::GetFileSize(const std::string_view& path) {
   }
   return file_stat.st_size;
 }
+
+bool FileTool::FileExists(const std::string& path) {
+  return ::access(path.c_str(), F_OK) == 0;
+}
+
+DBStatus FileTool::GetChildren(const std::string& dir,
+                               std::vector<std::string>* result) {
+  result->clear();
+  ::DIR* d = ::opendir(dir.c_str());
+  if (d == nullptr) {
+    return Status::kReadFileFailed;
+  }
+  struct ::dirent* entry;
+  while ((entry = ::readdir(d)) != nullptr) {
+    const std::string name = entry->d_name;
+    if (name != "." && name != "..") {
+      result->emplace_back(name);
+    }
+  }
+  ::closedir(d);
+  return Status::kSuccess;
+}
+
+DBStatus FileTool::CreateDir(const std::string& dir) {
+  if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    return Status::kWriteFileFailed;
+  }
+  return Status::kSuccess;
+}
+
+DBStatus FileTool::RemoveDir(const std::string& dir) {
+  if (::rmdir(dir.c_str()) != 0) {
+    return Status::kWriteFileFailed;
+  }
+  return Status::kSuccess;
+}
+
+DBStatus FileTool::RemoveDirAndFiles(const std::string& dir) {
+  std::vector<std::string> filenames;
+  GetChildren(dir, &filenames);
+  for (const auto& filename : filenames) {
+    ::unlink((dir + "/" + filename).c_str());
+  }
+  return RemoveDir(dir);
+}
+
+DBStatus FileTool::RemoveFile(const std::string& path) {
+  if (::unlink(path.c_str()) != 0) {
+    return Status::kWriteFileFailed;
+  }
+  return Status::kSuccess;
+}
+
+DBStatus FileTool::RenameFile(const std::string& from, const std::string& to) {
+  if (std::rename(from.c_str(), to.c_str()) != 0) {
+    return Status::kWriteFileFailed;
+  }
+  return Status::kSuccess;
+}
+
+DBStatus FileTool::LinkFile(const std::string& from, const std::string& to) {
+  if (::link(from.c_str(), to.c_str()) == 0) {
+    return Status::kSuccess;
+  }
+  if (errno != EXDEV && errno != EPERM) {
+    return Status::kWriteFileFailed;
+  }
+  return CopyFile(from, to);
+}
+
+DBStatus FileTool::CopyFile(const std::string& from, const std::string& to,
+                            uint64_t size) {
+  const int src = ::open(from.c_str(), O_RDONLY);
+  if (src < 0) {
+    return Status::kReadFileFailed;
+  }
+  const int dst = ::open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (dst < 0) {
+    ::close(src);
+    return Status::kWriteFileFailed;
+  }
+  DBStatus s = Status::kSuccess;
+  char buf[64 * 1024];
+  while (size > 0) {
+    const ssize_t n = ::read(
+        src, buf, static_cast<size_t>(std::min<uint64_t>(sizeof(buf), size)));
+    if (n == 0) {
+      break;
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      s = Status::kReadFileFailed;
+      break;
+    }
+    const char* p = buf;
+    ssize_t left = n;
+    while (left > 0) {
+      const ssize_t written = ::write(dst, p, left);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        s = Status::kWriteFileFailed;
+        break;
+      }
+      p += written;
+      left -= written;
+    }
+    if (s != Status::kSuccess) {
+      break;
+    }
+    size -= n;
+  }
+  if (s == Status::kSuccess && ::fsync(dst) != 0) {
+    s = Status::kWriteFileFailed;
+  }
+  ::close(src);
+  ::close(dst);
+  if (s != Status::kSuccess) {
+    ::unlink(to.c_str());
+  }
+  return s;
+}
 }  // namespace corekv
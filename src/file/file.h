@@ -6,41 +6,122 @@
 #include <string>
 
 #include "../db/status.h"
+#include "../utils/rate_limiter.h"
+#include "io_uring.h"
 namespace corekv {
 
+// O_DIRECT要求读写的内存地址、文件偏移和长度都按照这个大小对齐
+static constexpr uint32_t kDirectIOAlignment = 4096;
+
 class FileWriter final {
  public:
-  FileWriter(const std::string& file_name);
+  // append为true时在已有文件的末尾追加，否则清空文件
+  // use_direct_io为true时使用O_DIRECT绕过page cache，只对新建的文件生效，
+  // 文件系统不支持的时候退化成普通写
+  FileWriter(const std::string& file_name, bool append = false,
+             bool use_direct_io = false);
   ~FileWriter();
   DBStatus Append(const char* data, int32_t len);
 
+  // direct io的时候只有缓冲区写满才落盘，不足一个缓冲区的部分留到Sync或者Close
   DBStatus FlushBuffer();
   void DeleteFile();
-  void Sync();
+  DBStatus Sync();
   void Close();
+  bool IsDirectIO() const { return direct_io_; }
+  // 大于0的时候每写入bytes_per_sync字节就用sync_file_range让内核开始异步回写，
+  // 脏页不会一直堆积到最后的fsync，direct io的时候不需要
+  void SetBytesPerSync(uint64_t bytes_per_sync);
+  // 实际发起sync_file_range的次数
+  uint64_t RangeSyncCount() const { return range_sync_count_; }
+  // 设置之后每次写文件之前都要先从rate_limiter申请令牌，为nullptr时不限速
+  void SetRateLimiter(RateLimiter* rate_limiter, IOPriority pri) {
+    rate_limiter_ = rate_limiter;
+    io_priority_ = pri;
+  }
  private:
   ssize_t Writen(const char* data, int len);
+  // 从file_offset_开始写入缓冲区的前n个字节，n需要是kDirectIOAlignment的整数倍
+  bool WriteAligned(size_t n);
+  // 写入了n个字节之后调用，累计超过bytes_per_sync_的时候开始回写新写入的部分
+  void MaybeRangeSync(size_t n);
+  // 末尾不足对齐大小的部分补0写入，再把文件截断到真实的长度，
+  // 已经对齐的部分从缓冲区中去掉，剩下的部分下次会覆盖写
+  DBStatus FlushDirect();
 
  private:
   static constexpr uint32_t kMaxFileBufferSize = 65536;
-  char buffer_[kMaxFileBufferSize];
+  alignas(kDirectIOAlignment) char buffer_[kMaxFileBufferSize];
   int32_t current_pos_ = 0;
   int fd_ = -1;
+  bool direct_io_ = false;
+  // direct io的时候缓冲区第一个字节在文件中的偏移，总是对齐的
+  uint64_t file_offset_ = 0;
+  uint64_t bytes_per_sync_ = 0;
+  // 已经写入内核的数据末尾在文件中的偏移，以及已经开始回写的位置
+  uint64_t written_offset_ = 0;
+  uint64_t synced_offset_ = 0;
+  uint64_t range_sync_count_ = 0;
+  RateLimiter* rate_limiter_ = nullptr;
+  IOPriority io_priority_ = IOPriority::kLow;
   std::string file_name_;
 };
 
 class FileReader final {
  public:
   ~FileReader();
-  FileReader(const std::string& file_name);
+  // use_mmap为true时把整个文件映射到内存中，文件打开之后不能再被修改
+  // use_direct_io为true时使用O_DIRECT读取，读到的数据不进入page cache，
+  // 文件系统不支持的时候退化成普通读，两者同时设置时只使用mmap
+  FileReader(const std::string& file_name, bool use_mmap = false,
+             bool use_direct_io = false);
+  FileReader(const FileReader&) = delete;
+  FileReader& operator=(const FileReader&) = delete;
   DBStatus Read(uint64_t offset, size_t n, std::string* result) const;
+  // mmap的时候result直接指向映射的内存，不使用scratch；
+  // 否则读取到scratch中，result指向scratch
+  DBStatus Read(uint64_t offset, size_t n, std::string_view* result,
+                std::string* scratch) const;
+  // 一次读取多个区间，每个请求的status单独设置，返回值只表示参数是否合法
+  // use_io_uring为true时所有请求一起提交给io_uring，不可用的时候逐个pread；
+  // mmap的时候result直接指向映射的内存
+  DBStatus MultiRead(ReadRequest* reqs, size_t n, bool use_io_uring) const;
+  // 提示内核异步预读[offset, offset+n)，不等待数据真正读入page cache
+  DBStatus Prefetch(uint64_t offset, size_t n) const;
+  bool IsOpen() const { return fd_ > -1; }
+  bool IsMmap() const { return mmap_base_ != nullptr; }
+  bool IsDirectIO() const { return direct_io_; }
+
+ private:
+  // 把[offset, offset+n)扩展到对齐的区间读取，再把需要的部分拷贝到result
+  DBStatus ReadDirect(uint64_t offset, size_t n, std::string* result) const;
 
  private:
   int fd_=-1;
+  bool direct_io_ = false;
+  // 没有使用mmap的时候为nullptr
+  const char* mmap_base_ = nullptr;
+  size_t mmap_size_ = 0;
 };
 
 class FileTool final {
   public:
   static uint64_t GetFileSize(const std::string_view& path);
+  static bool FileExists(const std::string& path);
+  // 只返回文件名，不包含目录部分
+  static DBStatus GetChildren(const std::string& dir,
+                              std::vector<std::string>* result);
+  static DBStatus CreateDir(const std::string& dir);
+  static DBStatus RemoveDir(const std::string& dir);
+  // 删除dir下的所有文件(不处理子目录)之后删除dir，dir中有子目录的时候失败
+  static DBStatus RemoveDirAndFiles(const std::string& dir);
+  static DBStatus RemoveFile(const std::string& path);
+  static DBStatus RenameFile(const std::string& from, const std::string& to);
+  // 优先创建硬链接，不在同一个文件系统的时候退化成拷贝并fsync
+  static DBStatus LinkFile(const std::string& from, const std::string& to);
+  // 拷贝from的前size个字节(不足size时拷贝整个文件)到新建的to并fsync，
+  // to已经存在的时候失败
+  static DBStatus CopyFile(const std::string& from, const std::string& to,
+                           uint64_t size = UINT64_MAX);
 };
 }  // namespace corekv
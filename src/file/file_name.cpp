@@ -0,0 +1,132 @@
+#include "file_name.h"
+
+#include <stdio.h>
+
+#include "file.h"
+namespace corekv {
+static std::string MakeFileName(const std::string& dbname, uint64_t number,
+                                const char* suffix) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "/%06llu.%s",
+           static_cast<unsigned long long>(number), suffix);
+  return dbname + buf;
+}
+
+std::string FileName::LogFileName(const std::string& dbname,
+                                  uint64_t number) {
+  return MakeFileName(dbname, number, "log");
+}
+
+std::string FileName::TableFileName(const std::string& dbname,
+                                    uint64_t number) {
+  return MakeFileName(dbname, number, "sst");
+}
+
+std::string FileName::DescriptorFileName(const std::string& dbname,
+                                         uint64_t number) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "/MANIFEST-%06llu",
+           static_cast<unsigned long long>(number));
+  return dbname + buf;
+}
+
+std::string FileName::CurrentFileName(const std::string& dbname) {
+  return dbname + "/CURRENT";
+}
+
+std::string FileName::TempFileName(const std::string& dbname,
+                                   uint64_t number) {
+  return MakeFileName(dbname, number, "dbtmp");
+}
+
+std::string FileName::BlobFileName(const std::string& dbname,
+                                   uint64_t number) {
+  return MakeFileName(dbname, number, "blob");
+}
+
+std::string FileName::BlockCacheKeysFileName(const std::string& dbname) {
+  return dbname + "/BLOCK_CACHE_KEYS";
+}
+
+DBStatus FileName::SetCurrentFile(const std::string& dbname,
+                                  uint64_t descriptor_number) {
+  std::string manifest = DescriptorFileName(dbname, descriptor_number);
+  // 只保存不带目录的文件名
+  std::string contents = manifest.substr(dbname.size() + 1) + "\n";
+  const std::string& tmp = TempFileName(dbname, descriptor_number);
+  FileWriter writer(tmp);
+  DBStatus s = writer.Append(contents.data(), contents.size());
+  if (s == Status::kSuccess) {
+    s = writer.Sync();
+  }
+  writer.Close();
+  if (s == Status::kSuccess) {
+    s = FileTool::RenameFile(tmp, CurrentFileName(dbname));
+  }
+  if (s != Status::kSuccess) {
+    FileTool::RemoveFile(tmp);
+  }
+  return s;
+}
+
+// 解析出文件名中的数字部分，要求至少有一位数字
+static bool ConsumeDecimalNumber(std::string_view* in, uint64_t* val) {
+  uint64_t v = 0;
+  size_t digits = 0;
+  while (digits < in->size()) {
+    const char c = (*in)[digits];
+    if (c < '0' || c > '9') {
+      break;
+    }
+    const uint64_t delta = c - '0';
+    // 溢出
+    if (v > (UINT64_MAX - delta) / 10) {
+      return false;
+    }
+    v = v * 10 + delta;
+    ++digits;
+  }
+  in->remove_prefix(digits);
+  *val = v;
+  return digits > 0;
+}
+
+bool FileName::ParseFileName(const std::string& filename, uint64_t* number,
+                             FileType* type) {
+  std::string_view rest(filename);
+  if (rest == "CURRENT") {
+    *number = 0;
+    *type = FileType::kCurrentFile;
+    return true;
+  }
+  if (rest == "BLOCK_CACHE_KEYS") {
+    *number = 0;
+    *type = FileType::kBlockCacheKeysFile;
+    return true;
+  }
+  static constexpr std::string_view kManifestPrefix = "MANIFEST-";
+  if (rest.substr(0, kManifestPrefix.size()) == kManifestPrefix) {
+    rest.remove_prefix(kManifestPrefix.size());
+    if (!ConsumeDecimalNumber(&rest, number) || !rest.empty()) {
+      return false;
+    }
+    *type = FileType::kDescriptorFile;
+    return true;
+  }
+  if (!ConsumeDecimalNumber(&rest, number)) {
+    return false;
+  }
+  if (rest == ".log") {
+    *type = FileType::kLogFile;
+  } else if (rest == ".sst") {
+    *type = FileType::kTableFile;
+  } else if (rest == ".dbtmp") {
+    *type = FileType::kTempFile;
+  } else if (rest == ".blob") {
+    *type = FileType::kBlobFile;
+  } else {
+    return false;
+  }
+  return true;
+}
+}  // namespace corekv
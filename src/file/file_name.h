@@ -1,8 +1,47 @@
 #pragma once
+#include <stdint.h>
 
-namespace corekv
-{
-    class FileName {
+#include <string>
+#include <string_view>
 
-    };
-} // namespace corekv
+#include "../db/status.h"
+
+namespace corekv {
+enum class FileType {
+  kLogFile,
+  kTableFile,
+  kDescriptorFile,
+  kCurrentFile,
+  kTempFile,
+  kBlobFile,
+  kBlockCacheKeysFile,
+};
+// db目录下各类文件的命名规则
+//   dbname/[0-9]+.log
+//   dbname/[0-9]+.sst
+//   dbname/MANIFEST-[0-9]+
+//   dbname/CURRENT
+//   dbname/[0-9]+.dbtmp
+//   dbname/[0-9]+.blob
+//   dbname/BLOCK_CACHE_KEYS
+class FileName final {
+ public:
+  static std::string LogFileName(const std::string& dbname, uint64_t number);
+  static std::string TableFileName(const std::string& dbname, uint64_t number);
+  static std::string DescriptorFileName(const std::string& dbname,
+                                        uint64_t number);
+  // CURRENT文件中保存的是当前正在使用的MANIFEST文件名
+  static std::string CurrentFileName(const std::string& dbname);
+  static std::string TempFileName(const std::string& dbname, uint64_t number);
+  // 和sst分离存放的大value
+  static std::string BlobFileName(const std::string& dbname, uint64_t number);
+  // 关闭db时block_cache中的block位置，见Options::block_cache_warmup
+  static std::string BlockCacheKeysFileName(const std::string& dbname);
+  // 先写临时文件再rename，保证CURRENT的更新是原子的
+  static DBStatus SetCurrentFile(const std::string& dbname,
+                                 uint64_t descriptor_number);
+  // 解析不带目录的文件名，无法识别的返回false
+  static bool ParseFileName(const std::string& filename, uint64_t* number,
+                            FileType* type);
+};
+}  // namespace corekv
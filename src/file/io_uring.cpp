@@ -0,0 +1,212 @@
+#include "io_uring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define COREKV_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "../logger/log.h"
+namespace corekv {
+IoUring* IoUring::ThreadLocal() {
+  // 第一次使用的时候才创建，失败之后这个线程不再重试
+  thread_local bool inited = false;
+  thread_local std::unique_ptr<IoUring> ring;
+  if (!inited) {
+    inited = true;
+    std::unique_ptr<IoUring> r(new IoUring());
+    if (r->Init(kQueueDepth)) {
+      ring = std::move(r);
+    }
+  }
+  return ring.get();
+}
+
+#ifdef COREKV_HAVE_IO_URING
+namespace {
+inline uint32_t LoadAcquire(const uint32_t* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+inline void StoreRelease(uint32_t* p, uint32_t v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+}  // namespace
+
+IoUring::~IoUring() {
+  if (sqes_ != nullptr) {
+    ::munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+    ::munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != nullptr) {
+    ::munmap(sq_ring_, sq_ring_size_);
+  }
+  if (ring_fd_ > -1) {
+    ::close(ring_fd_);
+  }
+}
+
+bool IoUring::Init(uint32_t entries) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+  if (ring_fd_ < 0) {
+    LOG(corekv::LogLevel::WARN, "io_uring_setup failed:%s, fallback to pread",
+        strerror(errno));
+    return false;
+  }
+  sq_entries_ = params.sq_entries;
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  // 5.4之后的内核sq和cq的ring可以一次映射
+  const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  void* sq = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED) {
+    return false;
+  }
+  sq_ring_ = sq;
+  if (single_mmap) {
+    cq_ring_ = sq;
+  } else {
+    void* cq = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED) {
+      return false;
+    }
+    cq_ring_ = cq;
+  }
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  void* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return false;
+  }
+  sqes_ = sqes;
+  char* sq_base = static_cast<char*>(sq_ring_);
+  char* cq_base = static_cast<char*>(cq_ring_);
+  sq_head_ = reinterpret_cast<uint32_t*>(sq_base + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<uint32_t*>(sq_base + params.sq_off.tail);
+  sq_mask_ = reinterpret_cast<uint32_t*>(sq_base + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<uint32_t*>(sq_base + params.sq_off.array);
+  cq_head_ = reinterpret_cast<uint32_t*>(cq_base + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<uint32_t*>(cq_base + params.cq_off.tail);
+  cq_mask_ = reinterpret_cast<uint32_t*>(cq_base + params.cq_off.ring_mask);
+  cqes_ = cq_base + params.cq_off.cqes;
+  return true;
+}
+
+size_t IoUring::Prepare(int fd, ReadRequest* reqs, size_t begin, size_t end) {
+  uint32_t tail = *sq_tail_;
+  const uint32_t head = LoadAcquire(sq_head_);
+  const uint32_t mask = *sq_mask_;
+  auto* sqes = static_cast<struct io_uring_sqe*>(sqes_);
+  size_t i = begin;
+  for (; i < end && tail - head < sq_entries_; ++i, ++tail) {
+    ReadRequest& req = reqs[i];
+    req.scratch.resize(req.len);
+    const uint32_t index = tail & mask;
+    struct io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->off = req.offset;
+    sqe->addr = reinterpret_cast<uint64_t>(req.scratch.data());
+    sqe->len = static_cast<uint32_t>(req.len);
+    // 完成的时候通过user_data找到对应的请求
+    sqe->user_data = i;
+    sq_array_[index] = index;
+  }
+  StoreRelease(sq_tail_, tail);
+  return i - begin;
+}
+
+int IoUring::Enter(uint32_t to_submit, uint32_t min_complete) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd_, to_submit,
+                                    min_complete, IORING_ENTER_GETEVENTS,
+                                    nullptr, 0));
+}
+
+size_t IoUring::Reap(ReadRequest* reqs) {
+  uint32_t head = *cq_head_;
+  const uint32_t tail = LoadAcquire(cq_tail_);
+  const uint32_t mask = *cq_mask_;
+  auto* cqes = static_cast<struct io_uring_cqe*>(cqes_);
+  size_t reaped = 0;
+  for (; head != tail; ++head, ++reaped) {
+    const struct io_uring_cqe* cqe = &cqes[head & mask];
+    ReadRequest& req = reqs[cqe->user_data];
+    if (cqe->res < 0) {
+      req.scratch.clear();
+      req.status = Status::kReadFileFailed;
+      continue;
+    }
+    // 和pread一样，读到文件末尾的时候实际长度可能小于len
+    req.scratch.resize(cqe->res);
+    req.result = req.scratch;
+    req.status = Status::kSuccess;
+  }
+  StoreRelease(cq_head_, head);
+  return reaped;
+}
+
+void IoUring::Read(int fd, ReadRequest* reqs, size_t n) {
+  size_t prepared = 0;
+  size_t completed = 0;
+  uint32_t unsubmitted = 0;
+  while (completed < n) {
+    const size_t count = Prepare(fd, reqs, prepared, n);
+    prepared += count;
+    unsubmitted += count;
+    // 提交所有放入队列的请求，至少等待一个完成再继续放入剩下的
+    const int ret = Enter(unsubmitted, 1);
+    if (ret >= 0) {
+      unsubmitted -= static_cast<uint32_t>(ret);
+    } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      break;
+    }
+    completed += Reap(reqs);
+  }
+  if (completed == n) {
+    return;
+  }
+  // ring出错了，没有提交的请求直接失败，已经提交的要等内核写完才能释放scratch
+  LOG(corekv::LogLevel::ERROR, "io_uring_enter failed:%s", strerror(errno));
+  StoreRelease(sq_tail_, *sq_tail_ - unsubmitted);
+  for (size_t i = prepared - unsubmitted; i < n; ++i) {
+    reqs[i].status = Status::kReadFileFailed;
+  }
+  size_t inflight = prepared - unsubmitted - completed;
+  while (inflight > 0) {
+    if (Enter(0, 1) < 0 && errno != EINTR) {
+      break;
+    }
+    inflight -= Reap(reqs);
+  }
+}
+#else
+IoUring::~IoUring() {}
+bool IoUring::Init(uint32_t) { return false; }
+size_t IoUring::Prepare(int, ReadRequest*, size_t, size_t) { return 0; }
+int IoUring::Enter(uint32_t, uint32_t) { return -1; }
+size_t IoUring::Reap(ReadRequest*) { return 0; }
+void IoUring::Read(int, ReadRequest* reqs, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    reqs[i].status = Status::kNotSupported;
+  }
+}
+#endif
+}  // namespace corekv
@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+
+#include "../db/status.h"
+/*
+ * 直接通过系统调用使用io_uring，不依赖liburing
+ * 一次提交多个读请求，由内核并发完成，只需要一次io_uring_enter等待，
+ * 不需要每个在途的io占用一个线程，适合NVMe这种需要足够队列深度才能跑满的设备
+ *
+ * 每个线程一个ring，内核不支持或者被seccomp禁止的时候ThreadLocal返回nullptr，
+ * 调用方退化成逐个pread
+ */
+namespace corekv {
+struct ReadRequest {
+  uint64_t offset = 0;
+  size_t len = 0;
+  // 读取完成之后指向scratch或者mmap的内存
+  std::string_view result;
+  std::string scratch;
+  DBStatus status = Status::kSuccess;
+};
+
+class IoUring final {
+ public:
+  static IoUring* ThreadLocal();
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+  ~IoUring();
+  // 读取fd上的n个请求并等待全部完成，结果放在每个请求的scratch中
+  void Read(int fd, ReadRequest* reqs, size_t n);
+
+ private:
+  IoUring() = default;
+  bool Init(uint32_t entries);
+  // 把[begin, end)的请求放入提交队列，返回实际放入的个数
+  size_t Prepare(int fd, ReadRequest* reqs, size_t begin, size_t end);
+  // 提交to_submit个请求，并等待其中min_complete个完成
+  int Enter(uint32_t to_submit, uint32_t min_complete);
+  // 处理完成队列中所有的结果，返回处理的个数
+  size_t Reap(ReadRequest* reqs);
+
+ private:
+  // 队列深度，超过的请求分批提交
+  static constexpr uint32_t kQueueDepth = 64;
+  int ring_fd_ = -1;
+  uint32_t sq_entries_ = 0;
+  // 和内核共享的ring，head/tail需要用原子操作访问
+  uint32_t* sq_head_ = nullptr;
+  uint32_t* sq_tail_ = nullptr;
+  uint32_t* sq_mask_ = nullptr;
+  uint32_t* sq_array_ = nullptr;
+  uint32_t* cq_head_ = nullptr;
+  uint32_t* cq_tail_ = nullptr;
+  uint32_t* cq_mask_ = nullptr;
+  void* sqes_ = nullptr;
+  void* cqes_ = nullptr;
+  void* sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  size_t sqes_size_ = 0;
+};
+}  // namespace corekv
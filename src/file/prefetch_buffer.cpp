@@ -0,0 +1,42 @@
+#include "prefetch_buffer.h"
+
+#include <algorithm>
+
+namespace corekv {
+FilePrefetchBuffer::FilePrefetchBuffer(const FileReader* file_reader,
+                                       size_t initial_readahead,
+                                       size_t max_readahead,
+                                       bool assume_sequential)
+    : file_reader_(file_reader),
+      initial_readahead_(std::min(initial_readahead, max_readahead)),
+      max_readahead_(max_readahead),
+      readahead_size_(initial_readahead_),
+      assume_sequential_(assume_sequential) {}
+
+bool FilePrefetchBuffer::TryRead(uint64_t offset, size_t n,
+                                 std::string_view* result) {
+  if (offset >= buffer_offset_ &&
+      offset + n <= buffer_offset_ + buffer_.size()) {
+    *result = std::string_view(buffer_).substr(offset - buffer_offset_, n);
+    UpdateReadPattern(offset, n);
+    return true;
+  }
+  const bool sequential = assume_sequential_ || offset == prev_end_;
+  UpdateReadPattern(offset, n);
+  if (!sequential || max_readahead_ == 0) {
+    readahead_size_ = initial_readahead_;
+    return false;
+  }
+  std::string_view data;
+  DBStatus s = file_reader_->Read(offset, n + readahead_size_, &data, &buffer_);
+  // 读取失败或者不够n字节的时候交给调用方重新读，由它返回具体的错误
+  if (s != Status::kSuccess || data.size() < n || data.data() != buffer_.data()) {
+    buffer_.clear();
+    return false;
+  }
+  buffer_offset_ = offset;
+  readahead_size_ = std::min(readahead_size_ * 2, max_readahead_);
+  *result = data.substr(0, n);
+  return true;
+}
+}  // namespace corekv
@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+
+#include "file.h"
+namespace corekv {
+/*
+ * 顺序读的预读缓冲区，每个迭代器持有一个，不能在线程之间共享
+ * 缓冲区中没有的请求如果紧接着上一次读取的末尾，说明是顺序读，
+ * 一次多读readahead_size_字节放进缓冲区，之后每次预读的长度翻倍，直到max_readahead；
+ * 不连续的请求(Seek)把预读长度恢复成初始值，返回false由调用方自己读取
+ */
+class FilePrefetchBuffer final {
+ public:
+  // assume_sequential为true时第一次读取就开始预读，用于compaction这种一定是顺序读的场景
+  FilePrefetchBuffer(const FileReader* file_reader, size_t initial_readahead,
+                     size_t max_readahead, bool assume_sequential = false);
+  FilePrefetchBuffer(const FilePrefetchBuffer&) = delete;
+  FilePrefetchBuffer& operator=(const FilePrefetchBuffer&) = delete;
+
+  // 返回true时result指向缓冲区中[offset, offset+n)的数据，下次调用之前有效
+  bool TryRead(uint64_t offset, size_t n, std::string_view* result);
+  // 没有经过缓冲区的读取(例如命中了block_cache)也需要记录下来，用于判断是否顺序读
+  void UpdateReadPattern(uint64_t offset, size_t n) { prev_end_ = offset + n; }
+  size_t readahead_size() const { return readahead_size_; }
+
+ private:
+  const FileReader* const file_reader_;
+  const size_t initial_readahead_;
+  const size_t max_readahead_;
+  size_t readahead_size_;
+  std::string buffer_;
+  // 缓冲区第一个字节在文件中的偏移
+  uint64_t buffer_offset_ = 0;
+  // 上一次读取的末尾，UINT64_MAX表示还没有读过
+  uint64_t prev_end_ = UINT64_MAX;
+  bool assume_sequential_;
+};
+}  // namespace corekv
@@ -0,0 +1,211 @@
+#include "blocked_bloomfilter.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define COREKV_HAVE_AVX2_DISPATCH 1
+#endif
+
+#include "utils/codec.h"
+#include "utils/hash_util.h"
+
+namespace corekv {
+namespace {
+// 黄金比例常数，line内第j个bit位置是 (hash * kGolden^j) 的高9位
+constexpr uint32_t kGolden = 0x9e3779b9;
+constexpr uint32_t kLineBitsLg = 9;
+
+constexpr uint32_t GoldenPower(uint32_t n) {
+  uint32_t result = 1;
+  for (uint32_t i = 0; i < n; ++i) {
+    result *= kGolden;
+  }
+  return result;
+}
+
+// 选择line用原始hash，line内的位置用打散之后的hash，两者不相关
+inline uint32_t LineIndex(uint32_t hash, uint32_t num_lines) {
+  return static_cast<uint32_t>((static_cast<uint64_t>(hash) * num_lines) >> 32);
+}
+
+inline uint32_t Remix(uint32_t hash) {
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+// 选择line的hash和line内bit位置的hash，旧格式两者都来自32位hash，新格式分别取64位hash的高低32位
+inline void KeyHashes(const std::string_view& key, FilterFormat format,
+                      uint32_t* line_hash, uint32_t* bit_hash) {
+  if (format == kFilterFormatLegacy) {
+    const uint32_t hash = hash_util::SimMurMurHash(key.data(), key.size());
+    *line_hash = hash;
+    *bit_hash = Remix(hash);
+    return;
+  }
+  const uint64_t hash = hash_util::Hash64(key.data(), key.size());
+  *line_hash = static_cast<uint32_t>(hash >> 32);
+  *bit_hash = static_cast<uint32_t>(hash);
+}
+
+#ifdef COREKV_HAVE_AVX2_DISPATCH
+__attribute__((target("avx2"))) bool ProbeAvx2(const char* line, uint32_t h,
+                                                uint32_t hash_num) {
+  const __m256i multipliers = _mm256_setr_epi32(
+      GoldenPower(0), GoldenPower(1), GoldenPower(2), GoldenPower(3),
+      GoldenPower(4), GoldenPower(5), GoldenPower(6), GoldenPower(7));
+  const __m256i ones = _mm256_set1_epi32(1);
+  const __m256i low_bits = _mm256_set1_epi32(31);
+  __m256i base = _mm256_set1_epi32(static_cast<int32_t>(h));
+  for (uint32_t done = 0;; done += 8) {
+    const __m256i hashes = _mm256_mullo_epi32(base, multipliers);
+    const __m256i bit_pos = _mm256_srli_epi32(hashes, 32 - kLineBitsLg);
+    // line按照32位的word寻址，每个lane从对应的word中取出一个bit
+    const __m256i words =
+        _mm256_i32gather_epi32(reinterpret_cast<const int*>(line),
+                               _mm256_srli_epi32(bit_pos, 5), 4);
+    const __m256i bits =
+        _mm256_sllv_epi32(ones, _mm256_and_si256(bit_pos, low_bits));
+    const __m256i hit = _mm256_cmpeq_epi32(_mm256_and_si256(words, bits), bits);
+    const uint32_t mask = _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+    const uint32_t remaining = hash_num - done;
+    const uint32_t want = remaining >= 8 ? 0xff : (1u << remaining) - 1;
+    if ((mask & want) != want) {
+      return false;
+    }
+    if (remaining <= 8) {
+      return true;
+    }
+    base = _mm256_mullo_epi32(base, _mm256_set1_epi32(GoldenPower(8)));
+  }
+}
+
+// 静态初始化的时候可能还没有初始化cpu信息，需要先调用__builtin_cpu_init
+bool DetectAvx2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+const bool kHasAvx2 = DetectAvx2();
+#endif
+
+bool ProbePortable(const char* line, uint32_t h, uint32_t hash_num) {
+  for (uint32_t j = 0; j < hash_num; ++j) {
+    const uint32_t bit_pos = h >> (32 - kLineBitsLg);
+    if ((line[bit_pos >> 3] & (1 << (bit_pos & 7))) == 0) {
+      return false;
+    }
+    h *= kGolden;
+  }
+  return true;
+}
+}  // namespace
+
+BlockedBloomFilter::BlockedBloomFilter(int32_t bits_per_key)
+    : bits_per_key_(bits_per_key < 1 ? 1 : bits_per_key) {
+  // 和BloomFilter一样按照bits_per_key * ln2计算，line内有512位，最多30个足够
+  int32_t hash_num = static_cast<int32_t>(bits_per_key_ * 0.69314718056);
+  hash_num = hash_num < 1 ? 1 : hash_num;
+  hash_num = hash_num > 30 ? 30 : hash_num;
+  filter_policy_meta_.hash_num = EncodeHashNum(hash_num, kFilterFormatHash64);
+}
+
+const char* BlockedBloomFilter::Name() { return "blocked_bloomfilter"; }
+
+void BlockedBloomFilter::CreateFilter(const std::string* keys, int32_t n) {
+  CreateFilter(keys, n, &filter_data_);
+}
+
+void BlockedBloomFilter::CreateFilter(const std::string* keys, int32_t n,
+                                      std::string* dst) {
+  if (n <= 0 || !keys || !dst) {
+    return;
+  }
+  const uint64_t bits = static_cast<uint64_t>(n) * bits_per_key_;
+  const uint32_t num_lines = (bits + kLineBits - 1) / kLineBits;
+  const size_t init_size = dst->size();
+  dst->resize(init_size + num_lines * kLineBytes, 0);
+  char* lines = &(*dst)[init_size];
+  const FilterFormat format = DecodeFilterFormat(filter_policy_meta_.hash_num);
+  const uint32_t hash_num = DecodeHashNum(filter_policy_meta_.hash_num);
+  for (int32_t i = 0; i < n; ++i) {
+    uint32_t line_hash, h;
+    KeyHashes(keys[i], format, &line_hash, &h);
+    char* line = lines + LineIndex(line_hash, num_lines) * kLineBytes;
+    for (uint32_t j = 0; j < hash_num; ++j) {
+      const uint32_t bit_pos = h >> (32 - kLineBitsLg);
+      line[bit_pos >> 3] |= (1 << (bit_pos & 7));
+      h *= kGolden;
+    }
+  }
+}
+
+bool BlockedBloomFilter::MayMatchPortable(const std::string_view& key,
+                                          const char* lines,
+                                          uint32_t num_lines,
+                                          uint32_t hash_num) {
+  const FilterFormat format = DecodeFilterFormat(hash_num);
+  if (format > kFilterFormatHash64) {
+    return true;
+  }
+  uint32_t line_hash, h;
+  KeyHashes(key, format, &line_hash, &h);
+  return ProbePortable(lines + LineIndex(line_hash, num_lines) * kLineBytes, h,
+                       DecodeHashNum(hash_num));
+}
+
+bool BlockedBloomFilter::MayMatchLines(const std::string_view& key,
+                                       const char* lines, uint32_t num_lines,
+                                       uint32_t hash_num) {
+  const FilterFormat format = DecodeFilterFormat(hash_num);
+  if (format > kFilterFormatHash64) {
+    return true;
+  }
+  uint32_t line_hash, h;
+  KeyHashes(key, format, &line_hash, &h);
+  const char* line = lines + LineIndex(line_hash, num_lines) * kLineBytes;
+#ifdef COREKV_HAVE_AVX2_DISPATCH
+  if (kHasAvx2) {
+    return ProbeAvx2(line, h, DecodeHashNum(hash_num));
+  }
+#endif
+  return ProbePortable(line, h, DecodeHashNum(hash_num));
+}
+
+bool BlockedBloomFilter::MayMatch(const std::string_view& key,
+                                  int32_t start_pos, int32_t len) {
+  if (key.empty() || start_pos < 0 ||
+      static_cast<size_t>(start_pos) >= filter_data_.size()) {
+    return false;
+  }
+  if (len == 0) {
+    len = filter_data_.size() - start_pos;
+  }
+  const uint32_t num_lines = len / kLineBytes;
+  if (num_lines == 0) {
+    return true;
+  }
+  return MayMatchLines(key, filter_data_.data() + start_pos, num_lines,
+                       filter_policy_meta_.hash_num);
+}
+
+bool BlockedBloomFilter::MayMatch(const std::string_view& key,
+                                  const std::string_view& bf_datas) {
+  static constexpr uint32_t kFixedSize = 4;
+  const size_t size = bf_datas.size();
+  if (size < kFixedSize || key.empty()) {
+    return false;
+  }
+  const uint32_t hash_num =
+      util::DecodeFixed32(bf_datas.data() + size - kFixedSize);
+  const size_t lines_size = size - kFixedSize;
+  // 格式不对的时候不过滤
+  if (DecodeHashNum(hash_num) > 30 || lines_size == 0 ||
+      lines_size % kLineBytes != 0) {
+    return true;
+  }
+  return MayMatchLines(key, bf_datas.data(), lines_size / kLineBytes,
+                       hash_num);
+}
+}  // namespace corekv
@@ -0,0 +1,43 @@
+#pragma once
+#include "filter_policy.h"
+namespace corekv {
+/*
+ * 按cache line分块的布隆过滤器: 一个key的所有bit都落在同一个64字节的line中，
+ * 负查询最多访问一次cache line(数据没有按64字节对齐时最多两次)
+ * line由hash通过乘法映射，line内的bit位置由另一个hash反复乘以黄金比例常数得到，
+ * 整个查询没有除法，支持AVX2的时候8个bit位置一起计算和比较
+ *
+ * 数据格式和BloomFilter相同: [line 0]...[line N-1][hash_num(fixed32)]
+ */
+class BlockedBloomFilter final : public FilterPolicy {
+ public:
+  static constexpr uint32_t kLineBytes = 64;
+  static constexpr uint32_t kLineBits = kLineBytes * 8;
+
+  explicit BlockedBloomFilter(int32_t bits_per_key);
+  ~BlockedBloomFilter() = default;
+  const char* Name() override;
+  const std::string& Data() override { return filter_data_; }
+  const FilterPolicyMeta& GetMeta() override { return filter_policy_meta_; }
+  void CreateFilter(const std::string* keys, int32_t n) override;
+  void CreateFilter(const std::string* keys, int32_t n,
+                    std::string* dst) override;
+  bool MayMatch(const std::string_view& key, int32_t start_pos,
+                int32_t len) override;
+  uint32_t Size() override { return filter_data_.size(); }
+  bool MayMatch(const std::string_view& key,
+                const std::string_view& bf_datas) override;
+
+  // hash_num是带有格式版本的GetMeta().hash_num
+  // 在lines中查询key，不依赖CPU指令集的版本，测试中用来和SIMD版本对比
+  static bool MayMatchPortable(const std::string_view& key, const char* lines,
+                               uint32_t num_lines, uint32_t hash_num);
+  static bool MayMatchLines(const std::string_view& key, const char* lines,
+                            uint32_t num_lines, uint32_t hash_num);
+
+ private:
+  FilterPolicyMeta filter_policy_meta_;
+  int32_t bits_per_key_ = 0;
+  std::string filter_data_;
+};
+}  // namespace corekv
@@ -1,4 +1,6 @@
 #pragma once
+#include <stdint.h>
+
 #include "filter_policy.h"
 namespace corekv {
 class BloomFilter final : public FilterPolicy {
@@ -14,6 +16,8 @@ class BloomFilter final : public FilterPolicy {
     return filter_policy_meta_;
   }
   void CreateFilter(const std::string* keys, int32_t n) override;
+  void CreateFilter(const std::string* keys, int32_t n,
+                    std::string* dst) override;
   bool MayMatch(const std::string_view& key, int32_t start_pos,
                 int32_t len) override;
   uint32_t Size() override { return bloomfilter_data_.size(); }
@@ -21,6 +25,13 @@ class BloomFilter final : public FilterPolicy {
                 const std::string_view& bf_datas) override;
 
  private:
+  // 把64位hash映射到[0, bits)，用乘法代替取模
+  static uint64_t BitPosition(uint64_t hash, uint64_t bits) {
+    return static_cast<uint64_t>((static_cast<__uint128_t>(hash) * bits) >> 64);
+  }
+  // array是不包含hash_num的位数组，encoded_hash_num中带有格式版本
+  static bool MayMatchBits(const std::string_view& key, const char* array,
+                           size_t bytes, uint32_t encoded_hash_num);
   void CalcBloomBitsPerKey(int32_t entries_num, float positive = 0.01);
   void CalcHashNum();
 
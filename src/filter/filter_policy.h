@@ -1,8 +1,29 @@
 #pragma once
+#include <stdint.h>
+
 #include <string>
 #include <string_view>
 // 用于过滤
 namespace corekv {
+// 追加在filter末尾的hash_num: 低24位是hash函数的个数(ribbon是结果位数)，
+// 高8位是filter的格式版本，只认识版本0的旧代码看到的是一个很大的hash_num，不会过滤
+enum FilterFormat : uint32_t {
+  // 32位的SimMurMurHash
+  kFilterFormatLegacy = 0,
+  // 64位的Hash64
+  kFilterFormatHash64 = 1,
+};
+static constexpr uint32_t kFilterFormatShift = 24;
+inline uint32_t EncodeHashNum(uint32_t hash_num, FilterFormat format) {
+  return hash_num | (static_cast<uint32_t>(format) << kFilterFormatShift);
+}
+inline uint32_t DecodeHashNum(uint32_t encoded) {
+  return encoded & ((1u << kFilterFormatShift) - 1);
+}
+inline FilterFormat DecodeFilterFormat(uint32_t encoded) {
+  return static_cast<FilterFormat>(encoded >> kFilterFormatShift);
+}
+
 struct FilterPolicyMeta {
   uint32_t hash_num;
 };
@@ -13,6 +34,9 @@ class FilterPolicy {
   // 当前过滤器的名字
   virtual const char* Name() = 0;
   virtual void CreateFilter(const std::string* keys, int n) = 0;
+  // 把filter追加到dst中，不修改过滤器内部的数据，多个sst可以共用同一个policy
+  virtual void CreateFilter(const std::string* keys, int n,
+                            std::string* dst) = 0;
   virtual bool MayMatch(const std::string_view& key, int32_t start_pos,
                         int32_t len) = 0;
   virtual bool MayMatch(const std::string_view& key,
@@ -0,0 +1,240 @@
+#include "ribbon_filter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "utils/codec.h"
+#include "utils/hash_util.h"
+
+namespace corekv {
+namespace {
+// 每个方程的系数宽度，也是解按位交错存储时一组slot的个数
+constexpr uint32_t kCoeffBits = 64;
+// num_blocks(fixed32) + seed(1字节)
+constexpr size_t kMetaSize = 5;
+// r最多32位，和uint32_t的result对应
+constexpr uint32_t kMaxResultBits = 32;
+// slot数量相对key数量的初始冗余，64位系数下大部分情况第一个seed就能成功
+constexpr double kSlotOverhead = 1.05;
+constexpr uint32_t kMaxSeeds = 256;
+// 每失败这么多次就扩大一次slot数量
+constexpr uint32_t kSeedsPerSize = 8;
+
+inline uint64_t Mix64(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+struct Equation {
+  uint32_t start;
+  uint64_t coeff;
+  uint32_t result;
+};
+
+// 旧格式是32位的SimMurMurHash，新格式是64位的Hash64
+inline uint64_t KeyHash(const std::string_view& key, FilterFormat format) {
+  return format == kFilterFormatLegacy
+             ? hash_util::SimMurMurHash(key.data(), key.size())
+             : hash_util::Hash64(key.data(), key.size());
+}
+
+// 同一个key在不同seed下得到互不相关的方程，构建失败时换一个seed重试
+inline Equation MakeEquation(uint64_t hash, FilterFormat format, uint8_t seed,
+                             uint32_t num_starts, uint32_t result_mask) {
+  const uint64_t x =
+      format == kFilterFormatLegacy
+          ? Mix64((static_cast<uint64_t>(seed) << 32) | hash)
+          : Mix64(hash + seed * 0x9e3779b97f4a7c15ULL);
+  Equation eq;
+  eq.start = static_cast<uint32_t>(((x >> 32) * num_starts) >> 32);
+  // 最低位固定为1，对应start这个slot
+  eq.coeff = Mix64(x ^ 0x9e3779b97f4a7c15ULL) | 1;
+  eq.result = static_cast<uint32_t>(x) & result_mask;
+  return eq;
+}
+
+inline uint32_t Parity(uint64_t x) { return __builtin_parityll(x); }
+
+// 带状高斯消元，coeffs[i]不为0说明第i行已经有方程占用，并且最低位一定是1
+class Banding final {
+ public:
+  explicit Banding(uint32_t num_slots)
+      : coeffs_(num_slots, 0), results_(num_slots, 0) {}
+
+  bool Add(const Equation& eq) {
+    uint32_t i = eq.start;
+    uint64_t coeff = eq.coeff;
+    uint32_t result = eq.result;
+    while (true) {
+      if (coeffs_[i] == 0) {
+        coeffs_[i] = coeff;
+        results_[i] = result;
+        return true;
+      }
+      coeff ^= coeffs_[i];
+      result ^= results_[i];
+      if (coeff == 0) {
+        // 和已有的方程线性相关，结果也一样才有解
+        return result == 0;
+      }
+      const int32_t shift = __builtin_ctzll(coeff);
+      coeff >>= shift;
+      i += shift;
+    }
+  }
+
+  // 从最后一行开始回代，window[b]的第k位是slot i+k的解的第b位，
+  // 每处理完64个slot就把一组window写到dst中
+  void BackSubstitute(uint32_t result_bits, uint8_t seed, char* dst) const {
+    const uint32_t num_slots = coeffs_.size();
+    std::vector<uint64_t> window(result_bits, 0);
+    for (uint32_t i = num_slots; i-- > 0;) {
+      const uint64_t coeff = coeffs_[i];
+      // 没有方程的slot是自由变量，取随机值保证误判率不依赖于负载
+      const uint32_t value =
+          coeff == 0 ? static_cast<uint32_t>(Mix64(i ^ (seed * 0x100000001ULL)))
+                     : results_[i];
+      for (uint32_t b = 0; b < result_bits; ++b) {
+        window[b] <<= 1;
+        window[b] |= ((value >> b) & 1) ^ Parity(coeff & window[b]);
+      }
+      if (i % kCoeffBits == 0) {
+        char* block = dst + (i / kCoeffBits) * result_bits * 8;
+        for (uint32_t b = 0; b < result_bits; ++b) {
+          util::EncodeFixed64(block + b * 8, window[b]);
+        }
+      }
+    }
+  }
+
+ private:
+  std::vector<uint64_t> coeffs_;
+  std::vector<uint32_t> results_;
+};
+}  // namespace
+
+RibbonFilter::RibbonFilter(int32_t bloom_equivalent_bits_per_key) {
+  // bits_per_key的BloomFilter误判率约为0.6185^bits_per_key = 2^-(bits_per_key * ln2)
+  int32_t result_bits =
+      static_cast<int32_t>(std::lround(bloom_equivalent_bits_per_key * 0.69314718056));
+  result_bits =
+      std::clamp(result_bits, 1, static_cast<int32_t>(kMaxResultBits));
+  filter_policy_meta_.hash_num = EncodeHashNum(result_bits, kFilterFormatHash64);
+}
+
+const char* RibbonFilter::Name() { return "ribbon_filter"; }
+
+void RibbonFilter::CreateFilter(const std::string* keys, int32_t n) {
+  CreateFilter(keys, n, &filter_data_);
+}
+
+void RibbonFilter::CreateFilter(const std::string* keys, int32_t n,
+                                std::string* dst) {
+  if (n <= 0 || !keys || !dst) {
+    return;
+  }
+  const FilterFormat format = DecodeFilterFormat(filter_policy_meta_.hash_num);
+  const uint32_t result_bits = DecodeHashNum(filter_policy_meta_.hash_num);
+  const uint32_t result_mask =
+      result_bits == 32 ? 0xffffffffu : (1u << result_bits) - 1;
+  std::vector<uint64_t> hashes(n);
+  for (int32_t i = 0; i < n; ++i) {
+    hashes[i] = KeyHash(keys[i], format);
+  }
+  uint32_t num_blocks = static_cast<uint32_t>(
+      std::ceil(n * kSlotOverhead / kCoeffBits));
+  num_blocks = num_blocks < 1 ? 1 : num_blocks;
+  const size_t init_size = dst->size();
+  for (uint32_t seed = 0; seed < kMaxSeeds; ++seed) {
+    if (seed > 0 && seed % kSeedsPerSize == 0) {
+      num_blocks += num_blocks / 32 + 1;
+    }
+    const uint32_t num_slots = num_blocks * kCoeffBits;
+    const uint32_t num_starts = num_slots - kCoeffBits + 1;
+    Banding banding(num_slots);
+    bool ok = true;
+    for (int32_t i = 0; i < n && ok; ++i) {
+      ok = banding.Add(
+          MakeEquation(hashes[i], format, seed, num_starts, result_mask));
+    }
+    if (!ok) {
+      continue;
+    }
+    dst->resize(init_size + num_blocks * result_bits * 8 + kMetaSize);
+    char* data = &(*dst)[init_size];
+    banding.BackSubstitute(result_bits, seed, data);
+    util::EncodeFixed32(data + num_blocks * result_bits * 8, num_blocks);
+    data[num_blocks * result_bits * 8 + 4] = static_cast<char>(seed);
+    return;
+  }
+  // 几乎不可能走到这里，num_blocks为0的filter所有key都返回可能存在
+  dst->resize(init_size + kMetaSize, 0);
+}
+
+bool RibbonFilter::MayMatchFilter(const std::string_view& key,
+                                  const char* data, size_t len,
+                                  uint32_t hash_num) {
+  const FilterFormat format = DecodeFilterFormat(hash_num);
+  const uint32_t result_bits = DecodeHashNum(hash_num);
+  if (format > kFilterFormatHash64 || len < kMetaSize || result_bits == 0 || result_bits > kMaxResultBits) {
+    return true;
+  }
+  const size_t solution_size = len - kMetaSize;
+  const uint32_t num_blocks = util::DecodeFixed32(data + solution_size);
+  const uint8_t seed = static_cast<uint8_t>(data[solution_size + 4]);
+  // 格式不对的时候不过滤
+  if (num_blocks == 0 ||
+      static_cast<uint64_t>(num_blocks) * result_bits * 8 != solution_size) {
+    return true;
+  }
+  const uint32_t result_mask =
+      result_bits == 32 ? 0xffffffffu : (1u << result_bits) - 1;
+  const uint32_t num_starts = num_blocks * kCoeffBits - kCoeffBits + 1;
+  const Equation eq = MakeEquation(KeyHash(key, format), format, seed,
+                                   num_starts, result_mask);
+  const uint32_t offset = eq.start % kCoeffBits;
+  const char* lo = data + (eq.start / kCoeffBits) * result_bits * 8;
+  // offset不为0时系数跨越两个block，start不超过num_starts，所以下一个block一定存在
+  const char* hi = lo + result_bits * 8;
+  for (uint32_t b = 0; b < result_bits; ++b) {
+    uint64_t window = util::DecodeFixed64(lo + b * 8) >> offset;
+    if (offset != 0) {
+      window |= util::DecodeFixed64(hi + b * 8) << (kCoeffBits - offset);
+    }
+    if (Parity(window & eq.coeff) != ((eq.result >> b) & 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RibbonFilter::MayMatch(const std::string_view& key, int32_t start_pos,
+                            int32_t len) {
+  if (key.empty() || start_pos < 0 ||
+      static_cast<size_t>(start_pos) >= filter_data_.size()) {
+    return false;
+  }
+  if (len == 0) {
+    len = filter_data_.size() - start_pos;
+  }
+  return MayMatchFilter(key, filter_data_.data() + start_pos, len,
+                        filter_policy_meta_.hash_num);
+}
+
+bool RibbonFilter::MayMatch(const std::string_view& key,
+                            const std::string_view& datas) {
+  static constexpr uint32_t kFixedSize = 4;
+  const size_t size = datas.size();
+  if (size < kFixedSize || key.empty()) {
+    return false;
+  }
+  const uint32_t hash_num =
+      util::DecodeFixed32(datas.data() + size - kFixedSize);
+  return MayMatchFilter(key, datas.data(), size - kFixedSize, hash_num);
+}
+}  // namespace corekv
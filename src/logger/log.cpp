@@ -2,6 +2,8 @@
 
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include <algorithm>
 #include <iostream>
@@ -12,6 +14,43 @@
 #include "log_config.h"
 #include "log_level.h"
 namespace corekv {
+namespace {
+const char *LogLevelPrefix(LogLevel log_level) {
+  switch (log_level) {
+    case LogLevel::DEBUG:
+      return "[DEBUG] ";
+    case LogLevel::INFO:
+      return "[INFO] ";
+    case LogLevel::WARN:
+      return "[WARN] ";
+    case LogLevel::ERROR:
+      return "[ERROR] ";
+    case LogLevel::FATAL:
+      return "[FATAL] ";
+    default:
+      return "[TRACE] ";
+  }
+}
+
+// 格式和util::GetCurrentTimeString相同，同一秒内复用上一次格式化的结果
+int32_t FormatTime(char *buf, int32_t size) {
+  thread_local time_t cached_second = -1;
+  thread_local char cached_time[32];
+  thread_local int32_t cached_len = 0;
+  const time_t now = time(nullptr);
+  if (now != cached_second) {
+    struct tm tm;
+    localtime_r(&now, &tm);
+    cached_len = strftime(cached_time, sizeof(cached_time), "%Y-%m-%d-%H%M%S",
+                          &tm);
+    cached_second = now;
+  }
+  const int32_t len = std::min(cached_len, size);
+  memcpy(buf, cached_time, len);
+  return len;
+}
+}  // namespace
+
 void Log::InitLog(const LogConfig &log_config) {
   if (inited_) {
     return;
@@ -32,24 +71,47 @@ void Log::InitLog(const LogConfig &log_config) {
 }
 
 void Log::LogV(LogLevel log_level, const char *fmt, ...) {
-  if (log_level < log_config_.log_level) {
+  // 没有初始化的时候不输出，避免访问空的appender
+  if (!IsEnabled(log_level)) {
     return;
   }
-   
+  // 每个线程复用自己的格式化缓冲区，避免每条日志都分配内存
+  thread_local std::vector<char> buffer;
+  const int32_t max_size = std::max<int32_t>(log_config_.log_buffer_max_size, 64);
+  if (buffer.size() < static_cast<size_t>(max_size)) {
+    buffer.resize(max_size);
+  }
+  char *buf = buffer.data();
+
   //先追加个时间
-  std::string buffer(1,'\n');
-  util::GetCurrentTimeString(buffer);
-  buffer.append(LogLevelToString(log_level));
-  int32_t len = buffer.size();
+  int32_t len = 0;
+  buf[len++] = '\n';
+  len += FormatTime(buf + len, max_size - len);
+  const char *prefix = LogLevelPrefix(log_level);
+  const int32_t prefix_len =
+      std::min<int32_t>(strlen(prefix), max_size - len - 1);
+  memcpy(buf + len, prefix, prefix_len);
+  len += prefix_len;
 
-  std::string output(log_config_.log_buffer_max_size - len,0);
   va_list ap;
   va_start(ap, fmt);
-  int32_t fmt_len = vsnprintf(&output[0],
-                              log_config_.log_buffer_max_size - len, fmt, ap);
+  int32_t fmt_len = vsnprintf(buf + len, max_size - len, fmt, ap);
   va_end(ap);
-  buffer+=output;
-  log_appender_->Append(&buffer[0], len+fmt_len);
+  if (fmt_len < 0) {
+    return;
+  }
+  // 被截断的时候vsnprintf返回的是完整的长度
+  len += std::min(fmt_len, max_size - len - 1);
+  log_appender_->Append(buf, len);
+  if (log_level >= LogLevel::FATAL) {
+    log_appender_->Flush();
+  }
+}
+
+void Log::Flush() {
+  if (inited_) {
+    log_appender_->Flush();
+  }
 }
 
 }  // namespace corekv
@@ -13,7 +13,14 @@ class Log final {
   }
   void InitLog(const LogConfig &log_config);
 
-  void LogV(LogLevel log_level, const char *fmt, ...);
+  // LOG宏在格式化参数之前先检查，关闭的级别只有一次比较
+  bool IsEnabled(LogLevel log_level) const {
+    return inited_ && log_level >= log_config_.log_level;
+  }
+  void LogV(LogLevel log_level, const char *fmt, ...)
+      __attribute__((format(printf, 3, 4)));
+  // 等待已经输出的日志写出去
+  void Flush();
  private:
   LogConfig log_config_;
   bool inited_ = false;
@@ -21,7 +28,15 @@ class Log final {
 };
 
 }  // namespace corekv
-#define LOG(level, format, args...)                                        \
-  corekv::Log::GetInstance()->LogV(level, "%s(%d): " format, __FILE__, \
-                                   __LINE__, ##args)
-#endif
\ No newline at end of file
+// 低于COREKV_MIN_LOG_LEVEL的级别在编译期就被去掉，参数也不会求值
+#define LOG(level, format, args...)                                       \
+  do {                                                                    \
+    if constexpr (static_cast<int>(level) >= COREKV_MIN_LOG_LEVEL) {      \
+      corekv::Log *corekv_log_ = corekv::Log::GetInstance();              \
+      if (corekv_log_->IsEnabled(level)) {                                \
+        corekv_log_->LogV(level, "%s(%d): " format, __FILE__, __LINE__, \
+                          ##args);                                        \
+      }                                                                   \
+    }                                                                     \
+  } while (0)
+#endif
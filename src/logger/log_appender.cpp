@@ -5,8 +5,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 
 #include "utils/util.h"
@@ -16,6 +19,103 @@ void GenerateLogFileName(std::string &output) {
   util::GetCurrentTimeString(output);
   output.append(std::to_string(util::GetCurrentPid()));
 }
+
+uint32_t RoundUpToPowerOfTwo(uint32_t n) {
+  uint32_t capacity = 4096;
+  while (capacity < n) {
+    capacity <<= 1;
+  }
+  return capacity;
+}
+
+std::atomic<uint64_t> g_next_appender_id{1};
+}  // namespace
+
+// 单生产者单消费者的字节环形缓冲区，写位置和读位置单调递增，取模之后才是下标
+class AysncFileAppender::RingBuffer final {
+ public:
+  explicit RingBuffer(uint32_t capacity)
+      : capacity_(capacity), data_(new char[capacity]) {}
+
+  uint32_t capacity() const { return capacity_; }
+
+  // 写日志的线程调用，空间不够的时候返回false；
+  // 这次写入使已用空间超过一半的时候half_full返回true，需要唤醒后台线程
+  bool TryAppend(const char *msg, uint32_t len, bool *half_full) {
+    const uint64_t w = write_pos_.load(std::memory_order_relaxed);
+    const uint64_t r = read_pos_.load(std::memory_order_acquire);
+    if (capacity_ - (w - r) < len) {
+      return false;
+    }
+    const uint32_t offset = w & (capacity_ - 1);
+    const uint32_t first = std::min(len, capacity_ - offset);
+    memcpy(data_.get() + offset, msg, first);
+    memcpy(data_.get(), msg + first, len - first);
+    write_pos_.store(w + len, std::memory_order_release);
+    const uint64_t half = capacity_ / 2;
+    *half_full = (w - r) <= half && (w + len - r) > half;
+    return true;
+  }
+
+  // 后台线程调用，把已经发布的内容填到iov中(最多两段)，返回使用的iov个数，
+  // end中返回写完之后需要Consume的位置
+  int32_t Peek(struct iovec *iov, uint64_t *end) const {
+    const uint64_t r = read_pos_.load(std::memory_order_relaxed);
+    const uint64_t w = write_pos_.load(std::memory_order_acquire);
+    *end = w;
+    if (w == r) {
+      return 0;
+    }
+    const uint32_t offset = r & (capacity_ - 1);
+    const uint32_t len = w - r;
+    const uint32_t first = std::min(len, capacity_ - offset);
+    iov[0].iov_base = data_.get() + offset;
+    iov[0].iov_len = first;
+    if (first == len) {
+      return 1;
+    }
+    iov[1].iov_base = data_.get();
+    iov[1].iov_len = len - first;
+    return 2;
+  }
+
+  void Consume(uint64_t end) {
+    read_pos_.store(end, std::memory_order_release);
+  }
+
+  bool Empty() const {
+    return read_pos_.load(std::memory_order_relaxed) ==
+           write_pos_.load(std::memory_order_acquire);
+  }
+
+  // 所属的线程退出之后设置，后台线程写完剩余内容之后把它移除
+  std::atomic<bool> orphaned{false};
+
+ private:
+  const uint32_t capacity_;
+  std::unique_ptr<char[]> data_;
+  // 分开在不同的cache line上，避免生产者和消费者互相失效
+  alignas(64) std::atomic<uint64_t> write_pos_{0};
+  alignas(64) std::atomic<uint64_t> read_pos_{0};
+};
+
+namespace {
+// 每个线程缓存自己在当前appender中注册的缓冲区
+struct ThreadBufferSlot {
+  uint64_t owner = 0;
+  std::shared_ptr<void> buffer;
+  std::atomic<bool> *orphaned = nullptr;
+  void Release() {
+    if (orphaned) {
+      orphaned->store(true, std::memory_order_release);
+    }
+    owner = 0;
+    orphaned = nullptr;
+    buffer.reset();
+  }
+  ~ThreadBufferSlot() { Release(); }
+};
+thread_local ThreadBufferSlot tls_buffer_slot;
 }  // namespace
 
 void EmptyAppender::Append(const char *msg, int32_t len) {
@@ -30,28 +130,194 @@ void ConsoleAppender::Append(const char *msg, int32_t) {
 }
 
 //文件Appender
+AysncFileAppender::RingBuffer *AysncFileAppender::GetThreadBuffer() {
+  ThreadBufferSlot &slot = tls_buffer_slot;
+  if (slot.owner == id_) {
+    return static_cast<RingBuffer *>(slot.buffer.get());
+  }
+  // 之前注册在别的appender中的缓冲区交给那个appender回收
+  slot.Release();
+  // 至少能放下两条最长的日志
+  auto buffer = std::make_shared<RingBuffer>(RoundUpToPowerOfTwo(std::max(
+      log_config_.ring_buffer_size, 2 * log_config_.log_buffer_max_size)));
+  {
+    std::lock_guard<std::mutex> lck(mutex_);
+    buffers_.push_back(buffer);
+  }
+  slot.owner = id_;
+  slot.orphaned = &buffer->orphaned;
+  slot.buffer = buffer;
+  return buffer.get();
+}
+
 void AysncFileAppender::Append(const char *msg, int32_t len) {
-  if (!msg || len == 0 || fd_ == -1) {
+  if (!msg || len <= 0 || !bg_thread_.joinable()) {
     return;
   }
+  RingBuffer *buffer = GetThreadBuffer();
+  // 超长的日志截断到缓冲区能放下的大小
+  const uint32_t size = std::min<uint32_t>(len, buffer->capacity());
+  bool half_full = false;
+  while (!buffer->TryAppend(msg, size, &half_full)) {
+    if (stop_.load(std::memory_order_acquire)) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lck(mutex_);
+      wakeup_ = true;
+    }
+    cv_.notify_one();
+    std::this_thread::yield();
+  }
+  if (half_full) {
+    {
+      std::lock_guard<std::mutex> lck(mutex_);
+      wakeup_ = true;
+    }
+    cv_.notify_one();
+  }
+}
 
+void AysncFileAppender::Flush() {
+  if (!bg_thread_.joinable()) {
+    return;
+  }
+  std::unique_lock<std::mutex> lck(mutex_);
+  // 需要等待一轮在调用Flush之后才开始的Drain
+  const uint64_t target = started_rounds_ + 1;
+  wakeup_ = true;
+  cv_.notify_one();
+  flushed_cv_.wait(lck, [&] { return drained_rounds_ >= target || stop_; });
+}
+
+size_t AysncFileAppender::NumThreadBuffers() {
   std::lock_guard<std::mutex> lck(mutex_);
-  int32_t ret = write(fd_, msg, len);
-  cur_file_size += ret;
+  return buffers_.size();
+}
+
+void AysncFileAppender::BackgroundThread() {
+  std::unique_lock<std::mutex> lck(mutex_);
+  while (true) {
+    cv_.wait_for(lck, std::chrono::milliseconds(log_config_.flush_interval_ms),
+                 [&] { return wakeup_ || stop_; });
+    const bool stop = stop_;
+    wakeup_ = false;
+    ++started_rounds_;
+    lck.unlock();
+    Drain();
+    lck.lock();
+    ++drained_rounds_;
+    flushed_cv_.notify_all();
+    // stop之后还要再完整地写一轮，保证析构之前的日志都落盘
+    if (stop) {
+      break;
+    }
+  }
+}
+
+void AysncFileAppender::Drain() {
+  {
+    std::lock_guard<std::mutex> lck(mutex_);
+    drain_buffers_ = buffers_;
+  }
+  static constexpr int32_t kMaxIov = 1024;
+  struct iovec iov[kMaxIov];
+  // 本批次中每个缓冲区写完之后需要推进到的位置
+  std::pair<RingBuffer *, uint64_t> pending[kMaxIov / 2];
+  int32_t iov_count = 0;
+  int32_t pending_count = 0;
+  auto commit = [&] {
+    // 写失败的时候也丢弃这部分内容，否则写日志的线程会一直等待空间
+    if (iov_count > 0) {
+      WriteBatch(iov, iov_count);
+    }
+    for (int32_t i = 0; i < pending_count; ++i) {
+      pending[i].first->Consume(pending[i].second);
+    }
+    iov_count = 0;
+    pending_count = 0;
+  };
+  bool has_orphaned = false;
+  for (const auto &buffer : drain_buffers_) {
+    // 每个缓冲区占用一个pending和最多两个iov，任意一个放不下都先写出去
+    if (iov_count + 2 > kMaxIov || pending_count == kMaxIov / 2) {
+      commit();
+    }
+    // 先读orphaned再读内容，保证移除的时候线程退出前写的都已经写出去
+    has_orphaned |= buffer->orphaned.load(std::memory_order_acquire);
+    uint64_t end = 0;
+    int32_t n = buffer->Peek(iov + iov_count, &end);
+    if (n > 0) {
+      iov_count += n;
+      pending[pending_count++] = {buffer.get(), end};
+    }
+  }
+  commit();
+  drain_buffers_.clear();
+
   if (log_config_.rotate_size > 0 && cur_file_size > log_config_.rotate_size) {
-    this->Rotate();
+    Rotate();
+  }
+  if (has_orphaned) {
+    std::lock_guard<std::mutex> lck(mutex_);
+    buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(),
+                                  [](const std::shared_ptr<RingBuffer> &b) {
+                                    return b->orphaned.load(
+                                               std::memory_order_acquire) &&
+                                           b->Empty();
+                                  }),
+                   buffers_.end());
   }
 }
 
-AysncFileAppender::AysncFileAppender(const LogConfig &log_config) {
+bool AysncFileAppender::WriteBatch(struct iovec *iov, int32_t count) {
+  if (fd_ == -1) {
+    return false;
+  }
+  while (count > 0) {
+    ssize_t ret = writev(fd_, iov, count);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    cur_file_size += ret;
+    // 部分写入的时候跳过已经写完的部分
+    while (count > 0 && static_cast<size_t>(ret) >= iov->iov_len) {
+      ret -= iov->iov_len;
+      ++iov;
+      --count;
+    }
+    if (count > 0) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + ret;
+      iov->iov_len -= ret;
+    }
+  }
+  return true;
+}
+
+AysncFileAppender::AysncFileAppender(const LogConfig &log_config)
+    : id_(g_next_appender_id.fetch_add(1, std::memory_order_relaxed)) {
   log_config_ = log_config;
   //构建fd
   int32_t fd = Open();
   if (fd != -1) {
     fd_ = fd;
+    bg_thread_ = std::thread(&AysncFileAppender::BackgroundThread, this);
   }
 }
-AysncFileAppender::~AysncFileAppender() { Close(); }
+AysncFileAppender::~AysncFileAppender() {
+  if (bg_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lck(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_one();
+    bg_thread_.join();
+  }
+  Close();
+}
 void AysncFileAppender::Rotate() {
   if (log_config_.log_type != LogType::FILE) {
     return;
@@ -60,21 +326,18 @@ void AysncFileAppender::Rotate() {
   std::string output;
   GenerateLogFileName(output);
   static const std::string kDefaultLogPrefix = "corekv.";
-  const auto &new_filename =
+  std::string new_filename =
       log_config_.log_path + kDefaultLogPrefix + output + ".log";
-
-  //新创建的文件，所以重新计算
-  cur_file_size = 0;
-  int fd = open(active_file_name_.data(), O_CREAT | O_WRONLY | O_APPEND, 0644);
-  if (fd == -1) {
-    fprintf(stderr, "open log file %s error - %s\n", active_file_name_.c_str(),
-            strerror(errno));
-    return;
+  // 文件名只精确到秒，一秒内滚动多次的时候加上序号，避免覆盖之前归档的文件
+  for (int32_t seq = 1; access(new_filename.c_str(), F_OK) == 0; ++seq) {
+    new_filename = log_config_.log_path + kDefaultLogPrefix + output + "." +
+                   std::to_string(seq) + ".log";
   }
-  Close();
-  fd_ = fd;
 
+  // 当前文件改名归档，再重新打开一个空的active文件
+  Close();
   rename(active_file_name_.c_str(), new_filename.c_str());
+  fd_ = Open();
 }
 void AysncFileAppender::Close() {
   if (fd_ != -1) {
@@ -107,6 +370,7 @@ int32_t AysncFileAppender::Open() {
   int32_t ret = fstat(fd, &st);
   if (ret == -1) {
     fprintf(stderr, "fstat log file %s error!\n", active_file_name_.c_str());
+    close(fd);
     return -1;
   } else {
     cur_file_size = st.st_size;
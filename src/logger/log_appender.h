@@ -1,14 +1,24 @@
 #ifndef LOGGER_LOG_APPENDER_H_
 #define LOGGER_LOG_APPENDER_H_
 #include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
+
 #include "log_config.h"
+struct iovec;
 namespace corekv {
 class LogAppender {
  public:
   LogAppender() = default;
   virtual ~LogAppender() = default;
   virtual void Append(const char *msg, int32_t len) = 0;
+  // 等待之前Append的内容都写出去
+  virtual void Flush() {}
 };
 //空的，啥都不输出
 class EmptyAppender final: public LogAppender {
@@ -21,23 +31,60 @@ class ConsoleAppender final : public LogAppender {
   virtual void Append(const char *msg, int32_t len) override;
 };
 
-//文件Appender
+/*
+ * 文件Appender，写日志的线程不做任何系统调用也不加锁：
+ * 每个线程第一次写日志的时候注册一个自己独占的环形缓冲区(单生产者单消费者)，
+ * Append只是把一条日志拷贝进去并发布写位置；后台线程周期性地(或者某个缓冲区
+ * 超过一半的时候被唤醒)收集所有缓冲区中已经发布的内容，用一次writev写入文件，
+ * 文件的滚动也只在后台线程中进行
+ *
+ * 同一个线程的日志保持顺序，不同线程之间的日志只保证以整条为单位交错；
+ * 缓冲区满的时候写日志的线程会唤醒后台线程并让出cpu直到有空间
+ */
 class AysncFileAppender final : public LogAppender {
  public:
   AysncFileAppender(const LogConfig &log_config);
   virtual ~AysncFileAppender();
   virtual void Append(const char *msg, int32_t len) override;
-private:
+  virtual void Flush() override;
+  // 当前注册的线程缓冲区个数，线程退出并且剩余内容写出去之后才会减少
+  size_t NumThreadBuffers();
+
+ private:
+  class RingBuffer;
+  RingBuffer *GetThreadBuffer();
+  void BackgroundThread();
+  // 把所有缓冲区中已经发布的内容写到文件中，只在后台线程中调用
+  void Drain();
+  // writev直到全部写完，返回是否成功
+  bool WriteBatch(struct iovec *iov, int32_t count);
   int32_t Open();
   void Rotate();
   void Close();
  private:
   LogConfig log_config_;
-  //当前log file的打开的fd，析构时候记得释放
+  // 区分不同的appender实例，线程缓存的缓冲区属于旧实例的时候需要重新注册
+  const uint64_t id_;
+  //当前log file的打开的fd，析构时候记得释放，只有后台线程访问
   int fd_ = -1;
   uint64_t cur_file_size = 0;
-  std::mutex mutex_;
   std::string active_file_name_;
+
+  // 保护buffers_的注册以及后台线程的唤醒
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  // 等待Flush完成
+  std::condition_variable flushed_cv_;
+  std::vector<std::shared_ptr<RingBuffer>> buffers_;
+  // 写日志的线程在缓冲区满的时候也会检查，所以是atomic
+  std::atomic<bool> stop_{false};
+  bool wakeup_ = false;
+  // 已经开始的Drain轮数，Flush需要等待在它之后开始的一轮完成
+  uint64_t started_rounds_ = 0;
+  uint64_t drained_rounds_ = 0;
+  // 后台线程复用的临时数组，避免每轮都分配
+  std::vector<std::shared_ptr<RingBuffer>> drain_buffers_;
+  std::thread bg_thread_;
 };
 //后面在支持
 // class SocketAppender : public LogAppender {
@@ -16,6 +16,10 @@ struct LogConfig {
   uint32_t log_buffer_max_size = kDefaultLogBufferMaxSize;
   LogLevel log_level = LogLevel::DEBUG;
   int32_t rotate_size = 100*1024*1024;//默认100M 
+  // FILE类型下每个写日志线程独占的环形缓冲区大小，向上取整到2的幂
+  uint32_t ring_buffer_size = 256 * 1024;
+  // 后台线程没有被唤醒时多久检查一次缓冲区
+  uint32_t flush_interval_ms = 100;
 };
 
 static std::string LogTypeToString(LogType log_level);
@@ -5,6 +5,12 @@
 #include <string>
 
 #include "../utils/string_util.h"
+
+// 编译期的最低日志级别，更低级别的LOG调用不会生成任何代码，
+// 例如-DCOREKV_MIN_LOG_LEVEL=2只保留INFO及以上
+#ifndef COREKV_MIN_LOG_LEVEL
+#define COREKV_MIN_LOG_LEVEL 0
+#endif
 namespace corekv {
 enum LogLevel {
   TRACE = 0,
@@ -1,19 +1,17 @@
 #include "alloc.h"
 
 #include <stdlib.h>
-#include <iostream>
+#include <string.h>
+
+#include <algorithm>
 #include <cassert>
+#include <unordered_map>
 namespace corekv {
 
 SimpleFreeListAlloc::~SimpleFreeListAlloc() {
-  //释放二级内存，最后统一释放
-  if(!free_list_start_pos_) {
-    FreeList* p = (FreeList*)free_list_start_pos_;
-    while(p) {
-      FreeList* next = p->next;
-      free(p);
-      p = next;
-    }
+  //所有小对象都切分自chunk，统一释放；大对象由调用方Deallocate的时候释放
+  for (char* chunk : chunks_) {
+    free(chunk);
   }
 }
 int32_t SimpleFreeListAlloc::M_FreelistIndex(int32_t bytes) {
@@ -36,7 +34,6 @@ char* SimpleFreeListAlloc::M_ChunkAlloc(int32_t bytes, int32_t& nobjs) {
     result = free_list_start_pos_;
     //这里需要进行更新，因为部分有一部分给了链表内存管理
     free_list_start_pos_ += total_bytes;
-    memory_usage_.fetch_add(total_bytes, std::memory_order_relaxed);
     return result;
   } else if (bytes_left >= bytes) {
     // 内存池剩余空间不能完全满足需求量，但足够供应一个以上区块
@@ -45,51 +42,50 @@ char* SimpleFreeListAlloc::M_ChunkAlloc(int32_t bytes, int32_t& nobjs) {
     result = free_list_start_pos_;
     //这里需要进行更新，因为部分有一部分给了链表内存管理
     free_list_start_pos_ += total_bytes;
-    memory_usage_.fetch_add(total_bytes, std::memory_order_relaxed);
     return result;
-  } else {
-    //内存池剩余空间一个都没法分配时
-    //在这里又分配了2倍，见uint32_t total_bytes = bytes * nobjs;
-    int32_t bytes_to_get = 2 * total_bytes + M_Roundup(heap_size_ >> 4);
-    if (bytes_left > 0) {
-      // 内存池中还有剩余，先配给适当的freelist，否则这部分会浪费掉
-      FreeList* volatile* cur_free_list =
-          freelist_ + M_FreelistIndex(bytes_left);
-      // 调整freelist，将内存池剩余空间编入
-      ((FreeList*)free_list_start_pos_)->next = *cur_free_list;
-      *cur_free_list = ((FreeList*)free_list_start_pos_);
-    }
+  }
+  //内存池剩余空间一个都没法分配时
+  //在这里又分配了2倍，见uint32_t total_bytes = bytes * nobjs;
+  int32_t bytes_to_get = 2 * total_bytes + M_Roundup(heap_size_ >> 4);
+  if (bytes_left > 0) {
+    // 内存池中还有剩余，先配给适当的freelist，否则这部分会浪费掉
+    // chunk和切分的大小都是8的倍数，所以剩余的部分刚好是某个freelist的大小
+    FreeList** cur_free_list = freelist_ + M_FreelistIndex(bytes_left);
+    // 调整freelist，将内存池剩余空间编入
+    ((FreeList*)free_list_start_pos_)->next = *cur_free_list;
+    *cur_free_list = ((FreeList*)free_list_start_pos_);
+  }
+  free_list_start_pos_ = free_list_end_pos_ = nullptr;
 
-    // 分配新的空间
-    free_list_start_pos_ = (char*)malloc(bytes_to_get);
-    //如果分配失败，尝试已经存在的slot能不能装下来
-    if (!free_list_start_pos_) {
-      FreeList *volatile *my_free_list = nullptr, *p = nullptr;
-      // 尝试从freelist中查找是不是有足够大的没有用过的区块
-      for (int32_t index = bytes; index <= kSmallObjectBytes;
-           index += kAlignBytes) {
-        my_free_list = freelist_ + M_FreelistIndex(index);
-        p = *my_free_list;
-        if (!p) {
-          //说明找到了，此时在进行下一轮循环时候，我们就能直接返回
-          *my_free_list = p->next;
-          free_list_start_pos_ = (char*)p;
-          free_list_end_pos_ = free_list_start_pos_ + index;
-          return M_ChunkAlloc(bytes, nobjs);
-        }
-      }
-      //如果未找到，此时我们再重新尝试分配一次，如果分配失败，此时将终止程序
-      free_list_end_pos_ = nullptr;
-      free_list_start_pos_ = (char*)malloc(bytes_to_get);
-      if (!free_list_start_pos_) {
-        exit(1);
+  // 分配新的空间
+  char* chunk = (char*)malloc(bytes_to_get);
+  //如果分配失败，尝试已经存在的slot能不能装下来
+  if (!chunk) {
+    // 尝试从freelist中查找是不是有足够大的没有用过的区块
+    for (int32_t index = bytes;
+         index <= static_cast<int32_t>(kSmallObjectBytes);
+         index += kAlignBytes) {
+      FreeList** my_free_list = freelist_ + M_FreelistIndex(index);
+      FreeList* p = *my_free_list;
+      if (p) {
+        //说明找到了，把这个区块作为内存池重新切分
+        *my_free_list = p->next;
+        free_list_start_pos_ = (char*)p;
+        free_list_end_pos_ = free_list_start_pos_ + index;
+        return M_ChunkAlloc(bytes, nobjs);
       }
     }
-    heap_size_ += bytes_to_get;
-    free_list_end_pos_ = free_list_start_pos_ + bytes_to_get;
-    memory_usage_.fetch_add(bytes_to_get, std::memory_order_relaxed);
-    return M_ChunkAlloc(bytes, nobjs);
+    //如果未找到，此时我们再重新尝试分配一次，如果分配失败，此时将终止程序
+    chunk = (char*)malloc(bytes_to_get);
+    if (!chunk) {
+      exit(1);
+    }
   }
+  chunks_.push_back(chunk);
+  heap_size_ += bytes_to_get;
+  free_list_start_pos_ = chunk;
+  free_list_end_pos_ = chunk + bytes_to_get;
+  return M_ChunkAlloc(bytes, nobjs);
 }
 
 void* SimpleFreeListAlloc::M_Refill(int32_t bytes) {
@@ -97,32 +93,18 @@ void* SimpleFreeListAlloc::M_Refill(int32_t bytes) {
   static const int32_t kInitBlockCount = 10;  //一次先分配10个，STL默认是20个
   int32_t real_block_count = kInitBlockCount;  //初始化，先按理想值来分配
   char* address = M_ChunkAlloc(bytes, real_block_count);
-  do {
-    //当前内存池刚好只够分配一个block块时
-    if (real_block_count == 1) {
-      break;
-    }
-    FreeList* next = nullptr;
-    FreeList* cur = nullptr;
-    FreeList* new_free_list = nullptr;
-    //我们将第一个给申请者，剩下的9个放到对应的链表上，但是我们在M_ChunkAlloc
-    //函数中，分配的是2倍，因此剩下的10个放在内存池中，供我们使用
-    new_free_list = next = reinterpret_cast<FreeList*>(address + bytes);
-    freelist_[M_FreelistIndex(bytes)] = new_free_list;
-
-    for (uint32_t index = 1;; ++index) {
+  //第一个给申请者，剩下的串起来放到对应的链表上
+  if (real_block_count > 1) {
+    FreeList* cur = reinterpret_cast<FreeList*>(address + bytes);
+    freelist_[M_FreelistIndex(bytes)] = cur;
+    for (int32_t index = 2; index < real_block_count; ++index) {
+      FreeList* next = reinterpret_cast<FreeList*>(address + index * bytes);
+      cur->next = next;
       cur = next;
-      next = (FreeList*)((char*)next + bytes);  //下一个块的首地址
-      if (index != real_block_count - 1) {
-          cur = cur->next;
-      } else {
-        cur->next = nullptr;
-        break;
-      }
     }
-  } while (0);
-  FreeList* result = reinterpret_cast<FreeList*>(address);
-  return result;
+    cur->next = nullptr;
+  }
+  return address;
 }
 
 void* SimpleFreeListAlloc::Allocate(int32_t n) {
@@ -133,15 +115,14 @@ void* SimpleFreeListAlloc::Allocate(int32_t n) {
     memory_usage_.fetch_add(n, std::memory_order_relaxed);
     return (char*)malloc(n);
   }
-  FreeList** select_free_list = nullptr;
+  memory_usage_.fetch_add(M_Roundup(n), std::memory_order_relaxed);
   //根据对象大小，定位位于哪个slot，对应内存分配策略其实最佳适配原则
-  select_free_list = freelist_ + M_FreelistIndex(n);
+  FreeList** select_free_list = freelist_ + M_FreelistIndex(n);
   FreeList* result = *select_free_list;
   //默认情况下，我们的slot不能提前分配内存，因为他为空
   if (!result) {
     //如果为空，此时我们需要分配内存来进行填充
-    void* ret = (char*)M_Refill(M_Roundup(n));
-    return ret;
+    return M_Refill(M_Roundup(n));
   }
   //更新下一个可用
   *select_free_list = result->next;
@@ -149,27 +130,210 @@ void* SimpleFreeListAlloc::Allocate(int32_t n) {
 }
 
 void SimpleFreeListAlloc::Deallocate(void* address, int32_t n) {
-  if (address) {
-    FreeList* p = (FreeList*)address;
-    FreeList* volatile* cur_free_list = nullptr;
+  if (!address) {
+    return;
+  }
+  if (n > static_cast<int32_t>(kSmallObjectBytes)) {
     memory_usage_.fetch_sub(n, std::memory_order_relaxed);
-    if (n > kSmallObjectBytes) {
-      free(address);
+    free(address);
+    return;
+  }
+  memory_usage_.fetch_sub(M_Roundup(n), std::memory_order_relaxed);
+  //可用内存挂在最前端
+  FreeList* p = (FreeList*)address;
+  FreeList** cur_free_list = freelist_ + M_FreelistIndex(n);
+  p->next = *cur_free_list;
+  *cur_free_list = p;
+}
+void* SimpleFreeListAlloc::Reallocate(void* address, int32_t old_size,
+                                      int32_t new_size) {
+  void* result = Allocate(new_size);
+  if (address) {
+    memcpy(result, address, std::min(old_size, new_size));
+    Deallocate(address, old_size);
+  }
+  return result;
+}
+
+namespace {
+inline uint32_t ClassIndex(int32_t n) {
+  return (n + ThreadCachedAlloc::kAlignBytes - 1) /
+             ThreadCachedAlloc::kAlignBytes -
+         1;
+}
+inline uint32_t ClassSize(uint32_t index) {
+  return (index + 1) * ThreadCachedAlloc::kAlignBytes;
+}
+// 小对象一个magazine多放一些，大对象至少也要放几个，否则每次都要访问depot
+inline uint32_t MagazineCapacity(uint32_t index) {
+  return std::min<uint32_t>(
+      std::max<uint32_t>(ThreadCachedAlloc::kMagazineBytes / ClassSize(index),
+                         4),
+      512);
+}
+std::atomic<uint64_t> next_alloc_id{1};
+}  // namespace
+
+struct ThreadCachedAlloc::Depot {
+  ~Depot() {
+    for (char* chunk : chunks) {
+      free(chunk);
+    }
+  }
+  // 一次从chunk中切出一个magazine的对象
+  void Refill(uint32_t index, Magazine* magazine) {
+    {
+      std::lock_guard<std::mutex> lock(classes[index].mutex);
+      auto& full = classes[index].full;
+      if (!full.empty()) {
+        *magazine = full.back();
+        full.pop_back();
+        return;
+      }
+    }
+    const uint32_t size = ClassSize(index);
+    const uint32_t count = MagazineCapacity(index);
+    char* base = Carve(static_cast<size_t>(size) * count);
+    for (uint32_t i = 0; i < count; ++i) {
+      FreeList* node = reinterpret_cast<FreeList*>(base + i * size);
+      node->next = i + 1 < count
+                       ? reinterpret_cast<FreeList*>(base + (i + 1) * size)
+                       : nullptr;
+    }
+    magazine->head = reinterpret_cast<FreeList*>(base);
+    magazine->count = count;
+  }
+  void Return(uint32_t index, const Magazine& magazine) {
+    std::lock_guard<std::mutex> lock(classes[index].mutex);
+    classes[index].full.push_back(magazine);
+  }
+  char* Carve(size_t bytes) {
+    std::lock_guard<std::mutex> lock(chunk_mutex);
+    if (static_cast<size_t>(chunk_end - chunk_pos) < bytes) {
+      // 旧chunk剩下的部分不到一个magazine，直接丢弃
+      const size_t chunk_bytes = std::max(kChunkBytes, bytes);
+      char* chunk = static_cast<char*>(malloc(chunk_bytes));
+      if (chunk == nullptr) {
+        exit(1);
+      }
+      chunks.push_back(chunk);
+      usage.fetch_add(chunk_bytes, std::memory_order_relaxed);
+      chunk_pos = chunk;
+      chunk_end = chunk + chunk_bytes;
+    }
+    char* result = chunk_pos;
+    chunk_pos += bytes;
+    return result;
+  }
 
-      address = nullptr;
+  static constexpr size_t kChunkBytes = 256 * 1024;
+  struct SizeClass {
+    std::mutex mutex;
+    std::vector<Magazine> full;
+  };
+  SizeClass classes[kClassNum];
+  std::mutex chunk_mutex;
+  char* chunk_pos = nullptr;
+  char* chunk_end = nullptr;
+  std::vector<char*> chunks;
+  std::atomic<uint64_t> usage{0};
+};
+
+struct ThreadCachedAlloc::ThreadCache {
+  explicit ThreadCache(std::weak_ptr<Depot> d) : depot(std::move(d)) {}
+  // 线程退出的时候把还没有用完的对象还给depot
+  ~ThreadCache() {
+    std::shared_ptr<Depot> d = depot.lock();
+    if (!d) {
       return;
     }
-    //可用内存挂在最前端
-    cur_free_list = freelist_ + M_FreelistIndex(n);
-    p->next = *cur_free_list;
-    *cur_free_list = p;
+    for (uint32_t i = 0; i < kClassNum; ++i) {
+      if (magazines[i].count > 0) {
+        d->Return(i, magazines[i]);
+      }
+    }
+  }
+  std::weak_ptr<Depot> depot;
+  Magazine magazines[kClassNum];
+};
+
+namespace {
+// 一个线程在所有分配器中的ThreadCache，最近一次使用的单独缓存下来
+struct LocalCaches {
+  uint64_t last_id = 0;
+  ThreadCachedAlloc::ThreadCache* last = nullptr;
+  std::unordered_map<uint64_t, std::unique_ptr<ThreadCachedAlloc::ThreadCache>>
+      caches;
+};
+thread_local LocalCaches local_caches;
+}  // namespace
+
+ThreadCachedAlloc::ThreadCachedAlloc()
+    : id_(next_alloc_id.fetch_add(1, std::memory_order_relaxed)),
+      depot_(std::make_shared<Depot>()) {}
+
+ThreadCachedAlloc::~ThreadCachedAlloc() = default;
+
+ThreadCachedAlloc::ThreadCache* ThreadCachedAlloc::GetThreadCache() {
+  LocalCaches& local = local_caches;
+  if (local.last_id == id_) {
+    return local.last;
+  }
+  auto it = local.caches.find(id_);
+  if (it == local.caches.end()) {
+    // 顺便清理已经析构的分配器留下的ThreadCache
+    for (auto iter = local.caches.begin(); iter != local.caches.end();) {
+      iter = iter->second->depot.expired() ? local.caches.erase(iter)
+                                           : std::next(iter);
+    }
+    it = local.caches
+             .emplace(id_, std::make_unique<ThreadCache>(depot_))
+             .first;
   }
+  local.last_id = id_;
+  local.last = it->second.get();
+  return local.last;
 }
-void* SimpleFreeListAlloc::Reallocate(void* address, int32_t old_size,
-                                      int32_t new_size) {
-  Deallocate(address, old_size);
-  address = Allocate(new_size);
-  return address;
+
+void* ThreadCachedAlloc::Allocate(int32_t n) {
+  assert(n > 0);
+  if (n > static_cast<int32_t>(kSmallObjectBytes)) {
+    depot_->usage.fetch_add(n, std::memory_order_relaxed);
+    return malloc(n);
+  }
+  const uint32_t index = ClassIndex(n);
+  Magazine& magazine = GetThreadCache()->magazines[index];
+  if (magazine.head == nullptr) {
+    depot_->Refill(index, &magazine);
+  }
+  FreeList* result = magazine.head;
+  magazine.head = result->next;
+  --magazine.count;
+  return result;
+}
+
+void ThreadCachedAlloc::Deallocate(void* p, int32_t n) {
+  if (p == nullptr) {
+    return;
+  }
+  if (n > static_cast<int32_t>(kSmallObjectBytes)) {
+    depot_->usage.fetch_sub(n, std::memory_order_relaxed);
+    free(p);
+    return;
+  }
+  const uint32_t index = ClassIndex(n);
+  Magazine& magazine = GetThreadCache()->magazines[index];
+  if (magazine.count >= MagazineCapacity(index)) {
+    depot_->Return(index, magazine);
+    magazine = Magazine();
+  }
+  FreeList* node = static_cast<FreeList*>(p);
+  node->next = magazine.head;
+  magazine.head = node;
+  ++magazine.count;
 }
 
-}  // namespace corekv
\ No newline at end of file
+uint64_t ThreadCachedAlloc::MemoryUsage() const {
+  return depot_->usage.load(std::memory_order_relaxed);
+}
+}  // namespace corekv
@@ -2,6 +2,9 @@
 #define MEMORY_ALLOC_H_
 #include <cstdint>
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
 namespace corekv {
 /*根据FreeList设计原理，分析如下：
 1.当使用next时，表示当前内存并未使用
@@ -13,19 +16,24 @@ union FreeList {
     char data[1];
 };
 
+// 单线程使用的按8字节分级的freelist分配器，不超过kSmallObjectBytes的对象从chunk中切分，
+// 更大的对象直接malloc；所有chunk在析构的时候统一释放
 class SimpleFreeListAlloc final {
   public:
   SimpleFreeListAlloc() = default;
+  SimpleFreeListAlloc(const SimpleFreeListAlloc&) = delete;
+  SimpleFreeListAlloc& operator=(const SimpleFreeListAlloc&) = delete;
   ~SimpleFreeListAlloc();
     void* Allocate(int32_t n);            //分配内存
     void Deallocate(void* p, int32_t n);  //释放内存
-    void* Reallocate(void* p, int32_t old_size, int32_t new_size);  //扩容
+    //扩容，保留原来min(old_size, new_size)字节的内容
+    void* Reallocate(void* p, int32_t old_size, int32_t new_size);
+    //当前分配给调用方的字节数，小对象按照对齐之后的大小计算
     uint32_t MemoryUsage() const {
       return memory_usage_.load(std::memory_order_relaxed);
     }
 
   private:
-    int32_t M_Align(int32_t bytes);          //字节对齐
     int32_t M_Roundup(int32_t bytes);        //向上取整
     int32_t M_FreelistIndex(int32_t bytes);  //计算位于哪个freelist
     void* M_Refill(int32_t n);
@@ -42,9 +50,55 @@ class SimpleFreeListAlloc final {
     //总的内存大小，可以理解为bias
     int32_t heap_size_ = 0;
     FreeList* freelist_[kFreeListMaxNum] = {nullptr};
+    //从malloc申请的chunk，析构的时候释放
+    std::vector<char*> chunks_;
     //用户获取当前内存分配量
-    std::atomic<uint32_t> memory_usage_;
+    std::atomic<uint32_t> memory_usage_{0};
+};
+
+/*
+ * 多线程使用的分配器，大小分级和SimpleFreeListAlloc相同
+ * 每个线程每个大小级别有一个magazine(最多kMagazineBytes字节的空闲对象链表)，
+ * 分配和释放只操作当前线程的magazine，不需要加锁；
+ * magazine空了从共享的depot中取一个装满的，depot也没有的时候从chunk中切一批，
+ * 满了就整个交给depot，换一个空的继续用，所以一个线程分配的对象可以在另一个线程释放
+ *
+ * 线程退出的时候把magazine还给depot；分配器析构之后线程中残留的magazine直接丢弃，
+ * 析构时需要保证其他线程不再使用这个分配器
+ */
+class ThreadCachedAlloc final {
+ public:
+  ThreadCachedAlloc();
+  ThreadCachedAlloc(const ThreadCachedAlloc&) = delete;
+  ThreadCachedAlloc& operator=(const ThreadCachedAlloc&) = delete;
+  ~ThreadCachedAlloc();
+
+  void* Allocate(int32_t n);
+  void Deallocate(void* p, int32_t n);
+  // 从系统申请的字节数，包括切好还没有分配出去的部分
+  uint64_t MemoryUsage() const;
+
+  static constexpr uint32_t kAlignBytes = 8;
+  static constexpr uint32_t kSmallObjectBytes = 4096;
+  static constexpr uint32_t kClassNum = kSmallObjectBytes / kAlignBytes;
+  static constexpr uint32_t kMagazineBytes = 32 * 1024;
+
+  struct Magazine {
+    FreeList* head = nullptr;
+    uint32_t count = 0;
+  };
+  struct Depot;
+  struct ThreadCache;
+
+ private:
+  ThreadCache* GetThreadCache();
+
+ private:
+  // 每个分配器唯一的id，用于在线程局部的表中找到自己的ThreadCache，不会被复用
+  const uint64_t id_;
+  // 线程退出的时候通过weak_ptr判断分配器是否还存在
+  std::shared_ptr<Depot> depot_;
 };
 }  // namespace corekv
 
-#endif
\ No newline at end of file
+#endif
@@ -1,16 +1,33 @@
 #include "area.h"
-#include <iostream>
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "huge_page.h"
 
 namespace corekv {
 static const int kBlockSize = 4096;
 SimpleVectorAlloc::SimpleVectorAlloc()
-    : alloc_ptr_(nullptr), alloc_bytes_remaining_(0), memory_usage_(0) {
-      std::cout<<"构造成功"<<std::endl;
-    }
+    : block_size_(kBlockSize),
+      alloc_ptr_(nullptr),
+      alloc_bytes_remaining_(0),
+      memory_usage_(0) {}
+
+SimpleVectorAlloc::SimpleVectorAlloc(size_t huge_page_size, int32_t numa_node)
+    : huge_page_size_(huge_page_size),
+      numa_node_(numa_node),
+      block_size_(huge_page_size > 0 ? huge_page_size : kBlockSize),
+      alloc_ptr_(nullptr),
+      alloc_bytes_remaining_(0),
+      memory_usage_(0) {}
 
 SimpleVectorAlloc::~SimpleVectorAlloc() {
   for (uint32_t i = 0; i < blocks_.size(); i++) {
-    delete[] blocks_[i];
+    free(blocks_[i]);
+  }
+  for (const auto& block : mapped_blocks_) {
+    FreePages(block.first, block.second);
   }
 }
 void SimpleVectorAlloc::Deallocate(void*, int32_t n) {
@@ -18,7 +35,7 @@ void SimpleVectorAlloc::Deallocate(void*, int32_t n) {
   
 }
 char* SimpleVectorAlloc::AllocateFallback(uint32_t bytes) {
-  if(bytes > kBlockSize / 4){
+  if(bytes > block_size_ / 4){
     char* result = AllocateNewBlock(bytes);
     return result;
   }
@@ -27,8 +44,20 @@ char* SimpleVectorAlloc::AllocateFallback(uint32_t bytes) {
   // 分配，那么这个时候leveldb就会重新申请一块大小为kBlockSize的内存，并让alloc_ptr_指向这块
   // 新内存，那alloc_ptr_原来指向的那块大小为256B的内存就没有被使用了，由于alloc_ptr_被重新
   // 赋值，所以原有那块256B内存就找不到了。所以本项目实现了stl的内存池防止这一现象的发生。
-  alloc_ptr_ = AllocateNewBlock(kBlockSize);
-  alloc_bytes_remaining_ = kBlockSize;
+  alloc_ptr_ = nullptr;
+  if (huge_page_size_ > 0 || numa_node_ >= 0) {
+    size_t mapped = 0;
+    alloc_ptr_ = AllocatePages(block_size_, huge_page_size_, numa_node_, &mapped);
+    if (alloc_ptr_ != nullptr) {
+      mapped_blocks_.emplace_back(alloc_ptr_, mapped);
+      memory_usage_.fetch_add(mapped, std::memory_order_relaxed);
+      alloc_bytes_remaining_ = mapped;
+    }
+  }
+  if (alloc_ptr_ == nullptr) {
+    alloc_ptr_ = AllocateNewBlock(block_size_);
+    alloc_bytes_remaining_ = block_size_;
+  }
   char* result = alloc_ptr_;
   alloc_ptr_ += bytes;
   alloc_bytes_remaining_ -= bytes;
@@ -66,4 +95,142 @@ char* SimpleVectorAlloc::AllocateNewBlock(uint32_t block_bytes) {
                           std::memory_order_relaxed);
   return result;
 }
+
+ConcurrentArena::ConcurrentArena(size_t block_size, size_t huge_page_size,
+                                 int32_t numa_node)
+    : block_size_(std::max<size_t>(block_size, 4096)),
+      huge_page_size_(huge_page_size),
+      numa_node_(numa_node) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  current_.store(NewBlock(), std::memory_order_release);
+}
+
+ConcurrentArena::~ConcurrentArena() {
+  for (const Memory& memory : memories_) {
+    if (memory.mmapped) {
+      FreePages(memory.data, memory.size);
+    } else {
+      free(memory.data);
+    }
+  }
+}
+
+char* ConcurrentArena::AllocateMemory(size_t bytes) {
+  char* data = static_cast<char*>(malloc(bytes));
+  memories_.push_back({data, bytes, false});
+  memory_usage_.fetch_add(bytes, std::memory_order_relaxed);
+  return data;
+}
+
+ConcurrentArena::Block* ConcurrentArena::NewBlock() {
+  auto block = std::make_unique<Block>();
+  if (huge_page_size_ > 0 || numa_node_ >= 0) {
+    size_t mapped = 0;
+    block->data = AllocatePages(block_size_, huge_page_size_, numa_node_, &mapped);
+    if (block->data != nullptr) {
+      // 按大页对齐之后多出来的部分也可以使用
+      block->size = mapped;
+      memories_.push_back({block->data, mapped, true});
+      memory_usage_.fetch_add(mapped, std::memory_order_relaxed);
+    }
+  }
+  if (block->data == nullptr) {
+    block->size = block_size_;
+    block->data = AllocateMemory(block_size_);
+  }
+  blocks_.push_back(std::move(block));
+  return blocks_.back().get();
+}
+
+void* ConcurrentArena::Allocate(uint32_t bytes) {
+  // 每次分配都按8字节对齐，block的起始地址本身是对齐的
+  const size_t needed = (static_cast<size_t>(bytes) + 7) & ~static_cast<size_t>(7);
+  if (needed > block_size_ / 4) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return AllocateMemory(needed);
+  }
+  while (true) {
+    Block* block = current_.load(std::memory_order_acquire);
+    const size_t offset =
+        block->used.fetch_add(needed, std::memory_order_relaxed);
+    if (offset + needed <= block->size) {
+      return block->data + offset;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 其他线程可能已经换过了
+    if (current_.load(std::memory_order_relaxed) == block) {
+      current_.store(NewBlock(), std::memory_order_release);
+    }
+  }
+}
+
+uint64_t ConcurrentArena::MemoryUsage() const {
+  const Block* block = current_.load(std::memory_order_acquire);
+  const size_t used =
+      std::min(block->used.load(std::memory_order_relaxed), block->size);
+  return memory_usage_.load(std::memory_order_relaxed) - (block->size - used);
+}
+
+PageSlabAlloc::PageSlabAlloc(size_t huge_page_size, int32_t numa_node)
+    : huge_page_size_(huge_page_size), numa_node_(numa_node) {}
+
+PageSlabAlloc::~PageSlabAlloc() {
+  for (const auto& [data, size] : chunks_) {
+    FreePages(data, size);
+  }
+}
+
+bool PageSlabAlloc::NewChunk() {
+  // chunk的长度和每个slot都是kSlotAlign的整数倍，剩余的部分比当前申请的slot小，
+  // 可以整个作为一个slot
+  if (chunk_remaining_ > 0) {
+    const size_t index = SlotIndex(chunk_remaining_);
+    Slot* slot = reinterpret_cast<Slot*>(chunk_pos_);
+    slot->next = free_slots_[index];
+    free_slots_[index] = slot;
+    chunk_pos_ = nullptr;
+    chunk_remaining_ = 0;
+  }
+  size_t mapped = 0;
+  char* data = AllocatePages(std::max(kChunkBytes, huge_page_size_),
+                             huge_page_size_, numa_node_, &mapped);
+  if (data == nullptr) {
+    return false;
+  }
+  chunks_.emplace_back(data, mapped);
+  memory_usage_.fetch_add(mapped, std::memory_order_relaxed);
+  chunk_pos_ = data;
+  chunk_remaining_ = mapped;
+  return true;
+}
+
+void* PageSlabAlloc::Allocate(size_t bytes) {
+  if (bytes == 0 || bytes > kMaxSlotBytes) {
+    return nullptr;
+  }
+  const size_t index = SlotIndex(bytes);
+  const size_t slot_bytes = (index + 1) * kSlotAlign;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (free_slots_[index] != nullptr) {
+    Slot* slot = free_slots_[index];
+    free_slots_[index] = slot->next;
+    return slot;
+  }
+  if (chunk_remaining_ < slot_bytes && !NewChunk()) {
+    return nullptr;
+  }
+  char* result = chunk_pos_;
+  chunk_pos_ += slot_bytes;
+  chunk_remaining_ -= slot_bytes;
+  return result;
+}
+
+void PageSlabAlloc::Deallocate(void* p, size_t bytes) {
+  assert(bytes > 0 && bytes <= kMaxSlotBytes);
+  Slot* slot = static_cast<Slot*>(p);
+  std::lock_guard<std::mutex> lock(mutex_);
+  const size_t index = SlotIndex(bytes);
+  slot->next = free_slots_[index];
+  free_slots_[index] = slot;
+}
 }  // namespace corekv
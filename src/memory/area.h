@@ -4,12 +4,17 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
 #include <vector>
 
 namespace corekv {
 class SimpleVectorAlloc final {
  public:
   SimpleVectorAlloc();
+  // block从大页中申请，每个block就是一个大页，numa_node的含义和ConcurrentArena相同
+  explicit SimpleVectorAlloc(size_t huge_page_size, int32_t numa_node = -1);
 
   SimpleVectorAlloc(const SimpleVectorAlloc&) = delete;
   SimpleVectorAlloc& operator=(const SimpleVectorAlloc&) = delete;
@@ -30,14 +35,119 @@ class SimpleVectorAlloc final {
   char* AllocateFallback(uint32_t bytes);
   char* AllocateNewBlock(uint32_t block_bytes);
 
+  const size_t huge_page_size_ = 0;
+  const int32_t numa_node_ = -1;
+  uint32_t block_size_;
   // Allocation state
   char* alloc_ptr_;
   uint32_t alloc_bytes_remaining_;
 
   // Array of new[] allocated memory blocks
   std::vector<char*> blocks_;
+  // 从大页映射的block和映射的长度
+  std::vector<std::pair<char*, size_t>> mapped_blocks_;
   std::atomic<uint32_t> memory_usage_;
 };
+
+/*
+ * 多线程共用的arena，给并发插入的memtable使用
+ * 当前block的已用字节数是原子变量，分配只需要一次fetch_add，
+ * 超过block末尾说明block已经用完，加锁换一个新的block之后重试，超出的部分直接浪费；
+ * 超过block_size/4的对象单独分配，不占用当前block
+ *
+ * huge_page_size大于0的时候block通过大页申请，减少遍历skiplist时的TLB miss；
+ * numa_node不小于0的时候block绑定到这个NUMA节点，细节见AllocatePages
+ */
+class ConcurrentArena final {
+ public:
+  static constexpr size_t kDefaultBlockSize = 1024 * 1024;
+  explicit ConcurrentArena(size_t block_size = kDefaultBlockSize,
+                           size_t huge_page_size = 0, int32_t numa_node = -1);
+  ConcurrentArena(const ConcurrentArena&) = delete;
+  ConcurrentArena& operator=(const ConcurrentArena&) = delete;
+  ~ConcurrentArena();
+
+  // 线程安全，返回的地址按8字节对齐；和SimpleVectorAlloc一样不支持单独释放
+  void* Allocate(uint32_t bytes);
+  // 所有block的大小减去当前block还没有用到的部分
+  uint64_t MemoryUsage() const;
+
+ private:
+  struct Block {
+    std::atomic<size_t> used{0};
+    size_t size = 0;
+    char* data = nullptr;
+  };
+  // 以下函数需要持有mutex_
+  // 单独分配的大对象直接使用malloc，不按大页对齐
+  char* AllocateMemory(size_t bytes);
+  Block* NewBlock();
+
+ private:
+  const size_t block_size_;
+  const size_t huge_page_size_;
+  const int32_t numa_node_;
+  std::atomic<Block*> current_{nullptr};
+  std::atomic<uint64_t> memory_usage_{0};
+  std::mutex mutex_;
+  // 所有申请的内存，析构的时候统一释放，mmap的时候同时记录长度
+  struct Memory {
+    char* data;
+    size_t size;
+    bool mmapped;
+  };
+  std::vector<Memory> memories_;
+  std::vector<std::unique_ptr<Block>> blocks_;
+};
+
+/*
+ * 按kSlotAlign分级的slab分配器，slot从AllocatePages映射的chunk中切分，
+ * 释放的slot挂到对应级别的空闲链表中复用，chunk直到析构的时候才归还给系统
+ * 给block cache这类反复申请、释放几KB数据的使用方，让数据落在大页上并且绑定到指定的NUMA节点
+ *
+ * 线程安全；超过kMaxSlotBytes或者mmap失败的时候返回nullptr，由调用方自己分配
+ */
+class PageSlabAlloc final {
+ public:
+  // huge_page_size为0时使用普通页，numa_node的含义和ConcurrentArena相同
+  explicit PageSlabAlloc(size_t huge_page_size, int32_t numa_node = -1);
+  PageSlabAlloc(const PageSlabAlloc&) = delete;
+  PageSlabAlloc& operator=(const PageSlabAlloc&) = delete;
+  ~PageSlabAlloc();
+
+  void* Allocate(size_t bytes);
+  // bytes需要和Allocate时相同
+  void Deallocate(void* p, size_t bytes);
+  // 映射的chunk的总长度
+  uint64_t MemoryUsage() const {
+    return memory_usage_.load(std::memory_order_relaxed);
+  }
+  int32_t numa_node() const { return numa_node_; }
+
+  static constexpr size_t kSlotAlign = 1024;
+  static constexpr size_t kMaxSlotBytes = 256 * 1024;
+  static constexpr size_t kChunkBytes = 2 * 1024 * 1024;
+
+ private:
+  struct Slot {
+    Slot* next;
+  };
+  static size_t SlotIndex(size_t bytes) {
+    return (bytes + kSlotAlign - 1) / kSlotAlign - 1;
+  }
+  // 需要持有mutex_，chunk剩余的部分挂到空闲链表中之后映射新的chunk
+  bool NewChunk();
+
+  const size_t huge_page_size_;
+  const int32_t numa_node_;
+  std::atomic<uint64_t> memory_usage_{0};
+  std::mutex mutex_;
+  Slot* free_slots_[kMaxSlotBytes / kSlotAlign] = {nullptr};
+  char* chunk_pos_ = nullptr;
+  size_t chunk_remaining_ = 0;
+  // 映射的chunk和长度，析构的时候释放
+  std::vector<std::pair<char*, size_t>> chunks_;
+};
 }  // namespace corekv
 
 #endif
\ No newline at end of file
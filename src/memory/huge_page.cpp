@@ -0,0 +1,91 @@
+#include "huge_page.h"
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if __has_include(<linux/mempolicy.h>)
+#include <linux/mempolicy.h>
+#define COREKV_HAVE_MBIND 1
+#endif
+
+namespace corekv {
+static void BindToNode(void* data, size_t bytes, int32_t numa_node) {
+#if defined(COREKV_HAVE_MBIND) && defined(SYS_mbind)
+  constexpr int32_t kBitsPerWord = sizeof(unsigned long) * 8;
+  constexpr int32_t kMaxNodes = 1024;
+  if (numa_node < 0 || numa_node >= kMaxNodes) {
+    return;
+  }
+  unsigned long nodemask[kMaxNodes / kBitsPerWord] = {0};
+  nodemask[numa_node / kBitsPerWord] = 1UL << (numa_node % kBitsPerWord);
+  // 节点不存在或者内核没有开启NUMA的时候返回错误，保持默认的首次访问分配策略
+  syscall(SYS_mbind, data, bytes, MPOL_BIND, nodemask, kMaxNodes, 0);
+#else
+  (void)data;
+  (void)bytes;
+  (void)numa_node;
+#endif
+}
+
+char* AllocatePages(size_t bytes, size_t huge_page_size, int32_t numa_node,
+                    size_t* mapped_bytes) {
+  const size_t page_size = huge_page_size > 0
+                               ? huge_page_size
+                               : static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const size_t size = (bytes + page_size - 1) / page_size * page_size;
+  void* data = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (huge_page_size > 0) {
+    data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+#endif
+  if (data == MAP_FAILED) {
+    data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+      return nullptr;
+    }
+#ifdef MADV_HUGEPAGE
+    if (huge_page_size > 0) {
+      madvise(data, size, MADV_HUGEPAGE);
+    }
+#endif
+  }
+  BindToNode(data, size, numa_node);
+  *mapped_bytes = size;
+  return static_cast<char*>(data);
+}
+
+void FreePages(char* data, size_t mapped_bytes) {
+  munmap(data, mapped_bytes);
+}
+
+int32_t NumaNodeCount() {
+  FILE* file = fopen("/sys/devices/system/node/online", "r");
+  if (file == nullptr) {
+    return 1;
+  }
+  // 格式为逗号分隔的节点区间，例如"0-1,3"
+  int32_t count = 0;
+  int32_t first = 0, last = 0;
+  while (fscanf(file, "%d", &first) == 1) {
+    last = first;
+    int c = fgetc(file);
+    if (c == '-') {
+      if (fscanf(file, "%d", &last) != 1) {
+        break;
+      }
+      c = fgetc(file);
+    }
+    count += last - first + 1;
+    if (c != ',') {
+      break;
+    }
+  }
+  fclose(file);
+  return count > 0 ? count : 1;
+}
+}  // namespace corekv
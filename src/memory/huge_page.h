@@ -0,0 +1,23 @@
+#ifndef MEMORY_HUGE_PAGE_H_
+#define MEMORY_HUGE_PAGE_H_
+#include <cstddef>
+#include <cstdint>
+
+namespace corekv {
+/*
+ * 通过mmap申请整页的内存，给arena这类一次申请一大块、生命周期很长的使用方
+ * huge_page_size大于0时长度按大页对齐，先尝试MAP_HUGETLB(需要系统预留了大页)，
+ * 失败的时候退化成普通的匿名映射并通过madvise(MADV_HUGEPAGE)交给THP合并；
+ * numa_node不小于0时在第一次访问之前通过mbind把内存绑定到这个节点，绑定失败不影响使用
+ *
+ * 返回nullptr表示mmap失败，调用方自己退化成malloc；
+ * *mapped_bytes是实际映射的长度，释放的时候原样传给FreePages
+ */
+char* AllocatePages(size_t bytes, size_t huge_page_size, int32_t numa_node,
+                    size_t* mapped_bytes);
+void FreePages(char* data, size_t mapped_bytes);
+// 在线的NUMA节点个数，读取/sys/devices/system/node/online，读不到的时候返回1
+int32_t NumaNodeCount();
+}  // namespace corekv
+
+#endif
@@ -1,11 +1,30 @@
 #include "block_builder.h"
 
+#include "../db/comparator.h"
+#include "../db/dbformat.h"
 #include "../utils/codec.h"
+#include "../utils/hash_util.h"
 namespace corekv {
 using namespace util;
 
-DataBlockBuilder::DataBlockBuilder(const Options* options) : options_(options) {
+DataBlockBuilder::DataBlockBuilder(const Options* options, bool key_prefix)
+    : options_(options) {
   restarts_.emplace_back(0);
+  // block写满的时候会超过block_size一个entry再加上restart数组，预留一些余量，
+  // 避免写一个block的过程中buffer反复扩容
+  buffer_.reserve(options_->block_size + options_->block_size / 8);
+  if (!key_prefix) {
+    return;
+  }
+  // 前缀的大小关系需要和comparator一致
+  Comparator* comparator = options_->comparator.get();
+  if (dynamic_cast<ByteComparator*>(comparator) != nullptr) {
+    key_prefix_mode_ = kFullKeyPrefix;
+  } else if (auto* icmp = dynamic_cast<InternalKeyComparator*>(comparator);
+             icmp != nullptr &&
+             dynamic_cast<ByteComparator*>(icmp->user_comparator()) != nullptr) {
+    key_prefix_mode_ = kUserKeyPrefix;
+  }
 }
 // 先写完key和value之后，需要将restart_pointer数据保存进行
 // restart_pointer我们使用固定长度，方便我们快速恢复出数据
@@ -16,9 +35,44 @@ void DataBlockBuilder::AddRestartPointers() {
   for (const auto& restart : restarts_) {
     PutFixed32(&buffer_, restart);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  if (UseHashIndex()) {
+    AddHashIndex();
+    PutFixed32(&buffer_, restarts_.size() | kDataBlockHashIndexFlag);
+  } else if (!key_prefixes_.empty() &&
+             key_prefixes_.size() == restarts_.size()) {
+    for (const uint64_t prefix : key_prefixes_) {
+      PutFixed64(&buffer_, prefix);
+    }
+    PutFixed32(&buffer_, restarts_.size() | kDataBlockKeyPrefixFlag |
+                             (key_prefix_mode_ == kUserKeyPrefix
+                                  ? kDataBlockUserKeyPrefixFlag
+                                  : 0));
+  } else {
+    PutFixed32(&buffer_, restarts_.size());
+  }
   is_finished_ = true;
 }
+uint32_t DataBlockBuilder::NumHashBuckets() const {
+  const double ratio = options_->data_block_hash_table_util_ratio > 0
+                           ? options_->data_block_hash_table_util_ratio
+                           : 0.75;
+  // 取奇数，减少key的hash分布不均匀时的冲突
+  return static_cast<uint32_t>(key_hashes_.size() / ratio) | 1;
+}
+void DataBlockBuilder::AddHashIndex() {
+  const uint32_t num_buckets = NumHashBuckets();
+  std::string buckets(num_buckets, static_cast<char>(kHashIndexNoEntry));
+  for (const auto& [hash, restart_index] : key_hashes_) {
+    char& bucket = buckets[hash % num_buckets];
+    if (static_cast<uint8_t>(bucket) == kHashIndexNoEntry) {
+      bucket = static_cast<char>(restart_index);
+    } else if (static_cast<uint8_t>(bucket) != restart_index) {
+      bucket = static_cast<char>(kHashIndexCollision);
+    }
+  }
+  buffer_.append(buckets);
+  PutFixed32(&buffer_, num_buckets);
+}
 void DataBlockBuilder::Finish() { AddRestartPointers(); }
 void DataBlockBuilder::Add(const std::string_view& key,
                            const std::string_view& value) {
@@ -45,7 +99,7 @@ void DataBlockBuilder::Add(const std::string_view& key,
   const auto& non_shared_size = current_key_size - shared;
   // <shared><non_shared><value>
   // user_key|ts(内部创建)|
-  // value_struct[meta(type[del|add|value_ptr])|ExpiresAt(ttl)|value]
+  // type保存在internal key的tag中，kTypeBlobIndex的value是指向blob文件的索引
   const auto& value_size = value.size();
   PutVarint32(&buffer_, shared);
   PutVarint32(&buffer_, non_shared_size);
@@ -53,9 +107,24 @@ void DataBlockBuilder::Add(const std::string_view& key,
   // 将当前的key信息序列化到buffer中
   buffer_.append(key.data() + shared, non_shared_size);
   buffer_.append(value.data(), value_size);
-  // 更新pre_key，因为下次我们需要使用他
-  pre_key_.assign(key.data(), current_key_size);
+  // 更新pre_key，因为下次我们需要使用他；公共前缀已经在pre_key中，只需要替换后面的部分
+  pre_key_.resize(shared);
+  pre_key_.append(key.data() + shared, non_shared_size);
   ++restart_pointer_counter_;
+  if (options_->data_block_hash_index &&
+      restarts_.size() <= kHashIndexMaxRestarts) {
+    const std::string_view& user_key =
+        options_->comparator ? options_->comparator->UserKey(key) : key;
+    key_hashes_.emplace_back(
+        hash_util::SimMurMurHash(user_key.data(), user_key.size()),
+        restarts_.size() - 1);
+  }
+  // 每个restart区间的第一个key
+  if (key_prefix_mode_ != kNoKeyPrefix &&
+      key_prefixes_.size() < restarts_.size()) {
+    key_prefixes_.emplace_back(KeyPrefix(
+        key_prefix_mode_ == kUserKeyPrefix ? ExtractUserKey(key) : key));
+  }
 }
 
 // filter_block_builder
@@ -68,13 +137,19 @@ void FilterBlockBuilder::Add(const std::string_view& key) {
   if (key.empty() || !Availabe()) {
     return;
   }
-  datas_.emplace_back(key);
+  if (num_keys_ < datas_.size()) {
+    datas_[num_keys_].assign(key.data(), key.size());
+  } else {
+    datas_.emplace_back(key);
+  }
+  ++num_keys_;
 }
 void FilterBlockBuilder::CreateFilter() {
-  if (!Availabe() || datas_.empty()) {
+  if (!Availabe() || num_keys_ == 0) {
     return;
   }
-  policy_filter_->CreateFilter(&datas_[0], datas_.size());
+  // 直接写到当前builder自己的buffer中，policy可能同时被其他sst使用
+  policy_filter_->CreateFilter(&datas_[0], num_keys_, &buffer_);
 }
 bool FilterBlockBuilder::MayMatch(const std::string_view& key) {
   if (key.empty() || !Availabe()) {
@@ -91,11 +166,11 @@ bool FilterBlockBuilder::MayMatch(const std::string_view& key,
 }
 const std::string& FilterBlockBuilder::Data() { return buffer_; }
 void FilterBlockBuilder::Finish() {
-  if (Availabe() && !datas_.empty()) {
+  if (Availabe() && num_keys_ > 0) {
     // 先构建布隆过滤器
+    buffer_.clear();
     CreateFilter();
-    // // 序列化hash个数和bf本身数据
-    buffer_ = policy_filter_->Data();
+    // 序列化hash个数和bf本身数据
     util::PutFixed32(&buffer_, policy_filter_->GetMeta().hash_num);
   }
 }
@@ -1,4 +1,7 @@
 #pragma once
+#include <string.h>
+
+#include <algorithm>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -6,29 +9,88 @@
 #include "../db/options.h"
 #include "../filter/filter_policy.h"
 namespace corekv {
+/*
+ * data block的格式:
+ * [entry 0]...[entry N-1][restart 0(fixed32)]...[restart M-1]
+ * [hash索引或者key前缀(可选)][num_restarts | flags (fixed32)]
+ *
+ * hash索引: [bucket 0(1字节)]...[bucket K-1][K(fixed32)]
+ * bucket保存user_key所在restart区间的下标，没有key的bucket是kHashIndexNoEntry，
+ * 多个restart区间冲突的bucket是kHashIndexCollision，这两种情况下点查回退到二分
+ *
+ * key前缀: [prefix 0(fixed64)]...[prefix M-1]，只用于index block
+ * prefix i是restart i的key的KeyPrefix，带有kDataBlockUserKeyPrefixFlag的时候
+ * key是internal key，取的是其中user key的前缀
+ */
+static constexpr uint32_t kDataBlockHashIndexFlag = 1u << 31;
+static constexpr uint32_t kDataBlockKeyPrefixFlag = 1u << 30;
+static constexpr uint32_t kDataBlockUserKeyPrefixFlag = 1u << 29;
+static constexpr uint32_t kDataBlockFlagsMask =
+    kDataBlockHashIndexFlag | kDataBlockKeyPrefixFlag |
+    kDataBlockUserKeyPrefixFlag;
+static constexpr uint8_t kHashIndexNoEntry = 255;
+static constexpr uint8_t kHashIndexCollision = 254;
+// restart下标需要放进1个字节，restart更多的block不生成hash索引
+static constexpr uint32_t kHashIndexMaxRestarts = kHashIndexCollision;
+
+// key前8个字节按照大端序组成的整数，不足8个字节的部分补0；
+// 两个key的前缀不同的时候，前缀的大小关系和key的字典序一致
+inline uint64_t KeyPrefix(const std::string_view& key) {
+  if (key.size() >= sizeof(uint64_t)) {
+    uint64_t result;
+    memcpy(&result, key.data(), sizeof(result));
+    return __builtin_bswap64(result);
+  }
+  uint64_t result = 0;
+  for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+    result = (result << 8) |
+             (i < key.size() ? static_cast<uint8_t>(key[i]) : 0);
+  }
+  return result;
+}
+
 class DataBlockBuilder final {
  public:
-  DataBlockBuilder(const Options* options);
+  // key_prefix为true并且comparator是bytewise的时候生成key前缀，见文件开头
+  DataBlockBuilder(const Options* options, bool key_prefix = false);
   void Add(const std::string_view& key, const std::string_view& value);
   void Finish();
   
   // 思考一下这里为什么不是直接buffer.size呢？
   const uint64_t CurrentSize() {
     return buffer_.size() + restarts_.size() * sizeof(uint32_t) +
-           sizeof(uint32_t);
+           sizeof(uint32_t) + HashIndexSize() +
+           key_prefixes_.size() * sizeof(uint64_t);
   }
 
   const std::string& Data() { return buffer_; }
+  // 还没有写入任何entry
+  bool Empty() const { return buffer_.empty(); }
+  // 最后一次Add的key，Reset之后为空
+  const std::string& LastKey() const { return pre_key_; }
+  // 清空之后buffer等保留已经分配的内存，同一个builder可以一直复用
   void Reset() {
       restarts_.clear();
       restarts_.emplace_back(0);
       is_finished_ = false;
       buffer_.clear();
-      pre_key_ = "";
+      pre_key_.clear();
       restart_pointer_counter_ = 0;
+      key_hashes_.clear();
+      key_prefixes_.clear();
   }
   private:
   void AddRestartPointers();
+  bool UseHashIndex() const {
+    return options_->data_block_hash_index && !key_hashes_.empty() &&
+           restarts_.size() <= kHashIndexMaxRestarts;
+  }
+  uint32_t NumHashBuckets() const;
+  uint64_t HashIndexSize() const {
+    return UseHashIndex() ? NumHashBuckets() + sizeof(uint32_t) : 0;
+  }
+  void AddHashIndex();
+  enum KeyPrefixMode { kNoKeyPrefix, kFullKeyPrefix, kUserKeyPrefix };
  private:
   // 判断是否结束了
   bool is_finished_ = false;
@@ -37,6 +99,11 @@ class DataBlockBuilder final {
   std::vector<uint32_t> restarts_;        // 记录重启点的位置
   uint32_t restart_pointer_counter_ = 0;  // 记录什么时候需要进行restart
   std::string pre_key_;  // 记录前一个key(需要进行深度复制，不能使用string_view)
+  // 打开data_block_hash_index时每个entry的user_key hash和所在的restart下标
+  std::vector<std::pair<uint32_t, uint8_t>> key_hashes_;
+  KeyPrefixMode key_prefix_mode_ = kNoKeyPrefix;
+  // 每个restart的key的前缀
+  std::vector<uint64_t> key_prefixes_;
 };
 // filter_block_builder的话
 class FilterBlockBuilder final {
@@ -49,10 +116,18 @@ class FilterBlockBuilder final {
   bool MayMatch(const std::string_view& key,
                 const std::string_view& bf_datas);
   const std::string& Data();
-  void Finish(); 
+  void Finish();
+  // 一个filter分区写完之后清空，开始构建下一个分区
+  void Reset() {
+    buffer_.clear();
+    num_keys_ = 0;
+  }
  private:
  std::string buffer_;
+  // 前num_keys_个是当前分区的key，Reset之后不释放，下一个分区直接覆盖，
+  // 不需要每个key重新分配内存
   std::vector<std::string> datas_;
+  size_t num_keys_ = 0;
   FilterPolicy* policy_filter_ = nullptr;
 };
 }  // namespace corekv
@@ -0,0 +1,240 @@
+#include "compression.h"
+
+#include <algorithm>
+
+#ifdef COREKV_HAVE_SNAPPY
+#include <snappy.h>
+#endif
+#ifdef COREKV_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef COREKV_HAVE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+#include "../utils/codec.h"
+
+namespace corekv {
+using namespace util;
+namespace {
+#if defined(COREKV_HAVE_LZ4) || defined(COREKV_HAVE_ZSTD)
+// lz4和zstd的压缩结果前面的原始长度
+void PutRawSize(std::string* output, size_t size) {
+  output->clear();
+  PutVarint32(output, static_cast<uint32_t>(size));
+}
+
+bool GetRawSize(std::string_view* input, uint32_t* size) {
+  const char* p =
+      GetVarint32Ptr(input->data(), input->data() + input->size(), size);
+  if (p == nullptr) {
+    return false;
+  }
+  input->remove_prefix(p - input->data());
+  return true;
+}
+#endif
+
+#ifdef COREKV_HAVE_ZSTD
+// 压缩和解压的上下文创建代价比较大，每个线程复用一份
+struct ZstdContext {
+  ZstdContext() : cctx(ZSTD_createCCtx()), dctx(ZSTD_createDCtx()) {}
+  ~ZstdContext() {
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+  }
+  ZSTD_CCtx* const cctx;
+  ZSTD_DCtx* const dctx;
+};
+
+ZstdContext* GetZstdContext() {
+  thread_local ZstdContext context;
+  return &context;
+}
+#endif
+}  // namespace
+
+CompressionDict::CompressionDict(std::string dict, int32_t level)
+    : dict_(std::move(dict)) {
+#ifdef COREKV_HAVE_ZSTD
+  if (!dict_.empty()) {
+    cdict_ = ZSTD_createCDict(dict_.data(), dict_.size(), level);
+    ddict_ = ZSTD_createDDict(dict_.data(), dict_.size());
+  }
+#else
+  (void)level;
+#endif
+}
+
+CompressionDict::~CompressionDict() {
+#ifdef COREKV_HAVE_ZSTD
+  ZSTD_freeCDict(reinterpret_cast<ZSTD_CDict*>(cdict_));
+  ZSTD_freeDDict(reinterpret_cast<ZSTD_DDict*>(ddict_));
+#endif
+}
+
+bool CompressionTypeSupported(BlockCompressType type) {
+  switch (type) {
+    case kNonCompress:
+      return true;
+#ifdef COREKV_HAVE_SNAPPY
+    case kSnappyCompression:
+      return true;
+#endif
+#ifdef COREKV_HAVE_LZ4
+    case kLZ4Compression:
+      return true;
+#endif
+#ifdef COREKV_HAVE_ZSTD
+    case kZSTDCompression:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+bool CompressBlock(BlockCompressType type, int32_t level,
+                   const CompressionDict* dict, const std::string_view& input,
+                   std::string* output) {
+  // 对应的压缩库没有编译进来的时候这些参数用不到
+  (void)level;
+  (void)dict;
+  (void)input;
+  (void)output;
+  switch (type) {
+#ifdef COREKV_HAVE_SNAPPY
+    case kSnappyCompression:
+      output->clear();
+      snappy::Compress(input.data(), input.size(), output);
+      return true;
+#endif
+#ifdef COREKV_HAVE_LZ4
+    case kLZ4Compression: {
+      PutRawSize(output, input.size());
+      const size_t header = output->size();
+      const int32_t bound = LZ4_compressBound(static_cast<int32_t>(input.size()));
+      output->resize(header + bound);
+      const int32_t size = LZ4_compress_default(
+          input.data(), &(*output)[header], static_cast<int32_t>(input.size()),
+          bound);
+      if (size <= 0) {
+        return false;
+      }
+      output->resize(header + size);
+      return true;
+    }
+#endif
+#ifdef COREKV_HAVE_ZSTD
+    case kZSTDCompression: {
+      PutRawSize(output, input.size());
+      const size_t header = output->size();
+      const size_t bound = ZSTD_compressBound(input.size());
+      output->resize(header + bound);
+      ZSTD_CCtx* cctx = GetZstdContext()->cctx;
+      const size_t size =
+          dict != nullptr && dict->cdict_ != nullptr
+              ? ZSTD_compress_usingCDict(
+                    cctx, &(*output)[header], bound, input.data(), input.size(),
+                    reinterpret_cast<const ZSTD_CDict*>(dict->cdict_))
+              : ZSTD_compressCCtx(cctx, &(*output)[header], bound, input.data(),
+                                  input.size(), level);
+      if (ZSTD_isError(size)) {
+        return false;
+      }
+      output->resize(header + size);
+      return true;
+    }
+#endif
+    default:
+      return false;
+  }
+}
+
+DBStatus UncompressBlock(BlockCompressType type, const CompressionDict* dict,
+                         const std::string_view& input, std::string* output) {
+  (void)dict;
+  (void)input;
+  (void)output;
+  switch (type) {
+#ifdef COREKV_HAVE_SNAPPY
+    case kSnappyCompression: {
+      size_t size = 0;
+      if (!snappy::GetUncompressedLength(input.data(), input.size(), &size)) {
+        return Status::kCorruption;
+      }
+      output->resize(size);
+      if (!snappy::RawUncompress(input.data(), input.size(), &(*output)[0])) {
+        return Status::kCorruption;
+      }
+      return Status::kSuccess;
+    }
+#endif
+#ifdef COREKV_HAVE_LZ4
+    case kLZ4Compression: {
+      std::string_view data = input;
+      uint32_t size = 0;
+      if (!GetRawSize(&data, &size)) {
+        return Status::kCorruption;
+      }
+      output->resize(size);
+      const int32_t actual =
+          LZ4_decompress_safe(data.data(), &(*output)[0],
+                              static_cast<int32_t>(data.size()), size);
+      if (actual < 0 || static_cast<uint32_t>(actual) != size) {
+        return Status::kCorruption;
+      }
+      return Status::kSuccess;
+    }
+#endif
+#ifdef COREKV_HAVE_ZSTD
+    case kZSTDCompression: {
+      std::string_view data = input;
+      uint32_t size = 0;
+      if (!GetRawSize(&data, &size)) {
+        return Status::kCorruption;
+      }
+      output->resize(size);
+      ZSTD_DCtx* dctx = GetZstdContext()->dctx;
+      const size_t actual =
+          dict != nullptr && dict->ddict_ != nullptr
+              ? ZSTD_decompress_usingDDict(
+                    dctx, &(*output)[0], size, data.data(), data.size(),
+                    reinterpret_cast<const ZSTD_DDict*>(dict->ddict_))
+              : ZSTD_decompressDCtx(dctx, &(*output)[0], size, data.data(),
+                                    data.size());
+      if (ZSTD_isError(actual) || actual != size) {
+        return Status::kCorruption;
+      }
+      return Status::kSuccess;
+    }
+#endif
+    default:
+      return Status::kNotSupported;
+  }
+}
+
+std::string TrainCompressionDict(const std::string& samples,
+                                 const std::vector<size_t>& sample_sizes,
+                                 size_t max_dict_bytes) {
+  if (samples.empty() || max_dict_bytes == 0) {
+    return std::string();
+  }
+#ifdef COREKV_HAVE_ZSTD
+  std::string dict(max_dict_bytes, '\0');
+  const size_t dict_size = ZDICT_trainFromBuffer(
+      &dict[0], dict.size(), samples.data(), sample_sizes.data(),
+      static_cast<unsigned>(sample_sizes.size()));
+  if (!ZDICT_isError(dict_size)) {
+    dict.resize(dict_size);
+    return dict;
+  }
+#else
+  (void)sample_sizes;
+#endif
+  // zstd可以直接使用任意内容作为字典，越靠后的样本越接近接下来要压缩的数据
+  const size_t size = std::min(samples.size(), max_dict_bytes);
+  return samples.substr(samples.size() - size);
+}
+}  // namespace corekv
@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../db/options.h"
+#include "../db/status.h"
+/*
+ * block压缩，每种算法需要在编译时定义对应的宏并链接对应的库:
+ *   COREKV_HAVE_SNAPPY -lsnappy   COREKV_HAVE_LZ4 -llz4   COREKV_HAVE_ZSTD -lzstd
+ * bazel中通过--define snappy/lz4/zstd=true或者--config=compression打开，见table/BUILD
+ * 没有编译进来的算法写入时退化成不压缩，读取时返回kNotSupported
+ *
+ * snappy的压缩结果自己带有原始长度；lz4和zstd前面加上varint32的原始长度，
+ * 解压的时候可以一次分配好内存
+ */
+namespace corekv {
+// 一个sst共用的zstd字典，构建和读取的时候各自持有一份
+class CompressionDict final {
+ public:
+  CompressionDict(std::string dict, int32_t level);
+  CompressionDict(const CompressionDict&) = delete;
+  CompressionDict& operator=(const CompressionDict&) = delete;
+  ~CompressionDict();
+  const std::string& data() const { return dict_; }
+  // 用type压缩的时候是否真的会用到字典：只有zstd，并且字典不为空
+  bool UsedFor(BlockCompressType type) const {
+    return type == kZSTDCompression && cdict_ != nullptr;
+  }
+
+ private:
+  friend bool CompressBlock(BlockCompressType, int32_t, const CompressionDict*,
+                            const std::string_view&, std::string*);
+  friend DBStatus UncompressBlock(BlockCompressType, const CompressionDict*,
+                                  const std::string_view&, std::string*);
+  std::string dict_;
+  // 预先解析好的ZSTD_CDict和ZSTD_DDict，没有zstd的时候为nullptr
+  void* cdict_ = nullptr;
+  void* ddict_ = nullptr;
+};
+
+bool CompressionTypeSupported(BlockCompressType type);
+// 压缩成功返回true，level只对zstd生效，dict为nullptr的时候不使用字典
+bool CompressBlock(BlockCompressType type, int32_t level,
+                   const CompressionDict* dict, const std::string_view& input,
+                   std::string* output);
+DBStatus UncompressBlock(BlockCompressType type, const CompressionDict* dict,
+                         const std::string_view& input, std::string* output);
+// 用拼接在一起的样本训练zstd字典，sample_sizes是每个样本的长度
+// 样本太少训练失败的时候直接用最后max_dict_bytes字节的样本作为原始内容字典
+std::string TrainCompressionDict(const std::string& samples,
+                                 const std::vector<size_t>& sample_sizes,
+                                 size_t max_dict_bytes);
+}  // namespace corekv
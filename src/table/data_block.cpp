@@ -1,16 +1,53 @@
 #include "data_block.h"
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define COREKV_HAVE_AVX2_DISPATCH 1
+#endif
+
 #include "../db/comparator.h"
+#include "../db/dbformat.h"
+#include "../memory/area.h"
 #include "../utils/codec.h"
+#include "../utils/hash_util.h"
+#include "../utils/perf_context.h"
+#include "block_builder.h"
 namespace corekv {
 using namespace util;
 // 反解析出来的实际restarts offset个数
 uint32_t DataBlock::NumRestarts() const {
-  return util::DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  return util::DecodeFixed32(data_ + size_ - sizeof(uint32_t)) &
+         ~kDataBlockFlagsMask;
+}
+DataBlock::~DataBlock() {
+  if (alloc_ != nullptr) {
+    alloc_->Deallocate(const_cast<char*>(contents_.data()), contents_.size());
+  }
 }
-DataBlock::~DataBlock() {}
 DataBlock::DataBlock(const std::string_view& contents)
-    : data_(contents.data()), size_(contents.size()), owned_(false) {
+    : contents_(contents),
+      data_(contents.data()),
+      size_(contents.size()),
+      owned_(false) {
+  Init();
+}
+DataBlock::DataBlock(std::string&& contents)
+    : owned_(true), owned_data_(std::move(contents)) {
+  // 必须在move之后再取地址，短字符串move之后地址会发生变化
+  data_ = owned_data_.data();
+  size_ = owned_data_.size();
+  contents_ = owned_data_;
+  Init();
+}
+DataBlock::DataBlock(const std::string_view& contents, PageSlabAlloc* alloc)
+    : contents_(contents),
+      data_(contents.data()),
+      size_(contents.size()),
+      owned_(true),
+      alloc_(alloc) {
+  Init();
+}
+void DataBlock::Init() {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
   } else {
@@ -26,6 +63,46 @@ DataBlock::DataBlock(const std::string_view& contents)
       restart_offset_ = size_ - (1 + num_restart_size) * sizeof(uint32_t);
     }
   }
+  if (size_ == 0) {
+    return;
+  }
+  const uint32_t flags =
+      DecodeFixed32(data_ + size_ - sizeof(uint32_t)) & kDataBlockFlagsMask;
+  if ((flags & kDataBlockKeyPrefixFlag) != 0) {
+    // key前缀在restart数组和num_restarts之间，不会和hash索引同时存在
+    const uint64_t section_size =
+        static_cast<uint64_t>(NumRestarts()) * sizeof(uint64_t);
+    if ((flags & kDataBlockHashIndexFlag) != 0 ||
+        section_size + NumRestarts() * sizeof(uint32_t) + sizeof(uint32_t) >
+            size_) {
+      size_ = 0;
+      return;
+    }
+    key_prefixes_ = data_ + size_ - sizeof(uint32_t) - section_size;
+    user_key_prefix_ = (flags & kDataBlockUserKeyPrefixFlag) != 0;
+    restart_offset_ = key_prefixes_ - data_ - NumRestarts() * sizeof(uint32_t);
+    return;
+  }
+  if ((flags & kDataBlockHashIndexFlag) == 0) {
+    return;
+  }
+  // hash索引在restart数组和num_restarts之间
+  const size_t tail = size_ - sizeof(uint32_t);
+  if (tail < sizeof(uint32_t)) {
+    size_ = 0;
+    return;
+  }
+  const uint32_t num_buckets = DecodeFixed32(data_ + tail - sizeof(uint32_t));
+  const uint64_t index_size =
+      static_cast<uint64_t>(num_buckets) + sizeof(uint32_t);
+  if (num_buckets == 0 ||
+      index_size + NumRestarts() * sizeof(uint32_t) > tail) {
+    size_ = 0;
+    return;
+  }
+  num_hash_buckets_ = num_buckets;
+  hash_buckets_ = data_ + tail - index_size;
+  restart_offset_ = hash_buckets_ - data_ - NumRestarts() * sizeof(uint32_t);
 }
 
 static inline const char* DecodeEntry(const char* p, const char* limit,
@@ -50,9 +127,75 @@ static inline const char* DecodeEntry(const char* p, const char* limit,
   return p;
 }
 
+namespace {
+inline uint64_t PrefixAt(const char* prefixes, uint32_t index) {
+  return DecodeFixed64(prefixes + index * sizeof(uint64_t));
+}
+
+#ifdef COREKV_HAVE_AVX2_DISPATCH
+// prefixes[0, 8)中小于target的个数，64位比较是有符号的，两边都翻转最高位
+__attribute__((target("avx2"))) uint32_t CountLessAvx2(const char* prefixes,
+                                                        uint64_t target) {
+  const __m256i sign = _mm256_set1_epi64x(static_cast<int64_t>(1ull << 63));
+  const __m256i t = _mm256_xor_si256(
+      _mm256_set1_epi64x(static_cast<int64_t>(target)), sign);
+  const __m256i lo = _mm256_xor_si256(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prefixes)), sign);
+  const __m256i hi = _mm256_xor_si256(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prefixes + 32)),
+      sign);
+  const int mask =
+      _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(t, lo))) |
+      (_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(t, hi)))
+       << 4);
+  return __builtin_popcount(mask);
+}
+
+bool DetectAvx2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+const bool kHasAvx2 = DetectAvx2();
+#endif
+
+// 有序的prefixes[0, n)中第一个不小于target的下标；先无分支地二分到最多8个元素，
+// 再一次比较完剩下的窗口，窗口之后的元素都不小于target，多比较几个不影响结果
+uint32_t PrefixLowerBound(const char* prefixes, uint32_t n, uint64_t target) {
+  uint32_t base = 0;
+  uint32_t len = n;
+  while (len > 8) {
+    const uint32_t half = len / 2;
+    base = PrefixAt(prefixes, base + half) < target ? base + half : base;
+    len -= half;
+  }
+#ifdef COREKV_HAVE_AVX2_DISPATCH
+  if (kHasAvx2 && base + 8 <= n) {
+    return base + CountLessAvx2(prefixes + base * sizeof(uint64_t), target);
+  }
+#endif
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < len; ++i) {
+    count += PrefixAt(prefixes, base + i) < target;
+  }
+  return base + count;
+}
+
+// 前缀的顺序需要和comparator一致才能使用，其余情况忽略前缀
+bool KeyPrefixUsable(Comparator* comparator, bool user_key_prefix) {
+  if (!user_key_prefix) {
+    return dynamic_cast<ByteComparator*>(comparator) != nullptr;
+  }
+  auto* icmp = dynamic_cast<InternalKeyComparator*>(comparator);
+  return icmp != nullptr &&
+         dynamic_cast<ByteComparator*>(icmp->user_comparator()) != nullptr;
+}
+}  // namespace
+
 class DataBlock::Iter : public Iterator {
  private:
   std::shared_ptr<Comparator> comparator_;
+  InternalKeyComparator* const internal_comparator_;
+  ByteComparator* const bytewise_comparator_;
   // data是整个数据开始计算的
   const char* const data_;  // underlying block contents
   // 重启点开始的位置
@@ -60,15 +203,28 @@ class DataBlock::Iter : public Iterator {
 
   // 重启点的个数
   uint32_t const num_restarts_;  // Number of uint32_t entries in restart array
+  const char* const hash_buckets_;
+  uint32_t const num_hash_buckets_;
+  // 可以使用的key前缀，没有或者和comparator不匹配的时候为nullptr
+  const char* const key_prefixes_;
+  bool const user_key_prefix_;
   uint32_t current_;
   uint32_t restart_index_;  // Index of restart block in which current_ falls
   std::string key_;
-  std::string value_;
+  // 直接指向block中的数据，block由迭代器的cleanup或者调用方保证有效
+  std::string_view value_;
   uint32_t offset_ = 0;
   DBStatus status_;
 
+  // 常见的两种comparator直接调用final类的内联实现，其余的走虚函数
   inline int Compare(const std::string_view& a, const std::string_view& b) {
-    return comparator_->Compare(a.data(), b.data());
+    if (internal_comparator_ != nullptr) {
+      return internal_comparator_->Compare(a, b);
+    }
+    if (bytewise_comparator_ != nullptr) {
+      return bytewise_comparator_->Compare(a, b);
+    }
+    return comparator_->Compare(a, b);
   }
 
   // Return the offset in data_ just past the end of the current entry.
@@ -92,16 +248,25 @@ class DataBlock::Iter : public Iterator {
 
     // 重启点的位置
     offset_ = GetRestartPoint(index);
-    value_ = std::string(data_ + offset_, 0);
+    value_ = std::string_view(data_ + offset_, 0);
   }
 
  public:
   Iter(std::shared_ptr<Comparator> comparator, const char* data, uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts, const char* hash_buckets,
+       uint32_t num_hash_buckets, const char* key_prefixes,
+       bool user_key_prefix)
       : comparator_(comparator),
+        internal_comparator_(
+            dynamic_cast<InternalKeyComparator*>(comparator_.get())),
+        bytewise_comparator_(dynamic_cast<ByteComparator*>(comparator_.get())),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
+        hash_buckets_(hash_buckets),
+        num_hash_buckets_(num_hash_buckets),
+        key_prefixes_(key_prefixes),
+        user_key_prefix_(user_key_prefix),
         current_(restarts_),
         restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
@@ -114,7 +279,7 @@ class DataBlock::Iter : public Iterator {
     assert(Valid());
     return key_;
   }
-  std::string value() override {
+  std::string_view value() const override {
     assert(Valid());
     return value_;
   }
@@ -151,6 +316,7 @@ class DataBlock::Iter : public Iterator {
     uint32_t left = 0;
     // num_restarts_：表示当前总个数
     uint32_t right = num_restarts_ - 1;
+    NarrowByKeyPrefix(target, &left, &right);
 
     while (left < right) {
       uint32_t mid = (left + right + 1) / 2;
@@ -194,6 +360,39 @@ class DataBlock::Iter : public Iterator {
     }
   }
 
+  // 通过hash索引直接定位到user_key所在的restart区间，同一个user_key的所有版本都在这个区间内，
+  // 区间内在它之前的entry都比target小，从区间开头顺序查找就能得到和Seek一样的结果
+  void SeekForGet(const std::string_view& target) override {
+    if (hash_buckets_ == nullptr) {
+      Seek(target);
+      return;
+    }
+    const std::string_view& user_key = comparator_->UserKey(target);
+    const uint8_t restart_index = static_cast<uint8_t>(
+        hash_buckets_[hash_util::SimMurMurHash(user_key.data(),
+                                               user_key.size()) %
+                      num_hash_buckets_]);
+    if (restart_index == kHashIndexNoEntry) {
+      // block中没有这个user_key
+      PerfCounterAdd(&PerfContext::block_hash_index_lookup_count);
+      current_ = restarts_;
+      restart_index_ = num_restarts_;
+      return;
+    }
+    if (restart_index >= num_restarts_) {
+      // 冲突的bucket或者数据不对，都按照没有索引处理
+      Seek(target);
+      return;
+    }
+    PerfCounterAdd(&PerfContext::block_hash_index_lookup_count);
+    SeekToRestartPoint(restart_index);
+    while (ParseNextKey()) {
+      if (Compare(key_, target) >= 0) {
+        return;
+      }
+    }
+  }
+
   void SeekToFirst() override {
     SeekToRestartPoint(0);
     ParseNextKey();
@@ -207,12 +406,33 @@ class DataBlock::Iter : public Iterator {
   }
 
  private:
+  // 前缀小于target前缀的restart key一定小于target，大于的一定大于target，
+  // 二分只需要在前缀相同的restart以及它前面的一个restart中进行
+  void NarrowByKeyPrefix(const std::string_view& target, uint32_t* left,
+                         uint32_t* right) {
+    if (key_prefixes_ == nullptr ||
+        (user_key_prefix_ && target.size() < sizeof(uint64_t))) {
+      return;
+    }
+    const uint64_t prefix =
+        KeyPrefix(user_key_prefix_ ? ExtractUserKey(target) : target);
+    const uint32_t lower =
+        PrefixLowerBound(key_prefixes_, num_restarts_, prefix);
+    uint32_t upper = num_restarts_;
+    if (prefix != UINT64_MAX) {
+      upper = lower + PrefixLowerBound(key_prefixes_ + lower * sizeof(uint64_t),
+                                       num_restarts_ - lower, prefix + 1);
+    }
+    *left = lower > 0 ? lower - 1 : 0;
+    *right = std::max(*left, upper > 0 ? upper - 1 : 0);
+  }
+
   void CorruptionError() {
     current_ = restarts_;
     restart_index_ = num_restarts_;
     status_ = Status::kInterupt;
     key_.clear();
-    value_.clear();
+    value_ = std::string_view();
   }
 
   bool ParseNextKey() {
@@ -238,7 +458,9 @@ class DataBlock::Iter : public Iterator {
     } else {
       key_.resize(shared);
       key_.append(p, non_shared);
-      value_ = std::string(p + non_shared, value_length);
+      value_ = std::string_view(p + non_shared, value_length);
+      // 下一个entry开始的位置
+      offset_ = (p + non_shared + value_length) - data_;
       // 更新restart_index_指针，到当前value所在的重启点数据的前一个
       while (restart_index_ + 1 < num_restarts_ &&
              GetRestartPoint(restart_index_ + 1) < current_) {
@@ -258,7 +480,14 @@ Iterator* DataBlock::NewIterator(std::shared_ptr<Comparator> comparator) {
     return NewEmptyIterator();
   } else {
     // restart_offset_：重启点开始的位置，也是数据部分的总长度
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
+    const char* key_prefixes =
+        key_prefixes_ != nullptr &&
+                KeyPrefixUsable(comparator.get(), user_key_prefix_)
+            ? key_prefixes_
+            : nullptr;
+    return new Iter(comparator, data_, restart_offset_, num_restarts,
+                    hash_buckets_, num_hash_buckets_, key_prefixes,
+                    user_key_prefix_);
   }
 }
 }  // namespace corekv
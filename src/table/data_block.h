@@ -2,28 +2,50 @@
 #include <stdint.h>
 #include <string_view>
 #include <memory>
+#include <string>
 #include "../db/iterator.h"
 namespace corekv {
 class Comparator;
+class PageSlabAlloc;
 class DataBlock {
  public:
   // Initialize the block with the specified contents.
   explicit DataBlock(const std::string_view& contents);
+  // 接管contents的内存，block的生命周期不再依赖于调用方的buffer
+  explicit DataBlock(std::string&& contents);
+  // contents从alloc申请，block析构的时候还给alloc
+  DataBlock(const std::string_view& contents, PageSlabAlloc* alloc);
 
   DataBlock(const DataBlock&) = delete;
   DataBlock& operator=(const DataBlock&) = delete;
   ~DataBlock();
   size_t size() const { return size_; }
+  // block的原始数据，filter这类不是按照entry组织的block直接使用
+  std::string_view contents() const { return contents_; }
+  // 为false的时候数据属于调用方(例如mmap的内存)，可能比block先失效
+  bool owns_data() const { return owned_; }
   Iterator* NewIterator(std::shared_ptr<Comparator> comparator);
 
  private:
   class Iter;
   uint32_t NumRestarts() const;
+  void Init();
 
+  std::string_view contents_;
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;  // Offset in data_ of restart array
+  // 没有hash索引的时候为nullptr
+  const char* hash_buckets_ = nullptr;
+  uint32_t num_hash_buckets_ = 0;
+  // 每个restart的key前缀，没有的时候为nullptr
+  const char* key_prefixes_ = nullptr;
+  // 前缀取自internal key中的user key
+  bool user_key_prefix_ = false;
   bool owned_;               // Block owns data_[]
+  std::string owned_data_;
+  // 数据从这个分配器申请，为nullptr时数据在owned_data_中或者属于调用方
+  PageSlabAlloc* alloc_ = nullptr;
 };
 
 }  // namespace corekv
\ No newline at end of file
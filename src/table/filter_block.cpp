@@ -0,0 +1,90 @@
+#include "filter_block.h"
+
+#include "../filter/filter_policy.h"
+#include "../utils/codec.h"
+namespace corekv {
+using namespace util;
+
+PerBlockFilterBuilder::PerBlockFilterBuilder(FilterPolicy* policy)
+    : policy_(policy) {}
+
+void PerBlockFilterBuilder::StartBlock(uint64_t block_offset) {
+  // 中间跳过的范围没有block开始，生成空的filter
+  const uint64_t filter_index = block_offset / kFilterBase;
+  while (filter_index > filter_offsets_.size()) {
+    GenerateFilter();
+  }
+}
+
+void PerBlockFilterBuilder::AddKey(const std::string_view& key) {
+  key_starts_.push_back(keys_.size());
+  keys_.append(key.data(), key.size());
+}
+
+const std::string& PerBlockFilterBuilder::Finish() {
+  if (!key_starts_.empty()) {
+    GenerateFilter();
+  }
+  const uint32_t array_offset = result_.size();
+  for (const auto offset : filter_offsets_) {
+    PutFixed32(&result_, offset);
+  }
+  PutFixed32(&result_, array_offset);
+  result_.push_back(static_cast<char>(kFilterBaseLg));
+  return result_;
+}
+
+void PerBlockFilterBuilder::GenerateFilter() {
+  filter_offsets_.push_back(result_.size());
+  const size_t num_keys = key_starts_.size();
+  if (num_keys == 0) {
+    return;
+  }
+  tmp_keys_.resize(num_keys);
+  key_starts_.push_back(keys_.size());
+  for (size_t i = 0; i < num_keys; ++i) {
+    tmp_keys_[i].assign(keys_.data() + key_starts_[i],
+                        key_starts_[i + 1] - key_starts_[i]);
+  }
+  policy_->CreateFilter(&tmp_keys_[0], num_keys, &result_);
+  PutFixed32(&result_, policy_->GetMeta().hash_num);
+  keys_.clear();
+  key_starts_.clear();
+}
+
+PerBlockFilterReader::PerBlockFilterReader(FilterPolicy* policy,
+                                           const std::string_view& contents)
+    : policy_(policy) {
+  const size_t n = contents.size();
+  // 至少需要offset数组的位置和base_lg
+  if (n < 5) {
+    return;
+  }
+  const uint32_t array_offset = DecodeFixed32(contents.data() + n - 5);
+  if (array_offset > n - 5) {
+    return;
+  }
+  base_lg_ = contents[n - 1];
+  data_ = contents.data();
+  offset_ = data_ + array_offset;
+  num_ = (n - 5 - array_offset) / 4;
+}
+
+bool PerBlockFilterReader::KeyMayMatch(uint64_t block_offset,
+                                       const std::string_view& key) const {
+  const uint64_t index = block_offset >> base_lg_;
+  if (index >= num_) {
+    // 数据有问题的时候不过滤
+    return true;
+  }
+  // 最后一个filter的结束位置就是offset数组的起始位置
+  const uint32_t start = DecodeFixed32(offset_ + index * 4);
+  const uint32_t limit = DecodeFixed32(offset_ + index * 4 + 4);
+  if (start > limit || limit > static_cast<size_t>(offset_ - data_)) {
+    return true;
+  }
+  // 空的filter说明这个范围内没有任何key
+  return start < limit &&
+         policy_->MayMatch(key, std::string_view(data_ + start, limit - start));
+}
+}  // namespace corekv
@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace corekv {
+class FilterPolicy;
+// 起始偏移量在同一个kFilterBase字节范围内的data block共用一个filter
+static constexpr uint32_t kFilterBaseLg = 11;
+static constexpr uint32_t kFilterBase = 1 << kFilterBaseLg;
+/*
+ * 按照data block的偏移量分段构建filter，builder中只需要保存当前这一段的key
+ * ┌──────────┬─────┬────────────┬───────────────────────┬──────────────────────┬─────────┐
+ * │ filter 0 │ ... │ filter N-1 │ filter offset[N] (32) │ offset array pos(32) │ base_lg │
+ * └──────────┴─────┴────────────┴───────────────────────┴──────────────────────┴─────────┘
+ * 起始偏移量落在[i*kFilterBase, (i+1)*kFilterBase)中的block使用第i个filter，
+ * 每个filter是FilterPolicy生成的数据后面加上fixed32的hash个数，可以直接交给MayMatch
+ */
+class PerBlockFilterBuilder final {
+ public:
+  explicit PerBlockFilterBuilder(FilterPolicy* policy);
+  PerBlockFilterBuilder(const PerBlockFilterBuilder&) = delete;
+  PerBlockFilterBuilder& operator=(const PerBlockFilterBuilder&) = delete;
+
+  // 开始一个新的data block，block_offset是它在文件中的偏移量
+  void StartBlock(uint64_t block_offset);
+  void AddKey(const std::string_view& key);
+  // 返回整个filter block，在builder析构之前有效
+  const std::string& Finish();
+
+ private:
+  void GenerateFilter();
+
+  FilterPolicy* policy_;
+  // 当前这一段的所有key拼接在一起，key_starts_记录每个key的起点
+  std::string keys_;
+  std::vector<size_t> key_starts_;
+  // CreateFilter需要std::string数组
+  std::vector<std::string> tmp_keys_;
+  std::string result_;
+  std::vector<uint32_t> filter_offsets_;
+};
+
+class PerBlockFilterReader final {
+ public:
+  // contents需要在reader的生命周期内有效
+  PerBlockFilterReader(FilterPolicy* policy, const std::string_view& contents);
+  // 返回false说明key一定不在从block_offset开始的data block中
+  bool KeyMayMatch(uint64_t block_offset, const std::string_view& key) const;
+
+ private:
+  FilterPolicy* policy_;
+  const char* data_ = nullptr;
+  // offset数组的起始位置
+  const char* offset_ = nullptr;
+  size_t num_ = 0;
+  size_t base_lg_ = 0;
+};
+}  // namespace corekv
@@ -0,0 +1,185 @@
+#include "merging_iterator.h"
+
+#include <utility>
+#include <vector>
+
+#include "../db/comparator.h"
+namespace corekv {
+namespace {
+/*
+ * 用败者树做k路归并: tree_[0]保存当前胜者(正向为最小，反向为最大)，
+ * tree_[1..n-1]是内部节点，保存这一场比赛的败者；叶子i的父节点是(i + n) / 2
+ * 胜者前进一步之后只需要沿着它到根的路径重新比赛，每次Next()需要O(log n)次比较
+ */
+class MergingIterator final : public Iterator {
+ public:
+  MergingIterator(Comparator* comparator, Iterator** children, int32_t n)
+      : comparator_(comparator), n_(n), tree_(n, 0) {
+    children_.reserve(n);
+    for (int32_t i = 0; i < n; ++i) {
+      children_.emplace_back(children[i]);
+    }
+  }
+  ~MergingIterator() override = default;
+
+  bool Valid() const override { return current_ != nullptr; }
+  void SeekToFirst() override {
+    for (auto& child : children_) {
+      child->SeekToFirst();
+    }
+    direction_ = kForward;
+    Rebuild();
+  }
+  void SeekToLast() override {
+    for (auto& child : children_) {
+      child->SeekToLast();
+    }
+    direction_ = kReverse;
+    Rebuild();
+  }
+  void Seek(const std::string_view& target) override {
+    for (auto& child : children_) {
+      child->Seek(target);
+    }
+    direction_ = kForward;
+    Rebuild();
+  }
+  void Next() override {
+    assert(Valid());
+    // 反向切换到正向时，需要把其他迭代器都定位到大于key()的位置
+    if (direction_ != kForward) {
+      const std::string current_key(key());
+      for (auto& child : children_) {
+        if (child.get() != current_) {
+          child->Seek(current_key);
+          if (child->Valid() &&
+              comparator_->Compare(current_key, child->key()) == 0) {
+            child->Next();
+          }
+        }
+      }
+      current_->Next();
+      direction_ = kForward;
+      Rebuild();
+      return;
+    }
+    current_->Next();
+    Adjust(tree_[0]);
+  }
+  void Prev() override {
+    assert(Valid());
+    // 正向切换到反向时，需要把其他迭代器都定位到小于key()的位置
+    if (direction_ != kReverse) {
+      const std::string current_key(key());
+      for (auto& child : children_) {
+        if (child.get() != current_) {
+          child->Seek(current_key);
+          if (child->Valid()) {
+            child->Prev();
+          } else {
+            // 所有的key都小于current_key
+            child->SeekToLast();
+          }
+        }
+      }
+      current_->Prev();
+      direction_ = kReverse;
+      Rebuild();
+      return;
+    }
+    current_->Prev();
+    Adjust(tree_[0]);
+  }
+  std::string_view key() const override {
+    assert(Valid());
+    return current_->key();
+  }
+  std::string_view value() const override {
+    assert(Valid());
+    return current_->value();
+  }
+  DBStatus status() const override {
+    for (const auto& child : children_) {
+      if (child->status() != Status::kSuccess) {
+        return child->status();
+      }
+    }
+    return Status::kSuccess;
+  }
+
+ private:
+  enum Direction { kForward, kReverse };
+  // a是否赢了b，无效的迭代器永远是败者
+  // 正向时key相同的情况下编号小的获胜，反向时编号大的获胜，和线性扫描的结果保持一致
+  bool Beats(int32_t a, int32_t b) const {
+    Iterator* x = children_[a].get();
+    Iterator* y = children_[b].get();
+    if (!x->Valid()) {
+      return false;
+    }
+    if (!y->Valid()) {
+      return true;
+    }
+    const int32_t r = comparator_->Compare(x->key(), y->key());
+    if (direction_ == kForward) {
+      return r < 0 || (r == 0 && a < b);
+    }
+    return r > 0 || (r == 0 && a > b);
+  }
+  // 所有子迭代器都重新定位之后，自底向上重新构建整棵树，需要n-1次比较
+  void Rebuild() {
+    // winners[i]为内部节点i的胜者，位置大于等于n_的是叶子
+    std::vector<int32_t> winners(n_, 0);
+    auto winner_of = [this, &winners](int32_t pos) {
+      return pos >= n_ ? pos - n_ : winners[pos];
+    };
+    for (int32_t node = n_ - 1; node >= 1; --node) {
+      const int32_t left = winner_of(2 * node);
+      const int32_t right = winner_of(2 * node + 1);
+      if (Beats(right, left)) {
+        winners[node] = right;
+        tree_[node] = left;
+      } else {
+        winners[node] = left;
+        tree_[node] = right;
+      }
+    }
+    tree_[0] = winners[1];
+    UpdateCurrent();
+  }
+  // 叶子leaf的迭代器移动之后，沿着到根的路径重新比赛
+  void Adjust(int32_t leaf) {
+    int32_t winner = leaf;
+    for (int32_t node = (leaf + n_) / 2; node > 0; node /= 2) {
+      if (Beats(tree_[node], winner)) {
+        std::swap(tree_[node], winner);
+      }
+    }
+    tree_[0] = winner;
+    UpdateCurrent();
+  }
+  void UpdateCurrent() {
+    Iterator* winner = children_[tree_[0]].get();
+    current_ = winner->Valid() ? winner : nullptr;
+  }
+
+ private:
+  Comparator* comparator_;
+  const int32_t n_;
+  std::vector<std::unique_ptr<Iterator>> children_;
+  std::vector<int32_t> tree_;
+  Iterator* current_ = nullptr;
+  Direction direction_ = kForward;
+};
+}  // namespace
+
+Iterator* NewMergingIterator(Comparator* comparator, Iterator** children,
+                             int32_t n) {
+  if (n == 0) {
+    return NewEmptyIterator();
+  } else if (n == 1) {
+    return children[0];
+  }
+  return new MergingIterator(comparator, children, n);
+}
+}  // namespace corekv
@@ -0,0 +1,11 @@
+#pragma once
+#include <memory>
+
+#include "../db/iterator.h"
+namespace corekv {
+class Comparator;
+// 把多个有序的迭代器合并成一个有序的迭代器，接管children中所有迭代器的生命周期
+// 相同的key不会去重，全部都会返回
+Iterator* NewMergingIterator(Comparator* comparator, Iterator** children,
+                             int32_t n);
+}  // namespace corekv
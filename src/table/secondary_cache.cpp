@@ -0,0 +1,55 @@
+#include "secondary_cache.h"
+
+#include "compression.h"
+
+namespace corekv {
+CompressedSecondaryCache::CompressedSecondaryCache(
+    size_t capacity, BlockCompressType compress_type, uint32_t shard_num)
+    : compress_type_(CompressionTypeSupported(compress_type) ? compress_type
+                                                             : kNonCompress),
+      cache_(capacity, shard_num) {
+  cache_.RegistCleanHandle(
+      [](const uint64_t&, std::string* value) { delete value; });
+}
+
+void CompressedSecondaryCache::Insert(uint64_t key,
+                                      const std::string_view& contents) {
+  auto value = std::make_unique<std::string>();
+  std::string compressed;
+  if (compress_type_ != kNonCompress &&
+      CompressBlock(compress_type_, 0, nullptr, contents, &compressed) &&
+      compressed.size() < contents.size()) {
+    value->reserve(1 + compressed.size());
+    value->push_back(static_cast<char>(compress_type_));
+    value->append(compressed);
+  } else {
+    value->reserve(1 + contents.size());
+    value->push_back(static_cast<char>(kNonCompress));
+    value->append(contents.data(), contents.size());
+  }
+  const size_t charge = value->size();
+  cache_.Insert(key, value.release(), charge);
+}
+
+bool CompressedSecondaryCache::Lookup(uint64_t key, std::string* contents) {
+  auto* node = cache_.Get(key);
+  if (node == nullptr) {
+    return false;
+  }
+  const std::string& value = *node->value;
+  bool found = !value.empty();
+  if (found) {
+    const auto type = static_cast<BlockCompressType>(value[0]);
+    const std::string_view data(value.data() + 1, value.size() - 1);
+    if (type == kNonCompress) {
+      contents->assign(data.data(), data.size());
+    } else {
+      found = UncompressBlock(type, nullptr, data, contents) == Status::kSuccess;
+    }
+  }
+  cache_.Release(node);
+  // 放回block_cache之后这里的副本就没有用了
+  cache_.Erase(key);
+  return found;
+}
+}  // namespace corekv
@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+
+#include "../cache/cache.h"
+#include "../db/options.h"
+
+namespace corekv {
+/*
+ * block_cache的第二层: 从block_cache中淘汰的block压缩之后保存在内存里，
+ * block_cache未命中的时候先在这里查找，命中之后解压放回block_cache并从这里删除，
+ * 两层中同一个block只保存一份；解压比从文件读取快得多，适合数据量是block_cache
+ * 几倍、磁盘又比较慢的场景
+ *
+ * value为 [压缩类型(1字节)][block数据]，容量按照压缩之后的字节数计算，
+ * 压缩之后没有变小的block直接保存原始数据
+ */
+class CompressedSecondaryCache final {
+ public:
+  // compress_type没有编译进来的时候不压缩，只是把block换到另一个容量里
+  explicit CompressedSecondaryCache(
+      size_t capacity, BlockCompressType compress_type = kLZ4Compression,
+      uint32_t shard_num = 0);
+  CompressedSecondaryCache(const CompressedSecondaryCache&) = delete;
+  CompressedSecondaryCache& operator=(const CompressedSecondaryCache&) = delete;
+
+  // key和block_cache中的key相同
+  void Insert(uint64_t key, const std::string_view& contents);
+  // 命中的时候把解压之后的block数据放到contents中，并且从缓存中删除
+  bool Lookup(uint64_t key, std::string* contents);
+  size_t GetUsage() const { return cache_.GetUsage(); }
+  BlockCompressType compress_type() const { return compress_type_; }
+
+ private:
+  BlockCompressType compress_type_;
+  ShardCache<uint64_t, std::string> cache_;
+};
+}  // namespace corekv
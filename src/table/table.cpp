@@ -1,15 +1,28 @@
 #include "table.h"
+
+#include <algorithm>
 #include <memory>
 #include "../db/comparator.h"
 #include "../logger/log.h"
 #include "../utils/codec.h"
 #include "../utils/crc32.h"
+#include "../utils/perf_context.h"
+#include "../utils/statistics.h"
 #include "data_block.h"
+#include "filter_block.h"
 #include "footer.h"
+#include "secondary_cache.h"
 #include "table_options.h"
+#include "two_level_iterator.h"
+#include "../filter/filter_policy.h"
 #include "../cache/cache.h"
 namespace corekv {
 using namespace util;
+// 顶层的index和filter是否常驻在Table中，没有block_cache的时候只能常驻
+static bool PinTopLevel(const Options* options) {
+  return options->pin_top_level_index_and_filter ||
+         options->block_cache == nullptr;
+}
 Table::Table(const Options* options, const FileReader* file_reader)
     : options_(options), file_reader_(file_reader) {}
 DBStatus Table::Open(uint64_t file_size) {
@@ -23,121 +36,913 @@ DBStatus Table::Open(uint64_t file_size) {
   if (status != Status::kSuccess) {
     return status;
   }
+  if (footer_space.size() != kEncodedLength) {
+    return Status::kBadBlock;
+  }
   Footer footer;
   std::string_view st = footer_space;
   status = footer.DecodeFrom(&st);
-  std::string index_meta_data;
-  ReadBlock(footer.GetIndexBlockMetaData(), index_meta_data);
-  index_block_ = std::make_unique<DataBlock>(index_meta_data);
+  if (status != Status::kSuccess) {
+    return status;
+  }
+  if (options_->block_cache != nullptr) {
+    // 每次打开都分配新的id，同一个sst被淘汰之后重新打开也不会读到旧的block
+    table_id_ = options_->block_cache->NewId();
+    CompressedSecondaryCache* secondary = options_->secondary_cache;
+    options_->block_cache->RegistCleanHandle(
+        [secondary](const uint64_t& key, DataBlock* block) {
+          // 淘汰的block放进第二层；指向mmap的block在sst关闭之后不能再访问，
+          // 而且mmap读取本来就不慢，直接丢弃
+          if (secondary != nullptr && block->owns_data()) {
+            secondary->Insert(key, block->contents());
+          }
+          delete block;
+        });
+  }
+  index_handle_ = footer.GetIndexBlockMetaData();
   ReadMeta(&footer);
+  if (PinTopLevel(options_) && options_->lazy_load_index_and_filter) {
+    // 第一次访问的时候再读取，打开大量sst的时候只需要读footer和meta block
+    index_loaded_.store(false, std::memory_order_relaxed);
+  } else if (PinTopLevel(options_)) {
+    std::string index_meta_data;
+    status = ReadBlock(index_handle_, index_meta_data);
+    if (status != Status::kSuccess) {
+      return status;
+    }
+    // index block常驻内存，由DataBlock自己持有数据
+    index_block_ = std::make_unique<DataBlock>(std::move(index_meta_data));
+  }
   return status;
 }
 
-DBStatus Table::ReadBlock(const OffSetSize& offset_size, std::string& buf) {
-  buf.resize(offset_size.length + kBlockTrailerSize);
-  file_reader_->Read(offset_size.offset, offset_size.length + kBlockTrailerSize,
-                     &buf);
-  const char* data = buf.data();
+// 校验block的crc，data指向block数据，后面紧跟着trailer
+static DBStatus CheckBlock(const OffSetSize& offset_size, const char* data) {
   const uint32_t crc =
       crc32::Unmask(DecodeFixed32(data + offset_size.length + 1));
   const uint32_t actual = crc32::Value(data, offset_size.length + 1);
-
   if (crc != actual) {
     LOG(corekv::LogLevel::ERROR, "Invalid Block");
     return Status::kInvalidObject;
   }
-  switch (data[offset_size.length]) {
-    case kSnappyCompression:
-      LOG(corekv::LogLevel::ERROR, "kSnappyCompression");
-      break;
-    default:
-      LOG(corekv::LogLevel::ERROR, "kNonCompress");
-      break;
+  return Status::kSuccess;
+}
+
+DBStatus Table::UncompressContents(uint8_t type, const std::string_view& data,
+                                   std::string* contents) const {
+  const bool use_dict = (type & kDictCompressedFlag) != 0;
+  if (use_dict && compression_dict_ == nullptr) {
+    return Status::kCorruption;
+  }
+  return UncompressBlock(
+      static_cast<BlockCompressType>(type & ~kDictCompressedFlag),
+      use_dict ? compression_dict_.get() : nullptr, data, contents);
+}
+
+DBStatus Table::DecodeBlock(const OffSetSize& offset_size,
+                            const std::string_view& data, std::string* scratch,
+                            std::string_view* contents) const {
+  DBStatus status;
+  {
+    PerfTimer timer(&PerfContext::block_checksum_time);
+    status = CheckBlock(offset_size, data.data());
+  }
+  if (status != Status::kSuccess) {
+    return status;
+  }
+  const uint8_t type = static_cast<uint8_t>(data[offset_size.length]);
+  if (type != kNonCompress) {
+    std::string uncompressed;
+    PerfTimer timer(&PerfContext::block_decompress_time);
+    status = UncompressContents(
+        type, std::string_view(data.data(), offset_size.length), &uncompressed);
+    timer.Stop();
+    if (status != Status::kSuccess) {
+      return status;
+    }
+    scratch->swap(uncompressed);
+  } else if (data.data() == scratch->data()) {
+    // 去掉trailer，只保留block数据
+    scratch->resize(offset_size.length);
+  } else if (file_reader_->IsMmap()) {
+    // 直接使用映射的内存，不需要拷贝
+    *contents = data.substr(0, offset_size.length);
+    return Status::kSuccess;
+  } else {
+    scratch->assign(data.data(), offset_size.length);
+  }
+  *contents = *scratch;
+  return Status::kSuccess;
+}
+
+DBStatus Table::ReadBlockContents(const OffSetSize& offset_size,
+                                  std::string* scratch,
+                                  std::string_view* contents,
+                                  FilePrefetchBuffer* prefetch) const {
+  std::string_view data;
+  const size_t n = offset_size.length + kBlockTrailerSize;
+  if (prefetch == nullptr || !prefetch->TryRead(offset_size.offset, n, &data)) {
+    PerfTimer timer(&PerfContext::block_read_time);
+    DBStatus status =
+        file_reader_->Read(offset_size.offset, n, &data, scratch);
+    timer.Stop();
+    PerfCounterAdd(&PerfContext::block_read_count);
+    PerfCounterAdd(&PerfContext::block_read_byte, n);
+    if (status != Status::kSuccess) {
+      return status;
+    }
+  }
+  if (data.size() != offset_size.length + kBlockTrailerSize) {
+    return Status::kBadBlock;
+  }
+  return DecodeBlock(offset_size, data, scratch, contents);
+}
+
+DataBlock* Table::NewDataBlock(std::string* scratch,
+                               const std::string_view& contents,
+                               PageSlabAlloc* alloc) const {
+  if (contents.data() != scratch->data()) {
+    // 指向mmap的内存，sst关闭之前一直有效
+    return new DataBlock(contents);
+  }
+  if (alloc != nullptr) {
+    // 缓存命中的时候读到的是分片所在NUMA节点的大页，alloc放不下的时候还是用scratch
+    char* data = static_cast<char*>(alloc->Allocate(contents.size()));
+    if (data != nullptr) {
+      memcpy(data, contents.data(), contents.size());
+      return new DataBlock(std::string_view(data, contents.size()), alloc);
+    }
+  }
+  return new DataBlock(std::move(*scratch));
+}
+
+DBStatus Table::ReadBlock(const OffSetSize& offset_size,
+                          std::string& buf) const {
+  std::string_view contents;
+  DBStatus status = ReadBlockContents(offset_size, &buf, &contents);
+  if (status != Status::kSuccess) {
+    return status;
+  }
+  if (contents.data() != buf.data()) {
+    buf.assign(contents.data(), contents.size());
   }
   return Status::kSuccess;
 }
 void Table::ReadMeta(const Footer* footer) {
+  // 没有写过meta block，位置为空
+  if (footer->GetFilterBlockMetaData().length == 0) {
+    return;
+  }
+  std::string meta_data;
+  if (ReadBlock(footer->GetFilterBlockMetaData(), meta_data) !=
+      Status::kSuccess) {
+    return;
+  }
+  std::unique_ptr<DataBlock> meta =
+      std::make_unique<DataBlock>(std::move(meta_data));
+  std::unique_ptr<Iterator> iter(
+      meta->NewIterator(std::make_shared<ByteComparator>()));
+  iter->Seek(kPartitionedIndexMetaKey);
+  partitioned_index_ = iter->Valid() && iter->key() == kPartitionedIndexMetaKey;
+  iter->Seek(kCompressionDictMetaKey);
+  if (iter->Valid() && iter->key() == kCompressionDictMetaKey) {
+    OffSetSize dict_handle;
+    std::string dict;
+    OffsetBuilder offset_builder;
+    offset_builder.Decode(iter->value().data(), dict_handle);
+    // 字典读取失败的时候用字典压缩的block都会返回kCorruption
+    if (ReadBlock(dict_handle, dict) == Status::kSuccess) {
+      compression_dict_ = std::make_unique<CompressionDict>(
+          std::move(dict), options_->compression_opts.level);
+    }
+  }
+  iter->Seek(kRangeDelMetaKey);
+  if (iter->Valid() && iter->key() == kRangeDelMetaKey) {
+    ReadRangeTombstones(iter->value());
+  }
+  iter->Seek(kPropertiesMetaKey);
+  if (iter->Valid() && iter->key() == kPropertiesMetaKey) {
+    ReadProperties(iter->value());
+  }
   if (options_->filter_policy == nullptr) {
     return;
   }
-  std::string filter_meta_data;
-  ReadBlock(footer->GetFilterBlockMetaData(), filter_meta_data);
-  std::string_view real_data(filter_meta_data.data(),
-                             footer->GetFilterBlockMetaData().length);
-  std::unique_ptr<DataBlock> meta = std::make_unique<DataBlock>(real_data);
-  Iterator* iter = meta->NewIterator(std::make_shared<ByteComparator>());
-  std::string_view key = options_->filter_policy->Name();
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == key) {
-    LOG(corekv::LogLevel::ERROR, "Hit Key=%s",key.data());
-    ReadFilter(iter->value());
+  const std::string name = options_->filter_policy->Name();
+  const std::pair<std::string, FilterType> filter_keys[] = {
+      {name, kFullFilter},
+      {kPartitionedFilterMetaPrefix + name, kPartitionedFilter},
+      {kPerBlockFilterMetaPrefix + name, kPerBlockFilter}};
+  bool found = false;
+  for (const auto& [key, type] : filter_keys) {
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == key) {
+      filter_type_ = type;
+      found = true;
+      break;
+    }
+  }
+  if (!found) {
+    return;
+  }
+  OffsetBuilder offset_builder;
+  offset_builder.Decode(iter->value().data(), filter_handle_);
+  if (!PinTopLevel(options_)) {
+    return;
+  }
+  if (options_->lazy_load_index_and_filter) {
+    filter_loaded_.store(false, std::memory_order_relaxed);
+    return;
+  }
+  std::string filter_data;
+  if (ReadBlock(filter_handle_, filter_data) != Status::kSuccess) {
+    // filter读取失败的时候不使用filter
+    filter_handle_ = OffSetSize();
+    return;
   }
-  delete iter;
+  filter_block_ = std::make_unique<DataBlock>(std::move(filter_data));
 }
-void Table::ReadFilter(const std::string_view& filter_handle_value) {
-  OffSetSize offset_size;
+
+void Table::ReadRangeTombstones(const std::string_view& handle_value) {
+  OffSetSize handle;
+  std::string data;
   OffsetBuilder offset_builder;
-  offset_builder.Decode(filter_handle_value.data(), offset_size);
-  ReadBlock(offset_size, bf_);
-  bf_.resize(offset_size.length);
+  if (offset_builder.Decode(handle_value.data(), handle) != Status::kSuccess ||
+      ReadBlock(handle, data) != Status::kSuccess) {
+    // 读取失败的时候tombstone删除的数据会重新出现，记录下来方便排查
+    LOG(corekv::LogLevel::ERROR, "read range tombstone block failed");
+    return;
+  }
+  DataBlock block(std::move(data));
+  std::unique_ptr<Iterator> iter(
+      block.NewIterator(std::make_shared<ByteComparator>()));
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    RangeTombstone tombstone;
+    if (RangeTombstone::Decode(iter->key(), iter->value(), &tombstone)) {
+      range_tombstones_.push_back(std::move(tombstone));
+    }
+  }
 }
-static void DeleteCachedBlock(const uint64_t& key, void* value) {
-  DataBlock* block = reinterpret_cast<DataBlock*>(value);
-  delete block;
+
+void Table::ReadProperties(const std::string_view& handle_value) {
+  OffSetSize handle;
+  std::string data;
+  OffsetBuilder offset_builder;
+  if (offset_builder.Decode(handle_value.data(), handle) != Status::kSuccess ||
+      ReadBlock(handle, data) != Status::kSuccess) {
+    // 属性只用于统计和估算，读取失败的时候当作没有
+    LOG(corekv::LogLevel::WARN, "read properties block failed");
+    return;
+  }
+  DataBlock block(std::move(data));
+  std::unique_ptr<Iterator> iter(
+      block.NewIterator(std::make_shared<ByteComparator>()));
+  auto properties = std::make_shared<TableProperties>();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (!properties->DecodeEntry(iter->key(), iter->value())) {
+      LOG(corekv::LogLevel::WARN, "corrupted table property");
+      return;
+    }
+  }
+  properties_ = std::move(properties);
 }
+
 static void DeleteBlock(void* arg, void*) {
   delete reinterpret_cast<DataBlock*>(arg);
 }
 
 static void ReleaseBlock(void* arg, void* h) {
-  CacheNode<uint64_t, DataBlock>* node = reinterpret_cast<CacheNode<uint64_t, DataBlock>*>(arg);
-  Cache<uint64_t, DataBlock>* cache = reinterpret_cast<Cache<uint64_t, DataBlock>*>(arg);
+  Cache<uint64_t, DataBlock>* cache =
+      reinterpret_cast<Cache<uint64_t, DataBlock>*>(arg);
+  CacheNode<uint64_t, DataBlock>* node =
+      reinterpret_cast<CacheNode<uint64_t, DataBlock>*>(h);
   cache->Release(node);
 }
 
-Iterator* Table::BlockReader(const ReadOptions& options,
-                             const std::string_view& index_value) {
-  auto* block_cache = options_->block_cache;
+// 从缓存或者文件中读到的block，析构的时候释放缓存的引用或者block本身
+struct BlockHolder {
+  BlockHolder() = default;
+  BlockHolder(const BlockHolder&) = delete;
+  BlockHolder& operator=(const BlockHolder&) = delete;
+  ~BlockHolder() {
+    if (cache_handle != nullptr) {
+      cache->Release(cache_handle);
+    } else if (owned) {
+      delete block;
+    }
+  }
+  // 把block的生命周期交给迭代器，迭代器析构的时候释放
+  void TransferTo(Iterator* iter) {
+    if (cache_handle != nullptr) {
+      iter->RegisterCleanup(&ReleaseBlock, cache, cache_handle);
+    } else if (owned) {
+      iter->RegisterCleanup(&DeleteBlock, block, nullptr);
+    }
+    cache_handle = nullptr;
+    owned = false;
+  }
+
   DataBlock* block = nullptr;
+  Cache<uint64_t, DataBlock>* cache = nullptr;
   CacheNode<uint64_t, DataBlock>* cache_handle = nullptr;
-  OffSetSize offset_size;
-  OffsetBuilder offset_builder;
-  offset_builder.Decode(index_value.data(), offset_size);
-  DBStatus s;
-  std::string contents;
+  // 没有使用缓存的时候block由holder自己释放
+  bool owned = false;
+};
+
+void Table::RecordCacheLookup(BlockType type, bool hit) const {
+  PerfCounterAdd(hit ? &PerfContext::block_cache_hit_count
+                     : &PerfContext::block_cache_miss_count);
+  static constexpr Tickers kHitTickers[] = {
+      kBlockCacheDataHit, kBlockCacheIndexHit, kBlockCacheFilterHit};
+  static constexpr Tickers kMissTickers[] = {
+      kBlockCacheDataMiss, kBlockCacheIndexMiss, kBlockCacheFilterMiss};
+  RecordTick(options_->statistics.get(),
+             hit ? kHitTickers[type] : kMissTickers[type]);
+}
+
+void Table::RecordFilterResult(bool may_match) const {
+  PerfCounterAdd(may_match ? &PerfContext::bloom_sst_hit_count
+                           : &PerfContext::bloom_sst_miss_count);
+  RecordTick(options_->statistics.get(),
+             may_match ? kBloomFilterPositive : kBloomFilterUseful);
+}
+
+DBStatus Table::ReadCachedBlock(const OffSetSize& offset_size, BlockType type,
+                                BlockHolder* holder,
+                                FilePrefetchBuffer* prefetch,
+                                bool cache_only) const {
+  auto* block_cache = options_->block_cache;
+  uint64_t cache_id = 0;
   if (block_cache != nullptr) {
-    uint64_t cache_id = table_id_ * 10 + offset_size.offset;
-    cache_handle = block_cache->Get(cache_id);
-    if (cache_handle != nullptr) {
-      block = cache_handle->value;
-    } else {
-      s = ReadBlock(offset_size, contents);
-      if (s == Status::kSuccess) {
-        block = new DataBlock(contents);
-        {
-          block_cache->RegistCleanHandle(DeleteCachedBlock);
-          block_cache->Insert(cache_id, block);
-        }
+    cache_id = BlockCacheKey(offset_size.offset);
+    {
+      PerfTimer timer(&PerfContext::block_cache_lookup_time);
+      holder->cache_handle = block_cache->Get(cache_id);
+    }
+    RecordCacheLookup(type, holder->cache_handle != nullptr);
+    if (holder->cache_handle != nullptr) {
+      holder->cache = block_cache;
+      holder->block = holder->cache_handle->value;
+      if (prefetch != nullptr) {
+        prefetch->UpdateReadPattern(offset_size.offset,
+                                    offset_size.length + kBlockTrailerSize);
       }
+      return Status::kSuccess;
+    }
+    if (PromoteFromSecondaryCache(cache_id, holder)) {
+      return Status::kSuccess;
     }
+  }
+  if (cache_only) {
+    return Status::kIncomplete;
+  }
+  std::string scratch;
+  std::string_view contents;
+  DBStatus s = ReadBlockContents(offset_size, &scratch, &contents, prefetch);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  holder->block = NewDataBlock(
+      &scratch, contents,
+      block_cache != nullptr ? block_cache->ShardAllocator(cache_id) : nullptr);
+  if (block_cache != nullptr) {
+    // block直接交给缓存，holder持有缓存节点的引用，不再单独释放block
+    holder->cache = block_cache;
+    holder->cache_handle = block_cache->InsertAndRef(
+        cache_id, holder->block, holder->block->contents().size());
   } else {
-    s = ReadBlock(offset_size, contents);
-    if (s == Status::kSuccess) {
-      block = new DataBlock(contents);
+    holder->owned = true;
+  }
+  return Status::kSuccess;
+}
+
+bool Table::PromoteFromSecondaryCache(uint64_t cache_id,
+                                      BlockHolder* holder) const {
+  CompressedSecondaryCache* secondary = options_->secondary_cache;
+  if (secondary == nullptr) {
+    return false;
+  }
+  std::string contents;
+  const bool hit = secondary->Lookup(cache_id, &contents);
+  RecordTick(options_->statistics.get(),
+             hit ? kSecondaryCacheHit : kSecondaryCacheMiss);
+  if (!hit) {
+    return false;
+  }
+  const std::string_view view(contents);
+  holder->block = NewDataBlock(
+      &contents, view, options_->block_cache->ShardAllocator(cache_id));
+  holder->cache = options_->block_cache;
+  holder->cache_handle = options_->block_cache->InsertAndRef(
+      cache_id, holder->block, holder->block->contents().size());
+  return true;
+}
+
+// MultiGet合并读的时候，单次读取的上限
+static constexpr uint64_t kMaxCoalescedReadBytes = 1024 * 1024;
+
+DBStatus Table::ReadBlocks(const std::vector<OffSetSize>& handles,
+                           bool async_io, bool cache_only,
+                           std::vector<BlockHolder>* holders) const {
+  auto* block_cache = options_->block_cache;
+  const size_t n = handles.size();
+  if (block_cache != nullptr) {
+    PerfTimer timer(&PerfContext::block_cache_lookup_time);
+    for (size_t i = 0; i < n; ++i) {
+      BlockHolder& holder = (*holders)[i];
+      const uint64_t cache_id = BlockCacheKey(handles[i].offset);
+      holder.cache_handle = block_cache->Get(cache_id);
+      RecordCacheLookup(kDataBlock, holder.cache_handle != nullptr);
+      if (holder.cache_handle != nullptr) {
+        holder.cache = block_cache;
+        holder.block = holder.cache_handle->value;
+      } else {
+        PromoteFromSecondaryCache(cache_id, &holder);
+      }
+    }
+  }
+  if (cache_only &&
+      std::any_of(holders->begin(), holders->end(),
+                  [](const BlockHolder& h) { return h.block == nullptr; })) {
+    return Status::kIncomplete;
+  }
+  // 没有命中缓存并且在文件中首尾相连的block合并成一个请求，
+  // runs[k]是第k个请求覆盖的[第一个block, 最后一个block + 1)
+  std::vector<ReadRequest> reqs;
+  std::vector<std::pair<size_t, size_t>> runs;
+  for (size_t i = 0; i < n;) {
+    if ((*holders)[i].block != nullptr) {
+      ++i;
+      continue;
+    }
+    const uint64_t start = handles[i].offset;
+    uint64_t end = start + handles[i].length + kBlockTrailerSize;
+    size_t j = i + 1;
+    while (j < n && (*holders)[j].block == nullptr && handles[j].offset == end &&
+           end - start < kMaxCoalescedReadBytes) {
+      end += handles[j].length + kBlockTrailerSize;
+      ++j;
+    }
+    reqs.emplace_back();
+    reqs.back().offset = start;
+    reqs.back().len = end - start;
+    runs.emplace_back(i, j);
+    i = j;
+  }
+  PerfTimer read_timer(&PerfContext::block_read_time);
+  DBStatus s = file_reader_->MultiRead(reqs.data(), reqs.size(), async_io);
+  read_timer.Stop();
+  PerfCounterAdd(&PerfContext::block_read_count, reqs.size());
+  for (const auto& req : reqs) {
+    PerfCounterAdd(&PerfContext::block_read_byte, req.len);
+  }
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  for (size_t k = 0; k < reqs.size(); ++k) {
+    ReadRequest& req = reqs[k];
+    if (req.status != Status::kSuccess) {
+      return req.status;
+    }
+    if (req.result.size() != req.len) {
+      return Status::kBadBlock;
+    }
+    const bool single = runs[k].second - runs[k].first == 1;
+    for (size_t i = runs[k].first; i < runs[k].second; ++i) {
+      // 只有一个block的时候直接复用请求的scratch，不需要再拷贝一次
+      std::string local;
+      std::string* scratch = single ? &req.scratch : &local;
+      std::string_view contents;
+      s = DecodeBlock(handles[i],
+                      req.result.substr(handles[i].offset - req.offset,
+                                        handles[i].length + kBlockTrailerSize),
+                      scratch, &contents);
+      if (s != Status::kSuccess) {
+        return s;
+      }
+      BlockHolder& holder = (*holders)[i];
+      const uint64_t cache_id = BlockCacheKey(handles[i].offset);
+      holder.block = NewDataBlock(
+          scratch, contents,
+          block_cache != nullptr ? block_cache->ShardAllocator(cache_id)
+                                 : nullptr);
+      if (block_cache != nullptr) {
+        holder.cache = block_cache;
+        holder.cache_handle = block_cache->InsertAndRef(
+            cache_id, holder.block,
+            holder.block->contents().size());
+      } else {
+        holder.owned = true;
+      }
     }
   }
+  return Status::kSuccess;
+}
 
-  Iterator* iter;
-  if (block != nullptr) {
-    iter = block->NewIterator(options_->comparator);
-    if (cache_handle == nullptr) {
-      iter->RegisterCleanup(&DeleteBlock, block, nullptr);
-    } else {
-      iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+DBStatus Table::ReadTopLevelBlock(const OffSetSize& offset_size,
+                                  const DataBlock* pinned, BlockType type,
+                                  BlockHolder* holder, bool cache_only) const {
+  if (pinned != nullptr) {
+    holder->block = const_cast<DataBlock*>(pinned);
+    return Status::kSuccess;
+  }
+  return ReadCachedBlock(offset_size, type, holder, nullptr, cache_only);
+}
+
+const DataBlock* Table::PinnedBlock(const OffSetSize& offset_size,
+                                    std::unique_ptr<DataBlock>* block,
+                                    std::atomic<bool>* loaded,
+                                    bool cache_only) const {
+  if (loaded->load(std::memory_order_acquire)) {
+    return block->get();
+  }
+  if (cache_only) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> guard(pin_mutex_);
+  if (!loaded->load(std::memory_order_relaxed)) {
+    std::string data;
+    if (ReadBlock(offset_size, data) != Status::kSuccess) {
+      return nullptr;
     }
-  } else {
-    iter = NewErrorIterator(s);
+    *block = std::make_unique<DataBlock>(std::move(data));
+    loaded->store(true, std::memory_order_release);
   }
+  return block->get();
+}
+
+Iterator* Table::NewBlockIterator(const std::string_view& index_value,
+                                  BlockType type, FilePrefetchBuffer* prefetch,
+                                  bool cache_only) const {
+  OffSetSize offset_size;
+  OffsetBuilder offset_builder;
+  offset_builder.Decode(index_value.data(), offset_size);
+  BlockHolder holder;
+  DBStatus s =
+      ReadCachedBlock(offset_size, type, &holder, prefetch, cache_only);
+  if (s != Status::kSuccess) {
+    return NewErrorIterator(s);
+  }
+  Iterator* iter = holder.block->NewIterator(options_->comparator);
+  holder.TransferTo(iter);
   return iter;
 }
-}  // namespace corekv
\ No newline at end of file
+
+Iterator* Table::BlockReader(const ReadOptions& options,
+                             const std::string_view& index_value,
+                             FilePrefetchBuffer* prefetch) const {
+  return NewBlockIterator(index_value, kDataBlock, prefetch,
+                          options.cache_only);
+}
+
+Iterator* Table::IndexPartitionReader(
+    const ReadOptions& options, const std::string_view& index_value) const {
+  return NewBlockIterator(index_value, kIndexBlock, nullptr,
+                          options.cache_only);
+}
+
+// data block和index分区都是通过index value找到对应的block
+static Iterator* TableBlockReader(void* arg, const ReadOptions& options,
+                                  const std::string_view& index_value) {
+  return reinterpret_cast<const Table*>(arg)->BlockReader(options,
+                                                          index_value);
+}
+
+static Iterator* TableIndexPartitionReader(
+    void* arg, const ReadOptions& options,
+    const std::string_view& index_value) {
+  return reinterpret_cast<const Table*>(arg)->IndexPartitionReader(
+      options, index_value);
+}
+
+void Table::PrefetchNextBlock(const std::string_view& index_value) const {
+  if (index_value.size() < 2 * sizeof(uint64_t)) {
+    return;
+  }
+  OffSetSize offset_size;
+  OffsetBuilder offset_builder;
+  offset_builder.Decode(index_value.data(), offset_size);
+  const uint64_t block_size = offset_size.length + kBlockTrailerSize;
+  file_reader_->Prefetch(offset_size.offset + block_size, block_size);
+}
+
+static void TablePrefetchNextBlock(void* arg,
+                                   const std::string_view& index_value) {
+  reinterpret_cast<const Table*>(arg)->PrefetchNextBlock(index_value);
+}
+
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  BlockHolder holder;
+  DBStatus s = ReadTopLevelBlock(
+      index_handle_,
+      PinnedBlock(index_handle_, &index_block_, &index_loaded_,
+                  options.cache_only),
+      kIndexBlock, &holder, options.cache_only);
+  if (s != Status::kSuccess) {
+    return NewErrorIterator(s);
+  }
+  Iterator* iter = holder.block->NewIterator(options_->comparator);
+  holder.TransferTo(iter);
+  if (partitioned_index_) {
+    // 顶层index的value是index分区的位置
+    iter = NewTwoLevelIterator(iter, &TableIndexPartitionReader,
+                               const_cast<Table*>(this), options);
+  }
+  return iter;
+}
+
+namespace {
+// 每个迭代器自己的预读缓冲区，迭代器析构的时候释放
+struct ReadaheadState {
+  ReadaheadState(const Table* t, const FileReader* file_reader,
+                 const Options* options, bool for_compaction)
+      : table(t),
+        prefetch(file_reader,
+                 for_compaction ? options->max_auto_readahead_size
+                                : options->initial_auto_readahead_size,
+                 options->max_auto_readahead_size, for_compaction) {}
+  const Table* table;
+  FilePrefetchBuffer prefetch;
+};
+
+Iterator* ReadaheadBlockReader(void* arg, const ReadOptions& options,
+                               const std::string_view& index_value) {
+  auto* state = reinterpret_cast<ReadaheadState*>(arg);
+  return state->table->BlockReader(options, index_value, &state->prefetch);
+}
+
+void DeleteReadaheadState(void* arg1, void*) {
+  delete reinterpret_cast<ReadaheadState*>(arg1);
+}
+}  // namespace
+
+Iterator* Table::NewIterator(const ReadOptions& options) const {
+  if (index_handle_.length == 0) {
+    return NewErrorIterator(Status::kInvalidObject);
+  }
+  // mmap的时候读取没有系统调用，仍然只用madvise提示预读下一个block
+  if (file_reader_->IsMmap() || options_->max_auto_readahead_size == 0) {
+    return NewTwoLevelIterator(NewIndexIterator(options), &TableBlockReader,
+                               const_cast<Table*>(this), options,
+                               &TablePrefetchNextBlock);
+  }
+  auto* state =
+      new ReadaheadState(this, file_reader_, options_, options.for_compaction);
+  Iterator* iter = NewTwoLevelIterator(NewIndexIterator(options),
+                                       &ReadaheadBlockReader, state, options);
+  iter->RegisterCleanup(&DeleteReadaheadState, state, nullptr);
+  return iter;
+}
+
+void Table::GetIndexKeys(std::vector<std::string>* keys,
+                         std::vector<uint64_t>* block_sizes) const {
+  if (index_handle_.length == 0) {
+    return;
+  }
+  std::unique_ptr<Iterator> iter(NewIndexIterator(ReadOptions()));
+  OffsetBuilder offset_builder;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    keys->emplace_back(iter->key());
+    if (block_sizes != nullptr) {
+      OffSetSize handle;
+      offset_builder.Decode(iter->value().data(), handle);
+      block_sizes->push_back(handle.length + kBlockTrailerSize);
+    }
+  }
+}
+
+DBStatus Table::LoadBlocks(const std::vector<uint64_t>& offsets) const {
+  if (options_->block_cache == nullptr || index_handle_.length == 0) {
+    return Status::kSuccess;
+  }
+  std::unique_ptr<Iterator> iter(NewIndexIterator(ReadOptions()));
+  OffSetSize handle;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    DBStatus s = OffsetBuilder().Decode(iter->value().data(), handle);
+    if (s != Status::kSuccess) {
+      return s;
+    }
+    if (!std::binary_search(offsets.begin(), offsets.end(),
+                            handle.offset & 0xffffffffu)) {
+      continue;
+    }
+    BlockHolder holder;
+    s = ReadCachedBlock(handle, kDataBlock, &holder);
+    if (s != Status::kSuccess) {
+      return s;
+    }
+  }
+  return iter->status();
+}
+
+uint64_t Table::ApproximateOffsetOf(const std::string_view& key) const {
+  // data block之后依次是meta block和index，没有properties的旧文件用index的位置近似
+  const uint64_t data_end =
+      properties_ ? properties_->data_size : index_handle_.offset;
+  if (index_handle_.length == 0) {
+    return data_end;
+  }
+  std::unique_ptr<Iterator> iter(NewIndexIterator(ReadOptions()));
+  iter->Seek(key);
+  OffSetSize handle;
+  if (iter->Valid() &&
+      OffsetBuilder().Decode(iter->value().data(), handle) ==
+          Status::kSuccess) {
+    return handle.offset;
+  }
+  return data_end;
+}
+
+bool Table::KeyMayMatch(const std::string_view& key, bool cache_only) const {
+  if (options_->filter_policy == nullptr || filter_handle_.length == 0) {
+    return true;
+  }
+  BlockHolder holder;
+  if (ReadTopLevelBlock(filter_handle_,
+                        PinnedBlock(filter_handle_, &filter_block_,
+                                    &filter_loaded_, cache_only),
+                        kFilterBlock, &holder, cache_only) != Status::kSuccess) {
+    return true;
+  }
+  if (filter_type_ == kPerBlockFilter) {
+    return true;
+  }
+  if (filter_type_ == kFullFilter) {
+    const std::string_view& filter = holder.block->contents();
+    if (filter.empty()) {
+      return true;
+    }
+    const bool may_match = options_->filter_policy->MayMatch(key, filter);
+    RecordFilterResult(may_match);
+    return may_match;
+  }
+  // 先在顶层filter index中找到key所在的分区，再读取这个分区的filter
+  std::unique_ptr<Iterator> iter(
+      holder.block->NewIterator(options_->comparator));
+  iter->Seek(key);
+  if (!iter->Valid()) {
+    // 比sst中所有的key都大
+    return iter->status() != Status::kSuccess;
+  }
+  OffSetSize partition;
+  OffsetBuilder offset_builder;
+  offset_builder.Decode(iter->value().data(), partition);
+  BlockHolder partition_holder;
+  if (ReadCachedBlock(partition, kFilterBlock, &partition_holder, nullptr,
+                      cache_only) != Status::kSuccess) {
+    return true;
+  }
+  const bool may_match = options_->filter_policy->MayMatch(
+      key, partition_holder.block->contents());
+  RecordFilterResult(may_match);
+  return may_match;
+}
+
+bool Table::BlockMayMatch(uint64_t block_offset, const std::string_view& key,
+                          bool cache_only) const {
+  if (options_->filter_policy == nullptr || filter_handle_.length == 0 ||
+      filter_type_ != kPerBlockFilter) {
+    return true;
+  }
+  BlockHolder holder;
+  if (ReadTopLevelBlock(filter_handle_,
+                        PinnedBlock(filter_handle_, &filter_block_,
+                                    &filter_loaded_, cache_only),
+                        kFilterBlock, &holder, cache_only) != Status::kSuccess) {
+    return true;
+  }
+  PerBlockFilterReader reader(options_->filter_policy.get(),
+                              holder.block->contents());
+  const bool may_match = reader.KeyMayMatch(block_offset, key);
+  RecordFilterResult(may_match);
+  return may_match;
+}
+
+bool Table::FilterMayMatch(const ReadOptions& options,
+                           const std::string_view& key) const {
+  if (!KeyMayMatch(key, options.cache_only)) {
+    return false;
+  }
+  if (options_->filter_policy == nullptr || filter_type_ != kPerBlockFilter) {
+    return true;
+  }
+  std::unique_ptr<Iterator> index_iter(NewIndexIterator(options));
+  index_iter->Seek(key);
+  if (!index_iter->Valid()) {
+    return index_iter->status() != Status::kSuccess;
+  }
+  OffSetSize block_handle;
+  OffsetBuilder offset_builder;
+  offset_builder.Decode(index_iter->value().data(), block_handle);
+  return BlockMayMatch(block_handle.offset, key, options.cache_only);
+}
+
+DBStatus Table::InternalGet(const ReadOptions& options,
+                            const std::string_view& key, void* arg,
+                            void (*handle_result)(void*,
+                                                  const std::string_view&,
+                                                  const std::string_view&)) {
+  if (index_handle_.length == 0) {
+    return Status::kInvalidObject;
+  }
+  // 布隆过滤器判断不存在的话，就不需要再读取data block
+  PerfTimer filter_timer(&PerfContext::filter_check_time);
+  if (!KeyMayMatch(key, options.cache_only)) {
+    return Status::kSuccess;
+  }
+  filter_timer.Stop();
+  DBStatus s = Status::kSuccess;
+  PerfTimer index_timer(&PerfContext::index_seek_time);
+  std::unique_ptr<Iterator> index_iter(NewIndexIterator(options));
+  index_iter->Seek(key);
+  index_timer.Stop();
+  OffSetSize block_handle;
+  OffsetBuilder offset_builder;
+  bool may_match = false;
+  if (index_iter->Valid()) {
+    offset_builder.Decode(index_iter->value().data(), block_handle);
+    PerfTimer timer(&PerfContext::filter_check_time);
+    may_match = BlockMayMatch(block_handle.offset, key, options.cache_only);
+  }
+  if (may_match) {
+    std::unique_ptr<Iterator> block_iter(
+        BlockReader(options, index_iter->value()));
+    block_iter->SeekForGet(key);
+    if (block_iter->Valid()) {
+      (*handle_result)(arg, block_iter->key(), block_iter->value());
+    }
+    s = block_iter->status();
+  }
+  if (s == Status::kSuccess) {
+    s = index_iter->status();
+  }
+  return s;
+}
+
+DBStatus Table::MultiGet(const ReadOptions& options,
+                         const std::vector<std::string_view>& keys,
+                         const std::vector<void*>& args,
+                         void (*handle_result)(void*, const std::string_view&,
+                                               const std::string_view&)) {
+  if (index_handle_.length == 0) {
+    return Status::kInvalidObject;
+  }
+  std::vector<size_t> candidates;
+  candidates.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (KeyMayMatch(keys[i], options.cache_only)) {
+      candidates.push_back(i);
+    }
+  }
+  if (candidates.empty()) {
+    return Status::kSuccess;
+  }
+  // 按照key排序之后，同一个data block中的key是相邻的
+  Comparator* cmp = options_->comparator.get();
+  std::sort(candidates.begin(), candidates.end(), [&](size_t a, size_t b) {
+    return cmp->Compare(keys[a], keys[b]) < 0;
+  });
+  std::vector<OffSetSize> handles;
+  // block_keys[i]是落在handles[i]中的key
+  std::vector<std::vector<size_t>> block_keys;
+  std::unique_ptr<Iterator> index_iter(NewIndexIterator(options));
+  OffsetBuilder offset_builder;
+  for (const size_t idx : candidates) {
+    index_iter->Seek(keys[idx]);
+    if (!index_iter->Valid()) {
+      // 后面的key更大，都不在这个sst中
+      break;
+    }
+    OffSetSize handle;
+    offset_builder.Decode(index_iter->value().data(), handle);
+    if (!BlockMayMatch(handle.offset, keys[idx], options.cache_only)) {
+      continue;
+    }
+    if (handles.empty() || handles.back().offset != handle.offset) {
+      handles.push_back(handle);
+      block_keys.emplace_back();
+    }
+    block_keys.back().push_back(idx);
+  }
+  DBStatus s = index_iter->status();
+  if (s != Status::kSuccess || handles.empty()) {
+    return s;
+  }
+  std::vector<BlockHolder> holders(handles.size());
+  s = ReadBlocks(handles, options.async_io, options.cache_only, &holders);
+  if (s != Status::kSuccess) {
+    return s;
+  }
+  for (size_t i = 0; i < handles.size() && s == Status::kSuccess; ++i) {
+    std::unique_ptr<Iterator> block_iter(
+        holders[i].block->NewIterator(options_->comparator));
+    for (const size_t idx : block_keys[i]) {
+      block_iter->SeekForGet(keys[idx]);
+      if (block_iter->Valid()) {
+        (*handle_result)(args[idx], block_iter->key(), block_iter->value());
+      }
+    }
+    s = block_iter->status();
+  }
+  return s;
+}
+}  // namespace corekv
@@ -1,31 +1,181 @@
 #pragma once
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include "../db/iterator.h"
 #include "../db/options.h"
+#include "../db/range_del.h"
 #include "../file/file.h"
+#include "../file/prefetch_buffer.h"
 #include "block_builder.h"
+#include "compression.h"
 #include "footer.h"
 #include "offset_size.h"
+#include "table_properties.h"
 namespace corekv {
-
+struct BlockHolder;
+/*
+ * index和filter都可以是分区的:
+ *   顶层index的value是index分区的位置，index分区的value才是data block的位置
+ *   顶层filter index的key和顶层index相同，value是对应filter分区的位置
+ * 顶层的block默认常驻在Table中，分区通过block_cache按需读取
+ */
 class Table final {
  public:
   Table(const Options* options, const FileReader* file_reader);
   DBStatus Open(uint64_t file_size);
-  DBStatus ReadBlock(const OffSetSize&, std::string&);
+  // block在block_cache中的key: 高32位是table_id_，低32位是block在文件中的偏移
+  uint64_t BlockCacheKey(uint64_t offset) const {
+    return (table_id_ << 32) | (offset & 0xffffffffu);
+  }
+  uint64_t table_id() const { return table_id_; }
+  // 把偏移(BlockCacheKey中的低32位)在offsets中的data block读进block_cache，
+  // offsets需要从小到大排好序，不是data block起始位置的偏移直接忽略；
+  // 分区的index在遍历的时候也会被读进缓存
+  DBStatus LoadBlocks(const std::vector<uint64_t>& offsets) const;
+  // 读取一个block并校验crc，buf中只保留block本身的数据(去掉trailer)，压缩过的block会解压
+  DBStatus ReadBlock(const OffSetSize&, std::string&) const;
   void ReadMeta(const Footer* footer);
-  void ReadFilter(const std::string_view& filter_handle_value);
   Iterator* NewIterator(const ReadOptions&) const;
- Iterator* BlockReader(const ReadOptions&,
-                               const std::string_view&);
-  private:
+  // 打开index_value对应的block，data block和index分区都通过它读取
+  // prefetch不为空的时候没有命中缓存的block先尝试从预读缓冲区中读取
+  Iterator* BlockReader(const ReadOptions&, const std::string_view&,
+                        FilePrefetchBuffer* prefetch = nullptr) const;
+  // 和BlockReader相同，只是block cache的命中率按照index统计
+  Iterator* IndexPartitionReader(const ReadOptions&,
+                                 const std::string_view&) const;
+  // data block在文件中是连续存放的，按照当前block的大小预读紧跟在后面的block
+  void PrefetchNextBlock(const std::string_view& index_value) const;
+  // index block中每个data block的分隔key，可以用来把sst切分成大小接近的若干段
+  // block_sizes不为nullptr的时候同时追加每个data block在文件中占用的字节数
+  void GetIndexKeys(std::vector<std::string>* keys,
+                    std::vector<uint64_t>* block_sizes = nullptr) const;
+  // key所在的data block在文件中的偏移，key比所有数据都大的时候返回data block的末尾；
+  // 只读取index，不读取data block
+  uint64_t ApproximateOffsetOf(const std::string_view& key) const;
+  // 点查: 先用布隆过滤器过滤，再根据index定位到对应的data block，
+  // 找到第一个大于等于key的entry之后调用handle_result
+  DBStatus InternalGet(const ReadOptions&, const std::string_view& key,
+                       void* arg,
+                       void (*handle_result)(void* arg,
+                                             const std::string_view& k,
+                                             const std::string_view& v));
+  // 批量点查，keys[i]的结果通过handle_result(args[i], ...)返回
+  // 所有key先一起经过filter，剩下的key按照所在的data block分组，每个block只读取一次，
+  // 没有命中缓存并且在文件中首尾相连的block合并成一次读，
+  // ReadOptions::async_io为true时所有的读一起提交给io_uring
+  DBStatus MultiGet(const ReadOptions&, const std::vector<std::string_view>& keys,
+                    const std::vector<void*>& args,
+                    void (*handle_result)(void* arg, const std::string_view& k,
+                                          const std::string_view& v));
+  // 只查filter，返回false说明sst中一定没有key；按block分段的filter会用index找到
+  // 第一个不小于key的data block，再检查这个block的filter
+  bool FilterMayMatch(const ReadOptions&, const std::string_view& key) const;
+  // Open的时候从meta block中读出来的所有range tombstone
+  const std::vector<RangeTombstone>& range_tombstones() const {
+    return range_tombstones_;
+  }
+  // Open的时候从properties block中读出来的统计信息，没有写properties block的旧文件
+  // 或者读取失败的时候为nullptr
+  std::shared_ptr<const TableProperties> properties() const {
+    return properties_;
+  }
+
+ private:
+  // 解析meta block中kRangeDelMetaKey指向的block
+  void ReadRangeTombstones(const std::string_view& handle_value);
+  // 解析meta block中kPropertiesMetaKey指向的block
+  void ReadProperties(const std::string_view& handle_value);
+  // 只用于按类型统计block cache的命中率
+  enum BlockType { kDataBlock = 0, kIndexBlock, kFilterBlock };
+  // data是block数据加上trailer，校验crc之后按照下面的规则设置contents:
+  //   压缩过的block解压到scratch中；data就是scratch的时候去掉trailer；
+  //   mmap的时候直接指向映射的内存；否则拷贝到scratch中
+  DBStatus DecodeBlock(const OffSetSize& offset_size,
+                       const std::string_view& data, std::string* scratch,
+                       std::string_view* contents) const;
+  DBStatus ReadBlockContents(const OffSetSize& offset_size,
+                             std::string* scratch,
+                             std::string_view* contents,
+                             FilePrefetchBuffer* prefetch = nullptr) const;
+  // contents不指向scratch的时候说明是mmap的内存，block不需要持有数据；
+  // alloc是block cache分片的分配器，不为nullptr时把数据拷贝到alloc申请的内存中
+  DataBlock* NewDataBlock(std::string* scratch,
+                          const std::string_view& contents,
+                          PageSlabAlloc* alloc = nullptr) const;
+  // 按照trailer中的压缩类型解压，带有kDictCompressedFlag的时候使用sst的字典
+  DBStatus UncompressContents(uint8_t type, const std::string_view& data,
+                              std::string* contents) const;
+  // 读取handles对应的block，holders需要和handles一样大
+  // async_io为true时没有命中缓存的block一起通过io_uring提交，
+  // cache_only为true时有block没有命中缓存就返回kIncomplete
+  DBStatus ReadBlocks(const std::vector<OffSetSize>& handles, bool async_io,
+                      bool cache_only,
+                      std::vector<BlockHolder>* holders) const;
+  // 有block_cache的时候先查缓存，没有命中再读文件并放入缓存；
+  // cache_only为true时不读文件，没有命中的时候返回kIncomplete
+  DBStatus ReadCachedBlock(const OffSetSize& offset_size, BlockType type,
+                           BlockHolder* holder,
+                           FilePrefetchBuffer* prefetch = nullptr,
+                           bool cache_only = false) const;
+  // block_cache未命中之后在secondary_cache中查找，命中的时候放回block_cache，
+  // holder持有block_cache中的引用
+  bool PromoteFromSecondaryCache(uint64_t cache_id, BlockHolder* holder) const;
+  // 顶层block常驻内存的时候直接使用，否则通过ReadCachedBlock读取
+  DBStatus ReadTopLevelBlock(const OffSetSize& offset_size,
+                             const DataBlock* pinned, BlockType type,
+                             BlockHolder* holder,
+                             bool cache_only = false) const;
+  // 需要常驻的顶层block，lazy_load_index_and_filter的时候第一次访问才从文件读取；
+  // 不需要常驻、cache_only时还没有读取过或者读取失败的时候返回nullptr，
+  // 由ReadTopLevelBlock按照不常驻的方式读取，失败的读取在下次访问时重试
+  const DataBlock* PinnedBlock(const OffSetSize& offset_size,
+                               std::unique_ptr<DataBlock>* block,
+                               std::atomic<bool>* loaded,
+                               bool cache_only) const;
+  // 打开index_value对应的block并返回它的迭代器
+  Iterator* NewBlockIterator(const std::string_view& index_value,
+                             BlockType type, FilePrefetchBuffer* prefetch,
+                             bool cache_only) const;
+  // 把一次block cache的查找结果记录到statistics和当前线程的PerfContext中
+  void RecordCacheLookup(BlockType type, bool hit) const;
+  // 同上，记录一次布隆过滤器的判断结果
+  void RecordFilterResult(bool may_match) const;
+  // 遍历所有data block位置的迭代器，分区的时候是一个两层迭代器
+  Iterator* NewIndexIterator(const ReadOptions& options) const;
+  // 返回false说明key一定不在这个sst中，按block分段的filter在这里总是返回true
+  // cache_only为true时filter不在缓存中就当作可能存在
+  bool KeyMayMatch(const std::string_view& key, bool cache_only = false) const;
+  // 返回false说明key一定不在从block_offset开始的data block中
+  bool BlockMayMatch(uint64_t block_offset, const std::string_view& key,
+                     bool cache_only = false) const;
+
+ private:
   const Options* options_;
   const FileReader* file_reader_;
+  // 从block_cache中分配的id，作为这个sst中所有block在缓存中的key前缀
   uint64_t table_id_ = 0;
-  std::string bf_;
-  // index_block对象，用于两层迭代器使用
-  std::unique_ptr<DataBlock> index_block_;
-
+  OffSetSize index_handle_;
+  bool partitioned_index_ = false;
+  // index_block对象，用于两层迭代器使用，分区的时候是顶层index
+  mutable std::unique_ptr<DataBlock> index_block_;
+  // 没有filter的时候filter_handle_.length为0
+  OffSetSize filter_handle_;
+  enum FilterType { kFullFilter, kPartitionedFilter, kPerBlockFilter };
+  FilterType filter_type_ = kFullFilter;
+  // 整个sst的filter，分区的时候是顶层filter index，分段的时候是整个filter block
+  mutable std::unique_ptr<DataBlock> filter_block_;
+  // index_block_/filter_block_已经确定下来(读取完成或者不需要常驻)，之后不再修改
+  mutable std::atomic<bool> index_loaded_{true};
+  mutable std::atomic<bool> filter_loaded_{true};
+  // 延迟读取常驻block时保证同一个block只读一次
+  mutable std::mutex pin_mutex_;
+  // 用字典压缩的sst才有
+  std::unique_ptr<CompressionDict> compression_dict_;
+  std::vector<RangeTombstone> range_tombstones_;
+  std::shared_ptr<const TableProperties> properties_;
 };
 }  // namespace corekv
@@ -1,6 +1,16 @@
 #include "table_builder.h"
 
+#include <assert.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
 #include "../db/comparator.h"
+#include "../db/dbformat.h"
 #include "../logger/log.h"
 #include "../utils/codec.h"
 #include "../utils/crc32.h"
@@ -8,14 +18,88 @@
 #include "table_options.h"
 namespace corekv {
 using namespace util;
+// Flush把block同时放入compress_queue和write_queue，压缩线程从compress_queue中取block，
+// 写线程按照write_queue的顺序等待队首的block压缩完成之后写入文件
+struct TableBuilder::ParallelCompression {
+  struct Block {
+    std::string raw;
+    const CompressionDict* dict = nullptr;
+    std::string compressed;
+    // 指向raw或者compressed
+    std::string_view output;
+    char trailer[kBlockTrailerSize];
+    bool ready = false;
+  };
+  std::mutex mu;
+  // compress_queue不为空或者结束
+  std::condition_variable compress_cv;
+  // 队首的block压缩完成或者结束
+  std::condition_variable write_cv;
+  // 有block写入完成
+  std::condition_variable space_cv;
+  std::deque<Block*> compress_queue;
+  std::deque<std::unique_ptr<Block>> write_queue;
+  // 同时在流水线中的block数量上限，Add比写入快的时候不会无限占用内存
+  size_t max_inflight = 0;
+  // 流水线中block的原始大小，用来估算文件大小
+  std::atomic<uint64_t> inflight_bytes{0};
+  // 按照写入顺序保存每个data block的位置
+  std::vector<OffSetSize> handles;
+  // 第一个写入错误，之后的block不再写入
+  DBStatus status = Status::kSuccess;
+  bool shutdown = false;
+  std::vector<std::thread> threads;
+};
+
 TableBuilder::TableBuilder(const Options& options, FileWriter* file_handler)
     : options_(options),
       index_options_(options),
       data_block_builder_(&options_),
-      index_block_builder_(&index_options_),
+      index_block_builder_(&index_options_, options.index_block_key_prefix),
       filter_block_builder_(options_) {
   index_options_.block_restart_interval = 1;
+  // 只有data block需要hash索引
+  index_options_.data_block_hash_index = false;
+  if (!CompressionTypeSupported(options_.block_compress_type)) {
+    LOG(corekv::LogLevel::WARN, "Compression type %d not supported, disabled",
+        options_.block_compress_type);
+    options_.block_compress_type = kNonCompress;
+    index_options_.block_compress_type = kNonCompress;
+  }
+  props_.compression_type = options_.block_compress_type;
   file_handler_ = file_handler;
+  internal_comparator_ =
+      dynamic_cast<InternalKeyComparator*>(options_.comparator.get());
+  const bool partitioned = options_.partition_index && options_.partition_filters;
+  if (options_.filter_policy && options_.per_block_filter && !partitioned) {
+    per_block_filter_builder_ = std::make_unique<PerBlockFilterBuilder>(
+        options_.filter_policy.get());
+    per_block_filter_builder_->StartBlock(0);
+  }
+  // 分区和per_block_filter在Add的时候就需要知道block的位置，只能串行写入
+  const uint32_t threads = options_.compression_opts.parallel_threads;
+  if (threads > 1 && options_.block_compress_type != kNonCompress &&
+      !options_.partition_index && !per_block_filter_builder_) {
+    parallel_ = std::make_unique<ParallelCompression>();
+    parallel_->max_inflight = threads * 2;
+    for (uint32_t i = 0; i < threads; ++i) {
+      parallel_->threads.emplace_back([this]() { CompressThread(); });
+    }
+    parallel_->threads.emplace_back([this]() { WriteThread(); });
+  }
+}
+
+TableBuilder::~TableBuilder() {
+  if (parallel_) {
+    StopParallel();
+  }
+}
+
+uint32_t TableBuilder::GetFileSize() {
+  if (!parallel_) {
+    return block_offset_;
+  }
+  return block_offset_ + parallel_->inflight_bytes.load();
 }
 void TableBuilder::Add(const std::string_view& key,
                        const std::string_view& value) {
@@ -25,17 +109,29 @@ void TableBuilder::Add(const std::string_view& key,
   if (need_create_index_block_ && options_.comparator) {
     // index中key做了优化，尽可能短
     options_.comparator->FindShortest(pre_block_last_key_, key);
-    std::string output;
-    // index中的value保存的是当前key在block中的偏移量和对应的block大小
-    index_block_offset_size_builder_.Encode(pre_block_offset_size_, output);
-    index_block_builder_.Add(pre_block_last_key_, output);
+    if (parallel_) {
+      pending_index_keys_.push_back(pre_block_last_key_);
+    } else {
+      AddIndexEntry(pre_block_last_key_, pre_block_offset_size_);
+    }
     need_create_index_block_ = false;
   }
-  // 构建bf(整个sst就构建一个)
-  if (filter_block_builder_.Availabe()) {
+  // 构建bf(没有分区的时候整个sst就构建一个)
+  if (per_block_filter_builder_) {
+    per_block_filter_builder_->AddKey(key);
+  } else if (filter_block_builder_.Availabe()) {
     filter_block_builder_.Add(key);
   }
-  pre_block_last_key_ = key;
+  if (entry_count_ == 0) {
+    props_.smallest_key.assign(key.data(), key.size());
+  }
+  props_.raw_key_size += key.size();
+  props_.raw_value_size += value.size();
+  ParsedInternalKey ikey;
+  if (internal_comparator_ != nullptr && ParseInternalKey(key, &ikey) &&
+      ikey.type == kTypeDeletion) {
+    ++props_.num_deletions;
+  }
   ++entry_count_;
   // 写入data block
   data_block_builder_.Add(key, value);
@@ -45,16 +141,79 @@ void TableBuilder::Add(const std::string_view& key,
   }
 }
 
+void TableBuilder::AddRangeTombstone(const RangeTombstone& tombstone) {
+  range_tombstones_.emplace_back(tombstone.InternalStartKey(), tombstone.end);
+}
+
+void TableBuilder::AddIndexEntry(const std::string& key,
+                                 const OffSetSize& offset_size) {
+  // index中的value保存的是当前key在block中的偏移量和对应的block大小
+  std::string output;
+  index_block_offset_size_builder_.Encode(offset_size, output);
+  index_block_builder_.Add(key, output);
+  if (options_.partition_index &&
+      index_block_builder_.CurrentSize() >= options_.index_partition_size) {
+    CutPartition(key);
+  }
+}
+
+void TableBuilder::CutPartition(const std::string& key) {
+  Partition partition;
+  partition.key = key;
+  index_block_builder_.Finish();
+  partition.index = index_block_builder_.Data();
+  index_block_builder_.Reset();
+  // 此时filter中恰好是这个分区内所有data block的key
+  if (options_.partition_filters && filter_block_builder_.Availabe()) {
+    filter_block_builder_.Finish();
+    partition.filter = filter_block_builder_.Data();
+    filter_block_builder_.Reset();
+  }
+  partitions_.emplace_back(std::move(partition));
+}
+
 void TableBuilder::Flush() {
-  if (data_block_builder_.CurrentSize() == 0) {
+  // CurrentSize()至少包含restart部分，不能用来判断是否为空；
+  // 空block刷下去会覆盖掉pre_block_offset_size_，导致前一个block的index丢失
+  if (data_block_builder_.Empty()) {
+    return;
+  }
+  ++props_.num_data_blocks;
+  // 下一个block的第一个key到来的时候用来生成index的key，每个block只复制一次
+  pre_block_last_key_ = data_block_builder_.LastKey();
+  // 先写data block数据，只有data block使用字典
+  data_block_builder_.Finish();
+  const std::string& data = data_block_builder_.Data();
+  if (parallel_) {
+    auto block = std::make_unique<ParallelCompression::Block>();
+    block->raw = data;
+    block->dict = compression_dict_.get();
+    SampleForDict(data);
+    data_block_builder_.Reset();
+    ParallelCompression* rep = parallel_.get();
+    std::unique_lock<std::mutex> lock(rep->mu);
+    rep->space_cv.wait(lock, [rep]() {
+      return rep->write_queue.size() < rep->max_inflight;
+    });
+    status_ = rep->status;
+    rep->inflight_bytes += block->raw.size();
+    rep->compress_queue.push_back(block.get());
+    rep->write_queue.push_back(std::move(block));
+    rep->compress_cv.notify_one();
+    need_create_index_block_ = true;
     return;
   }
-  // 先写data block数据
-  WriteDataBlock(data_block_builder_, pre_block_offset_size_);
+  WriteBytesBlock(data, options_.block_compress_type, pre_block_offset_size_,
+                  compression_dict_.get());
+  SampleForDict(data);
+  data_block_builder_.Reset();
   // 如果写入数据成功
   if (status_ == Status::kSuccess) {
     //在下一轮循环中时，就需要更新我们的index block数据
     need_create_index_block_ = true;
+    if (per_block_filter_builder_) {
+      per_block_filter_builder_->StartBlock(block_offset_);
+    }
     // 针对剩余的还未刷盘的数据我们需要手动进行刷盘
     status_ = file_handler_->FlushBuffer();
   }
@@ -73,78 +232,327 @@ void TableBuilder::WriteDataBlock(DataBlockBuilder& data_block_builder,
 }
 void TableBuilder::WriteBytesBlock(const std::string& datas,
                                    BlockCompressType block_compress_type,
-                                   OffSetSize& offset_size) {
-  std::string compress_data = datas;
-  bool compress_success = false;
-  BlockCompressType type = block_compress_type;
-  switch (block_compress_type) {
-    case kSnappyCompression: {
-      compress_data = datas;
-      compress_success = true;
-    } break;
-    default:
-      type = kNonCompress;
-      break;
+                                   OffSetSize& offset_size,
+                                   const CompressionDict* dict) {
+  char trailer[kBlockTrailerSize];
+  const std::string_view block = CompressAndChecksum(
+      datas, block_compress_type, dict, &compressed_buffer_, trailer);
+  status_ = AppendBlock(block, trailer, offset_size);
+}
+
+std::string_view TableBuilder::CompressAndChecksum(
+    const std::string& datas, BlockCompressType block_compress_type,
+    const CompressionDict* dict, std::string* buffer, char* trailer) const {
+  std::string_view block = datas;
+  uint8_t type = kNonCompress;
+  // 只有真正用字典压缩的block才带上kDictCompressedFlag
+  if (dict != nullptr && !dict->UsedFor(block_compress_type)) {
+    dict = nullptr;
+  }
+  if (block_compress_type != kNonCompress &&
+      CompressBlock(block_compress_type, options_.compression_opts.level, dict,
+                    datas, buffer) &&
+      buffer->size() < datas.size() - datas.size() / 8) {
+    block = *buffer;
+    type = block_compress_type | (dict != nullptr ? kDictCompressedFlag : 0);
   }
+  trailer[0] = static_cast<char>(type);
+  uint32_t crc = crc32::Value(block.data(), block.size());
+  crc = crc32::Extend(crc, trailer, 1);  // Extend crc to cover block type
+  EncodeFixed32(trailer + 1, crc32::Mask(crc));
+  return block;
+}
 
+DBStatus TableBuilder::AppendBlock(const std::string_view& block,
+                                   const char* trailer,
+                                   OffSetSize& offset_size) {
   offset_size.offset = block_offset_;
-  offset_size.length = datas.size();
+  offset_size.length = block.size();
   // 追加我们的block数据
-  status_ = file_handler_->Append(datas.data(), datas.size());
-  char trailer[kBlockTrailerSize];
-  trailer[0] = static_cast<uint8_t>(type);
-  uint32_t crc = crc32::Value(datas.data(), datas.size());
-  crc = crc32::Extend(crc, trailer, 1);  // Extend crc to cover block type
-  EncodeFixed32(trailer + 1, crc32::Mask(crc));
-  status_ = file_handler_->Append(trailer, kBlockTrailerSize);
-  if (status_ == Status::kSuccess) {
+  DBStatus status = file_handler_->Append(block.data(), block.size());
+  if (status == Status::kSuccess) {
+    status = file_handler_->Append(trailer, kBlockTrailerSize);
+  }
+  if (status == Status::kSuccess) {
     block_offset_ += offset_size.length + kBlockTrailerSize;
   }
+  return status;
+}
+
+void TableBuilder::CompressThread() {
+  ParallelCompression* rep = parallel_.get();
+  std::unique_lock<std::mutex> lock(rep->mu);
+  while (true) {
+    rep->compress_cv.wait(lock, [rep]() {
+      return rep->shutdown || !rep->compress_queue.empty();
+    });
+    if (rep->compress_queue.empty()) {
+      return;
+    }
+    ParallelCompression::Block* block = rep->compress_queue.front();
+    rep->compress_queue.pop_front();
+    lock.unlock();
+    block->output =
+        CompressAndChecksum(block->raw, options_.block_compress_type,
+                            block->dict, &block->compressed, block->trailer);
+    lock.lock();
+    block->ready = true;
+    if (block == rep->write_queue.front().get()) {
+      rep->write_cv.notify_one();
+    }
+  }
+}
+
+void TableBuilder::WriteThread() {
+  ParallelCompression* rep = parallel_.get();
+  std::unique_lock<std::mutex> lock(rep->mu);
+  while (true) {
+    rep->write_cv.wait(lock, [rep]() {
+      return rep->write_queue.empty() ? rep->shutdown
+                                      : rep->write_queue.front()->ready;
+    });
+    if (rep->write_queue.empty()) {
+      return;
+    }
+    std::unique_ptr<ParallelCompression::Block> block =
+        std::move(rep->write_queue.front());
+    rep->write_queue.pop_front();
+    const bool ok = rep->status == Status::kSuccess;
+    lock.unlock();
+    OffSetSize handle;
+    DBStatus s = Status::kSuccess;
+    if (ok) {
+      s = AppendBlock(block->output, block->trailer, handle);
+      if (s == Status::kSuccess) {
+        s = file_handler_->FlushBuffer();
+      }
+    }
+    const size_t raw_size = block->raw.size();
+    block.reset();
+    lock.lock();
+    if (rep->status == Status::kSuccess) {
+      rep->status = s;
+    }
+    rep->handles.push_back(handle);
+    rep->inflight_bytes -= raw_size;
+    rep->space_cv.notify_all();
+  }
+}
+
+void TableBuilder::StopParallel() {
+  ParallelCompression* rep = parallel_.get();
+  {
+    std::unique_lock<std::mutex> lock(rep->mu);
+    rep->space_cv.wait(lock, [rep]() { return rep->write_queue.empty(); });
+    rep->shutdown = true;
+    rep->compress_cv.notify_all();
+    rep->write_cv.notify_all();
+  }
+  for (auto& thread : rep->threads) {
+    thread.join();
+  }
+  rep->threads.clear();
+}
+
+void TableBuilder::FinishParallel() {
+  StopParallel();
+  ParallelCompression* rep = parallel_.get();
+  status_ = rep->status;
+  if (status_ != Status::kSuccess) {
+    return;
+  }
+  assert(pending_index_keys_.size() == rep->handles.size() ||
+         !options_.comparator);
+  for (size_t i = 0; i < pending_index_keys_.size(); ++i) {
+    AddIndexEntry(pending_index_keys_[i], rep->handles[i]);
+  }
+  pending_index_keys_.clear();
+}
+
+void TableBuilder::SampleForDict(const std::string& block) {
+  const CompressionOptions& opts = options_.compression_opts;
+  if (options_.block_compress_type != kZSTDCompression ||
+      opts.max_dict_bytes == 0 || compression_dict_) {
+    return;
+  }
+  dict_samples_.append(block);
+  dict_sample_sizes_.push_back(block.size());
+  const size_t limit = opts.zstd_max_train_bytes > 0 ? opts.zstd_max_train_bytes
+                                                     : opts.max_dict_bytes;
+  if (dict_samples_.size() < limit) {
+    return;
+  }
+  std::string dict;
+  if (opts.zstd_max_train_bytes > 0) {
+    dict = TrainCompressionDict(dict_samples_, dict_sample_sizes_,
+                                opts.max_dict_bytes);
+  } else {
+    dict = dict_samples_.substr(0, opts.max_dict_bytes);
+  }
+  compression_dict_ =
+      std::make_unique<CompressionDict>(std::move(dict), opts.level);
+  std::string().swap(dict_samples_);
+  std::vector<size_t>().swap(dict_sample_sizes_);
 }
+
+void TableBuilder::WriteFilter(OffSetSize* meta_offset_size) {
+  const bool partitioned = !partitions_.empty() && options_.partition_filters;
+  // meta block中的key需要有序，先收集起来
+  std::map<std::string, std::string> meta;
+  if (!partitions_.empty()) {
+    meta[kPartitionedIndexMetaKey] = "";
+  }
+  if (compression_dict_) {
+    // 字典本身不压缩，读取的时候要先拿到它才能解压data block
+    OffSetSize dict_offset;
+    WriteBytesBlock(compression_dict_->data(), BlockCompressType::kNonCompress,
+                    dict_offset);
+    OffsetBuilder offset_builder;
+    std::string handle_encoding_str;
+    offset_builder.Encode(dict_offset, handle_encoding_str);
+    meta[kCompressionDictMetaKey] = handle_encoding_str;
+  }
+  if (filter_block_builder_.Availabe()) {
+    OffSetSize filter_block_offset;
+    OffsetBuilder offset_builder;
+    std::string handle_encoding_str;
+    if (per_block_filter_builder_) {
+      WriteBytesBlock(per_block_filter_builder_->Finish(),
+                      BlockCompressType::kNonCompress, filter_block_offset);
+      offset_builder.Encode(filter_block_offset, handle_encoding_str);
+      meta[std::string(kPerBlockFilterMetaPrefix) +
+           options_.filter_policy->Name()] = handle_encoding_str;
+    } else if (partitioned) {
+      // 每个filter分区单独写一个block，顶层filter index的key和顶层index相同
+      DataBlockBuilder top_filter_builder(&index_options_);
+      for (const auto& partition : partitions_) {
+        OffSetSize partition_offset;
+        WriteBytesBlock(partition.filter, BlockCompressType::kNonCompress,
+                        partition_offset);
+        std::string output;
+        offset_builder.Encode(partition_offset, output);
+        top_filter_builder.Add(partition.key, output);
+      }
+      WriteDataBlock(top_filter_builder, filter_block_offset);
+      offset_builder.Encode(filter_block_offset, handle_encoding_str);
+      meta[std::string(kPartitionedFilterMetaPrefix) +
+           options_.filter_policy->Name()] = handle_encoding_str;
+    } else {
+      // 这部分写的是filter即布隆过滤器部分数据
+      filter_block_builder_.Finish();
+      // 这部分不需要进行压缩，所以直接调用WriteBytesBlock函数
+      WriteBytesBlock(filter_block_builder_.Data(),
+                      BlockCompressType::kNonCompress, filter_block_offset);
+      offset_builder.Encode(filter_block_offset, handle_encoding_str);
+      meta[options_.filter_policy->Name()] = handle_encoding_str;
+    }
+  }
+  if (!range_tombstones_.empty()) {
+    // block内按照internal key有序，读取的时候只会顺序遍历；没有comparator的时候
+    // 保持Add的顺序
+    if (options_.comparator) {
+      std::stable_sort(range_tombstones_.begin(), range_tombstones_.end(),
+                       [this](const auto& a, const auto& b) {
+                         return options_.comparator->Compare(a.first, b.first) <
+                                0;
+                       });
+    }
+    DataBlockBuilder range_del_block(&index_options_);
+    for (const auto& [start, end] : range_tombstones_) {
+      range_del_block.Add(start, end);
+    }
+    OffSetSize range_del_offset;
+    WriteDataBlock(range_del_block, range_del_offset);
+    std::string handle_encoding_str;
+    OffsetBuilder().Encode(range_del_offset, handle_encoding_str);
+    meta[kRangeDelMetaKey] = handle_encoding_str;
+  }
+  {
+    DataBlockBuilder properties_block(&index_options_);
+    for (const auto& item : props_.Encode()) {
+      properties_block.Add(item.first, item.second);
+    }
+    OffSetSize properties_offset;
+    WriteDataBlock(properties_block, properties_offset);
+    std::string handle_encoding_str;
+    OffsetBuilder().Encode(properties_offset, handle_encoding_str);
+    meta[kPropertiesMetaKey] = handle_encoding_str;
+  }
+  // 记录filter在整个sst中的位置以及index是否分区，这部分的位置保存到footer中
+  // 这部分目的是针对不同的块可以使用不同的filter_policy
+  DataBlockBuilder meta_block(&index_options_);
+  for (const auto& item : meta) {
+    meta_block.Add(item.first, item.second);
+  }
+  WriteDataBlock(meta_block, *meta_offset_size);
+}
+
+void TableBuilder::WriteIndex(OffSetSize* index_offset_size) {
+  if (partitions_.empty()) {
+    WriteDataBlock(index_block_builder_, *index_offset_size);
+    return;
+  }
+  // 顶层index中每个分区对应一个entry
+  DataBlockBuilder top_index_builder(&index_options_,
+                                     options_.index_block_key_prefix);
+  for (const auto& partition : partitions_) {
+    OffSetSize partition_offset;
+    WriteBytesBlock(partition.index, options_.block_compress_type,
+                    partition_offset);
+    std::string output;
+    index_block_offset_size_builder_.Encode(partition_offset, output);
+    top_index_builder.Add(partition.key, output);
+  }
+  WriteDataBlock(top_index_builder, *index_offset_size);
+}
+
 void TableBuilder::Finish() {
   if (!Success()) {
     return;
   }
   // data buffer中剩余的数据可能还没来得及刷到磁盘
   Flush();
-  OffSetSize filter_block_offset, meta_filter_block_offset, index_block_offset;
-  // 开始构建filter_block和meta_filter_block_offset(这部分其实保存到footer中)
-  if (filter_block_builder_.Availabe()) {
-    // 这部分写的是filter即布隆过滤器部分数据
-    filter_block_builder_.Finish();
-    const auto& filter_block_data = filter_block_builder_.Data();
-
-    // 这部分不需要进行压缩，所以直接调用WriteBytesBlock函数
-    WriteBytesBlock(filter_block_data, BlockCompressType::kNonCompress,
-                    filter_block_offset);
-    // 该部分是获取布隆过滤器部分数据在整个sst中的位置，然后将这部分数据写入到sst中
-    // 这部分目的是针对不同的块可以使用不同的filter_policy
-    DataBlockBuilder meta_filter_block(&options_);
-    OffsetBuilder filter_block_offset_builder;
-    std::string handle_encoding_str;
-    filter_block_offset_builder.Encode(filter_block_offset,
-                                       handle_encoding_str);
-    meta_filter_block.Add(options_.filter_policy->Name(), handle_encoding_str);
-    WriteDataBlock(meta_filter_block, meta_filter_block_offset);
-  }
-  // 处理index_block
+  // 最后一个data block后面没有key了，index中使用大于等于最后一个key的最短的key
+  std::string last_index_key = pre_block_last_key_;
   if (need_create_index_block_ && options_.comparator) {
-    // 最后一个key这里我们就不做优化了，直接使用(leveldb中是FindShortSuccessor(std::string*
-    // key)函数)
-    // index中的value保存的是当前key在block中的偏移量和对应的block大小
-    std::string output;
-    index_block_offset_size_builder_.Encode(pre_block_offset_size_, output);
-    index_block_builder_.Add(pre_block_last_key_, output);
+    options_.comparator->FindShortSuccessor(last_index_key);
+    if (parallel_) {
+      pending_index_keys_.push_back(last_index_key);
+    } else {
+      AddIndexEntry(last_index_key, pre_block_offset_size_);
+    }
     need_create_index_block_ = false;
   }
-  WriteDataBlock(index_block_builder_, index_block_offset);
+  if (parallel_) {
+    FinishParallel();
+    if (!Success()) {
+      return;
+    }
+  }
+  if (options_.partition_index && !index_block_builder_.Empty()) {
+    CutPartition(last_index_key);
+  }
+  // 此时所有data block都已经写入文件，之后才是字典、filter等meta block
+  props_.num_entries = entry_count_;
+  props_.num_range_deletions = range_tombstones_.size();
+  props_.data_size = block_offset_;
+  if (entry_count_ > 0) {
+    props_.largest_key = pre_block_last_key_;
+  }
+  OffSetSize meta_filter_block_offset, index_block_offset;
+  WriteFilter(&meta_filter_block_offset);
+  WriteIndex(&index_block_offset);
   Footer footer;
   footer.SetFilterBlockMetaData(meta_filter_block_offset);
   footer.SetIndexBlockMetaData(index_block_offset);
   std::string footer_output;
   footer.EncodeTo(&footer_output);
-  file_handler_->Append(footer_output.data(), footer_output.size());
+  status_ = file_handler_->Append(footer_output.data(), footer_output.size());
   block_offset_ += footer_output.size();
+  // sst生成之后才会删除对应的WAL，所以需要保证数据已经落盘
+  if (status_ == Status::kSuccess) {
+    status_ = file_handler_->Sync();
+  }
   file_handler_->Close();
 }
 }  // namespace corekv
@@ -1,10 +1,20 @@
 #pragma once
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "../db/options.h"
+#include "../db/range_del.h"
 #include "../file/file.h"
 #include "block_builder.h"
+#include "compression.h"
+#include "filter_block.h"
 #include "offset_size.h"
+#include "table_properties.h"
 namespace corekv {
 struct Options;
+class InternalKeyComparator;
 }  // namespace corekv
 
 namespace corekv {
@@ -13,22 +23,55 @@ class TableBuilder final {
   TableBuilder(const TableBuilder&) = delete;
   TableBuilder& operator=(const TableBuilder&) = delete;
   TableBuilder(const Options& options,FileWriter* file_handler);
+  ~TableBuilder();
   void Add(const std::string_view& key, const std::string_view& value);
+  // range tombstone不进入data block，Finish的时候和filter一起写到meta block中，
+  // 可以在Finish之前的任何时候调用
+  void AddRangeTombstone(const RangeTombstone& tombstone);
   // Finish是指Add最后，有一部分数据还没来得及刷盘
   void Finish();
   bool Success() { return status_ == Status::kSuccess; }
-  uint32_t GetFileSize() {
-    return block_offset_;
-  }
+  // 并行压缩的时候包含还没有写入文件的block的原始大小，Finish之后是准确的文件大小
+  uint32_t GetFileSize();
   uint32_t GetEntryNum() {
     return entry_count_;
   }
+  uint32_t GetRangeTombstoneNum() const { return range_tombstones_.size(); }
+  // 记录到properties中的生成时间(ms)，不设置的时候为0，相同的输入生成的文件完全一致
+  void SetCreationTime(uint64_t time_ms) { props_.creation_time = time_ms; }
+  // Finish之后是写入properties block的完整内容
+  const TableProperties& GetProperties() const { return props_; }
  private:
+  // 写完一个data block之后，在index中记录它的位置
+  void AddIndexEntry(const std::string& key, const OffSetSize& offset_size);
+  // 当前的index分区已经足够大了，和对应的filter分区一起保存下来
+  void CutPartition(const std::string& key);
+  void WriteFilter(OffSetSize* filter_offset_size);
+  void WriteIndex(OffSetSize* index_offset_size);
   void Flush();
   void WriteDataBlock(DataBlockBuilder& data_block, OffSetSize& offset_size);
+  // 压缩之后节省不到1/8的时候按照不压缩写入，dict不为空的时候用字典压缩
   void WriteBytesBlock(const std::string& datas,
                        BlockCompressType block_compress_type,
+                       OffSetSize& offset_size,
+                       const CompressionDict* dict = nullptr);
+  // 压缩并生成trailer，buffer用来保存压缩结果，返回需要写入的数据
+  std::string_view CompressAndChecksum(const std::string& datas,
+                                       BlockCompressType block_compress_type,
+                                       const CompressionDict* dict,
+                                       std::string* buffer,
+                                       char* trailer) const;
+  // 把block和trailer追加到文件末尾，并行压缩的时候只有写线程调用
+  DBStatus AppendBlock(const std::string_view& block, const char* trailer,
                        OffSetSize& offset_size);
+  // 并行压缩时等待所有block写入文件，然后补上所有data block的index
+  void FinishParallel();
+  // 等待流水线中的block全部写完并停止所有线程
+  void StopParallel();
+  void CompressThread();
+  void WriteThread();
+  // 收集data block作为字典的样本，样本足够的时候生成compression_dict_
+  void SampleForDict(const std::string& block);
 
  private:
   Options options_;
@@ -37,15 +80,42 @@ class TableBuilder final {
   DataBlockBuilder data_block_builder_;
   DataBlockBuilder index_block_builder_;
   FilterBlockBuilder filter_block_builder_;
+  // 打开per_block_filter时代替filter_block_builder_
+  std::unique_ptr<PerBlockFilterBuilder> per_block_filter_builder_;
+  // 分区在Finish的时候才写入文件，保证data block在文件中是连续的
+  struct Partition {
+    // 分区中最后一个index key，作为顶层index的key
+    std::string key;
+    std::string index;
+    std::string filter;
+  };
+  std::vector<Partition> partitions_;
   OffsetBuilder index_block_offset_size_builder_;
   FileWriter* file_handler_ = nullptr;
   // 索引的构建，我们只能在下一个block开始时候去构建上一个
   std::string pre_block_last_key_;
   // 前一个block偏移量和大小的话
   OffSetSize pre_block_offset_size_;
-  uint32_t block_offset_ = 0;
+  // 并行压缩的时候由写线程更新
+  std::atomic<uint32_t> block_offset_{0};
   uint64_t entry_count_ = 0;
+  // comparator是InternalKeyComparator的时候用来统计删除标记，否则为nullptr
+  InternalKeyComparator* internal_comparator_ = nullptr;
+  TableProperties props_;
   bool need_create_index_block_ = false;
+  // 复用的压缩缓冲区
+  std::string compressed_buffer_;
+  // 字典生成之前的data block样本，sample_sizes_是每个样本的长度
+  std::string dict_samples_;
+  std::vector<size_t> dict_sample_sizes_;
+  std::unique_ptr<CompressionDict> compression_dict_;
+  // 并行压缩的流水线，block的位置要等写入之后才知道，
+  // 所以index的key先保存在pending_index_keys_中，Finish的时候统一加入index
+  struct ParallelCompression;
+  std::unique_ptr<ParallelCompression> parallel_;
+  std::vector<std::string> pending_index_keys_;
+  // internal start key -> end key
+  std::vector<std::pair<std::string, std::string>> range_tombstones_;
   DBStatus status_;
 };
 }  // namespace corekv
@@ -11,4 +11,18 @@ static constexpr uint32_t kMaxOffSetSizeLength = 2 * kMaxVarInt64Length;
 static constexpr uint64_t kEncodedLength = 40;
 // 1-byte type + 32-bit crc
 static constexpr size_t kBlockTrailerSize = 5;
+// meta block中存在这个key时，footer中的index是顶层index，value是各个index分区的位置
+static constexpr const char* kPartitionedIndexMetaKey = "corekv.index.partitioned";
+// 分区filter在meta block中的key是这个前缀加上filter的名字，value是顶层filter index的位置
+static constexpr const char* kPartitionedFilterMetaPrefix = "partitioned.";
+// 按照data block分段的filter在meta block中的key前缀，格式见filter_block.h
+static constexpr const char* kPerBlockFilterMetaPrefix = "filter.";
+// zstd字典在meta block中的key
+static constexpr const char* kCompressionDictMetaKey = "corekv.compression_dict";
+// range tombstone block在meta block中的key，block中的格式见db/range_del.h
+static constexpr const char* kRangeDelMetaKey = "corekv.range_del";
+// properties block在meta block中的key，block中的格式见table_properties.h
+static constexpr const char* kPropertiesMetaKey = "corekv.properties";
+// block trailer中的压缩类型带上这一位说明是用sst的字典压缩的
+static constexpr uint8_t kDictCompressedFlag = 0x80;
 }  // namespace corekv
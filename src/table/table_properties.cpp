@@ -0,0 +1,76 @@
+#include "table_properties.h"
+
+#include <stdio.h>
+
+#include "../utils/codec.h"
+namespace corekv {
+using namespace util;
+namespace {
+// 数值类型的属性，名字确定之后不能修改
+struct NumericProperty {
+  const char* name;
+  uint64_t TableProperties::*field;
+};
+constexpr NumericProperty kNumericProperties[] = {
+    {"corekv.num.entries", &TableProperties::num_entries},
+    {"corekv.num.deletions", &TableProperties::num_deletions},
+    {"corekv.num.range-deletions", &TableProperties::num_range_deletions},
+    {"corekv.raw.key.size", &TableProperties::raw_key_size},
+    {"corekv.raw.value.size", &TableProperties::raw_value_size},
+    {"corekv.data.size", &TableProperties::data_size},
+    {"corekv.num.data.blocks", &TableProperties::num_data_blocks},
+    {"corekv.creation.time", &TableProperties::creation_time},
+    {"corekv.compression.type", &TableProperties::compression_type},
+};
+constexpr const char* kSmallestKey = "corekv.smallest.key";
+constexpr const char* kLargestKey = "corekv.largest.key";
+}  // namespace
+
+std::map<std::string, std::string> TableProperties::Encode() const {
+  std::map<std::string, std::string> result;
+  for (const auto& property : kNumericProperties) {
+    PutVarint64(&result[property.name], this->*property.field);
+  }
+  result[kSmallestKey] = smallest_key;
+  result[kLargestKey] = largest_key;
+  return result;
+}
+
+bool TableProperties::DecodeEntry(const std::string_view& name,
+                                  const std::string_view& value) {
+  if (name == kSmallestKey) {
+    smallest_key.assign(value.data(), value.size());
+    return true;
+  }
+  if (name == kLargestKey) {
+    largest_key.assign(value.data(), value.size());
+    return true;
+  }
+  for (const auto& property : kNumericProperties) {
+    if (name == property.name) {
+      std::string_view input = value;
+      return GetVarint64(&input, &(this->*property.field)) && input.empty();
+    }
+  }
+  return true;
+}
+
+std::string TableProperties::ToString() const {
+  char buf[512];
+  snprintf(buf, sizeof(buf),
+           "entries=%llu deletions=%llu range_deletions=%llu "
+           "raw_key_size=%llu raw_value_size=%llu data_size=%llu "
+           "data_blocks=%llu compression_ratio=%.3f creation_time=%llu "
+           "compression_type=%llu",
+           static_cast<unsigned long long>(num_entries),
+           static_cast<unsigned long long>(num_deletions),
+           static_cast<unsigned long long>(num_range_deletions),
+           static_cast<unsigned long long>(raw_key_size),
+           static_cast<unsigned long long>(raw_value_size),
+           static_cast<unsigned long long>(data_size),
+           static_cast<unsigned long long>(num_data_blocks),
+           CompressionRatio(), static_cast<unsigned long long>(creation_time),
+           static_cast<unsigned long long>(compression_type));
+  return buf;
+}
+}  // namespace corekv
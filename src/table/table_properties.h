@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace corekv {
+/*
+ * sst的统计信息，TableBuilder在Finish的时候写到meta block中kPropertiesMetaKey指向的
+ * block里，Table::Open的时候读出来常驻内存，之后不需要再扫描data block
+ *
+ * block中每个属性是一个entry，key为属性名，数值类型的value是varint64，
+ * 不认识的属性直接忽略，新增属性的时候旧版本也能读取
+ */
+struct TableProperties {
+  // data block中的entry个数，不包含range tombstone
+  uint64_t num_entries = 0;
+  // 删除标记的个数，只有key是internal key的时候才会统计
+  uint64_t num_deletions = 0;
+  uint64_t num_range_deletions = 0;
+  // 所有key和value压缩之前的总长度
+  uint64_t raw_key_size = 0;
+  uint64_t raw_value_size = 0;
+  // 所有data block写入文件之后的总大小，包括trailer
+  uint64_t data_size = 0;
+  uint64_t num_data_blocks = 0;
+  // 生成sst的时间(ms)
+  uint64_t creation_time = 0;
+  // data block实际使用的压缩算法(BlockCompressType)，配置的算法不支持时为kNonCompress，
+  // 没有这个属性的旧sst读出来也是0
+  uint64_t compression_type = 0;
+  // data block中最小和最大的key，没有entry的时候为空
+  std::string smallest_key;
+  std::string largest_key;
+
+  // 原始数据和压缩之后data block的大小之比，没有数据的时候返回0
+  double CompressionRatio() const {
+    return data_size == 0
+               ? 0
+               : static_cast<double>(raw_key_size + raw_value_size) / data_size;
+  }
+  // 编码成有序的(属性名, value)，用来生成properties block
+  std::map<std::string, std::string> Encode() const;
+  // 解析properties block中的一个entry，value格式错误的时候返回false
+  bool DecodeEntry(const std::string_view& name, const std::string_view& value);
+  std::string ToString() const;
+};
+
+// 文件编号 -> 对应sst的属性
+using TablePropertiesCollection =
+    std::map<uint64_t, std::shared_ptr<const TableProperties>>;
+}  // namespace corekv
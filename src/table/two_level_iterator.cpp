@@ -0,0 +1,148 @@
+#include "two_level_iterator.h"
+
+#include <memory>
+#include <string>
+namespace corekv {
+namespace {
+class TwoLevelIterator final : public Iterator {
+ public:
+  TwoLevelIterator(Iterator* index_iter, BlockFunction block_function,
+                   void* arg, const ReadOptions& options,
+                   PrefetchFunction prefetch_function)
+      : block_function_(block_function),
+        prefetch_function_(prefetch_function),
+        arg_(arg),
+        options_(options),
+        index_iter_(index_iter) {}
+  ~TwoLevelIterator() override = default;
+
+  void Seek(const std::string_view& target) override {
+    index_iter_->Seek(target);
+    InitDataBlock();
+    if (data_iter_) {
+      data_iter_->Seek(target);
+    }
+    SkipEmptyDataBlocksForward();
+  }
+  void SeekToFirst() override {
+    index_iter_->SeekToFirst();
+    InitDataBlock();
+    if (data_iter_) {
+      data_iter_->SeekToFirst();
+    }
+    SkipEmptyDataBlocksForward();
+  }
+  void SeekToLast() override {
+    index_iter_->SeekToLast();
+    InitDataBlock();
+    if (data_iter_) {
+      data_iter_->SeekToLast();
+    }
+    SkipEmptyDataBlocksBackward();
+  }
+  void Next() override {
+    assert(Valid());
+    data_iter_->Next();
+    SkipEmptyDataBlocksForward();
+  }
+  void Prev() override {
+    assert(Valid());
+    data_iter_->Prev();
+    SkipEmptyDataBlocksBackward();
+  }
+  bool Valid() const override { return data_iter_ && data_iter_->Valid(); }
+  std::string_view key() const override {
+    assert(Valid());
+    return data_iter_->key();
+  }
+  std::string_view value() const override {
+    assert(Valid());
+    return data_iter_->value();
+  }
+  DBStatus status() const override {
+    if (index_iter_->status() != Status::kSuccess) {
+      return index_iter_->status();
+    }
+    if (data_iter_ && data_iter_->status() != Status::kSuccess) {
+      return data_iter_->status();
+    }
+    return status_;
+  }
+
+ private:
+  void SaveError(const DBStatus& s) {
+    if (status_ == Status::kSuccess && s != Status::kSuccess) {
+      status_ = s;
+    }
+  }
+  void SkipEmptyDataBlocksForward() {
+    while (!data_iter_ || !data_iter_->Valid()) {
+      if (!index_iter_->Valid()) {
+        SetDataIterator(nullptr);
+        return;
+      }
+      index_iter_->Next();
+      InitDataBlock();
+      if (data_iter_) {
+        data_iter_->SeekToFirst();
+        if (prefetch_function_ != nullptr) {
+          (*prefetch_function_)(arg_, data_block_handle_);
+        }
+      }
+    }
+  }
+  void SkipEmptyDataBlocksBackward() {
+    while (!data_iter_ || !data_iter_->Valid()) {
+      if (!index_iter_->Valid()) {
+        SetDataIterator(nullptr);
+        return;
+      }
+      index_iter_->Prev();
+      InitDataBlock();
+      if (data_iter_) {
+        data_iter_->SeekToLast();
+      }
+    }
+  }
+  void SetDataIterator(Iterator* data_iter) {
+    if (data_iter_) {
+      SaveError(data_iter_->status());
+    }
+    data_iter_.reset(data_iter);
+  }
+  void InitDataBlock() {
+    if (!index_iter_->Valid()) {
+      SetDataIterator(nullptr);
+      return;
+    }
+    const std::string_view handle = index_iter_->value();
+    // 还在同一个data block中，不需要重新读取
+    if (data_iter_ && handle == data_block_handle_) {
+      return;
+    }
+    Iterator* iter = (*block_function_)(arg_, options_, handle);
+    data_block_handle_ = handle;
+    SetDataIterator(iter);
+  }
+
+ private:
+  BlockFunction block_function_;
+  PrefetchFunction prefetch_function_;
+  void* arg_;
+  const ReadOptions options_;
+  DBStatus status_ = Status::kSuccess;
+  std::unique_ptr<Iterator> index_iter_;
+  std::unique_ptr<Iterator> data_iter_;
+  // 当前data_iter_对应的index value
+  std::string data_block_handle_;
+};
+}  // namespace
+
+Iterator* NewTwoLevelIterator(Iterator* index_iter,
+                              BlockFunction block_function, void* arg,
+                              const ReadOptions& options,
+                              PrefetchFunction prefetch_function) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              prefetch_function);
+}
+}  // namespace corekv
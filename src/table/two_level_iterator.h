@@ -0,0 +1,23 @@
+#pragma once
+#include <string_view>
+
+#include "../db/iterator.h"
+#include "../db/options.h"
+namespace corekv {
+/*
+ * 两层迭代器: 第一层是index block的迭代器，value是data block的位置；
+ * 第二层由block_function根据index value创建出对应data block的迭代器
+ * 正向遍历从一个data block进入下一个data block的时候，说明是在做范围扫描，
+ * 此时通过prefetch_function预读再下一个data block，读完当前block时数据已经在page cache中
+ */
+using BlockFunction = Iterator* (*)(void* arg, const ReadOptions& options,
+                                    const std::string_view& index_value);
+// index_value为刚刚打开的data block的位置
+using PrefetchFunction = void (*)(void* arg,
+                                  const std::string_view& index_value);
+
+Iterator* NewTwoLevelIterator(Iterator* index_iter,
+                              BlockFunction block_function, void* arg,
+                              const ReadOptions& options,
+                              PrefetchFunction prefetch_function = nullptr);
+}  // namespace corekv
@@ -1,8 +1,14 @@
 #include "memory/alloc.h"
+#include "memory/area.h"
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "logger/log.h"
 
@@ -33,3 +39,250 @@ TEST(allocTest, Allocate) {
 }
 
 
+
+TEST(allocTest, ManySizes) {
+  corekv::SimpleFreeListAlloc alloc;
+  std::vector<std::pair<char*, int32_t>> objects;
+  // 大小覆盖所有的freelist和直接malloc的大对象，每个对象填上不同的内容检查是否重叠
+  for (int32_t round = 0; round < 3; ++round) {
+    for (int32_t i = 0; i < 5000; ++i) {
+      const int32_t n = 1 + (i * 37) % 5000;
+      char* p = static_cast<char*>(alloc.Allocate(n));
+      memset(p, i & 0xff, n);
+      objects.emplace_back(p, n);
+    }
+    for (size_t i = 0; i < objects.size(); ++i) {
+      const auto& object = objects[i];
+      for (int32_t k = 0; k < object.second; ++k) {
+        ASSERT_EQ(object.first[k], static_cast<char>(i & 0xff));
+      }
+    }
+    EXPECT_GT(alloc.MemoryUsage(), 0u);
+    // 释放一半之后再分配，释放的内存会被重新使用
+    for (size_t i = 0; i < objects.size(); i += 2) {
+      alloc.Deallocate(objects[i].first, objects[i].second);
+    }
+    for (size_t i = 1; i < objects.size(); i += 2) {
+      alloc.Deallocate(objects[i].first, objects[i].second);
+    }
+    objects.clear();
+    EXPECT_EQ(alloc.MemoryUsage(), 0u);
+  }
+}
+
+TEST(allocTest, Reallocate) {
+  corekv::SimpleFreeListAlloc alloc;
+  char* p = static_cast<char*>(alloc.Allocate(16));
+  memcpy(p, "0123456789abcdef", 16);
+  p = static_cast<char*>(alloc.Reallocate(p, 16, 8000));
+  EXPECT_EQ(std::string(p, 16), "0123456789abcdef");
+  p = static_cast<char*>(alloc.Reallocate(p, 8000, 4));
+  EXPECT_EQ(std::string(p, 4), "0123");
+  alloc.Deallocate(p, 4);
+  EXPECT_EQ(alloc.MemoryUsage(), 0u);
+}
+
+TEST(allocTest, ThreadCachedCrossThreadFree) {
+  corekv::ThreadCachedAlloc alloc;
+  static constexpr int32_t kThreads = 8;
+  static constexpr int32_t kObjects = 20000;
+  // 每个线程分配的对象交给下一个线程释放
+  std::vector<std::vector<std::pair<char*, int32_t>>> handoff(kThreads);
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      auto& objects = handoff[t];
+      for (int32_t i = 0; i < kObjects; ++i) {
+        const int32_t n = 1 + (i * 131 + t) % 6000;
+        char* p = static_cast<char*>(alloc.Allocate(n));
+        memset(p, t, n);
+        objects.emplace_back(p, n);
+        // 一部分对象马上释放，走magazine的快速路径
+        if (i % 3 == 0) {
+          alloc.Deallocate(p, n);
+          objects.pop_back();
+        }
+      }
+      for (const auto& object : objects) {
+        for (int32_t k = 0; k < object.second; ++k) {
+          ASSERT_EQ(object.first[k], static_cast<char>(t));
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  threads.clear();
+  EXPECT_GT(alloc.MemoryUsage(), 0u);
+  for (int32_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (const auto& object : handoff[(t + 1) % kThreads]) {
+        alloc.Deallocate(object.first, object.second);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  // 释放的对象回到了depot，再次分配的时候不需要申请新的chunk
+  const uint64_t usage = alloc.MemoryUsage();
+  std::vector<char*> again;
+  for (int32_t i = 0; i < 50; ++i) {
+    again.push_back(static_cast<char*>(alloc.Allocate(64)));
+  }
+  EXPECT_EQ(alloc.MemoryUsage(), usage);
+  for (char* p : again) {
+    alloc.Deallocate(p, 64);
+  }
+}
+
+TEST(allocTest, ConcurrentArenaAlignment) {
+  corekv::ConcurrentArena arena(4096);
+  uint64_t bytes = 0;
+  for (int32_t i = 1; i < 2000; ++i) {
+    const uint32_t n = i % 97 + 1;
+    char* p = static_cast<char*>(arena.Allocate(n));
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(p) % 8, 0u);
+    memset(p, i, n);
+    bytes += n;
+  }
+  EXPECT_GE(arena.MemoryUsage(), bytes);
+  // 超过block_size/4的对象单独分配，之后的小对象仍然使用原来的block
+  const uint64_t before = arena.MemoryUsage();
+  char* large = static_cast<char*>(arena.Allocate(100000));
+  memset(large, 1, 100000);
+  EXPECT_GE(arena.MemoryUsage(), before + 100000);
+}
+
+TEST(allocTest, ConcurrentArenaMultiThread) {
+  // 大页申请失败的时候退化成malloc，两种情况都应该可以正常使用
+  for (size_t huge_page_size : {size_t(0), size_t(2 * 1024 * 1024)}) {
+    corekv::ConcurrentArena arena(64 * 1024, huge_page_size);
+    static constexpr int32_t kThreads = 8;
+    static constexpr int32_t kObjects = 20000;
+    std::vector<std::vector<std::pair<char*, uint32_t>>> objects(kThreads);
+    std::vector<std::thread> threads;
+    for (int32_t t = 0; t < kThreads; ++t) {
+      threads.emplace_back([&, t]() {
+        for (int32_t i = 0; i < kObjects; ++i) {
+          const uint32_t n = 1 + (i * 37 + t) % 200;
+          char* p = static_cast<char*>(arena.Allocate(n));
+          memset(p, t, n);
+          objects[t].emplace_back(p, n);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    // 不同线程拿到的内存不能重叠
+    std::vector<std::pair<char*, uint32_t>> all;
+    for (int32_t t = 0; t < kThreads; ++t) {
+      for (const auto& object : objects[t]) {
+        for (uint32_t k = 0; k < object.second; ++k) {
+          ASSERT_EQ(object.first[k], static_cast<char>(t));
+        }
+      }
+      all.insert(all.end(), objects[t].begin(), objects[t].end());
+    }
+    std::sort(all.begin(), all.end());
+    for (size_t i = 1; i < all.size(); ++i) {
+      ASSERT_LE(all[i - 1].first + all[i - 1].second, all[i].first);
+    }
+  }
+}
+
+TEST(allocTest, HugePageBackedBlocks) {
+  // 系统没有预留大页或者没有这个NUMA节点的时候分别退化成THP和默认的分配策略
+  for (int32_t numa_node : {-1, 0}) {
+    corekv::SimpleVectorAlloc alloc(2 * 1024 * 1024, numa_node);
+    std::vector<std::pair<char*, uint32_t>> objects;
+    for (int32_t i = 0; i < 50000; ++i) {
+      const uint32_t n = 1 + i % 300;
+      char* p = static_cast<char*>(alloc.Allocate(n));
+      memset(p, i, n);
+      objects.emplace_back(p, n);
+    }
+    for (size_t i = 0; i < objects.size(); ++i) {
+      for (uint32_t k = 0; k < objects[i].second; ++k) {
+        ASSERT_EQ(objects[i].first[k], static_cast<char>(i));
+      }
+    }
+    EXPECT_GE(alloc.MemoryUsage(), 2u * 1024 * 1024);
+
+    // 映射的长度按大页对齐，block多出来的部分也可以使用
+    corekv::ConcurrentArena arena(64 * 1024, 2 * 1024 * 1024, numa_node);
+    for (int32_t i = 0; i < 1000; ++i) {
+      char* p = static_cast<char*>(arena.Allocate(1000));
+      memset(p, i, 1000);
+    }
+    EXPECT_EQ(arena.MemoryUsage(), 1000u * 1000);
+  }
+}
+
+TEST(allocTest, PageSlabAlloc) {
+  for (int32_t numa_node : {-1, 0}) {
+    corekv::PageSlabAlloc alloc(2 * 1024 * 1024, numa_node);
+    EXPECT_EQ(alloc.Allocate(0), nullptr);
+    // 超过最大slot的由调用方自己分配
+    EXPECT_EQ(alloc.Allocate(corekv::PageSlabAlloc::kMaxSlotBytes + 1),
+              nullptr);
+
+    std::vector<std::pair<char*, size_t>> objects;
+    for (int32_t i = 0; i < 2000; ++i) {
+      const size_t n = 1 + (i * 7919) % corekv::PageSlabAlloc::kMaxSlotBytes;
+      char* p = static_cast<char*>(alloc.Allocate(n));
+      ASSERT_NE(p, nullptr);
+      memset(p, i, n);
+      objects.emplace_back(p, n);
+    }
+    for (size_t i = 0; i < objects.size(); ++i) {
+      for (size_t k = 0; k < objects[i].second; ++k) {
+        ASSERT_EQ(objects[i].first[k], static_cast<char>(i));
+      }
+    }
+    // 释放之后同样大小级别的申请复用原来的slot，不再映射新的chunk
+    const uint64_t usage = alloc.MemoryUsage();
+    EXPECT_GE(usage, 2u * 1024 * 1024);
+    for (const auto& [p, n] : objects) {
+      alloc.Deallocate(p, n);
+    }
+    for (size_t i = objects.size(); i-- > 0;) {
+      EXPECT_EQ(alloc.Allocate(objects[i].second), objects[i].first);
+    }
+    EXPECT_EQ(alloc.MemoryUsage(), usage);
+  }
+}
+
+TEST(allocTest, PageSlabAllocMultiThread) {
+  corekv::PageSlabAlloc alloc(0);
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&alloc, t]() {
+      std::vector<std::pair<char*, size_t>> live;
+      for (int32_t i = 0; i < 20000; ++i) {
+        const size_t n = 1000 + (i + t) % 8 * 1000;
+        char* p = static_cast<char*>(alloc.Allocate(n));
+        ASSERT_NE(p, nullptr);
+        memset(p, t, n);
+        live.emplace_back(p, n);
+        if (live.size() > 64) {
+          // 其他线程不会拿到还没有释放的slot
+          const auto& [q, m] = live.front();
+          for (size_t k = 0; k < m; ++k) {
+            ASSERT_EQ(q[k], static_cast<char>(t));
+          }
+          alloc.Deallocate(q, m);
+          live.erase(live.begin());
+        }
+      }
+      for (const auto& [p, n] : live) {
+        alloc.Deallocate(p, n);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
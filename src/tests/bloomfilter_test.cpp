@@ -4,12 +4,16 @@
 
 #include <iostream>
 #include <memory>
+#include <set>
 #include <string>
 #include <string_view>
 #include <vector>
 
+#include "filter/blocked_bloomfilter.h"
+#include "filter/ribbon_filter.h"
 #include "utils/codec.h"
 #include "utils/crc32.h"
+#include "utils/hash_util.h"
 using namespace std;
 using namespace corekv;
 using namespace corekv::crc32;
@@ -35,4 +39,129 @@ TEST(bloomFilterTest, CreateFilter) {
          << ", has_existed:" << filter_policy->MayMatch(item, 0, 0) << " ]"
          << endl;
   }
-}
\ No newline at end of file
+}
+TEST(bloomFilterTest, BlockedBloomFilter) {
+  BlockedBloomFilter policy(10);
+  EXPECT_STREQ(policy.Name(), "blocked_bloomfilter");
+  for (int32_t n : {1, 10, 100, 1000, 10000}) {
+    std::vector<std::string> keys;
+    for (int32_t i = 0; i < n; ++i) {
+      keys.emplace_back("key" + std::to_string(i));
+    }
+    std::string filter;
+    policy.CreateFilter(&keys[0], n, &filter);
+    ASSERT_EQ(filter.size() % BlockedBloomFilter::kLineBytes, 0u);
+    const uint32_t num_lines = filter.size() / BlockedBloomFilter::kLineBytes;
+    util::PutFixed32(&filter, policy.GetMeta().hash_num);
+    // 插入过的key一定能查到
+    for (const auto& key : keys) {
+      ASSERT_TRUE(policy.MayMatch(key, filter)) << key;
+    }
+    int32_t false_positives = 0;
+    for (int32_t i = 0; i < 10000; ++i) {
+      const std::string& key = "missing" + std::to_string(i);
+      const bool match = policy.MayMatch(key, filter);
+      // SIMD版本和可移植版本的结果必须完全一致
+      ASSERT_EQ(match, BlockedBloomFilter::MayMatchPortable(
+                           key, filter.data(), num_lines,
+                           policy.GetMeta().hash_num));
+      false_positives += match;
+    }
+    // 10 bits/key的理论误判率大约1%，按块划分之后略高
+    EXPECT_LT(false_positives, 300) << n;
+  }
+}
+TEST(bloomFilterTest, RibbonFilter) {
+  RibbonFilter policy(10);
+  BloomFilter bloom(10);
+  EXPECT_STREQ(policy.Name(), "ribbon_filter");
+  for (int32_t n : {1, 10, 100, 1000, 10000, 100000}) {
+    std::vector<std::string> keys;
+    for (int32_t i = 0; i < n; ++i) {
+      keys.emplace_back("key" + std::to_string(i));
+    }
+    std::string filter;
+    policy.CreateFilter(&keys[0], n, &filter);
+    util::PutFixed32(&filter, policy.GetMeta().hash_num);
+    // 插入过的key一定能查到
+    for (const auto& key : keys) {
+      ASSERT_TRUE(policy.MayMatch(key, filter)) << key;
+    }
+    int32_t false_positives = 0;
+    for (int32_t i = 0; i < 10000; ++i) {
+      false_positives += policy.MayMatch("missing" + std::to_string(i), filter);
+    }
+    // 和10 bits/key的BloomFilter误判率相当
+    EXPECT_LT(false_positives, 200) << n;
+    if (n >= 1000) {
+      std::string bloom_filter;
+      bloom.CreateFilter(&keys[0], n, &bloom_filter);
+      // key足够多的时候比BloomFilter至少节省20%的空间
+      EXPECT_LT(filter.size(), bloom_filter.size() * 0.8) << n;
+    }
+    std::cout << "n:" << n << ", bits/key:" << filter.size() * 8.0 / n
+              << ", false positives:" << false_positives << "/10000"
+              << std::endl;
+  }
+}
+
+TEST(bloomFilterTest, LegacyFormat) {
+  BloomFilter policy(10);
+  EXPECT_EQ(DecodeFilterFormat(policy.GetMeta().hash_num), kFilterFormatHash64);
+  const uint32_t hash_num = DecodeHashNum(policy.GetMeta().hash_num);
+  std::vector<std::string> keys;
+  for (int32_t i = 0; i < 1000; ++i) {
+    keys.emplace_back("key" + std::to_string(i));
+  }
+  // 旧版本写入的filter: 32位hash取模，末尾的hash_num没有格式版本
+  const uint32_t bits = keys.size() * 10;
+  std::string legacy((bits + 7) / 8, '\0');
+  for (const auto& key : keys) {
+    uint32_t h = hash_util::SimMurMurHash(key.data(), key.size());
+    const uint32_t delta = (h >> 17) | (h << 15);
+    for (uint32_t j = 0; j < hash_num; ++j) {
+      const uint32_t bitpos = h % (legacy.size() * 8);
+      legacy[bitpos / 8] |= (1 << (bitpos % 8));
+      h += delta;
+    }
+  }
+  util::PutFixed32(&legacy, hash_num);
+  std::string filter;
+  policy.CreateFilter(&keys[0], keys.size(), &filter);
+  util::PutFixed32(&filter, policy.GetMeta().hash_num);
+  int32_t legacy_positives = 0, false_positives = 0;
+  for (const auto& key : keys) {
+    ASSERT_TRUE(policy.MayMatch(key, legacy)) << key;
+    ASSERT_TRUE(policy.MayMatch(key, filter)) << key;
+  }
+  for (int32_t i = 0; i < 10000; ++i) {
+    const std::string& key = "missing" + std::to_string(i);
+    legacy_positives += policy.MayMatch(key, legacy);
+    false_positives += policy.MayMatch(key, filter);
+  }
+  EXPECT_LT(legacy_positives, 200);
+  EXPECT_LT(false_positives, 200);
+  // 不认识的格式版本不过滤
+  std::string future = filter;
+  future.resize(future.size() - 4);
+  util::PutFixed32(&future, EncodeHashNum(hash_num, FilterFormat(7)));
+  EXPECT_TRUE(policy.MayMatch("missing", future));
+}
+
+TEST(bloomFilterTest, Hash64) {
+  const std::string data(1000, 'x');
+  // 长度不同的前缀结果都不相同，覆盖<4、<=16、<=48和更长的分支
+  std::set<uint64_t> hashes;
+  for (size_t len = 0; len <= data.size(); ++len) {
+    hashes.insert(hash_util::Hash64(data.data(), len));
+  }
+  EXPECT_EQ(hashes.size(), data.size() + 1);
+  EXPECT_NE(hash_util::Hash64("key", 3, 0), hash_util::Hash64("key", 3, 1));
+  // 只改变一个字节也会改变结果
+  std::string other = data;
+  other[500] = 'y';
+  EXPECT_NE(hash_util::Hash64(data.data(), data.size()),
+            hash_util::Hash64(other.data(), other.size()));
+  EXPECT_EQ(hash_util::HashKey(std::string("key")),
+            hash_util::Hash64("key", 3));
+}
@@ -1,13 +1,18 @@
-
-
 #include "cache/cache.h"
+#include "cache/count_min_sketch.h"
+#include "memory/area.h"
 
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <random>
+#include <set>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
 using namespace std;
 using namespace corekv;
@@ -24,7 +29,382 @@ TEST(cacheTest, Insert) {
   std::string* corekv1 = new std::string("corekv");
   cache_handler->Insert(corekv, corekv1);
   CacheNode<std::string, std::string>* node = cache_handler->Get(corekv);
-  
+  ASSERT_NE(node, nullptr);
+  EXPECT_EQ(*node->value, "corekv");
   std::cout << "value:" << node->value << std::endl;
   cache_handler->Release(node);
-}
\ No newline at end of file
+}
+
+TEST(cacheTest, EvictAndRelease) {
+  std::atomic<int32_t> deleted{0};
+  ShardCache<uint64_t, std::string> cache(2, 1);
+  cache.RegistCleanHandle([&deleted](const uint64_t&, std::string* value) {
+    delete value;
+    ++deleted;
+  });
+  cache.Insert(1, new std::string("v1"));
+  cache.Insert(2, new std::string("v2"));
+  auto* node = cache.Get(1);
+  ASSERT_NE(node, nullptr);
+  // 2是最久没有被访问的，被淘汰
+  cache.Insert(3, new std::string("v3"));
+  EXPECT_EQ(cache.Get(2), nullptr);
+  EXPECT_EQ(deleted, 1);
+  // 被淘汰之后还有外部引用的节点，要等到Release之后才析构
+  cache.Insert(4, new std::string("v4"));
+  cache.Insert(5, new std::string("v5"));
+  EXPECT_EQ(cache.Get(1), nullptr);
+  EXPECT_EQ(*node->value, "v1");
+  EXPECT_EQ(deleted, 2);
+  cache.Release(node);
+  EXPECT_EQ(deleted, 3);
+  // 相同的key覆盖旧值
+  cache.Insert(5, new std::string("v5'"));
+  node = cache.Get(5);
+  ASSERT_NE(node, nullptr);
+  EXPECT_EQ(*node->value, "v5'");
+  cache.Release(node);
+  cache.Erase(5);
+  EXPECT_EQ(cache.Get(5), nullptr);
+}
+
+TEST(cacheTest, Concurrent) {
+  static constexpr int32_t kThreadNum = 8;
+  static constexpr uint64_t kKeyNum = 1000;
+  ShardCache<uint64_t, uint64_t> cache(kKeyNum / 2, 4);
+  EXPECT_EQ(cache.ShardNum(), 4u);
+  cache.RegistCleanHandle([](const uint64_t&, uint64_t* value) { delete value; });
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < kThreadNum; ++t) {
+    threads.emplace_back([&cache, t]() {
+      for (uint64_t i = 0; i < 20000; ++i) {
+        const uint64_t key = (i * 7 + t) % kKeyNum;
+        auto* node = cache.Get(key);
+        if (node == nullptr) {
+          cache.Insert(key, new uint64_t(key));
+        } else {
+          ASSERT_EQ(*node->value, key);
+          cache.Release(node);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  cache.Prune();
+}
+
+template <typename PolicyType>
+class CachePolicyTest : public ::testing::Test {};
+using Policies = ::testing::Types<LruCachePolicy<uint64_t, uint64_t>,
+                                  WTinyLfuCachePolicy<uint64_t, uint64_t>,
+                                  ClockCachePolicy<uint64_t, uint64_t>>;
+TYPED_TEST_SUITE(CachePolicyTest, Policies);
+
+TYPED_TEST(CachePolicyTest, InsertEraseMatchesModel) {
+  // 容量足够大，不会发生淘汰，大量的插入删除用来检查哈希表删除之后的搬移逻辑
+  TypeParam cache(4096);
+  cache.RegistCleanHandle([](const uint64_t&, uint64_t* value) { delete value; });
+  std::set<uint64_t> model;
+  std::mt19937 rnd(301);
+  for (int32_t i = 0; i < 100000; ++i) {
+    const uint64_t key = rnd() % 3000;
+    if (rnd() % 3 == 0) {
+      cache.Erase(key);
+      model.erase(key);
+    } else {
+      cache.Insert(key, new uint64_t(key));
+      model.insert(key);
+    }
+    const uint64_t probe = rnd() % 3000;
+    auto* node = cache.Get(probe);
+    ASSERT_EQ(node != nullptr, model.count(probe) != 0);
+    if (node != nullptr) {
+      ASSERT_EQ(*node->value, probe);
+      cache.Release(node);
+    }
+  }
+  std::set<uint64_t> keys;
+  cache.ApplyToAllKeys([&keys](const uint64_t& key) {
+    EXPECT_TRUE(keys.insert(key).second);
+  });
+  EXPECT_EQ(keys, model);
+}
+
+TYPED_TEST(CachePolicyTest, PinnedNodeOutlivesEviction) {
+  int32_t deleted = 0;
+  TypeParam cache(4);
+  cache.RegistCleanHandle([&deleted](const uint64_t&, uint64_t* value) {
+    delete value;
+    ++deleted;
+  });
+  cache.Insert(0, new uint64_t(0));
+  auto* node = cache.Get(0);
+  ASSERT_NE(node, nullptr);
+  for (uint64_t i = 1; i < 100; ++i) {
+    cache.Insert(i, new uint64_t(i));
+    // 新key的访问频率比0高，W-TinyLFU的准入不依赖于sketch中的hash冲突
+    for (int32_t j = 0; j < 2; ++j) {
+      auto* hot = cache.Get(i);
+      if (hot != nullptr) {
+        cache.Release(hot);
+      }
+    }
+  }
+  // 容量只有4，0早就被淘汰了，但是还有外部引用
+  EXPECT_EQ(cache.Get(0), nullptr);
+  EXPECT_EQ(*node->value, 0u);
+  const int32_t before = deleted;
+  cache.Release(node);
+  EXPECT_EQ(deleted, before + 1);
+}
+
+TYPED_TEST(CachePolicyTest, InsertAndRef) {
+  int32_t deleted = 0;
+  TypeParam cache(100);
+  cache.RegistCleanHandle([&deleted](const uint64_t&, uint64_t* value) {
+    delete value;
+    ++deleted;
+  });
+  auto* node = cache.InsertAndRef(1, new uint64_t(1), 10);
+  ASSERT_NE(node, nullptr);
+  EXPECT_EQ(cache.GetPinnedUsage(), 10u);
+  cache.Release(node);
+  EXPECT_EQ(cache.GetPinnedUsage(), 0u);
+  EXPECT_EQ(deleted, 0);
+  // 超过容量的节点不会被缓存，但是在Release之前仍然可以使用
+  node = cache.InsertAndRef(2, new uint64_t(2), 1000);
+  ASSERT_NE(node, nullptr);
+  EXPECT_EQ(*node->value, 2u);
+  EXPECT_EQ(cache.Get(2), nullptr);
+  EXPECT_EQ(cache.GetPinnedUsage(), 1000u);
+  cache.Release(node);
+  EXPECT_EQ(deleted, 1);
+  EXPECT_EQ(cache.GetPinnedUsage(), 0u);
+  EXPECT_EQ(cache.GetUsage(), 10u);
+}
+
+TYPED_TEST(CachePolicyTest, ChargeBasedCapacity) {
+  TypeParam cache(1000);
+  cache.RegistCleanHandle([](const uint64_t&, uint64_t* value) { delete value; });
+  for (uint64_t i = 0; i < 100; ++i) {
+    cache.Insert(i, new uint64_t(i), 100);
+    ASSERT_LE(cache.GetUsage(), 1000u);
+  }
+  EXPECT_GT(cache.GetUsage(), 0u);
+  // 超过容量的节点不会被缓存
+  cache.Insert(1000, new uint64_t(1000), 2000);
+  EXPECT_EQ(cache.Get(1000), nullptr);
+  EXPECT_LE(cache.GetUsage(), 1000u);
+
+  cache.Insert(2000, new uint64_t(2000), 10);
+  auto* node = cache.Get(2000);
+  ASSERT_NE(node, nullptr);
+  EXPECT_EQ(cache.GetPinnedUsage(), 10u);
+  auto* again = cache.Get(2000);
+  EXPECT_EQ(cache.GetPinnedUsage(), 10u);
+  cache.Release(again);
+  // 被删除之后还没有Release，仍然算作pinned
+  cache.Erase(2000);
+  EXPECT_EQ(cache.GetPinnedUsage(), 10u);
+  cache.Release(node);
+  EXPECT_EQ(cache.GetPinnedUsage(), 0u);
+  cache.Prune();
+  EXPECT_EQ(cache.GetUsage(), 0u);
+}
+
+TEST(cacheTest, CountMinSketchEstimate) {
+  CountMinSketch sketch(1024);
+  for (int32_t i = 0; i < 10; ++i) {
+    sketch.Increment(42);
+  }
+  sketch.Increment(7);
+  EXPECT_EQ(sketch.Estimate(42), 10);
+  EXPECT_EQ(sketch.Estimate(7), 1);
+  EXPECT_EQ(sketch.Estimate(1000), 0);
+  // counter最大为15
+  for (int32_t i = 0; i < 100; ++i) {
+    sketch.Increment(42);
+  }
+  EXPECT_EQ(sketch.Estimate(42), 15);
+  sketch.Reset();
+  EXPECT_EQ(sketch.Estimate(42), 7);
+}
+
+TEST(cacheTest, CountMinSketchNeverUnderestimates) {
+  CountMinSketch sketch(4096);
+  std::mt19937 rnd(17);
+  std::vector<int32_t> counts(2000, 0);
+  for (int32_t i = 0; i < 10000; ++i) {
+    const uint32_t key = rnd() % counts.size();
+    sketch.Increment(key);
+    ++counts[key];
+  }
+  int32_t exact = 0;
+  for (uint32_t key = 0; key < counts.size(); ++key) {
+    const int32_t estimate = sketch.Estimate(key);
+    EXPECT_GE(estimate, std::min(counts[key], 15));
+    exact += (estimate == std::min(counts[key], 15));
+  }
+  // 宽度足够的时候绝大部分的估计都是准确的
+  EXPECT_GT(exact, 1800);
+}
+
+// 热点数据被反复访问，中间穿插一次性的扫描，统计热点数据的命中率
+template <typename PolicyType>
+static double HotHitRatio() {
+  static constexpr uint64_t kHotNum = 50;
+  PolicyType cache(100);
+  cache.RegistCleanHandle([](const uint64_t&, uint64_t* value) { delete value; });
+  uint64_t hits = 0, total = 0;
+  uint64_t scan_key = 1000000;
+  for (int32_t round = 0; round < 200; ++round) {
+    for (uint64_t key = 0; key < kHotNum; ++key) {
+      auto* node = cache.Get(key);
+      ++total;
+      if (node != nullptr) {
+        ++hits;
+        cache.Release(node);
+      } else {
+        cache.Insert(key, new uint64_t(key));
+      }
+    }
+    for (int32_t i = 0; i < 200; ++i, ++scan_key) {
+      if (cache.Get(scan_key) == nullptr) {
+        cache.Insert(scan_key, new uint64_t(scan_key));
+      }
+    }
+  }
+  return static_cast<double>(hits) / total;
+}
+
+TEST(cacheTest, WTinyLfuResistsScan) {
+  const double lru = HotHitRatio<LruCachePolicy<uint64_t, uint64_t>>();
+  const double lfu = HotHitRatio<WTinyLfuCachePolicy<uint64_t, uint64_t>>();
+  std::cout << "hot hit ratio, lru:" << lru << ", w-tinylfu:" << lfu
+            << std::endl;
+  EXPECT_GT(lfu, 0.9);
+  EXPECT_GT(lfu, lru);
+}
+
+TEST(cacheTest, ShardedWTinyLfu) {
+  ShardCache<uint64_t, uint64_t, WTinyLfuCachePolicy> cache(1000, 4);
+  cache.RegistCleanHandle([](const uint64_t&, uint64_t* value) { delete value; });
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache, t]() {
+      for (uint64_t i = 0; i < 20000; ++i) {
+        const uint64_t key = (i * 13 + t) % 3000;
+        auto* node = cache.Get(key);
+        if (node == nullptr) {
+          cache.Insert(key, new uint64_t(key));
+        } else {
+          ASSERT_EQ(*node->value, key);
+          cache.Release(node);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+TEST(cacheTest, ClockSecondChance) {
+  ClockCachePolicy<uint64_t, uint64_t> cache(4);
+  cache.RegistCleanHandle([](const uint64_t&, uint64_t* value) { delete value; });
+  for (uint64_t i = 0; i < 4; ++i) {
+    cache.Insert(i, new uint64_t(i));
+  }
+  // 访问过的节点在第一轮扫描中只清除标记，没有访问过的节点先被淘汰
+  for (uint64_t key : {0, 2}) {
+    cache.Release(cache.Get(key));
+  }
+  cache.Insert(4, new uint64_t(4));
+  cache.Insert(5, new uint64_t(5));
+  for (uint64_t key : {0, 2, 4, 5}) {
+    auto* node = cache.Get(key);
+    ASSERT_NE(node, nullptr) << key;
+    cache.Release(node);
+  }
+  EXPECT_EQ(cache.Get(1), nullptr);
+  EXPECT_EQ(cache.Get(3), nullptr);
+}
+
+TEST(cacheTest, ShardedClockReadMostly) {
+  static constexpr uint64_t kKeyNum = 1000;
+  ShardCache<uint64_t, uint64_t, ClockCachePolicy> cache(kKeyNum, 4);
+  cache.RegistCleanHandle([](const uint64_t&, uint64_t* value) { delete value; });
+  for (uint64_t key = 0; key < kKeyNum; ++key) {
+    cache.Insert(key, new uint64_t(key));
+  }
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < 8; ++t) {
+    threads.emplace_back([&cache, t]() {
+      for (uint64_t i = 0; i < 50000; ++i) {
+        // 大部分访问命中，少量的插入触发淘汰
+        const uint64_t key = (i * 7 + t) % (i % 20 == 0 ? 3 * kKeyNum : kKeyNum);
+        auto* node = cache.Get(key);
+        if (node == nullptr) {
+          cache.Insert(key, new uint64_t(key));
+        } else {
+          ASSERT_EQ(*node->value, key);
+          cache.Release(node);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_LE(cache.GetUsage(), kKeyNum);
+  EXPECT_EQ(cache.GetPinnedUsage(), 0u);
+}
+
+TEST(cacheTest, ShardAllocator) {
+  // 默认不分配value的数据
+  ShardCache<uint64_t, std::string> plain(1024, 4);
+  EXPECT_EQ(plain.ShardAllocator(1), nullptr);
+
+  // 每个分片一个分配器，4个分片轮流绑定到2个节点上
+  ShardCache<uint64_t, std::string> cache(1024, 4, 0, 2);
+  std::set<PageSlabAlloc*> allocators;
+  std::set<int32_t> nodes;
+  for (uint64_t key = 0; key < 1000; ++key) {
+    PageSlabAlloc* alloc = cache.ShardAllocator(key);
+    ASSERT_NE(alloc, nullptr);
+    EXPECT_EQ(cache.ShardAllocator(key), alloc);
+    allocators.insert(alloc);
+    nodes.insert(alloc->numa_node());
+  }
+  EXPECT_EQ(allocators.size(), 4u);
+  EXPECT_EQ(nodes, std::set<int32_t>({0, 1}));
+
+  // 淘汰的value把数据还给所在分片的分配器，每个分片只保留4个value，slot被反复复用
+  struct Buffer {
+    char* data;
+  };
+  ShardCache<uint64_t, Buffer> buffers(4 * 4 * 4096, 4, 0, 2);
+  buffers.RegistCleanHandle([&buffers](const uint64_t& key, Buffer* value) {
+    buffers.ShardAllocator(key)->Deallocate(value->data, 4096);
+    delete value;
+  });
+  for (uint64_t key = 0; key < 10000; ++key) {
+    char* data =
+        static_cast<char*>(buffers.ShardAllocator(key)->Allocate(4096));
+    ASSERT_NE(data, nullptr);
+    memset(data, static_cast<int>(key), 4096);
+    buffers.Insert(key, new Buffer{data}, 4096);
+  }
+  std::set<PageSlabAlloc*> shard_allocators;
+  for (uint64_t key = 0; key < 10000; ++key) {
+    shard_allocators.insert(buffers.ShardAllocator(key));
+  }
+  uint64_t usage = 0;
+  for (PageSlabAlloc* alloc : shard_allocators) {
+    usage += alloc->MemoryUsage();
+  }
+  // 不复用的话每个分片需要10MB
+  EXPECT_LE(usage, 4 * PageSlabAlloc::kChunkBytes);
+}
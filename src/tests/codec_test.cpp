@@ -0,0 +1,85 @@
+#include "utils/codec.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace corekv;
+using namespace corekv::util;
+
+namespace {
+// 各种长度的varint，覆盖每个字节数的边界
+std::vector<uint64_t> TestValues() {
+  std::vector<uint64_t> values = {0, 1, UINT32_MAX, UINT64_MAX};
+  for (uint32_t bits = 1; bits < 64; ++bits) {
+    const uint64_t power = 1ull << bits;
+    values.push_back(power - 1);
+    values.push_back(power);
+    values.push_back(power + 1);
+  }
+  return values;
+}
+}  // namespace
+
+// 解析结果不受后面的数据影响，buffer末尾不足8个字节的时候走逐字节解析
+TEST(codec_Test, Varint64) {
+  const std::vector<uint64_t> values = TestValues();
+  std::string buffer;
+  for (const uint64_t value : values) {
+    PutVarint64(&buffer, value);
+  }
+  const char* p = buffer.data();
+  const char* limit = p + buffer.size();
+  for (const uint64_t expected : values) {
+    uint64_t actual;
+    const char* start = p;
+    p = GetVarint64Ptr(p, limit, &actual);
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(actual, expected);
+    EXPECT_EQ(p - start, VarintLength(expected));
+  }
+  EXPECT_EQ(p, limit);
+}
+
+TEST(codec_Test, Varint32) {
+  std::string buffer;
+  std::vector<uint32_t> values;
+  for (const uint64_t value : TestValues()) {
+    if (value <= UINT32_MAX) {
+      values.push_back(static_cast<uint32_t>(value));
+      PutVarint32(&buffer, static_cast<uint32_t>(value));
+    }
+  }
+  std::string_view input(buffer);
+  for (const uint32_t expected : values) {
+    uint32_t actual;
+    ASSERT_TRUE(GetVarint32(&input, &actual));
+    EXPECT_EQ(actual, expected);
+  }
+  EXPECT_TRUE(input.empty());
+}
+
+TEST(codec_Test, VarintCorruption) {
+  // varint32超过5个字节，不论后面还有多少数据
+  for (const size_t size : {6, 16}) {
+    const std::string buffer(size, '\x81');
+    uint32_t value32;
+    EXPECT_EQ(GetVarint32Ptr(buffer.data(), buffer.data() + size, &value32),
+              nullptr);
+  }
+  // varint64超过10个字节
+  const std::string buffer(16, '\xff');
+  uint64_t value64;
+  EXPECT_EQ(GetVarint64Ptr(buffer.data(), buffer.data() + buffer.size(),
+                           &value64),
+            nullptr);
+  // 数据在varint结束之前截断
+  std::string truncated;
+  PutVarint64(&truncated, UINT64_MAX);
+  for (size_t size = 0; size < truncated.size(); ++size) {
+    EXPECT_EQ(GetVarint64Ptr(truncated.data(), truncated.data() + size,
+                             &value64),
+              nullptr);
+  }
+}
@@ -0,0 +1,76 @@
+#include "utils/crc32.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <random>
+#include <string>
+
+using namespace corekv;
+// 逐位计算的crc32c，用来校验查表和硬件实现
+static uint32_t BitwiseCRC32C(const std::string& data) {
+  uint32_t crc = 0xffffffffu;
+  for (unsigned char c : data) {
+    crc ^= c;
+    for (int32_t i = 0; i < 8; ++i) {
+      crc = (crc >> 1) ^ (0x82f63b78u & (0u - (crc & 1)));
+    }
+  }
+  return crc ^ 0xffffffffu;
+}
+
+TEST(crc32Test, StandardResults) {
+  // rfc3720 B.4
+  char buf[32];
+  memset(buf, 0, sizeof(buf));
+  EXPECT_EQ(0x8a9136aau, crc32::Value(buf, sizeof(buf)));
+  memset(buf, 0xff, sizeof(buf));
+  EXPECT_EQ(0x62a8ab43u, crc32::Value(buf, sizeof(buf)));
+  for (int32_t i = 0; i < 32; ++i) {
+    buf[i] = static_cast<char>(i);
+  }
+  EXPECT_EQ(0x46dd794eu, crc32::Value(buf, sizeof(buf)));
+  for (int32_t i = 0; i < 32; ++i) {
+    buf[i] = static_cast<char>(31 - i);
+  }
+  EXPECT_EQ(0x113fdb5cu, crc32::Value(buf, sizeof(buf)));
+  EXPECT_EQ(0xe3069283u, crc32::Value("123456789", 9));
+}
+
+TEST(crc32Test, MatchesBitwise) {
+  std::mt19937 rnd(301);
+  std::string data(64 * 1024 + 7, '\0');
+  for (auto& c : data) {
+    c = static_cast<char>(rnd());
+  }
+  // 覆盖不同的长度和起始对齐，包括3路交错计算的边界
+  for (size_t len : {0, 1, 7, 8, 15, 767, 768, 769, 1536, 4096, 4103, 65536}) {
+    for (size_t offset : {0, 1, 3, 7}) {
+      const std::string piece = data.substr(offset, len);
+      ASSERT_EQ(crc32::Value(piece.data(), piece.size()), BitwiseCRC32C(piece))
+          << "len " << len << " offset " << offset;
+    }
+  }
+}
+
+TEST(crc32Test, Extend) {
+  std::mt19937 rnd(302);
+  std::string data(10000, '\0');
+  for (auto& c : data) {
+    c = static_cast<char>(rnd());
+  }
+  const uint32_t expected = crc32::Value(data.data(), data.size());
+  for (size_t split : {0, 1, 100, 768, 2500, 9999, 10000}) {
+    const uint32_t crc = crc32::Value(data.data(), split);
+    EXPECT_EQ(crc32::Extend(crc, data.data() + split, data.size() - split),
+              expected);
+  }
+}
+
+TEST(crc32Test, Mask) {
+  const uint32_t crc = crc32::Value("foo", 3);
+  EXPECT_NE(crc, crc32::Mask(crc));
+  EXPECT_NE(crc, crc32::Mask(crc32::Mask(crc)));
+  EXPECT_EQ(crc, crc32::Unmask(crc32::Mask(crc)));
+  EXPECT_EQ(crc, crc32::Unmask(crc32::Unmask(crc32::Mask(crc32::Mask(crc)))));
+}
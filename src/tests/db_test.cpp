@@ -0,0 +1,2365 @@
+#include "db/db.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "db/backup_engine.h"
+#include "db/checkpoint.h"
+#include "memory/huge_page.h"
+#include "db/comparator.h"
+#include "db/compaction_filter.h"
+#include "db/dbformat.h"
+#include "db/memtable_rep.h"
+#include "db/merge_operator.h"
+#include "db/write_batch.h"
+#include "file/file.h"
+#include "filter/bloomfilter.h"
+#include "filter/ribbon_filter.h"
+#include "db/prefix_extractor.h"
+#include "db/sst_file_writer.h"
+#include "table/compression.h"
+#include "utils/codec.h"
+#include "utils/perf_context.h"
+#include "utils/rate_limiter.h"
+#include "utils/statistics.h"
+
+using namespace std;
+using namespace corekv;
+
+static const std::string kDBName = "db_test_dir";
+
+class DBTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    DestroyDB(kDBName, options_);
+    options_.create_if_missing = true;
+    options_.filter_policy = std::make_shared<BloomFilter>(10);
+    Reopen();
+  }
+  void TearDown() override {
+    db_.reset();
+    DestroyDB(kDBName, options_);
+  }
+  void Reopen() {
+    db_.reset();
+    DB* db = nullptr;
+    ASSERT_EQ(DB::Open(options_, kDBName, &db), Status::kSuccess);
+    db_.reset(db);
+  }
+  std::string Get(const std::string& key) {
+    std::string value;
+    DBStatus s = db_->Get(ReadOptions(), key, &value);
+    if (s == Status::kNotFound) {
+      return "NOT_FOUND";
+    }
+    return value;
+  }
+  // 正向和反向遍历的结果需要一致
+  std::string Contents() {
+    std::unique_ptr<Iterator> iter(db_->NewIterator(ReadOptions()));
+    std::string forward;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      forward.append(iter->key());
+      forward.append("=").append(iter->value()).append(";");
+    }
+    std::vector<std::string> backward;
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      backward.emplace_back(std::string(iter->key()) + "=" +
+                            std::string(iter->value()) + ";");
+    }
+    std::string reversed;
+    for (auto it = backward.rbegin(); it != backward.rend(); ++it) {
+      reversed.append(*it);
+    }
+    EXPECT_EQ(forward, reversed);
+    return forward;
+  }
+
+  int32_t NumFilesAtLevel(int32_t level) {
+    std::string value;
+    EXPECT_TRUE(db_->GetProperty(
+        "corekv.num-files-at-level" + std::to_string(level), &value));
+    return std::stoi(value);
+  }
+
+  // 很小的memtable和sst，CompactAndVerify写入的数据会分布到多层
+  void UseSmallFiles() {
+    options_.write_buffer_size = 32 * 1024;
+    options_.max_file_size = 32 * 1024;
+    options_.max_bytes_for_level_base = 128 * 1024;
+    options_.max_bytes_for_level_multiplier = 4;
+  }
+
+  // 大量覆盖写和删除之后，等待compaction把level0的文件个数降到触发阈值以下，
+  // 然后和model对比
+  void CompactAndVerify() {
+    std::map<std::string, std::string> model;
+    for (int32_t i = 0; i < 30000; ++i) {
+      const std::string& key = "key" + std::to_string((i * 7919) % 5000);
+      if (i % 11 == 0) {
+        ASSERT_EQ(db_->Delete(WriteOptions(), key), Status::kSuccess);
+        model.erase(key);
+      } else {
+        const std::string& value = std::to_string(i) + std::string(80, 'x');
+        ASSERT_EQ(db_->Put(WriteOptions(), key, value), Status::kSuccess);
+        model[key] = value;
+      }
+    }
+    // 等待后台compaction减少level0的文件
+    for (int32_t retry = 0;
+         retry < 500 &&
+         NumFilesAtLevel(0) >= options_.level0_file_num_compaction_trigger;
+         ++retry) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_LT(NumFilesAtLevel(0), options_.level0_file_num_compaction_trigger);
+    int32_t deeper_files = 0;
+    for (int32_t level = 1; level < 7; ++level) {
+      deeper_files += NumFilesAtLevel(level);
+    }
+    // universal方式下所有的sorted run都留在level0
+    if (options_.compaction_style == kCompactionStyleUniversal) {
+      EXPECT_EQ(deeper_files, 0);
+    } else {
+      EXPECT_GT(deeper_files, 0);
+    }
+
+    auto check = [&]() {
+      for (int32_t i = 0; i < 5000; ++i) {
+        const std::string& key = "key" + std::to_string(i);
+        auto iter = model.find(key);
+        ASSERT_EQ(Get(key), iter == model.end() ? "NOT_FOUND" : iter->second);
+      }
+      CheckMultiGet(model, 5000);
+      std::string expected;
+      for (const auto& item : model) {
+        expected.append(item.first + "=" + item.second + ";");
+      }
+      ASSERT_EQ(Contents(), expected);
+    };
+    check();
+    Reopen();
+    check();
+  }
+
+  // 每次100个key批量查找，其中有一部分key从来没有写入过，结果需要和model一致
+  void CheckMultiGet(const std::map<std::string, std::string>& model,
+                     int32_t key_num) {
+    for (int32_t begin = 0; begin < key_num; begin += 100) {
+      std::vector<std::string> keys;
+      for (int32_t i = begin; i < begin + 100; ++i) {
+        keys.push_back("key" + std::to_string((i * 37) % key_num));
+        if (i % 10 == 0) {
+          keys.push_back("missing" + std::to_string(i));
+        }
+      }
+      std::vector<std::string_view> key_views(keys.begin(), keys.end());
+      std::vector<std::string> values;
+      const auto& statuses = db_->MultiGet(ReadOptions(), key_views, &values);
+      ASSERT_EQ(statuses.size(), keys.size());
+      ASSERT_EQ(values.size(), keys.size());
+      for (size_t i = 0; i < keys.size(); ++i) {
+        auto iter = model.find(keys[i]);
+        if (iter == model.end()) {
+          ASSERT_EQ(statuses[i], Status::kNotFound) << keys[i];
+        } else {
+          ASSERT_EQ(statuses[i], Status::kSuccess) << keys[i];
+          ASSERT_EQ(values[i], iter->second) << keys[i];
+        }
+      }
+    }
+  }
+
+  // db目录下所有的MANIFEST文件
+  std::vector<std::string> Manifests() {
+    std::vector<std::string> filenames, result;
+    FileTool::GetChildren(kDBName, &filenames);
+    for (const auto& filename : filenames) {
+      if (filename.rfind("MANIFEST-", 0) == 0) {
+        result.push_back(filename);
+      }
+    }
+    return result;
+  }
+
+  Options options_;
+  // 需要比db_后析构
+  std::unique_ptr<Cache<uint64_t, DataBlock>> block_cache_;
+  std::unique_ptr<Cache<std::string, std::string>> row_cache_;
+  std::unique_ptr<DB> db_;
+};
+
+TEST_F(DBTest, PutGetDelete) {
+  ASSERT_EQ(db_->Put(WriteOptions(), "foo", "v1"), Status::kSuccess);
+  EXPECT_EQ(Get("foo"), "v1");
+  ASSERT_EQ(db_->Put(WriteOptions(), "foo", "v2"), Status::kSuccess);
+  EXPECT_EQ(Get("foo"), "v2");
+  ASSERT_EQ(db_->Delete(WriteOptions(), "foo"), Status::kSuccess);
+  EXPECT_EQ(Get("foo"), "NOT_FOUND");
+  EXPECT_EQ(Get("missing"), "NOT_FOUND");
+}
+
+TEST_F(DBTest, WriteBatch) {
+  WriteBatch batch;
+  batch.Put("a", "va");
+  batch.Put("b", "vb");
+  batch.Delete("a");
+  batch.Put("c", "vc");
+  ASSERT_EQ(db_->Write(WriteOptions(), &batch), Status::kSuccess);
+  EXPECT_EQ(Contents(), "b=vb;c=vc;");
+}
+
+TEST_F(DBTest, Iterator) {
+  db_->Put(WriteOptions(), "b", "vb");
+  db_->Put(WriteOptions(), "a", "va");
+  db_->Put(WriteOptions(), "c", "vc");
+  db_->Delete(WriteOptions(), "b");
+  EXPECT_EQ(Contents(), "a=va;c=vc;");
+
+  std::unique_ptr<Iterator> iter(db_->NewIterator(ReadOptions()));
+  iter->Seek("b");
+  ASSERT_TRUE(iter->Valid());
+  EXPECT_EQ(iter->key(), "c");
+  iter->Prev();
+  ASSERT_TRUE(iter->Valid());
+  EXPECT_EQ(iter->key(), "a");
+  // 迭代器创建之后的写入不可见
+  db_->Put(WriteOptions(), "d", "vd");
+  iter->Seek("d");
+  EXPECT_FALSE(iter->Valid());
+}
+
+TEST_F(DBTest, Recover) {
+  WriteOptions sync;
+  sync.sync = true;
+  db_->Put(sync, "foo", "v1");
+  db_->Put(sync, "baz", "v5");
+  Reopen();
+  EXPECT_EQ(Get("foo"), "v1");
+  EXPECT_EQ(Get("baz"), "v5");
+  db_->Put(sync, "bar", "v2");
+  db_->Put(sync, "foo", "v3");
+  Reopen();
+  EXPECT_EQ(Get("foo"), "v3");
+  db_->Put(sync, "foo", "v4");
+  EXPECT_EQ(Get("foo"), "v4");
+  EXPECT_EQ(Get("bar"), "v2");
+  EXPECT_EQ(Get("baz"), "v5");
+}
+
+TEST_F(DBTest, FlushToTable) {
+  options_.write_buffer_size = 64 * 1024;
+  Reopen();
+  std::map<std::string, std::string> model;
+  for (int32_t i = 0; i < 5000; ++i) {
+    const std::string& key = "key" + std::to_string(i % 1000);
+    const std::string& value = std::string(100, 'a' + i % 26);
+    ASSERT_EQ(db_->Put(WriteOptions(), key, value), Status::kSuccess);
+    model[key] = value;
+    if (i % 7 == 0) {
+      db_->Delete(WriteOptions(), key);
+      model.erase(key);
+    }
+  }
+  auto check = [&]() {
+    for (int32_t i = 0; i < 1000; ++i) {
+      const std::string& key = "key" + std::to_string(i);
+      auto iter = model.find(key);
+      EXPECT_EQ(Get(key), iter == model.end() ? "NOT_FOUND" : iter->second);
+    }
+    std::string expected;
+    for (const auto& item : model) {
+      expected.append(item.first + "=" + item.second + ";");
+    }
+    EXPECT_EQ(Contents(), expected);
+  };
+  check();
+  Reopen();
+  check();
+}
+
+TEST_F(DBTest, ConcurrentWrite) {
+  static constexpr int32_t kThreadNum = 4;
+  static constexpr int32_t kKeyNumPerThread = 2000;
+  options_.write_buffer_size = 128 * 1024;
+  Reopen();
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < kThreadNum; ++t) {
+    threads.emplace_back([this, t]() {
+      for (int32_t i = 0; i < kKeyNumPerThread; ++i) {
+        const std::string& key = std::to_string(t) + "_" + std::to_string(i);
+        ASSERT_EQ(db_->Put(WriteOptions(), key, key), Status::kSuccess);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  Reopen();
+  for (int32_t t = 0; t < kThreadNum; ++t) {
+    for (int32_t i = 0; i < kKeyNumPerThread; ++i) {
+      const std::string& key = std::to_string(t) + "_" + std::to_string(i);
+      ASSERT_EQ(Get(key), key);
+    }
+  }
+}
+
+TEST_F(DBTest, ReadYourWrites) {
+  static constexpr int32_t kReaderNum = 2;
+  static constexpr int32_t kKeyNumPerThread = 2000;
+  std::atomic<bool> done(false);
+  // 大batch写memtable的时间长，后分配序号的小写入经常先写完
+  std::thread writer([this, &done]() {
+    for (int32_t round = 0; !done.load(std::memory_order_acquire); ++round) {
+      WriteBatch batch;
+      for (int32_t i = 0; i < 2000; ++i) {
+        batch.Put("batch" + std::to_string(i), std::to_string(round));
+      }
+      ASSERT_EQ(db_->Write(WriteOptions(), &batch), Status::kSuccess);
+    }
+  });
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < kReaderNum; ++t) {
+    threads.emplace_back([this, t]() {
+      for (int32_t i = 0; i < kKeyNumPerThread; ++i) {
+        const std::string& key = std::to_string(t) + "_" + std::to_string(i);
+        ASSERT_EQ(db_->Put(WriteOptions(), key, key), Status::kSuccess);
+        ASSERT_EQ(Get(key), key);
+        std::vector<std::string> values;
+        const auto& statuses =
+            db_->MultiGet(ReadOptions(), {std::string_view(key)}, &values);
+        ASSERT_EQ(statuses[0], Status::kSuccess);
+        ASSERT_EQ(values[0], key);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  done.store(true, std::memory_order_release);
+  writer.join();
+}
+
+TEST_F(DBTest, ReadDuringBackgroundFlush) {
+  static constexpr int32_t kKeyNum = 20000;
+  options_.write_buffer_size = 64 * 1024;
+  Reopen();
+  std::atomic<int32_t> written(0);
+  std::thread writer([this, &written]() {
+    for (int32_t i = 0; i < kKeyNum; ++i) {
+      const std::string& key = "key" + std::to_string(i);
+      ASSERT_EQ(db_->Put(WriteOptions(), key, std::string(64, 'v')),
+                Status::kSuccess);
+      written.store(i + 1, std::memory_order_release);
+    }
+  });
+  // 已经写入成功的key，不管是在memtable还是正在刷盘，都必须能读到
+  while (written.load(std::memory_order_acquire) < kKeyNum) {
+    const int32_t n = written.load(std::memory_order_acquire);
+    if (n == 0) {
+      continue;
+    }
+    const std::string& key = "key" + std::to_string(n - 1);
+    ASSERT_EQ(Get(key), std::string(64, 'v'));
+  }
+  writer.join();
+  for (int32_t i = 0; i < kKeyNum; i += 97) {
+    ASSERT_EQ(Get("key" + std::to_string(i)), std::string(64, 'v'));
+  }
+}
+
+TEST_F(DBTest, ReadDuringSuperVersionChange) {
+  static constexpr int32_t kKeyNum = 100;
+  static constexpr int32_t kReaderNum = 4;
+  options_.write_buffer_size = 32 * 1024;
+  Reopen();
+  for (int32_t i = 0; i < kKeyNum; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), "key" + std::to_string(i), "0"),
+              Status::kSuccess);
+  }
+  // 写入不断切换memtable、刷盘和compaction，读线程缓存的SuperVersion随之过期；
+  // 每个key的值单调递增，同一个线程读到的值不能回退
+  std::atomic<bool> done(false);
+  std::vector<std::thread> readers;
+  for (int32_t t = 0; t < kReaderNum; ++t) {
+    readers.emplace_back([this, &done]() {
+      std::vector<int32_t> last(kKeyNum, 0);
+      for (int32_t round = 0; !done.load(std::memory_order_acquire); ++round) {
+        const int32_t i = round % kKeyNum;
+        const std::string& value = Get("key" + std::to_string(i));
+        ASSERT_NE(value, "NOT_FOUND");
+        const int32_t n = std::stoi(value);
+        ASSERT_GE(n, last[i]);
+        last[i] = n;
+      }
+    });
+  }
+  for (int32_t round = 1; round <= 100; ++round) {
+    for (int32_t i = 0; i < kKeyNum; ++i) {
+      ASSERT_EQ(db_->Put(WriteOptions(), "key" + std::to_string(i),
+                         std::to_string(round) + std::string(100, ' ')),
+                Status::kSuccess);
+    }
+  }
+  done.store(true, std::memory_order_release);
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  for (int32_t i = 0; i < kKeyNum; ++i) {
+    EXPECT_EQ(std::stoi(Get("key" + std::to_string(i))), 100);
+  }
+}
+
+TEST_F(DBTest, LeveledCompaction) {
+  options_.write_buffer_size = 32 * 1024;
+  options_.max_file_size = 32 * 1024;
+  options_.max_bytes_for_level_base = 128 * 1024;
+  options_.max_bytes_for_level_multiplier = 4;
+  options_.max_background_jobs = 3;
+  Reopen();
+  CompactAndVerify();
+}
+
+TEST_F(DBTest, Subcompaction) {
+  options_.write_buffer_size = 32 * 1024;
+  options_.max_file_size = 32 * 1024;
+  options_.max_bytes_for_level_base = 128 * 1024;
+  options_.max_bytes_for_level_multiplier = 4;
+  options_.max_background_jobs = 3;
+  options_.max_subcompactions = 4;
+  Reopen();
+  CompactAndVerify();
+}
+
+TEST_F(DBTest, UniversalCompaction) {
+  options_.write_buffer_size = 32 * 1024;
+  options_.compaction_style = kCompactionStyleUniversal;
+  options_.max_background_jobs = 3;
+  Reopen();
+  CompactAndVerify();
+}
+
+TEST_F(DBTest, FIFOCompaction) {
+  options_.write_buffer_size = 32 * 1024;
+  options_.compaction_style = kCompactionStyleFIFO;
+  options_.compaction_options_fifo.max_table_files_size = 256 * 1024;
+  Reopen();
+  auto total_size = [this]() {
+    std::string value;
+    EXPECT_TRUE(db_->GetProperty("corekv.total-sst-files-size", &value));
+    return std::stoull(value);
+  };
+  const int32_t kKeyNum = 20000;
+  for (int32_t i = 0; i < kKeyNum; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), "key" + std::to_string(i),
+                       std::string(100, 'v')),
+              Status::kSuccess);
+  }
+  for (int32_t retry = 0;
+       retry < 500 &&
+       total_size() > options_.compaction_options_fifo.max_table_files_size;
+       ++retry) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  // 最旧的sst被整个删除，最新的数据还在，文件从来不会离开level0
+  EXPECT_LE(total_size(), options_.compaction_options_fifo.max_table_files_size);
+  EXPECT_GT(NumFilesAtLevel(0), 0);
+  for (int32_t level = 1; level < 7; ++level) {
+    EXPECT_EQ(NumFilesAtLevel(level), 0);
+  }
+  EXPECT_EQ(Get("key0"), "NOT_FOUND");
+  EXPECT_EQ(Get("key" + std::to_string(kKeyNum - 1)), std::string(100, 'v'));
+  // 已经刷盘的数据，不在memtable中
+  const std::string& flushed_key = "key" + std::to_string(kKeyNum - 1000);
+  EXPECT_EQ(Get(flushed_key), std::string(100, 'v'));
+
+  // 重新打开之后之前的sst都已经超过ttl，只剩下恢复时刚刚刷盘的sst
+  options_.compaction_options_fifo.max_table_files_size = 1024 * 1024 * 1024;
+  options_.compaction_options_fifo.ttl_ms = 1;
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  Reopen();
+  for (int32_t retry = 0; retry < 500 && NumFilesAtLevel(0) > 1; ++retry) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_LE(NumFilesAtLevel(0), 1);
+  EXPECT_EQ(Get(flushed_key), "NOT_FOUND");
+}
+
+TEST_F(DBTest, Snapshot) {
+  options_.write_buffer_size = 32 * 1024;
+  options_.max_file_size = 32 * 1024;
+  options_.max_bytes_for_level_base = 128 * 1024;
+  options_.max_background_jobs = 3;
+  Reopen();
+  auto write_round = [&](const std::string& tag) {
+    for (int32_t i = 0; i < 500; ++i) {
+      const std::string& key = "key" + std::to_string(i);
+      if (tag == "v2" && i % 3 == 0) {
+        ASSERT_EQ(db_->Delete(WriteOptions(), key), Status::kSuccess);
+      } else {
+        ASSERT_EQ(db_->Put(WriteOptions(), key, tag + "_" + key),
+                  Status::kSuccess);
+      }
+    }
+  };
+  write_round("v1");
+  const Snapshot* s1 = db_->GetSnapshot();
+  write_round("v2");
+  const Snapshot* s2 = db_->GetSnapshot();
+  EXPECT_LT(s1->sequence_number(), s2->sequence_number());
+  write_round("v3");
+
+  // 快照的读取结果，key3和key6在v2中被删除
+  auto expected = [](const std::string& tag) {
+    std::map<std::string, std::string> model;
+    for (int32_t i = 0; i < 500; ++i) {
+      const std::string& key = "key" + std::to_string(i);
+      if (tag != "v2" || i % 3 != 0) {
+        model[key] = tag + "_" + key;
+      }
+    }
+    return model;
+  };
+  auto check = [&](const Snapshot* snapshot, const std::string& tag) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    const auto& model = expected(tag);
+    for (int32_t i = 0; i < 500; ++i) {
+      const std::string& key = "key" + std::to_string(i);
+      std::string value;
+      DBStatus s = db_->Get(options, key, &value);
+      auto iter = model.find(key);
+      if (iter == model.end()) {
+        ASSERT_EQ(s, Status::kNotFound) << key;
+      } else {
+        ASSERT_EQ(s, Status::kSuccess) << key;
+        ASSERT_EQ(value, iter->second);
+      }
+    }
+    std::vector<std::string_view> keys = {"key0", "key1", "key499"};
+    std::vector<std::string> values;
+    const auto& statuses = db_->MultiGet(options, keys, &values);
+    EXPECT_EQ(statuses[0], tag == "v2" ? Status::kNotFound : Status::kSuccess);
+    EXPECT_EQ(values[1], tag + "_key1");
+    std::unique_ptr<Iterator> iter(db_->NewIterator(options));
+    auto model_iter = model.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++model_iter) {
+      if (iter->key().substr(0, 3) != "key") {
+        break;
+      }
+      ASSERT_NE(model_iter, model.end());
+      ASSERT_EQ(iter->key(), model_iter->first);
+      ASSERT_EQ(iter->value(), model_iter->second);
+    }
+    EXPECT_EQ(model_iter, model.end());
+  };
+  check(s1, "v1");
+  check(s2, "v2");
+  check(nullptr, "v3");
+
+  // 大量写入触发多轮compaction，快照能看到的旧版本需要保留下来
+  for (int32_t i = 0; i < 20000; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), "pad" + std::to_string(i % 3000),
+                       std::string(100, 'p')),
+              Status::kSuccess);
+  }
+  for (int32_t retry = 0;
+       retry < 500 &&
+       NumFilesAtLevel(0) >= options_.level0_file_num_compaction_trigger;
+       ++retry) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  int32_t deeper_files = 0;
+  for (int32_t level = 1; level < 7; ++level) {
+    deeper_files += NumFilesAtLevel(level);
+  }
+  EXPECT_GT(deeper_files, 0);
+  check(s1, "v1");
+  check(s2, "v2");
+  check(nullptr, "v3");
+
+  db_->ReleaseSnapshot(s1);
+  check(s2, "v2");
+  db_->ReleaseSnapshot(s2);
+  check(nullptr, "v3");
+}
+
+TEST_F(DBTest, DeleteRange) {
+  options_.write_buffer_size = 32 * 1024;
+  options_.max_file_size = 32 * 1024;
+  options_.max_bytes_for_level_base = 128 * 1024;
+  options_.max_background_jobs = 3;
+  Reopen();
+  EXPECT_EQ(db_->DeleteRange(WriteOptions(), "b", "a"),
+            Status::kInvalidArgument);
+  EXPECT_EQ(db_->DeleteRange(WriteOptions(), "a", "a"), Status::kSuccess);
+
+  auto key = [](int32_t i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%05d", i);
+    return std::string(buf);
+  };
+  std::map<std::string, std::string> model;
+  auto put = [&](int32_t i, const std::string& tag) {
+    ASSERT_EQ(db_->Put(WriteOptions(), key(i), tag + "_" + key(i)),
+              Status::kSuccess);
+    model[key(i)] = tag + "_" + key(i);
+  };
+  auto delete_range = [&](int32_t begin, int32_t end) {
+    ASSERT_EQ(db_->DeleteRange(WriteOptions(), key(begin), key(end)),
+              Status::kSuccess);
+    model.erase(model.lower_bound(key(begin)), model.lower_bound(key(end)));
+  };
+  auto check = [&](const Snapshot* snapshot,
+                   const std::map<std::string, std::string>& expected) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::vector<std::string> keys;
+    for (int32_t i = 0; i < 2000; ++i) {
+      keys.push_back(key(i));
+      std::string value;
+      DBStatus s = db_->Get(options, key(i), &value);
+      auto iter = expected.find(key(i));
+      if (iter == expected.end()) {
+        ASSERT_EQ(s, Status::kNotFound) << key(i);
+      } else {
+        ASSERT_EQ(s, Status::kSuccess) << key(i);
+        ASSERT_EQ(value, iter->second);
+      }
+    }
+    std::vector<std::string_view> key_views(keys.begin(), keys.end());
+    std::vector<std::string> values;
+    const auto& statuses = db_->MultiGet(options, key_views, &values);
+    for (size_t i = 0; i < keys.size(); ++i) {
+      auto iter = expected.find(keys[i]);
+      if (iter == expected.end()) {
+        ASSERT_EQ(statuses[i], Status::kNotFound) << keys[i];
+      } else {
+        ASSERT_EQ(statuses[i], Status::kSuccess) << keys[i];
+        ASSERT_EQ(values[i], iter->second);
+      }
+    }
+    std::unique_ptr<Iterator> iter(db_->NewIterator(options));
+    auto model_iter = expected.begin();
+    for (iter->Seek("key"); iter->Valid() && iter->key().substr(0, 3) == "key";
+         iter->Next(), ++model_iter) {
+      ASSERT_NE(model_iter, expected.end());
+      ASSERT_EQ(iter->key(), model_iter->first);
+      ASSERT_EQ(iter->value(), model_iter->second);
+    }
+    EXPECT_EQ(model_iter, expected.end());
+    auto reverse_iter = expected.rbegin();
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      if (iter->key().substr(0, 3) != "key") {
+        continue;
+      }
+      ASSERT_NE(reverse_iter, expected.rend());
+      ASSERT_EQ(iter->key(), reverse_iter->first);
+      ASSERT_EQ(iter->value(), reverse_iter->second);
+      ++reverse_iter;
+    }
+    EXPECT_EQ(reverse_iter, expected.rend());
+  };
+
+  for (int32_t i = 0; i < 2000; ++i) {
+    put(i, "v1");
+  }
+  // 只在memtable中的tombstone
+  delete_range(100, 200);
+  EXPECT_EQ(Get(key(99)), "v1_" + key(99));
+  EXPECT_EQ(Get(key(100)), "NOT_FOUND");
+  EXPECT_EQ(Get(key(199)), "NOT_FOUND");
+  EXPECT_EQ(Get(key(200)), "v1_" + key(200));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  const auto snapshot_model = model;
+  // 之后写入的版本不受更早的tombstone影响，互相重叠的tombstone
+  put(150, "v2");
+  delete_range(500, 900);
+  delete_range(700, 1200);
+  put(800, "v2");
+  check(snapshot, snapshot_model);
+  check(nullptr, model);
+
+  // 大量写入触发flush和多轮compaction，tombstone写到sst中之后仍然生效
+  auto fill = [&]() {
+    for (int32_t i = 0; i < 20000; ++i) {
+      ASSERT_EQ(db_->Put(WriteOptions(), "pad" + std::to_string(i % 3000),
+                         std::string(100, 'p')),
+                Status::kSuccess);
+    }
+    for (int32_t retry = 0;
+         retry < 500 &&
+         NumFilesAtLevel(0) >= options_.level0_file_num_compaction_trigger;
+         ++retry) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  };
+  fill();
+  delete_range(1500, 1600);
+  fill();
+  check(snapshot, snapshot_model);
+  check(nullptr, model);
+
+  // 快照释放之后被覆盖的数据可以在compaction中丢弃
+  db_->ReleaseSnapshot(snapshot);
+  delete_range(0, 50);
+  fill();
+  check(nullptr, model);
+  Reopen();
+  check(nullptr, model);
+}
+
+TEST_F(DBTest, IncrementalManifest) {
+  options_.write_buffer_size = 16 * 1024;
+  Reopen();
+  const auto& before = Manifests();
+  ASSERT_EQ(before.size(), 1u);
+  for (int32_t i = 0; i < 2000; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), "key" + std::to_string(i),
+                       std::string(64, 'v')),
+              Status::kSuccess);
+  }
+  Reopen();
+  // 刷盘和compaction只是在同一个MANIFEST后面追加记录，重新打开的时候也会继续复用
+  EXPECT_EQ(Manifests(), before);
+  for (int32_t i = 0; i < 2000; i += 37) {
+    ASSERT_EQ(Get("key" + std::to_string(i)), std::string(64, 'v'));
+  }
+}
+
+TEST_F(DBTest, ManifestRollover) {
+  options_.write_buffer_size = 16 * 1024;
+  options_.max_manifest_file_size = 256;
+  Reopen();
+  const auto& before = Manifests();
+  std::map<std::string, std::string> model;
+  for (int32_t i = 0; i < 4000; ++i) {
+    const std::string& key = "key" + std::to_string(i % 1500);
+    model[key] = std::to_string(i) + std::string(32, 'v');
+    ASSERT_EQ(db_->Put(WriteOptions(), key, model[key]), Status::kSuccess);
+  }
+  Reopen();
+  // 超过大小之后切换到了新的MANIFEST，旧的MANIFEST被删除
+  const auto& after = Manifests();
+  ASSERT_EQ(after.size(), 1u);
+  EXPECT_NE(after, before);
+  std::string expected;
+  for (const auto& item : model) {
+    expected.append(item.first + "=" + item.second + ";");
+  }
+  EXPECT_EQ(Contents(), expected);
+}
+
+TEST_F(DBTest, SmallTableCache) {
+  // 打开的sst远多于max_open_files，淘汰之后需要重新打开
+  options_.write_buffer_size = 32 * 1024;
+  options_.max_file_size = 32 * 1024;
+  options_.max_bytes_for_level_base = 128 * 1024;
+  options_.max_bytes_for_level_multiplier = 4;
+  options_.max_open_files = 2;
+  Reopen();
+  CompactAndVerify();
+}
+
+TEST_F(DBTest, PartitionedIndexAndFilter) {
+  options_.write_buffer_size = 32 * 1024;
+  options_.max_file_size = 32 * 1024;
+  options_.max_bytes_for_level_base = 128 * 1024;
+  options_.max_bytes_for_level_multiplier = 4;
+  options_.partition_index = true;
+  options_.partition_filters = true;
+  options_.index_partition_size = 128;
+  options_.pin_top_level_index_and_filter = false;
+  block_cache_ = std::make_unique<ShardCache<uint64_t, DataBlock>>(256 * 1024);
+  options_.block_cache = block_cache_.get();
+  Reopen();
+  CompactAndVerify();
+}
+
+TEST_F(DBTest, BlockCacheHugePages) {
+  UseSmallFiles();
+  // 每个分片的block数据从自己的大页中分配，轮流绑定到各个NUMA节点
+  block_cache_ = std::make_unique<ShardCache<uint64_t, DataBlock>>(
+      1024 * 1024, 4, 2 * 1024 * 1024, NumaNodeCount());
+  options_.block_cache = block_cache_.get();
+  Reopen();
+  CompactAndVerify();
+
+  int32_t cached = 0;
+  std::vector<uint64_t> keys;
+  block_cache_->ApplyToAllKeys([&keys](const uint64_t& key) {
+    keys.push_back(key);
+  });
+  for (uint64_t key : keys) {
+    CacheNode<uint64_t, DataBlock>* node = block_cache_->Get(key);
+    if (node == nullptr) {
+      continue;
+    }
+    PageSlabAlloc* alloc = block_cache_->ShardAllocator(key);
+    ASSERT_NE(alloc, nullptr);
+    EXPECT_GT(alloc->MemoryUsage(), 0u);
+    EXPECT_TRUE(node->value->owns_data());
+    ++cached;
+    block_cache_->Release(node);
+  }
+  EXPECT_GT(cached, 0);
+}
+
+TEST_F(DBTest, ParallelTableOpen) {
+  options_.write_buffer_size = 32 * 1024;
+  Reopen();
+  std::map<std::string, std::string> model;
+  for (int32_t i = 0; i < 2000; ++i) {
+    const std::string& key = "key" + std::to_string(i);
+    model[key] = std::to_string(i) + std::string(80, 'x');
+    ASSERT_EQ(db_->Put(WriteOptions(), key, model[key]), Status::kSuccess);
+  }
+  ReadOptions cache_only;
+  cache_only.cache_only = true;
+  std::string value;
+  // 不在db中但是落在sst范围内的key，只需要filter就能确定不存在
+  const std::string missing = "key5x";
+  Reopen();
+  EXPECT_EQ(db_->Get(cache_only, missing, &value), Status::kIncomplete);
+
+  // 打开的时候sst已经全部放进TableCache，常驻的filter也已经读好
+  options_.max_file_opening_threads = 4;
+  Reopen();
+  EXPECT_EQ(db_->Get(cache_only, missing, &value), Status::kNotFound);
+  CheckMultiGet(model, 2000);
+
+  // 延迟读取的filter在第一次访问之后才常驻
+  options_.lazy_load_index_and_filter = true;
+  Reopen();
+  EXPECT_EQ(db_->Get(cache_only, missing, &value), Status::kIncomplete);
+  EXPECT_EQ(Get(missing), "NOT_FOUND");
+  EXPECT_EQ(db_->Get(cache_only, missing, &value), Status::kNotFound);
+  CheckMultiGet(model, 2000);
+}
+
+TEST_F(DBTest, RowCache) {
+  auto statistics = std::make_shared<Statistics>();
+  options_.statistics = statistics;
+  options_.write_buffer_size = 32 * 1024;
+  row_cache_ = std::make_unique<ShardCache<std::string, std::string>>(1024 * 1024);
+  options_.row_cache = row_cache_.get();
+  Reopen();
+  auto key_of = [](int32_t i) { return "key" + std::to_string(1000 + i); };
+  for (int32_t i = 0; i < 200; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), key_of(i), "v1_" + key_of(i)),
+              Status::kSuccess);
+  }
+  // 恢复的时候memtable写入sst
+  Reopen();
+  for (int32_t round = 0; round < 2; ++round) {
+    for (int32_t i = 0; i < 200; ++i) {
+      EXPECT_EQ(Get(key_of(i)), "v1_" + key_of(i));
+    }
+    // sst范围内不存在的key同样缓存
+    EXPECT_EQ(Get(key_of(0) + "a"), "NOT_FOUND");
+  }
+  // 第二轮全部命中
+  EXPECT_EQ(statistics->GetTickerCount(kRowCacheMiss), 201u);
+  EXPECT_EQ(statistics->GetTickerCount(kRowCacheHit), 201u);
+
+  // 快照之后的写入进入新的sst，它们最新的版本对快照不可见，需要直接查找sst
+  const Snapshot* snapshot = db_->GetSnapshot();
+  std::string sst_size;
+  ASSERT_TRUE(db_->GetProperty("corekv.total-sst-files-size", &sst_size));
+  for (int32_t i = 0; i < 200; i += 2) {
+    ASSERT_EQ(db_->Put(WriteOptions(), key_of(i), "v2_" + key_of(i)),
+              Status::kSuccess);
+  }
+  ASSERT_EQ(db_->Delete(WriteOptions(), key_of(1)), Status::kSuccess);
+  for (int32_t i = 0; i < 1000; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), "filler" + std::to_string(i),
+                       std::string(100, 'f')),
+              Status::kSuccess);
+  }
+  std::string new_sst_size = sst_size;
+  for (int32_t i = 0; i < 500 && new_sst_size == sst_size; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ASSERT_TRUE(
+        db_->GetProperty("corekv.total-sst-files-size", &new_sst_size));
+  }
+  EXPECT_NE(new_sst_size, sst_size);
+  ReadOptions snapshot_options;
+  snapshot_options.snapshot = snapshot;
+  for (int32_t round = 0; round < 2; ++round) {
+    for (int32_t i = 0; i < 200; ++i) {
+      std::string value;
+      ASSERT_EQ(db_->Get(snapshot_options, key_of(i), &value),
+                Status::kSuccess);
+      EXPECT_EQ(value, "v1_" + key_of(i));
+      EXPECT_EQ(Get(key_of(i)), i == 1   ? "NOT_FOUND"
+                                : i % 2 ? "v1_" + key_of(i)
+                                        : "v2_" + key_of(i));
+    }
+  }
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST_F(DBTest, BlockCacheWarmup) {
+  auto statistics = std::make_shared<Statistics>();
+  options_.statistics = statistics;
+  options_.block_cache_warmup = true;
+  block_cache_ = std::make_unique<ShardCache<uint64_t, DataBlock>>(1024 * 1024);
+  options_.block_cache = block_cache_.get();
+  Reopen();
+  auto key_of = [](int32_t i) { return "key" + std::to_string(10000 + i); };
+  for (int32_t i = 0; i < 2000; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), key_of(i), std::string(100, 'a' + i % 26)),
+              Status::kSuccess);
+  }
+  // 恢复的时候memtable写入sst
+  Reopen();
+  // 只读一半的key，预热的时候只会读回这部分block
+  for (int32_t i = 0; i < 1000; ++i) {
+    ASSERT_EQ(Get(key_of(i)), std::string(100, 'a' + i % 26));
+  }
+  const size_t usage = block_cache_->GetUsage();
+  ASSERT_GT(usage, 0u);
+  // 模拟进程重启，block_cache是空的
+  db_.reset();
+  block_cache_ = std::make_unique<ShardCache<uint64_t, DataBlock>>(1024 * 1024);
+  options_.block_cache = block_cache_.get();
+  Reopen();
+  for (int32_t i = 0; i < 500 && block_cache_->GetUsage() < usage; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(block_cache_->GetUsage(), usage);
+  statistics->Reset();
+  for (int32_t i = 0; i < 1000; ++i) {
+    ASSERT_EQ(Get(key_of(i)), std::string(100, 'a' + i % 26));
+  }
+  EXPECT_GT(statistics->GetTickerCount(kBlockCacheDataHit), 0u);
+  EXPECT_EQ(statistics->GetTickerCount(kBlockCacheDataMiss), 0u);
+
+  // 损坏的文件直接忽略，不影响打开
+  db_.reset();
+  const std::string fname = kDBName + "/BLOCK_CACHE_KEYS";
+  {
+    FileWriter writer(fname);
+    ASSERT_EQ(writer.Append("corrupted", 9), Status::kSuccess);
+    writer.Close();
+  }
+  block_cache_ = std::make_unique<ShardCache<uint64_t, DataBlock>>(1024 * 1024);
+  options_.block_cache = block_cache_.get();
+  Reopen();
+  EXPECT_EQ(Get(key_of(1999)), std::string(100, 'a' + 1999 % 26));
+  // 运行中也可以主动保存
+  ASSERT_EQ(db_->PersistBlockCacheKeys(), Status::kSuccess);
+  EXPECT_GT(FileTool::GetFileSize(fname), sizeof(uint32_t));
+}
+
+TEST_F(DBTest, ReadOnly) {
+  for (int32_t i = 0; i < 100; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), "key" + std::to_string(i),
+                       "value" + std::to_string(i)),
+              Status::kSuccess);
+  }
+  // 一部分数据在sst中，一部分只在WAL中
+  Reopen();
+  ASSERT_EQ(db_->Put(WriteOptions(), "key0", "new"), Status::kSuccess);
+  ASSERT_EQ(db_->Delete(WriteOptions(), "key1"), Status::kSuccess);
+  db_.reset();
+  std::vector<std::string> before;
+  ASSERT_EQ(FileTool::GetChildren(kDBName, &before), Status::kSuccess);
+
+  DB* db = nullptr;
+  ASSERT_EQ(DB::OpenForReadOnly(options_, kDBName, &db), Status::kSuccess);
+  db_.reset(db);
+  EXPECT_EQ(Get("key0"), "new");
+  EXPECT_EQ(Get("key1"), "NOT_FOUND");
+  EXPECT_EQ(Get("key99"), "value99");
+  EXPECT_EQ(db_->Put(WriteOptions(), "key2", "x"), Status::kNotSupported);
+  EXPECT_EQ(db_->TryCatchUpWithPrimary(), Status::kNotSupported);
+  ColumnFamilyHandle* handle = nullptr;
+  EXPECT_EQ(db_->CreateColumnFamily(options_, "cf", &handle),
+            Status::kNotSupported);
+  db_.reset();
+  // 只读打开不会修改目录中的任何文件
+  std::vector<std::string> after;
+  ASSERT_EQ(FileTool::GetChildren(kDBName, &after), Status::kSuccess);
+  std::sort(before.begin(), before.end());
+  std::sort(after.begin(), after.end());
+  EXPECT_EQ(before, after);
+
+  ASSERT_NE(DB::OpenForReadOnly(options_, "db_test_missing_dir", &db),
+            Status::kSuccess);
+  Reopen();
+}
+
+TEST_F(DBTest, Secondary) {
+  for (int32_t i = 0; i < 100; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), "key" + std::to_string(i), "v1"),
+              Status::kSuccess);
+  }
+  Reopen();
+  DB* db = nullptr;
+  ASSERT_EQ(DB::OpenAsSecondary(options_, kDBName, &db), Status::kSuccess);
+  std::unique_ptr<DB> secondary(db);
+  auto secondary_get = [&secondary](const std::string& key) {
+    std::string value;
+    DBStatus s = secondary->Get(ReadOptions(), key, &value);
+    return s == Status::kNotFound ? "NOT_FOUND" : value;
+  };
+  EXPECT_EQ(secondary_get("key0"), "v1");
+
+  // primary新写入的数据还在WAL中
+  for (int32_t i = 0; i < 50; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), "key" + std::to_string(i), "v2"),
+              Status::kSuccess);
+  }
+  ASSERT_EQ(db_->Delete(WriteOptions(), "key99"), Status::kSuccess);
+  EXPECT_EQ(secondary_get("key0"), "v1");
+  ASSERT_EQ(secondary->TryCatchUpWithPrimary(), Status::kSuccess);
+  EXPECT_EQ(secondary_get("key0"), "v2");
+  EXPECT_EQ(secondary_get("key50"), "v1");
+  EXPECT_EQ(secondary_get("key99"), "NOT_FOUND");
+
+  // primary重新打开之后WAL写入sst，旧的WAL被删除，数据从MANIFEST中追上
+  Reopen();
+  ASSERT_EQ(db_->Put(WriteOptions(), "key1", "v3"), Status::kSuccess);
+  ASSERT_EQ(secondary->TryCatchUpWithPrimary(), Status::kSuccess);
+  EXPECT_EQ(secondary_get("key0"), "v2");
+  EXPECT_EQ(secondary_get("key1"), "v3");
+  EXPECT_EQ(secondary_get("key99"), "NOT_FOUND");
+  EXPECT_EQ(secondary->Put(WriteOptions(), "key0", "x"),
+            Status::kNotSupported);
+
+  // primary切换到新的MANIFEST
+  options_.max_manifest_file_size = 1;
+  Reopen();
+  ASSERT_EQ(db_->Put(WriteOptions(), "key2", "v4"), Status::kSuccess);
+  Reopen();
+  ASSERT_EQ(secondary->TryCatchUpWithPrimary(), Status::kSuccess);
+  EXPECT_EQ(secondary_get("key1"), "v3");
+  EXPECT_EQ(secondary_get("key2"), "v4");
+  EXPECT_EQ(secondary_get("key98"), "v1");
+}
+
+TEST_F(DBTest, Checkpoint) {
+  options_.write_buffer_size = 16 * 1024;
+  Reopen();
+  const std::string checkpoint_dir = "db_test_checkpoint";
+  DestroyDB(checkpoint_dir, options_);
+  std::map<std::string, std::string> model;
+  for (int32_t i = 0; i < 3000; ++i) {
+    const std::string& key = "key" + std::to_string(i % 1000);
+    model[key] = std::to_string(i) + std::string(40, 'v');
+    ASSERT_EQ(db_->Put(WriteOptions(), key, model[key]), Status::kSuccess);
+  }
+  // checkpoint生成的过程中继续写入
+  std::atomic<bool> stop{false};
+  std::thread writer([this, &stop]() {
+    for (int32_t i = 0; !stop.load(); ++i) {
+      db_->Put(WriteOptions(), "other" + std::to_string(i % 500),
+               std::string(100, 'o'));
+    }
+  });
+  Checkpoint checkpoint(db_.get());
+  ASSERT_EQ(checkpoint.Create(checkpoint_dir), Status::kSuccess);
+  stop = true;
+  writer.join();
+  EXPECT_EQ(checkpoint.Create(checkpoint_dir), Status::kInvalidArgument);
+  // 原来的db继续修改，checkpoint不受影响
+  for (int32_t i = 0; i < 1000; ++i) {
+    ASSERT_EQ(db_->Delete(WriteOptions(), "key" + std::to_string(i)),
+              Status::kSuccess);
+  }
+  Reopen();
+
+  DB* db = nullptr;
+  ASSERT_EQ(DB::Open(options_, checkpoint_dir, &db), Status::kSuccess);
+  std::unique_ptr<DB> copy(db);
+  for (const auto& [key, value] : model) {
+    std::string result;
+    ASSERT_EQ(copy->Get(ReadOptions(), key, &result), Status::kSuccess) << key;
+    ASSERT_EQ(result, value);
+  }
+  EXPECT_EQ(Get("key0"), "NOT_FOUND");
+  copy.reset();
+  DestroyDB(checkpoint_dir, options_);
+  FileTool::RemoveDir(checkpoint_dir);
+}
+
+// 删除备份目录下的所有文件
+static void DestroyBackupDir(const std::string& dir) {
+  std::vector<std::string> ids;
+  FileTool::GetChildren(dir + "/private", &ids);
+  for (const auto& id : ids) {
+    FileTool::RemoveDirAndFiles(dir + "/private/" + id);
+  }
+  for (const char* sub : {"/private", "/shared", "/meta"}) {
+    FileTool::RemoveDirAndFiles(dir + sub);
+  }
+  FileTool::RemoveDir(dir);
+}
+
+TEST_F(DBTest, BackupEngine) {
+  options_.write_buffer_size = 16 * 1024;
+  Reopen();
+  const std::string backup_dir = "db_test_backup";
+  const std::string restore_dir = "db_test_restore";
+  DestroyBackupDir(backup_dir);
+  DestroyDB(restore_dir, options_);
+  BackupEngineOptions backup_options;
+  backup_options.backup_dir = backup_dir;
+  BackupEngine* engine = nullptr;
+  ASSERT_EQ(BackupEngine::Open(backup_options, &engine), Status::kSuccess);
+  std::unique_ptr<BackupEngine> backup_engine(engine);
+
+  auto write = [this](int32_t round) {
+    for (int32_t i = 0; i < 1000; ++i) {
+      ASSERT_EQ(db_->Put(WriteOptions(), "key" + std::to_string(i),
+                         std::to_string(round) + std::string(40, 'v')),
+                Status::kSuccess);
+    }
+  };
+  write(1);
+  uint32_t first = 0;
+  ASSERT_EQ(backup_engine->CreateNewBackup(db_.get(), &first),
+            Status::kSuccess);
+  // 重新拷贝的文件会先写到临时文件再rename，inode会变化
+  auto inode_of = [&backup_dir](const std::string& filename) {
+    struct ::stat st;
+    return ::stat((backup_dir + "/shared/" + filename).c_str(), &st) == 0
+               ? st.st_ino
+               : 0;
+  };
+  std::vector<std::string> shared;
+  FileTool::GetChildren(backup_dir + "/shared", &shared);
+  ASSERT_FALSE(shared.empty());
+  std::map<std::string, ino_t> first_inodes;
+  for (const auto& filename : shared) {
+    first_inodes[filename] = inode_of(filename);
+  }
+
+  // 没有变化的sst不会再拷贝一次
+  write(2);
+  uint32_t second = 0;
+  ASSERT_EQ(backup_engine->CreateNewBackup(db_.get(), &second),
+            Status::kSuccess);
+  EXPECT_EQ(second, first + 1);
+  std::vector<BackupInfo> infos;
+  backup_engine->GetBackupInfo(&infos);
+  ASSERT_EQ(infos.size(), 2u);
+  for (const auto& info : infos) {
+    EXPECT_GT(info.size, 0u);
+    EXPECT_GT(info.number_files, 0u);
+  }
+  // 第一次备份的sst还被第一个备份引用，都还在
+  FileTool::GetChildren(backup_dir + "/shared", &shared);
+  for (const auto& [filename, inode] : first_inodes) {
+    EXPECT_EQ(inode_of(filename), inode) << filename;
+  }
+  EXPECT_GE(shared.size(), first_inodes.size());
+  EXPECT_EQ(backup_engine->VerifyBackup(first), Status::kSuccess);
+  EXPECT_EQ(backup_engine->VerifyBackup(second), Status::kSuccess);
+
+  auto check = [this, &restore_dir](const std::string& prefix) {
+    DB* db = nullptr;
+    ASSERT_EQ(DB::Open(options_, restore_dir, &db), Status::kSuccess);
+    std::unique_ptr<DB> restored(db);
+    for (int32_t i = 0; i < 1000; ++i) {
+      std::string value;
+      ASSERT_EQ(restored->Get(ReadOptions(), "key" + std::to_string(i), &value),
+                Status::kSuccess);
+      ASSERT_EQ(value, prefix + std::string(40, 'v'));
+    }
+  };
+  ASSERT_EQ(backup_engine->RestoreDBFromBackup(first, restore_dir),
+            Status::kSuccess);
+  check("1");
+  // 重新打开之后还能看到之前的备份
+  backup_engine.reset();
+  ASSERT_EQ(BackupEngine::Open(backup_options, &engine), Status::kSuccess);
+  backup_engine.reset(engine);
+  ASSERT_EQ(backup_engine->RestoreDBFromLatestBackup(restore_dir),
+            Status::kSuccess);
+  check("2");
+
+  // 删除旧备份之后只被它引用的sst也被删除
+  ASSERT_EQ(backup_engine->PurgeOldBackups(1), Status::kSuccess);
+  backup_engine->GetBackupInfo(&infos);
+  ASSERT_EQ(infos.size(), 1u);
+  EXPECT_EQ(infos[0].backup_id, second);
+  EXPECT_EQ(backup_engine->VerifyBackup(first), Status::kNotFound);
+  ASSERT_EQ(backup_engine->VerifyBackup(second), Status::kSuccess);
+  std::vector<std::string> remaining;
+  FileTool::GetChildren(backup_dir + "/shared", &remaining);
+  EXPECT_LE(remaining.size(), shared.size());
+  ASSERT_FALSE(remaining.empty());
+  {
+    FileWriter writer(backup_dir + "/shared/" + remaining[0], true);
+    ASSERT_EQ(writer.Append("x", 1), Status::kSuccess);
+    writer.Close();
+  }
+  EXPECT_EQ(backup_engine->VerifyBackup(second), Status::kCorruption);
+  EXPECT_EQ(backup_engine->RestoreDBFromBackup(second, restore_dir),
+            Status::kCorruption);
+
+  backup_engine.reset();
+  DestroyBackupDir(backup_dir);
+  DestroyDB(restore_dir, options_);
+  FileTool::RemoveDir(restore_dir);
+}
+
+TEST_F(DBTest, AsyncGet) {
+  auto statistics = std::make_shared<Statistics>();
+  options_.statistics = statistics;
+  block_cache_ = std::make_unique<ShardCache<uint64_t, DataBlock>>(1024 * 1024);
+  options_.block_cache = block_cache_.get();
+  Reopen();
+  for (int32_t i = 0; i < 1000; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), "key" + std::to_string(i),
+                       "value" + std::to_string(i)),
+              Status::kSuccess);
+  }
+  // 恢复的时候写入sst，sst还没有打开
+  Reopen();
+  ASSERT_EQ(db_->Put(WriteOptions(), "mem", "mem_value"), Status::kSuccess);
+  ReadOptions cache_only;
+  cache_only.cache_only = true;
+  std::string value;
+  EXPECT_EQ(db_->Get(cache_only, "key1", &value), Status::kIncomplete);
+  EXPECT_EQ(db_->Get(cache_only, "mem", &value), Status::kSuccess);
+  EXPECT_EQ(value, "mem_value");
+
+  // 等待callback执行，返回执行callback的线程
+  auto async_get = [this](const ReadOptions& options, const std::string& key,
+                          DBStatus* s, std::string* result) {
+    std::promise<std::thread::id> done;
+    db_->AsyncGet(options, key,
+                  [&done, s, result](DBStatus status, std::string&& v) {
+                    *s = status;
+                    *result = std::move(v);
+                    done.set_value(std::this_thread::get_id());
+                  });
+    return done.get_future().get();
+  };
+  DBStatus s;
+  // 需要读文件的时候在读线程上执行
+  EXPECT_NE(async_get(ReadOptions(), "key1", &s, &value),
+            std::this_thread::get_id());
+  EXPECT_EQ(s, Status::kSuccess);
+  EXPECT_EQ(value, "value1");
+  EXPECT_EQ(statistics->GetTickerCount(kAsyncReadOffloaded), 1u);
+  // block已经在缓存中了，直接在调用线程上执行
+  EXPECT_EQ(async_get(ReadOptions(), "key1", &s, &value),
+            std::this_thread::get_id());
+  EXPECT_EQ(value, "value1");
+  EXPECT_EQ(async_get(ReadOptions(), "mem", &s, &value),
+            std::this_thread::get_id());
+  EXPECT_EQ(value, "mem_value");
+  EXPECT_EQ(statistics->GetTickerCount(kAsyncReadOffloaded), 1u);
+
+  std::vector<std::string> keys;
+  for (int32_t i = 0; i < 1000; i += 7) {
+    keys.push_back("key" + std::to_string(i));
+  }
+  keys.push_back("mem");
+  keys.push_back("missing");
+  std::vector<std::string_view> key_views(keys.begin(), keys.end());
+  std::promise<void> done;
+  std::vector<DBStatus> statuses;
+  std::vector<std::string> values;
+  db_->AsyncMultiGet(ReadOptions(), key_views,
+                     [&](std::vector<DBStatus>&& st,
+                         std::vector<std::string>&& v) {
+                       statuses = std::move(st);
+                       values = std::move(v);
+                       done.set_value();
+                     });
+  done.get_future().wait();
+  ASSERT_EQ(statuses.size(), keys.size());
+  for (int32_t i = 0, j = 0; i < 1000; i += 7, ++j) {
+    ASSERT_EQ(statuses[j], Status::kSuccess);
+    ASSERT_EQ(values[j], "value" + std::to_string(i));
+  }
+  EXPECT_EQ(values[keys.size() - 2], "mem_value");
+  EXPECT_EQ(statuses.back(), Status::kNotFound);
+
+  // 关闭db的时候等待已经提交的请求执行完
+  Reopen();
+  std::atomic<int32_t> finished{0};
+  for (int32_t i = 0; i < 100; ++i) {
+    db_->AsyncGet(ReadOptions(), "key" + std::to_string(i * 10),
+                  [&finished](DBStatus status, std::string&&) {
+                    EXPECT_EQ(status, Status::kSuccess);
+                    ++finished;
+                  });
+  }
+  db_.reset();
+  EXPECT_EQ(finished.load(), 100);
+  Reopen();
+}
+
+TEST_F(DBTest, Statistics) {
+  auto statistics = std::make_shared<Statistics>();
+  options_.statistics = statistics;
+  options_.write_buffer_size = 32 * 1024;
+  options_.max_file_size = 32 * 1024;
+  options_.max_bytes_for_level_base = 128 * 1024;
+  options_.max_bytes_for_level_multiplier = 4;
+  options_.pin_top_level_index_and_filter = false;
+  block_cache_ = std::make_unique<ShardCache<uint64_t, DataBlock>>(256 * 1024);
+  options_.block_cache = block_cache_.get();
+  Reopen();
+  CompactAndVerify();
+  for (int32_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(Get("missing" + std::to_string(i)), "NOT_FOUND");
+  }
+  std::unique_ptr<Iterator> iter(db_->NewIterator(ReadOptions()));
+  iter->Seek("key1");
+
+  EXPECT_EQ(statistics->GetTickerCount(kNumberKeysWritten), 30000u);
+  EXPECT_GT(statistics->GetTickerCount(kBytesWritten), 30000u * 80);
+  EXPECT_GE(statistics->GetTickerCount(kNumberKeysRead),
+            statistics->GetTickerCount(kNumberKeysFound) + 100);
+  EXPECT_GT(statistics->GetTickerCount(kBytesRead), 0u);
+  EXPECT_GT(statistics->GetTickerCount(kWalFileBytes), 0u);
+  EXPECT_EQ(statistics->GetTickerCount(kNumberDbSeek), 1u);
+  // index和filter都通过block cache读取
+  for (Tickers ticker : {kBlockCacheDataHit, kBlockCacheDataMiss,
+                         kBlockCacheIndexHit, kBlockCacheIndexMiss,
+                         kBlockCacheFilterHit, kBlockCacheFilterMiss}) {
+    EXPECT_GT(statistics->GetTickerCount(ticker), 0u)
+        << Statistics::TickerName(ticker);
+  }
+  EXPECT_GT(statistics->GetTickerCount(kBloomFilterUseful), 0u);
+  EXPECT_GT(statistics->GetTickerCount(kBloomFilterPositive), 0u);
+  EXPECT_GT(statistics->GetTickerCount(kFlushWriteBytes), 0u);
+  EXPECT_GT(statistics->GetTickerCount(kCompactReadBytes), 0u);
+  EXPECT_GT(statistics->GetTickerCount(kCompactWriteBytes), 0u);
+
+  Histogram hist;
+  statistics->GetHistogram(kDbWrite, &hist);
+  EXPECT_EQ(hist.Count(), 30000u);
+  statistics->GetHistogram(kDbGet, &hist);
+  EXPECT_EQ(hist.Count(), 10100u);
+  for (Histograms h : {kDbMultiGet, kDbSeek, kFlushTime, kCompactionTime}) {
+    statistics->GetHistogram(h, &hist);
+    EXPECT_GT(hist.Count(), 0u) << Statistics::HistogramName(h);
+  }
+  std::string value;
+  ASSERT_TRUE(db_->GetProperty("corekv.stats", &value));
+  EXPECT_NE(value.find("corekv.block.cache.data.hit COUNT"), std::string::npos);
+  EXPECT_NE(value.find("corekv.db.get.micros P50"), std::string::npos);
+}
+
+TEST_F(DBTest, PerfContext) {
+  block_cache_ = std::make_unique<ShardCache<uint64_t, DataBlock>>(256 * 1024);
+  options_.block_cache = block_cache_.get();
+  Reopen();
+  for (int32_t i = 0; i < 1000; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), "key" + std::to_string(i),
+                       std::string(100, 'a' + i % 26)),
+              Status::kSuccess);
+  }
+  // 重新打开之后数据都在sst中
+  Reopen();
+  PerfContext* ctx = GetPerfContext();
+  ctx->Reset();
+  Get("key500");
+  // 默认不统计
+  EXPECT_EQ(ctx->ToString(true), "");
+
+  SetPerfLevel(PerfLevel::kEnableTime);
+  ctx->Reset();
+  EXPECT_EQ(Get("key1"), std::string(100, 'b'));
+  EXPECT_EQ(ctx->get_from_memtable_count, 1u);
+  EXPECT_GT(ctx->get_from_output_files_time, 0u);
+  EXPECT_GT(ctx->index_seek_time, 0u);
+  EXPECT_GT(ctx->filter_check_time, 0u);
+  EXPECT_EQ(ctx->bloom_sst_hit_count, 1u);
+  EXPECT_EQ(ctx->block_cache_miss_count, 1u);
+  EXPECT_EQ(ctx->block_read_count, 1u);
+  EXPECT_GT(ctx->block_read_byte, 0u);
+  EXPECT_GT(ctx->block_read_time, 0u);
+  EXPECT_GT(ctx->block_checksum_time, 0u);
+  EXPECT_NE(ctx->ToString().find("block_read_count = 1"), std::string::npos);
+
+  // 第二次命中block cache，不再读文件
+  ctx->Reset();
+  EXPECT_EQ(Get("key1"), std::string(100, 'b'));
+  EXPECT_EQ(ctx->block_cache_hit_count, 1u);
+  EXPECT_EQ(ctx->block_read_count, 0u);
+  EXPECT_EQ(ctx->block_checksum_time, 0u);
+
+  ctx->Reset();
+  // 落在sst的key范围内，由布隆过滤器排除
+  EXPECT_EQ(Get("key1x"), "NOT_FOUND");
+  EXPECT_EQ(ctx->bloom_sst_miss_count, 1u);
+  EXPECT_EQ(ctx->block_read_count, 0u);
+
+  // 只统计次数的时候不读取时钟
+  SetPerfLevel(PerfLevel::kEnableCount);
+  ctx->Reset();
+  ASSERT_EQ(db_->Put(WriteOptions(), "key1", "v"), Status::kSuccess);
+  EXPECT_EQ(Get("key1"), "v");
+  EXPECT_EQ(ctx->get_from_memtable_count, 1u);
+  EXPECT_EQ(ctx->write_wal_time, 0u);
+  EXPECT_EQ(ctx->get_from_memtable_time, 0u);
+  SetPerfLevel(PerfLevel::kDisable);
+}
+
+TEST_F(DBTest, PerBlockFilter) {
+  UseSmallFiles();
+  auto statistics = std::make_shared<Statistics>();
+  options_.statistics = statistics;
+  options_.per_block_filter = true;
+  Reopen();
+  CompactAndVerify();
+  // 落在sst的key范围内但不存在的key，被所在block的filter过滤
+  const uint64_t useful = statistics->GetTickerCount(kBloomFilterUseful);
+  for (int32_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(Get("key" + std::to_string(i) + "x"), "NOT_FOUND");
+  }
+  EXPECT_GT(statistics->GetTickerCount(kBloomFilterUseful), useful);
+}
+
+TEST_F(DBTest, RibbonFilter) {
+  UseSmallFiles();
+  auto statistics = std::make_shared<Statistics>();
+  options_.statistics = statistics;
+  options_.filter_policy = std::make_shared<RibbonFilter>(10);
+  options_.partition_filters = true;
+  options_.partition_index = true;
+  Reopen();
+  CompactAndVerify();
+  // sst中只有ribbon filter的分区，排除不存在的key的只能是它
+  const uint64_t useful = statistics->GetTickerCount(kBloomFilterUseful);
+  for (int32_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(Get("key" + std::to_string(i) + "x"), "NOT_FOUND");
+  }
+  EXPECT_GT(statistics->GetTickerCount(kBloomFilterUseful), useful);
+}
+
+TEST_F(DBTest, DataBlockHashIndex) {
+  UseSmallFiles();
+  options_.data_block_hash_index = true;
+  Reopen();
+  CompactAndVerify();
+  // 重新打开之后数据都在sst中，点查通过data block的hash索引定位
+  SetPerfLevel(PerfLevel::kEnableCount);
+  PerfContext* ctx = GetPerfContext();
+  ctx->Reset();
+  for (int32_t i = 0; i < 100; ++i) {
+    Get("key" + std::to_string(i));
+  }
+  EXPECT_GT(ctx->block_hash_index_lookup_count, 0u);
+  SetPerfLevel(PerfLevel::kDisable);
+}
+
+TEST_F(DBTest, CompressionPerLevel) {
+  UseSmallFiles();
+  // level0不压缩，更深的层用lz4和zstd字典压缩，没有编译进来的算法退化成不压缩
+  options_.compression_per_level = {kNonCompress, kLZ4Compression,
+                                    kZSTDCompression};
+  options_.compression_opts.max_dict_bytes = 4096;
+  Reopen();
+  CompactAndVerify();
+  // 恢复时"zzz"刷到level0，调高触发阈值让它留在level0
+  ASSERT_EQ(db_->Put(WriteOptions(), "zzz", "v"), Status::kSuccess);
+  options_.level0_file_num_compaction_trigger = 100;
+  Reopen();
+  auto expected = [](BlockCompressType type) -> uint64_t {
+    return CompressionTypeSupported(type) ? type : kNonCompress;
+  };
+  TablePropertiesCollection props;
+  ASSERT_EQ(db_->GetPropertiesOfAllTables(&props), Status::kSuccess);
+  int32_t level0_tables = 0, compressed_tables = 0;
+  for (const auto& [number, p] : props) {
+    if (ExtractUserKey(p->largest_key) == "zzz") {
+      EXPECT_EQ(p->compression_type, kNonCompress) << number;
+      ++level0_tables;
+    } else if (p->compression_type == expected(kLZ4Compression) ||
+               p->compression_type == expected(kZSTDCompression)) {
+      ++compressed_tables;
+    }
+  }
+  EXPECT_EQ(level0_tables, 1);
+  // compaction生成的sst按照所在的层压缩
+  EXPECT_GT(compressed_tables, 0);
+  if (!CompressionTypeSupported(kLZ4Compression) &&
+      !CompressionTypeSupported(kZSTDCompression)) {
+    GTEST_SKIP() << "lz4 and zstd are not compiled in, every level was "
+                    "uncompressed; build with --config=compression";
+  }
+}
+
+TEST_F(DBTest, UseMmapReads) {
+  UseSmallFiles();
+  options_.use_mmap_reads = true;
+  Reopen();
+  CompactAndVerify();
+  // table cache中打开的sst都映射到了进程的地址空间
+  std::ifstream maps("/proc/self/maps");
+  int32_t mapped_tables = 0;
+  for (std::string line; std::getline(maps, line);) {
+    if (line.find(kDBName + "/") != std::string::npos &&
+        line.find(".sst") != std::string::npos) {
+      ++mapped_tables;
+    }
+  }
+  EXPECT_GT(mapped_tables, 0);
+}
+
+TEST_F(DBTest, DirectIO) {
+  {
+    FileWriter probe("direct_io_probe", false, true);
+    const bool supported = probe.IsDirectIO();
+    probe.Close();
+    FileTool::RemoveFile("direct_io_probe");
+    if (!supported) {
+      GTEST_SKIP() << "O_DIRECT is not supported";
+    }
+  }
+  UseSmallFiles();
+  options_.use_direct_io_for_flush_and_compaction = true;
+  options_.use_direct_reads_for_compaction = true;
+  Reopen();
+  for (int32_t i = 0; i < 2000; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), "key" + std::to_string(i),
+                       std::string(100, 'a' + i % 26)),
+              Status::kSuccess);
+  }
+  for (int32_t retry = 0;
+       retry < 500 &&
+       NumFilesAtLevel(0) >= options_.level0_file_num_compaction_trigger;
+       ++retry) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  // 还没有读过data block，flush和compaction写的sst大部分不在page cache中，
+  // 只有打开sst时读取的index、filter和footer
+  std::vector<std::string> filenames;
+  FileTool::GetChildren(kDBName, &filenames);
+  uint64_t resident_pages = 0, total_pages = 0;
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  for (const auto& filename : filenames) {
+    if (filename.size() < 4 ||
+        filename.compare(filename.size() - 4, 4, ".sst") != 0) {
+      continue;
+    }
+    const std::string& path = kDBName + "/" + filename;
+    const size_t size = FileTool::GetFileSize(path);
+    const int fd = open(path.c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0) << path;
+    void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    ASSERT_NE(base, MAP_FAILED) << path;
+    std::vector<unsigned char> vec((size + page_size - 1) / page_size);
+    ASSERT_EQ(mincore(base, size, vec.data()), 0) << path;
+    munmap(base, size);
+    for (unsigned char v : vec) {
+      resident_pages += v & 1;
+    }
+    total_pages += vec.size();
+  }
+  ASSERT_GT(total_pages, 0u);
+  EXPECT_LT(resident_pages * 2, total_pages)
+      << resident_pages << "/" << total_pages;
+  CompactAndVerify();
+}
+
+TEST_F(DBTest, BytesPerSync) {
+  options_.write_buffer_size = 32 * 1024;
+  options_.max_file_size = 32 * 1024;
+  options_.bytes_per_sync = 8 * 1024;
+  Reopen();
+  CompactAndVerify();
+}
+
+TEST_F(DBTest, RateLimiter) {
+  options_.write_buffer_size = 32 * 1024;
+  options_.max_file_size = 32 * 1024;
+  auto rate_limiter =
+      std::make_shared<RateLimiter>(64 * 1024 * 1024, 10 * 1000, true, 1000);
+  options_.rate_limiter = rate_limiter;
+  Reopen();
+  CompactAndVerify();
+  // flush和compaction的写入都经过了限速器
+  EXPECT_GT(rate_limiter->GetTotalBytesThrough(IOPriority::kHigh), 0);
+  EXPECT_GT(rate_limiter->GetTotalBytesThrough(IOPriority::kLow), 0);
+}
+
+TEST_F(DBTest, MultiGet) {
+  options_.write_buffer_size = 64 * 1024;
+  Reopen();
+  // 一部分数据在sst中，一部分在memtable中，一部分被删除
+  std::map<std::string, std::string> model;
+  for (int32_t i = 0; i < 3000; ++i) {
+    const std::string& key = "key" + std::to_string(i % 2000);
+    if (i % 13 == 0) {
+      ASSERT_EQ(db_->Delete(WriteOptions(), key), Status::kSuccess);
+      model.erase(key);
+    } else {
+      model[key] = std::to_string(i) + std::string(100, 'v');
+      ASSERT_EQ(db_->Put(WriteOptions(), key, model[key]), Status::kSuccess);
+    }
+  }
+  CheckMultiGet(model, 2000);
+  std::vector<std::string> values;
+  EXPECT_TRUE(db_->MultiGet(ReadOptions(), {}, &values).empty());
+  // 同一个key出现多次
+  const auto& statuses =
+      db_->MultiGet(ReadOptions(), {"key1", "key1", "nokey"}, &values);
+  ASSERT_EQ(statuses.size(), 3u);
+  EXPECT_EQ(statuses[0], Status::kSuccess);
+  EXPECT_EQ(values[0], model["key1"]);
+  EXPECT_EQ(values[1], model["key1"]);
+  EXPECT_EQ(statuses[2], Status::kNotFound);
+}
+
+TEST_F(DBTest, HashSkipListMemTable) {
+  options_.write_buffer_size = 64 * 1024;
+  options_.memtable_factory = std::make_shared<HashSkipListRepFactory>(
+      std::make_shared<DelimitedPrefixExtractor>('|'), 1000);
+  Reopen();
+  std::map<std::string, std::string> model;
+  for (int32_t i = 0; i < 5000; ++i) {
+    const std::string& key =
+        "tenant" + std::to_string(i % 37) + "|" + std::to_string(i % 800);
+    const std::string& value = std::string(50, 'a' + i % 26);
+    ASSERT_EQ(db_->Put(WriteOptions(), key, value), Status::kSuccess);
+    model[key] = value;
+    if (i % 11 == 0) {
+      db_->Delete(WriteOptions(), key);
+      model.erase(key);
+    }
+  }
+  auto check = [&]() {
+    for (int32_t i = 0; i < 800; ++i) {
+      const std::string& key =
+          "tenant" + std::to_string(i % 37) + "|" + std::to_string(i);
+      auto iter = model.find(key);
+      ASSERT_EQ(Get(key), iter == model.end() ? "NOT_FOUND" : iter->second);
+    }
+    std::string expected;
+    for (const auto& item : model) {
+      expected.append(item.first + "=" + item.second + ";");
+    }
+    ASSERT_EQ(Contents(), expected);
+  };
+  check();
+  Reopen();
+  check();
+}
+
+TEST_F(DBTest, VectorMemTable) {
+  options_.write_buffer_size = 256 * 1024;
+  options_.memtable_factory = std::make_shared<VectorRepFactory>();
+  Reopen();
+  // 并发写入的时候只是追加，flush的时候再排序
+  static constexpr int32_t kThreadNum = 4;
+  static constexpr int32_t kKeyNumPerThread = 3000;
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < kThreadNum; ++t) {
+    threads.emplace_back([this, t]() {
+      for (int32_t i = kKeyNumPerThread - 1; i >= 0; --i) {
+        const std::string& key = std::to_string(i) + "_" + std::to_string(t);
+        ASSERT_EQ(db_->Put(WriteOptions(), key, key), Status::kSuccess);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (int32_t i = 0; i < kKeyNumPerThread; i += 7) {
+    const std::string& key = std::to_string(i) + "_1";
+    ASSERT_EQ(Get(key), key);
+  }
+  Reopen();
+  std::unique_ptr<Iterator> iter(db_->NewIterator(ReadOptions()));
+  int32_t count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(iter->key(), iter->value());
+    ++count;
+  }
+  EXPECT_EQ(count, kThreadNum * kKeyNumPerThread);
+}
+
+TEST_F(DBTest, PrefixSameAsStart) {
+  options_.write_buffer_size = 32 * 1024;
+  options_.max_file_size = 32 * 1024;
+  options_.prefix_extractor = std::make_shared<DelimitedPrefixExtractor>('|');
+  Reopen();
+  // 每个tenant的数据集中写入，只落在少数几个sst中，奇数编号的tenant不存在
+  std::map<std::string, std::string> model;
+  for (int32_t tenant = 0; tenant < 100; tenant += 2) {
+    for (int32_t i = 0; i < 50; ++i) {
+      const std::string& key =
+          "tenant" + std::to_string(tenant) + "|" + std::to_string(1000 + i);
+      model[key] = std::to_string(i) + std::string(100, 'v');
+      ASSERT_EQ(db_->Put(WriteOptions(), key, model[key]), Status::kSuccess);
+    }
+  }
+  ASSERT_EQ(db_->Put(WriteOptions(), "no_delimiter", "v"), Status::kSuccess);
+  model["no_delimiter"] = "v";
+  ReadOptions read_options;
+  read_options.prefix_same_as_start = true;
+  std::unique_ptr<Iterator> iter(db_->NewIterator(read_options));
+  for (int32_t tenant = 0; tenant < 100; ++tenant) {
+    const std::string& prefix = "tenant" + std::to_string(tenant) + "|";
+    std::string expected, actual;
+    for (auto it = model.lower_bound(prefix);
+         it != model.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+         ++it) {
+      expected.append(it->first + "=" + it->second + ";");
+    }
+    for (iter->Seek(prefix); iter->Valid(); iter->Next()) {
+      actual.append(iter->key()).append("=").append(iter->value()).append(";");
+    }
+    ASSERT_EQ(actual, expected) << prefix;
+    if (tenant % 2 == 1) {
+      EXPECT_TRUE(expected.empty());
+    }
+    // 反向遍历同样不会越过前缀的起点
+    iter->Seek(prefix + "1025");
+    if (tenant % 2 == 0) {
+      int32_t count = 0;
+      for (; iter->Valid(); iter->Prev()) {
+        ++count;
+      }
+      EXPECT_EQ(count, 26);
+    }
+  }
+  EXPECT_EQ(iter->status(), Status::kSuccess);
+  // 不在domain里的目标不受前缀限制
+  iter->Seek("no");
+  ASSERT_TRUE(iter->Valid());
+  EXPECT_EQ(iter->key(), "no_delimiter");
+  // 默认的迭代器会越过前缀继续返回后面的key
+  std::unique_ptr<Iterator> total_order(db_->NewIterator(ReadOptions()));
+  total_order->Seek("tenant1|");
+  ASSERT_TRUE(total_order->Valid());
+  EXPECT_EQ(total_order->key(), "tenant20|1000");
+}
+
+TEST_F(DBTest, TableProperties) {
+  for (int32_t i = 0; i < 1000; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), "key" + std::to_string(i),
+                       std::string(100, 'v')),
+              Status::kSuccess);
+  }
+  for (int32_t i = 0; i < 1000; i += 10) {
+    ASSERT_EQ(db_->Delete(WriteOptions(), "key" + std::to_string(i)),
+              Status::kSuccess);
+  }
+  // 恢复的时候把WAL中的数据刷成一个sst
+  Reopen();
+  ASSERT_EQ(NumFilesAtLevel(0), 1);
+  TablePropertiesCollection props;
+  ASSERT_EQ(db_->GetPropertiesOfAllTables(&props), Status::kSuccess);
+  ASSERT_EQ(props.size(), 1u);
+  const TableProperties& p = *props.begin()->second;
+  EXPECT_EQ(p.num_entries, 1100u);
+  EXPECT_EQ(p.num_deletions, 100u);
+  EXPECT_EQ(p.raw_value_size, 1000u * 100);
+  EXPECT_EQ(ExtractUserKey(p.smallest_key), "key0");
+  EXPECT_EQ(ExtractUserKey(p.largest_key), "key999");
+  EXPECT_GT(p.creation_time, 0u);
+  EXPECT_GT(p.CompressionRatio(), 0);
+}
+
+TEST_F(DBTest, ApproximateSizes) {
+  options_.write_buffer_size = 256 * 1024;
+  Reopen();
+  auto key_of = [](int32_t i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    return std::string(buf);
+  };
+  const int32_t kKeyNum = 20000;
+  for (int32_t i = 0; i < kKeyNum; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), key_of(i), std::string(100, 'a' + i % 26)),
+              Status::kSuccess);
+  }
+  Reopen();
+  for (int32_t retry = 0;
+       retry < 500 &&
+       NumFilesAtLevel(0) >= options_.level0_file_num_compaction_trigger;
+       ++retry) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::string value;
+  ASSERT_TRUE(db_->GetProperty("corekv.total-sst-files-size", &value));
+  const uint64_t total = std::stoull(value);
+  const std::string first = key_of(0), middle = key_of(kKeyNum / 2),
+                    last = key_of(kKeyNum), empty = "zzz";
+  const Range ranges[] = {Range(first, last), Range(first, middle),
+                          Range(middle, last), Range(last, empty)};
+  uint64_t sizes[4];
+  db_->GetApproximateSizes(ranges, 4, sizes);
+  // 文件末尾的meta block和index不属于任何区间
+  EXPECT_GT(sizes[0], total * 8 / 10);
+  EXPECT_LE(sizes[0], total);
+  EXPECT_NEAR(static_cast<double>(sizes[1]), sizes[0] / 2.0, sizes[0] * 0.1);
+  EXPECT_NEAR(static_cast<double>(sizes[2]), sizes[0] / 2.0, sizes[0] * 0.1);
+  EXPECT_EQ(sizes[3], 0u);
+
+  // 切分出来的每一段大小接近
+  std::vector<std::string> boundaries;
+  db_->GetApproximateKeyBoundaries(4, &boundaries);
+  ASSERT_EQ(boundaries.size(), 3u);
+  std::vector<std::string> points = {first};
+  points.insert(points.end(), boundaries.begin(), boundaries.end());
+  points.push_back(last);
+  for (size_t i = 0; i + 1 < points.size(); ++i) {
+    ASSERT_LT(points[i], points[i + 1]);
+    const Range range(points[i], points[i + 1]);
+    uint64_t size = 0;
+    db_->GetApproximateSizes(&range, 1, &size);
+    EXPECT_NEAR(static_cast<double>(size), sizes[0] / 4.0, sizes[0] * 0.1);
+  }
+  db_->GetApproximateKeyBoundaries(1, &boundaries);
+  EXPECT_TRUE(boundaries.empty());
+}
+
+TEST_F(DBTest, ParallelScan) {
+  options_.write_buffer_size = 32 * 1024;
+  Reopen();
+  std::map<std::string, std::string> model;
+  char key[16];
+  for (int32_t i = 0; i < 5000; ++i) {
+    snprintf(key, sizeof(key), "key%05d", i);
+    model[key] = std::to_string(i) + std::string(100, 'v');
+    ASSERT_EQ(db_->Put(WriteOptions(), key, model[key]), Status::kSuccess);
+  }
+  for (int32_t i = 0; i < 5000; i += 7) {
+    snprintf(key, sizeof(key), "key%05d", i);
+    model.erase(key);
+    ASSERT_EQ(db_->Delete(WriteOptions(), key), Status::kSuccess);
+  }
+  Reopen();
+  // 一部分数据留在memtable中
+  ASSERT_EQ(db_->Put(WriteOptions(), "key00001", "mem"), Status::kSuccess);
+  model["key00001"] = "mem";
+
+  auto scan = [this](const std::string_view* begin,
+                     const std::string_view* end, int32_t n_threads,
+                     std::map<std::string, std::string>* result) {
+    std::mutex mutex;
+    size_t calls = 0;
+    DBStatus s = db_->ParallelScan(
+        ReadOptions(), begin, end, n_threads,
+        [&](const std::string_view& k, const std::string_view& v) {
+          std::lock_guard<std::mutex> lock(mutex);
+          ++calls;
+          (*result)[std::string(k)] = std::string(v);
+          return true;
+        });
+    // 分区之间没有重叠
+    EXPECT_EQ(calls, result->size());
+    return s;
+  };
+  std::map<std::string, std::string> result;
+  ASSERT_EQ(scan(nullptr, nullptr, 4, &result), Status::kSuccess);
+  EXPECT_EQ(result, model);
+
+  const std::string_view begin("key01000"), end("key02000");
+  result.clear();
+  ASSERT_EQ(scan(&begin, &end, 3, &result), Status::kSuccess);
+  std::map<std::string, std::string> expected(model.lower_bound("key01000"),
+                                              model.lower_bound("key02000"));
+  EXPECT_EQ(result, expected);
+
+  // 只限制一侧
+  result.clear();
+  ASSERT_EQ(scan(&end, nullptr, 3, &result), Status::kSuccess);
+  expected.clear();
+  expected.insert(model.lower_bound("key02000"), model.end());
+  EXPECT_EQ(result, expected);
+  result.clear();
+  ASSERT_EQ(scan(nullptr, &begin, 3, &result), Status::kSuccess);
+  expected.clear();
+  expected.insert(model.begin(), model.lower_bound("key01000"));
+  EXPECT_EQ(result, expected);
+
+  // 空字符串是普通的key，不表示不限制：作为begin从头开始，作为end什么都没有
+  const std::string_view empty;
+  result.clear();
+  ASSERT_EQ(scan(&empty, nullptr, 4, &result), Status::kSuccess);
+  EXPECT_EQ(result, model);
+  result.clear();
+  ASSERT_EQ(scan(nullptr, &empty, 4, &result), Status::kSuccess);
+  EXPECT_TRUE(result.empty());
+
+  // 回调返回false之后所有分区都停止
+  std::atomic<int32_t> calls(0);
+  ASSERT_EQ(db_->ParallelScan(ReadOptions(), nullptr, nullptr, 4,
+                              [&calls](const std::string_view&,
+                                       const std::string_view&) {
+                                calls.fetch_add(1);
+                                return false;
+                              }),
+            Status::kSuccess);
+  EXPECT_GE(calls.load(), 1);
+  EXPECT_LE(calls.load(), 4);
+}
+
+TEST_F(DBTest, IngestExternalFile) {
+  // b在memtable中，c已经刷成sst，导入之后都被文件中的版本覆盖
+  ASSERT_EQ(db_->Put(WriteOptions(), "c", "old_c"), Status::kSuccess);
+  Reopen();
+  ASSERT_EQ(db_->Put(WriteOptions(), "a", "old_a"), Status::kSuccess);
+  ASSERT_EQ(db_->Put(WriteOptions(), "b", "old_b"), Status::kSuccess);
+  ASSERT_EQ(db_->Put(WriteOptions(), "z", "old_z"), Status::kSuccess);
+
+  const std::string path = kDBName + "_external.sst";
+  SstFileWriter writer(options_);
+  ASSERT_EQ(writer.Open(path), Status::kSuccess);
+  ASSERT_EQ(writer.Put("b", "new_b"), Status::kSuccess);
+  ASSERT_EQ(writer.Put("c", "new_c"), Status::kSuccess);
+  ASSERT_EQ(writer.Delete("d"), Status::kSuccess);
+  ASSERT_EQ(writer.Put("e", "new_e"), Status::kSuccess);
+  // key必须严格递增
+  EXPECT_EQ(writer.Put("e", "dup"), Status::kInvalidArgument);
+  uint64_t file_size = 0;
+  ASSERT_EQ(writer.Finish(&file_size), Status::kSuccess);
+  EXPECT_EQ(file_size, FileTool::GetFileSize(path));
+
+  ASSERT_EQ(db_->Put(WriteOptions(), "d", "old_d"), Status::kSuccess);
+  ASSERT_EQ(db_->IngestExternalFile(path), Status::kSuccess);
+  FileTool::RemoveFile(path);
+  const std::string expected = "a=old_a;b=new_b;c=new_c;e=new_e;z=old_z;";
+  EXPECT_EQ(Contents(), expected);
+  EXPECT_EQ(Get("d"), "NOT_FOUND");
+  std::vector<std::string> values;
+  auto statuses = db_->MultiGet(ReadOptions(), {"a", "c", "d", "e"}, &values);
+  EXPECT_EQ(statuses[0], Status::kSuccess);
+  EXPECT_EQ(values[1], "new_c");
+  EXPECT_EQ(statuses[2], Status::kNotFound);
+  EXPECT_EQ(values[3], "new_e");
+
+  // 之后的写入比导入的文件新
+  ASSERT_EQ(db_->Put(WriteOptions(), "c", "newer_c"), Status::kSuccess);
+  EXPECT_EQ(Get("c"), "newer_c");
+  Reopen();
+  EXPECT_EQ(Get("c"), "newer_c");
+  EXPECT_EQ(Get("b"), "new_b");
+  EXPECT_EQ(Get("d"), "NOT_FOUND");
+  EXPECT_EQ(Contents(), "a=old_a;b=new_b;c=newer_c;e=new_e;z=old_z;");
+
+  // 文件不存在或者为空
+  EXPECT_NE(db_->IngestExternalFile(path), Status::kSuccess);
+  SstFileWriter empty(options_);
+  ASSERT_EQ(empty.Open(path), Status::kSuccess);
+  EXPECT_EQ(empty.Finish(), Status::kInvalidArgument);
+}
+
+TEST_F(DBTest, BlobFiles) {
+  options_.write_buffer_size = 32 * 1024;
+  options_.max_file_size = 32 * 1024;
+  options_.max_bytes_for_level_base = 128 * 1024;
+  options_.max_bytes_for_level_multiplier = 4;
+  options_.max_background_jobs = 3;
+  options_.min_blob_size = 64;
+  options_.blob_file_size = 64 * 1024;
+  options_.blob_garbage_collection_age_cutoff = 0.5;
+  Reopen();
+  CompactAndVerify();
+  // 小于min_blob_size的value仍然保存在sst中
+  ASSERT_EQ(db_->Put(WriteOptions(), "small", "v"), Status::kSuccess);
+  Reopen();
+  EXPECT_EQ(Get("small"), "v");
+  std::string value;
+  ASSERT_TRUE(db_->GetProperty("corekv.num-blob-files", &value));
+  EXPECT_GT(std::stoi(value), 0);
+
+  // 覆盖写产生的garbage被回收，磁盘上的blob文件远小于写入的总量
+  uint64_t blob_bytes = 0;
+  std::vector<std::string> filenames;
+  FileTool::GetChildren(kDBName, &filenames);
+  for (const auto& filename : filenames) {
+    if (filename.size() > 5 &&
+        filename.compare(filename.size() - 5, 5, ".blob") == 0) {
+      blob_bytes += FileTool::GetFileSize(kDBName + "/" + filename);
+    }
+  }
+  EXPECT_GT(blob_bytes, 0);
+  EXPECT_LT(blob_bytes, 1024 * 1024);
+}
+
+TEST_F(DBTest, TTL) {
+  ASSERT_EQ(db_->Put(WriteOptions(), "key0", "old"), Status::kSuccess);
+  ASSERT_EQ(db_->PutWithTTL(WriteOptions(), "key0", "v0", 200),
+            Status::kSuccess);
+  ASSERT_EQ(db_->PutWithTTL(WriteOptions(), "key1", "v1", 3600 * 1000),
+            Status::kSuccess);
+  ASSERT_EQ(db_->PutWithTTL(WriteOptions(), "key2", "v2", 200),
+            Status::kSuccess);
+  std::map<std::string, std::string> model = {
+      {"key0", "v0"}, {"key1", "v1"}, {"key2", "v2"}};
+  auto check = [&]() {
+    for (int32_t i = 0; i < 3; ++i) {
+      const std::string& key = "key" + std::to_string(i);
+      auto iter = model.find(key);
+      ASSERT_EQ(Get(key), iter == model.end() ? "NOT_FOUND" : iter->second);
+    }
+    CheckMultiGet(model, 3);
+    std::string expected;
+    for (const auto& item : model) {
+      expected.append(item.first + "=" + item.second + ";");
+    }
+    ASSERT_EQ(Contents(), expected);
+  };
+  check();
+
+  // 过期之后和删除一样，也不会露出更旧的版本
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  model = {{"key1", "v1"}};
+  check();
+  // 从日志恢复到memtable
+  Reopen();
+  check();
+
+  // 写入更多数据触发flush和compaction，过期的value在sst中同样不可见
+  options_.write_buffer_size = 32 * 1024;
+  options_.max_file_size = 32 * 1024;
+  Reopen();
+  for (int32_t i = 0; i < 5000; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), "filler" + std::to_string(i),
+                       std::string(100, 'x')),
+              Status::kSuccess);
+  }
+  for (int32_t retry = 0;
+       retry < 500 &&
+       NumFilesAtLevel(0) >= options_.level0_file_num_compaction_trigger;
+       ++retry) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  for (int32_t i = 0; i < 3; ++i) {
+    const std::string& key = "key" + std::to_string(i);
+    auto iter = model.find(key);
+    ASSERT_EQ(Get(key), iter == model.end() ? "NOT_FOUND" : iter->second);
+  }
+  CheckMultiGet(model, 3);
+  Reopen();
+  EXPECT_EQ(Get("key0"), "NOT_FOUND");
+  EXPECT_EQ(Get("key1"), "v1");
+  EXPECT_EQ(Get("key2"), "NOT_FOUND");
+}
+
+TEST_F(DBTest, MergeOperator) {
+  ASSERT_EQ(db_->Merge(WriteOptions(), "a", "x"), Status::kNotSupported);
+  options_.merge_operator = std::make_shared<StringAppendOperator>(',');
+  Reopen();
+  // 没有旧的value、覆盖在value上、覆盖在删除标记上
+  ASSERT_EQ(db_->Merge(WriteOptions(), "key0", "a"), Status::kSuccess);
+  ASSERT_EQ(db_->Merge(WriteOptions(), "key0", "b"), Status::kSuccess);
+  ASSERT_EQ(db_->Put(WriteOptions(), "key1", "v"), Status::kSuccess);
+  ASSERT_EQ(db_->Merge(WriteOptions(), "key1", "c"), Status::kSuccess);
+  ASSERT_EQ(db_->Put(WriteOptions(), "key2", "old"), Status::kSuccess);
+  ASSERT_EQ(db_->Delete(WriteOptions(), "key2"), Status::kSuccess);
+  ASSERT_EQ(db_->Merge(WriteOptions(), "key2", "d"), Status::kSuccess);
+  // 操作数之后的value遮住了操作数
+  ASSERT_EQ(db_->Merge(WriteOptions(), "key3", "e"), Status::kSuccess);
+  ASSERT_EQ(db_->Put(WriteOptions(), "key3", "f"), Status::kSuccess);
+  std::map<std::string, std::string> model = {
+      {"key0", "a,b"}, {"key1", "v,c"}, {"key2", "d"}, {"key3", "f"}};
+  auto check = [&]() {
+    for (const auto& item : model) {
+      ASSERT_EQ(Get(item.first), item.second);
+    }
+    CheckMultiGet(model, 4);
+    std::string expected;
+    for (const auto& item : model) {
+      expected.append(item.first + "=" + item.second + ";");
+    }
+    ASSERT_EQ(Contents(), expected);
+  };
+  check();
+  Reopen();
+  check();
+
+  // 操作数和旧的value分散在memtable和不同层的sst中
+  options_.write_buffer_size = 32 * 1024;
+  options_.max_file_size = 32 * 1024;
+  Reopen();
+  for (int32_t round = 0; round < 4; ++round) {
+    ASSERT_EQ(db_->Merge(WriteOptions(), "key0", std::to_string(round)),
+              Status::kSuccess);
+    model["key0"] += "," + std::to_string(round);
+    for (int32_t i = 0; i < 2000; ++i) {
+      ASSERT_EQ(db_->Put(WriteOptions(), "filler" + std::to_string(i),
+                         std::string(100, 'x')),
+                Status::kSuccess);
+    }
+    ASSERT_EQ(Get("key0"), model["key0"]);
+  }
+  for (int32_t retry = 0;
+       retry < 500 &&
+       NumFilesAtLevel(0) >= options_.level0_file_num_compaction_trigger;
+       ++retry) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  for (const auto& item : model) {
+    ASSERT_EQ(Get(item.first), item.second);
+  }
+  CheckMultiGet(model, 4);
+  Reopen();
+  for (const auto& item : model) {
+    ASSERT_EQ(Get(item.first), item.second);
+  }
+}
+
+TEST_F(DBTest, MergeCounter) {
+  options_.merge_operator = std::make_shared<UInt64AddOperator>();
+  options_.write_buffer_size = 32 * 1024;
+  options_.max_file_size = 32 * 1024;
+  Reopen();
+  auto encode = [](uint64_t n) {
+    std::string value;
+    util::PutFixed64(&value, n);
+    return value;
+  };
+  // 大量的加一分散到多层，compaction合并之后结果不变
+  std::map<std::string, uint64_t> counters;
+  for (int32_t i = 0; i < 20000; ++i) {
+    const std::string& key = "counter" + std::to_string(i % 50);
+    ASSERT_EQ(db_->Merge(WriteOptions(), key, encode(1)), Status::kSuccess);
+    ++counters[key];
+    if (i % 10 == 0) {
+      ASSERT_EQ(db_->Put(WriteOptions(), "filler" + std::to_string(i),
+                         std::string(100, 'x')),
+                Status::kSuccess);
+    }
+  }
+  auto check = [&]() {
+    for (const auto& item : counters) {
+      const std::string& value = Get(item.first);
+      ASSERT_EQ(value.size(), sizeof(uint64_t));
+      ASSERT_EQ(util::DecodeFixed64(value.data()), item.second) << item.first;
+    }
+  };
+  check();
+  for (int32_t retry = 0;
+       retry < 500 &&
+       NumFilesAtLevel(0) >= options_.level0_file_num_compaction_trigger;
+       ++retry) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  check();
+  Reopen();
+  check();
+}
+
+namespace {
+// 删除drop开头的key，把change开头的key的value改成changed
+class TestCompactionFilter final : public CompactionFilter {
+ public:
+  const char* Name() const override { return "TestCompactionFilter"; }
+  bool Filter(int32_t level, const std::string_view& key,
+              const std::string_view& existing_value, std::string* new_value,
+              bool* value_changed) const override {
+    if (key.substr(0, 4) == "drop") {
+      return true;
+    }
+    if (key.substr(0, 6) == "change") {
+      new_value->assign("changed");
+      *value_changed = true;
+    }
+    return false;
+  }
+};
+}  // namespace
+
+TEST_F(DBTest, CompactionFilter) {
+  options_.compaction_filter = std::make_shared<TestCompactionFilter>();
+  options_.write_buffer_size = 32 * 1024;
+  options_.max_file_size = 32 * 1024;
+  Reopen();
+  for (int32_t i = 0; i < 100; ++i) {
+    const std::string& suffix = std::to_string(i);
+    ASSERT_EQ(db_->Put(WriteOptions(), "drop" + suffix, "v"),
+              Status::kSuccess);
+    ASSERT_EQ(db_->Put(WriteOptions(), "change" + suffix, "v"),
+              Status::kSuccess);
+    ASSERT_EQ(db_->Put(WriteOptions(), "keep" + suffix, "v"),
+              Status::kSuccess);
+  }
+  // compaction之前不受filter影响
+  EXPECT_EQ(Get("drop0"), "v");
+  EXPECT_EQ(Get("change0"), "v");
+  // 写入更多数据，等待这些key被compaction合并到下一层
+  for (int32_t i = 0; i < 20000; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), "filler" + std::to_string(i),
+                       std::string(100, 'x')),
+              Status::kSuccess);
+  }
+  for (int32_t retry = 0;
+       retry < 500 &&
+       NumFilesAtLevel(0) >= options_.level0_file_num_compaction_trigger;
+       ++retry) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_LT(NumFilesAtLevel(0), options_.level0_file_num_compaction_trigger);
+  for (int32_t i = 0; i < 100; ++i) {
+    const std::string& suffix = std::to_string(i);
+    EXPECT_EQ(Get("drop" + suffix), "NOT_FOUND");
+    EXPECT_EQ(Get("change" + suffix), "changed");
+    EXPECT_EQ(Get("keep" + suffix), "v");
+  }
+}
+
+namespace {
+// 按照字典序的逆序排列
+class ReverseComparator final : public Comparator {
+ public:
+  const char* Name() override { return "test.ReverseComparator"; }
+  int32_t Compare(const std::string_view& a,
+                  const std::string_view& b) override {
+    return b.compare(a);
+  }
+  void FindShortest(std::string& start,
+                    const std::string_view& limit) override {}
+};
+}  // namespace
+
+TEST_F(DBTest, ColumnFamilies) {
+  Options cf_options;
+  cf_options.comparator = std::make_shared<ReverseComparator>();
+  cf_options.write_buffer_size = 16 * 1024;
+  ColumnFamilyHandle* cf = nullptr;
+  ASSERT_EQ(db_->CreateColumnFamily(cf_options, "reverse", &cf),
+            Status::kSuccess);
+  EXPECT_EQ(cf->GetName(), "reverse");
+  EXPECT_NE(cf->GetID(), 0u);
+  // 名字不能重复
+  ColumnFamilyHandle* dup = nullptr;
+  EXPECT_EQ(db_->CreateColumnFamily(cf_options, "reverse", &dup),
+            Status::kInvalidArgument);
+
+  // 同一个batch写入两个column family，key互相隔离
+  WriteBatch batch;
+  batch.Put("a", "default_a");
+  batch.Put(cf, "a", "cf_a");
+  batch.Put(cf, "b", "cf_b");
+  ASSERT_EQ(db_->Write(WriteOptions(), &batch), Status::kSuccess);
+  std::string value;
+  EXPECT_EQ(Get("a"), "default_a");
+  EXPECT_EQ(Get("b"), "NOT_FOUND");
+  ASSERT_EQ(db_->Get(ReadOptions(), cf, "a", &value), Status::kSuccess);
+  EXPECT_EQ(value, "cf_a");
+  ASSERT_EQ(db_->Delete(WriteOptions(), cf, "a"), Status::kSuccess);
+  EXPECT_EQ(db_->Get(ReadOptions(), cf, "a", &value), Status::kNotFound);
+  EXPECT_EQ(Get("a"), "default_a");
+  {
+    // 使用各自的comparator排序
+    ASSERT_EQ(db_->Put(WriteOptions(), cf, "c", "cf_c"), Status::kSuccess);
+    std::unique_ptr<Iterator> iter(db_->NewIterator(ReadOptions(), cf));
+    std::string keys;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      keys.append(iter->key());
+    }
+    EXPECT_EQ(keys, "cb");
+  }
+  // 写满小的write_buffer_size会刷成sst
+  for (int32_t i = 0; i < 2000; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), cf, "key" + std::to_string(i),
+                       std::string(100, 'v')),
+              Status::kSuccess);
+  }
+  ASSERT_EQ(db_->DestroyColumnFamilyHandle(cf), Status::kSuccess);
+
+  // 已有的column family没有出现在descriptor中的时候打不开
+  db_.reset();
+  DB* db = nullptr;
+  EXPECT_EQ(DB::Open(options_, kDBName, &db), Status::kInvalidArgument);
+  // comparator不一致的时候打不开
+  std::vector<ColumnFamilyDescriptor> descriptors;
+  descriptors.emplace_back(kDefaultColumnFamilyName, options_);
+  descriptors.emplace_back("reverse", Options());
+  std::vector<ColumnFamilyHandle*> handles;
+  EXPECT_EQ(DB::Open(options_, kDBName, descriptors, &handles, &db),
+            Status::kInvalidArgument);
+  // 重新打开之后从sst和WAL中恢复出两个column family的数据
+  descriptors[1].options = cf_options;
+  ASSERT_EQ(DB::Open(options_, kDBName, descriptors, &handles, &db),
+            Status::kSuccess);
+  db_.reset(db);
+  ASSERT_EQ(handles.size(), 2u);
+  EXPECT_EQ(handles[0], db_->DefaultColumnFamily());
+  cf = handles[1];
+  EXPECT_EQ(Get("a"), "default_a");
+  EXPECT_EQ(db_->Get(ReadOptions(), cf, "a", &value), Status::kNotFound);
+  ASSERT_EQ(db_->Get(ReadOptions(), cf, "b", &value), Status::kSuccess);
+  EXPECT_EQ(value, "cf_b");
+  for (int32_t i = 0; i < 2000; i += 100) {
+    ASSERT_EQ(
+        db_->Get(ReadOptions(), cf, "key" + std::to_string(i), &value),
+        Status::kSuccess);
+    EXPECT_EQ(value, std::string(100, 'v'));
+  }
+  std::string files;
+  int32_t num_files = 0;
+  for (int32_t level = 0; level < config::kNumLevels; ++level) {
+    ASSERT_TRUE(db_->GetProperty(
+        cf, "corekv.num-files-at-level" + std::to_string(level), &files));
+    num_files += std::stoi(files);
+  }
+  EXPECT_GT(num_files, 0);
+
+  // 默认column family不能删除，删除之后的column family不能再写入
+  EXPECT_EQ(db_->DropColumnFamily(db_->DefaultColumnFamily()),
+            Status::kInvalidArgument);
+  ASSERT_EQ(db_->DropColumnFamily(cf), Status::kSuccess);
+  ASSERT_EQ(db_->DestroyColumnFamilyHandle(cf), Status::kSuccess);
+  descriptors.pop_back();
+  db_.reset();
+  ASSERT_EQ(DB::Open(options_, kDBName, descriptors, &handles, &db),
+            Status::kSuccess);
+  db_.reset(db);
+  EXPECT_EQ(Get("a"), "default_a");
+  // 删除之后名字可以重新使用，得到的是一个新的空的column family
+  ASSERT_EQ(db_->CreateColumnFamily(cf_options, "reverse", &cf),
+            Status::kSuccess);
+  EXPECT_EQ(db_->Get(ReadOptions(), cf, "b", &value), Status::kNotFound);
+  ASSERT_EQ(db_->DestroyColumnFamilyHandle(cf), Status::kSuccess);
+}
+
+TEST_F(DBTest, WriteStall) {
+  std::string value;
+  ASSERT_TRUE(db_->GetProperty("corekv.is-write-stopped", &value));
+  EXPECT_EQ(value, "0");
+  ASSERT_TRUE(db_->GetProperty("corekv.actual-delayed-write-rate", &value));
+  EXPECT_EQ(value, "0");
+  ASSERT_TRUE(
+      db_->GetProperty("corekv.estimate-pending-compaction-bytes", &value));
+  EXPECT_EQ(value, "0");
+
+  // level0有两个文件就开始限速，刷盘之后到compaction完成之前的写入都会被推迟
+  options_.statistics = std::make_shared<Statistics>();
+  options_.write_buffer_size = 16 * 1024;
+  options_.level0_file_num_compaction_trigger = 2;
+  options_.level0_slowdown_writes_trigger = 2;
+  options_.delayed_write_rate = 1024 * 1024;
+  Reopen();
+  for (int32_t i = 0; i < 2000; ++i) {
+    ASSERT_EQ(db_->Put(WriteOptions(), "key" + std::to_string(i),
+                       std::string(100, 'v')),
+              Status::kSuccess);
+  }
+  EXPECT_GT(options_.statistics->GetTickerCount(kStallMicros), 0u);
+  for (int32_t i = 0; i < 2000; i += 100) {
+    EXPECT_EQ(Get("key" + std::to_string(i)), std::string(100, 'v'));
+  }
+  ASSERT_TRUE(db_->GetProperty("corekv.is-write-stopped", &value));
+  EXPECT_EQ(value, "0");
+}
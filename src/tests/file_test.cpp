@@ -0,0 +1,42 @@
+#include "file/file.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+using namespace corekv;
+
+static const std::string kFileName = "file_writer.dat";
+
+// 每次追加4KB，一共写total字节，返回发起sync_file_range的次数
+static uint64_t WriteAndCountRangeSyncs(bool append, uint64_t bytes_per_sync,
+                                        uint64_t total) {
+  FileWriter writer(kFileName, append);
+  writer.SetBytesPerSync(bytes_per_sync);
+  const std::string chunk(4096, 'x');
+  for (uint64_t written = 0; written < total; written += chunk.size()) {
+    EXPECT_EQ(writer.Append(chunk.data(), chunk.size()), Status::kSuccess);
+  }
+  EXPECT_EQ(writer.Sync(), Status::kSuccess);
+  writer.Close();
+  return writer.RangeSyncCount();
+}
+
+TEST(FileWriterTest, BytesPerSync) {
+  static constexpr uint64_t kTotal = 4 * 1024 * 1024;
+  // 大约每bytes_per_sync字节回写一次
+  uint64_t count = WriteAndCountRangeSyncs(false, 256 * 1024, kTotal);
+  EXPECT_GE(count, kTotal / (256 * 1024) - 1);
+  EXPECT_LE(count, kTotal / (256 * 1024));
+  count = WriteAndCountRangeSyncs(false, 1024 * 1024, kTotal);
+  EXPECT_GE(count, kTotal / (1024 * 1024) - 1);
+  EXPECT_LE(count, kTotal / (1024 * 1024));
+  // 没有打开的时候从来不回写
+  EXPECT_EQ(WriteAndCountRangeSyncs(false, 0, kTotal), 0u);
+  // 追加写从原来的末尾开始累计
+  count = WriteAndCountRangeSyncs(true, 1024 * 1024, kTotal);
+  EXPECT_GE(count, kTotal / (1024 * 1024) - 1);
+  EXPECT_LE(count, kTotal / (1024 * 1024));
+  EXPECT_EQ(FileTool::GetFileSize(kFileName), 2 * kTotal);
+  FileTool::RemoveFile(kFileName);
+}
@@ -0,0 +1,80 @@
+#include "table/filter_block.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "filter/bloomfilter.h"
+
+using namespace std;
+using namespace corekv;
+
+TEST(filterBlockTest, EmptyBuilder) {
+  BloomFilter policy(10);
+  PerBlockFilterBuilder builder(&policy);
+  const std::string block = builder.Finish();
+  // 只有offset数组的位置和base_lg
+  EXPECT_EQ(block.size(), 5u);
+  PerBlockFilterReader reader(&policy, block);
+  EXPECT_TRUE(reader.KeyMayMatch(0, "foo"));
+  EXPECT_TRUE(reader.KeyMayMatch(100000, "foo"));
+}
+
+TEST(filterBlockTest, SingleChunk) {
+  BloomFilter policy(10);
+  PerBlockFilterBuilder builder(&policy);
+  builder.StartBlock(100);
+  builder.AddKey("foo");
+  builder.AddKey("bar");
+  builder.AddKey("box");
+  builder.StartBlock(200);
+  builder.AddKey("box");
+  builder.StartBlock(300);
+  builder.AddKey("hello");
+  const std::string block = builder.Finish();
+  PerBlockFilterReader reader(&policy, block);
+  EXPECT_TRUE(reader.KeyMayMatch(100, "foo"));
+  EXPECT_TRUE(reader.KeyMayMatch(100, "bar"));
+  EXPECT_TRUE(reader.KeyMayMatch(100, "box"));
+  EXPECT_TRUE(reader.KeyMayMatch(100, "hello"));
+  EXPECT_FALSE(reader.KeyMayMatch(100, "missing"));
+  EXPECT_FALSE(reader.KeyMayMatch(100, "other"));
+}
+
+TEST(filterBlockTest, MultiChunk) {
+  BloomFilter policy(10);
+  PerBlockFilterBuilder builder(&policy);
+  // 第一个filter
+  builder.StartBlock(0);
+  builder.AddKey("foo");
+  builder.StartBlock(2000);
+  builder.AddKey("bar");
+  // 第二个filter
+  builder.StartBlock(3100);
+  builder.AddKey("box");
+  // 第三个filter为空
+  // 第四个filter
+  builder.StartBlock(9000);
+  builder.AddKey("box");
+  builder.AddKey("hello");
+  const std::string block = builder.Finish();
+  PerBlockFilterReader reader(&policy, block);
+
+  EXPECT_TRUE(reader.KeyMayMatch(0, "foo"));
+  EXPECT_TRUE(reader.KeyMayMatch(2000, "bar"));
+  EXPECT_FALSE(reader.KeyMayMatch(0, "box"));
+  EXPECT_FALSE(reader.KeyMayMatch(0, "hello"));
+
+  EXPECT_TRUE(reader.KeyMayMatch(3100, "box"));
+  EXPECT_FALSE(reader.KeyMayMatch(3100, "foo"));
+  EXPECT_FALSE(reader.KeyMayMatch(3100, "bar"));
+  EXPECT_FALSE(reader.KeyMayMatch(3100, "hello"));
+
+  EXPECT_FALSE(reader.KeyMayMatch(4100, "foo"));
+  EXPECT_FALSE(reader.KeyMayMatch(4100, "box"));
+
+  EXPECT_TRUE(reader.KeyMayMatch(9000, "box"));
+  EXPECT_TRUE(reader.KeyMayMatch(9000, "hello"));
+  EXPECT_FALSE(reader.KeyMayMatch(9000, "foo"));
+  EXPECT_FALSE(reader.KeyMayMatch(9000, "bar"));
+}
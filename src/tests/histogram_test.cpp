@@ -0,0 +1,47 @@
+#include "utils/histogram.h"
+
+#include <gtest/gtest.h>
+
+using namespace corekv;
+
+TEST(HistogramTest, Empty) {
+  Histogram h;
+  EXPECT_EQ(h.Count(), 0u);
+  EXPECT_EQ(h.Min(), 0);
+  EXPECT_EQ(h.Max(), 0);
+  EXPECT_EQ(h.Average(), 0);
+  EXPECT_EQ(h.Percentile(99), 0);
+}
+
+TEST(HistogramTest, Percentiles) {
+  Histogram h;
+  for (int32_t i = 1; i <= 10000; ++i) {
+    h.Add(i);
+  }
+  EXPECT_EQ(h.Count(), 10000u);
+  EXPECT_EQ(h.Min(), 1);
+  EXPECT_EQ(h.Max(), 10000);
+  EXPECT_DOUBLE_EQ(h.Average(), 5000.5);
+  EXPECT_NEAR(h.StandardDeviation(), 2886.75, 0.01);
+  // 桶宽度约10%，插值之后误差更小
+  EXPECT_NEAR(h.Median(), 5000, 500);
+  EXPECT_NEAR(h.Percentile(99), 9900, 990);
+  EXPECT_LE(h.Percentile(100), 10000);
+  EXPECT_GE(h.Percentile(0), 1);
+}
+
+TEST(HistogramTest, Merge) {
+  Histogram a, b;
+  for (int32_t i = 0; i < 100; ++i) {
+    a.Add(10);
+    b.Add(1000);
+  }
+  a.Merge(b);
+  EXPECT_EQ(a.Count(), 200u);
+  EXPECT_EQ(a.Min(), 10);
+  EXPECT_EQ(a.Max(), 1000);
+  EXPECT_NEAR(a.Percentile(25), 10, 1);
+  EXPECT_NEAR(a.Percentile(75), 1000, 100);
+  a.Clear();
+  EXPECT_EQ(a.Count(), 0u);
+}
@@ -0,0 +1,166 @@
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "db/log_reader.h"
+#include "db/log_writer.h"
+#include "file/file.h"
+
+using namespace std;
+using namespace corekv;
+
+static const std::string kLogFile = "log_test.log";
+
+static std::string BigString(const std::string& partial, size_t n) {
+  std::string result;
+  while (result.size() < n) {
+    result.append(partial);
+  }
+  result.resize(n);
+  return result;
+}
+
+static std::vector<std::string> ReadAll(uint64_t* dropped = nullptr) {
+  FileReader file_reader(kLogFile);
+  log::Reader reader(&file_reader, true);
+  std::vector<std::string> records;
+  std::string_view record;
+  std::string scratch;
+  while (reader.ReadRecord(&record, &scratch)) {
+    records.emplace_back(record);
+  }
+  if (dropped) {
+    *dropped = reader.DroppedBytes();
+  }
+  return records;
+}
+
+TEST(logTest, ReadWrite) {
+  std::vector<std::string> expected = {
+      "corekv", "", BigString("medium", 5000), BigString("large", 100000),
+      BigString("block", log::kBlockSize - log::kHeaderSize), "tail"};
+  {
+    FileWriter file_writer(kLogFile);
+    log::Writer writer(&file_writer);
+    for (const auto& item : expected) {
+      ASSERT_EQ(writer.AddRecord(item), Status::kSuccess);
+    }
+    file_writer.Close();
+  }
+  EXPECT_EQ(ReadAll(), expected);
+}
+
+TEST(logTest, Corruption) {
+  {
+    FileWriter file_writer(kLogFile);
+    log::Writer writer(&file_writer);
+    writer.AddRecord("first");
+    writer.AddRecord("second");
+    file_writer.Close();
+  }
+  // 修改第一条记录的payload
+  {
+    std::string contents;
+    FileReader file_reader(kLogFile);
+    file_reader.Read(0, log::kBlockSize, &contents);
+    contents[log::kHeaderSize] ^= 0x1;
+    FileWriter file_writer(kLogFile);
+    file_writer.Append(contents.data(), contents.size());
+    file_writer.Close();
+  }
+  uint64_t dropped = 0;
+  // crc校验失败之后，整个block剩余的部分都被丢弃
+  EXPECT_TRUE(ReadAll(&dropped).empty());
+  EXPECT_GT(dropped, 0u);
+}
+
+TEST(logTest, GroupCommit) {
+  static constexpr int32_t kThreadNum = 8;
+  static constexpr int32_t kRecordNumPerThread = 200;
+  {
+    FileWriter file_writer(kLogFile);
+    GroupCommitWriter writer(&file_writer);
+    std::vector<std::thread> threads;
+    for (int32_t t = 0; t < kThreadNum; ++t) {
+      threads.emplace_back([&writer, t]() {
+        for (int32_t i = 0; i < kRecordNumPerThread; ++i) {
+          const auto& record =
+              std::to_string(t) + "_" + std::to_string(i);
+          ASSERT_EQ(writer.AddRecord(record, true), Status::kSuccess);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    std::cout << "records:" << kThreadNum * kRecordNumPerThread
+              << ", groups:" << writer.GroupCount()
+              << ", fsync:" << writer.SyncCount() << std::endl;
+    EXPECT_LE(writer.SyncCount(), kThreadNum * kRecordNumPerThread);
+    file_writer.Close();
+  }
+  const auto& records = ReadAll();
+  ASSERT_EQ(records.size(), kThreadNum * kRecordNumPerThread);
+  std::unordered_set<std::string> unique(records.begin(), records.end());
+  EXPECT_EQ(unique.size(), records.size());
+}
+
+TEST(logTest, GroupCommitSyncPolicy) {
+  // 写到管道里: 管道满了之后leader的写入阻塞，后面的请求在队列中排队；
+  // 管道上的fsync一定失败，只有需要sync的组会看到这个错误
+  const std::string fifo = "group_commit_fifo";
+  ::unlink(fifo.c_str());
+  ASSERT_EQ(::mkfifo(fifo.c_str(), 0644), 0);
+  // 先打开读端，写端的open才不会阻塞
+  const int reader = ::open(fifo.c_str(), O_RDONLY | O_NONBLOCK);
+  ASSERT_GE(reader, 0);
+  {
+    FileWriter file_writer(fifo);
+    GroupCommitWriter writer(&file_writer);
+    DBStatus leader_status, sync_status, no_sync_status;
+    std::thread leader([&]() {
+      leader_status = writer.AddRecord(std::string(256 * 1024, 'x'), false);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::thread sync_writer(
+        [&]() { sync_status = writer.AddRecord("sync", true); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::thread no_sync_writer(
+        [&]() { no_sync_status = writer.AddRecord("no_sync", false); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::atomic<bool> done(false);
+    std::thread drain([&]() {
+      char buf[4096];
+      while (!done.load()) {
+        if (::read(reader, buf, sizeof(buf)) <= 0) {
+          std::this_thread::yield();
+        }
+      }
+    });
+    leader.join();
+    sync_writer.join();
+    no_sync_writer.join();
+    done.store(true);
+    drain.join();
+    // 三个请求各自一组，不需要sync的请求没有被拖进fsync
+    EXPECT_EQ(leader_status, Status::kSuccess);
+    EXPECT_EQ(sync_status, Status::kWriteFileFailed);
+    EXPECT_EQ(no_sync_status, Status::kSuccess);
+    EXPECT_EQ(writer.GroupCount(), 3u);
+    EXPECT_EQ(writer.SyncCount(), 1u);
+    file_writer.Close();
+  }
+  ::close(reader);
+  ::unlink(fifo.c_str());
+}
@@ -0,0 +1,213 @@
+// 需要在所有头文件之前定义，只保留WARN及以上的LOG调用
+#define COREKV_MIN_LOG_LEVEL 3
+
+#include "logger/log.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "file/file.h"
+#include "logger/log_appender.h"
+
+using namespace std;
+using namespace corekv;
+
+static const std::string kLogDir = "logger_test_dir";
+
+class LoggerTest : public ::testing::Test {
+ protected:
+  void SetUp() override { FileTool::RemoveDirAndFiles(kLogDir); }
+  void TearDown() override { FileTool::RemoveDirAndFiles(kLogDir); }
+
+  // 每个线程4KB的缓冲区，后台线程只在Flush或者缓冲区过半的时候写文件，不会滚动
+  static LogConfig FileConfig() {
+    LogConfig config;
+    config.log_type = LogType::FILE;
+    config.log_path = kLogDir;
+    config.log_buffer_max_size = 256;
+    config.ring_buffer_size = 4096;
+    config.rotate_size = 0;
+    config.flush_interval_ms = 60 * 1000;
+    return config;
+  }
+
+  static std::string ReadFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+  }
+
+  static std::string ActiveLog() {
+    return ReadFile(kLogDir + "/" + kLogActiveName);
+  }
+
+  // 滚动之后归档的日志文件
+  static std::vector<std::string> RotatedLogs() {
+    std::vector<std::string> filenames, result;
+    FileTool::GetChildren(kLogDir, &filenames);
+    for (const auto& filename : filenames) {
+      if (filename != kLogActiveName && filename.rfind("corekv.", 0) == 0) {
+        result.push_back(kLogDir + "/" + filename);
+      }
+    }
+    return result;
+  }
+
+  // 每一行出现的次数
+  static std::map<std::string, int32_t> CountLines(const std::string& content) {
+    std::map<std::string, int32_t> lines;
+    std::istringstream in(content);
+    for (std::string line; std::getline(in, line);) {
+      ++lines[line];
+    }
+    return lines;
+  }
+};
+
+TEST_F(LoggerTest, ConcurrentAppend) {
+  static constexpr int32_t kThreads = 8;
+  static constexpr int32_t kLines = 20000;
+  AysncFileAppender appender(FileConfig());
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < kThreads; ++t) {
+    // 缓冲区很小，写日志的线程会反复等待后台线程腾出空间
+    threads.emplace_back([&appender, t]() {
+      char line[32];
+      for (int32_t i = 0; i < kLines; ++i) {
+        const int32_t len = snprintf(line, sizeof(line), "t%d-%d\n", t, i);
+        appender.Append(line, len);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  appender.Flush();
+  // 退出的线程的缓冲区写完之后被移除
+  EXPECT_EQ(appender.NumThreadBuffers(), 0u);
+
+  // 每一行恰好出现一次，同一个线程的日志保持顺序
+  std::istringstream in(ActiveLog());
+  std::vector<int32_t> next(kThreads, 0);
+  int32_t total = 0;
+  for (std::string line; std::getline(in, line); ++total) {
+    int32_t t = -1, i = -1;
+    ASSERT_EQ(sscanf(line.c_str(), "t%d-%d", &t, &i), 2) << line;
+    ASSERT_TRUE(t >= 0 && t < kThreads) << line;
+    ASSERT_EQ(i, next[t]++) << line;
+  }
+  EXPECT_EQ(total, kThreads * kLines);
+}
+
+TEST_F(LoggerTest, ManyThreadBuffers) {
+  // 一轮中有数据的缓冲区比一次writev的iov个数还多，需要分批写出
+  static constexpr int32_t kThreads = 600;
+  AysncFileAppender appender(FileConfig());
+  std::atomic<int32_t> appended(0);
+  std::atomic<bool> exit(false);
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      const std::string line = "thread" + std::to_string(t) + "\n";
+      appender.Append(line.data(), line.size());
+      appended.fetch_add(1);
+      while (!exit.load()) {
+        std::this_thread::yield();
+      }
+    });
+  }
+  while (appended.load() < kThreads) {
+    std::this_thread::yield();
+  }
+  // 所有线程都还活着，缓冲区都没有被移除
+  appender.Flush();
+  EXPECT_EQ(appender.NumThreadBuffers(), static_cast<size_t>(kThreads));
+  exit.store(true);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const auto& lines = CountLines(ActiveLog());
+  ASSERT_EQ(lines.size(), static_cast<size_t>(kThreads));
+  for (int32_t t = 0; t < kThreads; ++t) {
+    auto iter = lines.find("thread" + std::to_string(t));
+    ASSERT_NE(iter, lines.end()) << t;
+    EXPECT_EQ(iter->second, 1) << t;
+  }
+}
+
+TEST_F(LoggerTest, WrapAndTruncate) {
+  AysncFileAppender appender(FileConfig());
+  const std::string a(3000, 'a'), b(3000, 'b');
+  appender.Append(a.data(), a.size());
+  appender.Flush();
+  // 从3000开始写3000字节，绕回4KB缓冲区的开头，分成两段写出
+  appender.Append(b.data(), b.size());
+  appender.Flush();
+  EXPECT_EQ(ActiveLog(), a + b);
+
+  // 超过缓冲区大小的日志截断到缓冲区大小
+  const std::string c(10000, 'c');
+  appender.Append(c.data(), c.size());
+  appender.Flush();
+  EXPECT_EQ(ActiveLog(), a + b + std::string(4096, 'c'));
+}
+
+TEST_F(LoggerTest, Rotate) {
+  static constexpr int32_t kRotateSize = 10000;
+  static constexpr int32_t kLines = 300;
+  LogConfig config = FileConfig();
+  config.rotate_size = kRotateSize;
+  AysncFileAppender appender(config);
+  for (int32_t i = 0; i < kLines; ++i) {
+    std::string line = "line" + std::to_string(i);
+    line.resize(199, '.');
+    line.append("\n");
+    appender.Append(line.data(), line.size());
+  }
+  appender.Flush();
+
+  // 超过rotate_size之后归档，归档的文件都超过rotate_size
+  const auto& rotated = RotatedLogs();
+  ASSERT_FALSE(rotated.empty());
+  std::string all = ActiveLog();
+  EXPECT_LE(all.size(), static_cast<size_t>(kRotateSize));
+  for (const auto& path : rotated) {
+    const std::string& content = ReadFile(path);
+    EXPECT_GT(content.size(), static_cast<size_t>(kRotateSize)) << path;
+    all.append(content);
+  }
+  // 滚动不会丢失或者重复日志
+  const auto& lines = CountLines(all);
+  ASSERT_EQ(lines.size(), static_cast<size_t>(kLines));
+  for (const auto& [line, count] : lines) {
+    EXPECT_EQ(count, 1) << line;
+  }
+}
+
+TEST_F(LoggerTest, MinLogLevel) {
+  Log::GetInstance()->InitLog(FileConfig());
+  int32_t evaluated = 0;
+  auto next = [&evaluated]() { return ++evaluated; };
+  // 低于COREKV_MIN_LOG_LEVEL的调用被编译期去掉，参数不会求值
+  LOG(corekv::LogLevel::DEBUG, "debug %d", next());
+  LOG(corekv::LogLevel::INFO, "info %d", next());
+  EXPECT_EQ(evaluated, 0);
+  LOG(corekv::LogLevel::WARN, "warn %d", next());
+  EXPECT_EQ(evaluated, 1);
+  Log::GetInstance()->Flush();
+
+  const std::string& content = ActiveLog();
+  EXPECT_NE(content.find("[WARN] "), std::string::npos);
+  EXPECT_NE(content.find("warn 1"), std::string::npos);
+  EXPECT_EQ(content.find("debug"), std::string::npos);
+  EXPECT_EQ(content.find("info"), std::string::npos);
+}
@@ -0,0 +1,231 @@
+#include "db/memtable.h"
+
+#include <gtest/gtest.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "db/comparator.h"
+#include "db/dbformat.h"
+#include "db/memtable_rep.h"
+#include "db/prefix_extractor.h"
+
+using namespace std;
+using namespace corekv;
+
+TEST(memtableTest, AddAndGet) {
+  ByteComparator byte_comparator;
+  InternalKeyComparator icmp(&byte_comparator);
+  MemTable* mem = new MemTable(icmp);
+  mem->Ref();
+  mem->Add(1, kTypeValue, "corekv", "v1");
+  mem->Add(2, kTypeValue, "corekv1", "v2");
+  mem->Add(3, kTypeValue, "corekv", "v3");
+  mem->Add(4, kTypeDeletion, "corekv1", "");
+
+  std::string value;
+  DBStatus s;
+  // 最新的版本
+  ASSERT_TRUE(mem->Get(LookupKey("corekv", 10), &value, &s));
+  EXPECT_EQ(s, Status::kSuccess);
+  EXPECT_EQ(value, "v3");
+  // 按照序号读取旧版本
+  ASSERT_TRUE(mem->Get(LookupKey("corekv", 2), &value, &s));
+  EXPECT_EQ(value, "v1");
+  // 已经被删除
+  ASSERT_TRUE(mem->Get(LookupKey("corekv1", 10), &value, &s));
+  EXPECT_EQ(s, Status::kNotFound);
+  ASSERT_TRUE(mem->Get(LookupKey("corekv1", 3), &value, &s));
+  EXPECT_EQ(value, "v2");
+  EXPECT_FALSE(mem->Get(LookupKey("corekv2", 10), &value, &s));
+  mem->Unref();
+}
+
+TEST(memtableTest, Iterator) {
+  ByteComparator byte_comparator;
+  InternalKeyComparator icmp(&byte_comparator);
+  MemTable* mem = new MemTable(icmp);
+  mem->Ref();
+  mem->Add(1, kTypeValue, "b", "vb");
+  mem->Add(2, kTypeValue, "a", "va");
+  mem->Add(3, kTypeValue, "c", "vc");
+  mem->Add(4, kTypeValue, "a", "va2");
+  std::unique_ptr<Iterator> iter(mem->NewIterator());
+  std::vector<std::string> values;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    values.emplace_back(iter->value());
+  }
+  std::vector<std::string> expected = {"va2", "va", "vb", "vc"};
+  EXPECT_EQ(values, expected);
+  iter->SeekToLast();
+  ASSERT_TRUE(iter->Valid());
+  EXPECT_EQ(ExtractUserKey(iter->key()), "c");
+  iter->Prev();
+  ASSERT_TRUE(iter->Valid());
+  EXPECT_EQ(ExtractUserKey(iter->key()), "b");
+  iter.reset();
+  mem->Unref();
+}
+
+TEST(memtableTest, AddConcurrently) {
+  ByteComparator byte_comparator;
+  InternalKeyComparator icmp(&byte_comparator);
+  MemTable* mem = new MemTable(icmp);
+  mem->Ref();
+  static constexpr int32_t kThreadNum = 4;
+  static constexpr int32_t kKeyNumPerThread = 2000;
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < kThreadNum; ++t) {
+    threads.emplace_back([mem, t]() {
+      for (int32_t i = 0; i < kKeyNumPerThread; ++i) {
+        const auto& key = "key_" + std::to_string(t) + "_" + std::to_string(i);
+        mem->AddConcurrently(t * kKeyNumPerThread + i + 1, kTypeValue, key,
+                             key);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::string value;
+  DBStatus s;
+  for (int32_t t = 0; t < kThreadNum; ++t) {
+    for (int32_t i = 0; i < kKeyNumPerThread; ++i) {
+      const auto& key = "key_" + std::to_string(t) + "_" + std::to_string(i);
+      ASSERT_TRUE(mem->Get(LookupKey(key, kMaxSequenceNumber), &value, &s));
+      EXPECT_EQ(value, key);
+    }
+  }
+  // 检查整体有序
+  std::unique_ptr<Iterator> iter(mem->NewIterator());
+  int32_t count = 0;
+  std::string pre_key;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    std::string cur(iter->key());
+    if (!pre_key.empty()) {
+      EXPECT_LT(icmp.Compare(pre_key, cur), 0);
+    }
+    pre_key = cur;
+    ++count;
+  }
+  EXPECT_EQ(count, kThreadNum * kKeyNumPerThread);
+  iter.reset();
+  mem->Unref();
+}
+
+TEST(memtableTest, HashSkipListRep) {
+  ByteComparator byte_comparator;
+  InternalKeyComparator icmp(&byte_comparator);
+  HashSkipListRepFactory factory(std::make_shared<DelimitedPrefixExtractor>('|'),
+                                 16);
+  MemTable* mem = new MemTable(icmp, ConcurrentArena::kDefaultBlockSize, 0, -1,
+                               &factory);
+  mem->Ref();
+  static constexpr int32_t kThreadNum = 4;
+  static constexpr int32_t kKeyNumPerThread = 1000;
+  // 同一个前缀的key由不同的线程写入，没有分隔符的key都在同一个桶里
+  auto MakeKey = [](int32_t t, int32_t i) {
+    const std::string& suffix = std::to_string(t * 10000 + i);
+    return i % 10 == 0 ? "nodelim_" + suffix
+                       : "t" + std::to_string(i % 50) + "|" + suffix;
+  };
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < kThreadNum; ++t) {
+    threads.emplace_back([mem, t, &MakeKey]() {
+      for (int32_t i = 0; i < kKeyNumPerThread; ++i) {
+        const auto& key = MakeKey(t, i);
+        mem->AddConcurrently(t * kKeyNumPerThread + i + 1, kTypeValue, key,
+                             key);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  mem->Add(kThreadNum * kKeyNumPerThread + 1, kTypeDeletion, "t1|x", "");
+  std::string value;
+  DBStatus s;
+  for (int32_t t = 0; t < kThreadNum; ++t) {
+    for (int32_t i = 0; i < kKeyNumPerThread; ++i) {
+      const auto& key = MakeKey(t, i);
+      ASSERT_TRUE(mem->Get(LookupKey(key, kMaxSequenceNumber), &value, &s));
+      ASSERT_EQ(s, Status::kSuccess);
+      EXPECT_EQ(value, key);
+    }
+  }
+  ASSERT_TRUE(mem->Get(LookupKey("t1|x", kMaxSequenceNumber), &value, &s));
+  EXPECT_EQ(s, Status::kNotFound);
+  EXPECT_FALSE(mem->Get(LookupKey("t1|2", kMaxSequenceNumber), &value, &s));
+  EXPECT_FALSE(mem->Get(LookupKey("t99|1", kMaxSequenceNumber), &value, &s));
+  // 遍历的时候所有桶合并成全局有序
+  std::unique_ptr<Iterator> iter(mem->NewIterator());
+  int32_t count = 0;
+  std::string pre_key;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    std::string cur(iter->key());
+    if (!pre_key.empty()) {
+      EXPECT_LT(icmp.Compare(pre_key, cur), 0);
+    }
+    pre_key = cur;
+    ++count;
+  }
+  EXPECT_EQ(count, kThreadNum * kKeyNumPerThread + 1);
+  iter->Seek(LookupKey("t1|", kMaxSequenceNumber).internal_key());
+  ASSERT_TRUE(iter->Valid());
+  EXPECT_EQ(ExtractUserKey(iter->key()), "t1|1");
+  iter->Prev();
+  ASSERT_TRUE(iter->Valid());
+  // "t19|"按照字节序排在"t1|"前面
+  EXPECT_EQ(ExtractUserKey(iter->key()).substr(0, 4), "t19|");
+  iter.reset();
+  mem->Unref();
+}
+
+TEST(memtableTest, VectorRep) {
+  ByteComparator byte_comparator;
+  InternalKeyComparator icmp(&byte_comparator);
+  VectorRepFactory factory(4);
+  MemTable* mem = new MemTable(icmp, ConcurrentArena::kDefaultBlockSize, 0, -1,
+                               &factory);
+  mem->Ref();
+  // 数量足够多的时候分成多段并行排序
+  static constexpr int32_t kKeyNum = 100000;
+  auto MakeKey = [](int32_t i) {
+    return "key" + std::to_string((i * 7919) % kKeyNum);
+  };
+  for (int32_t i = 0; i < kKeyNum; ++i) {
+    mem->Add(i + 1, kTypeValue, MakeKey(i), std::to_string(i));
+  }
+  std::string value;
+  DBStatus s;
+  ASSERT_TRUE(mem->Get(LookupKey(MakeKey(12345), kMaxSequenceNumber), &value,
+                       &s));
+  EXPECT_EQ(value, "12345");
+  // 排序之后追加的entry需要归并进来
+  mem->Add(kKeyNum + 1, kTypeDeletion, MakeKey(12345), "");
+  mem->Add(kKeyNum + 2, kTypeValue, "key", "new");
+  ASSERT_TRUE(mem->Get(LookupKey(MakeKey(12345), kMaxSequenceNumber), &value,
+                       &s));
+  EXPECT_EQ(s, Status::kNotFound);
+  ASSERT_TRUE(mem->Get(LookupKey(MakeKey(12345), kKeyNum), &value, &s));
+  EXPECT_EQ(value, "12345");
+  ASSERT_TRUE(mem->Get(LookupKey("key", kMaxSequenceNumber), &value, &s));
+  EXPECT_EQ(value, "new");
+  std::unique_ptr<Iterator> iter(mem->NewIterator());
+  int32_t count = 0;
+  std::string pre_key;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    std::string cur(iter->key());
+    if (!pre_key.empty()) {
+      ASSERT_LT(icmp.Compare(pre_key, cur), 0);
+    }
+    pre_key = cur;
+    ++count;
+  }
+  EXPECT_EQ(count, kKeyNum + 2);
+  iter.reset();
+  mem->Unref();
+}
@@ -0,0 +1,101 @@
+#include "table/merging_iterator.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "db/comparator.h"
+
+using namespace std;
+using namespace corekv;
+
+namespace {
+// 基于有序vector的迭代器，用来构造merging iterator的输入
+class VectorIterator final : public Iterator {
+ public:
+  explicit VectorIterator(std::vector<std::string> keys)
+      : keys_(std::move(keys)) {}
+  bool Valid() const override { return pos_ < keys_.size(); }
+  void SeekToFirst() override { pos_ = 0; }
+  void SeekToLast() override { pos_ = keys_.empty() ? 0 : keys_.size() - 1; }
+  void Seek(const std::string_view& target) override {
+    pos_ = std::lower_bound(keys_.begin(), keys_.end(), target) - keys_.begin();
+  }
+  void Next() override { ++pos_; }
+  void Prev() override { pos_ = (pos_ == 0) ? keys_.size() : pos_ - 1; }
+  std::string_view key() const override { return keys_[pos_]; }
+  std::string_view value() const override { return keys_[pos_]; }
+  DBStatus status() const override { return Status::kSuccess; }
+
+ private:
+  std::vector<std::string> keys_;
+  size_t pos_ = 0;
+};
+}  // namespace
+
+class MergingIteratorTest : public ::testing::TestWithParam<int32_t> {
+ protected:
+  void SetUp() override {
+    std::mt19937 rnd(GetParam());
+    std::vector<std::vector<std::string>> inputs(GetParam());
+    for (int32_t i = 0; i < 2000; ++i) {
+      const std::string& key = "key" + std::to_string(rnd() % 100000);
+      inputs[rnd() % inputs.size()].push_back(key);
+      expected_.push_back(key);
+    }
+    std::sort(expected_.begin(), expected_.end());
+    std::vector<Iterator*> children;
+    for (auto& input : inputs) {
+      std::sort(input.begin(), input.end());
+      children.push_back(new VectorIterator(input));
+    }
+    iter_.reset(NewMergingIterator(&cmp_, children.data(), children.size()));
+  }
+
+  ByteComparator cmp_;
+  std::vector<std::string> expected_;
+  std::unique_ptr<Iterator> iter_;
+};
+
+TEST_P(MergingIteratorTest, ForwardAndBackward) {
+  size_t i = 0;
+  for (iter_->SeekToFirst(); iter_->Valid(); iter_->Next(), ++i) {
+    ASSERT_EQ(iter_->key(), expected_[i]);
+  }
+  EXPECT_EQ(i, expected_.size());
+  for (iter_->SeekToLast(); iter_->Valid(); iter_->Prev()) {
+    ASSERT_EQ(iter_->key(), expected_[--i]);
+  }
+  EXPECT_EQ(i, 0u);
+}
+
+TEST_P(MergingIteratorTest, SeekAndChangeDirection) {
+  std::mt19937 rnd(GetParam() + 1);
+  for (int32_t round = 0; round < 100; ++round) {
+    const std::string& target = "key" + std::to_string(rnd() % 100000);
+    size_t pos = std::lower_bound(expected_.begin(), expected_.end(), target) -
+                 expected_.begin();
+    iter_->Seek(target);
+    // 相同的key会返回多次，只比较key本身，不关心来自哪一路
+    for (int32_t step = 0; step < 20 && pos < expected_.size(); ++step) {
+      ASSERT_TRUE(iter_->Valid());
+      ASSERT_EQ(iter_->key(), expected_[pos]);
+      if (rnd() % 3 == 0 && pos > 0 && expected_[pos - 1] != expected_[pos]) {
+        iter_->Prev();
+        --pos;
+      } else if (pos + 1 < expected_.size() &&
+                 expected_[pos + 1] != expected_[pos]) {
+        iter_->Next();
+        ++pos;
+      } else {
+        break;
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Inputs, MergingIteratorTest,
+                         ::testing::Values(2, 3, 7, 50));
@@ -0,0 +1,63 @@
+#include "file/prefetch_buffer.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "file/file.h"
+
+using namespace corekv;
+class PrefetchBufferTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (int32_t i = 0; i < 1024 * 1024; ++i) {
+      data_.push_back(static_cast<char>(i * 131));
+    }
+    FileWriter writer(kFileName);
+    ASSERT_EQ(writer.Append(data_.data(), data_.size()), Status::kSuccess);
+    writer.Close();
+  }
+  void TearDown() override { FileTool::RemoveFile(kFileName); }
+
+  static constexpr const char* kFileName = "prefetch_buffer.dat";
+  std::string data_;
+};
+
+TEST_F(PrefetchBufferTest, SequentialReadsGrowReadahead) {
+  FileReader reader(kFileName);
+  FilePrefetchBuffer prefetch(&reader, 8 * 1024, 64 * 1024);
+  std::string_view result;
+  // 第一次读取不知道是不是顺序读，由调用方自己读
+  EXPECT_FALSE(prefetch.TryRead(0, 4096, &result));
+  for (uint64_t offset = 4096; offset < data_.size(); offset += 4096) {
+    const size_t n = std::min<size_t>(4096, data_.size() - offset);
+    ASSERT_TRUE(prefetch.TryRead(offset, n, &result)) << offset;
+    ASSERT_EQ(result, std::string_view(data_).substr(offset, n));
+  }
+  EXPECT_EQ(prefetch.readahead_size(), 64 * 1024u);
+  // 跳跃的读取恢复成初始的预读长度
+  EXPECT_FALSE(prefetch.TryRead(4096, 4096, &result));
+  EXPECT_EQ(prefetch.readahead_size(), 8 * 1024u);
+}
+
+TEST_F(PrefetchBufferTest, AssumeSequential) {
+  FileReader reader(kFileName);
+  FilePrefetchBuffer prefetch(&reader, 64 * 1024, 64 * 1024, true);
+  std::string_view result;
+  ASSERT_TRUE(prefetch.TryRead(100, 1000, &result));
+  EXPECT_EQ(result, std::string_view(data_).substr(100, 1000));
+  ASSERT_TRUE(prefetch.TryRead(50000, 1000, &result));
+  EXPECT_EQ(result, std::string_view(data_).substr(50000, 1000));
+  // 超过文件末尾的时候不够n字节，交给调用方处理
+  EXPECT_FALSE(prefetch.TryRead(data_.size() - 10, 100, &result));
+}
+
+TEST_F(PrefetchBufferTest, CacheHitsKeepPattern) {
+  FileReader reader(kFileName);
+  FilePrefetchBuffer prefetch(&reader, 8 * 1024, 64 * 1024);
+  std::string_view result;
+  // 命中block_cache的读取也算作顺序读的一部分
+  prefetch.UpdateReadPattern(0, 4096);
+  ASSERT_TRUE(prefetch.TryRead(4096, 4096, &result));
+  EXPECT_EQ(result, std::string_view(data_).substr(4096, 4096));
+}
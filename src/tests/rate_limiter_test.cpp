@@ -0,0 +1,77 @@
+#include "utils/rate_limiter.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace corekv;
+static int64_t ElapsedMillis(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+TEST(RateLimiterTest, LimitsThroughput) {
+  // 1MB/s，桶的容量是10ms的量
+  RateLimiter limiter(1024 * 1024, 10 * 1000);
+  const auto start = std::chrono::steady_clock::now();
+  for (int32_t i = 0; i < 50; ++i) {
+    limiter.Request(4096, IOPriority::kLow);
+  }
+  // 超过桶容量的请求会被拆开
+  limiter.Request(100 * 1024, IOPriority::kLow);
+  const int64_t elapsed = ElapsedMillis(start);
+  EXPECT_GE(elapsed, 250);
+  EXPECT_LT(elapsed, 2000);
+  EXPECT_EQ(limiter.GetTotalBytesThrough(IOPriority::kLow), 300 * 1024);
+  EXPECT_EQ(limiter.GetTotalBytesThrough(IOPriority::kHigh), 0);
+}
+
+TEST(RateLimiterTest, HighPriorityFirst) {
+  RateLimiter limiter(512 * 1024, 10 * 1000);
+  std::vector<int64_t> finish(3);
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < 3; ++t) {
+    // 0是flush，1和2是compaction
+    const IOPriority pri = t == 0 ? IOPriority::kHigh : IOPriority::kLow;
+    threads.emplace_back([&, t, pri]() {
+      for (int32_t i = 0; i < 25; ++i) {
+        limiter.Request(4096, pri);
+      }
+      finish[t] = ElapsedMillis(start);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_LT(finish[0], finish[1]);
+  EXPECT_LT(finish[0], finish[2]);
+  EXPECT_EQ(limiter.GetTotalBytesThrough(IOPriority::kHigh), 100 * 1024);
+  EXPECT_EQ(limiter.GetTotalBytesThrough(IOPriority::kLow), 200 * 1024);
+}
+
+TEST(RateLimiterTest, AutoTuneBacksOff) {
+  // 每100ms调整一次，前台延迟目标1ms
+  RateLimiter limiter(1024 * 1024, 10 * 1000, true, 1000);
+  limiter.RecordForegroundLatency(5000);
+  std::this_thread::sleep_for(std::chrono::milliseconds(120));
+  limiter.Request(1, IOPriority::kLow);
+  EXPECT_EQ(limiter.GetBytesPerSecond(), 1024 * 1024 * 4 / 5);
+  for (int32_t i = 0; i < 5; ++i) {
+    limiter.RecordForegroundLatency(10000);
+    std::this_thread::sleep_for(std::chrono::milliseconds(110));
+    limiter.Request(1, IOPriority::kLow);
+  }
+  EXPECT_LT(limiter.GetBytesPerSecond(), 1024 * 1024 / 2);
+  // 前台恢复之后，一直被限速的后台写入把速率慢慢提上去
+  const int64_t backed_off = limiter.GetBytesPerSecond();
+  const auto start = std::chrono::steady_clock::now();
+  while (ElapsedMillis(start) < 500) {
+    limiter.Request(4096, IOPriority::kLow);
+  }
+  EXPECT_GT(limiter.GetBytesPerSecond(), backed_off);
+  EXPECT_LE(limiter.GetBytesPerSecond(), 1024 * 1024);
+}
@@ -29,3 +29,60 @@ TEST(skiplistTest, Insert) {
          << " ]" << endl;
   }
 }
+
+namespace {
+struct U64Comparator {
+  int32_t Compare(uint64_t a, uint64_t b) const {
+    return a < b ? -1 : (a > b ? 1 : 0);
+  }
+};
+}  // namespace
+
+TEST(skiplistTest, InsertWithHint) {
+  using Table = SkipList<uint64_t, U64Comparator, SimpleVectorAlloc>;
+  Table tb((U64Comparator()));
+  // 递增的key走hint，中间穿插更小的key和间隔很大的key，hint失效后要能正确回退
+  std::vector<uint64_t> sorted;
+  for (uint64_t i = 1; i <= 3000; ++i) {
+    sorted.push_back(i * 10);
+  }
+  tb.InsertBatch(sorted.data(), sorted.size());
+  for (uint64_t i = 1; i <= 3000; ++i) {
+    tb.Insert(i * 10 - 5);
+    tb.Insert(i * 10 - 3);
+  }
+  tb.Insert(100000);
+  tb.Insert(11);
+  Table::Iterator iter(&tb);
+  iter.SeekToFirst();
+  uint64_t last = 0;
+  size_t count = 0;
+  for (; iter.Valid(); iter.Next()) {
+    ASSERT_GT(iter.key(), last);
+    last = iter.key();
+    ++count;
+  }
+  EXPECT_EQ(count, 3000u * 3 + 2);
+  for (uint64_t i = 1; i <= 3000; ++i) {
+    ASSERT_TRUE(tb.Contains(i * 10));
+    ASSERT_TRUE(tb.Contains(i * 10 - 5));
+    ASSERT_FALSE(tb.Contains(i * 10 - 1));
+  }
+}
+
+TEST(skiplistTest, SeededRandom) {
+  RandomUtil a(42), b(42), c(43);
+  bool differs = false;
+  int32_t hits = 0;
+  for (int32_t i = 0; i < 10000; ++i) {
+    const int64_t x = a.GetSimpleRandomNum();
+    ASSERT_EQ(x, b.GetSimpleRandomNum());
+    differs |= x != c.GetSimpleRandomNum();
+    ASSERT_GE(x, 0);
+    hits += (x % SkipListOption::kBranching) == 0;
+  }
+  EXPECT_TRUE(differs);
+  // 大约1/kBranching的概率增加一层
+  EXPECT_GT(hits, 2000);
+  EXPECT_LT(hits, 3000);
+}
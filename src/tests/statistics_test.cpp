@@ -0,0 +1,62 @@
+#include "utils/statistics.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+using namespace corekv;
+
+TEST(statisticsTest, Tickers) {
+  Statistics statistics;
+  statistics.RecordTick(kBytesRead, 10);
+  statistics.RecordTick(kBytesRead);
+  RecordTick(&statistics, kWalFileSynced, 3);
+  RecordTick(nullptr, kWalFileSynced, 3);
+  EXPECT_EQ(statistics.GetTickerCount(kBytesRead), 11u);
+  EXPECT_EQ(statistics.GetTickerCount(kWalFileSynced), 3u);
+  EXPECT_EQ(statistics.GetTickerCount(kBytesWritten), 0u);
+  statistics.Reset();
+  EXPECT_EQ(statistics.GetTickerCount(kBytesRead), 0u);
+}
+
+TEST(statisticsTest, ConcurrentRecord) {
+  static constexpr int32_t kThreadNum = 8;
+  static constexpr int32_t kOps = 100000;
+  Statistics statistics;
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < kThreadNum; ++t) {
+    threads.emplace_back([&statistics, t]() {
+      for (int32_t i = 0; i < kOps; ++i) {
+        statistics.RecordTick(kNumberKeysRead);
+        statistics.MeasureTime(kDbGet, t + 1);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(statistics.GetTickerCount(kNumberKeysRead),
+            static_cast<uint64_t>(kThreadNum) * kOps);
+  Histogram hist;
+  statistics.GetHistogram(kDbGet, &hist);
+  EXPECT_EQ(hist.Count(), static_cast<uint64_t>(kThreadNum) * kOps);
+  EXPECT_EQ(hist.Min(), 1);
+  EXPECT_EQ(hist.Max(), kThreadNum);
+}
+
+TEST(statisticsTest, StopWatchAndToString) {
+  Statistics statistics;
+  {
+    StopWatch watch(&statistics, kFlushTime);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  { StopWatch watch(nullptr, kFlushTime); }
+  Histogram hist;
+  statistics.GetHistogram(kFlushTime, &hist);
+  ASSERT_EQ(hist.Count(), 1u);
+  EXPECT_GE(hist.Max(), 2000);
+  const std::string& text = statistics.ToString();
+  EXPECT_NE(text.find("corekv.flush.micros P50"), std::string::npos);
+  EXPECT_NE(text.find("corekv.bytes.read COUNT : 0"), std::string::npos);
+}
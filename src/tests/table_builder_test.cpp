@@ -2,14 +2,23 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <tuple>
 #include <vector>
 #include "db/comparator.h"
+#include "db/dbformat.h"
+#include "db/prefix_extractor.h"
 #include "file/file.h"
 #include "filter/bloomfilter.h"
+#include "table/data_block.h"
+#include "table/secondary_cache.h"
 #include "table/table.h"
+#include "cache/cache.h"
 #include "logger/log.h"
+#include "utils/statistics.h"
 
 using namespace std;
 using namespace corekv;
@@ -36,4 +45,879 @@ TEST(table_builder_Test, Add) {
   FileReader file_reader(st);
   Table tab(&options, &file_reader);
   tab.Open(FileTool::GetFileSize(st));
-}
\ No newline at end of file
+}
+
+TEST(table_builder_Test, IterateAcrossBlocks) {
+  static const std::string st = "iterate.sst";
+  static constexpr int32_t kKeyNum = 5000;
+  auto key_of = [](int32_t i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%08d", i);
+    return std::string(buf);
+  };
+  Options options;
+  options.comparator = std::make_shared<ByteComparator>();
+  {
+    FileWriter file_handler(st);
+    TableBuilder tb(options, &file_handler);
+    for (int32_t i = 0; i < kKeyNum; ++i) {
+      tb.Add(key_of(i), std::string(32, 'a' + i % 26));
+    }
+    tb.Finish();
+  }
+  FileReader file_reader(st);
+  Table tab(&options, &file_reader);
+  ASSERT_EQ(tab.Open(FileTool::GetFileSize(st)), Status::kSuccess);
+  std::unique_ptr<Iterator> iter(tab.NewIterator(ReadOptions()));
+  // 正向遍历会跨越多个data block，并在进入新block的时候预读下一个
+  int32_t i = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++i) {
+    ASSERT_EQ(iter->key(), key_of(i));
+    ASSERT_EQ(iter->value(), std::string(32, 'a' + i % 26));
+  }
+  EXPECT_EQ(i, kKeyNum);
+  EXPECT_EQ(iter->status(), Status::kSuccess);
+  i = kKeyNum - 1;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev(), --i) {
+    ASSERT_EQ(iter->key(), key_of(i));
+  }
+  EXPECT_EQ(i, -1);
+  iter->Seek(key_of(2500) + "0");
+  ASSERT_TRUE(iter->Valid());
+  EXPECT_EQ(iter->key(), key_of(2501));
+  iter->Seek("zzz");
+  EXPECT_FALSE(iter->Valid());
+}
+
+TEST(table_builder_Test, SharedBlockCache) {
+  // 两个sst的block偏移完全相同，共用一个block_cache时不能互相覆盖
+  ShardCache<uint64_t, DataBlock> block_cache(64 * 1024, 1);
+  Options options;
+  options.comparator = std::make_shared<ByteComparator>();
+  options.block_cache = &block_cache;
+  const std::vector<std::string> files = {"cache_a.sst", "cache_b.sst"};
+  for (size_t f = 0; f < files.size(); ++f) {
+    FileWriter file_handler(files[f]);
+    TableBuilder tb(options, &file_handler);
+    for (int32_t i = 0; i < 1000; ++i) {
+      tb.Add("key" + std::to_string(10000 + i), std::string(32, 'a' + f));
+    }
+    tb.Finish();
+  }
+  std::vector<std::unique_ptr<FileReader>> readers;
+  std::vector<std::unique_ptr<Table>> tables;
+  for (const auto& file : files) {
+    readers.emplace_back(std::make_unique<FileReader>(file));
+    tables.emplace_back(std::make_unique<Table>(&options, readers.back().get()));
+    ASSERT_EQ(tables.back()->Open(FileTool::GetFileSize(file)),
+              Status::kSuccess);
+  }
+  // 第二轮遍历全部命中缓存，缓存中的block在迭代器释放之后仍然有效
+  for (int32_t round = 0; round < 2; ++round) {
+    for (size_t f = 0; f < tables.size(); ++f) {
+      std::unique_ptr<Iterator> iter(tables[f]->NewIterator(ReadOptions()));
+      int32_t count = 0;
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++count) {
+        ASSERT_EQ(iter->value(), std::string(32, 'a' + f));
+      }
+      EXPECT_EQ(count, 1000);
+    }
+  }
+  EXPECT_GT(block_cache.GetUsage(), 0u);
+  EXPECT_EQ(block_cache.GetPinnedUsage(), 0u);
+}
+
+static void SaveValue(void* arg, const std::string_view& k,
+                      const std::string_view& v) {
+  auto* result = reinterpret_cast<std::pair<std::string, std::string>*>(arg);
+  result->first = k;
+  result->second = v;
+}
+
+class PartitionedTableTest : public ::testing::TestWithParam<bool> {};
+
+TEST_P(PartitionedTableTest, GetAndIterate) {
+  static const std::string st = "partitioned.sst";
+  static constexpr int32_t kKeyNum = 5000;
+  auto key_of = [](int32_t i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%08d", i);
+    return std::string(buf);
+  };
+  ShardCache<uint64_t, DataBlock> block_cache(1024 * 1024, 1);
+  Options options;
+  options.comparator = std::make_shared<ByteComparator>();
+  options.filter_policy = std::make_shared<BloomFilter>(10);
+  options.block_cache = &block_cache;
+  options.partition_index = true;
+  options.partition_filters = true;
+  options.index_partition_size = 256;
+  options.pin_top_level_index_and_filter = GetParam();
+  {
+    FileWriter file_handler(st);
+    TableBuilder tb(options, &file_handler);
+    // 只写偶数key，奇数key用来检查filter
+    for (int32_t i = 0; i < kKeyNum; i += 2) {
+      tb.Add(key_of(i), std::string(32, 'a' + i % 26));
+    }
+    tb.Finish();
+  }
+  FileReader file_reader(st);
+  Table tab(&options, &file_reader);
+  ASSERT_EQ(tab.Open(FileTool::GetFileSize(st)), Status::kSuccess);
+  std::vector<std::string> index_keys;
+  tab.GetIndexKeys(&index_keys);
+  EXPECT_GT(index_keys.size(), 10u);
+
+  int32_t i = 0;
+  std::unique_ptr<Iterator> iter(tab.NewIterator(ReadOptions()));
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i += 2) {
+    ASSERT_EQ(iter->key(), key_of(i));
+  }
+  EXPECT_EQ(i, kKeyNum);
+  iter->Seek(key_of(2501));
+  ASSERT_TRUE(iter->Valid());
+  EXPECT_EQ(iter->key(), key_of(2502));
+  iter.reset();
+
+  int32_t false_positives = 0;
+  for (i = 0; i < kKeyNum; ++i) {
+    std::pair<std::string, std::string> result;
+    ASSERT_EQ(tab.InternalGet(ReadOptions(), key_of(i), &result, &SaveValue),
+              Status::kSuccess);
+    if (i % 2 == 0) {
+      ASSERT_EQ(result.first, key_of(i));
+      ASSERT_EQ(result.second, std::string(32, 'a' + i % 26));
+    } else if (!result.first.empty()) {
+      ++false_positives;
+    }
+  }
+  // 奇数key被分区filter过滤掉，不需要读取data block
+  EXPECT_LT(false_positives, kKeyNum / 20);
+  std::pair<std::string, std::string> result;
+  ASSERT_EQ(tab.InternalGet(ReadOptions(), "zzz", &result, &SaveValue),
+            Status::kSuccess);
+  EXPECT_TRUE(result.first.empty());
+  EXPECT_EQ(block_cache.GetPinnedUsage(), 0u);
+}
+
+INSTANTIATE_TEST_SUITE_P(PinTopLevel, PartitionedTableTest,
+                         ::testing::Bool());
+
+TEST(table_builder_Test, PerBlockFilter) {
+  static const std::string st = "per_block_filter.sst";
+  static constexpr int32_t kKeyNum = 5000;
+  auto key_of = [](int32_t i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%08d", i);
+    return std::string(buf);
+  };
+  Options options;
+  options.comparator = std::make_shared<ByteComparator>();
+  options.filter_policy = std::make_shared<BloomFilter>(10);
+  options.per_block_filter = true;
+  {
+    FileWriter file_handler(st);
+    TableBuilder tb(options, &file_handler);
+    for (int32_t i = 0; i < kKeyNum; i += 2) {
+      tb.Add(key_of(i), std::string(32, 'a' + i % 26));
+    }
+    tb.Finish();
+  }
+  FileReader file_reader(st);
+  Table tab(&options, &file_reader);
+  ASSERT_EQ(tab.Open(FileTool::GetFileSize(st)), Status::kSuccess);
+  int32_t false_positives = 0;
+  for (int32_t i = 0; i < kKeyNum; ++i) {
+    std::pair<std::string, std::string> result;
+    ASSERT_EQ(tab.InternalGet(ReadOptions(), key_of(i), &result, &SaveValue),
+              Status::kSuccess);
+    if (i % 2 == 0) {
+      ASSERT_EQ(result.first, key_of(i));
+    } else if (!result.first.empty()) {
+      ++false_positives;
+    }
+  }
+  // 奇数key被所在data block的filter过滤掉
+  EXPECT_LT(false_positives, kKeyNum / 20);
+}
+
+// 参数: 是否使用block_cache、是否使用mmap读取、是否使用io_uring
+class MultiGetTableTest
+    : public ::testing::TestWithParam<std::tuple<bool, bool, bool>> {};
+
+TEST_P(MultiGetTableTest, MatchesInternalGet) {
+  static const std::string st = "multi_get.sst";
+  static constexpr int32_t kKeyNum = 5000;
+  auto key_of = [](int32_t i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%08d", i);
+    return std::string(buf);
+  };
+  ShardCache<uint64_t, DataBlock> block_cache(1024 * 1024, 1);
+  Options options;
+  options.comparator = std::make_shared<ByteComparator>();
+  options.filter_policy = std::make_shared<BloomFilter>(10);
+  if (std::get<0>(GetParam())) {
+    options.block_cache = &block_cache;
+  }
+  {
+    FileWriter file_handler(st);
+    TableBuilder tb(options, &file_handler);
+    for (int32_t i = 0; i < kKeyNum; i += 2) {
+      tb.Add(key_of(i), std::string(32, 'a' + i % 26));
+    }
+    tb.Finish();
+  }
+  FileReader file_reader(st, std::get<1>(GetParam()));
+  ASSERT_EQ(file_reader.IsMmap(), std::get<1>(GetParam()));
+  Table tab(&options, &file_reader);
+  ASSERT_EQ(tab.Open(FileTool::GetFileSize(st)), Status::kSuccess);
+  // 乱序的key，奇数的key不存在，连续的key落在相邻的block中需要合并读取
+  std::vector<std::string> keys;
+  for (int32_t i = 0; i < kKeyNum; ++i) {
+    keys.push_back(key_of((i * 7919) % kKeyNum));
+  }
+  keys.push_back("zzz");
+  // 每隔几个block取一个key，没有命中缓存的block不相邻，每个block一个读请求
+  for (int32_t i = 0; i < kKeyNum; i += 397) {
+    keys.push_back(key_of(i));
+  }
+  ReadOptions read_options;
+  read_options.async_io = std::get<2>(GetParam());
+  for (int32_t round = 0; round < 3; ++round) {
+    // 第一轮只查稀疏的key，这时候block_cache还是空的
+    const size_t begin = round == 0 ? kKeyNum + 1 : 0;
+    std::vector<std::string_view> key_views(keys.begin() + begin, keys.end());
+    std::vector<std::pair<std::string, std::string>> results(key_views.size());
+    std::vector<void*> args;
+    for (auto& result : results) {
+      args.push_back(&result);
+    }
+    ASSERT_EQ(tab.MultiGet(read_options, key_views, args, &SaveValue),
+              Status::kSuccess);
+    for (size_t i = 0; i < key_views.size(); ++i) {
+      std::pair<std::string, std::string> expected;
+      ASSERT_EQ(
+          tab.InternalGet(ReadOptions(), key_views[i], &expected, &SaveValue),
+          Status::kSuccess);
+      if (expected.first == key_views[i]) {
+        ASSERT_EQ(results[i], expected) << key_views[i];
+      } else {
+        ASSERT_NE(results[i].first, key_views[i]) << key_views[i];
+      }
+    }
+  }
+  EXPECT_EQ(block_cache.GetPinnedUsage(), 0u);
+}
+
+INSTANTIATE_TEST_SUITE_P(BlockCache, MultiGetTableTest,
+                         ::testing::Combine(::testing::Bool(),
+                                            ::testing::Bool(),
+                                            ::testing::Bool()));
+
+// 0: 整个sst一个filter 1: 分区filter 2: 按block分段的filter
+class PrefixFilterTest : public ::testing::TestWithParam<int32_t> {};
+
+TEST_P(PrefixFilterTest, FilterMayMatch) {
+  static const std::string st = "prefix_filter.sst";
+  auto user_comparator = std::make_shared<ByteComparator>();
+  Options options;
+  options.comparator =
+      std::make_shared<InternalKeyComparator>(user_comparator.get());
+  options.filter_policy = std::make_shared<InternalFilterPolicy>(
+      std::make_shared<BloomFilter>(10),
+      std::make_shared<DelimitedPrefixExtractor>('|'));
+  options.partition_index = GetParam() == 1;
+  options.partition_filters = GetParam() == 1;
+  options.per_block_filter = GetParam() == 2;
+  options.index_partition_size = 256;
+  auto key_of = [](int32_t tenant) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "tenant%04d|", tenant);
+    return std::string(buf);
+  };
+  {
+    FileWriter file_handler(st);
+    TableBuilder tb(options, &file_handler);
+    // 只有偶数编号的tenant
+    for (int32_t tenant = 0; tenant < 200; tenant += 2) {
+      for (int32_t i = 0; i < 20; ++i) {
+        const std::string& user_key = key_of(tenant) + std::to_string(100 + i);
+        std::string key;
+        AppendInternalKey(&key, ParsedInternalKey(user_key, 1, kTypeValue));
+        tb.Add(key, std::string(64, 'v'));
+      }
+    }
+    tb.Finish();
+  }
+  FileReader file_reader(st);
+  Table tab(&options, &file_reader);
+  ASSERT_EQ(tab.Open(FileTool::GetFileSize(st)), Status::kSuccess);
+  int32_t false_positives = 0;
+  for (int32_t tenant = 0; tenant < 200; ++tenant) {
+    LookupKey prefix_key(key_of(tenant), kMaxSequenceNumber);
+    const bool match = tab.FilterMayMatch(ReadOptions(), prefix_key.internal_key());
+    if (tenant % 2 == 0) {
+      ASSERT_TRUE(match) << tenant;
+    } else {
+      false_positives += match;
+    }
+  }
+  EXPECT_LT(false_positives, 10);
+  // 完整的key仍然会加入filter
+  std::string key = key_of(10) + "105";
+  LookupKey lookup_key(key, kMaxSequenceNumber);
+  EXPECT_TRUE(tab.FilterMayMatch(ReadOptions(), lookup_key.internal_key()));
+}
+
+INSTANTIATE_TEST_SUITE_P(FilterType, PrefixFilterTest,
+                         ::testing::Values(0, 1, 2));
+
+TEST(table_builder_Test, DataBlockHashIndex) {
+  auto user_comparator = std::make_shared<ByteComparator>();
+  Options options;
+  options.comparator =
+      std::make_shared<InternalKeyComparator>(user_comparator.get());
+  options.data_block_hash_index = true;
+  options.block_restart_interval = 4;
+  DataBlockBuilder builder(&options);
+  // 每个user_key有三个版本，部分版本会跨越restart区间
+  for (int32_t i = 0; i < 200; i += 2) {
+    for (SequenceNumber seq = 30; seq > 0; seq -= 10) {
+      std::string key;
+      AppendInternalKey(&key,
+                        ParsedInternalKey("key" + std::to_string(1000 + i),
+                                          seq, kTypeValue));
+      builder.Add(key, std::to_string(i) + "@" + std::to_string(seq));
+    }
+  }
+  builder.Finish();
+  DataBlock block{std::string_view(builder.Data())};
+  std::unique_ptr<Iterator> seek_iter(block.NewIterator(options.comparator));
+  std::unique_ptr<Iterator> get_iter(block.NewIterator(options.comparator));
+  for (int32_t i = 0; i < 200; ++i) {
+    for (SequenceNumber snapshot : {5, 10, 25, 100}) {
+      LookupKey lookup_key("key" + std::to_string(1000 + i), snapshot);
+      seek_iter->Seek(lookup_key.internal_key());
+      get_iter->SeekForGet(lookup_key.internal_key());
+      if (i % 2 == 1 || snapshot < 10) {
+        // 不存在的key或者所有版本都比snapshot新，不能返回同一个user_key
+        ASSERT_TRUE(!get_iter->Valid() ||
+                    ExtractUserKey(get_iter->key()) != lookup_key.user_key());
+        continue;
+      }
+      ASSERT_TRUE(get_iter->Valid());
+      EXPECT_EQ(get_iter->key(), seek_iter->key());
+      EXPECT_EQ(get_iter->value(), seek_iter->value());
+    }
+  }
+  EXPECT_EQ(get_iter->status(), Status::kSuccess);
+  // 普通的遍历不受hash索引影响
+  int32_t count = 0;
+  for (seek_iter->SeekToFirst(); seek_iter->Valid(); seek_iter->Next()) {
+    ++count;
+  }
+  EXPECT_EQ(count, 300);
+  for (seek_iter->SeekToLast(); seek_iter->Valid(); seek_iter->Prev()) {
+    --count;
+  }
+  EXPECT_EQ(count, 0);
+}
+
+TEST(table_builder_Test, IndexBlockKeyPrefix) {
+  auto user_comparator = std::make_shared<ByteComparator>();
+  // 大量key共享前8个字节，另外还有比8个字节短的key
+  std::vector<std::string> user_keys;
+  for (int32_t i = 0; i < 600; i += 2) {
+    user_keys.emplace_back("prefix__" + std::to_string(100000 + i));
+    user_keys.emplace_back(std::to_string(1000 + i));
+  }
+  std::sort(user_keys.begin(), user_keys.end());
+  std::vector<std::string> targets;
+  for (int32_t i = 0; i < 601; ++i) {
+    targets.emplace_back("prefix__" + std::to_string(100000 + i));
+    targets.emplace_back(std::to_string(1000 + i));
+  }
+  targets.insert(targets.end(), {"", "0", "prefix_", "prefix__9", "zzz",
+                                 std::string(8, '\xff')});
+  for (const bool internal_key : {true, false}) {
+    Options options;
+    if (internal_key) {
+      options.comparator =
+          std::make_shared<InternalKeyComparator>(user_comparator.get());
+    } else {
+      options.comparator = user_comparator;
+    }
+    options.block_restart_interval = 1;
+    DataBlockBuilder plain_builder(&options);
+    DataBlockBuilder prefix_builder(&options, true);
+    for (const auto& user_key : user_keys) {
+      std::string key = user_key;
+      if (internal_key) {
+        key.clear();
+        AppendInternalKey(&key, ParsedInternalKey(user_key, 10, kTypeValue));
+      }
+      plain_builder.Add(key, user_key);
+      prefix_builder.Add(key, user_key);
+    }
+    plain_builder.Finish();
+    prefix_builder.Finish();
+    ASSERT_EQ(prefix_builder.Data().size(),
+              plain_builder.Data().size() + user_keys.size() * sizeof(uint64_t));
+    DataBlock plain_block{std::string_view(plain_builder.Data())};
+    DataBlock prefix_block{std::string_view(prefix_builder.Data())};
+    std::unique_ptr<Iterator> plain_iter(
+        plain_block.NewIterator(options.comparator));
+    std::unique_ptr<Iterator> prefix_iter(
+        prefix_block.NewIterator(options.comparator));
+    for (const auto& user_key : targets) {
+      for (SequenceNumber snapshot : {5, 10, 100}) {
+        std::string target = user_key;
+        if (internal_key) {
+          target = LookupKey(user_key, snapshot).internal_key();
+        }
+        plain_iter->Seek(target);
+        prefix_iter->Seek(target);
+        ASSERT_EQ(plain_iter->Valid(), prefix_iter->Valid()) << user_key;
+        if (plain_iter->Valid()) {
+          ASSERT_EQ(plain_iter->key(), prefix_iter->key()) << user_key;
+          ASSERT_EQ(plain_iter->value(), prefix_iter->value());
+        }
+      }
+    }
+    EXPECT_EQ(prefix_iter->status(), Status::kSuccess);
+    int32_t count = 0;
+    for (prefix_iter->SeekToFirst(); prefix_iter->Valid(); prefix_iter->Next()) {
+      ++count;
+    }
+    EXPECT_EQ(count, user_keys.size());
+  }
+
+  // 打开选项之后整个sst的读取结果不变
+  static const std::string st = "index_key_prefix.sst";
+  Options options;
+  options.comparator =
+      std::make_shared<InternalKeyComparator>(user_comparator.get());
+  options.block_size = 256;
+  options.index_block_key_prefix = true;
+  {
+    FileWriter file_handler(st);
+    TableBuilder tb(options, &file_handler);
+    for (const auto& user_key : user_keys) {
+      std::string key;
+      AppendInternalKey(&key, ParsedInternalKey(user_key, 10, kTypeValue));
+      tb.Add(key, user_key);
+    }
+    tb.Finish();
+    ASSERT_TRUE(tb.Success());
+  }
+  FileReader file_reader(st);
+  Table tab(&options, &file_reader);
+  ASSERT_EQ(tab.Open(FileTool::GetFileSize(st)), Status::kSuccess);
+  std::unique_ptr<Iterator> iter(tab.NewIterator(ReadOptions()));
+  for (int32_t i = 0; i < 599; ++i) {
+    const std::string user_key = "prefix__" + std::to_string(100000 + i);
+    iter->Seek(LookupKey(user_key, 100).internal_key());
+    ASSERT_TRUE(iter->Valid());
+    if (i % 2 == 0) {
+      EXPECT_EQ(iter->value(), user_key);
+    } else {
+      EXPECT_GT(ExtractUserKey(iter->key()), user_key);
+    }
+  }
+  EXPECT_EQ(iter->status(), Status::kSuccess);
+}
+
+TEST(table_builder_Test, ShortestIndexKeys) {
+  ByteComparator cmp;
+  std::string start = "abc1xyz";
+  cmp.FindShortest(start, "abd");
+  EXPECT_EQ(start, "abc2");
+  start = "abc";
+  cmp.FindShortest(start, "abe");
+  EXPECT_EQ(start, "abd");
+  // 大于等于0x80的字节按照无符号比较
+  start = "a\x90zz";
+  cmp.FindShortest(start, "a\xa0");
+  EXPECT_EQ(start, "a\x91");
+  start = "abc";
+  cmp.FindShortest(start, "abcd");
+  EXPECT_EQ(start, "abc");
+  std::string key = "\xff\xff" "abc";
+  cmp.FindShortSuccessor(key);
+  EXPECT_EQ(key, "\xff\xff" "b");
+  key = "\xff\xff";
+  cmp.FindShortSuccessor(key);
+  EXPECT_EQ(key, "\xff\xff");
+
+  // 共享很长前缀的key，index中只保留能区分相邻block的部分
+  static const std::string st = "shortest_index.sst";
+  auto user_comparator = std::make_shared<ByteComparator>();
+  Options options;
+  options.comparator =
+      std::make_shared<InternalKeyComparator>(user_comparator.get());
+  options.block_size = 1024;
+  const std::string common(64, 'k');
+  auto user_key_of = [&common](int32_t i) {
+    return common + std::to_string(100000 + i) + std::string(10, 'z');
+  };
+  std::string last_key;
+  {
+    FileWriter file_handler(st);
+    TableBuilder tb(options, &file_handler);
+    for (int32_t i = 0; i < 2000; ++i) {
+      last_key.clear();
+      AppendInternalKey(&last_key,
+                        ParsedInternalKey(user_key_of(i), 1, kTypeValue));
+      tb.Add(last_key, std::string(20, 'v'));
+    }
+    tb.Finish();
+    ASSERT_TRUE(tb.Success());
+  }
+  FileReader file_reader(st);
+  Table tab(&options, &file_reader);
+  ASSERT_EQ(tab.Open(FileTool::GetFileSize(st)), Status::kSuccess);
+  std::vector<std::string> index_keys;
+  tab.GetIndexKeys(&index_keys);
+  ASSERT_GT(index_keys.size(), 10u);
+  for (const auto& index_key : index_keys) {
+    EXPECT_LT(index_key.size(), last_key.size());
+  }
+  // 最后一个index key不小于sst中最后一个key
+  EXPECT_GE(options.comparator->Compare(index_keys.back(), last_key), 0);
+  EXPECT_EQ(tab.properties()->largest_key, last_key);
+  std::unique_ptr<Iterator> iter(tab.NewIterator(ReadOptions()));
+  for (int32_t i = 0; i < 2000; i += 7) {
+    iter->Seek(LookupKey(user_key_of(i), 1).internal_key());
+    ASSERT_TRUE(iter->Valid());
+    EXPECT_EQ(ExtractUserKey(iter->key()), user_key_of(i));
+  }
+  // 在最后一个key和最后一个index key之间
+  iter->Seek(LookupKey(user_key_of(1999) + "a", 1).internal_key());
+  EXPECT_FALSE(iter->Valid());
+  EXPECT_EQ(iter->status(), Status::kSuccess);
+}
+
+TEST(table_builder_Test, Properties) {
+  static const std::string st = "properties.sst";
+  auto user_comparator = std::make_shared<ByteComparator>();
+  Options options;
+  options.comparator =
+      std::make_shared<InternalKeyComparator>(user_comparator.get());
+  options.block_size = 1024;
+  uint64_t raw_key_size = 0, raw_value_size = 0;
+  std::string smallest, largest;
+  {
+    FileWriter file_handler(st);
+    TableBuilder tb(options, &file_handler);
+    tb.SetCreationTime(12345);
+    for (int32_t i = 0; i < 1000; ++i) {
+      std::string key;
+      AppendInternalKey(&key, ParsedInternalKey(
+                                  "key" + std::to_string(1000 + i), 1,
+                                  i % 4 == 0 ? kTypeDeletion : kTypeValue));
+      const std::string value = i % 4 == 0 ? "" : std::string(100, 'v');
+      if (i == 0) {
+        smallest = key;
+      }
+      largest = key;
+      raw_key_size += key.size();
+      raw_value_size += value.size();
+      tb.Add(key, value);
+    }
+    tb.AddRangeTombstone(RangeTombstone("key1100", "key1200", 2));
+    tb.Finish();
+    ASSERT_TRUE(tb.Success());
+  }
+  FileReader file_reader(st);
+  Table tab(&options, &file_reader);
+  ASSERT_EQ(tab.Open(FileTool::GetFileSize(st)), Status::kSuccess);
+  std::shared_ptr<const TableProperties> props = tab.properties();
+  ASSERT_NE(props, nullptr);
+  EXPECT_EQ(props->num_entries, 1000u);
+  EXPECT_EQ(props->num_deletions, 250u);
+  EXPECT_EQ(props->num_range_deletions, 1u);
+  EXPECT_EQ(props->raw_key_size, raw_key_size);
+  EXPECT_EQ(props->raw_value_size, raw_value_size);
+  EXPECT_EQ(props->smallest_key, smallest);
+  EXPECT_EQ(props->largest_key, largest);
+  EXPECT_EQ(props->creation_time, 12345u);
+  EXPECT_GT(props->num_data_blocks, 1u);
+  EXPECT_GT(props->data_size, 0u);
+  EXPECT_LT(props->data_size, FileTool::GetFileSize(st));
+  EXPECT_GT(props->CompressionRatio(), 0.5);
+}
+
+// 参数: 压缩算法、zstd字典大小
+class CompressionTableTest
+    : public ::testing::TestWithParam<std::tuple<BlockCompressType, uint32_t>> {};
+
+TEST_P(CompressionTableTest, RoundTrip) {
+  const std::string st = "compression.sst";
+  static constexpr int32_t kKeyNum = 5000;
+  auto key_of = [](int32_t i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%08d", i);
+    return std::string(buf);
+  };
+  // 重复度很高的value，压缩之后明显变小
+  auto value_of = [](int32_t i) {
+    return "value" + std::to_string(i % 100) + std::string(64, 'a' + i % 3);
+  };
+  auto build = [&](const Options& options) {
+    FileWriter file_handler(st);
+    TableBuilder tb(options, &file_handler);
+    for (int32_t i = 0; i < kKeyNum; ++i) {
+      tb.Add(key_of(i), value_of(i));
+    }
+    tb.Finish();
+    EXPECT_TRUE(tb.Success());
+    return tb.GetFileSize();
+  };
+  Options options;
+  options.comparator = std::make_shared<ByteComparator>();
+  options.filter_policy = std::make_shared<BloomFilter>(10);
+  const uint32_t raw_size = build(options);
+  options.block_compress_type = std::get<0>(GetParam());
+  options.compression_opts.max_dict_bytes = std::get<1>(GetParam());
+  const uint32_t file_size = build(options);
+  const bool supported = CompressionTypeSupported(options.block_compress_type);
+  if (supported) {
+    EXPECT_LT(file_size, raw_size / 2);
+  } else {
+    // 没有编译进来的算法退化成不压缩
+    EXPECT_EQ(file_size, raw_size);
+  }
+  FileReader file_reader(st);
+  Table tab(&options, &file_reader);
+  ASSERT_EQ(tab.Open(FileTool::GetFileSize(st)), Status::kSuccess);
+  std::unique_ptr<Iterator> iter(tab.NewIterator(ReadOptions()));
+  int32_t i = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++i) {
+    ASSERT_EQ(iter->key(), key_of(i));
+    ASSERT_EQ(iter->value(), value_of(i));
+  }
+  EXPECT_EQ(i, kKeyNum);
+  EXPECT_EQ(iter->status(), Status::kSuccess);
+  for (int32_t k = 0; k < kKeyNum; k += 97) {
+    std::pair<std::string, std::string> result;
+    ASSERT_EQ(tab.InternalGet(ReadOptions(), key_of(k), &result, SaveValue),
+              Status::kSuccess);
+    EXPECT_EQ(result.first, key_of(k));
+    EXPECT_EQ(result.second, value_of(k));
+  }
+  if (!supported) {
+    GTEST_SKIP() << "compression type " << options.block_compress_type
+                 << " is not compiled in, only the fallback was tested; "
+                    "build with --config=compression";
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Types, CompressionTableTest,
+    ::testing::Values(std::make_tuple(kSnappyCompression, 0u),
+                      std::make_tuple(kLZ4Compression, 0u),
+                      std::make_tuple(kZSTDCompression, 0u),
+                      std::make_tuple(kZSTDCompression, 4096u)));
+
+TEST(table_builder_Test, UncompressBlock) {
+  const std::string raw(4096, 'x');
+  std::string missing;
+  for (BlockCompressType type :
+       {kSnappyCompression, kLZ4Compression, kZSTDCompression}) {
+    std::string compressed, output;
+    if (!CompressionTypeSupported(type)) {
+      EXPECT_FALSE(CompressBlock(type, 3, nullptr, raw, &compressed));
+      EXPECT_EQ(UncompressBlock(type, nullptr, raw, &output),
+                Status::kNotSupported);
+      missing.append(" ").append(std::to_string(type));
+      continue;
+    }
+    ASSERT_TRUE(CompressBlock(type, 3, nullptr, raw, &compressed));
+    ASSERT_EQ(UncompressBlock(type, nullptr, compressed, &output),
+              Status::kSuccess);
+    EXPECT_EQ(output, raw);
+    // 截断的数据不能解压成功
+    compressed.resize(compressed.size() / 2);
+    EXPECT_NE(UncompressBlock(type, nullptr, compressed, &output),
+              Status::kSuccess);
+  }
+  if (!missing.empty()) {
+    GTEST_SKIP() << "compression types" << missing
+                 << " are not compiled in; build with --config=compression";
+  }
+}
+
+TEST(table_builder_Test, CompressionDictUsedFor) {
+  // 空字典和非zstd的算法都不会用到字典，block也不能带上kDictCompressedFlag
+  CompressionDict empty_dict("", 3);
+  EXPECT_FALSE(empty_dict.UsedFor(kZSTDCompression));
+  CompressionDict dict(std::string(4096, 'x'), 3);
+  EXPECT_FALSE(dict.UsedFor(kLZ4Compression));
+  EXPECT_FALSE(dict.UsedFor(kNonCompress));
+  EXPECT_EQ(dict.UsedFor(kZSTDCompression),
+            CompressionTypeSupported(kZSTDCompression));
+}
+
+TEST(table_builder_Test, ParallelCompression) {
+  static constexpr int32_t kKeyNum = 20000;
+  auto key_of = [](int32_t i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%08d", i);
+    return std::string(buf);
+  };
+  auto value_of = [](int32_t i) {
+    return "value" + std::to_string(i % 100) + std::string(64, 'a' + i % 3);
+  };
+  auto build = [&](const std::string& name, const Options& options) {
+    FileWriter file_handler(name);
+    TableBuilder tb(options, &file_handler);
+    for (int32_t i = 0; i < kKeyNum; ++i) {
+      tb.Add(key_of(i), value_of(i));
+    }
+    tb.Finish();
+    EXPECT_TRUE(tb.Success());
+    EXPECT_EQ(tb.GetFileSize(), FileTool::GetFileSize(name));
+  };
+  auto read_all = [](const std::string& name) {
+    std::string data;
+    FileReader reader(name);
+    EXPECT_EQ(reader.Read(0, FileTool::GetFileSize(name), &data),
+              Status::kSuccess);
+    return data;
+  };
+  std::string missing;
+  for (BlockCompressType type : {kLZ4Compression, kZSTDCompression}) {
+    // 不压缩的时候不会使用并行的流水线
+    if (!CompressionTypeSupported(type)) {
+      missing.append(" ").append(std::to_string(type));
+      continue;
+    }
+    Options options;
+    options.comparator = std::make_shared<ByteComparator>();
+    options.filter_policy = std::make_shared<BloomFilter>(10);
+    options.block_compress_type = type;
+    options.compression_opts.max_dict_bytes = 4096;
+    build("serial.sst", options);
+    options.compression_opts.parallel_threads = 4;
+    build("parallel.sst", options);
+    // 压缩的结果和顺序都与串行写入一致
+    ASSERT_EQ(read_all("parallel.sst"), read_all("serial.sst"));
+    FileReader file_reader("parallel.sst");
+    Table tab(&options, &file_reader);
+    ASSERT_EQ(tab.Open(FileTool::GetFileSize("parallel.sst")),
+              Status::kSuccess);
+    std::unique_ptr<Iterator> iter(tab.NewIterator(ReadOptions()));
+    int32_t i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++i) {
+      ASSERT_EQ(iter->key(), key_of(i));
+      ASSERT_EQ(iter->value(), value_of(i));
+    }
+    EXPECT_EQ(i, kKeyNum);
+  }
+  if (!missing.empty()) {
+    GTEST_SKIP() << "compression types" << missing
+                 << " are not compiled in; build with --config=compression";
+  }
+}
+
+TEST(table_builder_Test, DirectIO) {
+  static constexpr int32_t kKeyNum = 20000;
+  auto key_of = [](int32_t i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%08d", i);
+    return std::string(buf);
+  };
+  Options options;
+  options.comparator = std::make_shared<ByteComparator>();
+  options.filter_policy = std::make_shared<BloomFilter>(10);
+  auto build = [&](const std::string& name, bool direct_io) {
+    FileWriter file_handler(name, false, direct_io);
+    TableBuilder tb(options, &file_handler);
+    for (int32_t i = 0; i < kKeyNum; ++i) {
+      tb.Add(key_of(i), std::to_string(i));
+    }
+    tb.Finish();
+    EXPECT_TRUE(tb.Success());
+    // 末尾补齐的部分被截断，文件长度和普通写一致
+    EXPECT_EQ(tb.GetFileSize(), FileTool::GetFileSize(name));
+  };
+  build("buffered.sst", false);
+  build("direct.sst", true);
+  std::string buffered, direct;
+  FileReader buffered_reader("buffered.sst");
+  ASSERT_EQ(buffered_reader.Read(0, FileTool::GetFileSize("buffered.sst"),
+                                 &buffered),
+            Status::kSuccess);
+  FileReader direct_reader("direct.sst", false, true);
+  // 读取的区间不对齐，超过文件末尾的部分不返回
+  ASSERT_EQ(direct_reader.Read(0, FileTool::GetFileSize("direct.sst") + 100,
+                               &direct),
+            Status::kSuccess);
+  ASSERT_EQ(direct, buffered);
+  Table tab(&options, &direct_reader);
+  ASSERT_EQ(tab.Open(FileTool::GetFileSize("direct.sst")), Status::kSuccess);
+  std::unique_ptr<Iterator> iter(tab.NewIterator(ReadOptions()));
+  int32_t i = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++i) {
+    ASSERT_EQ(iter->key(), key_of(i));
+    ASSERT_EQ(iter->value(), std::to_string(i));
+  }
+  EXPECT_EQ(i, kKeyNum);
+}
+
+TEST(table_builder_Test, SecondaryCache) {
+  static const std::string st = "secondary_cache.sst";
+  static constexpr int32_t kKeyNum = 20000;
+  auto key_of = [](int32_t i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%08d", i);
+    return std::string(buf);
+  };
+  auto value_of = [](int32_t i) { return std::string(32, 'a' + i % 26); };
+  // 第二层要比block_cache活得久，block_cache析构时淘汰的block还会放进来
+  CompressedSecondaryCache secondary_cache(4 * 1024 * 1024);
+  ShardCache<uint64_t, DataBlock> block_cache(16 * 1024, 1);
+  Options options;
+  options.comparator = std::make_shared<ByteComparator>();
+  options.block_cache = &block_cache;
+  options.secondary_cache = &secondary_cache;
+  options.statistics = std::make_shared<Statistics>();
+  {
+    FileWriter file_handler(st);
+    TableBuilder tb(options, &file_handler);
+    for (int32_t i = 0; i < kKeyNum; ++i) {
+      tb.Add(key_of(i), value_of(i));
+    }
+    tb.Finish();
+    ASSERT_TRUE(tb.Success());
+  }
+  FileReader file_reader(st);
+  Table tab(&options, &file_reader);
+  ASSERT_EQ(tab.Open(FileTool::GetFileSize(st)), Status::kSuccess);
+  for (int32_t round = 0; round < 2; ++round) {
+    for (int32_t i = 0; i < kKeyNum; ++i) {
+      std::pair<std::string, std::string> result;
+      ASSERT_EQ(tab.InternalGet(ReadOptions(), key_of(i), &result, &SaveValue),
+                Status::kSuccess);
+      ASSERT_EQ(result.first, key_of(i));
+      ASSERT_EQ(result.second, value_of(i));
+    }
+  }
+  // 第一轮从block_cache淘汰的block都进了第二层，第二轮从第二层读回来
+  const Statistics& stats = *options.statistics;
+  EXPECT_GT(stats.GetTickerCount(kSecondaryCacheHit), 0u);
+  EXPECT_GT(secondary_cache.GetUsage(), 0u);
+  std::unique_ptr<Iterator> iter(tab.NewIterator(ReadOptions()));
+  int32_t i = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++i) {
+    ASSERT_EQ(iter->key(), key_of(i));
+    ASSERT_EQ(iter->value(), value_of(i));
+  }
+  EXPECT_EQ(i, kKeyNum);
+  if (secondary_cache.compress_type() == kNonCompress) {
+    GTEST_SKIP() << "lz4 is not compiled in, the secondary cache stored "
+                    "uncompressed blocks; build with --config=compression";
+  }
+}
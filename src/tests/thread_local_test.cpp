@@ -0,0 +1,88 @@
+#include "utils/thread_local.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace corekv;
+
+static std::atomic<int32_t> unref_count(0);
+static void CountUnref(void*) { unref_count.fetch_add(1); }
+
+TEST(ThreadLocalTest, PerThreadValue) {
+  ThreadLocalPtr ptr;
+  int32_t a = 1, b = 2;
+  EXPECT_EQ(ptr.Get(), nullptr);
+  ptr.Reset(&a);
+  EXPECT_EQ(ptr.Get(), &a);
+  std::thread other([&ptr, &b]() {
+    // 其他线程看不到当前线程的值
+    EXPECT_EQ(ptr.Get(), nullptr);
+    ptr.Reset(&b);
+    EXPECT_EQ(ptr.Get(), &b);
+  });
+  other.join();
+  EXPECT_EQ(ptr.Get(), &a);
+
+  EXPECT_EQ(ptr.Swap(&b), &a);
+  void* expected = &a;
+  EXPECT_FALSE(ptr.CompareAndSwap(nullptr, expected));
+  EXPECT_EQ(expected, &b);
+  EXPECT_TRUE(ptr.CompareAndSwap(nullptr, expected));
+  EXPECT_EQ(ptr.Get(), nullptr);
+}
+
+TEST(ThreadLocalTest, Scrape) {
+  static constexpr int32_t kThreadNum = 4;
+  ThreadLocalPtr ptr;
+  std::vector<int32_t> values(kThreadNum);
+  std::atomic<int32_t> ready(0);
+  std::atomic<bool> scraped(false);
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < kThreadNum; ++t) {
+    threads.emplace_back([&, t]() {
+      ptr.Reset(&values[t]);
+      ready.fetch_add(1);
+      while (!scraped.load()) {
+        std::this_thread::yield();
+      }
+      // 被替换成了Scrape传入的值
+      EXPECT_EQ(ptr.Get(), &values[0]);
+    });
+  }
+  while (ready.load() < kThreadNum) {
+    std::this_thread::yield();
+  }
+  std::vector<void*> ptrs;
+  ptr.Scrape(&ptrs, &values[0]);
+  scraped.store(true);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(ptrs.size(), kThreadNum);
+  for (int32_t t = 0; t < kThreadNum; ++t) {
+    EXPECT_NE(std::find(ptrs.begin(), ptrs.end(), &values[t]), ptrs.end());
+  }
+}
+
+TEST(ThreadLocalTest, UnrefHandler) {
+  int32_t value = 0;
+  unref_count.store(0);
+  {
+    ThreadLocalPtr ptr(&CountUnref);
+    // 线程退出的时候释放
+    std::thread([&ptr, &value]() { ptr.Reset(&value); }).join();
+    EXPECT_EQ(unref_count.load(), 1);
+    std::thread([&ptr]() { ptr.Reset(nullptr); }).join();
+    EXPECT_EQ(unref_count.load(), 1);
+    // 析构的时候释放还存活的线程中的值
+    ptr.Reset(&value);
+  }
+  EXPECT_EQ(unref_count.load(), 2);
+  // id重新使用之后看不到之前的值
+  ThreadLocalPtr reused;
+  EXPECT_EQ(reused.Get(), nullptr);
+}
@@ -0,0 +1,200 @@
+#include "db/write_batch.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+#include "db/comparator.h"
+#include "db/dbformat.h"
+#include "db/log_reader.h"
+#include "db/log_writer.h"
+#include "db/memtable.h"
+#include "db/write_batch_internal.h"
+#include "file/file.h"
+
+using namespace std;
+using namespace corekv;
+
+// 把batch插入到memtable中，然后按照顺序打印出来
+static std::string PrintContents(WriteBatch* b) {
+  ByteComparator byte_comparator;
+  InternalKeyComparator icmp(&byte_comparator);
+  MemTable* mem = new MemTable(icmp);
+  mem->Ref();
+  std::string state;
+  DBStatus s = WriteBatchInternal::InsertInto(b, mem);
+  int32_t count = 0;
+  Iterator* iter = mem->NewIterator();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    EXPECT_TRUE(ParseInternalKey(iter->key(), &ikey));
+    switch (ikey.type) {
+      case kTypeValue:
+        state.append("Put(");
+        state.append(ikey.user_key);
+        state.append(", ");
+        state.append(iter->value());
+        state.append(")");
+        count++;
+        break;
+      case kTypeValueWithExpiry: {
+        std::string_view value;
+        uint64_t expire_at;
+        EXPECT_TRUE(SplitExpiry(iter->value(), &value, &expire_at));
+        state.append("PutWithExpiry(");
+        state.append(ikey.user_key);
+        state.append(", ");
+        state.append(value);
+        state.append(")");
+        count++;
+        break;
+      }
+      case kTypeMerge:
+        state.append("Merge(");
+        state.append(ikey.user_key);
+        state.append(", ");
+        state.append(iter->value());
+        state.append(")");
+        count++;
+        break;
+      case kTypeDeletion:
+        state.append("Delete(");
+        state.append(ikey.user_key);
+        state.append(")");
+        count++;
+        break;
+      // 正常情况下不会出现在memtable中，出现的时候也打印出来方便定位
+      case kTypeBlobIndex:
+        state.append("BlobIndex(");
+        state.append(ikey.user_key);
+        state.append(")");
+        count++;
+        break;
+      case kTypeRangeDeletion:
+        state.append("DeleteRange(");
+        state.append(ikey.user_key);
+        state.append(", ");
+        state.append(iter->value());
+        state.append(")");
+        count++;
+        break;
+    }
+    state.append("@");
+    state.append(std::to_string(ikey.sequence));
+  }
+  delete iter;
+  if (s != Status::kSuccess) {
+    state.append("ParseError()");
+  } else if (count != WriteBatchInternal::Count(b)) {
+    state.append("CountMismatch()");
+  }
+  mem->Unref();
+  return state;
+}
+
+TEST(writeBatchTest, Empty) {
+  WriteBatch batch;
+  EXPECT_EQ("", PrintContents(&batch));
+  EXPECT_EQ(0u, WriteBatchInternal::Count(&batch));
+}
+
+TEST(writeBatchTest, Multiple) {
+  WriteBatch batch;
+  batch.Put("foo", "bar");
+  batch.Delete("box");
+  batch.Put("baz", "boo");
+  WriteBatchInternal::SetSequence(&batch, 100);
+  EXPECT_EQ(100u, WriteBatchInternal::Sequence(&batch));
+  EXPECT_EQ(3u, WriteBatchInternal::Count(&batch));
+  EXPECT_EQ(
+      "Put(baz, boo)@102"
+      "Delete(box)@101"
+      "Put(foo, bar)@100",
+      PrintContents(&batch));
+}
+
+TEST(writeBatchTest, PutWithTTL) {
+  WriteBatch batch;
+  batch.Put("foo", "bar");
+  batch.PutWithTTL("box", "baz", 1000);
+  WriteBatchInternal::SetSequence(&batch, 100);
+  EXPECT_EQ(2u, WriteBatchInternal::Count(&batch));
+  EXPECT_EQ(
+      "PutWithExpiry(box, baz)@101"
+      "Put(foo, bar)@100",
+      PrintContents(&batch));
+}
+
+TEST(writeBatchTest, Merge) {
+  WriteBatch batch;
+  batch.Put("foo", "bar");
+  batch.Merge("foo", "baz");
+  batch.Merge("box", "boo");
+  WriteBatchInternal::SetSequence(&batch, 100);
+  EXPECT_EQ(3u, WriteBatchInternal::Count(&batch));
+  EXPECT_EQ(
+      "Merge(box, boo)@102"
+      "Merge(foo, baz)@101"
+      "Put(foo, bar)@100",
+      PrintContents(&batch));
+}
+
+TEST(writeBatchTest, Corruption) {
+  WriteBatch batch;
+  batch.Put("foo", "bar");
+  batch.Delete("box");
+  WriteBatchInternal::SetSequence(&batch, 200);
+  std::string_view contents = WriteBatchInternal::Contents(&batch);
+  WriteBatchInternal::SetContents(&batch,
+                                  contents.substr(0, contents.size() - 1));
+  EXPECT_EQ("Put(foo, bar)@200ParseError()", PrintContents(&batch));
+}
+
+TEST(writeBatchTest, Append) {
+  WriteBatch b1, b2;
+  WriteBatchInternal::SetSequence(&b1, 200);
+  WriteBatchInternal::SetSequence(&b2, 300);
+  b1.Append(b2);
+  EXPECT_EQ("", PrintContents(&b1));
+  b2.Put("a", "va");
+  b1.Append(b2);
+  EXPECT_EQ("Put(a, va)@200", PrintContents(&b1));
+  b2.Clear();
+  b2.Put("b", "vb");
+  b2.Delete("foo");
+  b1.Append(b2);
+  EXPECT_EQ(
+      "Put(a, va)@200"
+      "Put(b, vb)@201"
+      "Delete(foo)@202",
+      PrintContents(&b1));
+}
+
+TEST(writeBatchTest, LogRoundTrip) {
+  static const std::string kLogFile = "write_batch_test.log";
+  WriteBatch batch;
+  for (int32_t i = 0; i < 1000; ++i) {
+    batch.Put("key" + std::to_string(i), std::string(100, 'v'));
+  }
+  batch.Delete("key7");
+  WriteBatchInternal::SetSequence(&batch, 1);
+  {
+    // 整个batch作为WAL中的一条记录
+    FileWriter file_writer(kLogFile);
+    GroupCommitWriter writer(&file_writer);
+    ASSERT_EQ(writer.AddRecord(WriteBatchInternal::Contents(&batch), true),
+              Status::kSuccess);
+    file_writer.Close();
+  }
+  FileReader file_reader(kLogFile);
+  log::Reader reader(&file_reader, true);
+  std::string_view record;
+  std::string scratch;
+  ASSERT_TRUE(reader.ReadRecord(&record, &scratch));
+  WriteBatch recovered;
+  WriteBatchInternal::SetContents(&recovered, record);
+  EXPECT_EQ(WriteBatchInternal::Count(&recovered), 1001u);
+  EXPECT_EQ(PrintContents(&recovered), PrintContents(&batch));
+  EXPECT_FALSE(reader.ReadRecord(&record, &scratch));
+}
@@ -0,0 +1,36 @@
+#include "db/write_controller.h"
+
+#include <gtest/gtest.h>
+
+using namespace corekv;
+
+TEST(WriteControllerTest, PacesWrites) {
+  // 1MB/s，每写入1MB需要等待1s
+  WriteController controller(1024 * 1024);
+  EXPECT_EQ(controller.GetDelay(1000, 1024 * 1024), 0u);
+  // 同一时刻的下一次写入排在上一次的时间片之后
+  EXPECT_EQ(controller.GetDelay(1000, 512 * 1024), 1000000u);
+  EXPECT_EQ(controller.GetDelay(1000 + 500000, 1024), 1000000u);
+  // 时间片用完之后不再需要等待
+  EXPECT_EQ(controller.GetDelay(10 * 1000000, 1024), 0u);
+}
+
+TEST(WriteControllerTest, AdjustRate) {
+  WriteController controller(1024 * 1024);
+  EXPECT_EQ(controller.delayed_write_rate(), 1024u * 1024);
+  controller.Slowdown();
+  EXPECT_LT(controller.delayed_write_rate(), 1024u * 1024);
+  // 有下限
+  for (int32_t i = 0; i < 100; ++i) {
+    controller.Slowdown();
+  }
+  EXPECT_EQ(controller.delayed_write_rate(), 16u * 1024);
+  // 提高速率不会超过初始速率
+  for (int32_t i = 0; i < 100; ++i) {
+    controller.Speedup();
+  }
+  EXPECT_EQ(controller.delayed_write_rate(), 1024u * 1024);
+  controller.Slowdown();
+  controller.Reset();
+  EXPECT_EQ(controller.delayed_write_rate(), 1024u * 1024);
+}
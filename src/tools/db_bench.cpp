@@ -0,0 +1,649 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cache/cache.h"
+#include "db/db.h"
+#include "db/dbformat.h"
+#include "db/options.h"
+#include "filter/bloomfilter.h"
+#include "table/secondary_cache.h"
+#include "utils/histogram.h"
+#include "utils/random_util.h"
+#include "utils/statistics.h"
+#include "utils/string_util.h"
+
+/*
+ * 和leveldb/rocksdb的db_bench类似的压测工具，按照--benchmarks中的顺序依次执行:
+ *   fillseq          按照key的顺序写入num个key
+ *   fillrandom       按照随机的顺序写入num个key
+ *   overwrite        随机覆盖写已有的key
+ *   fillsync         每次写入都fsync，写入num/100个key
+ *   readrandom       随机点查reads次
+ *   multireadrandom  每batch_size个随机key调用一次MultiGet
+ *   readseq          正向遍历reads个key
+ *   readreverse      反向遍历reads个key
+ *   seekrandom       随机Seek之后再Next seek_nexts次
+ *   readwhilewriting threads个线程随机点查，同时另外一个线程持续随机写入
+ *   stats            打印db的状态，--statistics=1时同时打印计数器和延迟分布
+ *
+ * --threads大于1的时候每个测试用多个线程并发执行，操作次数在线程之间平分，
+ * 每个测试输出 micros/op、ops/sec、MB/s 以及延迟(us)的P50/P95/P99/P99.9/max
+ *
+ * 例: db_bench --benchmarks=fillrandom,readrandom --num=1000000 --threads=4
+ */
+using namespace corekv;
+
+namespace {
+// 命令行参数，名字和默认值尽量和leveldb的db_bench保持一致
+const char* FLAGS_benchmarks =
+    "fillseq,fillrandom,overwrite,readrandom,readseq,readreverse,seekrandom,"
+    "multireadrandom,readwhilewriting,stats";
+int64_t FLAGS_num = 1000000;
+// 小于0时和num相同
+int64_t FLAGS_reads = -1;
+int32_t FLAGS_threads = 1;
+int32_t FLAGS_key_size = 16;
+int32_t FLAGS_value_size = 100;
+// value的压缩率，0.5表示压缩之后大约是原来的一半
+double FLAGS_compression_ratio = 0.5;
+int32_t FLAGS_batch_size = 16;
+int32_t FLAGS_seek_nexts = 10;
+bool FLAGS_histogram = false;
+bool FLAGS_use_existing_db = false;
+// 为true时设置Options::statistics
+bool FLAGS_statistics = false;
+int64_t FLAGS_write_buffer_size = 4 * 1024 * 1024;
+int64_t FLAGS_max_file_size = 2 * 1024 * 1024;
+int32_t FLAGS_max_background_jobs = 2;
+// block_cache的字节数，小于等于0时不使用
+int64_t FLAGS_cache_size = 8 * 1024 * 1024;
+// row_cache的字节数，小于等于0时不使用
+int64_t FLAGS_row_cache_size = 0;
+// block_cache之后压缩的第二层缓存的字节数，小于等于0时不使用
+int64_t FLAGS_secondary_cache_size = 0;
+// 小于等于0时不使用bloom filter
+int32_t FLAGS_bloom_bits = 10;
+const char* FLAGS_compression = "none";
+uint64_t FLAGS_seed = 301;
+const char* FLAGS_db = "/tmp/corekv_bench";
+
+double NowMicros() {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// 预先生成一段满足压缩率的随机数据，每个value从中截取一段
+class RandomGenerator {
+ public:
+  RandomGenerator() {
+    RandomUtil rnd(FLAGS_seed);
+    const int32_t piece = 100;
+    const int32_t raw = std::max<int32_t>(
+        1, static_cast<int32_t>(piece * FLAGS_compression_ratio));
+    while (data_.size() < std::max<size_t>(1048576, FLAGS_value_size * 2)) {
+      // 随机的raw个字节重复填满piece个字节，压缩之后大约是raw个字节
+      std::string chunk;
+      for (int32_t i = 0; i < raw; ++i) {
+        chunk.push_back(' ' + static_cast<char>(rnd.GetSimpleRandomNum() % 95));
+      }
+      while (static_cast<int32_t>(chunk.size()) < piece) {
+        chunk.append(chunk, 0, piece - chunk.size());
+      }
+      data_.append(chunk);
+    }
+  }
+  std::string_view Generate(size_t len) {
+    if (pos_ + len > data_.size()) {
+      pos_ = 0;
+    }
+    pos_ += len;
+    return std::string_view(data_.data() + pos_ - len, len);
+  }
+
+ private:
+  std::string data_;
+  size_t pos_ = 0;
+};
+
+// 编号补齐到key_size，编号有序的key在字节序下也有序
+std::string MakeKey(uint64_t k) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%016llu", static_cast<unsigned long long>(k));
+  std::string key(buf);
+  if (static_cast<int32_t>(key.size()) < FLAGS_key_size) {
+    key.append(FLAGS_key_size - key.size(), 'x');
+  } else if (static_cast<int32_t>(key.size()) > FLAGS_key_size) {
+    key.erase(0, key.size() - FLAGS_key_size);
+  }
+  return key;
+}
+
+class Stats {
+ public:
+  void Start() {
+    start_ = NowMicros();
+    last_op_finish_ = start_;
+    finish_ = start_;
+  }
+  void Stop() { finish_ = NowMicros(); }
+  void Merge(const Stats& other) {
+    hist_.Merge(other.hist_);
+    done_ += other.done_;
+    bytes_ += other.bytes_;
+    // 多线程的时候按照最早开始和最晚结束计算总耗时
+    start_ = std::min(start_, other.start_);
+    finish_ = std::max(finish_, other.finish_);
+    found_ += other.found_;
+    lookups_ += other.lookups_;
+  }
+  void FinishedSingleOp(int64_t ops = 1) {
+    const double now = NowMicros();
+    hist_.Add(now - last_op_finish_);
+    last_op_finish_ = now;
+    done_ += ops;
+  }
+  void AddBytes(int64_t n) { bytes_ += n; }
+  // 点查和Seek命中的key个数
+  void AddFound(int64_t found, int64_t lookups) {
+    found_ += found;
+    lookups_ += lookups;
+  }
+
+  void Report(const std::string& name) const {
+    const double elapsed = (finish_ - start_) * 1e-6;
+    // 一个op都没有完成的时候避免除0
+    const int64_t done = std::max<int64_t>(done_, 1);
+    std::string extra;
+    if (bytes_ > 0 && elapsed > 0) {
+      char rate[100];
+      snprintf(rate, sizeof(rate), "%6.1f MB/s", (bytes_ / 1048576.0) / elapsed);
+      extra = rate;
+    }
+    if (lookups_ > 0) {
+      extra.append(extra.empty() ? "" : " ")
+          .append("(" + std::to_string(found_) + " of " +
+                  std::to_string(lookups_) + " found)");
+    }
+    fprintf(stdout, "%-16s : %11.3f micros/op %10.0f ops/sec;%s%s\n",
+            name.c_str(), elapsed * 1e6 / done * FLAGS_threads,
+            elapsed > 0 ? done / elapsed : 0.0, extra.empty() ? "" : " ",
+            extra.c_str());
+    fprintf(stdout,
+            "%-16s   latency(us) P50: %.2f P95: %.2f P99: %.2f P99.9: %.2f "
+            "max: %.2f\n",
+            "", hist_.Percentile(50), hist_.Percentile(95),
+            hist_.Percentile(99), hist_.Percentile(99.9), hist_.Max());
+    if (FLAGS_histogram) {
+      fprintf(stdout, "Microseconds per op:\n%s\n", hist_.ToString().c_str());
+    }
+    fflush(stdout);
+  }
+
+ private:
+  double start_ = 0;
+  double finish_ = 0;
+  double last_op_finish_ = 0;
+  int64_t done_ = 0;
+  int64_t bytes_ = 0;
+  int64_t found_ = 0;
+  int64_t lookups_ = 0;
+  Histogram hist_;
+};
+
+// 所有线程准备好之后一起开始，全部结束之后再汇总
+struct SharedState {
+  std::mutex mu;
+  std::condition_variable cv;
+  int32_t total = 0;
+  int32_t num_initialized = 0;
+  int32_t num_done = 0;
+  bool start = false;
+  // readwhilewriting中读线程结束之后通知写线程退出
+  std::atomic<int32_t> readers_done{0};
+};
+
+struct ThreadState {
+  ThreadState(int32_t index, int32_t count)
+      : tid(index), thread_count(count), rand(FLAGS_seed + 1000 * index) {}
+  const int32_t tid;
+  // 参与平分操作次数的线程个数
+  const int32_t thread_count;
+  RandomUtil rand;
+  Stats stats;
+  SharedState* shared = nullptr;
+};
+
+class Benchmark {
+ public:
+  Benchmark()
+      : num_(FLAGS_num), reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads) {
+    if (FLAGS_secondary_cache_size > 0) {
+      secondary_cache_ =
+          std::make_unique<CompressedSecondaryCache>(FLAGS_secondary_cache_size);
+    }
+    if (FLAGS_cache_size > 0) {
+      cache_ = std::make_unique<ShardCache<uint64_t, DataBlock>>(
+          FLAGS_cache_size);
+    }
+    if (FLAGS_row_cache_size > 0) {
+      row_cache_ = std::make_unique<ShardCache<std::string, std::string>>(
+          FLAGS_row_cache_size);
+    }
+    if (FLAGS_statistics) {
+      statistics_ = std::make_shared<Statistics>();
+    }
+    if (!FLAGS_use_existing_db) {
+      DestroyDB(FLAGS_db, Options());
+    }
+  }
+  ~Benchmark() { db_.reset(); }
+
+  void Run() {
+    PrintHeader();
+    Open();
+    std::vector<std::string> names;
+    string_util::Split(FLAGS_benchmarks, ',', names);
+    for (const auto& name : names) {
+      if (name.empty()) {
+        continue;
+      }
+      using Method = void (Benchmark::*)(ThreadState*);
+      Method method = nullptr;
+      bool fresh_db = false;
+      int32_t threads = FLAGS_threads;
+      if (name == "fillseq") {
+        fresh_db = true;
+        method = &Benchmark::WriteSeq;
+      } else if (name == "fillrandom") {
+        fresh_db = true;
+        method = &Benchmark::WriteRandom;
+      } else if (name == "overwrite") {
+        method = &Benchmark::WriteRandom;
+      } else if (name == "fillsync") {
+        fresh_db = true;
+        method = &Benchmark::WriteSync;
+      } else if (name == "readrandom") {
+        method = &Benchmark::ReadRandom;
+      } else if (name == "multireadrandom") {
+        method = &Benchmark::MultiReadRandom;
+      } else if (name == "readseq") {
+        method = &Benchmark::ReadSequential;
+      } else if (name == "readreverse") {
+        method = &Benchmark::ReadReverse;
+      } else if (name == "seekrandom") {
+        method = &Benchmark::SeekRandom;
+      } else if (name == "readwhilewriting") {
+        // 多出来的一个线程负责写入，不计入结果
+        ++threads;
+        method = &Benchmark::ReadWhileWriting;
+      } else if (name == "stats") {
+        PrintStats();
+        continue;
+      } else {
+        fprintf(stderr, "unknown benchmark '%s'\n", name.c_str());
+        continue;
+      }
+      if (fresh_db) {
+        if (FLAGS_use_existing_db) {
+          fprintf(stdout, "%-16s : skipped (--use_existing_db is true)\n",
+                  name.c_str());
+          continue;
+        }
+        db_.reset();
+        DestroyDB(FLAGS_db, Options());
+        Open();
+      }
+      RunBenchmark(threads, name, method);
+    }
+  }
+
+ private:
+  Options MakeOptions() const {
+    Options options;
+    options.create_if_missing = !FLAGS_use_existing_db;
+    options.write_buffer_size = FLAGS_write_buffer_size;
+    options.max_file_size = FLAGS_max_file_size;
+    options.max_background_jobs = FLAGS_max_background_jobs;
+    options.block_cache = cache_.get();
+    options.secondary_cache = secondary_cache_.get();
+    options.row_cache = row_cache_.get();
+    options.statistics = statistics_;
+    if (FLAGS_bloom_bits > 0) {
+      options.filter_policy = std::make_shared<BloomFilter>(FLAGS_bloom_bits);
+    }
+    if (strcmp(FLAGS_compression, "snappy") == 0) {
+      options.block_compress_type = kSnappyCompression;
+    } else if (strcmp(FLAGS_compression, "lz4") == 0) {
+      options.block_compress_type = kLZ4Compression;
+    } else if (strcmp(FLAGS_compression, "zstd") == 0) {
+      options.block_compress_type = kZSTDCompression;
+    }
+    return options;
+  }
+
+  void Open() {
+    DB* db = nullptr;
+    DBStatus s = DB::Open(MakeOptions(), FLAGS_db, &db);
+    if (s != Status::kSuccess) {
+      fprintf(stderr, "open %s failed: %s\n", FLAGS_db, s.message);
+      exit(1);
+    }
+    db_.reset(db);
+  }
+
+  void PrintHeader() const {
+    const double raw_mb =
+        (FLAGS_key_size + FLAGS_value_size) * static_cast<double>(num_) /
+        1048576.0;
+    fprintf(stdout, "Keys:       %d bytes each\n", FLAGS_key_size);
+    fprintf(stdout, "Values:     %d bytes each (%d bytes after compression)\n",
+            FLAGS_value_size,
+            static_cast<int32_t>(FLAGS_value_size * FLAGS_compression_ratio +
+                                 0.5));
+    fprintf(stdout, "Entries:    %lld\n", static_cast<long long>(num_));
+    fprintf(stdout, "RawSize:    %.1f MB (estimated)\n", raw_mb);
+    fprintf(stdout, "Threads:    %d\n", FLAGS_threads);
+    fprintf(stdout, "Compression:%s\n", FLAGS_compression);
+#ifndef NDEBUG
+    fprintf(stdout, "WARNING: assertions are enabled; benchmarks unnecessarily slow\n");
+#endif
+    fprintf(stdout, "------------------------------------------------\n");
+  }
+
+  void PrintStats() {
+    std::string value;
+    fprintf(stdout, "Level files:");
+    for (int32_t level = 0; level < config::kNumLevels; ++level) {
+      if (db_->GetProperty("corekv.num-files-at-level" + std::to_string(level),
+                           &value)) {
+        fprintf(stdout, " %s", value.c_str());
+      }
+    }
+    fprintf(stdout, "\n");
+    if (db_->GetProperty("corekv.stats", &value)) {
+      fprintf(stdout, "%s", value.c_str());
+    }
+  }
+
+  static void ThreadBody(Benchmark* bench, ThreadState* thread,
+                         void (Benchmark::*method)(ThreadState*)) {
+    SharedState* shared = thread->shared;
+    {
+      std::unique_lock<std::mutex> lock(shared->mu);
+      ++shared->num_initialized;
+      if (shared->num_initialized >= shared->total) {
+        shared->cv.notify_all();
+      }
+      shared->cv.wait(lock, [shared]() { return shared->start; });
+    }
+    thread->stats.Start();
+    (bench->*method)(thread);
+    thread->stats.Stop();
+    {
+      std::lock_guard<std::mutex> lock(shared->mu);
+      ++shared->num_done;
+      if (shared->num_done >= shared->total) {
+        shared->cv.notify_all();
+      }
+    }
+  }
+
+  void RunBenchmark(int32_t n, const std::string& name,
+                    void (Benchmark::*method)(ThreadState*)) {
+    SharedState shared;
+    shared.total = n;
+    std::vector<std::unique_ptr<ThreadState>> states;
+    std::vector<std::thread> threads;
+    for (int32_t i = 0; i < n; ++i) {
+      states.push_back(std::make_unique<ThreadState>(i, FLAGS_threads));
+      states.back()->shared = &shared;
+      threads.emplace_back(&Benchmark::ThreadBody, this, states.back().get(),
+                           method);
+    }
+    {
+      std::unique_lock<std::mutex> lock(shared.mu);
+      shared.cv.wait(lock, [&]() { return shared.num_initialized >= n; });
+      shared.start = true;
+      shared.cv.notify_all();
+      shared.cv.wait(lock, [&]() { return shared.num_done >= n; });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    // readwhilewriting中最后一个线程是写线程，只统计读线程
+    const int32_t reported = std::min(n, FLAGS_threads);
+    for (int32_t i = 1; i < reported; ++i) {
+      states[0]->stats.Merge(states[i]->stats);
+    }
+    states[0]->stats.Report(name);
+  }
+
+  // 当前线程负责的操作次数
+  static int64_t PerThread(int64_t total, const ThreadState* thread) {
+    return std::max<int64_t>(total / thread->thread_count, 1);
+  }
+
+  void DoWrite(ThreadState* thread, bool seq, const WriteOptions& options,
+               int64_t n) {
+    RandomGenerator gen;
+    const int64_t begin = thread->tid * n;
+    int64_t bytes = 0;
+    for (int64_t i = 0; i < n; ++i) {
+      const uint64_t k = seq ? begin + i : thread->rand.GetSimpleRandomNum() % num_;
+      const std::string key = MakeKey(k);
+      DBStatus s = db_->Put(options, key, gen.Generate(FLAGS_value_size));
+      if (s != Status::kSuccess) {
+        fprintf(stderr, "put error: %s\n", s.message);
+        exit(1);
+      }
+      bytes += key.size() + FLAGS_value_size;
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
+  void WriteSeq(ThreadState* thread) {
+    DoWrite(thread, true, WriteOptions(), PerThread(num_, thread));
+  }
+  void WriteRandom(ThreadState* thread) {
+    DoWrite(thread, false, WriteOptions(), PerThread(num_, thread));
+  }
+  void WriteSync(ThreadState* thread) {
+    WriteOptions options;
+    options.sync = true;
+    DoWrite(thread, false, options, PerThread(num_ / 100, thread));
+  }
+
+  void ReadRandom(ThreadState* thread) {
+    const int64_t n = PerThread(reads_, thread);
+    std::string value;
+    int64_t found = 0;
+    int64_t bytes = 0;
+    for (int64_t i = 0; i < n; ++i) {
+      const std::string key = MakeKey(thread->rand.GetSimpleRandomNum() % num_);
+      if (db_->Get(ReadOptions(), key, &value) == Status::kSuccess) {
+        ++found;
+        bytes += key.size() + value.size();
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+    thread->stats.AddFound(found, n);
+  }
+
+  void MultiReadRandom(ThreadState* thread) {
+    const int64_t n = PerThread(reads_, thread);
+    std::vector<std::string> keys(FLAGS_batch_size);
+    std::vector<std::string_view> key_views(FLAGS_batch_size);
+    std::vector<std::string> values;
+    int64_t found = 0;
+    int64_t bytes = 0;
+    for (int64_t i = 0; i < n; i += FLAGS_batch_size) {
+      for (int32_t j = 0; j < FLAGS_batch_size; ++j) {
+        keys[j] = MakeKey(thread->rand.GetSimpleRandomNum() % num_);
+        key_views[j] = keys[j];
+      }
+      const auto& statuses = db_->MultiGet(ReadOptions(), key_views, &values);
+      for (int32_t j = 0; j < FLAGS_batch_size; ++j) {
+        if (statuses[j] == Status::kSuccess) {
+          ++found;
+          bytes += keys[j].size() + values[j].size();
+        }
+      }
+      // 每个key算作一次操作，延迟统计的是整个batch
+      thread->stats.FinishedSingleOp(FLAGS_batch_size);
+    }
+    thread->stats.AddBytes(bytes);
+    thread->stats.AddFound(found, n);
+  }
+
+  void ReadSequential(ThreadState* thread) {
+    std::unique_ptr<Iterator> iter(db_->NewIterator(ReadOptions()));
+    const int64_t n = PerThread(reads_, thread);
+    int64_t i = 0;
+    int64_t bytes = 0;
+    for (iter->SeekToFirst(); i < n && iter->Valid(); iter->Next()) {
+      bytes += iter->key().size() + iter->value().size();
+      thread->stats.FinishedSingleOp();
+      ++i;
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
+  void ReadReverse(ThreadState* thread) {
+    std::unique_ptr<Iterator> iter(db_->NewIterator(ReadOptions()));
+    const int64_t n = PerThread(reads_, thread);
+    int64_t i = 0;
+    int64_t bytes = 0;
+    for (iter->SeekToLast(); i < n && iter->Valid(); iter->Prev()) {
+      bytes += iter->key().size() + iter->value().size();
+      thread->stats.FinishedSingleOp();
+      ++i;
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
+  void SeekRandom(ThreadState* thread) {
+    const int64_t n = PerThread(reads_, thread);
+    std::unique_ptr<Iterator> iter(db_->NewIterator(ReadOptions()));
+    int64_t found = 0;
+    int64_t bytes = 0;
+    for (int64_t i = 0; i < n; ++i) {
+      const std::string key = MakeKey(thread->rand.GetSimpleRandomNum() % num_);
+      iter->Seek(key);
+      if (iter->Valid() && iter->key() == key) {
+        ++found;
+      }
+      for (int32_t j = 0; j < FLAGS_seek_nexts && iter->Valid(); ++j) {
+        bytes += iter->key().size() + iter->value().size();
+        iter->Next();
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+    thread->stats.AddFound(found, n);
+  }
+
+  void ReadWhileWriting(ThreadState* thread) {
+    if (thread->tid < FLAGS_threads) {
+      ReadRandom(thread);
+      thread->shared->readers_done.fetch_add(1);
+      return;
+    }
+    // 写线程一直随机写入，直到所有读线程结束
+    RandomGenerator gen;
+    while (thread->shared->readers_done.load() < FLAGS_threads) {
+      const std::string key = MakeKey(thread->rand.GetSimpleRandomNum() % num_);
+      DBStatus s =
+          db_->Put(WriteOptions(), key, gen.Generate(FLAGS_value_size));
+      if (s != Status::kSuccess) {
+        fprintf(stderr, "put error: %s\n", s.message);
+        exit(1);
+      }
+    }
+  }
+
+  const int64_t num_;
+  const int64_t reads_;
+  // 要在cache_之后析构
+  std::unique_ptr<CompressedSecondaryCache> secondary_cache_;
+  std::unique_ptr<Cache<uint64_t, DataBlock>> cache_;
+  std::unique_ptr<Cache<std::string, std::string>> row_cache_;
+  std::shared_ptr<Statistics> statistics_;
+  std::unique_ptr<DB> db_;
+};
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int32_t i = 1; i < argc; ++i) {
+    double d;
+    long long n;
+    char junk;
+    if (strncmp(argv[i], "--benchmarks=", 13) == 0) {
+      FLAGS_benchmarks = argv[i] + 13;
+    } else if (strncmp(argv[i], "--db=", 5) == 0) {
+      FLAGS_db = argv[i] + 5;
+    } else if (strncmp(argv[i], "--compression=", 14) == 0) {
+      FLAGS_compression = argv[i] + 14;
+    } else if (sscanf(argv[i], "--num=%lld%c", &n, &junk) == 1) {
+      FLAGS_num = n;
+    } else if (sscanf(argv[i], "--reads=%lld%c", &n, &junk) == 1) {
+      FLAGS_reads = n;
+    } else if (sscanf(argv[i], "--threads=%lld%c", &n, &junk) == 1) {
+      FLAGS_threads = static_cast<int32_t>(std::max(n, 1LL));
+    } else if (sscanf(argv[i], "--key_size=%lld%c", &n, &junk) == 1) {
+      FLAGS_key_size = static_cast<int32_t>(n);
+    } else if (sscanf(argv[i], "--value_size=%lld%c", &n, &junk) == 1) {
+      FLAGS_value_size = static_cast<int32_t>(n);
+    } else if (sscanf(argv[i], "--compression_ratio=%lf%c", &d, &junk) == 1) {
+      FLAGS_compression_ratio = d;
+    } else if (sscanf(argv[i], "--batch_size=%lld%c", &n, &junk) == 1) {
+      FLAGS_batch_size = static_cast<int32_t>(std::max(n, 1LL));
+    } else if (sscanf(argv[i], "--seek_nexts=%lld%c", &n, &junk) == 1) {
+      FLAGS_seek_nexts = static_cast<int32_t>(n);
+    } else if (sscanf(argv[i], "--histogram=%lld%c", &n, &junk) == 1) {
+      FLAGS_histogram = n != 0;
+    } else if (sscanf(argv[i], "--use_existing_db=%lld%c", &n, &junk) == 1) {
+      FLAGS_use_existing_db = n != 0;
+    } else if (sscanf(argv[i], "--statistics=%lld%c", &n, &junk) == 1) {
+      FLAGS_statistics = n != 0;
+    } else if (sscanf(argv[i], "--write_buffer_size=%lld%c", &n, &junk) ==
+               1) {
+      FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--max_file_size=%lld%c", &n, &junk) == 1) {
+      FLAGS_max_file_size = n;
+    } else if (sscanf(argv[i], "--max_background_jobs=%lld%c", &n, &junk) ==
+               1) {
+      FLAGS_max_background_jobs = static_cast<int32_t>(n);
+    } else if (sscanf(argv[i], "--cache_size=%lld%c", &n, &junk) == 1) {
+      FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--row_cache_size=%lld%c", &n, &junk) == 1) {
+      FLAGS_row_cache_size = n;
+    } else if (sscanf(argv[i], "--secondary_cache_size=%lld%c", &n, &junk) ==
+               1) {
+      FLAGS_secondary_cache_size = n;
+    } else if (sscanf(argv[i], "--bloom_bits=%lld%c", &n, &junk) == 1) {
+      FLAGS_bloom_bits = static_cast<int32_t>(n);
+    } else if (sscanf(argv[i], "--seed=%lld%c", &n, &junk) == 1) {
+      FLAGS_seed = static_cast<uint64_t>(n);
+    } else {
+      fprintf(stderr, "invalid flag '%s'\n", argv[i]);
+      exit(1);
+    }
+  }
+  Benchmark benchmark;
+  benchmark.Run();
+  return 0;
+}
@@ -0,0 +1,561 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cache/cache.h"
+#include "db/db.h"
+#include "db/options.h"
+#include "filter/bloomfilter.h"
+#include "utils/histogram.h"
+#include "utils/random_util.h"
+#include "utils/string_util.h"
+
+/*
+ * YCSB(Yahoo! Cloud Serving Benchmark)核心workload的驱动，先load recordcount条记录，
+ * 然后按照--workloads中的顺序依次执行，每个workload执行operationcount次操作:
+ *   a  50% read  50% update            zipfian
+ *   b  95% read   5% update            zipfian
+ *   c 100% read                        zipfian
+ *   d  95% read   5% insert            latest
+ *   e  95% scan   5% insert            zipfian，scan长度在[1, max_scan_length]中均匀分布
+ *   f  50% read  50% read-modify-write zipfian
+ *
+ * key是"user"加上记录编号的hash，load按照编号的顺序写入，但是key在字节序上是打散的，
+ * 热点记录不会集中在相邻的block里；--distribution可以覆盖workload默认的分布
+ *
+ * 线上的访问大多是倾斜的，用这个工具比较不同的block cache淘汰策略:
+ *   ycsb --workloads=c --cache_policy=lru     --cache_size=67108864
+ *   ycsb --workloads=c --cache_policy=tinylfu --cache_size=67108864
+ */
+using namespace corekv;
+
+namespace {
+const char* FLAGS_workloads = "a,b,c,f,d,e";
+int64_t FLAGS_recordcount = 100000;
+int64_t FLAGS_operationcount = 100000;
+int32_t FLAGS_threads = 1;
+int32_t FLAGS_value_size = 1000;
+// 为空时使用workload默认的分布，可选zipfian/uniform/latest
+const char* FLAGS_distribution = "";
+double FLAGS_zipfian_const = 0.99;
+int32_t FLAGS_max_scan_length = 100;
+// block_cache的字节数，小于等于0时不使用
+int64_t FLAGS_cache_size = 8 * 1024 * 1024;
+// block_cache的淘汰策略，可选lru/tinylfu/clock
+const char* FLAGS_cache_policy = "lru";
+int32_t FLAGS_bloom_bits = 10;
+int64_t FLAGS_write_buffer_size = 4 * 1024 * 1024;
+int32_t FLAGS_max_background_jobs = 2;
+// 为true时跳过load，直接在已有的db上执行
+bool FLAGS_use_existing_db = false;
+bool FLAGS_histogram = false;
+uint64_t FLAGS_seed = 301;
+const char* FLAGS_db = "/tmp/corekv_ycsb";
+
+double NowMicros() {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// [0, 1)之间的均匀分布
+double NextDouble(RandomUtil* rnd) {
+  return rnd->GetSimpleRandomNum() / 2147483648.0;
+}
+
+uint64_t FNVHash64(uint64_t v) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (int32_t i = 0; i < 8; ++i) {
+    hash ^= v & 0xff;
+    hash *= 1099511628211ull;
+    v >>= 8;
+  }
+  return hash;
+}
+
+std::string MakeKey(uint64_t keynum) {
+  return "user" + std::to_string(FNVHash64(keynum));
+}
+
+/*
+ * Gray等人在"Quickly Generating Billion-Record Synthetic Databases"中的算法，
+ * 和YCSB的ZipfianGenerator相同: 返回[0, items)，越小的值概率越大，
+ * zeta在构造的时候计算一次(O(items))，之后每次生成都是O(1)；多个线程共享，
+ * 随机数由调用方提供
+ */
+class ZipfianGenerator {
+ public:
+  ZipfianGenerator(uint64_t items, double theta)
+      : items_(std::max<uint64_t>(items, 1)), theta_(theta) {
+    double zeta2 = 0;
+    for (uint64_t i = 1; i <= 2 && i <= items_; ++i) {
+      zeta2 += 1 / pow(i, theta_);
+    }
+    zetan_ = 0;
+    for (uint64_t i = 1; i <= items_; ++i) {
+      zetan_ += 1 / pow(i, theta_);
+    }
+    alpha_ = 1 / (1 - theta_);
+    eta_ = (1 - pow(2.0 / items_, 1 - theta_)) / (1 - zeta2 / zetan_);
+  }
+  uint64_t Next(RandomUtil* rnd) const {
+    const double u = NextDouble(rnd);
+    const double uz = u * zetan_;
+    if (uz < 1) {
+      return 0;
+    }
+    if (uz < 1 + pow(0.5, theta_)) {
+      return std::min<uint64_t>(1, items_ - 1);
+    }
+    const uint64_t ret =
+        static_cast<uint64_t>(items_ * pow(eta_ * u - eta_ + 1, alpha_));
+    return std::min(ret, items_ - 1);
+  }
+
+ private:
+  const uint64_t items_;
+  const double theta_;
+  double zetan_;
+  double alpha_;
+  double eta_;
+};
+
+enum class Distribution { kUniform, kZipfian, kLatest };
+enum OpType { kRead = 0, kUpdate, kInsert, kScan, kReadModifyWrite, kNumOpTypes };
+const char* const kOpNames[kNumOpTypes] = {"READ", "UPDATE", "INSERT", "SCAN",
+                                           "READ-MODIFY-WRITE"};
+
+struct Workload {
+  const char* name;
+  // 各种操作的比例，和为1
+  double proportions[kNumOpTypes];
+  Distribution distribution;
+};
+
+// 顺序和OpType一致: read update insert scan rmw
+const Workload kWorkloads[] = {
+    {"a", {0.5, 0.5, 0, 0, 0}, Distribution::kZipfian},
+    {"b", {0.95, 0.05, 0, 0, 0}, Distribution::kZipfian},
+    {"c", {1, 0, 0, 0, 0}, Distribution::kZipfian},
+    {"d", {0.95, 0, 0.05, 0, 0}, Distribution::kLatest},
+    {"e", {0, 0, 0.05, 0.95, 0}, Distribution::kZipfian},
+    {"f", {0.5, 0, 0, 0, 0.5}, Distribution::kZipfian},
+};
+
+// 统计block cache的命中率，其余的调用原样转发
+class CountingCache final : public Cache<uint64_t, DataBlock> {
+ public:
+  explicit CountingCache(std::unique_ptr<Cache<uint64_t, DataBlock>> base)
+      : base_(std::move(base)) {}
+  const char* Name() const override { return base_->Name(); }
+  void Insert(const uint64_t& key, DataBlock* value, size_t charge,
+              uint32_t ttl) override {
+    base_->Insert(key, value, charge, ttl);
+  }
+  CacheNode<uint64_t, DataBlock>* InsertAndRef(const uint64_t& key,
+                                               DataBlock* value, size_t charge,
+                                               uint32_t ttl) override {
+    return base_->InsertAndRef(key, value, charge, ttl);
+  }
+  CacheNode<uint64_t, DataBlock>* Get(const uint64_t& key) override {
+    auto* node = base_->Get(key);
+    (node != nullptr ? hits_ : misses_).fetch_add(1, std::memory_order_relaxed);
+    return node;
+  }
+  void Release(CacheNode<uint64_t, DataBlock>* node) override {
+    base_->Release(node);
+  }
+  void Prune() override { base_->Prune(); }
+  void Erase(const uint64_t& key) override { base_->Erase(key); }
+  size_t GetUsage() const override { return base_->GetUsage(); }
+  size_t GetPinnedUsage() const override { return base_->GetPinnedUsage(); }
+  void ApplyToAllKeys(
+      const std::function<void(const uint64_t& key)>& fn) const override {
+    base_->ApplyToAllKeys(fn);
+  }
+  uint64_t NewId() override { return base_->NewId(); }
+  void RegistCleanHandle(std::function<void(const uint64_t& key,
+                                            DataBlock* value)>
+                             destructor) override {
+    base_->RegistCleanHandle(std::move(destructor));
+  }
+
+  void ResetCounters() {
+    hits_.store(0, std::memory_order_relaxed);
+    misses_.store(0, std::memory_order_relaxed);
+  }
+  uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+  uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+ private:
+  std::unique_ptr<Cache<uint64_t, DataBlock>> base_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+// 每个线程各自统计，结束之后合并
+struct OpStats {
+  Histogram hist[kNumOpTypes];
+  int64_t failed[kNumOpTypes] = {0};
+
+  void Merge(const OpStats& other) {
+    for (int32_t i = 0; i < kNumOpTypes; ++i) {
+      hist[i].Merge(other.hist[i]);
+      failed[i] += other.failed[i];
+    }
+  }
+};
+
+class Driver {
+ public:
+  Driver()
+      : value_(FLAGS_value_size, 'v'),
+        zipfian_(FLAGS_recordcount, FLAGS_zipfian_const),
+        inserted_(FLAGS_recordcount) {
+    if (FLAGS_cache_size > 0) {
+      std::unique_ptr<Cache<uint64_t, DataBlock>> base;
+      if (strcmp(FLAGS_cache_policy, "tinylfu") == 0) {
+        base = std::make_unique<
+            ShardCache<uint64_t, DataBlock, WTinyLfuCachePolicy>>(
+            FLAGS_cache_size);
+      } else if (strcmp(FLAGS_cache_policy, "clock") == 0) {
+        base = std::make_unique<
+            ShardCache<uint64_t, DataBlock, ClockCachePolicy>>(
+            FLAGS_cache_size);
+      } else {
+        base = std::make_unique<ShardCache<uint64_t, DataBlock>>(
+            FLAGS_cache_size);
+      }
+      cache_ = std::make_unique<CountingCache>(std::move(base));
+    }
+    if (!FLAGS_use_existing_db) {
+      DestroyDB(FLAGS_db, Options());
+    }
+  }
+  ~Driver() { db_.reset(); }
+
+  void Run() {
+    PrintHeader();
+    Open();
+    if (!FLAGS_use_existing_db) {
+      RunPhase("load", nullptr, FLAGS_recordcount);
+    }
+    std::vector<std::string> names;
+    string_util::Split(FLAGS_workloads, ',', names);
+    for (const auto& name : names) {
+      const Workload* workload = nullptr;
+      for (const auto& w : kWorkloads) {
+        if (name == w.name) {
+          workload = &w;
+        }
+      }
+      if (workload == nullptr) {
+        if (!name.empty()) {
+          fprintf(stderr, "unknown workload '%s'\n", name.c_str());
+        }
+        continue;
+      }
+      RunPhase("workload" + name, workload, FLAGS_operationcount);
+    }
+  }
+
+ private:
+  Options MakeOptions() const {
+    Options options;
+    options.create_if_missing = true;
+    options.write_buffer_size = FLAGS_write_buffer_size;
+    options.max_background_jobs = FLAGS_max_background_jobs;
+    options.block_cache = cache_.get();
+    if (FLAGS_bloom_bits > 0) {
+      options.filter_policy = std::make_shared<BloomFilter>(FLAGS_bloom_bits);
+    }
+    return options;
+  }
+
+  void Open() {
+    DB* db = nullptr;
+    DBStatus s = DB::Open(MakeOptions(), FLAGS_db, &db);
+    if (s != Status::kSuccess) {
+      fprintf(stderr, "open %s failed: %s\n", FLAGS_db, s.message);
+      exit(1);
+    }
+    db_.reset(db);
+  }
+
+  void PrintHeader() const {
+    fprintf(stdout, "Records:      %lld\n",
+            static_cast<long long>(FLAGS_recordcount));
+    fprintf(stdout, "Operations:   %lld per workload\n",
+            static_cast<long long>(FLAGS_operationcount));
+    fprintf(stdout, "Values:       %d bytes each\n", FLAGS_value_size);
+    fprintf(stdout, "Threads:      %d\n", FLAGS_threads);
+    fprintf(stdout, "Distribution: %s (zipfian constant %.2f)\n",
+            FLAGS_distribution[0] != '\0' ? FLAGS_distribution : "default",
+            FLAGS_zipfian_const);
+    fprintf(stdout, "BlockCache:   %lld bytes %s\n",
+            static_cast<long long>(FLAGS_cache_size), FLAGS_cache_policy);
+#ifndef NDEBUG
+    fprintf(stdout, "WARNING: assertions are enabled; benchmarks unnecessarily slow\n");
+#endif
+    fprintf(stdout, "------------------------------------------------\n");
+  }
+
+  Distribution ChooseDistribution(const Workload* workload) const {
+    if (strcmp(FLAGS_distribution, "uniform") == 0) {
+      return Distribution::kUniform;
+    } else if (strcmp(FLAGS_distribution, "zipfian") == 0) {
+      return Distribution::kZipfian;
+    } else if (strcmp(FLAGS_distribution, "latest") == 0) {
+      return Distribution::kLatest;
+    }
+    return workload->distribution;
+  }
+
+  // 选择一条已经写入的记录
+  uint64_t NextKeyNum(Distribution distribution, RandomUtil* rnd) const {
+    const uint64_t inserted = inserted_.load(std::memory_order_acquire);
+    switch (distribution) {
+      case Distribution::kUniform:
+        return rnd->GetSimpleRandomNum() % inserted;
+      case Distribution::kZipfian:
+        return zipfian_.Next(rnd) % inserted;
+      case Distribution::kLatest:
+        // 越新插入的记录越热，zipfian只按照recordcount初始化，
+        // 运行过程中新插入的记录不会重新计算zeta
+        return inserted - 1 - zipfian_.Next(rnd) % inserted;
+    }
+    return 0;
+  }
+
+  OpType ChooseOp(const Workload* workload, RandomUtil* rnd) const {
+    double r = NextDouble(rnd);
+    for (int32_t i = 0; i < kNumOpTypes; ++i) {
+      if (r < workload->proportions[i]) {
+        return static_cast<OpType>(i);
+      }
+      r -= workload->proportions[i];
+    }
+    return kRead;
+  }
+
+  bool DoOp(OpType op, Distribution distribution, RandomUtil* rnd) {
+    std::string value;
+    switch (op) {
+      case kRead:
+        return db_->Get(ReadOptions(), MakeKey(NextKeyNum(distribution, rnd)),
+                        &value) == Status::kSuccess;
+      case kUpdate:
+        return db_->Put(WriteOptions(), MakeKey(NextKeyNum(distribution, rnd)),
+                        value_) == Status::kSuccess;
+      case kInsert: {
+        // 先写入再发布编号，读线程只会选到已经写完的记录
+        const uint64_t keynum = next_insert_.fetch_add(1);
+        const bool ok = db_->Put(WriteOptions(), MakeKey(keynum), value_) ==
+                        Status::kSuccess;
+        PublishInsert(keynum);
+        return ok;
+      }
+      case kScan: {
+        const int32_t len =
+            1 + rnd->GetSimpleRandomNum() % std::max(FLAGS_max_scan_length, 1);
+        std::unique_ptr<Iterator> iter(db_->NewIterator(ReadOptions()));
+        int32_t i = 0;
+        for (iter->Seek(MakeKey(NextKeyNum(distribution, rnd)));
+             i < len && iter->Valid(); iter->Next()) {
+          ++i;
+        }
+        return iter->status() == Status::kSuccess;
+      }
+      case kReadModifyWrite: {
+        const std::string key = MakeKey(NextKeyNum(distribution, rnd));
+        if (db_->Get(ReadOptions(), key, &value) != Status::kSuccess) {
+          return false;
+        }
+        return db_->Put(WriteOptions(), key, value_) == Status::kSuccess;
+      }
+      default:
+        return false;
+    }
+  }
+
+  // 插入可能乱序完成，inserted_只推进到连续写完的最大编号
+  void PublishInsert(uint64_t keynum) {
+    std::lock_guard<std::mutex> lock(insert_mu_);
+    pending_inserts_.push_back(keynum);
+    uint64_t inserted = inserted_.load(std::memory_order_relaxed);
+    bool advanced = true;
+    while (advanced) {
+      advanced = false;
+      auto iter = std::find(pending_inserts_.begin(), pending_inserts_.end(),
+                            inserted);
+      if (iter != pending_inserts_.end()) {
+        pending_inserts_.erase(iter);
+        ++inserted;
+        advanced = true;
+      }
+    }
+    inserted_.store(inserted, std::memory_order_release);
+  }
+
+  void Load(int32_t tid, int64_t n, OpStats* stats) {
+    // load阶段按照编号平分给各个线程
+    const int64_t begin = tid * n;
+    const int64_t end =
+        tid == FLAGS_threads - 1 ? FLAGS_recordcount : begin + n;
+    for (int64_t keynum = begin; keynum < end; ++keynum) {
+      const double start = NowMicros();
+      if (db_->Put(WriteOptions(), MakeKey(keynum), value_) !=
+          Status::kSuccess) {
+        ++stats->failed[kInsert];
+      }
+      stats->hist[kInsert].Add(NowMicros() - start);
+    }
+  }
+
+  void Execute(const Workload* workload, int32_t tid, int64_t n,
+               OpStats* stats) {
+    RandomUtil rnd(FLAGS_seed + 1000 * tid);
+    const Distribution distribution = ChooseDistribution(workload);
+    for (int64_t i = 0; i < n; ++i) {
+      const OpType op = ChooseOp(workload, &rnd);
+      const double start = NowMicros();
+      if (!DoOp(op, distribution, &rnd)) {
+        ++stats->failed[op];
+      }
+      stats->hist[op].Add(NowMicros() - start);
+    }
+  }
+
+  void RunPhase(const std::string& name, const Workload* workload,
+                int64_t total) {
+    const int64_t per_thread = std::max<int64_t>(total / FLAGS_threads, 1);
+    std::vector<OpStats> stats(FLAGS_threads);
+    std::vector<std::thread> threads;
+    if (cache_) {
+      cache_->ResetCounters();
+    }
+    const double start = NowMicros();
+    for (int32_t tid = 0; tid < FLAGS_threads; ++tid) {
+      threads.emplace_back([this, workload, tid, per_thread, &stats]() {
+        if (workload == nullptr) {
+          Load(tid, per_thread, &stats[tid]);
+        } else {
+          Execute(workload, tid, per_thread, &stats[tid]);
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    const double elapsed = (NowMicros() - start) * 1e-6;
+    for (int32_t tid = 1; tid < FLAGS_threads; ++tid) {
+      stats[0].Merge(stats[tid]);
+    }
+    Report(name, stats[0], elapsed);
+  }
+
+  void Report(const std::string& name, const OpStats& stats,
+              double elapsed) const {
+    uint64_t done = 0;
+    for (const auto& hist : stats.hist) {
+      done += hist.Count();
+    }
+    fprintf(stdout, "%-12s : %10.0f ops/sec %8.3f seconds", name.c_str(),
+            elapsed > 0 ? done / elapsed : 0.0, elapsed);
+    if (cache_ && cache_->hits() + cache_->misses() > 0) {
+      fprintf(stdout, "; block cache hit rate %.2f%%",
+              100.0 * cache_->hits() / (cache_->hits() + cache_->misses()));
+    }
+    fprintf(stdout, "\n");
+    for (int32_t i = 0; i < kNumOpTypes; ++i) {
+      const Histogram& hist = stats.hist[i];
+      if (hist.Count() == 0) {
+        continue;
+      }
+      fprintf(stdout,
+              "  %-18s ops: %llu failed: %lld latency(us) avg: %.2f P50: %.2f "
+              "P95: %.2f P99: %.2f P99.9: %.2f max: %.2f\n",
+              kOpNames[i], static_cast<unsigned long long>(hist.Count()),
+              static_cast<long long>(stats.failed[i]), hist.Average(),
+              hist.Percentile(50), hist.Percentile(95), hist.Percentile(99),
+              hist.Percentile(99.9), hist.Max());
+      if (FLAGS_histogram) {
+        fprintf(stdout, "%s\n", hist.ToString().c_str());
+      }
+    }
+    fflush(stdout);
+  }
+
+  const std::string value_;
+  const ZipfianGenerator zipfian_;
+  std::unique_ptr<CountingCache> cache_;
+  std::unique_ptr<DB> db_;
+  // 已经写完的记录编号是[0, inserted_)
+  std::atomic<uint64_t> inserted_;
+  // 下一个insert使用的编号
+  std::atomic<uint64_t> next_insert_{static_cast<uint64_t>(FLAGS_recordcount)};
+  std::mutex insert_mu_;
+  std::vector<uint64_t> pending_inserts_;
+};
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int32_t i = 1; i < argc; ++i) {
+    double d;
+    long long n;
+    char junk;
+    if (strncmp(argv[i], "--workloads=", 12) == 0) {
+      FLAGS_workloads = argv[i] + 12;
+    } else if (strncmp(argv[i], "--db=", 5) == 0) {
+      FLAGS_db = argv[i] + 5;
+    } else if (strncmp(argv[i], "--distribution=", 15) == 0) {
+      FLAGS_distribution = argv[i] + 15;
+    } else if (strncmp(argv[i], "--cache_policy=", 15) == 0) {
+      FLAGS_cache_policy = argv[i] + 15;
+    } else if (sscanf(argv[i], "--recordcount=%lld%c", &n, &junk) == 1) {
+      FLAGS_recordcount = std::max(n, 1LL);
+    } else if (sscanf(argv[i], "--operationcount=%lld%c", &n, &junk) == 1) {
+      FLAGS_operationcount = n;
+    } else if (sscanf(argv[i], "--threads=%lld%c", &n, &junk) == 1) {
+      FLAGS_threads = static_cast<int32_t>(std::max(n, 1LL));
+    } else if (sscanf(argv[i], "--value_size=%lld%c", &n, &junk) == 1) {
+      FLAGS_value_size = static_cast<int32_t>(n);
+    } else if (sscanf(argv[i], "--zipfian_const=%lf%c", &d, &junk) == 1) {
+      FLAGS_zipfian_const = d;
+    } else if (sscanf(argv[i], "--max_scan_length=%lld%c", &n, &junk) == 1) {
+      FLAGS_max_scan_length = static_cast<int32_t>(n);
+    } else if (sscanf(argv[i], "--cache_size=%lld%c", &n, &junk) == 1) {
+      FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--bloom_bits=%lld%c", &n, &junk) == 1) {
+      FLAGS_bloom_bits = static_cast<int32_t>(n);
+    } else if (sscanf(argv[i], "--write_buffer_size=%lld%c", &n, &junk) ==
+               1) {
+      FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--max_background_jobs=%lld%c", &n, &junk) ==
+               1) {
+      FLAGS_max_background_jobs = static_cast<int32_t>(n);
+    } else if (sscanf(argv[i], "--use_existing_db=%lld%c", &n, &junk) == 1) {
+      FLAGS_use_existing_db = n != 0;
+    } else if (sscanf(argv[i], "--histogram=%lld%c", &n, &junk) == 1) {
+      FLAGS_histogram = n != 0;
+    } else if (sscanf(argv[i], "--seed=%lld%c", &n, &junk) == 1) {
+      FLAGS_seed = static_cast<uint64_t>(n);
+    } else {
+      fprintf(stderr, "invalid flag '%s'\n", argv[i]);
+      exit(1);
+    }
+  }
+  Driver driver;
+  driver.Run();
+  return 0;
+}
@@ -100,8 +100,56 @@ int VarintLength(uint64_t v) {
   return len;
 }
 
+namespace {
+constexpr uint64_t kContinuationBits = 0x8080808080808080ull;
+
+// 按照小端序读入8个字节，第一个字节在最低位
+inline uint64_t LoadWord(const char* p) {
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  return word;
+}
+
+// 剩余数据不少于8个字节的时候一次读入8个字节，通过最高位找到varint的结尾，
+// 再把每个字节的低7位拼接起来，不需要逐字节循环和分支；
+// varint超过8个字节的时候返回nullptr，由调用方逐字节解析
+inline const char* DecodeVarintWord(const char* p, uint64_t* value) {
+  uint64_t word = LoadWord(p);
+  const uint64_t stop_bits = ~word & kContinuationBits;
+  if (stop_bits == 0) {
+    return nullptr;
+  }
+  // 最后一个字节的最高位所在的bit，varint的长度为(bit + 1) / 8
+  const int last_bit = __builtin_ctzll(stop_bits);
+  const int length = (last_bit + 1) / 8;
+  if (length < 8) {
+    word &= (1ull << (length * 8)) - 1;
+  }
+  word &= ~kContinuationBits;
+  // 7位一组两两合并: 8个7位 -> 4个14位 -> 2个28位 -> 56位
+  word = (word & 0x007f007f007f007full) | ((word & 0x7f007f007f007f00ull) >> 1);
+  word = (word & 0x00003fff00003fffull) | ((word & 0x3fff00003fff0000ull) >> 2);
+  word = (word & 0x000000000fffffffull) | ((word & 0x0fffffff00000000ull) >> 4);
+  *value = word;
+  return p + length;
+}
+}  // namespace
+
 const char* GetVarint32PtrFallback(const char* p, const char* limit,
                                    uint32_t* value) {
+  if (limit - p >= static_cast<ptrdiff_t>(sizeof(uint64_t))) {
+    uint64_t result;
+    const char* q = DecodeVarintWord(p, &result);
+    // 和逐字节解析一致，varint32最多5个字节，第5个字节超出32位的部分被丢弃
+    if (q != nullptr && q - p <= 5) {
+      *value = static_cast<uint32_t>(result);
+      return q;
+    }
+    return nullptr;
+  }
   uint32_t result = 0;
   for (uint32_t shift = 0; shift <= 28 && p < limit; shift += 7) {
     uint32_t byte = *(reinterpret_cast<const unsigned char*>(p));
@@ -132,7 +180,22 @@ bool GetVarint32(std::string_view* input, uint32_t* value) {
 
 const char* GetVarint64Ptr(const char* p, const char* limit, uint64_t* value) {
   uint64_t result = 0;
-  for (uint32_t shift = 0; shift <= 63 && p < limit; shift += 7) {
+  uint32_t shift = 0;
+  if (limit - p >= static_cast<ptrdiff_t>(sizeof(uint64_t))) {
+    const char* q = DecodeVarintWord(p, &result);
+    if (q != nullptr) {
+      *value = result;
+      return q;
+    }
+    // 超过8个字节的varint，前8个字节都是完整的7位，从第9个字节继续逐字节解析
+    const uint64_t word = LoadWord(p);
+    for (int i = 0; i < 8; ++i) {
+      result |= ((word >> (i * 8)) & 127) << (i * 7);
+    }
+    p += 8;
+    shift = 56;
+  }
+  for (; shift <= 63 && p < limit; shift += 7) {
     uint64_t byte = *(reinterpret_cast<const unsigned char*>(p));
     p++;
     if (byte & 128) {
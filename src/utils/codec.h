@@ -46,7 +46,7 @@ char* EncodeVarint64(char* dst, uint64_t value);
 
 void EncodeFixed32(char* dst, uint32_t value);
 
-inline void EncodeFixed64(char* dst, uint64_t value);
+void EncodeFixed64(char* dst, uint64_t value);
 
 // Lower-level versions of Get... that read directly from a character buffer
 // without any bounds checking.
@@ -1,5 +1,12 @@
 #include "crc32.h"
 
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#endif
+
 #include "codec.h"
 
 namespace corekv {
@@ -253,34 +260,139 @@ constexpr inline const uint8_t* RoundUp(const uint8_t* pointer) {
 
 }  // namespace
 
-static uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size) {
-#if HAVE_CRC32C
-  return ::crc32c::Extend(crc, reinterpret_cast<const uint8_t*>(buf), size);
+#if defined(__x86_64__) || defined(__aarch64__)
+#define COREKV_HAVE_HARDWARE_CRC32C 1
+#endif
+
+#ifdef COREKV_HAVE_HARDWARE_CRC32C
+namespace {
+// 3路交错计算时每一路每轮处理的字节数，crc32指令的延迟是3个周期、吞吐是每周期1条，
+// 三条互不依赖的流水线才能把吞吐跑满
+constexpr size_t kStreamBytes = 256;
+
+// 把crc状态后面追加kStreamBytes个0字节的线性变换，按照每个字节查表
+struct ShiftTable {
+  uint32_t table[4][256];
+
+  ShiftTable() {
+    uint32_t bits[32];
+    for (int32_t i = 0; i < 32; ++i) {
+      uint32_t l = 1u << i;
+      for (size_t j = 0; j < kStreamBytes; ++j) {
+        l = kByteExtensionTable[l & 0xff] ^ (l >> 8);
+      }
+      bits[i] = l;
+    }
+    for (int32_t k = 0; k < 4; ++k) {
+      for (uint32_t v = 0; v < 256; ++v) {
+        uint32_t result = 0;
+        for (int32_t j = 0; j < 8; ++j) {
+          if (v & (1u << j)) {
+            result ^= bits[k * 8 + j];
+          }
+        }
+        table[k][v] = result;
+      }
+    }
+  }
+
+  uint32_t Shift(uint32_t crc) const {
+    return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^
+           table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+  }
+};
+
+const ShiftTable& GetShiftTable() {
+  static const ShiftTable shift_table;
+  return shift_table;
+}
+}  // namespace
+
+#if defined(__x86_64__)
+#define COREKV_CRC32C_TARGET __attribute__((target("sse4.2")))
+#define COREKV_CRC32C_U8(crc, v) _mm_crc32_u8(crc, v)
+#define COREKV_CRC32C_U64(crc, v) \
+  static_cast<uint32_t>(_mm_crc32_u64(crc, v))
 #else
-  // Silence compiler warnings about unused arguments.
-  (void)crc;
-  (void)buf;
-  (void)size;
-  return 0;
-#endif  // HAVE_CRC32C
+#define COREKV_CRC32C_TARGET __attribute__((target("+crc")))
+#define COREKV_CRC32C_U8(crc, v) __crc32cb(crc, v)
+#define COREKV_CRC32C_U64(crc, v) __crc32cd(crc, v)
+#endif
+
+// SSE4.2和ARMv8的crc32c指令，和查表实现一样不包含前后的取反
+COREKV_CRC32C_TARGET static uint32_t HardwareExtend(uint32_t crc,
+                                                    const char* buf,
+                                                    size_t size) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+  const uint8_t* e = p + size;
+  uint32_t l = crc ^ kCRC32Xor;
+  // 数据分成相邻的三段同时计算，后两段从0开始，
+  // 最后把前面的结果追加后一段长度的0字节之后异或进来
+  if (e - p >= static_cast<ptrdiff_t>(3 * kStreamBytes)) {
+    const ShiftTable& shift_table = GetShiftTable();
+    while (e - p >= static_cast<ptrdiff_t>(3 * kStreamBytes)) {
+      uint32_t crc0 = l;
+      uint32_t crc1 = 0;
+      uint32_t crc2 = 0;
+      for (size_t i = 0; i < kStreamBytes; i += 8) {
+        crc0 = COREKV_CRC32C_U64(crc0, DecodeFixed64(
+                                           reinterpret_cast<const char*>(p + i)));
+        crc1 = COREKV_CRC32C_U64(
+            crc1, DecodeFixed64(
+                      reinterpret_cast<const char*>(p + kStreamBytes + i)));
+        crc2 = COREKV_CRC32C_U64(
+            crc2, DecodeFixed64(
+                      reinterpret_cast<const char*>(p + 2 * kStreamBytes + i)));
+      }
+      l = shift_table.Shift(shift_table.Shift(crc0) ^ crc1) ^ crc2;
+      p += 3 * kStreamBytes;
+    }
+  }
+  while (e - p >= 8) {
+    l = COREKV_CRC32C_U64(l, DecodeFixed64(reinterpret_cast<const char*>(p)));
+    p += 8;
+  }
+  while (p != e) {
+    l = COREKV_CRC32C_U8(l, *p++);
+  }
+  return l ^ kCRC32Xor;
 }
-// Determine if the CPU running this program can accelerate the CRC32C
-// calculation.
-static bool CanAccelerateCRC32C() {
-  // port::AcceleretedCRC32C returns zero when unable to accelerate.
+#undef COREKV_CRC32C_U64
+#undef COREKV_CRC32C_U8
+#undef COREKV_CRC32C_TARGET
+#endif  // COREKV_HAVE_HARDWARE_CRC32C
+
+static uint32_t PortableExtend(uint32_t crc, const char* data, size_t n);
+
+using ExtendFunction = uint32_t (*)(uint32_t, const char*, size_t);
+
+// 运行时检查CPU是否支持crc32c指令，并用一个已知的结果校验一遍
+static ExtendFunction ChooseExtend() {
+#ifdef COREKV_HAVE_HARDWARE_CRC32C
+#if defined(__x86_64__)
+  const bool supported = __builtin_cpu_supports("sse4.2");
+#elif defined(HWCAP_CRC32)
+  const bool supported = (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+  const bool supported = false;
+#endif
   static const char kTestCRCBuffer[] = "TestCRCBuffer";
-  static const char kBufSize = sizeof(kTestCRCBuffer) - 1;
+  static const size_t kBufSize = sizeof(kTestCRCBuffer) - 1;
   static const uint32_t kTestCRCValue = 0xdcbc59fa;
-
-  return AcceleratedCRC32C(0, kTestCRCBuffer, kBufSize) == kTestCRCValue;
+  if (supported &&
+      HardwareExtend(0, kTestCRCBuffer, kBufSize) == kTestCRCValue) {
+    return HardwareExtend;
+  }
+#endif
+  return PortableExtend;
 }
 
 uint32_t Extend(uint32_t crc, const char* data, size_t n) {
-  static bool accelerate = CanAccelerateCRC32C();
-  if (accelerate) {
-    return AcceleratedCRC32C(crc, data, n);
-  }
+  static const ExtendFunction extend = ChooseExtend();
+  return extend(crc, data, n);
+}
 
+static uint32_t PortableExtend(uint32_t crc, const char* data, size_t n) {
   const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
   const uint8_t* e = p + n;
   uint32_t l = crc ^ kCRC32Xor;
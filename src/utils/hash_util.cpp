@@ -1,8 +1,76 @@
 #include "hash_util.h"
 
+#include <string.h>
+
 #include "util.h"
 namespace corekv {
 namespace hash_util {
+namespace {
+constexpr uint64_t kSecret[4] = {0xa0761d6478bd642full, 0xe7037ed1a0b428dbull,
+                                 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull};
+
+inline uint64_t Read64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t Read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// 1到3个字节
+inline uint64_t Read3(const uint8_t *p, size_t k) {
+  return (static_cast<uint64_t>(p[0]) << 16) |
+         (static_cast<uint64_t>(p[k >> 1]) << 8) | p[k - 1];
+}
+}  // namespace
+
+uint64_t Hash64(const char *data, size_t len, uint64_t seed) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+  seed ^= Mix128(seed ^ kSecret[0], kSecret[1]);
+  uint64_t a, b;
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (Read32(p) << 32) | Read32(p + ((len >> 3) << 2));
+      b = (Read32(p + len - 4) << 32) | Read32(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = Read3(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = Mix128(Read64(p) ^ kSecret[1], Read64(p + 8) ^ seed);
+        see1 = Mix128(Read64(p + 16) ^ kSecret[2], Read64(p + 24) ^ see1);
+        see2 = Mix128(Read64(p + 32) ^ kSecret[3], Read64(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = Mix128(Read64(p) ^ kSecret[1], Read64(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = Read64(p + i - 16);
+    b = Read64(p + i - 8);
+  }
+  a ^= kSecret[1];
+  b ^= seed;
+  const __uint128_t r = static_cast<__uint128_t>(a) * b;
+  a = static_cast<uint64_t>(r);
+  b = static_cast<uint64_t>(r >> 64);
+  return Mix128(a ^ kSecret[0] ^ len, b ^ kSecret[1]);
+}
+
 uint32_t SimMurMurHash(const char *data, uint32_t len) {
   if (len <= 0 || !data) {
     return 0;
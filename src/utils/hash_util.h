@@ -1,8 +1,39 @@
 #pragma once
 #include <stdint.h>
+
+#include <cstddef>
+#include <functional>
+#include <string_view>
+#include <type_traits>
 namespace corekv {
 namespace hash_util {
 uint32_t SimMurMurHash(const char *data, uint32_t len);
-}  // namespace hash_utl
+// 64位的wyhash，长key每次用三条互不依赖的乘法链处理48字节，
+// filter的构建和查询、缓存的分片和哈希表都使用它
+uint64_t Hash64(const char *data, size_t len, uint64_t seed = 0);
+
+// 两个64位数相乘，高64位和低64位异或在一起
+inline uint64_t Mix128(uint64_t a, uint64_t b) {
+  const __uint128_t r = static_cast<__uint128_t>(a) * b;
+  return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
+// 整数key直接打散，字符串按照内容计算，其他类型退化成打散之后的std::hash
+template <typename KeyType>
+inline uint64_t HashKey(const KeyType &key) {
+  if constexpr (std::is_integral_v<KeyType>) {
+    return Mix128(static_cast<uint64_t>(key) ^ 0xa0761d6478bd642full,
+                  0xe7037ed1a0b428dbull);
+  } else if constexpr (std::is_convertible_v<const KeyType &,
+                                             std::string_view>) {
+    const std::string_view view = key;
+    return Hash64(view.data(), view.size());
+  } else {
+    return Mix128(static_cast<uint64_t>(std::hash<KeyType>{}(key)) ^
+                      0xa0761d6478bd642full,
+                  0xe7037ed1a0b428dbull);
+  }
+}
+}  // namespace hash_util
 
 }  // namespace corekv
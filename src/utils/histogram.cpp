@@ -0,0 +1,128 @@
+#include "histogram.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+namespace corekv {
+namespace {
+// 桶的上界(不包含)，按照大约1.1倍递增，最后一个桶没有上界
+const std::vector<double>& BucketLimits() {
+  static const std::vector<double> limits = []() {
+    std::vector<double> v;
+    for (double limit = 1; limit < 1e13;
+         limit = std::max(limit + 1, floor(limit * 1.1))) {
+      v.push_back(limit);
+    }
+    v.push_back(1e200);
+    return v;
+  }();
+  return limits;
+}
+}  // namespace
+
+Histogram::Histogram() { Clear(); }
+
+void Histogram::Clear() {
+  min_ = BucketLimits().back();
+  max_ = 0;
+  count_ = 0;
+  sum_ = 0;
+  sum_squares_ = 0;
+  buckets_.assign(BucketLimits().size(), 0);
+}
+
+void Histogram::Add(double value) {
+  const auto& limits = BucketLimits();
+  const size_t b =
+      std::upper_bound(limits.begin(), limits.end() - 1, value) -
+      limits.begin();
+  ++buckets_[b];
+  min_ = std::min(min_, value);
+  max_ = std::max(max_, value);
+  ++count_;
+  sum_ += value;
+  sum_squares_ += value * value;
+}
+
+void Histogram::Merge(const Histogram& other) {
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+  count_ += other.count_;
+  sum_ += other.sum_;
+  sum_squares_ += other.sum_squares_;
+  for (size_t b = 0; b < buckets_.size(); ++b) {
+    buckets_[b] += other.buckets_[b];
+  }
+}
+
+double Histogram::Average() const {
+  return count_ == 0 ? 0 : sum_ / count_;
+}
+
+double Histogram::StandardDeviation() const {
+  if (count_ == 0) {
+    return 0;
+  }
+  const double variance =
+      (sum_squares_ * count_ - sum_ * sum_) / (double(count_) * count_);
+  return sqrt(std::max(variance, 0.0));
+}
+
+double Histogram::Percentile(double p) const {
+  const auto& limits = BucketLimits();
+  const double threshold = count_ * (p / 100.0);
+  double cumulative = 0;
+  for (size_t b = 0; b < buckets_.size(); ++b) {
+    cumulative += buckets_[b];
+    if (cumulative >= threshold && buckets_[b] > 0) {
+      // 在桶内按照个数线性插值，结果限制在观察到的[min, max]之内
+      const double left = (b == 0) ? 0 : limits[b - 1];
+      const double right = limits[b];
+      const double left_count = cumulative - buckets_[b];
+      double r = left + (right - left) * (threshold - left_count) / buckets_[b];
+      return std::min(std::max(r, Min()), max_);
+    }
+  }
+  return max_;
+}
+
+std::string Histogram::ToString() const {
+  std::string r;
+  char buf[200];
+  snprintf(buf, sizeof(buf), "Count: %llu  Average: %.4f  StdDev: %.2f\n",
+           static_cast<unsigned long long>(count_), Average(),
+           StandardDeviation());
+  r.append(buf);
+  snprintf(buf, sizeof(buf), "Min: %.4f  Median: %.4f  Max: %.4f\n", Min(),
+           Median(), max_);
+  r.append(buf);
+  snprintf(buf, sizeof(buf),
+           "Percentiles: P50: %.2f P95: %.2f P99: %.2f P99.9: %.2f\n",
+           Percentile(50), Percentile(95), Percentile(99), Percentile(99.9));
+  r.append(buf);
+  r.append("------------------------------------------------------\n");
+  if (count_ == 0) {
+    return r;
+  }
+  const auto& limits = BucketLimits();
+  const double mult = 100.0 / count_;
+  double sum = 0;
+  for (size_t b = 0; b < buckets_.size(); ++b) {
+    if (buckets_[b] == 0) {
+      continue;
+    }
+    sum += buckets_[b];
+    snprintf(buf, sizeof(buf), "[ %9.0f, %9.0f ) %7llu %7.3f%% %7.3f%% ",
+             (b == 0) ? 0.0 : limits[b - 1], limits[b],
+             static_cast<unsigned long long>(buckets_[b]), mult * buckets_[b],
+             mult * sum);
+    r.append(buf);
+    // 每个#表示5%
+    r.append(static_cast<size_t>(20.0 * buckets_[b] / count_ + 0.5), '#');
+    r.push_back('\n');
+  }
+  return r;
+}
+}  // namespace corekv
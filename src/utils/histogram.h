@@ -0,0 +1,44 @@
+#ifndef UTILS_HISTOGRAM_H_
+#define UTILS_HISTOGRAM_H_
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace corekv {
+/*
+ * 按照指数增长的桶统计数值的分布(一般是微秒级的延迟)，百分位数在桶内线性插值，
+ * 相对误差不超过桶宽度的比例(约10%)
+ *
+ * 不是线程安全的，多线程统计的时候每个线程各用一个，最后Merge到一起
+ */
+class Histogram final {
+ public:
+  Histogram();
+
+  void Clear();
+  void Add(double value);
+  void Merge(const Histogram& other);
+
+  uint64_t Count() const { return count_; }
+  double Min() const { return count_ == 0 ? 0 : min_; }
+  double Max() const { return max_; }
+  double Sum() const { return sum_; }
+  double Average() const;
+  double StandardDeviation() const;
+  // p取值[0, 100]
+  double Percentile(double p) const;
+  double Median() const { return Percentile(50); }
+  // 多行的文本，包括统计值和每个非空桶的分布
+  std::string ToString() const;
+
+ private:
+  double min_;
+  double max_;
+  uint64_t count_;
+  double sum_;
+  double sum_squares_;
+  std::vector<uint64_t> buckets_;
+};
+}  // namespace corekv
+#endif
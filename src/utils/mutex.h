@@ -61,4 +61,28 @@ class SpinLock final {
 #endif
 };
 
+// 读写锁，Lock/UnLock为写锁，可以直接用于ScopedLockImpl
+class RWLock final {
+ public:
+  RWLock() { pthread_rwlock_init(&rw_lock_, NULL); }
+  ~RWLock() { pthread_rwlock_destroy(&rw_lock_); }
+  void Lock() { pthread_rwlock_wrlock(&rw_lock_); }
+  void UnLock() { pthread_rwlock_unlock(&rw_lock_); }
+  void ReadLock() { pthread_rwlock_rdlock(&rw_lock_); }
+  void ReadUnLock() { pthread_rwlock_unlock(&rw_lock_); }
+
+ private:
+  pthread_rwlock_t rw_lock_;
+};
+
+template <class T>
+struct ScopedReadLockImpl {
+ public:
+  ScopedReadLockImpl(T& mutex) : mutex_(mutex) { mutex_.ReadLock(); }
+  ~ScopedReadLockImpl() { mutex_.ReadUnLock(); }
+
+ private:
+  T& mutex_;
+};
+
 }  // namespace corekv
@@ -0,0 +1,42 @@
+#include "perf_context.h"
+
+#include <utility>
+
+namespace corekv {
+thread_local PerfLevel perf_level = PerfLevel::kDisable;
+thread_local PerfContext perf_context;
+
+std::string PerfContext::ToString(bool exclude_zero) const {
+  const std::pair<const char*, uint64_t> metrics[] = {
+      {"get_from_memtable_time", get_from_memtable_time},
+      {"get_from_memtable_count", get_from_memtable_count},
+      {"get_from_output_files_time", get_from_output_files_time},
+      {"filter_check_time", filter_check_time},
+      {"bloom_sst_miss_count", bloom_sst_miss_count},
+      {"bloom_sst_hit_count", bloom_sst_hit_count},
+      {"index_seek_time", index_seek_time},
+      {"block_hash_index_lookup_count", block_hash_index_lookup_count},
+      {"block_cache_lookup_time", block_cache_lookup_time},
+      {"block_cache_hit_count", block_cache_hit_count},
+      {"block_cache_miss_count", block_cache_miss_count},
+      {"block_read_time", block_read_time},
+      {"block_read_count", block_read_count},
+      {"block_read_byte", block_read_byte},
+      {"block_checksum_time", block_checksum_time},
+      {"block_decompress_time", block_decompress_time},
+      {"write_wal_time", write_wal_time},
+      {"write_memtable_time", write_memtable_time},
+  };
+  std::string result;
+  for (const auto& [name, value] : metrics) {
+    if (exclude_zero && value == 0) {
+      continue;
+    }
+    if (!result.empty()) {
+      result.append(", ");
+    }
+    result.append(name).append(" = ").append(std::to_string(value));
+  }
+  return result;
+}
+}  // namespace corekv
@@ -0,0 +1,97 @@
+#ifndef UTILS_PERF_CONTEXT_H_
+#define UTILS_PERF_CONTEXT_H_
+#include <stdint.h>
+
+#include <chrono>
+#include <string>
+
+namespace corekv {
+// kEnableCount只统计次数和字节数，kEnableTime还会在每个阶段前后读取时钟
+enum class PerfLevel { kDisable = 0, kEnableCount, kEnableTime };
+
+/*
+ * 当前线程上一次操作的耗时分解，用来回答"这一次Get慢在哪里":
+ *   SetPerfLevel(PerfLevel::kEnableTime);
+ *   GetPerfContext()->Reset();
+ *   db->Get(...);
+ *   GetPerfContext()->ToString(true);
+ * 每个线程各自一份，不需要同步；默认kDisable，没有打开的时候只多一次thread_local读取
+ * 时间的单位都是纳秒
+ */
+struct PerfContext {
+  void Reset() { *this = PerfContext(); }
+  // exclude_zero为true时不输出为0的项
+  std::string ToString(bool exclude_zero = false) const;
+
+  // 在memtable和immutable memtable中查找
+  uint64_t get_from_memtable_time = 0;
+  uint64_t get_from_memtable_count = 0;
+  // 在sst中查找的总耗时，包括下面所有sst相关的阶段
+  uint64_t get_from_output_files_time = 0;
+  // 布隆过滤器的检查，以及判断key不存在的次数
+  uint64_t filter_check_time = 0;
+  uint64_t bloom_sst_miss_count = 0;
+  uint64_t bloom_sst_hit_count = 0;
+  // 打开index并Seek到key所在的data block
+  uint64_t index_seek_time = 0;
+  // 通过data block的hash索引定位key的次数，冲突退回二分查找的不算
+  uint64_t block_hash_index_lookup_count = 0;
+  // block cache的查找(Get)，包括分片锁的等待
+  uint64_t block_cache_lookup_time = 0;
+  uint64_t block_cache_hit_count = 0;
+  uint64_t block_cache_miss_count = 0;
+  // 从文件中读取block
+  uint64_t block_read_time = 0;
+  uint64_t block_read_count = 0;
+  uint64_t block_read_byte = 0;
+  // block的crc校验和解压
+  uint64_t block_checksum_time = 0;
+  uint64_t block_decompress_time = 0;
+  // 写WAL(包括等待组提交)和写memtable
+  uint64_t write_wal_time = 0;
+  uint64_t write_memtable_time = 0;
+};
+
+extern thread_local PerfLevel perf_level;
+extern thread_local PerfContext perf_context;
+
+inline void SetPerfLevel(PerfLevel level) { perf_level = level; }
+inline PerfLevel GetPerfLevel() { return perf_level; }
+inline PerfContext* GetPerfContext() { return &perf_context; }
+
+// 计数类的指标，PerfLevel不低于kEnableCount时累加
+inline void PerfCounterAdd(uint64_t PerfContext::*metric, uint64_t value = 1) {
+  if (perf_level >= PerfLevel::kEnableCount) {
+    perf_context.*metric += value;
+  }
+}
+
+// 作用域内的耗时累加到metric中，PerfLevel低于kEnableTime的时候不读取时钟
+class PerfTimer final {
+ public:
+  explicit PerfTimer(uint64_t PerfContext::*metric)
+      : metric_(perf_level >= PerfLevel::kEnableTime ? metric : nullptr) {
+    if (metric_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  PerfTimer(const PerfTimer&) = delete;
+  PerfTimer& operator=(const PerfTimer&) = delete;
+  ~PerfTimer() { Stop(); }
+  // 提前结束计时，之后析构的时候不再累加
+  void Stop() {
+    if (metric_ != nullptr) {
+      perf_context.*metric_ +=
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start_)
+              .count();
+      metric_ = nullptr;
+    }
+  }
+
+ private:
+  uint64_t PerfContext::*metric_;
+  std::chrono::steady_clock::time_point start_;
+};
+}  // namespace corekv
+#endif
@@ -4,16 +4,25 @@
 
 #include <cstdint>
 namespace corekv {
+// xorshift64*，状态只有一个uint64，不加锁也不共享全局状态，
+// 同一个seed生成的序列是确定的；不是线程安全的，每个使用者持有自己的对象
 class RandomUtil final {
   public:
-    RandomUtil() = default;
+    static constexpr uint64_t kDefaultSeed = 0xdeadbeef;
+    RandomUtil() : RandomUtil(kDefaultSeed) {}
     ~RandomUtil() = default;
-    RandomUtil(uint32_t seed) : seed_val_(seed) {}
-    int64_t GetSimpleRandomNum() { return rand(); }
+    explicit RandomUtil(uint64_t seed) : state_(seed != 0 ? seed : kDefaultSeed) {}
+    int64_t GetSimpleRandomNum() {
+      state_ ^= state_ >> 12;
+      state_ ^= state_ << 25;
+      state_ ^= state_ >> 27;
+      // 只返回高31位，和rand()的取值范围一致
+      return static_cast<int64_t>((state_ * 0x2545F4914F6CDD1DULL) >> 33);
+    }
 
   private:
-    uint32_t seed_val_;
+    uint64_t state_;
 };
 }  // namespace corekv
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,101 @@
+#include "rate_limiter.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace corekv {
+RateLimiter::RateLimiter(int64_t bytes_per_second, int64_t refill_period_us,
+                         bool auto_tuned, int64_t foreground_latency_target_us)
+    : refill_period_us_(std::max<int64_t>(refill_period_us, 1)),
+      auto_tuned_(auto_tuned),
+      latency_target_us_(foreground_latency_target_us),
+      max_bytes_per_second_(std::max<int64_t>(bytes_per_second, 1)),
+      bytes_per_second_(max_bytes_per_second_) {
+  last_refill_us_ = last_tune_us_ = NowMicros();
+}
+
+int64_t RateLimiter::NowMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void RateLimiter::Refill(int64_t now_us) {
+  const double burst =
+      static_cast<double>(bytes_per_second_) * refill_period_us_ / 1000000;
+  available_ = std::min(
+      burst, available_ + static_cast<double>(now_us - last_refill_us_) *
+                              bytes_per_second_ / 1000000);
+  last_refill_us_ = now_us;
+  if (auto_tuned_ && now_us - last_tune_us_ >= kTunePeriods * refill_period_us_) {
+    Tune(now_us);
+  }
+}
+
+void RateLimiter::Tune(int64_t now_us) {
+  last_tune_us_ = now_us;
+  const uint64_t count = latency_count_.exchange(0, std::memory_order_relaxed);
+  const uint64_t sum = latency_sum_us_.exchange(0, std::memory_order_relaxed);
+  const int64_t min_rate = std::max<int64_t>(max_bytes_per_second_ / 20, 1);
+  if (latency_target_us_ > 0 && count > 0 &&
+      sum / count > static_cast<uint64_t>(latency_target_us_)) {
+    bytes_per_second_ = std::max(min_rate, bytes_per_second_ * 4 / 5);
+  } else if (throttled_) {
+    bytes_per_second_ = std::min(max_bytes_per_second_,
+                                 std::max(bytes_per_second_ * 11 / 10,
+                                          bytes_per_second_ + 1));
+  }
+  throttled_ = false;
+}
+
+void RateLimiter::Request(int64_t bytes, IOPriority pri) {
+  const int32_t p = static_cast<int32_t>(pri);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (bytes > 0) {
+    // 桶的容量可能因为调整而变化，每一块都重新计算
+    const int64_t burst = std::max<int64_t>(
+        bytes_per_second_ * refill_period_us_ / 1000000, 1);
+    const int64_t chunk = std::min(bytes, burst);
+    ++waiting_[p];
+    while (true) {
+      Refill(NowMicros());
+      const bool yield = pri == IOPriority::kLow &&
+                         waiting_[static_cast<int32_t>(IOPriority::kHigh)] > 0;
+      if (!yield && available_ >= chunk) {
+        break;
+      }
+      throttled_ = true;
+      // 等到令牌足够的时候再检查，高优先级拿完令牌之后会唤醒所有等待的请求
+      const double need = std::max(chunk - available_, 1.0);
+      const int64_t wait_us = std::min<int64_t>(
+          refill_period_us_,
+          static_cast<int64_t>(need * 1000000 / bytes_per_second_) + 1);
+      cv_.wait_for(lock, std::chrono::microseconds(wait_us));
+    }
+    --waiting_[p];
+    available_ -= chunk;
+    total_bytes_[p] += chunk;
+    bytes -= chunk;
+    if (pri == IOPriority::kHigh) {
+      cv_.notify_all();
+    }
+  }
+}
+
+void RateLimiter::SetBytesPerSecond(int64_t bytes_per_second) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_bytes_per_second_ = bytes_per_second_ =
+      std::max<int64_t>(bytes_per_second, 1);
+  cv_.notify_all();
+}
+
+int64_t RateLimiter::GetBytesPerSecond() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_per_second_;
+}
+
+int64_t RateLimiter::GetTotalBytesThrough(IOPriority pri) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return total_bytes_[static_cast<int32_t>(pri)];
+}
+}  // namespace corekv
@@ -0,0 +1,96 @@
+#pragma once
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace corekv {
+// flush阻塞的是memtable的切换，优先级比compaction高
+enum class IOPriority { kLow = 0, kHigh = 1, kTotal = 2 };
+
+/*
+ * 令牌桶限速，所有后台写入共用一个，每次写文件之前申请对应字节数的令牌
+ * 令牌按照bytes_per_second连续补充，桶的容量是一个refill_period的量，
+ * 单次申请超过桶容量的时候拆成多次；有高优先级的请求在等待时低优先级的请求让路
+ *
+ * auto_tuned为true时每10个refill_period根据前台读的平均延迟调整一次速率:
+ * 超过foreground_latency_target_us说明后台io影响了前台，速率降低到80%，
+ * 否则如果这段时间内有请求因为限速等待过，速率提高10%，
+ * 速率在[bytes_per_second / 20, bytes_per_second]之间变化
+ */
+class RateLimiter final {
+ public:
+  RateLimiter(int64_t bytes_per_second, int64_t refill_period_us = 100 * 1000,
+              bool auto_tuned = false, int64_t foreground_latency_target_us = 0);
+  RateLimiter(const RateLimiter&) = delete;
+  RateLimiter& operator=(const RateLimiter&) = delete;
+
+  // 阻塞直到拿到bytes个令牌
+  void Request(int64_t bytes, IOPriority pri);
+  // 修改速率上限，自动调整的时候也作为调整的上限
+  void SetBytesPerSecond(int64_t bytes_per_second);
+  int64_t GetBytesPerSecond() const;
+  int64_t GetTotalBytesThrough(IOPriority pri) const;
+  bool IsAutoTuned() const { return auto_tuned_; }
+  // 前台读完成之后调用，只在auto_tuned的时候使用
+  void RecordForegroundLatency(uint64_t micros) {
+    latency_sum_us_.fetch_add(micros, std::memory_order_relaxed);
+    latency_count_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+ private:
+  // 需要持有mutex_
+  void Refill(int64_t now_us);
+  void Tune(int64_t now_us);
+  static int64_t NowMicros();
+
+ private:
+  static constexpr int32_t kTunePeriods = 10;
+  const int64_t refill_period_us_;
+  const bool auto_tuned_;
+  const int64_t latency_target_us_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  // 设置的上限和当前实际使用的速率
+  int64_t max_bytes_per_second_;
+  int64_t bytes_per_second_;
+  // 桶中剩余的令牌，可以是小数
+  double available_ = 0;
+  int64_t last_refill_us_;
+  int64_t last_tune_us_;
+  // 上次调整之后是否有请求因为令牌不够等待过
+  bool throttled_ = false;
+  int32_t waiting_[static_cast<int32_t>(IOPriority::kTotal)] = {0, 0};
+  int64_t total_bytes_[static_cast<int32_t>(IOPriority::kTotal)] = {0, 0};
+  std::atomic<uint64_t> latency_sum_us_{0};
+  std::atomic<uint64_t> latency_count_{0};
+};
+
+// 作用域内的耗时作为一次前台读的延迟记录到限速器中，
+// 限速器为nullptr或者不自动调整的时候不读取时钟
+class ForegroundReadTimer final {
+ public:
+  explicit ForegroundReadTimer(RateLimiter* rate_limiter)
+      : rate_limiter_(rate_limiter != nullptr && rate_limiter->IsAutoTuned()
+                          ? rate_limiter
+                          : nullptr) {
+    if (rate_limiter_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  ~ForegroundReadTimer() {
+    if (rate_limiter_ != nullptr) {
+      rate_limiter_->RecordForegroundLatency(
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - start_)
+              .count());
+    }
+  }
+
+ private:
+  RateLimiter* const rate_limiter_;
+  std::chrono::steady_clock::time_point start_;
+};
+}  // namespace corekv
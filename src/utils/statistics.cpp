@@ -0,0 +1,132 @@
+#include "statistics.h"
+
+#include <sched.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+namespace corekv {
+namespace {
+const char* const kTickerNames[kTickerMax] = {
+    "corekv.block.cache.data.hit",
+    "corekv.block.cache.data.miss",
+    "corekv.block.cache.index.hit",
+    "corekv.block.cache.index.miss",
+    "corekv.block.cache.filter.hit",
+    "corekv.block.cache.filter.miss",
+    "corekv.row.cache.hit",
+    "corekv.row.cache.miss",
+    "corekv.secondary.cache.hit",
+    "corekv.secondary.cache.miss",
+    "corekv.bloom.filter.useful",
+    "corekv.bloom.filter.positive",
+    "corekv.number.keys.written",
+    "corekv.number.keys.read",
+    "corekv.number.keys.found",
+    "corekv.bytes.written",
+    "corekv.bytes.read",
+    "corekv.number.db.seek",
+    "corekv.async.read.offloaded",
+    "corekv.wal.bytes",
+    "corekv.wal.synced",
+    "corekv.flush.write.bytes",
+    "corekv.compact.read.bytes",
+    "corekv.compact.write.bytes",
+    "corekv.stall.micros",
+};
+
+const char* const kHistogramNames[kHistogramMax] = {
+    "corekv.db.get.micros",
+    "corekv.db.multiget.micros",
+    "corekv.db.write.micros",
+    "corekv.db.seek.micros",
+    "corekv.flush.micros",
+    "corekv.compaction.micros",
+};
+}  // namespace
+
+Statistics::Statistics()
+    : num_cores_(std::max(1u, std::thread::hardware_concurrency())),
+      tickers_(new CoreTickers[num_cores_]),
+      histograms_(new CoreHistograms[num_cores_]) {
+  Reset();
+}
+
+Statistics::~Statistics() = default;
+
+uint32_t Statistics::CurrentCore() const {
+  const int cpu = sched_getcpu();
+  if (cpu >= 0) {
+    return static_cast<uint32_t>(cpu) % num_cores_;
+  }
+  // 拿不到cpu编号的时候按照线程分散
+  return std::hash<std::thread::id>()(std::this_thread::get_id()) % num_cores_;
+}
+
+void Statistics::MeasureTime(Histograms histogram, double micros) {
+  CoreHistograms& core = histograms_[CurrentCore()];
+  std::lock_guard<std::mutex> lock(core.mutex);
+  core.values[histogram].Add(micros);
+}
+
+uint64_t Statistics::GetTickerCount(Tickers ticker) const {
+  uint64_t sum = 0;
+  for (uint32_t i = 0; i < num_cores_; ++i) {
+    sum += tickers_[i].values[ticker].load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+void Statistics::GetHistogram(Histograms histogram, Histogram* result) const {
+  result->Clear();
+  for (uint32_t i = 0; i < num_cores_; ++i) {
+    std::lock_guard<std::mutex> lock(histograms_[i].mutex);
+    result->Merge(histograms_[i].values[histogram]);
+  }
+}
+
+void Statistics::Reset() {
+  for (uint32_t i = 0; i < num_cores_; ++i) {
+    for (auto& value : tickers_[i].values) {
+      value.store(0, std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> lock(histograms_[i].mutex);
+    for (auto& value : histograms_[i].values) {
+      value.Clear();
+    }
+  }
+}
+
+std::string Statistics::ToString() const {
+  std::string result;
+  char buf[256];
+  for (uint32_t t = 0; t < kTickerMax; ++t) {
+    snprintf(buf, sizeof(buf), "%s COUNT : %llu\n", kTickerNames[t],
+             static_cast<unsigned long long>(
+                 GetTickerCount(static_cast<Tickers>(t))));
+    result.append(buf);
+  }
+  Histogram hist;
+  for (uint32_t h = 0; h < kHistogramMax; ++h) {
+    GetHistogram(static_cast<Histograms>(h), &hist);
+    snprintf(buf, sizeof(buf),
+             "%s P50 : %.2f P95 : %.2f P99 : %.2f P99.9 : %.2f MAX : %.2f "
+             "COUNT : %llu SUM : %.0f\n",
+             kHistogramNames[h], hist.Percentile(50), hist.Percentile(95),
+             hist.Percentile(99), hist.Percentile(99.9), hist.Max(),
+             static_cast<unsigned long long>(hist.Count()), hist.Sum());
+    result.append(buf);
+  }
+  return result;
+}
+
+const char* Statistics::TickerName(Tickers ticker) {
+  return ticker < kTickerMax ? kTickerNames[ticker] : "";
+}
+
+const char* Statistics::HistogramName(Histograms histogram) {
+  return histogram < kHistogramMax ? kHistogramNames[histogram] : "";
+}
+}  // namespace corekv
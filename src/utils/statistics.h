@@ -0,0 +1,147 @@
+#ifndef UTILS_STATISTICS_H_
+#define UTILS_STATISTICS_H_
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "histogram.h"
+
+namespace corekv {
+// 计数器，名字见Statistics::TickerName
+enum Tickers : uint32_t {
+  // block cache按照block类型分别统计命中和未命中
+  kBlockCacheDataHit = 0,
+  kBlockCacheDataMiss,
+  kBlockCacheIndexHit,
+  kBlockCacheIndexMiss,
+  kBlockCacheFilterHit,
+  kBlockCacheFilterMiss,
+  // 点查在row cache中命中和未命中的次数，每个查找的sst统计一次
+  kRowCacheHit,
+  kRowCacheMiss,
+  // block_cache未命中之后在secondary cache中命中和未命中的次数
+  kSecondaryCacheHit,
+  kSecondaryCacheMiss,
+  // 布隆过滤器判断key不存在，省掉了一次data block的读取
+  kBloomFilterUseful,
+  // 布隆过滤器判断key可能存在
+  kBloomFilterPositive,
+  // 用户写入和读到的key个数以及key + value的字节数
+  kNumberKeysWritten,
+  kNumberKeysRead,
+  kNumberKeysFound,
+  kBytesWritten,
+  kBytesRead,
+  kNumberDbSeek,
+  // AsyncGet/AsyncMultiGet在内存中得不到结果，交给读线程池读文件的次数
+  kAsyncReadOffloaded,
+  // 写入WAL的字节数和实际执行的fsync次数
+  kWalFileBytes,
+  kWalFileSynced,
+  // flush生成的sst字节数，compaction读取的输入和写出的输出字节数
+  kFlushWriteBytes,
+  kCompactReadBytes,
+  kCompactWriteBytes,
+  // compaction跟不上导致写入被限速或者停止的总时间(微秒)
+  kStallMicros,
+  kTickerMax
+};
+
+// 延迟分布(微秒)，名字见Statistics::HistogramName
+enum Histograms : uint32_t {
+  kDbGet = 0,
+  kDbMultiGet,
+  kDbWrite,
+  kDbSeek,
+  kFlushTime,
+  kCompactionTime,
+  kHistogramMax
+};
+
+/*
+ * 整个引擎的统计信息，通过Options::statistics设置，多个db可以共享同一个对象
+ *
+ * 计数器按照cpu分成多份，每份独占cache line，RecordTick只是对当前cpu那一份的
+ * relaxed fetch_add，不同核之间没有竞争；histogram同样按cpu分开，每份带一把锁，
+ * 只有同一个核上的线程会竞争；读取的时候把所有份加起来，不保证是同一时刻的快照
+ */
+class Statistics final {
+ public:
+  Statistics();
+  Statistics(const Statistics&) = delete;
+  Statistics& operator=(const Statistics&) = delete;
+  ~Statistics();
+
+  void RecordTick(Tickers ticker, uint64_t count = 1) {
+    Slot(ticker).fetch_add(count, std::memory_order_relaxed);
+  }
+  void MeasureTime(Histograms histogram, double micros);
+
+  uint64_t GetTickerCount(Tickers ticker) const;
+  // 所有cpu上的分布合并之后的结果
+  void GetHistogram(Histograms histogram, Histogram* result) const;
+  void Reset();
+  // 每个计数器一行，每个histogram一行(P50/P95/P99/P99.9/max)
+  std::string ToString() const;
+
+  static const char* TickerName(Tickers ticker);
+  static const char* HistogramName(Histograms histogram);
+
+ private:
+  struct alignas(64) CoreTickers {
+    std::atomic<uint64_t> values[kTickerMax];
+  };
+  struct alignas(64) CoreHistograms {
+    std::mutex mutex;
+    Histogram values[kHistogramMax];
+  };
+
+  uint32_t CurrentCore() const;
+  std::atomic<uint64_t>& Slot(Tickers ticker) {
+    return tickers_[CurrentCore()].values[ticker];
+  }
+
+  const uint32_t num_cores_;
+  std::unique_ptr<CoreTickers[]> tickers_;
+  std::unique_ptr<CoreHistograms[]> histograms_;
+};
+
+// statistics为nullptr的时候什么都不做
+inline void RecordTick(Statistics* statistics, Tickers ticker,
+                       uint64_t count = 1) {
+  if (statistics != nullptr) {
+    statistics->RecordTick(ticker, count);
+  }
+}
+
+// 作用域内的耗时记录到histogram中，statistics为nullptr的时候不读取时钟
+class StopWatch final {
+ public:
+  StopWatch(Statistics* statistics, Histograms histogram)
+      : statistics_(statistics), histogram_(histogram) {
+    if (statistics_ != nullptr) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  StopWatch(const StopWatch&) = delete;
+  StopWatch& operator=(const StopWatch&) = delete;
+  ~StopWatch() {
+    if (statistics_ != nullptr) {
+      statistics_->MeasureTime(
+          histogram_, std::chrono::duration<double, std::micro>(
+                          std::chrono::steady_clock::now() - start_)
+                          .count());
+    }
+  }
+
+ private:
+  Statistics* const statistics_;
+  const Histograms histogram_;
+  std::chrono::steady_clock::time_point start_;
+};
+}  // namespace corekv
+#endif
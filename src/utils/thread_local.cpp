@@ -0,0 +1,144 @@
+#include "thread_local.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+
+namespace corekv {
+namespace {
+struct ThreadData;
+
+// 所有线程的数据和已经分配的id，都由mutex保护
+struct Registry {
+  std::mutex mutex;
+  std::set<ThreadData*> threads;
+  // 下标是id，释放之后的id放进free_ids重新使用
+  std::vector<ThreadLocalPtr::UnrefHandler> handlers;
+  std::vector<uint32_t> free_ids;
+};
+
+// 进程退出的时候其他线程可能还在运行，不析构
+Registry& GetRegistry() {
+  static Registry* registry = new Registry;
+  return *registry;
+}
+
+// 一个线程中所有ThreadLocalPtr的值，下标是ThreadLocalPtr的id；
+// 只有所属的线程会扩容，扩容和其他线程的Scrape都持有Registry的锁
+struct ThreadData {
+  std::unique_ptr<std::atomic<void*>[]> entries;
+  uint32_t size = 0;
+
+  ThreadData() {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.threads.insert(this);
+  }
+  ~ThreadData() {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.threads.erase(this);
+    for (uint32_t id = 0; id < size; ++id) {
+      void* ptr = entries[id].exchange(nullptr, std::memory_order_acq_rel);
+      if (ptr != nullptr && registry.handlers[id] != nullptr) {
+        registry.handlers[id](ptr);
+      }
+    }
+  }
+
+  std::atomic<void*>* Entry(uint32_t id) {
+    if (id >= size) {
+      Registry& registry = GetRegistry();
+      std::lock_guard<std::mutex> lock(registry.mutex);
+      const uint32_t new_size =
+          std::max<uint32_t>(id + 1, registry.handlers.size());
+      auto new_entries = std::make_unique<std::atomic<void*>[]>(new_size);
+      for (uint32_t i = 0; i < new_size; ++i) {
+        new_entries[i].store(
+            i < size ? entries[i].load(std::memory_order_relaxed) : nullptr,
+            std::memory_order_relaxed);
+      }
+      entries = std::move(new_entries);
+      size = new_size;
+    }
+    return &entries[id];
+  }
+};
+
+ThreadData* GetThreadData() {
+  thread_local ThreadData data;
+  return &data;
+}
+
+uint32_t AllocateId(ThreadLocalPtr::UnrefHandler handler) {
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  if (!registry.free_ids.empty()) {
+    const uint32_t id = registry.free_ids.back();
+    registry.free_ids.pop_back();
+    registry.handlers[id] = handler;
+    return id;
+  }
+  registry.handlers.push_back(handler);
+  return registry.handlers.size() - 1;
+}
+}  // namespace
+
+ThreadLocalPtr::ThreadLocalPtr(UnrefHandler handler)
+    : id_(AllocateId(handler)) {}
+
+ThreadLocalPtr::~ThreadLocalPtr() {
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  // id重新分配之前清空所有线程中的值
+  for (ThreadData* data : registry.threads) {
+    if (id_ >= data->size) {
+      continue;
+    }
+    void* ptr = data->entries[id_].exchange(nullptr, std::memory_order_acq_rel);
+    if (ptr != nullptr && registry.handlers[id_] != nullptr) {
+      registry.handlers[id_](ptr);
+    }
+  }
+  registry.handlers[id_] = nullptr;
+  registry.free_ids.push_back(id_);
+}
+
+void* ThreadLocalPtr::Get() const {
+  ThreadData* data = GetThreadData();
+  if (id_ >= data->size) {
+    return nullptr;
+  }
+  return data->entries[id_].load(std::memory_order_acquire);
+}
+
+void ThreadLocalPtr::Reset(void* ptr) {
+  GetThreadData()->Entry(id_)->store(ptr, std::memory_order_release);
+}
+
+void* ThreadLocalPtr::Swap(void* ptr) {
+  return GetThreadData()->Entry(id_)->exchange(ptr, std::memory_order_acq_rel);
+}
+
+bool ThreadLocalPtr::CompareAndSwap(void* ptr, void*& expected) {
+  return GetThreadData()->Entry(id_)->compare_exchange_strong(
+      expected, ptr, std::memory_order_acq_rel, std::memory_order_acquire);
+}
+
+void ThreadLocalPtr::Scrape(std::vector<void*>* ptrs, void* replacement) {
+  Registry& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  for (ThreadData* data : registry.threads) {
+    if (id_ >= data->size) {
+      continue;
+    }
+    void* ptr =
+        data->entries[id_].exchange(replacement, std::memory_order_acq_rel);
+    if (ptr != nullptr) {
+      ptrs->push_back(ptr);
+    }
+  }
+}
+}  // namespace corekv
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+
+#include <vector>
+
+namespace corekv {
+/*
+ * 每个线程各自保存一个指针，和thread_local变量不同的是可以作为普通对象的成员，
+ * 并且其他线程可以通过Scrape一次性收回所有线程中保存的值
+ *
+ * 线程退出或者ThreadLocalPtr析构的时候，仍然不为nullptr的值交给handler释放；
+ * handler在全局锁中调用，不能再访问任何ThreadLocalPtr
+ */
+class ThreadLocalPtr final {
+ public:
+  using UnrefHandler = void (*)(void* ptr);
+
+  explicit ThreadLocalPtr(UnrefHandler handler = nullptr);
+  ThreadLocalPtr(const ThreadLocalPtr&) = delete;
+  ThreadLocalPtr& operator=(const ThreadLocalPtr&) = delete;
+  ~ThreadLocalPtr();
+
+  // 以下函数只访问当前线程的值，没有竞争
+  void* Get() const;
+  void Reset(void* ptr);
+  // 替换成ptr并返回原来的值
+  void* Swap(void* ptr);
+  // 当前值等于expected时替换成ptr并返回true，否则把当前值写到expected中返回false
+  bool CompareAndSwap(void* ptr, void*& expected);
+
+  // 把所有线程中不为nullptr的值追加到ptrs中，并替换成replacement
+  void Scrape(std::vector<void*>* ptrs, void* replacement);
+
+ private:
+  const uint32_t id_;
+};
+}  // namespace corekv
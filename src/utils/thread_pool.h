@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace corekv {
+// 固定线程数的线程池，任务按照提交的顺序执行
+class ThreadPool final {
+ public:
+  explicit ThreadPool(int32_t thread_num);
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  // 等待已经提交的任务执行完之后再退出
+  ~ThreadPool();
+
+  void Schedule(std::function<void()> task);
+  int32_t ThreadNum() const { return threads_.size(); }
+
+ private:
+  void WorkerLoop();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> tasks_;
+  bool stop_ = false;
+  std::vector<std::thread> threads_;
+};
+}  // namespace corekv